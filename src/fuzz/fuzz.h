@@ -0,0 +1,33 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _FUZZ_FUZZ_H
+#define _FUZZ_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Each fuzz target defines these.  They are called by libFuzzer when
+ * built with --enable-fuzzers, and by replay.c otherwise.
+ * LLVMFuzzerTestOneInput() must not leak or keep state between calls,
+ * and must return 0.
+ */
+int LLVMFuzzerInitialize (int *argc, char ***argv);
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+/* Name of the target's corpus subdirectory, e.g. "kv".
+ */
+extern const char *fuzz_corpus;
+
+#endif /* !_FUZZ_FUZZ_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,102 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* fuzz_header.c - fuzz flux_sign_unwrap() and friends
+ *
+ * Input is treated as a J string (HEADER.PAYLOAD.SIGNATURE).  The context
+ * is configured once with only the "none" mechanism allowed, so decoding
+ * of the header kv, base64, and mechanism lookup are all reached, but
+ * anything other than "none" is only decoded with FLUX_SIGN_NOVERIFY
+ * through flux_sign_unwrap_anymech().
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "src/lib/context.h"
+#include "src/lib/sign.h"
+
+#include "fuzz.h"
+
+const char *fuzz_corpus = "header";
+
+static const char *conf = \
+"[sign]\n" \
+"max-ttl = 30\n" \
+"default-type = \"none\"\n" \
+"allowed-types = [ \"none\" ]\n";
+
+static flux_security_t *ctx;
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+    const char *tmpdir = getenv ("TMPDIR");
+    char path[1024];
+    int fd;
+
+    snprintf (path, sizeof (path), "%s/fuzz-header-XXXXXX.toml",
+              tmpdir ? tmpdir : "/tmp");
+    if ((fd = mkstemps (path, 5)) < 0
+        || write (fd, conf, strlen (conf)) < 0
+        || close (fd) < 0) {
+        fprintf (stderr, "%s: %s\n", path, strerror (errno));
+        exit (1);
+    }
+    if (!(ctx = flux_security_create (0))
+        || flux_security_configure (ctx, path) < 0) {
+        fprintf (stderr, "flux_security_configure: %s\n",
+                 ctx ? flux_security_last_error (ctx) : strerror (errno));
+        exit (1);
+    }
+    (void)unlink (path);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    char *input;
+    const void *payload;
+    int payloadsz;
+    const char *mech_type;
+    int64_t userid;
+
+    if (!(input = malloc (size + 1)))
+        return 0;
+    memcpy (input, data, size);
+    input[size] = '\0';
+
+    (void)flux_sign_unwrap (ctx, input, &payload, &payloadsz, &userid, 0);
+    (void)flux_sign_unwrap_header (ctx,
+                                   input,
+                                   &mech_type,
+                                   &userid,
+                                   &payloadsz,
+                                   FLUX_SIGN_NOVERIFY);
+    (void)flux_sign_unwrap_anymech (ctx,
+                                    input,
+                                    &payload,
+                                    &payloadsz,
+                                    &mech_type,
+                                    &userid,
+                                    FLUX_SIGN_NOVERIFY);
+    free (input);
+    return 0;
+}
+
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,99 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* fuzz_kv.c - fuzz kv_decode()
+ *
+ * A decoded kv is iterated, re-encoded, and split/joined, since the
+ * J header and certs both feed untrusted kv through those paths.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "src/libutil/kv.h"
+
+#include "fuzz.h"
+
+const char *fuzz_corpus = "kv";
+
+static void get_value (const struct kv *kv, const char *key,
+                       enum kv_type type)
+{
+    const char *s;
+    int64_t i;
+    double d;
+    bool b;
+    time_t t;
+
+    switch (type) {
+        case KV_STRING:
+            (void)kv_get (kv, key, type, &s);
+            break;
+        case KV_INT64:
+            (void)kv_get (kv, key, type, &i);
+            break;
+        case KV_DOUBLE:
+            (void)kv_get (kv, key, type, &d);
+            break;
+        case KV_BOOL:
+            (void)kv_get (kv, key, type, &b);
+            break;
+        case KV_TIMESTAMP:
+            (void)kv_get (kv, key, type, &t);
+            break;
+        default:
+            break;
+    }
+}
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    struct kv *kv;
+    struct kv *kv2;
+    struct kv *meta;
+    struct kv_iter it;
+    const char *buf;
+    int len;
+
+    if (!(kv = kv_decode ((const char *)data, size)))
+        return 0;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it))
+        get_value (kv, it.key, it.type);
+    if (kv_encode (kv, &buf, &len) == 0) {
+        if ((kv2 = kv_decode (buf, len))) {
+            if (!kv_equal (kv, kv2))
+                abort ();
+            kv_destroy (kv2);
+        }
+    }
+    if ((meta = kv_split (kv, "meta."))) {
+        if ((kv2 = kv_copy (kv))) {
+            (void)kv_join (kv2, meta, "meta.");
+            kv_destroy (kv2);
+        }
+        kv_destroy (meta);
+    }
+    kv_destroy (kv);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,57 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* fuzz_sigcert.c - fuzz sigcert_decode() and sigcert_decode_binary()
+ *
+ * A cert that decodes is re-encoded and decoded again, and must
+ * compare equal to the original.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+
+#include "src/libca/sigcert.h"
+
+#include "fuzz.h"
+
+const char *fuzz_corpus = "sigcert";
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    const char *buf;
+    int len;
+
+    if ((cert = sigcert_decode ((const char *)data, size))) {
+        if (sigcert_encode (cert, &buf, &len) == 0) {
+            if (!(cert2 = sigcert_decode (buf, len))
+                || !sigcert_equal (cert, cert2))
+                abort ();
+            sigcert_destroy (cert2);
+        }
+        sigcert_destroy (cert);
+    }
+    if ((cert = sigcert_decode_binary (data, size)))
+        sigcert_destroy (cert);
+    return 0;
+}
+
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
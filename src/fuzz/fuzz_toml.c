@@ -0,0 +1,62 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* fuzz_toml.c - fuzz the TOML parser and cf_update()
+ *
+ * Config files are trusted more than J strings, but the IMP parses
+ * them as root and they may be edited by hand, so a malformed file
+ * must fail cleanly.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/libtomlc99/toml.h"
+#include "src/libutil/cf.h"
+
+#include "fuzz.h"
+
+const char *fuzz_corpus = "toml";
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    char *conf;
+    char errbuf[200];
+    toml_table_t *tab;
+    struct cf_error e;
+    cf_t *cf;
+
+    if (!(conf = malloc (size + 1)))
+        return 0;
+    memcpy (conf, data, size);
+    conf[size] = '\0';
+    if ((tab = toml_parse (conf, errbuf, sizeof (errbuf))))
+        toml_free (tab);
+    free (conf);
+
+    if ((cf = cf_create ())) {
+        (void)cf_update (cf, (const char *)data, size, &e);
+        cf_destroy (cf);
+    }
+    return 0;
+}
+
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+#
+#  Generate the checked-in fuzz corpus in src/fuzz/corpus.
+#
+#  Realistic inputs mimic what flux_sign_wrap(), sigcert_encode(), and the
+#  IMP config produce.  Pathological inputs are large or adversarial
+#  (many keys, hash-colliding keys, duplicates, deep nesting) and are used
+#  by 'make check' to catch quadratic regressions and by 'make bench' to
+#  measure decode throughput.  Output is deterministic, so re-running this
+#  script should not change the tree unless the script itself changed.
+#
+#  Usage: gen-corpus.py [corpus-dir]
+#
+
+import base64
+import os
+import random
+import struct
+import sys
+
+rng = random.Random(42)
+
+UID = 1000
+CTIME = "2018-06-01T12:00:00Z"
+XTIME = "2018-06-01T12:00:30Z"
+
+
+def kv(*pairs):
+    """Encode (key, hint, value) tuples in text kv format."""
+    out = b""
+    for key, hint, val in pairs:
+        if isinstance(val, str):
+            val = val.encode()
+        out += key.encode() + b"\0" + hint.encode() + val + b"\0"
+    return out
+
+
+def b64(data):
+    return base64.b64encode(data).decode()
+
+
+def rand_bytes(n):
+    return bytes(rng.getrandbits(8) for _ in range(n))
+
+
+def jstr(header, payload, signature):
+    return (b64(header) + "." + b64(payload) + "." + signature).encode()
+
+
+def fnv1a64(data):
+    h = 0xCBF29CE484222325
+    for c in data:
+        h ^= c
+        h = (h * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def colliding_keys(count, bits):
+    """Keys whose 64-bit FNV-1a hash has the same low 'bits' bits.
+    These all landed in one probe run of the kv index before it switched
+    to a keyed hash, and still make a good worst case for the bench.
+    """
+    mask = (1 << bits) - 1
+    keys = []
+    i = 0
+    while len(keys) < count:
+        key = "k%x" % i
+        if fnv1a64(key.encode()) & mask == 0:
+            keys.append(key)
+        i += 1
+    return keys
+
+
+def cert_kv(prefix="", signed=True, nmeta=0):
+    pairs = [
+        (prefix + "meta.uuid", "s", "0d2cfa44-0f0b-4d0a-9a62-6e1bd8e0c2b1"),
+        (prefix + "meta.not-valid-before-time", "t", CTIME),
+        (prefix + "meta.ctime", "t", CTIME),
+        (prefix + "meta.xtime", "t", "2018-06-08T12:00:00Z"),
+        (prefix + "meta.userid", "i", str(UID)),
+        (prefix + "meta.max-sign-ttl", "i", "30"),
+        (prefix + "meta.issuer", "s", "5b0a7f2e-4a8e-4f1e-8d3b-2f8f0b9c1e77"),
+        (prefix + "meta.domain", "s", "EXAMPLE.TEST"),
+        (prefix + "meta.ca-capability", "b", "false"),
+    ]
+    for i in range(nmeta):
+        pairs.append((prefix + "meta.x%05d" % i, "i", str(i)))
+    pairs.append((prefix + "curve.public-key", "s", b64(rand_bytes(32))))
+    if signed:
+        pairs.append((prefix + "curve.signature", "s", b64(rand_bytes(64))))
+    return kv(*pairs)
+
+
+def none_header(userid=UID, mech="none", version="1"):
+    return kv(("version", "i", version),
+              ("mechanism", "s", mech),
+              ("userid", "i", str(userid)))
+
+
+def curve_header(with_cert=False):
+    hdr = none_header(mech="curve")
+    if with_cert:
+        hdr += cert_kv(prefix="curve.cert.")
+    else:
+        hdr += kv(("curve.fingerprint", "s", b64(rand_bytes(32))))
+    hdr += kv(("curve.ctime", "t", CTIME), ("curve.xtime", "t", XTIME))
+    return hdr
+
+
+def many_keys(n):
+    return kv(*[("key%05d" % i, "i", str(i)) for i in range(n)])
+
+
+def corpus(topdir):
+    files = {}
+
+    # kv
+    files["kv/header-none.kv"] = none_header()
+    files["kv/header-curve.kv"] = curve_header(with_cert=True)
+    files["kv/cert.kv"] = cert_kv()
+    files["kv/binary.kv"] = (
+        b"version\0I" + struct.pack(">q", 1) + b"\0"
+        + b"double\0D" + struct.pack(">d", 3.14) + b"\0"
+        + b"ctime\0T" + struct.pack(">q", 1527854400) + b"\0"
+        + b"mechanism\0scurve\0")
+    files["kv/truncated.kv"] = (
+        b"version\0i1\0mechanism\0snone\0userid\0i10"
+        + b"\0novalue\0\0short\0I\0\0\0")
+    files["kv/bad-types.kv"] = kv(("a", "x", "1"), ("b", "i", "12z"),
+                                  ("c", "b", "maybe"), ("d", "t", "never"),
+                                  ("e", "d", "1e99999"))
+    files["kv/many-keys.kv"] = many_keys(5000)
+    files["kv/collide.kv"] = kv(*[(k, "i", "1")
+                                  for k in colliding_keys(2000, 10)])
+    files["kv/duplicates.kv"] = kv(*[("meta.dup", "i", str(i))
+                                     for i in range(5000)])
+    files["kv/long-value.kv"] = kv(("long", "s", "x" * 65536))
+
+    # header (J strings)
+    files["header/none.j"] = jstr(none_header(), b"hello world", "none")
+    files["header/none-empty-payload.j"] = jstr(none_header(), b"", "none")
+    files["header/curve.j"] = jstr(curve_header(), b"hello world",
+                                   b64(rand_bytes(64)))
+    files["header/curve-cert.j"] = jstr(curve_header(with_cert=True),
+                                        rand_bytes(1024),
+                                        b64(rand_bytes(64)))
+    files["header/munge.j"] = jstr(none_header(mech="munge"), b"payload",
+                                   "MUNGE:" + b64(rand_bytes(96)) + ":")
+    files["header/big-payload.j"] = jstr(none_header(), rand_bytes(65536),
+                                         "none")
+    files["header/many-keys.j"] = jstr(none_header() + many_keys(5000),
+                                       b"x", "none")
+    files["header/collide.j"] = jstr(
+        none_header() + kv(*[(k, "s", "v") for k in colliding_keys(2000, 10)]),
+        b"x", "none")
+    files["header/duplicates.j"] = jstr(
+        kv(*[("userid", "i", str(i)) for i in range(5000)])
+        + none_header(), b"x", "none")
+    files["header/bad-version.j"] = jstr(none_header(version="99"),
+                                         b"x", "none")
+    files["header/bad-userid.j"] = jstr(none_header(userid=-1), b"x", "none")
+    files["header/long-mech.j"] = jstr(none_header(mech="m" * 10000),
+                                       b"x", "none")
+    files["header/bad-base64.j"] = b"dmVyc2lvbgBpMQ!!*.aGVsbG8.none"
+    files["header/unpadded.j"] = (
+        b64(none_header()).rstrip("=") + ".aGVsbG8.none").encode()
+    files["header/dots.j"] = b"." * 4096
+    files["header/empty-fields.j"] = b"..none"
+    files["header/long-signature.j"] = jstr(none_header(), b"x",
+                                            "none" * 4096)
+
+    # sigcert
+    files["sigcert/cert.kv"] = cert_kv()
+    files["sigcert/unsigned.kv"] = cert_kv(signed=False)
+    files["sigcert/many-meta.kv"] = cert_kv(nmeta=5000)
+    files["sigcert/bad-pubkey.kv"] = kv(("curve.public-key", "s",
+                                         b64(rand_bytes(31))))
+    files["sigcert/bad-base64.kv"] = kv(("curve.public-key", "s",
+                                         "!" * 44))
+    meta = cert_kv().split(b"curve.public-key")[0]
+    scb = (struct.pack(">II", 0x53434231, 1) + rand_bytes(32)
+           + rand_bytes(64) + struct.pack(">I", len(meta)) + meta)
+    files["sigcert/binary.scb"] = scb
+    files["sigcert/binary-truncated.scb"] = scb[:-10]
+    files["sigcert/binary-badlen.scb"] = (scb[:104] + struct.pack(">I", 1 << 31)
+                                          + meta)
+
+    # toml
+    files["toml/sign.toml"] = b"""\
+[sign]
+max-ttl = 1209600  # 2 weeks
+default-type = "curve"
+allowed-types = [ "munge", "curve" ]
+"""
+    files["toml/imp.toml"] = b"""\
+allow-sudo = true
+
+[exec]
+allowed-users = [ "flux" ]
+allowed-shells = [ "/usr/libexec/flux/flux-shell" ]
+pam-support = true
+
+[run.prolog]
+allowed-users = [ "flux" ]
+path = "/etc/flux/system/prolog"
+allowed-environment = [ "FLUX_*" ]
+"""
+    files["toml/ca.toml"] = b"""\
+[ca]
+max-cert-ttl = 604800
+max-sign-ttl = 30
+cert-path = "/etc/flux/ca/ca"
+revoke-dir = "/var/lib/flux/revoke.d"
+revoke-allow = true
+domain = "EXAMPLE.TEST"
+"""
+    files["toml/deep-array.toml"] = b"a = " + b"[" * 20000 + b"]" * 20000
+    files["toml/deep-inline.toml"] = (b"a = " + b"{b = " * 10000 + b"1"
+                                      + b"}" * 10000)
+    files["toml/deep-unterminated.toml"] = b"a = " + b"[" * 20000
+    files["toml/wide-table.toml"] = b"[t]\n" + b"".join(
+        b"key%05d = %d\n" % (i, i) for i in range(5000))
+    files["toml/wide-array.toml"] = (b"a = [ " + b", ".join(
+        b"%d" % i for i in range(10000)) + b" ]\n")
+    files["toml/many-tables.toml"] = b"".join(
+        b"[[a]]\nb = %d\n" % i for i in range(5000))
+    files["toml/long-string.toml"] = b'a = "' + b"x" * 65536 + b'"\n'
+    files["toml/bad-escapes.toml"] = (b'a = "\\u0000\\uD800\\U0011FFFF'
+                                      b'\\x41\\q"\n')
+
+    for name, data in sorted(files.items()):
+        path = os.path.join(topdir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "wb") as f:
+            f.write(data)
+        print(name)
+
+
+if __name__ == "__main__":
+    corpus(sys.argv[1] if len(sys.argv) > 1 else
+           os.path.join(os.path.dirname(os.path.abspath(__file__)), "corpus"))
@@ -0,0 +1,250 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* replay.c - run a fuzz target over its checked-in corpus
+ *
+ * Usage: test_TARGET.t [-b] [-n iterations] [-t seconds] [path ...]
+ *
+ * Each path is a corpus file or a directory of them.  With no paths,
+ * $FUZZ_CORPUS_DIR/TARGET is used (default: corpus/TARGET).
+ *
+ * By default each input is run once under TAP, and fails if it takes
+ * longer than 'seconds' (default 10) so that a regression to quadratic
+ * behavior on the large pathological inputs shows up in 'make check'.
+ *
+ * With -b, each input is instead run 'iterations' times (default 100)
+ * and reported as ops/sec, MB/s, and latency percentiles.
+ * Run with 'make bench', passing options with BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+#include "src/libtap/tap.h"
+
+#include "fuzz.h"
+
+struct input {
+    char *path;
+    uint8_t *data;
+    size_t size;
+};
+
+static const char *prog;
+
+static struct input *inputs;
+static int ninputs;
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr,
+             "Usage: %s [-b] [-n iterations] [-t seconds] [path ...]\n",
+             prog);
+    exit (1);
+}
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+static void add_file (const char *path)
+{
+    struct input *in;
+    struct stat sb;
+    FILE *f;
+
+    if (!(inputs = realloc (inputs, (ninputs + 1) * sizeof (inputs[0]))))
+        die ("out of memory");
+    in = &inputs[ninputs];
+    if (!(f = fopen (path, "r")) || fstat (fileno (f), &sb) < 0)
+        die ("%s: %s", path, strerror (errno));
+    in->size = sb.st_size;
+    if (!(in->path = strdup (path))
+        || !(in->data = malloc (in->size ? in->size : 1)))
+        die ("out of memory");
+    if (fread (in->data, 1, in->size, f) != in->size)
+        die ("%s: read error", path);
+    fclose (f);
+    ninputs++;
+}
+
+static void add_path (const char *path)
+{
+    struct dirent **ents;
+    struct stat sb;
+    char fpath[PATH_MAX + 1];
+    int n;
+    int i;
+
+    if (stat (path, &sb) < 0)
+        die ("%s: %s", path, strerror (errno));
+    if (!S_ISDIR (sb.st_mode)) {
+        add_file (path);
+        return;
+    }
+    if ((n = scandir (path, &ents, NULL, alphasort)) < 0)
+        die ("%s: %s", path, strerror (errno));
+    for (i = 0; i < n; i++) {
+        if (ents[i]->d_name[0] != '.') {
+            snprintf (fpath, sizeof (fpath), "%s/%s", path, ents[i]->d_name);
+            add_file (fpath);
+        }
+        free (ents[i]);
+    }
+    free (ents);
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static void bench (struct input *in, int iterations)
+{
+    const char *base = strrchr (in->path, '/');
+    char name[64];
+    double *samples;
+    double total = 0;
+    double t0;
+    int i;
+
+    snprintf (name, sizeof (name), "%s/%s",
+              fuzz_corpus, base ? base + 1 : in->path);
+
+    if (!(samples = calloc (iterations, sizeof (samples[0]))))
+        die ("out of memory");
+    for (i = 0; i < iterations; i++) {
+        t0 = now ();
+        (void)LLVMFuzzerTestOneInput (in->data, in->size);
+        samples[i] = (now () - t0) * 1E6;
+        total += samples[i];
+    }
+    qsort (samples, iterations, sizeof (samples[0]), sample_cmp);
+    printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+            name,
+            total > 0 ? iterations / (total / 1E6) : 0,
+            total > 0 ? in->size * iterations / total : 0, // bytes/us = MB/s
+            samples[(iterations - 1) * 50 / 100],
+            samples[(iterations - 1) * 90 / 100],
+            samples[(iterations - 1) * 99 / 100],
+            samples[iterations - 1]);
+    free (samples);
+}
+
+int main (int argc, char *argv[])
+{
+    int iterations = 100;
+    double limit = 10;
+    int bench_mode = 0;
+    const char *dir;
+    char path[PATH_MAX + 1];
+    double t0;
+    int ch;
+    int i;
+
+    prog = (prog = strrchr (argv[0], '/')) ? prog + 1 : argv[0];
+    while ((ch = getopt (argc, argv, "bn:t:")) != -1) {
+        switch (ch) {
+            case 'b':
+                bench_mode = 1;
+                break;
+            case 'n':
+                if ((iterations = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 't':
+                if ((limit = strtod (optarg, NULL)) <= 0)
+                    usage ();
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind < argc) {
+        for (i = optind; i < argc; i++)
+            add_path (argv[i]);
+    }
+    else {
+        if (!(dir = getenv ("FUZZ_CORPUS_DIR")))
+            dir = "corpus";
+        snprintf (path, sizeof (path), "%s/%s", dir, fuzz_corpus);
+        add_path (path);
+    }
+    if (ninputs == 0)
+        die ("no corpus inputs found");
+
+    (void)LLVMFuzzerInitialize (&argc, &argv);
+
+    if (bench_mode) {
+        printf ("%-32s %10s %9s %9s %9s %9s %9s\n",
+                "operation", "ops/sec", "MB/s",
+                "p50(us)", "p90(us)", "p99(us)", "max(us)");
+        for (i = 0; i < ninputs; i++)
+            bench (&inputs[i], iterations);
+    }
+    else {
+        plan (NO_PLAN);
+        for (i = 0; i < ninputs; i++) {
+            double elapsed;
+            int rc;
+
+            t0 = now ();
+            rc = LLVMFuzzerTestOneInput (inputs[i].data, inputs[i].size);
+            elapsed = now () - t0;
+            ok (rc == 0 && elapsed < limit,
+                "%s: %zu bytes in %.3fs",
+                inputs[i].path, inputs[i].size, elapsed);
+        }
+    }
+    for (i = 0; i < ninputs; i++) {
+        free (inputs[i].path);
+        free (inputs[i].data);
+    }
+    free (inputs);
+    if (bench_mode)
+        return 0;
+    done_testing ();
+}
+
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <errno.h>
 
 #include "src/libutil/kv.h"
@@ -69,18 +70,14 @@ done:
     return rc;
 }
 
-/* Sign 'cert' with the CA cert, and emit to stdout.
- * The cert userid is set to the real uid used to execute the imp.
- * The TTL is set to the configured maximum.
+/* Create CA and load the CA cert, including its secret key.
  * The location of the CA cert is obtained from the [ca] configuration.
  */
-static void sign_cert (cf_t *conf, struct sigcert *cert)
+static struct ca *load_ca (cf_t *conf)
 {
     struct ca *ca;
     const cf_t *cf;
     ca_error_t error;
-    int64_t ttl = 0;            // use configured maximum
-    int64_t userid = getuid (); // sign as real userid
 
     if (!conf)
         imp_die (1, "casign: no configuration");
@@ -90,6 +87,20 @@ static void sign_cert (cf_t *conf, struct sigcert *cert)
         imp_die (1, "casign: ca_create: %s", error);
     if (ca_load (ca, true, error) < 0)
         imp_die (1, "casign: ca_load: %s", error);
+    return ca;
+}
+
+/* Sign 'cert' with the CA cert, and emit to stdout.
+ * The cert userid is set to the real uid used to execute the imp.
+ * The TTL is set to the configured maximum.
+ */
+static void sign_cert (cf_t *conf, struct sigcert *cert)
+{
+    struct ca *ca = load_ca (conf);
+    ca_error_t error;
+    int64_t ttl = 0;            // use configured maximum
+    int64_t userid = getuid (); // sign as real userid
+
     if (ca_sign (ca, cert, 0, ttl, userid, error) < 0)
         imp_die (1, "casign: ca_sign: %s", error);
     if (sigcert_fwrite_public (cert, stdout) < 0)
@@ -97,10 +108,154 @@ static void sign_cert (cf_t *conf, struct sigcert *cert)
     ca_destroy (ca);
 }
 
+/* Batch mode: certs are signed in groups of up to CASIGN_BATCH_SIZE with one
+ * ca_sign_batch() call, and written to stdout in binary form in the order
+ * they were read.
+ */
+#define CASIGN_BATCH_SIZE 256
+
+struct batch {
+    struct ca *ca;
+    int count;
+    struct sigcert *certs[CASIGN_BATCH_SIZE];
+    int64_t userids[CASIGN_BATCH_SIZE];
+};
+
+static void batch_flush (struct batch *b)
+{
+    ca_error_t error;
+    int i;
+
+    if (ca_sign_batch (b->ca, b->certs, b->count, 0, 0, b->userids,
+                       error) < 0)
+        imp_die (1, "casign: ca_sign_batch: %s", error);
+    for (i = 0; i < b->count; i++) {
+        if (sigcert_fwrite_binary (b->certs[i], stdout) < 0)
+            imp_die (1, "casign: write stdout: %s", strerror (errno));
+        sigcert_destroy (b->certs[i]);
+    }
+    b->count = 0;
+}
+
+/* Queue 'cert' for signing, taking ownership of it.
+ * The cert is signed for the userid in its metadata, if set, otherwise for
+ * the real uid used to execute the imp.  Only root may sign for other users.
+ */
+static void batch_add (struct batch *b, struct sigcert *cert)
+{
+    int64_t real_userid = getuid ();
+    int64_t userid;
+
+    if (sigcert_meta_get (cert, "userid", SM_INT64, &userid) < 0)
+        userid = real_userid;
+    else if (userid != real_userid && real_userid != 0)
+        imp_die (1, "casign: only root may sign certs for other users");
+    b->certs[b->count] = cert;
+    b->userids[b->count] = userid;
+    if (++b->count == CASIGN_BATCH_SIZE)
+        batch_flush (b);
+}
+
+static void batch_init (struct batch *b, cf_t *conf)
+{
+    b->ca = load_ca (conf);
+    b->count = 0;
+}
+
+static void batch_fini (struct batch *b)
+{
+    if (b->count > 0)
+        batch_flush (b);
+    if (fflush (stdout) != 0)
+        imp_die (1, "casign: write stdout: %s", strerror (errno));
+    ca_destroy (b->ca);
+}
+
+/* Read binary cert from stdin, or return NULL at end of file.
+ */
+static struct sigcert *batch_read_cert (void)
+{
+    struct sigcert *cert;
+
+    if (!(cert = sigcert_fread_binary (stdin))) {
+        if (errno == ENODATA)
+            return NULL;
+        imp_die (1, "casign: decode cert: %s", strerror (errno));
+    }
+    return cert;
+}
+
+/* Sign certs sent one per message by the unprivileged child, until a
+ * message with 'end' set is received.
+ */
+static void casign_batch_privileged (struct imp_state *imp)
+{
+    struct batch b;
+    struct kv *kv;
+    bool end = false;
+
+    batch_init (&b, imp->conf);
+    while (!end) {
+        if (!(kv = privsep_read_kv (imp->ps)))
+            imp_die (1, "casign: failed to read from privsep child");
+        if (kv_get (kv, "end", KV_BOOL, &end) < 0 || !end) {
+            struct sigcert *cert;
+            if (!(cert = get_cert_from_kv (kv)))
+                imp_die (1, "casign: decode cert: %s", strerror (errno));
+            batch_add (&b, cert);
+        }
+        kv_destroy (kv);
+    }
+    batch_fini (&b);
+}
+
+static void casign_batch_unprivileged (struct imp_state *imp, struct kv *kv)
+{
+    struct sigcert *cert;
+    struct kv *end_kv;
+
+    if (kv_put (kv, "batch", KV_BOOL, true) < 0)
+        imp_die (1, "casign: kv_put batch: %s", strerror (errno));
+    if (imp->ps) {
+        if (privsep_write_kv (imp->ps, kv) < 0)
+            imp_die (1, "casign: failed to communicate with privsep parent");
+        while ((cert = batch_read_cert ())) {
+            struct kv *cert_kv;
+            if (!(cert_kv = kv_create ())
+                || add_cert_to_kv (cert_kv, cert) < 0)
+                imp_die (1, "casign: encode cert: %s", strerror (errno));
+            if (privsep_write_kv (imp->ps, cert_kv) < 0)
+                imp_die (1, "casign: failed to communicate with privsep parent");
+            kv_destroy (cert_kv);
+            sigcert_destroy (cert);
+        }
+        if (!(end_kv = kv_create ())
+            || kv_put (end_kv, "end", KV_BOOL, true) < 0)
+            imp_die (1, "casign: kv_put end: %s", strerror (errno));
+        if (privsep_write_kv (imp->ps, end_kv) < 0)
+            imp_die (1, "casign: failed to communicate with privsep parent");
+        kv_destroy (end_kv);
+    }
+    else {
+        struct batch b;
+
+        imp_warn ("casign: imp is not installed setuid, proceeding anyway...");
+        batch_init (&b, imp->conf);
+        while ((cert = batch_read_cert ()))
+            batch_add (&b, cert);
+        batch_fini (&b);
+    }
+}
+
 int imp_casign_privileged (struct imp_state *imp, const struct kv *kv)
 {
     struct sigcert *cert;
+    bool batch;
 
+    if (kv_get (kv, "batch", KV_BOOL, &batch) == 0 && batch) {
+        casign_batch_privileged (imp);
+        return (0);
+    }
     if (!(cert = get_cert_from_kv (kv)))
         imp_die (1, "casign: decode cert: %s", strerror (errno));
     sign_cert (imp->conf, cert);
@@ -112,6 +267,14 @@ int imp_casign_unprivileged (struct imp_state *imp, struct kv *kv)
 {
     struct sigcert *cert;
 
+    if (imp->argc > 2) {
+        if (imp->argc == 3 && !strcmp (imp->argv[2], "--batch")) {
+            casign_batch_unprivileged (imp, kv);
+            return (0);
+        }
+        imp_die (1, "casign: Usage flux-imp casign [--batch]");
+    }
+
     if (!(cert = sigcert_fread_public (stdin)))
         imp_die (1, "casign: decode cert: %s", strerror (errno));
 
@@ -0,0 +1,72 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/*  flux-imp config-stats
+ *
+ *  Reload the IMP configuration and report where the time goes: glob(3)
+ *   expansion, then bytes, parse time and merge time for each file, so
+ *   a slow IMP startup can be traced to a cost and a file. The config
+ *   cache is bypassed, so the files are always parsed.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "src/libutil/cf.h"
+
+#include "imp_log.h"
+#include "impcmd.h"
+
+extern const char *imp_get_config_pattern (void);
+
+static double ms (uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+int imp_config_stats (struct imp_state *imp __attribute__ ((unused)),
+                      struct kv *kv __attribute__ ((unused)))
+{
+    const char *pattern = imp_get_config_pattern ();
+    struct cf_stats *stats = NULL;
+    struct cf_error err;
+    cf_t *cf;
+    int i;
+
+    if (!(cf = cf_create ()))
+        imp_die (1, "config-stats: out of memory");
+    memset (&err, 0, sizeof (err));
+    if (cf_update_glob_stats (cf, pattern, &stats, &err) < 0) {
+        imp_warn ("config-stats: %s: %d: %s",
+                  err.filename, err.lineno, err.errbuf);
+        cf_destroy (cf);
+        return (-1);
+    }
+    printf ("flux-imp: config: %s: %d files, glob %.3fms\n",
+            pattern, stats->count, ms (stats->glob_ns));
+    for (i = 0; i < stats->count; i++) {
+        struct cf_file_stats *fs = &stats->files[i];
+        printf ("flux-imp: config: %s: %jd bytes, parse %.3fms, "
+                "merge %.3fms\n",
+                fs->filename, (intmax_t) fs->size,
+                ms (fs->parse_ns), ms (fs->merge_ns));
+    }
+    cf_stats_destroy (stats);
+    cf_destroy (cf);
+    return (0);
+}
+
+/* vi: ts=4 sw=4 expandtab
+ */
@@ -17,6 +17,26 @@
  * Signed J as key "J" in JSON object on stdin, path to requested
  *  job shell and single argument on cmdline.
  *
+ * Usage: flux-imp exec --batch
+ *
+ * Input:
+ *
+ * JSON array of {"J":s, "shell":s, "arg":s} objects on stdin. Every J
+ *  is verified, using one security context, before any job shell is
+ *  started. Each job shell is then forked as its user, and the IMP
+ *  waits for all of them, exiting with the first nonzero exit code.
+ *
+ * In privsep mode, the unprivileged child only reads and forwards
+ *  input; J is verified once, by the privileged parent, which is the
+ *  only side whose result is trusted anyway. The child unwraps J
+ *  itself only when running without privilege (testing mode).
+ *
+ * The job shell is resolved (searching PATH if it has no '/') and
+ *  opened once, after it is checked against allowed-shells and before
+ *  switching user, then executed from that descriptor with fexecve(3).
+ *  When privileged, the caller's PATH is not trusted and a fixed safe
+ *  PATH is searched instead.
+ *
  */
 
 #if HAVE_CONFIG_H
@@ -24,11 +44,15 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 #include <jansson.h>
 
 
@@ -55,10 +79,18 @@ struct imp_exec {
     const char *J;
     const char *shell;
     const char *arg;
+
+    int shell_fd;       /* shell opened by imp_exec_open_shell() */
+    char **env;         /* job shell environment, if not ours */
     const void *spec;
     int specsz;
 };
 
+/*  PATH searched for a job shell given without '/' when it is opened
+ *   with privilege, since the caller's PATH cannot be trusted then.
+ */
+#define IMP_EXEC_SAFE_PATH "/usr/local/bin:/usr/bin:/bin"
+
 extern const char *imp_get_security_config_pattern (void);
 
 static flux_security_t *sec_init (void)
@@ -70,19 +102,19 @@ static flux_security_t *sec_init (void)
         imp_die (1, "exec: Error loading security context: %s",
                     sec ? flux_security_last_error (sec) : strerror (errno));
     }
+    imp_trace ("sec_init");
     return sec;
 }
 
 static bool imp_exec_user_allowed (struct imp_exec *exec)
 {
-    return cf_array_contains (cf_get_in (exec->conf, "allowed-users"),
-                              exec->imp_pwd->pw_name);
+    return cf_set_contains (exec->imp->allowed_users,
+                            exec->imp_pwd->pw_name);
 }
 
 static bool imp_exec_shell_allowed (struct imp_exec *exec)
 {
-    return cf_array_contains (cf_get_in (exec->conf, "allowed-shells"),
-                              exec->shell);
+    return cf_set_contains (exec->imp->allowed_shells, exec->shell);
 }
 
 static bool imp_exec_unprivileged_allowed (struct imp_exec *exec)
@@ -96,6 +128,14 @@ static void imp_exec_destroy (struct imp_exec *exec)
         flux_security_destroy (exec->sec);
         json_decref (exec->input);
         passwd_destroy (exec->imp_pwd);
+        if (exec->shell_fd >= 0)
+            close (exec->shell_fd);
+        if (exec->env) {
+            char **e;
+            for (e = exec->env; *e; e++)
+                free (*e);
+            free (exec->env);
+        }
         free (exec);
     }
 }
@@ -105,8 +145,8 @@ static struct imp_exec *imp_exec_create (struct imp_state *imp)
     struct imp_exec *exec = calloc (1, sizeof (*exec));
     if (exec) {
         exec->userid = (uid_t) -1;
+        exec->shell_fd = -1;
         exec->imp = imp;
-        exec->sec = sec_init ();
         exec->conf = cf_get_in (imp->conf, "exec");
 
         if (!(exec->imp_pwd = passwd_from_uid (getuid ())))
@@ -119,6 +159,11 @@ static void imp_exec_unwrap (struct imp_exec *exec, const char *J)
 {
     int64_t userid;
 
+    /*  Security context is created on demand, so that a privsep child
+     *  which never verifies J does not pay for loading it.
+     */
+    if (!exec->sec)
+        exec->sec = sec_init ();
     if (flux_sign_unwrap (exec->sec,
                           J,
                           &exec->spec,
@@ -127,6 +172,7 @@ static void imp_exec_unwrap (struct imp_exec *exec, const char *J)
                           0) < 0)
         imp_die (1, "exec: signature validation failed: %s",
                  flux_security_last_error (exec->sec));
+    imp_trace ("flux_sign_unwrap");
 
     exec->userid = (uid_t) userid;
 }
@@ -142,6 +188,7 @@ static void imp_exec_init_kv (struct imp_exec *exec, struct kv *kv)
     if (kv_get (kv, "arg", KV_STRING, &exec->arg) < 0)
         imp_die (1, "exec: Failed to get job shell arg");
 
+    /*  This is the single authoritative verification of J */
     imp_exec_unwrap (exec, exec->J);
 }
 
@@ -171,13 +218,86 @@ static void imp_exec_init_stream (struct imp_exec *exec, FILE *fp)
                            "{s:s}",
                            "J", &exec->J) < 0)
         imp_die (1, "exec: invalid json input: %s", err.text);
+}
 
-    imp_exec_unwrap (exec, exec->J);
+/*  Open `path` as a candidate job shell. Returns an O_PATH descriptor
+ *   if `path` is an executable regular file, otherwise -1 with errno set.
+ */
+static int shell_open (const char *path)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open (path, O_PATH | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode)
+        || !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+        close (fd);
+        errno = EACCES;
+        return -1;
+    }
+    return fd;
+}
+
+/*  Resolve the job shell once, as execvp(3) would, and open it, so the
+ *   file executed by imp_exec() is the file validated here. A shell
+ *   without '/' (allowed-shells may list bare names) is searched in PATH.
+ *   If `privileged`, nothing from the caller's environment is used: the
+ *   shell must be absolute or is searched in IMP_EXEC_SAFE_PATH.
+ *   Failure is fatal.
+ */
+static void imp_exec_open_shell (struct imp_exec *exec, bool privileged)
+{
+    const char *path;
+    const char *p;
+    int saved_errno = ENOENT;
+
+    if (exec->shell_fd >= 0)
+        return;
+
+    if (privileged && exec->shell[0] != '/' && strchr (exec->shell, '/'))
+        imp_die (1, "exec: %s: job shell must be an absolute path",
+                    exec->shell);
+    if (strchr (exec->shell, '/')) {
+        if ((exec->shell_fd = shell_open (exec->shell)) < 0)
+            imp_die (errno == EACCES ? 126 : 127,
+                     "%s: %s", exec->shell, strerror (errno));
+        return;
+    }
+
+    if (privileged)
+        path = IMP_EXEC_SAFE_PATH;
+    else if (!(path = getenv ("PATH")))
+        path = "/bin:/usr/bin";
+    for (p = path; ; p++) {
+        const char *end = strchrnul (p, ':');
+        char *candidate;
+
+        /*  Empty PATH element means current directory */
+        if (asprintf (&candidate, "%.*s%s%s",
+                      (int) (end - p), p,
+                      end == p ? "" : "/",
+                      exec->shell) < 0)
+            imp_die (1, "exec: Out of memory");
+        exec->shell_fd = shell_open (candidate);
+        if (exec->shell_fd < 0 && errno != ENOENT && errno != ENOTDIR)
+            saved_errno = errno;
+        free (candidate);
+        if (exec->shell_fd >= 0)
+            return;
+        if (*end == '\0')
+            break;
+        p = end;
+    }
+    imp_die (saved_errno == EACCES ? 126 : 127,
+             "%s: %s", exec->shell, strerror (saved_errno));
 }
 
 static void __attribute__((noreturn)) imp_exec (struct imp_exec *exec)
 {
+    extern char **environ;
     const char *args[3];
+    char **env = exec->env ? exec->env : environ;
     int exit_code;
 
     /* Setup minimal environment */
@@ -186,20 +306,336 @@ static void __attribute__((noreturn)) imp_exec (struct imp_exec *exec)
     if (chdir ("/") < 0)
         imp_die (1, "exec: failed to chdir to /");
 
+    /*  Without privilege, the shell is resolved here, after any switch
+     *   to the job user, so the caller's PATH may be used.
+     */
+    imp_exec_open_shell (exec, false);
+
     args[0] = exec->shell;
     args[1] = exec->arg;
     args[2] = NULL;
-    execvp (exec->shell, (char **) args);
+
+    /*  Last chance to emit phase trace and buffered log messages before
+     *   this process is replaced
+     */
+    imp_trace ("execvp");
+    imp_trace_flush ();
+    imp_log_flush ();
+    fexecve (exec->shell_fd, (char **) args, env);
+
+    /*  An interpreter script cannot be run from a close-on-exec
+     *   descriptor, since the interpreter would be unable to open it.
+     *   Retry from the same descriptor left open across exec, rather
+     *   than by path, so the file run is still the one validated.
+     */
+    if (errno == ENOENT
+        && fcntl (exec->shell_fd, F_SETFD, 0) == 0)
+        fexecve (exec->shell_fd, (char **) args, env);
 
     if (errno == EPERM || errno == EACCES)
-        exit_code =  126;
-    exit_code = 127;
+        exit_code = 126;
+    else
+        exit_code = 127;
     imp_die (exit_code, "%s: %s", exec->shell, strerror (errno));
 }
 
+/*  Batch exec: several (J, shell, arg) requests from one IMP.
+ *   Each job is a struct imp_exec borrowing the batch security context.
+ */
+#define IMP_EXEC_BATCH_MAX 1024
+
+struct imp_exec_batch {
+    struct imp_state *imp;
+    flux_security_t *sec;
+    json_t *input;
+    int count;
+    struct imp_exec **jobs;
+};
+
+static bool imp_exec_is_batch (struct imp_state *imp)
+{
+    return (imp->argc == 3 && strcmp (imp->argv[2], "--batch") == 0);
+}
+
+static void imp_exec_batch_destroy (struct imp_exec_batch *batch)
+{
+    if (batch) {
+        int i;
+        for (i = 0; i < batch->count; i++) {
+            if (batch->jobs[i]) {
+                batch->jobs[i]->sec = NULL;
+                imp_exec_destroy (batch->jobs[i]);
+            }
+        }
+        free (batch->jobs);
+        flux_security_destroy (batch->sec);
+        json_decref (batch->input);
+        free (batch);
+    }
+}
+
+static struct imp_exec_batch *imp_exec_batch_create (struct imp_state *imp,
+                                                     int count)
+{
+    int i;
+    struct imp_exec_batch *batch;
+
+    if (count <= 0)
+        imp_die (1, "exec: batch must contain at least one job");
+    if (count > IMP_EXEC_BATCH_MAX)
+        imp_die (1, "exec: batch may contain at most %d jobs",
+                 IMP_EXEC_BATCH_MAX);
+    if (!(batch = calloc (1, sizeof (*batch)))
+        || !(batch->jobs = calloc (count, sizeof (batch->jobs[0]))))
+        imp_die (1, "exec: failed to initialize batch");
+    batch->imp = imp;
+    batch->count = count;
+    for (i = 0; i < count; i++) {
+        if (!(batch->jobs[i] = imp_exec_create (imp)))
+            imp_die (1, "exec: failed to initialize state");
+    }
+    return batch;
+}
+
+static struct imp_exec_batch *imp_exec_batch_init_stream (struct imp_state *imp,
+                                                          FILE *fp)
+{
+    struct imp_exec_batch *batch;
+    json_error_t err;
+    json_t *input;
+    json_t *entry;
+    size_t index;
+
+    if (!(input = json_loadf (fp, 0, &err)))
+        imp_die (1, "exec: invalid json input: %s", err.text);
+    if (!json_is_array (input))
+        imp_die (1, "exec: invalid json input: batch must be an array");
+
+    batch = imp_exec_batch_create (imp, json_array_size (input));
+    batch->input = input;
+
+    json_array_foreach (input, index, entry) {
+        struct imp_exec *exec = batch->jobs[index];
+        if (json_unpack_ex (entry,
+                            &err,
+                            0,
+                            "{s:s s:s s:s}",
+                            "J", &exec->J,
+                            "shell", &exec->shell,
+                            "arg", &exec->arg) < 0)
+            imp_die (1, "exec: invalid json input: batch[%zu]: %s",
+                     index, err.text);
+    }
+    return batch;
+}
+
+static void imp_exec_batch_put_kv (struct imp_exec_batch *batch,
+                                   struct kv *kv)
+{
+    char key[64];
+    int i;
+
+    if (kv_put (kv, "batch", KV_INT64, (int64_t) batch->count) < 0)
+        imp_die (1, "exec: Failed to encode batch size");
+    for (i = 0; i < batch->count; i++) {
+        struct imp_exec *exec = batch->jobs[i];
+        (void) snprintf (key, sizeof (key), "J.%d", i);
+        if (kv_put (kv, key, KV_STRING, exec->J) < 0)
+            imp_die (1, "exec: Error encoding J");
+        (void) snprintf (key, sizeof (key), "shell_path.%d", i);
+        if (kv_put (kv, key, KV_STRING, exec->shell) < 0)
+            imp_die (1, "exec: Failed to encode job shell path");
+        (void) snprintf (key, sizeof (key), "arg.%d", i);
+        if (kv_put (kv, key, KV_STRING, exec->arg) < 0)
+            imp_die (1, "exec: Failed to encode job shell arg");
+    }
+}
+
+static void imp_exec_batch_get_kv (struct kv *kv, int i,
+                                   const char **J,
+                                   const char **shell,
+                                   const char **arg)
+{
+    char key[64];
+
+    (void) snprintf (key, sizeof (key), "J.%d", i);
+    if (kv_get (kv, key, KV_STRING, J) < 0)
+        imp_die (1, "exec: Error decoding J");
+    (void) snprintf (key, sizeof (key), "shell_path.%d", i);
+    if (kv_get (kv, key, KV_STRING, shell) < 0)
+        imp_die (1, "exec: Failed to get job shell path");
+    (void) snprintf (key, sizeof (key), "arg.%d", i);
+    if (kv_get (kv, key, KV_STRING, arg) < 0)
+        imp_die (1, "exec: Failed to get job shell arg");
+}
+
+/*  `kv` comes from the unprivileged child, so the batch size is not
+ *   trusted until the kv is known to hold the keys of that many jobs.
+ */
+static struct imp_exec_batch *imp_exec_batch_init_kv (struct imp_state *imp,
+                                                      struct kv *kv)
+{
+    struct imp_exec_batch *batch;
+    const char *key = NULL;
+    const char *J, *shell, *arg;
+    int64_t count;
+    int64_t entries = 0;
+    int i;
+
+    while ((key = kv_next (kv, key)))
+        entries++;
+    if (kv_get (kv, "batch", KV_INT64, &count) < 0
+        || count <= 0
+        || count > IMP_EXEC_BATCH_MAX
+        || count * 3 > entries - 1)
+        imp_die (1, "exec: Error decoding batch size");
+    for (i = 0; i < count; i++)
+        imp_exec_batch_get_kv (kv, i, &J, &shell, &arg);
+
+    batch = imp_exec_batch_create (imp, (int) count);
+    for (i = 0; i < batch->count; i++) {
+        struct imp_exec *exec = batch->jobs[i];
+        imp_exec_batch_get_kv (kv, i, &exec->J, &exec->shell, &exec->arg);
+    }
+    return batch;
+}
+
+/*  Verify every job in the batch with a single security context.
+ *   Nothing is started unless all jobs pass.
+ */
+static void imp_exec_batch_verify (struct imp_exec_batch *batch)
+{
+    int i;
+
+    if (!batch->sec)
+        batch->sec = sec_init ();
+    for (i = 0; i < batch->count; i++) {
+        struct imp_exec *exec = batch->jobs[i];
+        exec->sec = batch->sec;
+        imp_exec_unwrap (exec, exec->J);
+        if (exec->userid == 0)
+            imp_die (1, "exec: switching to user root not supported");
+        if (!imp_exec_shell_allowed (exec))
+            imp_die (1, "exec: shell not in allowed-shells list");
+        imp_exec_open_shell (exec, true);
+
+        /*  Resolve each job user once here, before fork, so that
+         *   imp_switch_user() in the job shell children hits the cache.
+         */
+        if (!passwd_lookup_uid (exec->userid))
+            imp_die (1, "exec: lookup userid=%ju failed",
+                        (uintmax_t) exec->userid);
+    }
+}
+
+/*  Fork all job shells in the batch, switching to the job user when
+ *   privileged, and wait for them. Returns the IMP exit code.
+ */
+static int imp_exec_batch_run (struct imp_exec_batch *batch)
+{
+    pid_t *pids;
+    int exit_code = 0;
+    int i;
+
+    if (!(pids = calloc (batch->count, sizeof (pid_t))))
+        imp_die (1, "exec: Out of memory");
+
+    for (i = 0; i < batch->count; i++) {
+        if ((pids[i] = fork ()) < 0) {
+            imp_warn ("exec: batch[%d]: fork: %s", i, strerror (errno));
+            exit_code = 1;
+            break;
+        }
+        if (pids[i] == 0) {
+            if (geteuid () == 0)
+                imp_switch_user (batch->jobs[i]->userid);
+            imp_exec (batch->jobs[i]);
+        }
+    }
+    for (i = 0; i < batch->count && pids[i] > 0; i++) {
+        int status;
+        int code = 0;
+        while (waitpid (pids[i], &status, 0) < 0) {
+            if (errno != EINTR)
+                imp_die (1, "exec: waitpid: %s", strerror (errno));
+        }
+        if (WIFSIGNALED (status))
+            code = 128 + WTERMSIG (status);
+        else if (WIFEXITED (status))
+            code = WEXITSTATUS (status);
+        if (code != 0) {
+            imp_warn ("exec: batch[%d]: %s exited with %d",
+                      i, batch->jobs[i]->shell, code);
+            if (exit_code == 0)
+                exit_code = code;
+        }
+    }
+    free (pids);
+    return exit_code;
+}
+
+static int imp_exec_batch_privileged (struct imp_state *imp, struct kv *kv)
+{
+    struct imp_exec_batch *batch = imp_exec_batch_init_kv (imp, kv);
+    int exit_code;
+
+    if (!imp_exec_user_allowed (batch->jobs[0]))
+        imp_die (1, "exec: user %s not in allowed-users list",
+                    batch->jobs[0]->imp_pwd->pw_name);
+
+    imp_exec_batch_verify (batch);
+
+    /* Ensure child exited with nonzero status */
+    if (privsep_wait (imp->ps) < 0)
+        exit (1);
+    imp_trace ("privsep_wait");
+
+    exit_code = imp_exec_batch_run (batch);
+    imp_exec_batch_destroy (batch);
+    exit (exit_code);
+}
+
+static int imp_exec_batch_unprivileged (struct imp_state *imp, struct kv *kv)
+{
+    struct imp_exec_batch *batch = imp_exec_batch_init_stream (imp, stdin);
+    int exit_code;
+    int i;
+
+    if (!imp_exec_user_allowed (batch->jobs[0]))
+        imp_die (1, "exec: user %s not in allowed-users list",
+                    batch->jobs[0]->imp_pwd->pw_name);
+
+    if (imp->ps) {
+        for (i = 0; i < batch->count; i++) {
+            if (!imp_exec_shell_allowed (batch->jobs[i]))
+                imp_die (1, "exec: shell not in allowed-shells");
+        }
+        imp_exec_batch_put_kv (batch, kv);
+        if (privsep_write_kv (imp->ps, kv) < 0)
+            imp_die (1, "exec: failed to communicate with privsep parent");
+        imp_exec_batch_destroy (batch);
+        exit (0);
+    }
+
+    if (!imp_exec_unprivileged_allowed (batch->jobs[0]))
+        imp_die (1, "exec: IMP not installed setuid, operation disabled.");
+
+    imp_warn ("Running without privilege, userid switching not available");
+
+    imp_exec_batch_verify (batch);
+    exit_code = imp_exec_batch_run (batch);
+    imp_exec_batch_destroy (batch);
+    exit (exit_code);
+}
+
 int imp_exec_privileged (struct imp_state *imp, struct kv *kv)
 {
-    struct imp_exec *exec = imp_exec_create (imp);
+    struct imp_exec *exec;
+
+    if (kv_get (kv, "batch", KV_INT64, NULL) == 0)
+        return imp_exec_batch_privileged (imp, kv);
+
+    exec = imp_exec_create (imp);
     if (!exec)
         imp_die (1, "exec: failed to initialize state");
 
@@ -216,10 +652,12 @@ int imp_exec_privileged (struct imp_state *imp, struct kv *kv)
         imp_die (1, "exec: switching to user root not supported");
     if (!imp_exec_shell_allowed (exec))
         imp_die (1, "exec: shell not in allowed-shells list");
+    imp_exec_open_shell (exec, true);
 
     /* Ensure child exited with nonzero status */
     if (privsep_wait (imp->ps) < 0)
         exit (1);
+    imp_trace ("privsep_wait");
 
     /* Call privileged IMP plugins/containment */
 
@@ -232,6 +670,80 @@ int imp_exec_privileged (struct imp_state *imp, struct kv *kv)
     return (-1);
 }
 
+/*  Build the job shell environment from the "env.NAME" = VALUE entries
+ *   of a service request, so that, as with `flux-imp exec`, the job shell
+ *   gets the requestor's environment and not the service's.
+ */
+static void imp_exec_init_env (struct imp_exec *exec, struct kv *kv)
+{
+    struct kv *env;
+    const char *key = NULL;
+    int n = 0;
+
+    if (!(env = kv_split (kv, "env.")))
+        imp_die (1, "exec: Failed to get job shell environment");
+    while ((key = kv_next (env, key)))
+        n++;
+    if (!(exec->env = calloc (n + 1, sizeof (exec->env[0]))))
+        imp_die (1, "exec: Out of memory");
+    n = 0;
+    while ((key = kv_next (env, key))) {
+        if (kv_typeof (key) != KV_STRING || strchr (key, '='))
+            imp_die (1, "exec: invalid job shell environment");
+        if (asprintf (&exec->env[n++], "%s=%s",
+                      key, kv_val_string (key)) < 0)
+            imp_die (1, "exec: Out of memory");
+    }
+    kv_destroy (env);
+}
+
+/*  Entry point for `flux-imp service` (see service.c): verify the exec
+ *   request in `kv` using the service's preloaded security context `sec`,
+ *   then fork the job shell as the target user. Returns the pid of the
+ *   job shell. Performs the same checks as imp_exec_privileged(), and
+ *   likewise any failure is fatal to the calling process.
+ */
+pid_t imp_exec_service (struct imp_state *imp,
+                        flux_security_t *sec,
+                        struct kv *kv)
+{
+    pid_t pid;
+    struct imp_exec *exec = imp_exec_create (imp);
+    if (!exec)
+        imp_die (1, "exec: failed to initialize state");
+
+    /* Security context is owned by the service, not this request */
+    exec->sec = sec;
+
+    if (!imp_exec_user_allowed (exec))
+        imp_die (1, "exec: user %s not in allowed-users list",
+                    exec->imp_pwd->pw_name);
+
+    imp_exec_init_kv (exec, kv);
+    imp_exec_init_env (exec, kv);
+
+    if (exec->userid == 0)
+        imp_die (1, "exec: switching to user root not supported");
+    if (!imp_exec_shell_allowed (exec))
+        imp_die (1, "exec: shell not in allowed-shells list");
+    imp_exec_open_shell (exec, true);
+    if (!passwd_lookup_uid (exec->userid))
+        imp_die (1, "exec: lookup userid=%ju failed",
+                    (uintmax_t) exec->userid);
+
+    if ((pid = fork ()) < 0)
+        imp_die (1, "exec: fork: %s", strerror (errno));
+    if (pid == 0) {
+        /* Userid switching is only possible when service is privileged */
+        if (geteuid () == 0)
+            imp_switch_user (exec->userid);
+        imp_exec (exec);
+    }
+    exec->sec = NULL;
+    imp_exec_destroy (exec);
+    return pid;
+}
+
 /* Put all data from imp_exec into kv struct `kv`
  */
 static void imp_exec_put_kv (struct imp_exec *exec,
@@ -247,7 +759,12 @@ static void imp_exec_put_kv (struct imp_exec *exec,
 
 int imp_exec_unprivileged (struct imp_state *imp, struct kv *kv)
 {
-    struct imp_exec *exec = imp_exec_create (imp);
+    struct imp_exec *exec;
+
+    if (imp_exec_is_batch (imp))
+        return imp_exec_batch_unprivileged (imp, kv);
+
+    exec = imp_exec_create (imp);
     if (!exec)
         imp_die (1, "exec: initialization failure");
 
@@ -258,15 +775,13 @@ int imp_exec_unprivileged (struct imp_state *imp, struct kv *kv)
     /* Read input from stdin, cmdline: */
     imp_exec_init_stream (exec, stdin);
 
-    /* XXX; Parse jobspec if necessary, disabled for now: */
-    //if (!(jobspec = json_loads (spec, 0, &err)))
-    //   imp_die (1, "exec: failed to parse jobspec: %s", err.text);
-
     if (imp->ps) {
         if (!imp_exec_shell_allowed (exec))
             imp_die (1, "exec: shell not in allowed-shells");
 
-        /* In privsep mode, write kv to privileged parent and exit */
+        /* In privsep mode, write kv to privileged parent and exit.
+         *  J is not verified here: the parent verifies it before use.
+         */
         imp_exec_put_kv (exec, kv);
 
         if (privsep_write_kv (imp->ps, kv) < 0)
@@ -283,6 +798,13 @@ int imp_exec_unprivileged (struct imp_state *imp, struct kv *kv)
      */
     imp_warn ("Running without privilege, userid switching not available");
 
+    /* No privileged parent to verify J, so verify it here */
+    imp_exec_unwrap (exec, exec->J);
+
+    /* XXX; Parse jobspec if necessary, disabled for now: */
+    //if (!(jobspec = json_loads (spec, 0, &err)))
+    //   imp_die (1, "exec: failed to parse jobspec: %s", err.text);
+
     imp_exec (exec);
 
     /* imp_exec() does not return */
@@ -21,6 +21,7 @@
 #include <grp.h>
 
 #include "imp_log.h"
+#include "passwd.h"
 
 /*
  *  Switch process to new UID/GID with supplementary group initialization
@@ -31,7 +32,7 @@ void imp_switch_user (uid_t uid)
     gid_t gid = -1;
     const char *user = NULL;
 
-    struct passwd *pwd = getpwuid (uid);
+    const struct passwd *pwd = passwd_lookup_uid (uid);
     if (!pwd)
         imp_die (1, "lookup userid=%ld failed: %s",
                      (long) uid,
@@ -54,6 +55,7 @@ void imp_switch_user (uid_t uid)
     if (setreuid (-1, 0) == 0)
         imp_die (1, "irreversible switch to uid %ld failed",
                  (long) uid);
+    imp_trace ("imp_switch_user");
 }
 
 /*
@@ -12,6 +12,8 @@
 #define HAVE_IMP_EXEC_USER_H 1
 /*
  *  Switch process to new UID/GID with supplementary group initialization
+ *   The passwd entry for UID is taken from the passwd cache, so a caller
+ *   which has already resolved UID before fork(2) pays no extra lookup.
  */
 void imp_switch_user (uid_t uid);
 
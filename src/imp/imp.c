@@ -18,11 +18,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "imp_state.h"
 #include "imp_log.h"
 #include "impcmd.h"
 #include "sudosim.h"
+#include "passwd.h"
+
+#define IMP_LOG_BUFSIZE (64*1024)
 
 /*
  *  External function used to return current default config pattern.
@@ -34,6 +38,7 @@ extern const char *imp_get_config_pattern (void);
 static void initialize_logging ();
 static int  imp_state_init (struct imp_state *imp, int argc, char **argv);
 static cf_t * imp_conf_load (const char *pattern);
+static void imp_conf_index (struct imp_state *imp);
 static bool imp_is_privileged ();
 static bool imp_is_setuid ();
 static void initialize_sudo_support ();
@@ -55,6 +60,18 @@ int main (int argc, char *argv[])
      */
     if (!(imp.conf = imp_conf_load (imp_get_config_pattern ())))
         imp_die (1, "Failed to load configuration");
+    imp_conf_index (&imp);
+    imp_trace ("imp_conf_load");
+
+    /*  Phase tracing for launch latency analysis, if configured
+     */
+    if (cf_bool (cf_get_in (imp.conf, "trace"))) {
+        imp_trace_enable (argc > 1 ? argv[1] : NULL);
+
+        /*  Keep log output off the launch path while measuring it */
+        if (imp_log_set_buffer (IMP_LOG_BUFSIZE) < 0)
+            imp_die (1, "Failed to allocate log buffer");
+    }
 
     /*  Audit subsystem initialization
      */
@@ -70,10 +87,18 @@ int main (int argc, char *argv[])
         if (!imp_is_setuid ())
             imp_die (1, "Refusing to run as root");
 
+        /*  Resolve the IMP user once, before the privsep fork, so that
+         *   both privileged parent and unprivileged child use this entry
+         *   without another lookup (which may be slow with LDAP/SSSD).
+         */
+        if (!passwd_lookup_uid (getuid ()))
+            imp_die (1, "failed to find IMP user");
+
         /*  Initialize privilege separation (required for now)
          */
         if (!(imp.ps = privsep_init (imp_child, &imp)))
             imp_die (1, "Privilege separation initialization failed");
+        imp_trace ("privsep_init");
 
         imp_parent (&imp);
 
@@ -81,13 +106,18 @@ int main (int argc, char *argv[])
          */
         if (privsep_wait (imp.ps) < 0)
             exit_code = 1;
+        imp_trace ("privsep_wait");
     }
     else {
         /*  Not running with privilege, run child half of function only */
         imp_child (NULL, &imp);
     }
 
+    imp_trace_flush ();
     privsep_destroy (imp.ps);
+    passwd_cache_clear ();
+    cf_set_destroy (imp.allowed_users);
+    cf_set_destroy (imp.allowed_shells);
     cf_destroy (imp.conf);
     imp_closelog ();
     exit (exit_code);
@@ -129,15 +159,18 @@ static cf_t * imp_conf_load (const char *pattern)
     int rc;
     struct cf_error err;
     cf_t *cf = NULL;
+    char cachefile[PATH_MAX + 1];
 
     if (pattern == NULL)
         imp_die (1, "imp_conf_load: Internal error");
+    if (cf_cache_path (pattern, cachefile, sizeof (cachefile)) < 0)
+        imp_die (1, "%s: config pattern too long", pattern);
 
     if (!(cf = cf_create ()))
         return (NULL);
 
     memset (&err, 0, sizeof (err));
-    if ((rc = cf_update_glob (cf, pattern, &err)) < 0) {
+    if ((rc = cf_update_glob_cache (cf, pattern, cachefile, &err)) < 0) {
         imp_warn ("loading config: %s: %d: %s",
                  err.filename, err.lineno, err.errbuf);
         cf_destroy (cf);
@@ -151,6 +184,22 @@ static cf_t * imp_conf_load (const char *pattern)
     return (cf);
 }
 
+/*
+ *  Index allow lists which are searched on every request, so that lookups
+ *   do not scan what may be thousands of entries. Sets refer to strings in
+ *   imp->conf and must be destroyed before it.
+ */
+static void imp_conf_index (struct imp_state *imp)
+{
+    const cf_t *exec = cf_get_in (imp->conf, "exec");
+
+    if (!(imp->allowed_users = cf_set_create (cf_get_in (exec,
+                                                         "allowed-users")))
+        || !(imp->allowed_shells = cf_set_create (cf_get_in (exec,
+                                                         "allowed-shells"))))
+        imp_die (1, "Failed to index configuration: %s", strerror (errno));
+}
+
 /*
  *  Return true if effective UID is 0.
  */
@@ -210,6 +259,8 @@ static void imp_child (privsep_t *ps, void *arg)
      *   been done yet (only in parent)
      */
     imp->ps = ps;
+    if (ps)
+        imp_trace ("privsep_init");
 
     if (imp->argc <= 1)
         imp_die (1, "command required");
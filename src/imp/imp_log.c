@@ -16,12 +16,16 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdbool.h>
 #include <errno.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "imp_log.h"
 #include "libutil/hash.h"
 
 #define PROVIDER_MAX_NAMELEN 32
+#define TRACE_MAX_PHASES 16
 
 struct log_output {
     char name [PROVIDER_MAX_NAMELEN+1];
@@ -35,14 +39,53 @@ struct log_msg {
     const char *msg;
 };
 
+/*  Optional buffer for deferred messages. Entries are a struct
+ *   log_entry header followed by the NUL terminated message. Each entry
+ *   records the pid which logged it, so a forked child does not emit
+ *   copies of messages that belong to its parent.
+ */
+struct log_entry {
+    int level;
+    pid_t pid;
+    size_t len;
+};
+
+struct log_buffer {
+    char *data;
+    size_t size;
+    size_t used;
+};
+
 struct imp_logger {
     int level;
+    int maxlevel;   /* highest level any output will accept */
     const char *prefix;
     hash_t outputs;
+    struct log_buffer buffer;
 };
 
 static struct imp_logger imp_logger;
 
+struct trace_phase {
+    const char *name;
+    struct timespec ts;
+};
+
+/*  Phase timestamps are kept in a fixed array so that imp_trace() is
+ *   cheap and cannot fail. Timestamps are CLOCK_MONOTONIC, reported
+ *   relative to `t0`, while `start` (CLOCK_REALTIME) allows lines from
+ *   different nodes to be lined up.
+ */
+struct imp_trace {
+    const char *cmd;
+    struct timespec t0;
+    struct timespec start;
+    int count;
+    struct trace_phase phases [TRACE_MAX_PHASES];
+};
+
+static struct imp_trace imp_trace_state;
+
 /*
  *  Static functions:
  */
@@ -87,6 +130,35 @@ static int find_by_name (void *data __attribute__ ((unused)),
     return (!strcmp (key, name));
 }
 
+static int output_maxlevel (struct log_output *o,
+                            const char *x __attribute__ ((unused)),
+                            int *maxlevel)
+{
+    if (o->level > *maxlevel)
+        *maxlevel = o->level;
+    return (1);
+}
+
+/*  Recompute the highest level any output will accept, so that messages
+ *   no output wants can be discarded before they are formatted.
+ */
+static void log_update_maxlevel (void)
+{
+    int maxlevel = -1;
+    hash_for_each (imp_logger.outputs,
+                   (hash_arg_f) output_maxlevel,
+                   &maxlevel);
+    if (maxlevel > imp_logger.level)
+        maxlevel = imp_logger.level;
+    imp_logger.maxlevel = maxlevel;
+}
+
+static void log_atexit (void)
+{
+    imp_trace_flush ();
+    imp_log_flush ();
+}
+
 
 /*
  *  Log initialization and log output registration functions:
@@ -94,6 +166,7 @@ static int find_by_name (void *data __attribute__ ((unused)),
 void imp_openlog ()
 {
     extern char *__progname; /* or glibc program_invocation_short_name */
+    static bool atexit_registered = false;
 
     memset (&imp_logger, 0, sizeof (struct imp_logger));
     imp_logger.prefix = __progname;
@@ -102,13 +175,29 @@ void imp_openlog ()
                                          (hash_cmp_f) strcmp,
                                          (hash_del_f) log_output_destroy);
     imp_logger.level = IMP_LOG_INFO;
+    imp_logger.maxlevel = -1;
+
+    /*  Emit trace and deferred messages even when a command calls exit(3)
+     *   or imp_die() directly
+     */
+    if (!atexit_registered) {
+        atexit (log_atexit);
+        atexit_registered = true;
+    }
+
+    memset (&imp_trace_state, 0, sizeof (imp_trace_state));
+    clock_gettime (CLOCK_MONOTONIC, &imp_trace_state.t0);
+    clock_gettime (CLOCK_REALTIME, &imp_trace_state.start);
     return;
 }
 
 void imp_closelog ()
 {
+    imp_log_flush ();
+    free (imp_logger.buffer.data);
     hash_destroy (imp_logger.outputs);
     memset (&imp_logger, 0, sizeof (struct imp_logger));
+    imp_logger.maxlevel = -1;
 }
 
 int imp_log_add (const char *name, int level, imp_log_output_f fn, void *arg)
@@ -126,6 +215,7 @@ int imp_log_add (const char *name, int level, imp_log_output_f fn, void *arg)
     if (!(p = log_output_create (name, level, fn, arg)) ||
         !hash_insert (imp_logger.outputs, p->name, p))
         return (-1);
+    log_update_maxlevel ();
     return (0);
 }
 
@@ -134,8 +224,10 @@ int imp_log_remove (char *name)
     int count = hash_delete_if (imp_logger.outputs,
                                 (hash_arg_f) find_by_name,
                                 name);
-    if (count > 0)
+    if (count > 0) {
+        log_update_maxlevel ();
         return (0);
+    }
     if (count == 0)
         errno = ENOENT;
     return (-1);
@@ -154,6 +246,7 @@ int imp_log_set_level (const char *name, int level)
      */
     if (name == NULL) {
         imp_logger.level = level;
+        log_update_maxlevel ();
         return (0);
     }
 
@@ -164,6 +257,25 @@ int imp_log_set_level (const char *name, int level)
         return (-1);
     }
     p->level = level;
+    log_update_maxlevel ();
+    return (0);
+}
+
+int imp_log_set_buffer (int size)
+{
+    char *data = NULL;
+
+    if (size < 0 || (size > 0 && size < 1024)) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (size > 0 && !(data = malloc (size)))
+        return (-1);
+    imp_log_flush ();
+    free (imp_logger.buffer.data);
+    imp_logger.buffer.data = data;
+    imp_logger.buffer.size = size;
+    imp_logger.buffer.used = 0;
     return (0);
 }
 
@@ -171,15 +283,66 @@ int imp_log_set_level (const char *name, int level)
 /*
  *   Logging interface functions
  */
-static void vlog_msg (int level, const char *format, va_list ap,
-                      hash_t outputs)
+static void log_dispatch (int level, const char *msg)
+{
+    struct log_msg arg = { .level = level, .msg = msg };
+    hash_for_each (imp_logger.outputs, (hash_arg_f) log_output_call, &arg);
+}
+
+static size_t log_entry_size (size_t len)
+{
+    size_t n = sizeof (struct log_entry) + len + 1;
+    size_t align = sizeof (struct log_entry);
+    return ((n + align - 1) / align) * align;
+}
+
+void imp_log_flush (void)
+{
+    struct log_buffer *b = &imp_logger.buffer;
+    pid_t pid = getpid ();
+    size_t offset = 0;
+
+    /*  Reset buffer first, in case an output logs a message */
+    size_t used = b->used;
+    b->used = 0;
+
+    while (offset < used) {
+        struct log_entry *e = (struct log_entry *) (b->data + offset);
+        if (e->pid == pid)
+            log_dispatch (e->level, (char *) (e + 1));
+        offset += log_entry_size (e->len);
+    }
+}
+
+/*  Append message to log buffer, flushing first if it does not fit.
+ *   Returns -1 if the message should be emitted immediately instead.
+ */
+static int log_buffer_append (int level, const char *msg, size_t len)
+{
+    struct log_buffer *b = &imp_logger.buffer;
+    struct log_entry *e;
+    size_t n = log_entry_size (len);
+
+    if (n > b->size)
+        return (-1);
+    if (b->used + n > b->size)
+        imp_log_flush ();
+    e = (struct log_entry *) (b->data + b->used);
+    e->level = level;
+    e->pid = getpid ();
+    e->len = len;
+    memcpy (e + 1, msg, len + 1);
+    b->used += n;
+    return (0);
+}
+
+static void vlog_msg (int level, const char *format, va_list ap)
 {
-    struct log_msg arg = { .level = level, .msg = NULL };
     char  buf [4096];
     int   n = 0;
     int   len = sizeof (buf);
 
-    if (format == NULL)
+    if (format == NULL || level > imp_logger.maxlevel)
         return;
 
     n = vsnprintf (buf, len, format, ap);
@@ -192,53 +355,112 @@ static void vlog_msg (int level, const char *format, va_list ap,
         strcpy (q, suffix);
         q += strlen (suffix);
         *q = '\0';
+        n = q - buf;
     }
 
-    arg.msg = buf;
-    hash_for_each (outputs, (hash_arg_f) log_output_call, (void *) &arg);
+    /*  Warnings and errors are never deferred, and flush anything
+     *   buffered before them so that message order is preserved.
+     */
+    if (imp_logger.buffer.data
+        && level > IMP_LOG_WARNING
+        && log_buffer_append (level, buf, n) == 0)
+        return;
+    imp_log_flush ();
+    log_dispatch (level, buf);
 }
 
 void imp_say (const char *fmt, ...)
 {
     va_list ap;
-    if (imp_logger.level < IMP_LOG_INFO)
+    if (imp_logger.maxlevel < IMP_LOG_INFO)
         return;
     va_start (ap, fmt);
-    vlog_msg (IMP_LOG_INFO, fmt, ap, imp_logger.outputs);
+    vlog_msg (IMP_LOG_INFO, fmt, ap);
     va_end (ap);
 }
 
 void imp_warn (const char *fmt, ...)
 {
     va_list ap;
-    if (imp_logger.level < IMP_LOG_WARNING)
+    if (imp_logger.maxlevel < IMP_LOG_WARNING)
         return;
     va_start (ap, fmt);
-    vlog_msg (IMP_LOG_WARNING, fmt, ap, imp_logger.outputs);
+    vlog_msg (IMP_LOG_WARNING, fmt, ap);
     va_end (ap);
 }
 
 void imp_debug (const char *fmt, ...)
 {
     va_list ap;
-    if (imp_logger.level < IMP_LOG_DEBUG)
+    if (imp_logger.maxlevel < IMP_LOG_DEBUG)
         return;
     va_start (ap, fmt);
-    vlog_msg (IMP_LOG_DEBUG, fmt, ap, imp_logger.outputs);
+    vlog_msg (IMP_LOG_DEBUG, fmt, ap);
     va_end (ap);
 }
 
 void imp_die (int code, const char *fmt, ...)
 {
     va_list ap;
-    if (imp_logger.level >= IMP_LOG_FATAL) {
+    if (imp_logger.maxlevel >= IMP_LOG_FATAL) {
         va_start (ap, fmt);
-        vlog_msg (IMP_LOG_FATAL, fmt, ap, imp_logger.outputs);
+        vlog_msg (IMP_LOG_FATAL, fmt, ap);
         va_end (ap);
     }
     exit (code);
 }
 
+/*
+ *   Phase tracing
+ */
+void imp_trace (const char *phase)
+{
+    struct trace_phase *p;
+
+    if (imp_trace_state.count == TRACE_MAX_PHASES)
+        return;
+    p = &imp_trace_state.phases [imp_trace_state.count++];
+    p->name = phase;
+    clock_gettime (CLOCK_MONOTONIC, &p->ts);
+}
+
+void imp_trace_enable (const char *cmd)
+{
+    imp_trace_state.cmd = cmd ? cmd : "-";
+}
+
+static double ts_diff (struct timespec *t1, struct timespec *t0)
+{
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1E9;
+}
+
+void imp_trace_flush (void)
+{
+    struct imp_trace *t = &imp_trace_state;
+    char buf [1024];
+    int len = sizeof (buf);
+    int n;
+    int i;
+
+    if (!t->cmd || t->count == 0 || !imp_logger.outputs)
+        return;
+
+    /*  e.g. trace: pid=123 cmd=exec start=1540000000.000000
+     *        imp_conf_load=0.000210 privsep_init=0.000312 ...
+     */
+    n = snprintf (buf, len, "trace: pid=%ld cmd=%s start=%ld.%06ld",
+                  (long) getpid (),
+                  t->cmd,
+                  (long) t->start.tv_sec,
+                  (long) t->start.tv_nsec / 1000);
+    for (i = 0; i < t->count && n < len; i++)
+        n += snprintf (buf + n, len - n, " %s=%.6f",
+                       t->phases[i].name,
+                       ts_diff (&t->phases[i].ts, &t->t0));
+    t->count = 0;
+    imp_say ("%s", buf);
+}
+
 const char *imp_log_strlevel (int level)
 {
     if (level == IMP_LOG_FATAL)
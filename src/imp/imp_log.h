@@ -30,6 +30,35 @@ void imp_debug (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
 void __attribute__((noreturn)) imp_die (int code, const char *fmt, ...)
      __attribute__ ((format (printf, 2, 3)));
 
+/*  Defer messages below warning level to a buffer of `size` bytes
+ *   instead of calling log outputs synchronously. The buffer is flushed
+ *   when full, before any warning or fatal message, by imp_log_flush(),
+ *   and at exit. A `size` of 0 disables buffering.
+ *
+ *  Returns 0 on success, -1 on error with errno set.
+ *   EINVAL - `size` is nonzero but less than 1024
+ */
+int imp_log_set_buffer (int size);
+
+/*  Emit any buffered messages to IMP logging destination(s) */
+void imp_log_flush (void);
+
+/*  Record the time at which `phase` completed, relative to imp_openlog().
+ *   Phases are only recorded, not logged, until imp_trace_enable().
+ */
+void imp_trace (const char *phase);
+
+/*  Enable phase tracing for command `cmd`. Recorded phases are then
+ *   emitted as a single line of key=value pairs by imp_trace_flush(),
+ *   which is also called at exit.
+ */
+void imp_trace_enable (const char *cmd);
+
+/*  Emit phases recorded so far to IMP logging destination(s) if tracing
+ *   is enabled, then forget them.
+ */
+void imp_trace_flush (void);
+
 /*
  *  Logging output provider prototype:
  */
@@ -19,6 +19,9 @@ struct imp_state {
     char     **argv;        /* cmdline arguments from main() */
     cf_t      *conf;        /* IMP configuration */
     privsep_t *ps;          /* Privilege separation handle */
+
+    cf_set_t  *allowed_users;   /* exec.allowed-users, indexed at load */
+    cf_set_t  *allowed_shells;  /* exec.allowed-shells, indexed at load */
 };
 
 #endif /* !HAVE_IMP_STATE_H */
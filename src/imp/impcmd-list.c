@@ -20,6 +20,9 @@ extern int imp_exec_unprivileged (struct imp_state *imp, struct kv *);
 extern int imp_exec_privileged (struct imp_state *imp, struct kv *);
 extern int imp_kill_unprivileged (struct imp_state *imp, struct kv *);
 extern int imp_kill_privileged (struct imp_state *imp, struct kv *);
+extern int imp_config_stats (struct imp_state *imp, struct kv *);
+extern int imp_service_unprivileged (struct imp_state *imp, struct kv *);
+extern int imp_service_privileged (struct imp_state *imp, struct kv *);
 
 /*  List of supported imp commands, curated by hand for now.
  *   For each named command, the `child_fn` runs unprivileged and the
@@ -42,6 +45,11 @@ struct impcmd impcmd_list[] = {
     { "kill",
       imp_kill_unprivileged,
       imp_kill_privileged },
+    { "config-stats",
+      imp_config_stats, NULL },
+    { "service",
+      imp_service_unprivileged,
+      imp_service_privileged },
 	{ NULL, NULL, NULL}
 };
 
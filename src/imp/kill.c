@@ -26,6 +26,15 @@
  *  flux-imp kill may authorize signal delivery to any task where
  *  the tasks cgroup is owned by the requesting user.
  *
+ *  Several pids may be given, e.g. to signal all tasks of a job on
+ *  cancellation. The owner of each distinct cgroup is looked up once,
+ *  and every pid is attempted even if signaling an earlier one fails.
+ *
+ *  With `flux-imp kill --cgroup SIGNAL PATH`, all tasks in the cgroup
+ *  at PATH and its descendants are signaled, if the cgroup is owned by
+ *  the requesting user. SIGKILL uses cgroup v2 cgroup.kill when the
+ *  kernel supports it; otherwise cgroup.procs is read once per cgroup.
+ *
  */
 
 #if HAVE_CONFIG_H
@@ -38,9 +47,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <pwd.h>
 #include <signal.h>
 
@@ -50,6 +63,7 @@
 #include "imp_state.h"
 #include "impcmd.h"
 #include "privsep.h"
+#include "passwd.h"
 
 struct pid_info {
     pid_t pid;
@@ -58,15 +72,34 @@ struct pid_info {
     uid_t cg_owner;
 };
 
-/*  Hard-coded path to systemd cgroup mount directory. This may
- *   need to be moved to configuration at some point.
+/*  Owners of cgroup directories already looked up in this invocation.
+ */
+struct cg_owner {
+    struct cg_owner *next;
+    uid_t owner;
+    char path[];
+};
+
+/*  Hard-coded paths to systemd cgroup mount directory, and to the
+ *   unified (cgroup v2) hierarchy mount. These may need to be moved
+ *   to configuration at some point.
  */
 static const char cgroup_mount_dir[] = "/sys/fs/cgroup/systemd";
+static const char cgroup_unified_mount_dir[] = "/sys/fs/cgroup";
+
+#ifndef CGROUP_SUPER_MAGIC
+#define CGROUP_SUPER_MAGIC 0x27e0eb
+#endif
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC 0x63677270
+#endif
 
 /*  Return the systemd cgroup path for PID `pid` in the provided buffer
  *  Looks up the 'name=systemd'[*] subsystem relative cgroup path in
  *   /proc/PID/cgroups and prepends `cgroup_mount_dir` to get the
- *   full path.
+ *   full path. On systems with only the unified hierarchy, there is
+ *   no 'name=systemd' entry, so the "0::" entry is used, relative to
+ *   `cgroup_unified_mount_dir`.
  *
  *  [*] perhaps could also use the "pids" cgroup.
  */
@@ -78,6 +111,7 @@ static int pid_systemd_cgroup_path (pid_t pid, char *buf, int len)
     int n;
     char file [4096];
     char *line = NULL;
+    char *unified = NULL;
 
     n = snprintf (file, sizeof(file), "/proc/%ju/cgroup", (uintmax_t) pid);
     if ((n < 0) || (n >= (int) sizeof(file))
@@ -101,8 +135,16 @@ static int pid_systemd_cgroup_path (pid_t pid, char *buf, int len)
                 rc = 0;
             break;
         }
+        if (strncmp (line, "0:", 2) == 0 && *subsys == '\0' && !unified)
+            unified = strdup (relpath);
+    }
+    if (rc < 0 && unified) {
+        n = snprintf (buf, len, "%s%s", cgroup_unified_mount_dir, unified);
+        if ((n > 0) && (n < len))
+            rc = 0;
     }
 
+    free (unified);
     free (line);
     fclose (fp);
     return rc;
@@ -130,12 +172,44 @@ static uid_t pid_owner (pid_t pid)
     return path_owner (path);
 }
 
+static void cg_owner_cache_destroy (struct cg_owner *cache)
+{
+    while (cache) {
+        struct cg_owner *next = cache->next;
+        free (cache);
+        cache = next;
+    }
+}
+
+/*  Return the owner of cgroup directory `path`, using and updating
+ *   `cachep` so that each cgroup is only stat'd once.
+ */
+static uid_t cg_owner_lookup (struct cg_owner **cachep, const char *path)
+{
+    struct cg_owner *cg;
+    uid_t owner;
+
+    for (cg = *cachep; cg != NULL; cg = cg->next) {
+        if (strcmp (cg->path, path) == 0)
+            return cg->owner;
+    }
+    if ((owner = path_owner (path)) == (uid_t) -1)
+        return owner;
+    if ((cg = malloc (sizeof (*cg) + strlen (path) + 1))) {
+        strcpy (cg->path, path);
+        cg->owner = owner;
+        cg->next = *cachep;
+        *cachep = cg;
+    }
+    return owner;
+}
+
 static void pid_info_destroy (struct pid_info *pi)
 {
     free (pi);
 }
 
-static struct pid_info *pid_info_create (pid_t pid)
+static struct pid_info *pid_info_create (pid_t pid, struct cg_owner **cachep)
 {
     struct pid_info *pi = calloc (1, sizeof (*pi));
     if (pi == NULL)
@@ -143,11 +217,17 @@ static struct pid_info *pid_info_create (pid_t pid)
     if (pid < 0)
         pid = -pid;
     pi->pid = pid;
-    if ((pi->pid_owner = pid_owner (pid)) == (uid_t) -1)
-        goto err;
     if (pid_systemd_cgroup_path (pid, pi->cg_path, sizeof (pi->cg_path)) < 0)
         goto err;
-    if ((pi->cg_owner = path_owner (pi->cg_path)) == (uid_t) -1)
+    if ((pi->cg_owner = cg_owner_lookup (cachep, pi->cg_path)) == (uid_t) -1)
+        goto err;
+
+    /*  The pid owner is only consulted if the cgroup owner is not the
+     *   IMP user, so skip the lookup when signaling tasks of own jobs.
+     */
+    if (pi->cg_owner == getuid ())
+        pi->pid_owner = (uid_t) -1;
+    else if ((pi->pid_owner = pid_owner (pid)) == (uid_t) -1)
         goto err;
 
     return pi;
@@ -160,100 +240,357 @@ err:
  *   'flux-imp kill'. This is the same set of users allowed to run
  *   'flux-imp exec', so look in exec.allowed-users.
  */
-static bool imp_kill_allowed (const cf_t *conf)
+static bool imp_kill_allowed (struct imp_state *imp)
 {
-    struct passwd * pwd = getpwuid (getuid ());
-    const cf_t *exec = cf_get_in (conf, "exec");
+    const struct passwd * pwd = passwd_lookup_uid (getuid ());
 
-    if (pwd && exec)
-        return cf_array_contains (cf_get_in (exec, "allowed-users"),
-                                  pwd->pw_name);
+    if (pwd)
+        return cf_set_contains (imp->allowed_users, pwd->pw_name);
     return false;
 }
 
-static void check_and_kill_process (struct imp_state *imp, pid_t pid, int sig)
+/*  Check that the IMP user owns `pid` or its cgroup and send it `sig`.
+ *   Returns 0 on success, -1 with a warning issued on failure.
+ */
+static int check_and_kill_process (pid_t pid,
+                                   int sig,
+                                   struct cg_owner **cachep)
 {
     uid_t user = getuid ();
     struct pid_info *p = NULL;
+    int rc = -1;
 
-    if (!imp_kill_allowed (imp->conf))
-        imp_die (1, "kill command not allowed");
-
-    if (!(p = pid_info_create ((pid_t) pid)))
-        imp_die (1, "kill: failed to initialize pid info: %s",
-                    strerror (errno));
+    if (!(p = pid_info_create ((pid_t) pid, cachep))) {
+        imp_warn ("kill: failed to initialize pid info: %s",
+                  strerror (errno));
+        return -1;
+    }
 
     /* Check if pid is in pids cgroup owned by IMP user */
     if (p->cg_owner != user
-        && p->pid_owner != user)
-        imp_die (1,
+        && p->pid_owner != user) {
+        imp_warn (
             "kill: refusing request from uid=%ju to kill pid %jd (owner=%ju)",
             (uintmax_t) user,
             (intmax_t) pid,
             (uintmax_t) p->cg_owner);
+        goto out;
+    }
 
-    if (kill (pid, sig) < 0)
-        imp_die (1, "kill: %jd sig=%ju: %s",
-                    (intmax_t) pid,
-                    (uintmax_t) sig,
-                    strerror (errno));
-
+    if (kill (pid, sig) < 0) {
+        imp_warn ("kill: %jd sig=%ju: %s",
+                  (intmax_t) pid,
+                  (uintmax_t) sig,
+                  strerror (errno));
+        goto out;
+    }
+    rc = 0;
+out:
     pid_info_destroy (p);
+    return rc;
+}
+
+/*  Signal all `npids` pids in `pids`. Returns 0 if all were signaled,
+ *   -1 if any failed.
+ */
+static int check_and_kill_processes (struct imp_state *imp,
+                                     const int64_t *pids,
+                                     int npids,
+                                     int sig)
+{
+    struct cg_owner *cache = NULL;
+    int rc = 0;
+    int i;
+
+    if (!imp_kill_allowed (imp))
+        imp_die (1, "kill command not allowed");
+
+    for (i = 0; i < npids; i++) {
+        if (check_and_kill_process (pids[i], sig, &cache) < 0)
+            rc = -1;
+    }
+    cg_owner_cache_destroy (cache);
+    return rc;
+}
+
+/*  Open cgroup directory `path` relative to `dirfd` and check that it
+ *   is a cgroup owned by the IMP user. The directory is checked through
+ *   the open fd, so that `path` cannot be swapped after the check, and
+ *   must be on a cgroup filesystem, so that the IMP is never directed
+ *   to signal pids listed in an arbitrary user-owned file.
+ */
+static int cgroup_open (int dirfd, const char *path)
+{
+    struct statfs fs;
+    struct stat st;
+    int fd;
+
+    if ((fd = openat (dirfd,
+                      path,
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0) {
+        imp_warn ("kill: %s: %s", path, strerror (errno));
+        return -1;
+    }
+    if (fstatfs (fd, &fs) < 0 || fstat (fd, &st) < 0) {
+        imp_warn ("kill: %s: %s", path, strerror (errno));
+        goto err;
+    }
+    if (fs.f_type != CGROUP_SUPER_MAGIC && fs.f_type != CGROUP2_SUPER_MAGIC) {
+        imp_warn ("kill: %s: not a cgroup", path);
+        goto err;
+    }
+    if (st.st_uid != getuid ()) {
+        imp_warn ("kill: refusing request from uid=%ju to kill cgroup %s"
+                  " (owner=%ju)",
+                  (uintmax_t) getuid (),
+                  path,
+                  (uintmax_t) st.st_uid);
+        goto err;
+    }
+    return fd;
+err:
+    close (fd);
+    return -1;
+}
+
+/*  Kill all tasks in cgroup `fd` and its descendants with cgroup v2
+ *   cgroup.kill. Returns 1 if cgroup.kill is not available.
+ */
+static int cgroup_kill_file (int fd, const char *path)
+{
+    int kfd;
+    int rc = 0;
+
+    if ((kfd = openat (fd, "cgroup.kill", O_WRONLY | O_CLOEXEC)) < 0) {
+        if (errno == ENOENT)
+            return 1;
+        imp_warn ("kill: %s/cgroup.kill: %s", path, strerror (errno));
+        return -1;
+    }
+    if (write (kfd, "1", 1) != 1) {
+        imp_warn ("kill: %s/cgroup.kill: %s", path, strerror (errno));
+        rc = -1;
+    }
+    close (kfd);
+    return rc;
 }
 
+/*  Send `sig` to every pid in cgroup.procs of cgroup `fd`, then
+ *   recurse into child cgroups.
+ */
+static int cgroup_signal_procs (int fd, const char *path, int sig)
+{
+    FILE *fp;
+    DIR *dir;
+    struct dirent *dent;
+    int pfd;
+    int dfd;
+    intmax_t pid;
+    int rc = 0;
+
+    if ((pfd = openat (fd, "cgroup.procs", O_RDONLY | O_CLOEXEC)) < 0
+        || !(fp = fdopen (pfd, "r"))) {
+        imp_warn ("kill: %s/cgroup.procs: %s", path, strerror (errno));
+        if (pfd >= 0)
+            close (pfd);
+        return -1;
+    }
+    while (fscanf (fp, "%jd", &pid) == 1) {
+        if (pid > 0 && kill ((pid_t) pid, sig) < 0 && errno != ESRCH) {
+            imp_warn ("kill: %jd sig=%d: %s", pid, sig, strerror (errno));
+            rc = -1;
+        }
+    }
+    fclose (fp);
 
-/*  Read pid and signal from the privsep pipe, then check if user
- *   is allowed to kill the target process.
+    if ((dfd = dup (fd)) < 0 || !(dir = fdopendir (dfd))) {
+        imp_warn ("kill: %s: %s", path, strerror (errno));
+        if (dfd >= 0)
+            close (dfd);
+        return -1;
+    }
+    while ((dent = readdir (dir))) {
+        char subpath [4096];
+        int cfd;
+
+        if (dent->d_type != DT_DIR
+            || strcmp (dent->d_name, ".") == 0
+            || strcmp (dent->d_name, "..") == 0)
+            continue;
+        (void) snprintf (subpath, sizeof (subpath),
+                         "%s/%s", path, dent->d_name);
+        if ((cfd = cgroup_open (fd, dent->d_name)) < 0) {
+            rc = -1;
+            continue;
+        }
+        if (cgroup_signal_procs (cfd, subpath, sig) < 0)
+            rc = -1;
+        close (cfd);
+    }
+    closedir (dir);
+    return rc;
+}
+
+/*  Signal all tasks in cgroup `path` and its descendants. SIGKILL
+ *   uses cgroup.kill where available, which is atomic with respect to
+ *   tasks forking in the cgroup. Otherwise cgroup.procs is read once
+ *   per cgroup.
+ */
+static int check_and_kill_cgroup (struct imp_state *imp,
+                                  const char *path,
+                                  int sig)
+{
+    int fd;
+    int rc = 1;
+
+    if (!imp_kill_allowed (imp))
+        imp_die (1, "kill command not allowed");
+    if (path[0] != '/')
+        imp_die (1, "kill: cgroup path must be absolute");
+    if ((fd = cgroup_open (AT_FDCWD, path)) < 0)
+        return -1;
+    if (sig == SIGKILL)
+        rc = cgroup_kill_file (fd, path);
+    if (rc > 0)
+        rc = cgroup_signal_procs (fd, path, sig);
+    close (fd);
+    return rc;
+}
+
+/*  Read pid(s) and signal from the privsep pipe, then check if user
+ *   is allowed to kill the target processes. A single pid is sent
+ *   as "pid", several as "npids" and "pid.0" ... "pid.N-1", and a
+ *   cgroup as "cgroup".
  */
 int imp_kill_privileged (struct imp_state *imp, struct kv *kv)
 {
-    int64_t pid;
+    int64_t *pids;
+    int64_t npids = 1;
     int64_t signum;
+    int rc;
+    int i;
+
+    const char *cgroup;
 
-    if (kv_get (kv, "pid", KV_INT64, &pid) < 0)
-        imp_die (1, "kill: failed to get pid");
     if (kv_get (kv, "signal", KV_INT64, &signum) < 0)
         imp_die (1, "kill: failed to get signal");
+    if (kv_get (kv, "cgroup", KV_STRING, &cgroup) == 0)
+        return check_and_kill_cgroup (imp, cgroup, signum);
+    if (kv_get (kv, "npids", KV_INT64, &npids) == 0
+        && (npids <= 0 || npids > INT_MAX))
+        imp_die (1, "kill: invalid pid count");
+    if (!(pids = calloc (npids, sizeof (pids[0]))))
+        imp_die (1, "kill: Out of memory");
+
+    if (kv_get (kv, "npids", KV_INT64, NULL) < 0) {
+        if (kv_get (kv, "pid", KV_INT64, &pids[0]) < 0)
+            imp_die (1, "kill: failed to get pid");
+    }
+    else {
+        for (i = 0; i < npids; i++) {
+            char key[32];
+            (void) snprintf (key, sizeof (key), "pid.%d", i);
+            if (kv_get (kv, key, KV_INT64, &pids[i]) < 0)
+                imp_die (1, "kill: failed to get pid");
+        }
+    }
+    rc = check_and_kill_processes (imp, pids, npids, signum);
+    free (pids);
+    return rc;
+}
+
+/*  flux-imp kill --cgroup SIGNAL PATH
+ */
+static int imp_kill_cgroup_unprivileged (struct imp_state *imp,
+                                         struct kv *kv)
+{
+    char *p = NULL;
+    int64_t signum;
+    const char *path;
+
+    if (imp->argc != 5)
+        imp_die (1, "kill: Usage flux-imp kill --cgroup SIGNAL PATH");
+    if ((signum = strtol (imp->argv[3], &p, 10)) <= 0
+        || *p != '\0')
+        imp_die (1, "kill: invalid SIGNAL %s", imp->argv[3]);
+    path = imp->argv[4];
+    if (path[0] != '/')
+        imp_die (1, "kill: cgroup path must be absolute");
+
+    if (kv_put (kv, "cgroup", KV_STRING, path) < 0)
+        imp_die (1, "kill: kv_put cgroup: %s", strerror (errno));
+    if (kv_put (kv, "signal", KV_INT64, signum) < 0)
+        imp_die (1, "kill: kv_put signum: %s", strerror (errno));
 
-    check_and_kill_process (imp, pid, signum);
+    if (!imp->ps)
+        return check_and_kill_cgroup (imp, path, signum);
+    if (privsep_write_kv (imp->ps, kv) < 0)
+        imp_die (1, "kill: failed to communicate with privsep parent");
     return 0;
 }
 
-/*  Unprivileged process reads signal and pid from cmdline and
+/*  Unprivileged process reads signal and pid(s) from cmdline and
  *   sends to parent over privsep pipe. If not running privileged,
  *   try killing as requesting user (used for testing).
  */
 int imp_kill_unprivileged (struct imp_state *imp, struct kv *kv)
 {
     char *p = NULL;
-    int64_t pid = 0;
+    int64_t *pids;
     int64_t signum = -1;
+    int npids;
+    int rc = 0;
+    int i;
+
+    if (imp->argc > 2 && strcmp (imp->argv[2], "--cgroup") == 0)
+        return imp_kill_cgroup_unprivileged (imp, kv);
 
     if (imp->argc < 4)
-        imp_die (1, "kill: Usage flux-imp kill SIGNAL PID");
+        imp_die (1, "kill: Usage flux-imp kill SIGNAL PID [PID...]");
 
     if ((signum = strtol (imp->argv[2], &p, 10)) <= 0
         || *p != '\0')
         imp_die (1, "kill: invalid SIGNAL %s", imp->argv[2]);
 
-    /*  PID of 0 is explicitly forbidden here as it could be used
-     *   to inadvertenly kill our parent.
-     */
-    if ((pid = strtol (imp->argv[3], &p, 10)) == 0
-        || *p != '\0')
-        imp_die (1, "kill: invalid PID %s", imp->argv[3]);
+    npids = imp->argc - 3;
+    if (!(pids = calloc (npids, sizeof (pids[0]))))
+        imp_die (1, "kill: Out of memory");
+
+    for (i = 0; i < npids; i++) {
+        const char *arg = imp->argv[i + 3];
 
-    if (kv_put (kv, "pid", KV_INT64, pid) < 0)
-        imp_die (1, "kill: kv_put pid: %s", strerror (errno));
+        /*  PID of 0 is explicitly forbidden here as it could be used
+         *   to inadvertenly kill our parent.
+         */
+        if ((pids[i] = strtol (arg, &p, 10)) == 0
+            || *p != '\0')
+            imp_die (1, "kill: invalid PID %s", arg);
+    }
+
+    if (npids == 1) {
+        if (kv_put (kv, "pid", KV_INT64, pids[0]) < 0)
+            imp_die (1, "kill: kv_put pid: %s", strerror (errno));
+    }
+    else {
+        if (kv_put (kv, "npids", KV_INT64, (int64_t) npids) < 0)
+            imp_die (1, "kill: kv_put npids: %s", strerror (errno));
+        for (i = 0; i < npids; i++) {
+            char key[32];
+            (void) snprintf (key, sizeof (key), "pid.%d", i);
+            if (kv_put (kv, key, KV_INT64, pids[i]) < 0)
+                imp_die (1, "kill: kv_put pid: %s", strerror (errno));
+        }
+    }
     if (kv_put (kv, "signal", KV_INT64, signum) < 0)
         imp_die (1, "kill: kv_put signum: %s", strerror (errno));
 
     if (!imp->ps)
-        check_and_kill_process (imp, pid, signum);
+        rc = check_and_kill_processes (imp, pids, npids, signum);
     else if (privsep_write_kv (imp->ps, kv) < 0)
         imp_die (1, "kill: failed to communicate with privsep parent");
 
-    return 0;
+    free (pids);
+    return rc;
 }
 
 /* vi: ts=4 sw=4 expandtab
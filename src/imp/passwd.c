@@ -17,7 +17,17 @@
 
 #include "passwd.h"
 
-static struct passwd * passwd_copy (struct passwd *arg)
+/*  Cached passwd entries. The IMP looks up only a handful of users
+ *   (itself and job owners), so a list is sufficient.
+ */
+struct passwd_entry {
+    struct passwd_entry *next;
+    struct passwd *pwd;
+};
+
+static struct passwd_entry *passwd_cache = NULL;
+
+static struct passwd * passwd_copy (const struct passwd *arg)
 {
     struct passwd *pwd = calloc (1, sizeof (*pwd));
     if (pwd) {
@@ -35,11 +45,42 @@ static struct passwd * passwd_copy (struct passwd *arg)
     return pwd;
 }
 
-struct passwd * passwd_from_uid (uid_t uid)
+const struct passwd * passwd_lookup_uid (uid_t uid)
 {
-    struct passwd *pwd = NULL;
+    struct passwd_entry *entry;
+    struct passwd *pwd;
+
+    for (entry = passwd_cache; entry != NULL; entry = entry->next) {
+        if (entry->pwd->pw_uid == uid)
+            return entry->pwd;
+    }
     if (!(pwd = getpwuid (uid)))
         return NULL;
+    if (!(entry = calloc (1, sizeof (*entry)))
+        || !(entry->pwd = passwd_copy (pwd))) {
+        free (entry);
+        return NULL;
+    }
+    entry->next = passwd_cache;
+    passwd_cache = entry;
+    return entry->pwd;
+}
+
+void passwd_cache_clear (void)
+{
+    while (passwd_cache) {
+        struct passwd_entry *next = passwd_cache->next;
+        passwd_destroy (passwd_cache->pwd);
+        free (passwd_cache);
+        passwd_cache = next;
+    }
+}
+
+struct passwd * passwd_from_uid (uid_t uid)
+{
+    const struct passwd *pwd = NULL;
+    if (!(pwd = passwd_lookup_uid (uid)))
+        return NULL;
     return passwd_copy (pwd);
 }
 
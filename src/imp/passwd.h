@@ -15,7 +15,21 @@
 #include <sys/types.h>
 
 /*
- *  Return a copy of the passwd entry for UID
+ *  Return the passwd entry for UID from a per-process cache, looking
+ *   it up on first use. The entry is owned by the cache and remains
+ *   valid until passwd_cache_clear(). Entries cached before fork(2)
+ *   are available to the child without another lookup, so the IMP
+ *   resolves its own user before privsep_init().
+ */
+const struct passwd * passwd_lookup_uid (uid_t uid);
+
+/*
+ *  Drop all cached passwd entries.
+ */
+void passwd_cache_clear (void);
+
+/*
+ *  Return a copy of the passwd entry for UID (via the cache)
  *  Caller must free with passwd_destroy()
  */
 struct passwd * passwd_from_uid (uid_t uid);
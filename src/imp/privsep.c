@@ -12,19 +12,16 @@
 #include "config.h"
 #endif
 
-#include <assert.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
 #include <errno.h>
 
-/*  Max size of KV array allowed to be sent over privsep pipe */
-#define PRIVSEP_MAX_KVLEN 1024*1024*4
-
 #include "privsep.h"
 #include "imp_log.h"
 
@@ -41,24 +38,6 @@ struct privsep {
     int rfd;       /* Copy of current process' read fd  */
 };
 
-static int wakeup_child (privsep_t *ps)
-{
-    char c = 0;
-    assert (privsep_is_parent (ps));
-    if (write (ps->wfd, &c, sizeof (c)) != sizeof (c))
-        return (-1);
-    return (0);
-}
-
-static int wait_for_parent (privsep_t *ps)
-{
-    char c;
-    assert (privsep_is_child (ps));
-    if (read (ps->rfd, &c, sizeof (c)) != sizeof (c))
-        return (-1);
-    return (0);
-}
-
 void drop_privileges ()
 {
     uid_t ruid = -1, euid, suid;
@@ -107,6 +86,16 @@ static void parent_pfds_setup (privsep_t *ps)
     ps->upfds[0] = -1;
 }
 
+/*  The child is created with a plain fork(2). vfork(2) or clone(2) with
+ *   CLONE_VM would let the unprivileged child run arbitrary code in the
+ *   privileged parent's address space, and spawning a separate helper
+ *   requires an exec and reloading configuration, which costs more than
+ *   the fork of a process as small as the IMP (see bench_privsep).
+ *
+ *  Both pipes exist before fork and parent setup cannot fail once the
+ *   child is running, so the child does not wait for the parent before
+ *   calling `fn`.
+ */
 static int
 run_unprivileged_child (privsep_t *ps, privsep_child_f fn, void *arg)
 {
@@ -119,8 +108,6 @@ run_unprivileged_child (privsep_t *ps, privsep_child_f fn, void *arg)
         /* Now drop privileges. This is fatal on error */
         drop_privileges ();
         child_pfds_setup (ps);
-        if (wait_for_parent (ps) < 0)
-            imp_die (1, "wait_for_parent: %s", strerror (errno));
         fn (ps, arg);
         exit (0);
     }
@@ -158,11 +145,6 @@ privsep_t * privsep_init (privsep_child_f fn, void *arg)
         return (NULL);
     }
 
-    if (wakeup_child (ps) < 0) {
-        imp_warn ("wakeup_child: %s", strerror (errno));
-        privsep_destroy (ps);
-        return (NULL);
-    }
     return (ps);
 }
 
@@ -226,6 +208,38 @@ ssize_t privsep_write (privsep_t *ps, const void *buf, size_t count)
     return (count);
 }
 
+/*  Write all of iovec `iov` in as few write(2) calls as possible,
+ *   advancing through the vector on short writes.
+ */
+static ssize_t privsep_writev (privsep_t *ps, struct iovec *iov, int iovcnt)
+{
+    ssize_t total = 0;
+
+    if (!ps || ps->wfd < 0) {
+        errno = EINVAL;
+        return (-1);
+    }
+    while (iovcnt > 0) {
+        ssize_t n = writev (ps->wfd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        total += n;
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return (total);
+}
+
 ssize_t privsep_read (privsep_t *ps, void *buf, size_t count)
 {
     char *p;
@@ -260,6 +274,7 @@ struct kv * privsep_read_kv (privsep_t *ps)
     struct kv *kv = NULL;
     char *buf;
     int len;
+    int bufsz;
 
     /*
      *  First read length of kv that is being sent
@@ -273,9 +288,10 @@ struct kv * privsep_read_kv (privsep_t *ps)
     }
 
     /*
-     *  Allocate buffer big enough to fit incoming kv structure:
+     *  Allocate buffer big enough to fit incoming kv structure.
+     *   It is entirely overwritten below, so there is no need to zero it.
      */
-    if ((buf = calloc (1, len)) == NULL)
+    if ((buf = malloc (len)) == NULL)
         return (NULL);
 
     /*
@@ -288,16 +304,26 @@ struct kv * privsep_read_kv (privsep_t *ps)
         return (NULL);
     }
 
-    kv = kv_decode (buf, len);
+    /*
+     *  Hand the buffer to the kv object instead of copying it
+     */
+    bufsz = len;
+    if (!(kv = kv_create ()) || kv_decode_swap (kv, &buf, &bufsz, len) < 0) {
+        int saved_errno = errno;
+        kv_destroy (kv);
+        free (buf);
+        errno = saved_errno;
+        return (NULL);
+    }
     free (buf);
     return (kv);
 }
 
 ssize_t privsep_write_kv (privsep_t *ps, struct kv *kv)
 {
-    int n;
     int len;
     const char *buf;
+    struct iovec iov[2];
 
     if (kv_encode (kv, &buf, &len) < 0)
         return (-1);
@@ -307,15 +333,17 @@ ssize_t privsep_write_kv (privsep_t *ps, struct kv *kv)
         return (-1);
     }
 
-    /*  Write length first */
-    if (privsep_write (ps, &len, sizeof (len)) != sizeof (len))
-        return (-1);
-
-    /*  Then write encoded kv structure */
-    if ((n = privsep_write (ps, buf, len)) != len)
+    /*  Write length and encoded kv structure together as one frame,
+     *   directly from the kv buffer.
+     */
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof (len);
+    iov[1].iov_base = (void *) buf;
+    iov[1].iov_len = len;
+    if (privsep_writev (ps, iov, 2) != (ssize_t) (sizeof (len) + len))
         return (-1);
 
-    return (n);
+    return (len);
 }
 
 /*
@@ -16,6 +16,9 @@
 
 #include "src/libutil/kv.h"
 
+/*  Max size of encoded kv allowed to be sent over privsep pipe */
+#define PRIVSEP_MAX_KVLEN (1024*1024*64)
+
 typedef struct privsep privsep_t;
 
 typedef void (*privsep_child_f) (privsep_t *ps, void *arg);
@@ -60,7 +63,8 @@ ssize_t privsep_write (privsep_t *ps, const void *buf, size_t count);
 
 /*
  *  Write a struct kv over privsep pipe, returning size of the kv
- *   written on success, -1 on failure.
+ *   written on success, -1 on failure. The length and encoded kv
+ *   are written as a single frame, without copying the kv buffer.
  *
  *  Specific errno values include:
  *    EINVAL  - Invalid argument (bad privsep handle or struct kv)
@@ -70,7 +74,8 @@ ssize_t privsep_write_kv (privsep_t *ps, struct kv *kv);
 
 /*
  *  Read a struct kv from privsep pipe. Returns kv on success or NULL
- *   on failure with errno set.
+ *   on failure with errno set. The received buffer is adopted by the
+ *   returned kv rather than copied.
  *
  *  Specific errno values include:
  *    EINVAL  - Invalide privsep handle
@@ -0,0 +1,529 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* flux-imp service - long-lived IMP servicing exec and kill requests
+ *
+ * Usage: flux-imp service SOCKET
+ *
+ * PURPOSE:
+ *
+ *  Each `flux-imp exec` pays for loading the IMP, its configuration
+ *  and the security context (including the CA certificate) only to
+ *  throw it all away after one job shell is started. For high rate
+ *  job launch, an instance may instead start a single IMP service,
+ *  which loads this state once and then handles exec and kill
+ *  requests over a local socket.
+ *
+ * OPERATION:
+ *
+ *  The service must be enabled with `exec.allow-service = true` and
+ *  may only be started by a user in exec.allowed-users. It listens on
+ *  an AF_UNIX socket at SOCKET, created with mode 0600 as the user
+ *  running the IMP. Connections are only accepted from a peer with the
+ *  same uid, as reported by SO_PEERCRED.
+ *
+ *  Each connection carries one request and is handled in a forked
+ *  child of the service, so requests are isolated from each other and
+ *  from the service. The child performs the same checks as the
+ *  corresponding `flux-imp` command, and any failure terminates only
+ *  that child, closing the connection without a final status.
+ *
+ *  Configuration, the security context, and passwd entries looked up
+ *  by the service are loaded once and never reloaded for the life of
+ *  the service. Restart it to pick up changes to any of them.
+ *
+ * PROTOCOL:
+ *
+ *  The client sends, in a single sendmsg(2), the int length of the
+ *  encoded request kv along with its stdin, stdout and stderr file
+ *  descriptors as SCM_RIGHTS. The encoded kv follows. The request
+ *  handler uses these descriptors as its own stdio, so errors are
+ *  reported to the requestor as they would be by `flux-imp`.
+ *
+ *  Requests are:
+ *
+ *   cmd=exec  J, shell_path, arg (as passed over privsep by exec),
+ *             and env.NAME = VALUE for each variable of the requestor's
+ *             environment
+ *   cmd=kill  pid, signal (as passed over privsep by kill)
+ *
+ *  As `flux-imp exec` passes its environment through unchanged, the
+ *  job shell of an exec request is run with exactly the environment
+ *  sent in the request, never that of the service.
+ *
+ *  Replies use the same length-prefixed kv framing. An exec request
+ *  is answered with `pid` once the job shell is started, then with
+ *  `status`, the wait(2) status of the job shell, when it exits.
+ *  A kill request is answered with `status` = 0.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pwd.h>
+
+#include "src/libutil/kv.h"
+#include "src/lib/context.h"
+
+#include "imp_log.h"
+#include "imp_state.h"
+#include "impcmd.h"
+#include "privsep.h"
+#include "passwd.h"
+
+extern const char *imp_get_security_config_pattern (void);
+extern pid_t imp_exec_service (struct imp_state *imp,
+                               flux_security_t *sec,
+                               struct kv *kv);
+extern int imp_kill_privileged (struct imp_state *imp, struct kv *kv);
+
+static volatile sig_atomic_t service_exiting = 0;
+
+static void service_sigchld (int signum __attribute__ ((unused)))
+{
+    /*  Nothing to do, just interrupt accept(2) so handlers are reaped */
+}
+
+static void service_sigterm (int signum __attribute__ ((unused)))
+{
+    service_exiting = 1;
+}
+
+static void service_signals_init (void)
+{
+    struct sigaction sa;
+
+    /*  Handlers are installed without SA_RESTART so that a pending
+     *   signal interrupts the blocking accept(2) in the main loop.
+     */
+    memset (&sa, 0, sizeof (sa));
+    sigemptyset (&sa.sa_mask);
+    sa.sa_handler = service_sigchld;
+    if (sigaction (SIGCHLD, &sa, NULL) < 0)
+        imp_die (1, "service: sigaction: %s", strerror (errno));
+    sa.sa_handler = service_sigterm;
+    if (sigaction (SIGTERM, &sa, NULL) < 0
+        || sigaction (SIGINT, &sa, NULL) < 0)
+        imp_die (1, "service: sigaction: %s", strerror (errno));
+}
+
+static void service_signals_reset (void)
+{
+    signal (SIGCHLD, SIG_DFL);
+    signal (SIGTERM, SIG_DFL);
+    signal (SIGINT, SIG_DFL);
+}
+
+static bool imp_service_allowed (const cf_t *conf)
+{
+    const cf_t *exec = cf_get_in (conf, "exec");
+    return exec && cf_bool (cf_get_in (exec, "allow-service"));
+}
+
+static bool imp_service_user_allowed (struct imp_state *imp)
+{
+    const struct passwd *pwd = passwd_lookup_uid (getuid ());
+
+    if (pwd)
+        return cf_set_contains (imp->allowed_users, pwd->pw_name);
+    return false;
+}
+
+static void imp_service_check (struct imp_state *imp)
+{
+    if (!imp_service_allowed (imp->conf))
+        imp_die (1, "service: not enabled in configuration");
+    if (!imp_service_user_allowed (imp))
+        imp_die (1, "service: user not in allowed-users list");
+}
+
+/*  Socket path is validated by both the unprivileged child and the
+ *   privileged parent, since the parent does not trust the child.
+ */
+static void imp_service_check_path (const char *path)
+{
+    if (path[0] != '/')
+        imp_die (1, "service: SOCKET must be an absolute path");
+    if (strlen (path) >= sizeof (((struct sockaddr_un *) 0)->sun_path))
+        imp_die (1, "service: SOCKET path too long");
+}
+
+static ssize_t fd_write_all (int fd, const void *buf, size_t count)
+{
+    const char *p = buf;
+    size_t nleft = count;
+
+    while (nleft > 0) {
+        ssize_t n = write (fd, p, nleft);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        nleft -= n;
+        p += n;
+    }
+    return (count);
+}
+
+static ssize_t fd_read_all (int fd, void *buf, size_t count)
+{
+    char *p = buf;
+    size_t nleft = count;
+
+    while (nleft > 0) {
+        ssize_t n = read (fd, p, nleft);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        else if (n == 0)
+            break;
+        nleft -= n;
+        p += n;
+    }
+    return (count - nleft);
+}
+
+static int service_write_kv (int fd, struct kv *kv)
+{
+    const char *buf;
+    int len;
+
+    if (kv_encode (kv, &buf, &len) < 0)
+        return (-1);
+    if (fd_write_all (fd, &len, sizeof (len)) != sizeof (len)
+        || fd_write_all (fd, buf, len) != len)
+        return (-1);
+    return (0);
+}
+
+static int service_reply (int fd, const char *key, int64_t val)
+{
+    int rc = -1;
+    struct kv *kv;
+
+    if (!(kv = kv_create ())
+        || kv_put (kv, key, KV_INT64, val) < 0
+        || service_write_kv (fd, kv) < 0)
+        goto out;
+    rc = 0;
+out:
+    kv_destroy (kv);
+    return (rc);
+}
+
+/*  Receive the request header: length of the encoded kv which follows,
+ *   and the requestor's stdin, stdout and stderr in `fds`.
+ */
+static int service_recv_header (int fd, int *lenp, int fds[3])
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        char buf[CMSG_SPACE (3 * sizeof (int))];
+        struct cmsghdr align;
+    } u;
+    ssize_t n;
+
+    memset (&msg, 0, sizeof (msg));
+    iov.iov_base = lenp;
+    iov.iov_len = sizeof (*lenp);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof (u.buf);
+
+    while ((n = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+    if (n != sizeof (*lenp)
+        || (msg.msg_flags & MSG_CTRUNC)
+        || !(cmsg = CMSG_FIRSTHDR (&msg))
+        || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN (3 * sizeof (int))) {
+        errno = EPROTO;
+        return (-1);
+    }
+    memcpy (fds, CMSG_DATA (cmsg), 3 * sizeof (int));
+    return (0);
+}
+
+static struct kv *service_read_request (int fd)
+{
+    struct kv *kv = NULL;
+    char *buf = NULL;
+    int bufsz;
+    int len;
+    int fds[3];
+    int i;
+
+    if (service_recv_header (fd, &len, fds) < 0)
+        imp_die (1, "service: failed to read request header: %s",
+                    strerror (errno));
+
+    /*  Requestor stdio becomes ours, so that all further errors
+     *   from this handler are reported to the requestor.
+     */
+    for (i = 0; i < 3; i++) {
+        if (dup2 (fds[i], i) < 0)
+            imp_die (1, "service: dup2: %s", strerror (errno));
+        close (fds[i]);
+    }
+
+    if (len <= 0 || len > PRIVSEP_MAX_KVLEN)
+        imp_die (1, "service: request too large");
+    if (!(buf = calloc (1, len)))
+        imp_die (1, "service: Out of memory");
+    if (fd_read_all (fd, buf, len) != len)
+        imp_die (1, "service: failed to read request");
+    bufsz = len;
+    if (!(kv = kv_create ()) || kv_decode_swap (kv, &buf, &bufsz, len) < 0)
+        imp_die (1, "service: failed to decode request");
+    free (buf);
+    return (kv);
+}
+
+/*  Handle a single request on connection `fd`. Runs in a child of
+ *   the service and does not return.
+ */
+static void __attribute__((noreturn))
+service_handle (struct imp_state *imp, flux_security_t *sec, int fd)
+{
+    struct kv *kv = service_read_request (fd);
+    const char *cmd;
+
+    if (kv_get (kv, "cmd", KV_STRING, &cmd) < 0)
+        imp_die (1, "service: failed to get request command");
+
+    if (strcmp (cmd, "exec") == 0) {
+        int status;
+        pid_t pid = imp_exec_service (imp, sec, kv);
+
+        /*  Job shell has its own copy of the requestor stdio */
+        close (STDIN_FILENO);
+        close (STDOUT_FILENO);
+
+        if (service_reply (fd, "pid", pid) < 0)
+            imp_warn ("service: failed to send pid: %s", strerror (errno));
+        while (waitpid (pid, &status, 0) < 0) {
+            if (errno != EINTR)
+                imp_die (1, "service: waitpid: %s", strerror (errno));
+        }
+        if (service_reply (fd, "status", status) < 0)
+            imp_die (1, "service: failed to send status: %s",
+                        strerror (errno));
+    }
+    else if (strcmp (cmd, "kill") == 0) {
+        if (imp_kill_privileged (imp, kv) < 0)
+            exit (1);
+        if (service_reply (fd, "status", 0) < 0)
+            imp_die (1, "service: failed to send status: %s",
+                        strerror (errno));
+    }
+    else
+        imp_die (1, "service: unknown command %s", cmd);
+
+    kv_destroy (kv);
+    exit (0);
+}
+
+/*  Only accept connections from the user which started the service.
+ */
+static bool service_peer_allowed (int fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof (cred);
+
+    if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        imp_warn ("service: SO_PEERCRED: %s", strerror (errno));
+        return false;
+    }
+    if (cred.uid != getuid ()) {
+        imp_warn ("service: rejecting connection from uid=%ju",
+                  (uintmax_t) cred.uid);
+        return false;
+    }
+    return true;
+}
+
+/*  Create listening socket at `path`. The socket is bound with
+ *   effective uid of the IMP user so that it is owned by that user
+ *   and permission checks on `path` are made against that user.
+ */
+static int service_listen (const char *path)
+{
+    struct sockaddr_un addr;
+    uid_t euid = geteuid ();
+    mode_t mask;
+    int fd;
+    int rc;
+    int saved_errno;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+
+    if ((fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        imp_die (1, "service: socket: %s", strerror (errno));
+
+    if (euid != getuid () && seteuid (getuid ()) < 0)
+        imp_die (1, "service: seteuid: %s", strerror (errno));
+    mask = umask (0077);
+    rc = bind (fd, (struct sockaddr *) &addr, sizeof (addr));
+    saved_errno = errno;
+    umask (mask);
+    if (euid != geteuid () && seteuid (euid) < 0)
+        imp_die (1, "service: failed to restore privileges: %s",
+                    strerror (errno));
+
+    if (rc < 0)
+        imp_die (1, "service: bind %s: %s", path, strerror (saved_errno));
+    if (listen (fd, 128) < 0)
+        imp_die (1, "service: listen: %s", strerror (errno));
+    return (fd);
+}
+
+static void service_unlink (const char *path)
+{
+    uid_t euid = geteuid ();
+
+    if (euid != getuid () && seteuid (getuid ()) < 0)
+        return;
+    (void) unlink (path);
+    if (euid != geteuid ())
+        (void) seteuid (euid);
+}
+
+static void service_reap (void)
+{
+    while (waitpid (-1, NULL, WNOHANG) > 0)
+        ;
+}
+
+static void service_run (struct imp_state *imp, const char *path)
+{
+    flux_security_t *sec;
+    int fd;
+
+    /*  Load security context once, shared by all request handlers */
+    if (!(sec = flux_security_create (0))
+        || flux_security_configure (sec,
+                                    imp_get_security_config_pattern ()) < 0)
+        imp_die (1, "service: Error loading security context: %s",
+                    sec ? flux_security_last_error (sec) : strerror (errno));
+
+    /*  A long running service must not hold log messages until exit */
+    (void) imp_log_set_buffer (0);
+
+    service_signals_init ();
+    fd = service_listen (path);
+    imp_say ("service: listening on %s", path);
+
+    while (!service_exiting) {
+        int cfd;
+        pid_t pid;
+
+        service_reap ();
+        if ((cfd = accept4 (fd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            imp_warn ("service: accept: %s", strerror (errno));
+            break;
+        }
+        if (!service_peer_allowed (cfd)) {
+            close (cfd);
+            continue;
+        }
+        if ((pid = fork ()) < 0)
+            imp_warn ("service: fork: %s", strerror (errno));
+        else if (pid == 0) {
+            close (fd);
+            service_signals_reset ();
+            service_handle (imp, sec, cfd);
+        }
+        close (cfd);
+    }
+
+    close (fd);
+    service_unlink (path);
+    service_reap ();
+    flux_security_destroy (sec);
+    imp_say ("service: exiting");
+}
+
+int imp_service_privileged (struct imp_state *imp, struct kv *kv)
+{
+    const char *path;
+
+    imp_service_check (imp);
+
+    if (kv_get (kv, "socket", KV_STRING, &path) < 0)
+        imp_die (1, "service: failed to get socket path");
+    imp_service_check_path (path);
+
+    /*  Ensure child exited with nonzero status */
+    if (privsep_wait (imp->ps) < 0)
+        exit (1);
+
+    service_run (imp, path);
+    return (0);
+}
+
+int imp_service_unprivileged (struct imp_state *imp, struct kv *kv)
+{
+    const char *path;
+
+    if (imp->argc < 3)
+        imp_die (1, "service: Usage: flux-imp service SOCKET");
+
+    imp_service_check (imp);
+
+    path = imp->argv[2];
+    imp_service_check_path (path);
+
+    if (imp->ps) {
+        if (kv_put (kv, "socket", KV_STRING, path) < 0)
+            imp_die (1, "service: kv_put socket: %s", strerror (errno));
+        if (privsep_write_kv (imp->ps, kv) < 0)
+            imp_die (1, "service: failed to communicate with privsep parent");
+        exit (0);
+    }
+
+    /*  Without privilege, the service is only useful for testing,
+     *   so require the same opt-in as unprivileged exec.
+     */
+    if (!cf_bool (cf_get_in (cf_get_in (imp->conf, "exec"),
+                             "allow-unprivileged-exec")))
+        imp_die (1, "service: IMP not installed setuid, operation disabled.");
+    imp_warn ("Running without privilege, userid switching not available");
+
+    service_run (imp, path);
+    return (0);
+}
+
+/* vi: ts=4 sw=4 expandtab
+ */
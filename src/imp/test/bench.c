@@ -0,0 +1,344 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* bench.c - time strategies for spawning the IMP privsep child
+ *
+ * Usage: bench_privsep [-n iterations] [-m megabytes]
+ *
+ * Each strategy creates a child connected by pipes, waits for the child
+ * to report that it is running, then reaps it:
+ *
+ *  fork+handshake  fork(2), parent wakes child (privsep before this change)
+ *  fork            fork(2), child runs immediately (current privsep)
+ *  vfork+exec      vfork(2) and exec of a helper (this program)
+ *  posix_spawn     posix_spawn(3) of a helper (this program)
+ *  privsep_init    privsep_init() itself, only when run setuid or sudo
+ *
+ * With -m, the parent first allocates and touches that much memory, to
+ * show the cost of copying page tables on fork in a large process.
+ * Each line reports ops/sec and p50/p90/p99/max latency.
+ *
+ * Run with 'make bench', passing options with BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <spawn.h>
+
+#include "imp_log.h"
+#include "sudosim.h"
+#include "privsep.h"
+
+extern char **environ;
+
+const char *prog = "bench_privsep";
+
+struct timer {
+    double *samples;    // nanoseconds
+    int count;
+    struct timespec t0;
+};
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: bench_privsep [-n iterations] [-m megabytes]\n");
+    exit (1);
+}
+
+static void timer_init (struct timer *t, int n)
+{
+    if (n < 1 || !(t->samples = calloc (n, sizeof (t->samples[0]))))
+        die ("out of memory");
+    t->count = 0;
+}
+
+static void timer_start (struct timer *t)
+{
+    clock_gettime (CLOCK_MONOTONIC, &t->t0);
+}
+
+static void timer_stop (struct timer *t)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t->samples[t->count++] = (t1.tv_sec - t->t0.tv_sec) * 1E9
+                           + (t1.tv_nsec - t->t0.tv_nsec);
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile (const struct timer *t, int p)
+{
+    return t->samples[(t->count - 1) * p / 100] / 1E3;
+}
+
+/* Print one line of results and free the samples.
+ */
+static void timer_report (struct timer *t, const char *fmt, ...)
+{
+    va_list ap;
+    char name[64];
+    double total = 0;
+    int i;
+
+    va_start (ap, fmt);
+    (void)vsnprintf (name, sizeof (name), fmt, ap);
+    va_end (ap);
+    for (i = 0; i < t->count; i++)
+        total += t->samples[i];
+    qsort (t->samples, t->count, sizeof (t->samples[0]), sample_cmp);
+    printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+            name,
+            total > 0 ? t->count / (total / 1E9) : 0,
+            percentile (t, 50),
+            percentile (t, 90),
+            percentile (t, 99),
+            percentile (t, 100));
+    free (t->samples);
+    t->samples = NULL;
+}
+
+static void read_byte (int fd)
+{
+    char c;
+    if (read (fd, &c, 1) != 1)
+        die ("read: %s", strerror (errno));
+}
+
+static void write_byte (int fd)
+{
+    char c = 0;
+    if (write (fd, &c, 1) != 1)
+        die ("write: %s", strerror (errno));
+}
+
+static void reap (pid_t pid)
+{
+    int status;
+    if (waitpid (pid, &status, 0) < 0)
+        die ("waitpid: %s", strerror (errno));
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        die ("child failed");
+}
+
+static void close_pipe (int fds[2])
+{
+    close (fds[0]);
+    close (fds[1]);
+}
+
+/*  fork(2) with pipes in both directions. If `handshake`, the child
+ *   waits for a wakeup from the parent before reporting, as privsep
+ *   did before.
+ */
+static void spawn_fork (bool handshake)
+{
+    int up[2], down[2];
+    pid_t pid;
+
+    if (pipe (up) < 0 || pipe (down) < 0)
+        die ("pipe: %s", strerror (errno));
+    if ((pid = fork ()) < 0)
+        die ("fork: %s", strerror (errno));
+    if (pid == 0) {
+        if (handshake)
+            read_byte (down[0]);
+        write_byte (up[1]);
+        _exit (0);
+    }
+    if (handshake)
+        write_byte (down[1]);
+    read_byte (up[0]);
+    reap (pid);
+    close_pipe (up);
+    close_pipe (down);
+}
+
+/*  Spawn this program as a helper which reports on the fd in argv[2].
+ */
+static void spawn_helper (bool use_vfork)
+{
+    int up[2];
+    char fdstr[16];
+    char *argv[] = { "bench_privsep", "--child", fdstr, NULL };
+    pid_t pid;
+
+    if (pipe (up) < 0)
+        die ("pipe: %s", strerror (errno));
+    (void) snprintf (fdstr, sizeof (fdstr), "%d", up[1]);
+    if (use_vfork) {
+        if ((pid = vfork ()) < 0)
+            die ("vfork: %s", strerror (errno));
+        if (pid == 0) {
+            execve ("/proc/self/exe", argv, environ);
+            _exit (1);
+        }
+    }
+    else if ((errno = posix_spawn (&pid, "/proc/self/exe", NULL, NULL,
+                                   argv, environ)) != 0)
+        die ("posix_spawn: %s", strerror (errno));
+    read_byte (up[0]);
+    reap (pid);
+    close_pipe (up);
+}
+
+static void privsep_child (privsep_t *ps, void *arg __attribute__ ((unused)))
+{
+    char c = 0;
+    if (privsep_write (ps, &c, 1) != 1)
+        _exit (1);
+}
+
+static void spawn_privsep (void)
+{
+    privsep_t *ps;
+    char c;
+
+    if (!(ps = privsep_init (privsep_child, NULL)))
+        die ("privsep_init failed");
+    if (privsep_read (ps, &c, 1) != 1)
+        die ("privsep_read: %s", strerror (errno));
+    if (privsep_wait (ps) < 0)
+        die ("privsep child failed");
+    privsep_destroy (ps);
+}
+
+static void bench_strategies (int n, int mb)
+{
+    struct timer t;
+    int i;
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        spawn_fork (true);
+        timer_stop (&t);
+    }
+    timer_report (&t, "fork+handshake (%dM)", mb);
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        spawn_fork (false);
+        timer_stop (&t);
+    }
+    timer_report (&t, "fork (%dM)", mb);
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        spawn_helper (true);
+        timer_stop (&t);
+    }
+    timer_report (&t, "vfork+exec (%dM)", mb);
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        spawn_helper (false);
+        timer_stop (&t);
+    }
+    timer_report (&t, "posix_spawn (%dM)", mb);
+
+    if (geteuid () == 0 && getuid () != 0) {
+        timer_init (&t, n);
+        for (i = 0; i < n; i++) {
+            timer_start (&t);
+            spawn_privsep ();
+            timer_stop (&t);
+        }
+        timer_report (&t, "privsep_init (%dM)", mb);
+    }
+    else
+        printf ("%-32s (skipped, not setuid)\n", "privsep_init");
+}
+
+int main (int argc, char *argv[])
+{
+    char *mem = NULL;
+    int n = 1000;
+    int mb = 0;
+    int c;
+
+    /*  Helper mode for vfork+exec and posix_spawn strategies */
+    if (argc == 3 && strcmp (argv[1], "--child") == 0) {
+        write_byte (strtol (argv[2], NULL, 10));
+        return 0;
+    }
+
+    imp_openlog ();
+    if (sudo_simulate_setuid () < 0)
+        die ("Failed to simulate setuid under sudo");
+
+    while ((c = getopt (argc, argv, "n:m:")) != -1) {
+        switch (c) {
+            case 'n':
+                if ((n = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'm':
+                if ((mb = strtol (optarg, NULL, 10)) < 0)
+                    usage ();
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc)
+        usage ();
+
+    if (mb > 0) {
+        if (!(mem = malloc ((size_t) mb * 1024 * 1024)))
+            die ("out of memory");
+        memset (mem, 1, (size_t) mb * 1024 * 1024);
+    }
+
+    printf ("%-32s %10s %9s %9s %9s %9s\n",
+            "operation", "ops/sec",
+            "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    bench_strategies (n, mb);
+
+    free (mem);
+    imp_closelog ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
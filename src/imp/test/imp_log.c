@@ -55,6 +55,8 @@ char * long_string (char *buf, int len)
 int main (void)
 {
     int rc;
+    int i;
+    char buf [8192];
 
     plan (NO_PLAN);
     imp_openlog ();
@@ -95,13 +97,74 @@ int main (void)
     is (testbuf, "", "test log ignores messages above its set level");
 
     /*  Test log output truncation */
-    char buf [8192];
     reset_logbuf ();
     imp_say ("%s", long_string (buf, 4200));
     rc = strlen (testbuf);
     ok (rc > 0, "very long log message gets written (len = %d)", rc);
     ok (testbuf[rc - 1] == '+', "very long log message is truncated");
 
+    /*  Test phase tracing */
+    ok (imp_log_set_level ("test", IMP_LOG_DEBUG) >= 0,
+        "imp_log_set_level: restore level for test logger");
+    reset_logbuf ();
+    imp_trace ("phase1");
+    imp_trace_flush ();
+    is (testbuf, "", "imp_trace: phases not logged until enabled");
+
+    imp_trace ("phase2");
+    imp_trace_enable ("test");
+    imp_trace_flush ();
+    ok (strncmp (testbuf, "Notice: trace: pid=", 19) == 0,
+        "imp_trace_flush: emits trace line");
+    ok (strstr (testbuf, " cmd=test start=") != NULL,
+        "imp_trace_flush: trace line includes cmd and start time");
+    ok (strstr (testbuf, " phase1=") && strstr (testbuf, " phase2="),
+        "imp_trace_flush: phases recorded before enable are included");
+    ok (strstr (testbuf, " phase1=") < strstr (testbuf, " phase2="),
+        "imp_trace_flush: phases are in order");
+
+    reset_logbuf ();
+    imp_trace_flush ();
+    is (testbuf, "", "imp_trace_flush: phases are only emitted once");
+
+    for (i = 0; i < 100; i++)
+        imp_trace ("phase");
+    imp_trace_flush ();
+    ok (strlen (testbuf) > 0, "imp_trace: excess phases are dropped");
+
+    /*  Test buffered logging */
+    ok (imp_log_set_buffer (100) < 0 && errno == EINVAL,
+        "imp_log_set_buffer: too small buffer fails with EINVAL");
+    ok (imp_log_set_buffer (1024) == 0,
+        "imp_log_set_buffer: works");
+    reset_logbuf ();
+    imp_say ("deferred");
+    is (testbuf, "", "imp_say: message is deferred");
+    imp_log_flush ();
+    is (testbuf, "Notice: deferred", "imp_log_flush: emits deferred message");
+
+    reset_logbuf ();
+    imp_say ("deferred");
+    imp_warn ("immediate");
+    is (testbuf, "Warning: immediate",
+        "imp_warn: is not deferred and flushes buffer first");
+    reset_logbuf ();
+    imp_log_flush ();
+    is (testbuf, "", "imp_log_flush: buffer is empty after warning");
+
+    for (i = 0; i < 100; i++)
+        imp_say ("message %d", i);
+    imp_log_flush ();
+    is (testbuf, "Notice: message 99",
+        "full buffer is flushed without losing messages");
+
+    reset_logbuf ();
+    imp_say ("%s", long_string (buf, 2048));
+    ok (strlen (testbuf) == 2047 + strlen ("Notice: "),
+        "message larger than buffer is emitted immediately");
+    ok (imp_log_set_buffer (0) == 0,
+        "imp_log_set_buffer: disable buffering");
+
     /*  Remove logging provider */
     rc = imp_log_remove ("test");
     ok (rc == 0, "imp_log_remove: works");
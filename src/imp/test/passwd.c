@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
 #include "passwd.h"
 
 #include "src/libtap/tap.h"
@@ -17,6 +18,7 @@
 int main (void)
 {
     struct passwd *pwd;
+    const struct passwd *entry;
 
     /* check passwd_destroy() on NULL doesn't segfault */
     lives_ok ({passwd_destroy (NULL);},
@@ -33,6 +35,27 @@ int main (void)
 
     ok (!(pwd = passwd_from_uid (-1)),
         "passwd_from_uid() fails on invalid uid");
+
+    if (!(entry = passwd_lookup_uid (0)))
+        BAIL_OUT ("passwd_lookup_uid() failed");
+    is (entry->pw_name, "root",
+        "passwd_lookup_uid() returned correct entry for root");
+    ok (passwd_lookup_uid (0) == entry,
+        "passwd_lookup_uid() returns cached entry on second lookup");
+    if (!(pwd = passwd_from_uid (0)))
+        BAIL_OUT ("passwd_from_uid() failed");
+    ok (pwd != entry && strcmp (pwd->pw_name, entry->pw_name) == 0,
+        "passwd_from_uid() returns a copy of the cached entry");
+    passwd_destroy (pwd);
+    ok (passwd_lookup_uid (-1) == NULL,
+        "passwd_lookup_uid() fails on invalid uid");
+
+    lives_ok ({passwd_cache_clear ();},
+        "passwd_cache_clear() works");
+    ok ((entry = passwd_lookup_uid (0)) != NULL
+        && strcmp (entry->pw_name, "root") == 0,
+        "passwd_lookup_uid() works after passwd_cache_clear()");
+    passwd_cache_clear ();
     done_testing ();
 }
 
@@ -174,9 +174,11 @@ static void child_write_ints (privsep_t *ps, void *arg)
     privsep_write (ps, &z[2], sizeof (int));
 }
 
-static struct kv *create_yuuuuuge_kv (void)
+/*  Create a kv with at least `size` bytes of values */
+static struct kv *create_yuuuuuge_kv (int size)
 {
     int i;
+    int count = size / 4095 + 1;
     char largeval [4096];
     struct kv *kv = kv_create ();
 
@@ -185,9 +187,9 @@ static struct kv *create_yuuuuuge_kv (void)
 
     ok (strlen (largeval) == 4095, "Create huge value for oversized kv");
 
-    for (i = 0; i < 1024; i++) {
-        char key [5];
-        if (sprintf (key, "%04d", i) != 4) {
+    for (i = 0; i < count; i++) {
+        char key [16];
+        if (sprintf (key, "%06d", i) != 6) {
             imp_warn ("huge_kv: Failed to create key %04d", i);
             goto fail;
         }
@@ -202,10 +204,54 @@ fail:
     return (NULL);
 }
 
+/*  Larger than the original 4MB limit, and many times the pipe buffer */
+#define LARGE_KV_SIZE (1024*1024*8)
+
+static void child_large_kv (privsep_t *ps, void *arg)
+{
+    struct kv *kv = arg;
+    if (privsep_write_kv (ps, kv) <= 0)
+        imp_die (1, "privsep_write_kv: %s", strerror (errno));
+}
+
+static void test_privsep_kv_large (void)
+{
+    privsep_t *ps;
+    struct kv *large;
+    struct kv *kv;
+    const char *s;
+    const char *buf;
+    int len;
+
+    /*  Create kv before privsep_init() so the child can send it
+     *   without generating TAP output of its own.
+     */
+    if (!(large = create_yuuuuuge_kv (LARGE_KV_SIZE)))
+        BAIL_OUT ("failed to create large kv");
+    ok ((ps = privsep_init (child_large_kv, large)) != NULL,
+        "privsep_init");
+    if (ps == NULL)
+        BAIL_OUT ("privsep_init failed");
+
+    ok ((kv = privsep_read_kv (ps)) != NULL,
+        "privsep_read_kv: read kv of %d bytes", LARGE_KV_SIZE);
+    ok (kv_encode (kv, &buf, &len) == 0 && len > LARGE_KV_SIZE,
+        "received kv has expected size");
+    ok (kv_get (kv, "000000", KV_STRING, &s) == 0 && strlen (s) == 4095,
+        "first value is intact");
+    ok (kv_get (kv, "002048", KV_STRING, &s) == 0 && strlen (s) == 4095,
+        "last value is intact");
+    ok (privsep_wait (ps) == 0, "privsep child exited normally");
+
+    privsep_destroy (ps);
+    kv_destroy (kv);
+    kv_destroy (large);
+}
+
 static void test_privsep_kv_bad_input (void)
 {
     struct kv *kv;
-    int invalid_size[3] = { 1024*1024*4 + 1, 0, -1234 };
+    int invalid_size[3] = { PRIVSEP_MAX_KVLEN + 1, 0, -1234 };
 
     privsep_t *ps = privsep_init (child_write_ints, &invalid_size);
 
@@ -221,7 +267,7 @@ static void test_privsep_kv_bad_input (void)
     ok ((kv = privsep_read_kv (ps)) == NULL && errno == E2BIG,
         "privsep_read fails with invalid size (< 0)");
 
-    ok ((kv = create_yuuuuuge_kv ()) != NULL,
+    ok ((kv = create_yuuuuuge_kv (PRIVSEP_MAX_KVLEN)) != NULL,
         "created kv of unusual size");
     ok ((privsep_write_kv (ps, kv) < 0) && errno == E2BIG,
         "privsep_write_kv returns E2BIG on very large kv");
@@ -257,6 +303,7 @@ int main (void)
 
     test_privsep_basic ();
     test_privsep_kv ();
+    test_privsep_kv_large ();
     test_privsep_kv_bad_input ();
 
     imp_closelog ();
@@ -16,6 +16,11 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdint.h>
+#include <jansson.h>
 
 #include "src/libutil/cf.h"
 #include "src/libutil/aux.h"
@@ -23,69 +28,715 @@
 #include "context.h"
 #include "context_private.h"
 
-struct flux_security {
-    cf_t *config;
-    struct aux_item *aux;
+/* Per-thread state.  In FLUX_SECURITY_THREADSAFE mode, each thread
+ * that uses the context gets one of these, otherwise ctx->local is used.
+ * A thread's state is freed when it exits, or with the context.
+ */
+struct security_thread {
     char error[200];
     int errnum;
+    struct aux_item *aux;
+    struct security_stat_counter *stats; // FLUX_SECURITY_STATS only
+    flux_security_t *ctx;
+    struct security_thread *next;
+};
+
+/* Counters are updated with atomic operations, so timed operations in
+ * different threads do not contend for ctx->lock.  In THREADSAFE mode
+ * each thread has its own counters, so they do not share cache lines
+ * either.  Reads sum ctx->local.stats, which also accumulates counters
+ * of exited threads, and those of every live thread.
+ */
+struct security_stat_counter {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t hist[FLUX_SECURITY_STATS_BUCKETS];
+};
+
+static const char *stat_names[STAT_COUNT] = {
+    [STAT_NONE_SIGN]                      = "none.sign",
+    [STAT_NONE_VERIFY]                    = "none.verify",
+    [STAT_MUNGE_SIGN]                     = "munge.sign",
+    [STAT_MUNGE_VERIFY]                   = "munge.verify",
+    [STAT_MUNGE_HASH]                     = "munge.hash",
+    [STAT_MUNGE_ENCODE]                   = "munge.encode",
+    [STAT_MUNGE_DECODE]                   = "munge.decode",
+    [STAT_MUNGE_ERROR_SNAFU]              = "munge.error.snafu",
+    [STAT_MUNGE_ERROR_BAD_ARG]            = "munge.error.bad-arg",
+    [STAT_MUNGE_ERROR_BAD_LENGTH]         = "munge.error.bad-length",
+    [STAT_MUNGE_ERROR_OVERFLOW]           = "munge.error.overflow",
+    [STAT_MUNGE_ERROR_NO_MEMORY]          = "munge.error.no-memory",
+    [STAT_MUNGE_ERROR_SOCKET]             = "munge.error.socket",
+    [STAT_MUNGE_ERROR_TIMEOUT]            = "munge.error.timeout",
+    [STAT_MUNGE_ERROR_BAD_CRED]           = "munge.error.bad-cred",
+    [STAT_MUNGE_ERROR_BAD_VERSION]        = "munge.error.bad-version",
+    [STAT_MUNGE_ERROR_BAD_CIPHER]         = "munge.error.bad-cipher",
+    [STAT_MUNGE_ERROR_BAD_MAC]            = "munge.error.bad-mac",
+    [STAT_MUNGE_ERROR_BAD_ZIP]            = "munge.error.bad-zip",
+    [STAT_MUNGE_ERROR_BAD_REALM]          = "munge.error.bad-realm",
+    [STAT_MUNGE_ERROR_CRED_INVALID]       = "munge.error.cred-invalid",
+    [STAT_MUNGE_ERROR_CRED_EXPIRED]       = "munge.error.cred-expired",
+    [STAT_MUNGE_ERROR_CRED_REWOUND]       = "munge.error.cred-rewound",
+    [STAT_MUNGE_ERROR_CRED_REPLAYED]      = "munge.error.cred-replayed",
+    [STAT_MUNGE_ERROR_CRED_UNAUTHORIZED]  = "munge.error.cred-unauthorized",
+    [STAT_CURVE_SIGN]                     = "curve.sign",
+    [STAT_CURVE_VERIFY]                   = "curve.verify",
+    [STAT_CURVE_GET_CERT]                 = "curve.verify.get-cert",
+    [STAT_CURVE_SIGNATURE]                = "curve.verify.signature",
+    [STAT_CURVE_CA]                       = "curve.verify.ca",
+    [STAT_CURVE_CA_REVOCATION]            = "curve.verify.ca-revocation",
+    [STAT_CURVE_HOME]                     = "curve.verify.home",
+    [STAT_CONFIG_LOAD]                    = "config.load",
+    [STAT_WRAP]                           = "wrap",
+    [STAT_WRAP_BYTES]                     = "wrap.bytes",
+    [STAT_UNWRAP]                         = "unwrap",
+    [STAT_UNWRAP_BYTES]                   = "unwrap.bytes",
+    [STAT_VERIFY_CACHE_HIT]               = "sign.verify-cache.hit",
+    [STAT_VERIFY_CACHE_MISS]              = "sign.verify-cache.miss",
+    [STAT_CURVE_CERT_CACHE_HIT]           = "curve.cert-cache.hit",
+    [STAT_CURVE_CERT_CACHE_MISS]          = "curve.cert-cache.miss",
+    [STAT_CURVE_HOME_CACHE_HIT]           = "curve.home-cache.hit",
+    [STAT_CURVE_HOME_CACHE_MISS]          = "curve.home-cache.miss",
+    [STAT_MUNGE_CRED_CACHE_HIT]           = "munge.cred-cache.hit",
+    [STAT_MUNGE_CRED_CACHE_MISS]          = "munge.cred-cache.miss",
+};
+
+/* Aux item 'name' was derived from the config objects at 'keys'.
+ */
+struct config_dep {
+    char *name;
+    const char *const *keys;
+    struct config_dep *next;
+};
+
+/* A loaded config is immutable, so contexts with equal configs, e.g. many
+ * contexts configured from the same pattern, share one copy.  Entries are
+ * on the shared_configs list while referenced.
+ */
+struct shared_config {
+    cf_t *cf;
+    int refcount;               // protected by shared_config_lock
+    struct shared_config *next;
+};
+
+static pthread_mutex_t shared_config_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shared_config *shared_configs; // protected by lock
+
+/* Return a shared config equal to 'cf', taking ownership of 'cf', which
+ * is destroyed if an equal config is already shared.
+ * Return NULL on failure with errno set.
+ */
+static struct shared_config *shared_config_get (cf_t *cf)
+{
+    struct shared_config *sc;
+
+    pthread_mutex_lock (&shared_config_lock);
+    for (sc = shared_configs; sc != NULL; sc = sc->next) {
+        if (cf_equal (sc->cf, cf))
+            break;
+    }
+    if (sc) {
+        sc->refcount++;
+        pthread_mutex_unlock (&shared_config_lock);
+        cf_destroy (cf);
+        return sc;
+    }
+    if (!(sc = calloc (1, sizeof (*sc)))) {
+        pthread_mutex_unlock (&shared_config_lock);
+        cf_destroy (cf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    sc->cf = cf;
+    sc->refcount = 1;
+    sc->next = shared_configs;
+    shared_configs = sc;
+    pthread_mutex_unlock (&shared_config_lock);
+    return sc;
+}
+
+static void shared_config_put (struct shared_config *sc)
+{
+    if (sc) {
+        struct shared_config **sp;
+
+        pthread_mutex_lock (&shared_config_lock);
+        if (--sc->refcount > 0) {
+            pthread_mutex_unlock (&shared_config_lock);
+            return;
+        }
+        for (sp = &shared_configs; *sp != NULL; sp = &(*sp)->next) {
+            if (*sp == sc) {
+                *sp = sc->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock (&shared_config_lock);
+        cf_destroy (sc->cf);
+        free (sc);
+    }
+}
+
+struct flux_security {
+    struct shared_config *config;
+    struct config_dep *deps;
+    uint64_t stats_epoch;       // start of the stats interval (monotonic ns)
+    struct aux_item *aux;
+    int flags;
+    struct security_thread local;
+    struct security_thread *threads; // all thread states (THREADSAFE only)
+    pthread_key_t key;
+    pthread_mutex_t lock;
 };
 
+static void stats_zero (struct security_stat_counter *stats)
+{
+    int id;
+    int i;
+
+    for (id = STAT_UNUSED + 1; id < STAT_COUNT; id++) {
+        __atomic_store_n (&stats[id].count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&stats[id].total_ns, 0, __ATOMIC_RELAXED);
+        for (i = 0; i < FLUX_SECURITY_STATS_BUCKETS; i++)
+            __atomic_store_n (&stats[id].hist[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/* Add counters in 'src' to 'dst'.
+ */
+static void stats_fold (struct security_stat_counter *dst,
+                        struct security_stat_counter *src)
+{
+    int id;
+    int i;
+
+    for (id = STAT_UNUSED + 1; id < STAT_COUNT; id++) {
+        uint64_t n;
+        n = __atomic_load_n (&src[id].count, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&dst[id].count, n, __ATOMIC_RELAXED);
+        n = __atomic_load_n (&src[id].total_ns, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&dst[id].total_ns, n, __ATOMIC_RELAXED);
+        for (i = 0; i < FLUX_SECURITY_STATS_BUCKETS; i++) {
+            n = __atomic_load_n (&src[id].hist[i], __ATOMIC_RELAXED);
+            __atomic_fetch_add (&dst[id].hist[i], n, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Get state for the calling thread, creating it on first use.
+ * Return NULL with errno = ENOMEM if it cannot be created.  The shared
+ * ctx->local is not a safe fallback, since other threads use it unlocked.
+ */
+static struct security_thread *get_thread (flux_security_t *ctx)
+{
+    struct security_thread *t;
+
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return &ctx->local;
+    if (!(t = pthread_getspecific (ctx->key))) {
+        if (!(t = calloc (1, sizeof (*t)))) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        /* If this fails, the thread counts in ctx->local.stats.
+         */
+        if (ctx->local.stats)
+            t->stats = calloc (STAT_COUNT, sizeof (t->stats[0]));
+        t->ctx = ctx;
+        if (pthread_setspecific (ctx->key, t) != 0) {
+            free (t->stats);
+            free (t);
+            errno = ENOMEM;
+            return NULL;
+        }
+        pthread_mutex_lock (&ctx->lock);
+        t->next = ctx->threads;
+        ctx->threads = t;
+        pthread_mutex_unlock (&ctx->lock);
+    }
+    return t;
+}
+
+/* Unlink thread state 't' from ctx->threads and free it, keeping its
+ * counts.  This is done with ctx->lock held, so a concurrent read counts
+ * them exactly once.
+ */
+static void thread_release (flux_security_t *ctx, struct security_thread *t)
+{
+    struct security_thread **tp;
+
+    pthread_mutex_lock (&ctx->lock);
+    for (tp = &ctx->threads; *tp != NULL; tp = &(*tp)->next) {
+        if (*tp == t) {
+            *tp = t->next;
+            break;
+        }
+    }
+    if (t->stats)
+        stats_fold (ctx->local.stats, t->stats);
+    pthread_mutex_unlock (&ctx->lock);
+    aux_destroy (&t->aux);
+    free (t->stats);
+    free (t);
+}
+
+/* pthread_key_t destructor, called when a thread that used the context
+ * exits without calling security_thread_exit().
+ */
+static void thread_destructor (void *arg)
+{
+    struct security_thread *t = arg;
+
+    thread_release (t->ctx, t);
+}
+
 /* Capture errno in ctx->errno, and an error message in ctx->error.
  * If 'fmt' is non-NULL, build message; otherwise use strerror (errno).
  */
 void security_error (flux_security_t *ctx, const char *fmt, ...)
 {
     if (ctx) {
-        size_t sz = sizeof (ctx->error);
-        ctx->errnum = errno;
+        int errnum = errno;
+        struct security_thread *t;
+        size_t sz;
+        if (!(t = get_thread (ctx)))
+            return;
+        sz = sizeof (t->error);
+        t->errnum = errnum;
         if (fmt) {
             va_list ap;
             va_start (ap, fmt);
-            vsnprintf (ctx->error, sz, fmt, ap);
+            vsnprintf (t->error, sz, fmt, ap);
             va_end (ap);
         }
         else
-            snprintf (ctx->error, sz, "%s", strerror (ctx->errnum));
-        errno = ctx->errnum;
+            snprintf (t->error, sz, "%s", strerror (t->errnum));
+        errno = t->errnum;
     }
 }
 
+static uint64_t monotime_ns (void)
+{
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 flux_security_t *flux_security_create (int flags)
 {
     flux_security_t *ctx;
+    pthread_mutexattr_t attr;
 
-    if (flags != 0) { // not used yet
+    if ((flags & ~(FLUX_SECURITY_THREADSAFE | FLUX_SECURITY_STATS))) {
         errno = EINVAL;
         return NULL;
     }
     if (!(ctx = calloc (1, sizeof (*ctx))))
         return NULL;
+    ctx->flags = flags;
+    if ((flags & FLUX_SECURITY_STATS)) {
+        if (!(ctx->local.stats = calloc (STAT_COUNT,
+                                         sizeof (ctx->local.stats[0])))) {
+            free (ctx);
+            return NULL;
+        }
+        ctx->stats_epoch = monotime_ns ();
+    }
+    if ((flags & FLUX_SECURITY_THREADSAFE)) {
+        int e;
+        if ((e = pthread_key_create (&ctx->key, thread_destructor)) != 0) {
+            free (ctx->local.stats);
+            free (ctx);
+            errno = e;
+            return NULL;
+        }
+    }
+    /* Recursive, since mechanism init may call aux_get/set while locked.
+     */
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&ctx->lock, &attr);
+    pthread_mutexattr_destroy (&attr);
     return ctx;
 }
 
 void flux_security_destroy (flux_security_t *ctx)
 {
     if (ctx) {
+        struct security_thread *t;
+        struct config_dep *dep;
+        while ((t = ctx->threads)) {
+            ctx->threads = t->next;
+            aux_destroy (&t->aux);
+            free (t->stats);
+            free (t);
+        }
+        if ((ctx->flags & FLUX_SECURITY_THREADSAFE))
+            pthread_key_delete (ctx->key);
+        aux_destroy (&ctx->local.aux);
         aux_destroy (&ctx->aux);
-        cf_destroy (ctx->config);
+        shared_config_put (ctx->config);
+        while ((dep = ctx->deps)) {
+            ctx->deps = dep->next;
+            free (dep->name);
+            free (dep);
+        }
+        pthread_mutex_destroy (&ctx->lock);
+        free (ctx->local.stats);
         free (ctx);
     }
 }
 
 const char *flux_security_last_error (flux_security_t *ctx)
 {
-    return (ctx && *ctx->error) ? ctx->error : NULL;
+    struct security_thread *t;
+
+    if (!ctx)
+        return NULL;
+    if (!(t = get_thread (ctx)))
+        return "Out of memory";
+    return *t->error ? t->error : NULL;
 }
 
 int flux_security_last_errnum (flux_security_t *ctx)
 {
-    return ctx ? ctx->errnum : 0;
+    struct security_thread *t;
+
+    if (!ctx)
+        return 0;
+    if (!(t = get_thread (ctx)))
+        return ENOMEM;
+    return t->errnum;
+}
+
+bool security_is_threadsafe (flux_security_t *ctx)
+{
+    return (ctx->flags & FLUX_SECURITY_THREADSAFE) ? true : false;
+}
+
+void security_thread_exit (flux_security_t *ctx)
+{
+    struct security_thread *t;
+
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return;
+    if (!(t = pthread_getspecific (ctx->key)))
+        return;
+    (void)pthread_setspecific (ctx->key, NULL);
+    thread_release (ctx, t);
+}
+
+void security_lock (flux_security_t *ctx)
+{
+    if ((ctx->flags & FLUX_SECURITY_THREADSAFE))
+        pthread_mutex_lock (&ctx->lock);
+}
+
+void security_unlock (flux_security_t *ctx)
+{
+    if ((ctx->flags & FLUX_SECURITY_THREADSAFE))
+        pthread_mutex_unlock (&ctx->lock);
+}
+
+
+uint64_t security_stats_start (flux_security_t *ctx)
+{
+    if (!ctx || !ctx->local.stats)
+        return 0;
+    return monotime_ns ();
+}
+
+/* Return the calling thread's counter for 'id', or NULL if statistics
+ * are disabled or 'id' is invalid.
+ */
+static struct security_stat_counter *stats_counter (flux_security_t *ctx,
+                                                    enum security_stat id)
+{
+    struct security_thread *t;
+    struct security_stat_counter *stats;
+
+    if (!ctx || !ctx->local.stats || id <= STAT_UNUSED || id >= STAT_COUNT)
+        return NULL;
+    /* Counters are atomic, so the shared ones may be used if the thread
+     * has none.
+     */
+    if (!(t = get_thread (ctx)) || !(stats = t->stats))
+        stats = ctx->local.stats;
+    return &stats[id];
+}
+
+void security_stats_end (flux_security_t *ctx, enum security_stat id,
+                         uint64_t start)
+{
+    struct security_stat_counter *c;
+    uint64_t ns;
+    uint64_t us;
+    int i;
+
+    if (start == 0 || !(c = stats_counter (ctx, id)))
+        return;
+    ns = monotime_ns () - start;
+    i = 0;
+    us = ns / 1000;
+    while (us > 0 && i < FLUX_SECURITY_STATS_BUCKETS - 1) {
+        us >>= 1;
+        i++;
+    }
+    __atomic_fetch_add (&c->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&c->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&c->hist[i], 1, __ATOMIC_RELAXED);
+}
+
+void security_stats_add (flux_security_t *ctx, enum security_stat id,
+                         uint64_t n)
+{
+    struct security_stat_counter *c;
+
+    if ((c = stats_counter (ctx, id)))
+        __atomic_fetch_add (&c->count, n, __ATOMIC_RELAXED);
+}
+
+void security_stats_count (flux_security_t *ctx, enum security_stat id)
+{
+    security_stats_add (ctx, id, 1);
+}
+
+/* Add counter 'c' to 'stats'.
+ */
+static void stats_sum (struct flux_security_stats *stats,
+                       struct security_stat_counter *c)
+{
+    int i;
+
+    stats->count += __atomic_load_n (&c->count, __ATOMIC_RELAXED);
+    stats->total_ns += __atomic_load_n (&c->total_ns, __ATOMIC_RELAXED);
+    for (i = 0; i < FLUX_SECURITY_STATS_BUCKETS; i++)
+        stats->hist[i] += __atomic_load_n (&c->hist[i], __ATOMIC_RELAXED);
+}
+
+/* Sum statistic 'id' over all threads into 'stats'.
+ * Call with ctx->lock held in THREADSAFE mode.
+ */
+static void stats_read (flux_security_t *ctx,
+                        int id,
+                        struct flux_security_stats *stats)
+{
+    struct security_thread *t;
+
+    memset (stats, 0, sizeof (*stats));
+    stats_sum (stats, &ctx->local.stats[id]);
+    for (t = ctx->threads; t != NULL; t = t->next) {
+        if (t->stats)
+            stats_sum (stats, &t->stats[id]);
+    }
+    stats->elapsed_ns = monotime_ns ()
+                        - __atomic_load_n (&ctx->stats_epoch, __ATOMIC_RELAXED);
+}
+
+static int stat_lookup (const char *name)
+{
+    int i;
+
+    for (i = STAT_UNUSED + 1; i < STAT_COUNT; i++) {
+        if (!strcmp (stat_names[i], name))
+            return i;
+    }
+    return -1;
+}
+
+const char *flux_security_stats_next (flux_security_t *ctx, const char *name)
+{
+    int i;
+
+    if (!ctx)
+        return NULL;
+    if (!name)
+        return stat_names[STAT_UNUSED + 1];
+    if ((i = stat_lookup (name)) < 0 || i + 1 >= STAT_COUNT)
+        return NULL;
+    return stat_names[i + 1];
+}
+
+int flux_security_stats_get (flux_security_t *ctx, const char *name,
+                             struct flux_security_stats *stats)
+{
+    int id;
+
+    if (!ctx || !name || !stats) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    if (!ctx->local.stats) {
+        errno = EINVAL;
+        security_error (ctx, "statistics are not enabled");
+        return -1;
+    }
+    if ((id = stat_lookup (name)) < 0) {
+        errno = ENOENT;
+        security_error (ctx, "unknown statistic: %s", name);
+        return -1;
+    }
+    security_lock (ctx);
+    stats_read (ctx, id, stats);
+    security_unlock (ctx);
+    return 0;
+}
+
+char *flux_security_stats_json (flux_security_t *ctx)
+{
+    struct flux_security_stats stats;
+    uint64_t elapsed_ns = 0;
+    json_t *o = NULL;
+    json_t *all;
+    json_t *hist;
+    json_t *entry;
+    char *buf;
+    int id;
+    int i;
+
+    if (!ctx) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    if (!ctx->local.stats) {
+        errno = EINVAL;
+        security_error (ctx, "statistics are not enabled");
+        return NULL;
+    }
+    if (!(all = json_object ()))
+        goto nomem;
+    security_lock (ctx);
+    for (id = STAT_UNUSED + 1; id < STAT_COUNT; id++) {
+        stats_read (ctx, id, &stats);
+        if (id == STAT_UNUSED + 1)
+            elapsed_ns = stats.elapsed_ns;
+        if (!(hist = json_array ()))
+            break;
+        for (i = 0; i < FLUX_SECURITY_STATS_BUCKETS; i++) {
+            if (json_array_append_new (hist,
+                                       json_integer (stats.hist[i])) < 0)
+                break;
+        }
+        entry = NULL;
+        if (i == FLUX_SECURITY_STATS_BUCKETS)
+            entry = json_pack ("{s:I s:I s:O}",
+                               "count", (json_int_t)stats.count,
+                               "total_ns", (json_int_t)stats.total_ns,
+                               "hist", hist);
+        json_decref (hist);
+        if (!entry || json_object_set_new (all, stat_names[id], entry) < 0)
+            break;
+    }
+    security_unlock (ctx);
+    if (id == STAT_COUNT)
+        o = json_pack ("{s:I s:O}",
+                       "elapsed_ns", (json_int_t)elapsed_ns,
+                       "stats", all);
+    json_decref (all);
+    if (!o || !(buf = json_dumps (o, JSON_COMPACT | JSON_PRESERVE_ORDER)))
+        goto nomem;
+    json_decref (o);
+    return buf;
+nomem:
+    json_decref (o);
+    errno = ENOMEM;
+    security_error (ctx, NULL);
+    return NULL;
+}
+
+void flux_security_stats_reset (flux_security_t *ctx)
+{
+    struct security_thread *t;
+
+    if (!ctx || !ctx->local.stats)
+        return;
+    security_lock (ctx);
+    stats_zero (ctx->local.stats);
+    for (t = ctx->threads; t != NULL; t = t->next) {
+        if (t->stats)
+            stats_zero (t->stats);
+    }
+    __atomic_store_n (&ctx->stats_epoch, monotime_ns (), __ATOMIC_RELAXED);
+    security_unlock (ctx);
 }
 
+/* Look up 'path', a sequence of table keys separated by periods,
+ * e.g. "sign.max-ttl", in 'cf'.  Return NULL if not found.
+ */
+static const cf_t *config_lookup (const cf_t *cf, const char *path)
+{
+    char key[128];
+    const char *next;
+    size_t len;
+
+    while (cf && (next = strchr (path, '.'))) {
+        if ((len = next - path) >= sizeof (key))
+            return NULL;
+        memcpy (key, path, len);
+        key[len] = '\0';
+        cf = cf_get_in (cf, key);
+        path = next + 1;
+    }
+    return cf ? cf_get_in (cf, path) : NULL;
+}
+
+static bool config_changed (const cf_t *old, const cf_t *new,
+                            const char *const *keys)
+{
+    int i;
+
+    for (i = 0; keys[i] != NULL; i++) {
+        if (!cf_equal (config_lookup (old, keys[i]),
+                       config_lookup (new, keys[i])))
+            return true;
+    }
+    return false;
+}
+
+/* Replace ctx->config with 'cf', taking ownership of it.  Aux items,
+ * in every thread, that depend on config objects that differ between the
+ * old and new config are deleted, so they are recreated on next use.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int config_replace (flux_security_t *ctx, cf_t *cf)
+{
+    struct shared_config *new;
+    struct config_dep *dep;
+    struct security_thread *t;
+
+    if (!(new = shared_config_get (cf)))
+        return -1;
+    security_lock (ctx);
+    if (new == ctx->config) {
+        security_unlock (ctx);
+        shared_config_put (new);
+        return 0;
+    }
+    for (dep = ctx->deps; dep != NULL; dep = dep->next) {
+        if (!config_changed (ctx->config ? ctx->config->cf : NULL,
+                             new->cf,
+                             dep->keys))
+            continue;
+        (void)aux_set (&ctx->aux, dep->name, NULL, NULL);
+        (void)aux_set (&ctx->local.aux, dep->name, NULL, NULL);
+        for (t = ctx->threads; t != NULL; t = t->next)
+            (void)aux_set (&t->aux, dep->name, NULL, NULL);
+    }
+    shared_config_put (ctx->config);
+    ctx->config = new;
+    security_unlock (ctx);
+    return 0;
+}
 
 int flux_security_configure (flux_security_t *ctx, const char *pattern)
 {
     struct cf_error cfe;
+    char cachefile[PATH_MAX + 1];
+    uint64_t t;
     int n;
     cf_t *cf = NULL;
 
@@ -95,11 +746,18 @@ int flux_security_configure (flux_security_t *ctx, const char *pattern)
     }
     if (!pattern)
         pattern = INSTALLED_CF_PATTERN;
+    if (cf_cache_path (pattern, cachefile, sizeof (cachefile)) < 0) {
+        security_error (ctx, "pattern %s is too long", pattern);
+        return -1;
+    }
     if (!(cf = cf_create ())) {
         security_error (ctx, NULL);
         return -1;
     }
-    if ((n = cf_update_glob (cf, pattern, &cfe)) < 0) {
+    t = security_stats_start (ctx);
+    n = cf_update_glob_cache (cf, pattern, cachefile, &cfe);
+    security_stats_end (ctx, STAT_CONFIG_LOAD, t);
+    if (n < 0) {
         security_error (ctx, "%s::%d: %s",
                         cfe.filename, cfe.lineno, cfe.errbuf);
         goto error;
@@ -109,8 +767,10 @@ int flux_security_configure (flux_security_t *ctx, const char *pattern)
         security_error (ctx, "pattern %s matched nothing", pattern);
         goto error;
     }
-    cf_destroy (ctx->config);
-    ctx->config = cf;
+    if (config_replace (ctx, cf) < 0) {
+        security_error (ctx, NULL);
+        return -1;
+    }
     return 0;
 error:
     cf_destroy (cf);
@@ -125,8 +785,12 @@ int flux_security_aux_set (flux_security_t *ctx, const char *name,
         errno = EINVAL;
         goto error;
     }
-    if (aux_set (&ctx->aux, name, data, freefun) < 0)
+    security_lock (ctx);
+    if (aux_set (&ctx->aux, name, data, freefun) < 0) {
+        security_unlock (ctx);
         goto error;
+    }
+    security_unlock (ctx);
     return 0;
 error:
     security_error (ctx, NULL);
@@ -141,7 +805,10 @@ void *flux_security_aux_get (flux_security_t *ctx, const char *name)
         errno = EINVAL;
         goto error;
     }
-    if (!(val = aux_get (ctx->aux, name)))
+    security_lock (ctx);
+    val = aux_get (ctx->aux, name);
+    security_unlock (ctx);
+    if (!val)
         goto error;
     return val;
 error:
@@ -149,6 +816,174 @@ error:
     return NULL;
 }
 
+int security_thread_aux_set (flux_security_t *ctx, const char *name,
+                             void *data, flux_security_free_f freefun)
+{
+    struct security_thread *t;
+
+    if (!ctx) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return flux_security_aux_set (ctx, name, data, freefun);
+    if (!(t = get_thread (ctx))
+        || aux_set (&t->aux, name, data, freefun) < 0)
+        goto error;
+    return 0;
+error:
+    security_error (ctx, NULL);
+    return -1;
+}
+
+void *security_thread_aux_get (flux_security_t *ctx, const char *name)
+{
+    struct security_thread *t;
+    void *val;
+
+    if (!ctx) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return flux_security_aux_get (ctx, name);
+    if (!(t = get_thread (ctx)) || !(val = aux_get (t->aux, name)))
+        goto error;
+    return val;
+error:
+    security_error (ctx, NULL);
+    return NULL;
+}
+
+/* Return the handle for 'key', registering it on first use.
+ * Registration is idempotent, so racing threads store the same value.
+ */
+static int aux_key (struct security_aux_key *key)
+{
+    int k = __atomic_load_n (&key->key, __ATOMIC_RELAXED);
+
+    if (k == 0 && (k = aux_key_register (key->name)) > 0)
+        __atomic_store_n (&key->key, k, __ATOMIC_RELAXED);
+    return k;
+}
+
+int security_aux_key_set (flux_security_t *ctx,
+                          struct security_aux_key *key,
+                          void *data,
+                          flux_security_free_f freefun)
+{
+    int rc;
+
+    if (!ctx || !key) {
+        errno = EINVAL;
+        goto error;
+    }
+    security_lock (ctx);
+    rc = aux_set_key (&ctx->aux, aux_key (key), data, freefun);
+    security_unlock (ctx);
+    if (rc < 0)
+        goto error;
+    return 0;
+error:
+    security_error (ctx, NULL);
+    return -1;
+}
+
+void *security_aux_key_get (flux_security_t *ctx,
+                            struct security_aux_key *key)
+{
+    void *val;
+
+    if (!ctx || !key) {
+        errno = EINVAL;
+        goto error;
+    }
+    security_lock (ctx);
+    val = aux_get_key (ctx->aux, aux_key (key));
+    security_unlock (ctx);
+    if (!val)
+        goto error;
+    return val;
+error:
+    security_error (ctx, NULL);
+    return NULL;
+}
+
+int security_thread_aux_key_set (flux_security_t *ctx,
+                                 struct security_aux_key *key,
+                                 void *data,
+                                 flux_security_free_f freefun)
+{
+    struct security_thread *t;
+
+    if (!ctx || !key) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return security_aux_key_set (ctx, key, data, freefun);
+    if (!(t = get_thread (ctx))
+        || aux_set_key (&t->aux, aux_key (key), data, freefun) < 0)
+        goto error;
+    return 0;
+error:
+    security_error (ctx, NULL);
+    return -1;
+}
+
+void *security_thread_aux_key_get (flux_security_t *ctx,
+                                   struct security_aux_key *key)
+{
+    struct security_thread *t;
+    void *val;
+
+    if (!ctx || !key) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(ctx->flags & FLUX_SECURITY_THREADSAFE))
+        return security_aux_key_get (ctx, key);
+    if (!(t = get_thread (ctx))
+        || !(val = aux_get_key (t->aux, aux_key (key))))
+        goto error;
+    return val;
+error:
+    security_error (ctx, NULL);
+    return NULL;
+}
+
+int security_aux_depends (flux_security_t *ctx, const char *name,
+                          const char *const *keys)
+{
+    struct config_dep *dep;
+
+    if (!ctx || !name || !keys) {
+        errno = EINVAL;
+        goto error;
+    }
+    security_lock (ctx);
+    for (dep = ctx->deps; dep != NULL; dep = dep->next) {
+        if (!strcmp (dep->name, name))
+            break;
+    }
+    if (!dep) {
+        if (!(dep = calloc (1, sizeof (*dep)))
+            || !(dep->name = strdup (name))) {
+            free (dep);
+            security_unlock (ctx);
+            goto error;
+        }
+        dep->next = ctx->deps;
+        ctx->deps = dep;
+    }
+    dep->keys = keys;
+    security_unlock (ctx);
+    return 0;
+error:
+    security_error (ctx, NULL);
+    return -1;
+}
+
 const cf_t *security_get_config (flux_security_t *ctx, const char *key)
 {
     const cf_t *cf;
@@ -164,8 +999,8 @@ const cf_t *security_get_config (flux_security_t *ctx, const char *key)
         return NULL;
     }
     if (key == NULL)
-        cf = ctx->config;
-    else if (!(cf = cf_get_in (ctx->config, key))) {
+        cf = ctx->config->cf;
+    else if (!(cf = cf_get_in (ctx->config->cf, key))) {
         security_error (ctx, "configuration object '%s' not found", key);
         return NULL;
     }
@@ -186,8 +1021,10 @@ int security_set_config (flux_security_t *ctx, const cf_t *cf)
         security_error (ctx, "Failed to copy config object");
         return (-1);
     }
-    cf_destroy (ctx->config);
-    ctx->config = new;
+    if (config_replace (ctx, new) < 0) {
+        security_error (ctx, NULL);
+        return (-1);
+    }
     return (0);
 }
 
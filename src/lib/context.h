@@ -15,16 +15,41 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 typedef struct flux_security flux_security_t;
 
 typedef void (*flux_security_free_f)(void *arg);
 
+enum {
+    /* Allow one context to be shared by multiple threads once configured.
+     * Configuration and mechanism state (e.g. loaded certs) are shared,
+     * while error state and scratch buffers, such as those returned by
+     * flux_sign_wrap() and flux_sign_unwrap(), are private to each thread,
+     * and are freed when the thread exits.
+     * Call flux_security_configure() before sharing the context.
+     */
+    FLUX_SECURITY_THREADSAFE = 1,
+
+    /* Record timing statistics for mechanism operations and their phases,
+     * which may be read with flux_security_stats_get().
+     */
+    FLUX_SECURITY_STATS = 2,
+};
+
 flux_security_t *flux_security_create (int flags);
 void flux_security_destroy (flux_security_t *ctx);
 
 const char *flux_security_last_error (flux_security_t *ctx);
 int flux_security_last_errnum (flux_security_t *ctx);
 
+/* Load configuration from TOML files matching glob 'pattern', or the
+ * installed configuration if 'pattern' is NULL.  The context may be
+ * reconfigured, e.g. to pick up a new allowed-types or max-ttl.  Mechanism
+ * state derived from config that did not change, such as loaded certs, CA
+ * state, and munge contexts, is kept.  In FLUX_SECURITY_THREADSAFE mode,
+ * do not reconfigure while other threads are using the context.
+ */
 int flux_security_configure (flux_security_t *ctx, const char *pattern);
 
 int flux_security_aux_set (flux_security_t *ctx, const char *name,
@@ -32,6 +57,58 @@ int flux_security_aux_set (flux_security_t *ctx, const char *name,
 
 void *flux_security_aux_get (flux_security_t *ctx, const char *name);
 
+/* Statistics (FLUX_SECURITY_STATS only).
+ *
+ * Each statistic counts samples of a timed operation, e.g. "wrap" or
+ * "unwrap" for successful calls, "curve.verify" for sign-curve
+ * verification as a whole, or "curve.verify.ca" for its CA check, or
+ * "config.load" for loading config files in flux_security_configure().
+ * 'total_ns' is the cumulative time spent.  hist[0] counts
+ * samples that took less than 1us, hist[i] those that took [2^(i-1),2^i)us,
+ * and the last bucket those that took longer.  Some statistics only count
+ * events, e.g. "munge.error.socket" for munge_err_t EMUNGE_SOCKET, or cache
+ * lookups, e.g. "sign.verify-cache.hit" and "sign.verify-cache.miss", and
+ * leave 'total_ns' and 'hist' zero.  "wrap.bytes" and "unwrap.bytes" count
+ * payload bytes.  'elapsed_ns' is the time since the
+ * context was created or statistics were reset, so count / elapsed_ns
+ * is the average rate.
+ *
+ * In FLUX_SECURITY_THREADSAFE mode, each thread updates its own counters,
+ * and reads return the sum over all threads.
+ *
+ * flux_security_stats_next() iterates over statistic names: pass NULL to
+ * get the first, and the previous name to get the next.  It returns NULL
+ * after the last one.
+ *
+ * flux_security_stats_get() returns a snapshot of statistic 'name' in
+ * 'stats'.  Return 0 on success, -1 on error with errno set (ENOENT if
+ * 'name' is unknown, EINVAL if statistics are not enabled).
+ *
+ * flux_security_stats_json() returns all statistics as a JSON object
+ *   {"elapsed_ns":N, "stats":{"name":{"count":N, "total_ns":N,
+ *    "hist":[N, ...]}, ...}}
+ * in a string the caller must free, or NULL on error with errno set.
+ *
+ * flux_security_stats_reset() zeroes all statistics.
+ */
+#define FLUX_SECURITY_STATS_BUCKETS 20
+
+struct flux_security_stats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t hist[FLUX_SECURITY_STATS_BUCKETS];
+    uint64_t elapsed_ns;
+};
+
+const char *flux_security_stats_next (flux_security_t *ctx, const char *name);
+
+int flux_security_stats_get (flux_security_t *ctx, const char *name,
+                             struct flux_security_stats *stats);
+
+char *flux_security_stats_json (flux_security_t *ctx);
+
+void flux_security_stats_reset (flux_security_t *ctx);
+
 #ifdef __cplusplus
 }
 #endif
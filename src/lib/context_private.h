@@ -12,6 +12,8 @@
 #define _FLUX_SECURITY_CONTEXT_PRIVATE_H
 
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "src/libutil/cf.h"
 
 /* Capture errno in ctx->errno, and an error message in ctx->error.
@@ -20,13 +22,155 @@
 void security_error (flux_security_t *ctx, const char *fmt, ...);
 
 /* Retrieve config object by 'key', entire config if key == NULL.
- * Returns the object (do not free), or NULL on error.
+ * Returns the object (do not free), or NULL on error.  The config may be
+ * shared with other contexts, so it must not be modified.
  */
 const cf_t *security_get_config (flux_security_t *ctx, const char *key);
 
 /* Set config object 'cf' as security handle configuration.
- * 'cf' is copied internally and any existing configuration is destroyed.
+ * 'cf' is copied internally and any existing configuration is released.
+ * Contexts with equal configuration share one copy.
+ * Aux items that depend on changed config objects are deleted, as with
+ * flux_security_configure().
  */
 int security_set_config (flux_security_t *ctx, const cf_t *cf);
 
+/* Declare that aux item 'name', set with flux_security_aux_set() or
+ * security_thread_aux_set(), was derived from the config objects at the
+ * NULL-terminated array of 'keys', e.g. "sign.max-ttl" for key max-ttl in
+ * table [sign].  When the config is replaced and any of those objects
+ * changed, the item is deleted in every thread, so it is recreated from the
+ * new config on next use.  Other items are kept.  'keys' is not copied.
+ * Return 0 on success, -1 on error with errno and context error set.
+ */
+int security_aux_depends (flux_security_t *ctx, const char *name,
+                          const char *const *keys);
+
+/* Serialize access to state shared between threads, such as lazily
+ * initialized mechanism state.  The lock is recursive.  These are no-ops
+ * unless the context was created with FLUX_SECURITY_THREADSAFE.
+ */
+void security_lock (flux_security_t *ctx);
+void security_unlock (flux_security_t *ctx);
+
+/* Like flux_security_aux_set/get(), but in FLUX_SECURITY_THREADSAFE mode,
+ * the item is private to the calling thread.  Use for scratch buffers and
+ * other state that cannot be shared.  Otherwise, same as the public calls.
+ */
+int security_thread_aux_set (flux_security_t *ctx, const char *name,
+                             void *data, flux_security_free_f freefun);
+void *security_thread_aux_get (flux_security_t *ctx, const char *name);
+
+/* A registered aux item name.  Declare one statically per item, e.g.
+ *   static struct security_aux_key key = { .name = "flux::sign" };
+ * The functions below look the item up by the handle registered for the
+ * name on first use, rather than by comparing strings, so prefer them on
+ * hot paths.  Otherwise they are the same as flux_security_aux_get/set()
+ * and security_thread_aux_get/set(), and interoperate with them.
+ */
+struct security_aux_key {
+    const char *name;
+    int key;
+};
+
+int security_aux_key_set (flux_security_t *ctx,
+                          struct security_aux_key *key,
+                          void *data,
+                          flux_security_free_f freefun);
+void *security_aux_key_get (flux_security_t *ctx,
+                            struct security_aux_key *key);
+
+int security_thread_aux_key_set (flux_security_t *ctx,
+                                 struct security_aux_key *key,
+                                 void *data,
+                                 flux_security_free_f freefun);
+void *security_thread_aux_key_get (flux_security_t *ctx,
+                                   struct security_aux_key *key);
+
+/* Timed operations, and counted events, recorded in FLUX_SECURITY_STATS
+ * mode.  Names are listed in context.c::stat_names[].
+ */
+enum security_stat {
+    STAT_UNUSED = 0,
+    STAT_NONE_SIGN,
+    STAT_NONE_VERIFY,
+    STAT_MUNGE_SIGN,
+    STAT_MUNGE_VERIFY,
+    STAT_MUNGE_HASH,
+    STAT_MUNGE_ENCODE,
+    STAT_MUNGE_DECODE,
+    /* One per munge_err_t value, from EMUNGE_SNAFU, in the same order.
+     */
+    STAT_MUNGE_ERROR_SNAFU,
+    STAT_MUNGE_ERROR_BAD_ARG,
+    STAT_MUNGE_ERROR_BAD_LENGTH,
+    STAT_MUNGE_ERROR_OVERFLOW,
+    STAT_MUNGE_ERROR_NO_MEMORY,
+    STAT_MUNGE_ERROR_SOCKET,
+    STAT_MUNGE_ERROR_TIMEOUT,
+    STAT_MUNGE_ERROR_BAD_CRED,
+    STAT_MUNGE_ERROR_BAD_VERSION,
+    STAT_MUNGE_ERROR_BAD_CIPHER,
+    STAT_MUNGE_ERROR_BAD_MAC,
+    STAT_MUNGE_ERROR_BAD_ZIP,
+    STAT_MUNGE_ERROR_BAD_REALM,
+    STAT_MUNGE_ERROR_CRED_INVALID,
+    STAT_MUNGE_ERROR_CRED_EXPIRED,
+    STAT_MUNGE_ERROR_CRED_REWOUND,
+    STAT_MUNGE_ERROR_CRED_REPLAYED,
+    STAT_MUNGE_ERROR_CRED_UNAUTHORIZED,
+    STAT_CURVE_SIGN,
+    STAT_CURVE_VERIFY,
+    STAT_CURVE_GET_CERT,
+    STAT_CURVE_SIGNATURE,
+    STAT_CURVE_CA,
+    STAT_CURVE_CA_REVOCATION,
+    STAT_CURVE_HOME,
+    STAT_CONFIG_LOAD,
+    STAT_WRAP,
+    STAT_WRAP_BYTES,
+    STAT_UNWRAP,
+    STAT_UNWRAP_BYTES,
+    STAT_VERIFY_CACHE_HIT,
+    STAT_VERIFY_CACHE_MISS,
+    STAT_CURVE_CERT_CACHE_HIT,
+    STAT_CURVE_CERT_CACHE_MISS,
+    STAT_CURVE_HOME_CACHE_HIT,
+    STAT_CURVE_HOME_CACHE_MISS,
+    STAT_MUNGE_CRED_CACHE_HIT,
+    STAT_MUNGE_CRED_CACHE_MISS,
+    STAT_COUNT,
+};
+
+/* Start timing an operation.  Returns a start time to pass to
+ * security_stats_end(), or 0 if statistics are disabled.
+ */
+uint64_t security_stats_start (flux_security_t *ctx);
+
+/* Record the time elapsed since 'start' in statistic 'id'.
+ * This is a no-op if 'start' or 'id' is zero.
+ */
+void security_stats_end (flux_security_t *ctx, enum security_stat id,
+                         uint64_t start);
+
+/* Count an event in statistic 'id', without timing it.
+ */
+void security_stats_count (flux_security_t *ctx, enum security_stat id);
+
+/* Add 'n' to the count of statistic 'id', e.g. a number of bytes.
+ */
+void security_stats_add (flux_security_t *ctx, enum security_stat id,
+                         uint64_t n);
+
+/* Return true if 'ctx' was created with FLUX_SECURITY_THREADSAFE.
+ */
+bool security_is_threadsafe (flux_security_t *ctx);
+
+/* In FLUX_SECURITY_THREADSAFE mode, destroy the calling thread's private
+ * state, e.g. before a short-lived worker thread exits.  Otherwise a no-op.
+ * State of a thread that exits without calling this is destroyed by a
+ * thread-specific data destructor, but only once the thread has exited.
+ */
+void security_thread_exit (flux_security_t *ctx);
+
 #endif /* !_FLUX_SECURITY_CONTEXT_PRIVATE_H */
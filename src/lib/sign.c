@@ -14,45 +14,111 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
-#include <sodium.h>
 
 #include "src/libutil/cf.h"
+#include "src/libutil/base64.h"
 #include "src/libutil/kv.h"
 #include "src/libutil/macros.h"
+#include "src/libutil/sha256.h"
+#include "src/libutil/cmap.h"
 
 #include "context.h"
 #include "context_private.h"
 #include "sign.h"
 #include "sign_mech.h"
+#include "sign_cache.h"
+#include "sign_batch.h"
 
 struct sign {
-    const cf_t *config;
     void *wrapbuf;
     int wrapbufsz;
     void *unwrapbuf;
     int unwrapbufsz;
+    void *hdrbuf;       // decoded HEADER, reused by unwrap
+    int hdrbufsz;
+    struct kv *header;  // parsed HEADER, reused by unwrap
+    const struct sign_mech *default_mech;
+    int64_t version;            // header version for wrap
+    unsigned int allowed;       // bitmask of allowed-types, by mechtab index
+    unsigned int initialized;   // bitmask of mechanisms already initialized
+    struct sign_cache *cache;   // verified signatures, if enabled
+    struct cmap *shared_cache;  // same, shared by threads (not owned)
+    int shared_cache_size;
+    struct kv *prefix;          // constant part of last wrap header
+    struct kv *wrap_header;     // header built by wrap, reused
+    int64_t prefix_userid;
+    const struct sign_mech *prefix_mech;
+    int prefix_generation;
 };
 
+/* Header versions understood by unwrap.  Version 2 is the same as
+ * version 1, except that mechanisms may omit data the verifier can obtain
+ * by other means, e.g. sign-curve refers to the signer's cert by
+ * fingerprint.  Version 3 is version 2 with numbers and timestamps in the
+ * binary kv encoding, which earlier readers cannot decode.  wrap uses
+ * version 1 unless header-version is configured.
+ */
 static const int64_t sign_version = 1;
+static const int64_t sign_version_max = 3;
+
+static const int max_cache_size = 1024*1024;
+
+/* Initial room for SIGNATURE when a mechanism signs in place.
+ */
+static const int signature_reserve = 128;
 
 static const struct cf_option sign_opts[] = {
     {"max-ttl",             CF_INT64,       true},
     {"default-type",        CF_STRING,      true},
     {"allowed-types",       CF_ARRAY,       true},
+    {"verify-cache-size",   CF_INT64,       false},
+    {"header-version",      CF_INT64,       false},
     CF_OPTIONS_TABLE_END,
 };
 
+/* Mechanisms are identified internally by their index in this table,
+ * which is used for the allowed/initialized bitmasks in struct sign.
+ */
+static const struct sign_mech *mechtab[] = {
+    &sign_mech_none,
+    &sign_mech_munge,
+    &sign_mech_curve,
+};
+static const int mechtab_count = sizeof (mechtab) / sizeof (mechtab[0]);
+
+/* Return mechtab index of mechanism 'name', or -1 if not found.
+ */
+static int lookup_mech_index (const char *name)
+{
+    int i;
+
+    for (i = 0; i < mechtab_count; i++) {
+        if (!strcmp (name, mechtab[i]->name))
+            return i;
+    }
+    return -1;
+}
+
 static const struct sign_mech *lookup_mech (const char *name)
 {
-    if (!strcmp (name, "none"))
-        return &sign_mech_none;
-    if (!strcmp (name, "munge"))
-        return &sign_mech_munge;
-    if (!strcmp (name, "curve"))
-        return &sign_mech_curve;
-    return NULL;
+    int i = lookup_mech_index (name);
+
+    return i < 0 ? NULL : mechtab[i];
+}
+
+static int mech_index (const struct sign_mech *mech)
+{
+    int i;
+
+    for (i = 0; i < mechtab_count; i++) {
+        if (mechtab[i] == mech)
+            return i;
+    }
+    return -1;
 }
 
 /* Grow *buf to newsz if *bufsz is less than that.
@@ -76,86 +142,238 @@ static void sign_destroy (struct sign *sign)
         int saved_errno = errno;
         free (sign->wrapbuf);
         free (sign->unwrapbuf);
+        free (sign->hdrbuf);
+        kv_destroy (sign->header);
+        sign_cache_destroy (sign->cache);
+        kv_destroy (sign->prefix);
+        kv_destroy (sign->wrap_header);
         free (sign);
         errno = saved_errno;
     }
 }
 
-static bool validate_mech_array (flux_security_t *ctx, const cf_t *mechs)
+/* In FLUX_SECURITY_THREADSAFE mode, verified signatures are remembered
+ * in one map shared by all threads instead of a cache per thread, so an
+ * input verified by one thread is a hit in the others, and hits take no
+ * locks.  It is an aux item of 'ctx' that is dropped with struct sign when
+ * [sign] changes.  Instead of LRU eviction, a full map is purged of
+ * expired entries, and if it is still full, new results are not added.
+ */
+struct shared_result {
+    int64_t expires;
+    int64_t userid;
+    int mech;
+};
+
+static const char *const shared_cache_deps[] = { "sign", NULL };
+
+static struct cmap *shared_cache_get (flux_security_t *ctx)
+{
+    static struct security_aux_key auxkey = {
+        .name = "flux::sign_verify_cache",
+    };
+    struct cmap *map;
+
+    security_lock (ctx);
+    if (!(map = security_aux_key_get (ctx, &auxkey))) {
+        if (!(map = cmap_create (SHA256_BLOCK_SIZE,
+                                 sizeof (struct shared_result)))) {
+            security_error (ctx, NULL);
+            goto done;
+        }
+        if (security_aux_key_set (ctx, &auxkey, map,
+                                  (flux_security_free_f)cmap_destroy) < 0) {
+            cmap_destroy (map);
+            map = NULL;
+            goto done;
+        }
+        if (security_aux_depends (ctx, auxkey.name, shared_cache_deps) < 0)
+            map = NULL;
+    }
+done:
+    security_unlock (ctx);
+    return map;
+}
+
+static bool shared_result_expired (const void *key, const void *val, void *arg)
+{
+    const struct shared_result *r = val;
+    time_t now = *(time_t *)arg;
+
+    return now > r->expires;
+}
+
+/* Look up 'digest' in the verify cache, if enabled.
+ * Return 0 on hit, -1 on miss.
+ */
+static int verify_cache_lookup (struct sign *sign,
+                                const uint8_t digest[SHA256_BLOCK_SIZE],
+                                time_t now,
+                                int *mech,
+                                int64_t *userid)
+{
+    struct shared_result r;
+
+    if (sign->cache)
+        return sign_cache_lookup (sign->cache, digest, now, mech, userid, NULL);
+    if (!sign->shared_cache
+        || cmap_get (sign->shared_cache, digest, &r) < 0
+        || now > r.expires)
+        return -1;
+    *mech = r.mech;
+    *userid = r.userid;
+    return 0;
+}
+
+static void verify_cache_insert (struct sign *sign,
+                                 const uint8_t digest[SHA256_BLOCK_SIZE],
+                                 time_t now,
+                                 time_t expires,
+                                 int mech,
+                                 int64_t userid)
+{
+    struct shared_result r = {
+        .expires = expires,
+        .userid = userid,
+        .mech = mech,
+    };
+
+    if (sign->cache) {
+        (void)sign_cache_insert (sign->cache, digest, expires, mech, userid,
+                                 NULL);
+        return;
+    }
+    if (cmap_count (sign->shared_cache) >= sign->shared_cache_size) {
+        (void)cmap_remove_if (sign->shared_cache, shared_result_expired, &now);
+        if (cmap_count (sign->shared_cache) >= sign->shared_cache_size)
+            return;
+    }
+    (void)cmap_put (sign->shared_cache, digest, &r);
+}
+
+/* Validate 'mechs' array and convert it to a bitmask of mechtab indices.
+ */
+static bool validate_mech_array (flux_security_t *ctx,
+                                 const cf_t *mechs,
+                                 unsigned int *maskp)
 {
     int i;
     const cf_t *el;
+    unsigned int mask = 0;
 
     for (i = 0; (el = cf_get_at (mechs, i)) != NULL; i++) {
+        int index;
         if (cf_typeof (el) != CF_STRING) {
             errno = EINVAL;
             security_error (ctx, "sign: allowed-types[%d] not a string", i);
             return false;
         }
-        if (!lookup_mech (cf_string (el))) {
+        if ((index = lookup_mech_index (cf_string (el))) < 0) {
             errno = EINVAL;
             security_error (ctx, "sign: unknown mechanism=%s", cf_string (el));
             return false;
         }
+        mask |= 1U << index;
     }
     if (i == 0) {
         errno = EINVAL;
         security_error (ctx, "sign: allowed-types array is empty");
         return false;
     }
-
+    *maskp = mask;
     return true;
 }
 
 static struct sign *sign_create (flux_security_t *ctx)
 {
     struct sign *sign;
+    const cf_t *config;
     struct cf_error e;
     const char *default_type;
     const cf_t *allowed_types;
+    const cf_t *el;
     int64_t max_ttl;
 
     if (!(sign = calloc (1, sizeof (*sign)))) {
         security_error (ctx, NULL);
         return NULL;
     }
-    if (!(sign->config = security_get_config (ctx, "sign")))
+    if (!(config = security_get_config (ctx, "sign")))
         goto error;
-    if (cf_check (sign->config, sign_opts, CF_STRICT | CF_ANYTAB, &e) < 0) {
+    if (cf_check (config, sign_opts, CF_STRICT | CF_ANYTAB, &e) < 0) {
         security_error (ctx, "sign: config error: %s", e.errbuf);
         goto error;
     }
     /* Allow -100 for testing
      */
-    max_ttl = cf_int64 (cf_get_in (sign->config, "max-ttl"));
+    max_ttl = cf_int64 (cf_get_in (config, "max-ttl"));
     if (max_ttl <= 0 && max_ttl != -100) {
         errno = EINVAL;
         security_error (ctx, "sign: max-ttl should be greater than zero");
         goto error;
     }
-    allowed_types = cf_get_in (sign->config, "allowed-types");
-    if (!validate_mech_array (ctx, allowed_types))
+    allowed_types = cf_get_in (config, "allowed-types");
+    if (!validate_mech_array (ctx, allowed_types, &sign->allowed))
         goto error;
-    default_type = cf_string (cf_get_in (sign->config, "default-type"));
-    if (!lookup_mech (default_type))
+    default_type = cf_string (cf_get_in (config, "default-type"));
+    if (!(sign->default_mech = lookup_mech (default_type))) {
+        errno = EINVAL;
+        security_error (ctx, "sign: unknown default-type=%s", default_type);
         goto error;
+    }
+    if ((el = cf_get_in (config, "verify-cache-size"))) {
+        int64_t size = cf_int64 (el);
+        if (size < 0 || size > max_cache_size) {
+            errno = EINVAL;
+            security_error (ctx, "sign: verify-cache-size must be 0-%d",
+                            max_cache_size);
+            goto error;
+        }
+        if (size > 0 && security_is_threadsafe (ctx)) {
+            if (!(sign->shared_cache = shared_cache_get (ctx)))
+                goto error;
+            sign->shared_cache_size = size;
+        }
+        else if (size > 0 && !(sign->cache = sign_cache_create (size, NULL))) {
+            security_error (ctx, NULL);
+            goto error;
+        }
+    }
+    sign->version = sign_version;
+    if ((el = cf_get_in (config, "header-version"))) {
+        sign->version = cf_int64 (el);
+        if (sign->version < sign_version || sign->version > sign_version_max) {
+            errno = EINVAL;
+            security_error (ctx, "sign: header-version must be %d-%d",
+                            (int)sign_version, (int)sign_version_max);
+            goto error;
+        }
+    }
     return sign;
 error:
     sign_destroy (sign);
     return NULL;
 }
 
+/* struct sign records which mechanisms are initialized, so it must be
+ * recreated whenever mechanism state is, on reconfiguration.  Mechanism
+ * state depends on [sign] (including [sign.<mech>]) and [ca] at most.
+ */
+static const char *const sign_deps[] = { "sign", "ca", NULL };
+
 static struct sign *sign_init (flux_security_t *ctx)
 {
-    const char *auxname = "flux::sign";
-    struct sign *sign = flux_security_aux_get (ctx, auxname);
+    static struct security_aux_key auxkey = { .name = "flux::sign" };
+    struct sign *sign = security_thread_aux_key_get (ctx, &auxkey);
 
     if (!sign) {
         if (!(sign = sign_create (ctx)))
             goto error_nomsg;
-        if (flux_security_aux_set (ctx, auxname, sign,
-                                   (flux_security_free_f)sign_destroy) < 0)
+        if (security_thread_aux_key_set (ctx, &auxkey, sign,
+                                (flux_security_free_f)sign_destroy) < 0)
             goto error;
+        if (security_aux_depends (ctx, auxkey.name, sign_deps) < 0)
+            return NULL;
     }
     return sign;
 error:
@@ -165,6 +383,34 @@ error_nomsg:
     return NULL;
 }
 
+/* Call mech->init, if defined, the first time 'mech' is used with 'sign'.
+ * It lazily creates mechanism state that may be shared between threads,
+ * so serialize with security_lock().
+ * Return 0 on success, -1 on failure with ctx error state updated.
+ */
+static int mech_init (flux_security_t *ctx,
+                      struct sign *sign,
+                      const struct sign_mech *mech)
+{
+    unsigned int bit = 1U << mech_index (mech);
+    const cf_t *config;
+    int rc = 0;
+
+    if ((sign->initialized & bit))
+        return 0;
+    if (mech->init) {
+        security_lock (ctx);
+        if (!(config = security_get_config (ctx, "sign")))
+            rc = -1;
+        else
+            rc = mech->init (ctx, config);
+        security_unlock (ctx);
+    }
+    if (rc == 0)
+        sign->initialized |= bit;
+    return rc;
+}
+
 /* Convert header to base64, storing in buf/bufsz, growing as needed.
  * Any existing content is overwritten.  Result is NULL terminated.
  * Return 0 on success, -1 on failure with errno set.
@@ -178,16 +424,53 @@ static int header_encode_cpy (struct kv *header, void **buf, int *bufsz)
 
     if (kv_encode (header, &src, &srclen) < 0)
         return -1;
-    dstlen = sodium_base64_encoded_len (srclen,
-                                        sodium_base64_VARIANT_ORIGINAL);
+    dstlen = base64_encoded_len (srclen);
     if (grow_buf (buf, bufsz, dstlen) < 0)
         return -1;
     dst = *buf;
-    sodium_bin2base64 (dst, dstlen, (const unsigned char *)src, srclen,
-                       sodium_base64_VARIANT_ORIGINAL);
+    base64_encode (dst, src, srclen);
     return 0;
 }
 
+/* Call mech->sign, mech->sign_into, or mech->verify, recording the time
+ * spent in FLUX_SECURITY_STATS mode.
+ */
+static char *mech_sign (flux_security_t *ctx,
+                        const struct sign_mech *mech,
+                        const char *input, int inputsz, int flags)
+{
+    uint64_t t = security_stats_start (ctx);
+    char *sig = mech->sign (ctx, input, inputsz, flags);
+    security_stats_end (ctx, mech->stat_sign, t);
+    return sig;
+}
+
+static int mech_sign_into (flux_security_t *ctx,
+                           const struct sign_mech *mech,
+                           const char *input, int inputsz,
+                           char *buf, int bufsz, int flags)
+{
+    uint64_t t = security_stats_start (ctx);
+    int n = mech->sign_into (ctx, input, inputsz, buf, bufsz, flags);
+    /* Only count calls that signed, not size queries.
+     */
+    if (n < bufsz)
+        security_stats_end (ctx, mech->stat_sign, t);
+    return n;
+}
+
+static int mech_verify (flux_security_t *ctx,
+                        const struct sign_mech *mech,
+                        const struct kv *header,
+                        const char *input, int inputsz,
+                        const char *signature, time_t now, int flags)
+{
+    uint64_t t = security_stats_start (ctx);
+    int rc = mech->verify (ctx, header, input, inputsz, signature, now, flags);
+    security_stats_end (ctx, mech->stat_verify, t);
+    return rc;
+}
+
 /* Convert payload to base64, then append with "." prefix to buf/bufsz,
  * growing as needed.  Result is NULL-terminated.
  * This must be called after header_encode_cpy().
@@ -201,14 +484,12 @@ static int payload_encode_cat (const void *pay, int paysz,
     char *dst;
 
     len = strlen (*buf);
-    dstlen = sodium_base64_encoded_len (paysz,
-                                        sodium_base64_VARIANT_ORIGINAL);
+    dstlen = base64_encoded_len (paysz);
     if (grow_buf (buf, bufsz, dstlen + len + 1) < 0)
         return -1;
     dst = (char *)*buf + len;
     *dst++ = '.';
-    sodium_bin2base64 (dst, dstlen, pay, paysz,
-                       sodium_base64_VARIANT_ORIGINAL);
+    base64_encode (dst, pay, paysz);
     return 0;
 }
 
@@ -233,270 +514,1329 @@ static int signature_cat (const char *sig, void **buf, int *bufsz)
     return 0;
 }
 
-const char *flux_sign_wrap_as (flux_security_t *ctx,
-                               int64_t userid,
-                               const void *pay, int paysz,
-                               const char *mech_type, int flags)
+/* Sign HEADER.PAYLOAD in buf/bufsz with mech->sign_into, appending
+ * .SIGNATURE directly to the buffer, growing it as needed.
+ * This must be called after payload_encode_cat().
+ * Return 0 on success, -1 on failure with ctx error state updated.
+ */
+static int signature_sign_cat (flux_security_t *ctx,
+                               const struct sign_mech *mech,
+                               void **buf, int *bufsz,
+                               int flags)
 {
-    struct sign *sign;
-    struct kv *header = NULL;
-    char *sig = NULL;
-    const struct sign_mech *mech;
-    int saved_errno;
+    int len = strlen (*buf);
+    int n;
 
-    if (!ctx || userid < 0 || flags != 0
-        || paysz < 0 || (paysz > 0 && pay == NULL)) {
-        errno = EINVAL;
-        security_error (ctx, NULL);
-        return NULL;
-    }
-    if (!(sign = sign_init (ctx)))
-        return NULL;
-    if (!mech_type)
-        mech_type = cf_string (cf_get_in (sign->config, "default-type"));
-    if (!(mech = lookup_mech (mech_type))) {
-        errno = EINVAL;
-        security_error (ctx, "sign-wrap: unknown mechanism: %s", mech_type);
-        return NULL;
+    /* Start with room for a typical signature, and if that turns out
+     * to be too small, grow to the size reported by sign_into and retry.
+     */
+    if (grow_buf (buf, bufsz, len + 2 + signature_reserve) < 0)
+        goto error;
+    while ((n = mech_sign_into (ctx, mech, *buf, len,
+                                (char *)*buf + len + 1,
+                                *bufsz - len - 1, flags)) >= *bufsz - len - 1) {
+        if (grow_buf (buf, bufsz, len + n + 2) < 0)
+            goto error;
     }
-    if (mech->init) {
-        if (mech->init (ctx, sign->config) < 0)
-            return NULL;
+    if (n < 0)
+        return -1;
+    ((char *)*buf)[len] = '.';
+    return 0;
+error:
+    security_error (ctx, NULL);
+    return -1;
+}
+
+/* Copy pre-encoded header 'hdr' to buf/bufsz, growing as needed.
+ * Any existing content is overwritten.  Result is NULL terminated.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int header_cpy (const char *hdr, void **buf, int *bufsz)
+{
+    if (grow_buf (buf, bufsz, strlen (hdr) + 1) < 0)
+        return -1;
+    strcpy (*buf, hdr);
+    return 0;
+}
+
+/* Read the clock once per wrap or unwrap operation, so that the time
+ * checks of the mechanism (and of a batch) are consistent.
+ * Return 0 on success, -1 on failure with ctx error state updated.
+ */
+static int sign_now (flux_security_t *ctx, time_t *now)
+{
+    if ((*now = time (NULL)) == (time_t)-1) {
+        security_error (ctx, NULL);
+        return -1;
     }
+    return 0;
+}
 
-    /* Create security header.
-     */
+/* Create the part of the security header for 'userid' that is the same
+ * for every signature, including any mechanism-specific data added by
+ * mech->prep_static, and cache it in 'sign' for the next call.
+ * The cached copy is reused as long as userid and mechanism don't change,
+ * and mech->generation, if defined, returns the same value.
+ * Return 0 on success, -1 on failure with ctx error state updated.
+ */
+static int header_prefix (flux_security_t *ctx,
+                          struct sign *sign,
+                          int64_t userid,
+                          const struct sign_mech *mech,
+                          time_t now,
+                          int flags)
+{
+    struct kv *header;
+    int generation = 0;
+
+    if (mech->generation) {
+        if ((generation = mech->generation (ctx, now, flags)) < 0)
+            return -1;
+    }
+    if (sign->prefix
+        && sign->prefix_userid == userid
+        && sign->prefix_mech == mech
+        && sign->prefix_generation == generation)
+        return 0;
     if (!(header = kv_create ()))
         goto error;
-    if (kv_put (header, "version", KV_INT64, sign_version) < 0)
+    if (sign->version >= 3
+        && kv_set_encoding (header, KV_ENCODING_BINARY) < 0)
         goto error;
-    if (kv_put (header, "mechanism", KV_STRING, mech->name) < 0)
+    if (kv_put_unique (header, "version", KV_INT64, sign->version) < 0)
         goto error;
-    if (kv_put (header, "userid", KV_INT64, userid) < 0)
+    if (kv_put_unique (header, "mechanism", KV_STRING, mech->name) < 0)
         goto error;
-    /* Call mech->prep, which adds mechanism-specific data to header, if any.
-     */
-    if (mech->prep) {
-        if (mech->prep (ctx, header, flags) < 0)
+    if (kv_put_unique (header, "userid", KV_INT64, userid) < 0)
+        goto error;
+    if (mech->prep_static) {
+        if (mech->prep_static (ctx, header, now, flags) < 0)
             goto error_msg;
     }
-    /* Serialize to HEADER.PAYLOAD.SIGNATURE
-     */
-    if (header_encode_cpy (header, &sign->wrapbuf, &sign->wrapbufsz) < 0)
-        goto error;
-    if (payload_encode_cat (pay, paysz, &sign->wrapbuf, &sign->wrapbufsz) < 0)
-        goto error;
-    if (!(sig = mech->sign (ctx, sign->wrapbuf, strlen (sign->wrapbuf), flags)))
-        goto error_msg;
-    if (signature_cat (sig, &sign->wrapbuf, &sign->wrapbufsz) < 0)
-        goto error;
-
-    free (sig);
-    kv_destroy (header);
-    return sign->wrapbuf;
+    kv_destroy (sign->prefix);
+    sign->prefix = header;
+    sign->prefix_userid = userid;
+    sign->prefix_mech = mech;
+    sign->prefix_generation = generation;
+    return 0;
 error:
     security_error (ctx, NULL);
 error_msg:
     kv_destroy (header);
-    saved_errno = errno;
-    free (sig);
-    errno = saved_errno;
-    return NULL;
-}
-
-const char *flux_sign_wrap (flux_security_t *ctx,
-                            const void *pay, int paysz,
-                            const char *mech_type, int flags)
-{
-    return flux_sign_wrap_as (ctx, getuid(), pay, paysz, mech_type, flags);
+    return -1;
 }
 
-/* Decode HEADER portion of HEADER.PAYLOAD.SIGNATURE
- * Return header on success or NULL on error with errno set.
- * Set 'endptr' to period ('.') delimiter following HEADER.
+/* Look up mechanism, call mech->init, and create security header
+ * for 'userid', including any mechanism-specific data added by mech->prep.
+ * The header is built in sign->wrap_header, reusing its buffer, so it is
+ * only valid until the next call.
+ * Return header on success, or NULL on failure with ctx error state updated.
  */
-static struct kv *header_decode (const char *input, char **endptr)
+static struct kv *header_create (flux_security_t *ctx,
+                                 struct sign *sign,
+                                 int64_t userid,
+                                 const char *mech_type,
+                                 int flags,
+                                 const struct sign_mech **mechp)
 {
-    char *p;
-    const char *src;
-    size_t srclen;
-    void *dst;
-    size_t dstlen;
+    const struct sign_mech *mech;
     struct kv *header;
-    int saved_errno;
+    time_t now;
 
-    if (!(p = strchr (input, '.'))) {
+    if (!mech_type)
+        mech = sign->default_mech;
+    else if (!(mech = lookup_mech (mech_type))) {
         errno = EINVAL;
+        security_error (ctx, "sign-wrap: unknown mechanism: %s", mech_type);
         return NULL;
     }
-    src = input;
-    srclen = p - input;
-    dstlen = BASE64_DECODE_SIZE (srclen);
-    if (!(dst = malloc (dstlen)))
+    if (mech_init (ctx, sign, mech) < 0)
         return NULL;
-    if (sodium_base642bin (dst, dstlen, src, srclen,
-                           NULL, &dstlen, NULL,
-                           sodium_base64_VARIANT_ORIGINAL) < 0) {
-        errno = EINVAL;
+    if (sign_now (ctx, &now) < 0)
+        return NULL;
+    if (header_prefix (ctx, sign, userid, mech, now, flags) < 0)
+        return NULL;
+    if (!sign->wrap_header && !(sign->wrap_header = kv_create ()))
         goto error;
-    }
-    if (!(header = kv_decode (dst, dstlen)))
+    header = sign->wrap_header;
+    if (kv_copy_into (header, sign->prefix) < 0)
         goto error;
-    free (dst);
-    *endptr = p;
+    /* Call mech->prep, which adds the mechanism-specific data to header
+     * that changes with each signature, if any.
+     */
+    if (mech->prep) {
+        if (mech->prep (ctx, header, now, flags) < 0)
+            goto error_msg;
+    }
+    *mechp = mech;
     return header;
 error:
-    saved_errno = errno;
-    free (dst);
-    errno = saved_errno;
+    security_error (ctx, NULL);
+error_msg:
     return NULL;
 }
 
-/* Decode PAYLOAD portion of PAYLOAD.SIGNATURE to buf/bufsz,
- * expanding as needed.  Any existing content is overwritten.
- * Set 'endptr' to period ('.') delimiter following PAYLOAD.
- * Return 0 on success, -1 on failure with errno set.
+/* Record a successful wrap or unwrap of 'paysz' payload bytes, started
+ * at 't' (see security_stats_start()).
  */
-static int payload_decode_cpy (const char *input, void **buf, int *bufsz,
-                               char **endptr)
+static void stats_wrap (flux_security_t *ctx, uint64_t t, int paysz)
 {
-    char *p;
-    size_t dstlen;
-    size_t srclen;
-    const char *src;
+    security_stats_end (ctx, STAT_WRAP, t);
+    security_stats_add (ctx, STAT_WRAP_BYTES, paysz);
+}
 
-    if (!(p = strchr (input, '.'))) {
-        errno = EINVAL;
-        return -1;
-    }
-    src = input;
-    srclen = p - input;
-    dstlen = BASE64_DECODE_SIZE (srclen);
-    if (grow_buf (buf, bufsz, dstlen) < 0)
-        return -1;
-    if (sodium_base642bin (*buf, dstlen, src, srclen,
-                           NULL, &dstlen, NULL,
-                           sodium_base64_VARIANT_ORIGINAL) < 0) {
-        errno = EINVAL;
-        return -1;
-    }
-    *endptr = p;
-    return dstlen;
+static void stats_unwrap (flux_security_t *ctx, uint64_t t, int paysz)
+{
+    security_stats_end (ctx, STAT_UNWRAP, t);
+    security_stats_add (ctx, STAT_UNWRAP_BYTES, paysz);
 }
 
-/* Return true if mechanism 'name' is present in the 'allowed' array.
+/* Given HEADER already encoded in sign->wrapbuf, append .PAYLOAD.SIGNATURE.
+ * Return 0 on success, -1 on failure with ctx error state updated.
  */
-static bool mech_allowed (const char *name, const cf_t *allowed)
+static int wrap_payload (flux_security_t *ctx,
+                         struct sign *sign,
+                         const struct sign_mech *mech,
+                         const void *pay, int paysz,
+                         int flags)
 {
-    int i;
-    const cf_t *el;
+    char *sig = NULL;
+    int saved_errno;
 
-    for (i = 0; (el = cf_get_at (allowed, i)) != NULL; i++) {
-        if (!strcmp (cf_string (el), name))
-            return true;
-    }
-    return false;
+    if (payload_encode_cat (pay, paysz, &sign->wrapbuf, &sign->wrapbufsz) < 0)
+        goto error;
+    if (mech->sign_into)
+        return signature_sign_cat (ctx, mech, &sign->wrapbuf,
+                                   &sign->wrapbufsz, flags);
+    if (!(sig = mech_sign (ctx, mech, sign->wrapbuf, strlen (sign->wrapbuf),
+                           flags)))
+        goto error_msg;
+    if (signature_cat (sig, &sign->wrapbuf, &sign->wrapbufsz) < 0)
+        goto error;
+    free (sig);
+    return 0;
+error:
+    security_error (ctx, NULL);
+error_msg:
+    saved_errno = errno;
+    free (sig);
+    errno = saved_errno;
+    return -1;
 }
 
-static int sign_unwrap (flux_security_t *ctx,
-                        const char *input,
-                        const void **payload, int *payloadsz,
-                        const char **mech_typep,
-                        int64_t *useridp, int flags, bool check_allowed)
+const char *flux_sign_wrap_as (flux_security_t *ctx,
+                               int64_t userid,
+                               const void *pay, int paysz,
+                               const char *mech_type, int flags)
 {
     struct sign *sign;
     struct kv *header;
-    int len;
-    int64_t userid;
-    int64_t version;
-    const char *mechanism;
     const struct sign_mech *mech;
-    const cf_t *allowed_types;
-    char *endptr;
+    uint64_t t;
 
-    if (!ctx || !input || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY)) {
+    if (!ctx || userid < 0 || flags != 0
+        || paysz < 0 || (paysz > 0 && pay == NULL)) {
         errno = EINVAL;
         security_error (ctx, NULL);
-        return -1;
+        return NULL;
     }
+    t = security_stats_start (ctx);
     if (!(sign = sign_init (ctx)))
-        return -1;
-    /* Parse and verify generic portion of security header.
+        return NULL;
+    if (!(header = header_create (ctx, sign, userid, mech_type, flags, &mech)))
+        return NULL;
+    /* Serialize to HEADER.PAYLOAD.SIGNATURE
      */
-    if (!(header = header_decode (input, &endptr))) {
-        security_error (ctx, "sign-unwrap: header decode error: %s",
-                        strerror (errno));
+    if (header_encode_cpy (header, &sign->wrapbuf, &sign->wrapbufsz) < 0) {
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    if (wrap_payload (ctx, sign, mech, pay, paysz, flags) < 0)
+        return NULL;
+    stats_wrap (ctx, t, paysz);
+    return sign->wrapbuf;
+}
+
+const char *flux_sign_wrap (flux_security_t *ctx,
+                            const void *pay, int paysz,
+                            const char *mech_type, int flags)
+{
+    return flux_sign_wrap_as (ctx, getuid(), pay, paysz, mech_type, flags);
+}
+
+/* Return the length of NULL terminated HEADER.PAYLOAD, given the
+ * raw header and payload sizes.
+ */
+static int unsigned_length (int headersz, int paysz)
+{
+    size_t hlen = base64_encoded_len (headersz);
+    size_t plen = base64_encoded_len (paysz);
+    return hlen + plen - 1; // each length includes a NUL, one becomes '.'
+}
+
+static int wrap_as_into (flux_security_t *ctx,
+                         int64_t userid,
+                         const void *pay, int paysz,
+                         const char *mech_type, int flags,
+                         char *buf, int bufsz)
+{
+    struct sign *sign;
+    struct kv *header;
+    const struct sign_mech *mech;
+    const char *src;
+    int srclen;
+    int need;
+    int len;
+    int siglen;
+    char *sig = NULL;
+    int saved_errno;
+
+    if (!ctx || userid < 0 || flags != 0
+        || paysz < 0 || (paysz > 0 && pay == NULL)
+        || bufsz < 0 || (bufsz > 0 && buf == NULL)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(header = header_create (ctx, sign, userid, mech_type, flags, &mech)))
         return -1;
+    if (kv_encode (header, &src, &srclen) < 0)
+        goto error;
+    /* If caller's buffer may not hold the result, report its size from
+     * the mechanism's signature bound, without signing.
+     */
+    need = unsigned_length (srclen, paysz) + 1 + mech->sig_max;
+    if (need >= bufsz)
+        return need;
+    base64_encode (buf, src, srclen);
+    len = strlen (buf);
+    buf[len++] = '.';
+    base64_encode (buf + len, pay, paysz);
+    len += strlen (buf + len);
+    if (mech->sign_into) {
+        int avail = bufsz - len - 1;
+        siglen = mech_sign_into (ctx, mech, buf, len,
+                                 avail > 0 ? buf + len + 1 : NULL, avail,
+                                 flags);
+        if (siglen < 0)
+            goto error_msg;
+        if (siglen < avail)
+            buf[len] = '.';
+        return len + siglen + 1;
+    }
+    if (!(sig = mech_sign (ctx, mech, buf, len, flags)))
+        goto error_msg;
+    siglen = strlen (sig);
+    if (len + siglen + 2 <= bufsz) {
+        buf[len] = '.';
+        strcpy (buf + len + 1, sig);
+    }
+    free (sig);
+    return len + siglen + 1;
+error:
+    security_error (ctx, NULL);
+error_msg:
+    saved_errno = errno;
+    free (sig);
+    errno = saved_errno;
+    return -1;
+}
+
+int flux_sign_wrap_as_into (flux_security_t *ctx,
+                            int64_t userid,
+                            const void *pay, int paysz,
+                            const char *mech_type, int flags,
+                            char *buf, int bufsz)
+{
+    uint64_t t = security_stats_start (ctx);
+    int rc;
+
+    rc = wrap_as_into (ctx, userid, pay, paysz, mech_type, flags, buf, bufsz);
+    if (rc >= 0)
+        stats_wrap (ctx, t, paysz);
+    return rc;
+}
+
+int flux_sign_wrap_into (flux_security_t *ctx,
+                         const void *pay, int paysz,
+                         const char *mech_type, int flags,
+                         char *buf, int bufsz)
+{
+    return flux_sign_wrap_as_into (ctx, getuid (), pay, paysz, mech_type,
+                                   flags, buf, bufsz);
+}
+
+static void free_outputs (char **outputs, int count)
+{
+    int saved_errno = errno;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free (outputs[i]);
+        outputs[i] = NULL;
+    }
+    errno = saved_errno;
+}
+
+static const int batch_max_threads = 32;
+static const int batch_min_per_thread = 16;
+
+/* Choose the number of threads to use for a batch of 'count' items.
+ */
+static int batch_nthreads (flux_security_t *ctx, int count)
+{
+    long ncpu;
+    int n;
+
+    if (!security_is_threadsafe (ctx))
+        return 1;
+    if ((ncpu = sysconf (_SC_NPROCESSORS_ONLN)) < 1)
+        ncpu = 1;
+    n = count / batch_min_per_thread;
+    if (n > ncpu)
+        n = ncpu;
+    if (n > batch_max_threads)
+        n = batch_max_threads;
+    return n < 1 ? 1 : n;
+}
+
+/* Batch signing.  HEADER is prepared and encoded once by the calling
+ * thread.  For mechanisms with sign_parallel set, workers then sign a
+ * strided subset of the payloads each, using their own thread state in
+ * 'ctx'.  The first error stops the batch.
+ */
+struct wrap_batch {
+    flux_security_t *ctx;
+    const struct sign_mech *mech;
+    const char *hdr;
+    const void **pays;
+    const int *payszs;
+    char **outputs;
+    int count;
+    int flags;
+    int stride;
+    int errnum;         // protected by security_lock()
+    char *error;        // protected by security_lock()
+};
+
+struct wrap_batch_worker {
+    struct wrap_batch *batch;
+    int start;
+    pthread_t t;
+};
+
+/* Record the first error of a batch from this thread's error state.
+ */
+static void wrap_batch_fail (struct wrap_batch *b)
+{
+    security_lock (b->ctx);
+    if (b->errnum == 0) {
+        if ((b->errnum = flux_security_last_errnum (b->ctx)) == 0)
+            b->errnum = EINVAL;
+        b->error = strdup (flux_security_last_error (b->ctx));
+    }
+    security_unlock (b->ctx);
+}
+
+static bool wrap_batch_failed (struct wrap_batch *b)
+{
+    bool failed;
+
+    security_lock (b->ctx);
+    failed = b->errnum != 0;
+    security_unlock (b->ctx);
+    return failed;
+}
+
+static void wrap_batch_run (struct wrap_batch *b, struct sign *sign, int start)
+{
+    int i;
+
+    for (i = start; i < b->count; i += b->stride) {
+        uint64_t t;
+
+        if (b->stride > 1 && wrap_batch_failed (b))
+            return;
+        t = security_stats_start (b->ctx);
+        if (header_cpy (b->hdr, &sign->wrapbuf, &sign->wrapbufsz) < 0) {
+            security_error (b->ctx, NULL);
+            goto error;
+        }
+        if (wrap_payload (b->ctx, sign, b->mech, b->pays[i], b->payszs[i],
+                          b->flags) < 0)
+            goto error;
+        if (!(b->outputs[i] = strdup (sign->wrapbuf))) {
+            security_error (b->ctx, NULL);
+            goto error;
+        }
+        stats_wrap (b->ctx, t, b->payszs[i]);
+    }
+    return;
+error:
+    wrap_batch_fail (b);
+}
+
+static void *wrap_batch_worker (void *arg)
+{
+    struct wrap_batch_worker *w = arg;
+    struct wrap_batch *b = w->batch;
+    struct sign *sign;
+
+    if (!(sign = sign_init (b->ctx))
+        || mech_init (b->ctx, sign, b->mech) < 0)
+        wrap_batch_fail (b);
+    else
+        wrap_batch_run (b, sign, w->start);
+    security_thread_exit (b->ctx);
+    return NULL;
+}
+
+/* Sign with 'nthreads' (see batch_nthreads()), where the calling thread
+ * takes the first share of the work.
+ */
+static void wrap_batch_threads (struct wrap_batch *b, struct sign *sign)
+{
+    struct wrap_batch_worker w[batch_max_threads];
+    int nthreads;
+    int started;
+    int i;
+
+    nthreads = b->mech->sign_parallel ? batch_nthreads (b->ctx, b->count) : 1;
+    b->stride = nthreads;
+    for (i = 1; i < nthreads; i++) {
+        w[i].batch = b;
+        w[i].start = i;
+        if (pthread_create (&w[i].t, NULL, wrap_batch_worker, &w[i]) != 0)
+            break;
+    }
+    /* If thread creation failed, the calling thread takes the unclaimed
+     * shares too.
+     */
+    started = i;
+    wrap_batch_run (b, sign, 0);
+    for (; i < nthreads; i++)
+        wrap_batch_run (b, sign, i);
+    for (i = 1; i < started; i++)
+        (void)pthread_join (w[i].t, NULL);
+}
+
+/* Sign with mech->sign_many.  HEADER.PAYLOAD of each item is built in
+ * outputs[i], then .SIGNATURE is appended once all results are in.
+ */
+static void wrap_batch_many (struct wrap_batch *b, struct sign *sign)
+{
+    flux_security_t *ctx = b->ctx;
+    struct sign_batch *batch;
+    uint64_t t = security_stats_start (ctx);
+    int i;
+
+    if (mech_init (ctx, sign, b->mech) < 0)
+        goto error_msg;
+    if (!(batch = sign_batch_create (b->count)))
+        goto error;
+    for (i = 0; i < b->count; i++) {
+        if (header_cpy (b->hdr, &sign->wrapbuf, &sign->wrapbufsz) < 0
+            || payload_encode_cat (b->pays[i], b->payszs[i],
+                                   &sign->wrapbuf, &sign->wrapbufsz) < 0
+            || !(b->outputs[i] = strdup (sign->wrapbuf))) {
+            sign_batch_destroy (batch);
+            goto error;
+        }
+        sign_batch_set (batch, i, b->outputs[i], strlen (b->outputs[i]),
+                        NULL, NULL);
+    }
+    if (b->mech->sign_many (ctx, batch, b->flags) < 0) {
+        int errnum = flux_security_last_errnum (ctx);
+        sign_batch_fail_pending (batch, errnum ? errnum : EINVAL,
+                                 flux_security_last_error (ctx));
+    }
+    sign_batch_wait (batch);
+    for (i = 0; i < b->count; i++) {
+        char *sig = NULL;
+        int len;
+        char *new;
+
+        if ((errno = sign_batch_result (batch, i, &sig)) != 0) {
+            if (sign_batch_error (batch))
+                security_error (ctx, "%s", sign_batch_error (batch));
+            else
+                security_error (ctx, NULL);
+            sign_batch_destroy (batch);
+            goto error_msg;
+        }
+        len = strlen (b->outputs[i]);
+        if (!sig || !(new = realloc (b->outputs[i], len + strlen (sig) + 2))) {
+            if (!sig)
+                errno = EINVAL;
+            free (sig);
+            sign_batch_destroy (batch);
+            goto error;
+        }
+        new[len] = '.';
+        strcpy (new + len + 1, sig);
+        b->outputs[i] = new;
+        free (sig);
+        stats_wrap (ctx, t, b->payszs[i]);
+    }
+    sign_batch_destroy (batch);
+    return;
+error:
+    security_error (ctx, NULL);
+error_msg:
+    wrap_batch_fail (b);
+}
+
+int flux_sign_wrap_batch_as (flux_security_t *ctx,
+                             int64_t userid,
+                             const void **pays, const int *payszs, int count,
+                             char **outputs,
+                             const char *mech_type, int flags)
+{
+    struct sign *sign;
+    struct kv *header;
+    struct wrap_batch b = {
+        .ctx = ctx,
+        .pays = pays,
+        .payszs = payszs,
+        .outputs = outputs,
+        .count = count,
+        .flags = flags,
+    };
+    char *hdr = NULL;
+    int saved_errno;
+    int i;
+
+    /* Clear every output first, so all are NULL on any error.
+     */
+    if (outputs) {
+        for (i = 0; i < count; i++)
+            outputs[i] = NULL;
+    }
+    if (!ctx || userid < 0 || flags != 0 || count < 0
+        || (count > 0 && (!pays || !payszs || !outputs))) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (payszs[i] < 0 || (payszs[i] > 0 && pays[i] == NULL)) {
+            errno = EINVAL;
+            security_error (ctx, "sign-wrap: payload[%d] is invalid", i);
+            return -1;
+        }
+    }
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(header = header_create (ctx, sign, userid, mech_type, flags,
+                                  &b.mech)))
+        return -1;
+    /* Encode HEADER once for the whole batch, then reuse it for each
+     * HEADER.PAYLOAD.SIGNATURE.
+     */
+    if (header_encode_cpy (header, &sign->wrapbuf, &sign->wrapbufsz) < 0
+        || !(hdr = strdup (sign->wrapbuf))) {
+        security_error (ctx, NULL);
+        return -1;
+    }
+    b.hdr = hdr;
+    if (b.mech->sign_many)
+        wrap_batch_many (&b, sign);
+    else
+        wrap_batch_threads (&b, sign);
+    free (hdr);
+    if (b.errnum != 0) {
+        free_outputs (outputs, count);
+        errno = b.errnum;
+        if (b.error)
+            security_error (ctx, "%s", b.error);
+        else
+            security_error (ctx, NULL);
+        saved_errno = errno;
+        free (b.error);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+int flux_sign_wrap_batch (flux_security_t *ctx,
+                          const void **pays, const int *payszs, int count,
+                          char **outputs,
+                          const char *mech_type, int flags)
+{
+    return flux_sign_wrap_batch_as (ctx, getuid (), pays, payszs, count,
+                                    outputs, mech_type, flags);
+}
+
+/* Segments of HEADER.PAYLOAD.SIGNATURE, located by unwrap_tokenize().
+ * 'signature' is NULL terminated since it is the tail of the input.
+ */
+struct unwrap_input {
+    const char *header;
+    int headersz;
+    const char *payload;
+    int payloadsz;
+    const char *signature;
+};
+
+/* Locate the segments of HEADER.PAYLOAD.SIGNATURE in one pass over 'input'.
+ * Return 0 on success, -1 on failure with errno set.  On failure,
+ * in->header is non-NULL if the HEADER delimiter was found.
+ */
+static int unwrap_tokenize (const char *input, struct unwrap_input *in)
+{
+    const char *p = input;
+    const char *dot[2];
+    int n = 0;
+
+    while (*p && n < 2) {
+        if (*p == '.')
+            dot[n++] = p;
+        p++;
+    }
+    in->header = n > 0 ? input : NULL;
+    if (n < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    in->header = input;
+    in->headersz = dot[0] - input;
+    in->payload = dot[0] + 1;
+    in->payloadsz = dot[1] - in->payload;
+    in->signature = dot[1] + 1;
+    return 0;
+}
+
+/* Return the exact decoded size of base64 string 'src' of length 'srclen',
+ * or -1 with errno set if the length is invalid.
+ */
+static int base64_decoded_len (const char *src, size_t srclen)
+{
+    int len;
+
+    if (srclen % 4 != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    len = srclen / 4 * 3;
+    if (srclen > 0 && src[srclen - 1] == '=')
+        len--;
+    if (srclen > 1 && src[srclen - 2] == '=')
+        len--;
+    return len;
+}
+
+/* Decode HEADER portion of input into sign->header, reusing the
+ * decode buffer and kv object from previous calls.
+ * Return header on success or NULL on error with errno set.
+ */
+static const struct kv *header_decode (struct sign *sign,
+                                       const struct unwrap_input *in)
+{
+    char *buf;
+    int len;
+
+    if (grow_buf (&sign->hdrbuf, &sign->hdrbufsz,
+                  BASE64_DECODE_SIZE (in->headersz)) < 0)
+        return NULL;
+    if ((len = base64_decode (sign->hdrbuf, sign->hdrbufsz,
+                              in->header, in->headersz)) < 0)
+        return NULL;
+    if (!sign->header && !(sign->header = kv_create ()))
+        return NULL;
+    /* The decoded header becomes the kv buffer, and the previous kv
+     * buffer is kept for decoding the next one, so there is no copy.
+     */
+    buf = sign->hdrbuf;
+    if (kv_decode_swap (sign->header, &buf, &sign->hdrbufsz, len) < 0)
+        return NULL;
+    sign->hdrbuf = buf;
+    return sign->header;
+}
+
+/* Parse and verify generic portion of security header.
+ * Set 'mechp' and 'useridp'.
+ * Return header on success, or NULL on failure with ctx error state updated.
+ */
+static const struct kv *unwrap_header (flux_security_t *ctx,
+                                       struct sign *sign,
+                                       const struct unwrap_input *in,
+                                       bool check_allowed,
+                                       const struct sign_mech **mechp,
+                                       int64_t *useridp)
+{
+    const struct kv *header;
+    int64_t userid;
+    int64_t version;
+    const char *mechanism;
+    int index;
+
+    if (!(header = header_decode (sign, in))) {
+        security_error (ctx, "sign-unwrap: header decode error: %s",
+                        strerror (errno));
+        return NULL;
+    }
+    if (kv_get (header, "version", KV_INT64, &version) < 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header version missing");
+        return NULL;
+    }
+    if (version < sign_version || version > sign_version_max) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header version=%d unknown",
+                        (int)version);
+        return NULL;
+    }
+    if (kv_get (header, "mechanism", KV_STRING, &mechanism) < 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header mechanism missing");
+        return NULL;
+    }
+    if ((index = lookup_mech_index (mechanism)) < 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header mechanism=%s unknown",
+                        mechanism);
+        return NULL;
+    }
+    if (check_allowed && !(sign->allowed & (1U << index))) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header mechanism=%s not allowed",
+                        mechanism);
+        return NULL;
+    }
+    if (kv_get (header, "userid", KV_INT64, &userid) < 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-unwrap: header userid missing");
+        return NULL;
+    }
+    *mechp = mechtab[index];
+    *useridp = userid;
+    return header;
+}
+
+/* Mech-specific verification of SIGNATURE over HEADER.PAYLOAD.
+ * Return 0 on success, -1 on failure with ctx error state updated.
+ */
+static int unwrap_verify (flux_security_t *ctx,
+                          struct sign *sign,
+                          const struct sign_mech *mech,
+                          const struct kv *header,
+                          const struct unwrap_input *in,
+                          time_t now,
+                          int flags)
+{
+    int inputsz = in->signature - in->header - 1;
+    uint8_t digest[SHA256_BLOCK_SIZE];
+
+    /* If the exact same input was verified recently, skip the mechanism.
+     * The key covers the whole input, so it implies the same header.
+     */
+    if (sign->cache || sign->shared_cache) {
+        SHA256_CTX shx;
+        int cached_mech;
+        int64_t cached_userid;
+        int64_t userid;
+
+        sha256_init (&shx);
+        sha256_update (&shx, (const BYTE *)in->header,
+                       inputsz + 1 + strlen (in->signature));
+        sha256_final (&shx, digest);
+        if (verify_cache_lookup (sign, digest, now,
+                                 &cached_mech, &cached_userid) == 0
+            && kv_get (header, "userid", KV_INT64, &userid) == 0
+            && cached_mech == mech_index (mech)
+            && cached_userid == userid) {
+            security_stats_count (ctx, STAT_VERIFY_CACHE_HIT);
+            return 0;
+        }
+        security_stats_count (ctx, STAT_VERIFY_CACHE_MISS);
+    }
+    if (mech_init (ctx, sign, mech) < 0)
+        return -1;
+    if (mech_verify (ctx, mech, header, in->header, inputsz, in->signature,
+                     now, flags) < 0)
+        return -1;
+    if ((sign->cache || sign->shared_cache) && mech->expires) {
+        time_t expires = mech->expires (ctx, header);
+        int64_t userid;
+
+        if (expires != (time_t)-1
+            && kv_get (header, "userid", KV_INT64, &userid) == 0)
+            verify_cache_insert (sign, digest, now, expires,
+                                 mech_index (mech), userid);
+    }
+    return 0;
+}
+
+/* Tokenize input and parse header, filling 'in', 'mechp', and 'useridp'.
+ * Return header on success, or NULL on failure with ctx error state updated.
+ */
+static const struct kv *unwrap_parse (flux_security_t *ctx,
+                                      struct sign *sign,
+                                      const char *input,
+                                      bool check_allowed,
+                                      struct unwrap_input *in,
+                                      const struct sign_mech **mechp,
+                                      int64_t *useridp)
+{
+    if (unwrap_tokenize (input, in) < 0) {
+        security_error (ctx, "sign-unwrap: %s decode error: %s",
+                        in->header ? "payload" : "header",
+                        strerror (errno));
+        return NULL;
+    }
+    return unwrap_header (ctx, sign, in, check_allowed, mechp, useridp);
+}
+
+static int sign_unwrap (flux_security_t *ctx,
+                        const char *input,
+                        const void **payload, int *payloadsz,
+                        const char **mech_typep,
+                        int64_t *useridp, int flags, bool check_allowed)
+{
+    struct sign *sign;
+    const struct kv *header;
+    struct unwrap_input in;
+    int len;
+    int64_t userid;
+    const struct sign_mech *mech;
+    uint64_t t;
+
+    if (!ctx || !input || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    t = security_stats_start (ctx);
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(header = unwrap_parse (ctx, sign, input, check_allowed,
+                                 &in, &mech, &userid)))
+        return -1;
+    /* Decode payload
+     */
+    if (grow_buf (&sign->unwrapbuf, &sign->unwrapbufsz,
+                  BASE64_DECODE_SIZE (in.payloadsz)) < 0
+        || (len = base64_decode (sign->unwrapbuf, sign->unwrapbufsz,
+                                 in.payload, in.payloadsz)) < 0) {
+        security_error (ctx, "sign-unwrap: payload decode error: %s",
+                        strerror (errno));
+        return -1;
+    }
+    /* Mech-specific verification (optional).
+     */
+    if (!(flags & FLUX_SIGN_NOVERIFY)) {
+        time_t now;
+        if (sign_now (ctx, &now) < 0
+            || unwrap_verify (ctx, sign, mech, header, &in, now, flags) < 0)
+            return -1;
+    }
+    if (payload)
+        *payload = (len > 0 ? sign->unwrapbuf : NULL);
+    if (payloadsz)
+        *payloadsz = len;
+    if (mech_typep)
+        *mech_typep = mech->name;
+    if (useridp)
+        *useridp = userid;
+    stats_unwrap (ctx, t, len);
+    return 0;
+}
+
+int flux_sign_unwrap_into (flux_security_t *ctx, const char *input,
+                           void *buf, int bufsz,
+                           int64_t *useridp, int flags)
+{
+    struct sign *sign;
+    const struct kv *header;
+    struct unwrap_input in;
+    int len;
+    int64_t userid;
+    const struct sign_mech *mech;
+    uint64_t t;
+
+    if (!ctx || !input || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY)
+        || bufsz < 0 || (bufsz > 0 && buf == NULL)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    t = security_stats_start (ctx);
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(header = unwrap_parse (ctx, sign, input, true, &in, &mech, &userid)))
+        return -1;
+    if ((len = base64_decoded_len (in.payload, in.payloadsz)) < 0)
+        goto error_decode;
+    /* If payload does not fit, only report the required size.
+     */
+    if (len > bufsz)
+        return len;
+    if (base64_decode (buf, bufsz, in.payload, in.payloadsz) < 0)
+        goto error_decode;
+    if (!(flags & FLUX_SIGN_NOVERIFY)) {
+        time_t now;
+        if (sign_now (ctx, &now) < 0
+            || unwrap_verify (ctx, sign, mech, header, &in, now, flags) < 0)
+            return -1;
+    }
+    if (useridp)
+        *useridp = userid;
+    stats_unwrap (ctx, t, len);
+    return len;
+error_decode:
+    security_error (ctx, "sign-unwrap: payload decode error: %s",
+                    strerror (errno));
+    return -1;
+}
+
+/* flux_sign_unwrap_header() with 'now' supplied by the caller.
+ * If 'deferp' is non-NULL and the mechanism defines verify_many, skip
+ * verification and set '*deferp' to a copy of the parsed header, so the
+ * caller can verify it later with others.  Otherwise set it to NULL.
+ */
+static int sign_unwrap_header (flux_security_t *ctx, const char *input,
+                               const char **mech_typep, int64_t *useridp,
+                               int *payloadszp, time_t now, int flags,
+                               struct kv **deferp)
+{
+    struct sign *sign;
+    const struct kv *header;
+    struct unwrap_input in;
+    int len;
+    int64_t userid;
+    const struct sign_mech *mech;
+
+    if (!ctx || !input || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(header = unwrap_parse (ctx, sign, input, true, &in, &mech, &userid)))
+        return -1;
+    /* N.B. The signature covers the encoded PAYLOAD, so it need not be
+     * decoded here.  It is checked to be valid base64, so that a later
+     * flux_sign_decode_payload() cannot fail.
+     */
+    if ((len = base64_check (in.payload, in.payloadsz)) < 0) {
+        security_error (ctx, "sign-unwrap: payload decode error: %s",
+                        strerror (errno));
+        return -1;
+    }
+    if (deferp)
+        *deferp = NULL;
+    if (!(flags & FLUX_SIGN_NOVERIFY)) {
+        if (deferp && mech->verify_many) {
+            if (!(*deferp = kv_copy (header))) {
+                security_error (ctx, NULL);
+                return -1;
+            }
+        }
+        else if (unwrap_verify (ctx, sign, mech, header, &in, now, flags) < 0)
+            return -1;
+    }
+    if (mech_typep)
+        *mech_typep = mech->name;
+    if (useridp)
+        *useridp = userid;
+    if (payloadszp)
+        *payloadszp = len;
+    return 0;
+}
+
+int flux_sign_unwrap_header (flux_security_t *ctx, const char *input,
+                             const char **mech_typep, int64_t *useridp,
+                             int *payloadszp, int flags)
+{
+    time_t now = 0;
+
+    if (!(flags & FLUX_SIGN_NOVERIFY) && sign_now (ctx, &now) < 0)
+        return -1;
+    return sign_unwrap_header (ctx, input, mech_typep, useridp, payloadszp,
+                               now, flags, NULL);
+}
+
+/* Parallel batch verification.  Each worker verifies a strided subset of
+ * the batch like flux_sign_unwrap_header(), using its own thread state
+ * in 'ctx', which is destroyed when the worker is done.  The whole batch
+ * is checked against the same 'now'.  Inputs signed with a mechanism that
+ * defines verify_many are only parsed by the workers, then verified
+ * together by the calling thread once the workers are done.
+ */
+struct batch_deferred {
+    struct kv *header;  // parsed header, or NULL if not deferred
+    int mech;           // mechtab index
+    int payloadsz;
+    int index;          // index in the sign_batch of 'mech'
+};
+
+struct batch {
+    flux_security_t *ctx;
+    const char **inputs;
+    int count;
+    int64_t *userids;
+    int *payloadszs;
+    int *errnums;
+    time_t now;
+    int flags;
+    int stride;
+    int failed;         // protected by security_lock()
+    struct batch_deferred *deferred;
+};
+
+struct batch_worker {
+    struct batch *batch;
+    int start;
+    pthread_t t;
+};
+
+static int batch_run (struct batch *b, int start)
+{
+    int i;
+    int failed = 0;
+
+    for (i = start; i < b->count; i += b->stride) {
+        int64_t userid = -1;
+        int payloadsz = 0;
+        const char *mech_type;
+        struct batch_deferred *d = b->deferred ? &b->deferred[i] : NULL;
+        uint64_t t = security_stats_start (b->ctx);
+
+        if (sign_unwrap_header (b->ctx, b->inputs[i], &mech_type, &userid,
+                                &payloadsz, b->now, b->flags,
+                                d ? &d->header : NULL) < 0) {
+            b->errnums[i] = flux_security_last_errnum (b->ctx);
+            if (b->errnums[i] == 0)
+                b->errnums[i] = EINVAL;
+            failed++;
+        }
+        else if (d && d->header) {
+            d->mech = lookup_mech_index (mech_type);
+            d->payloadsz = payloadsz;
+        }
+        else {
+            b->errnums[i] = 0;
+            stats_unwrap (b->ctx, t, payloadsz);
+        }
+        if (b->userids)
+            b->userids[i] = userid;
+        if (b->payloadszs)
+            b->payloadszs[i] = payloadsz;
     }
-    if (kv_get (header, "version", KV_INT64, &version) < 0) {
-        errno = EINVAL;
-        security_error (ctx, "sign-unwrap: header version missing");
-        goto error;
+    return failed;
+}
+
+/* Verify the inputs deferred by batch_run() with mech->verify_many,
+ * submitting a sign_batch for each mechanism before waiting on any.
+ * Return the number of inputs that failed.
+ */
+static int batch_run_many (struct batch *b, struct sign *sign)
+{
+    flux_security_t *ctx = b->ctx;
+    struct sign_batch *batches[sizeof (mechtab) / sizeof (mechtab[0])];
+    uint64_t t = security_stats_start (ctx);
+    int failed = 0;
+    int m, i;
+
+    for (m = 0; m < mechtab_count; m++) {
+        int n = 0;
+
+        for (i = 0; i < b->count; i++) {
+            if (b->deferred[i].header && b->deferred[i].mech == m)
+                b->deferred[i].index = n++;
+        }
+        batches[m] = NULL;
+        if (n == 0)
+            continue;
+        if (!(batches[m] = sign_batch_create (n)))
+            continue;
+        for (i = 0; i < b->count; i++) {
+            struct batch_deferred *d = &b->deferred[i];
+            struct unwrap_input in;
+
+            if (!d->header || d->mech != m)
+                continue;
+            (void)unwrap_tokenize (b->inputs[i], &in); // parsed before
+            sign_batch_set (batches[m], d->index, in.header,
+                            in.signature - in.header - 1,
+                            d->header, in.signature);
+        }
+        if (mech_init (ctx, sign, mechtab[m]) < 0
+            || mechtab[m]->verify_many (ctx, batches[m], b->now,
+                                        b->flags) < 0) {
+            int errnum = flux_security_last_errnum (ctx);
+            sign_batch_fail_pending (batches[m], errnum ? errnum : EINVAL,
+                                     NULL);
+        }
     }
-    if (version != sign_version) {
-        errno = EINVAL;
-        security_error (ctx, "sign-unwrap: header version=%d unknown",
-                        (int)version);
-        goto error;
+    for (m = 0; m < mechtab_count; m++) {
+        if (batches[m])
+            sign_batch_wait (batches[m]);
     }
-    if (kv_get (header, "mechanism", KV_STRING, &mechanism) < 0) {
-        errno = EINVAL;
-        security_error (ctx, "sign-unwrap: header mechanism missing");
-        goto error;
+    for (i = 0; i < b->count; i++) {
+        struct batch_deferred *d = &b->deferred[i];
+
+        if (!d->header)
+            continue;
+        if (!batches[d->mech])
+            b->errnums[i] = ENOMEM;
+        else
+            b->errnums[i] = sign_batch_result (batches[d->mech], d->index,
+                                               NULL);
+        if (b->errnums[i] != 0) {
+            if (b->userids)
+                b->userids[i] = -1;
+            if (b->payloadszs)
+                b->payloadszs[i] = 0;
+            failed++;
+        }
+        else
+            stats_unwrap (ctx, t, d->payloadsz);
+    }
+    for (m = 0; m < mechtab_count; m++)
+        sign_batch_destroy (batches[m]);
+    return failed;
+}
+
+static void batch_deferred_destroy (struct batch_deferred *deferred,
+                                    int count)
+{
+    if (deferred) {
+        int i;
+        for (i = 0; i < count; i++)
+            kv_destroy (deferred[i].header);
+        free (deferred);
+    }
+}
+
+/* Return true if any mechanism allowed by 'sign' defines verify_many.
+ */
+static bool batch_can_defer (struct sign *sign)
+{
+    int i;
+
+    for (i = 0; i < mechtab_count; i++) {
+        if ((sign->allowed & (1U << i)) && mechtab[i]->verify_many)
+            return true;
     }
-    if (!(mech = lookup_mech (mechanism))) {
+    return false;
+}
+
+static void *batch_worker (void *arg)
+{
+    struct batch_worker *w = arg;
+    struct batch *b = w->batch;
+    int failed = batch_run (b, w->start);
+
+    security_lock (b->ctx);
+    b->failed += failed;
+    security_unlock (b->ctx);
+    security_thread_exit (b->ctx);
+    return NULL;
+}
+
+int flux_sign_unwrap_batch (flux_security_t *ctx,
+                            const char **inputs, int count,
+                            int64_t *userids, int *payloadszs, int *errnums,
+                            int flags)
+{
+    struct batch b = {
+        .ctx = ctx,
+        .inputs = inputs,
+        .count = count,
+        .userids = userids,
+        .payloadszs = payloadszs,
+        .errnums = errnums,
+        .flags = flags,
+    };
+    struct batch_worker w[batch_max_threads];
+    struct sign *sign;
+    int nthreads;
+    int started;
+    int failed;
+    int i;
+
+    if (!ctx || count < 0 || (count > 0 && (!inputs || !errnums))
+        || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY)) {
         errno = EINVAL;
-        security_error (ctx, "sign-unwrap: header mechanism=%s unknown",
-                        mechanism);
-        goto error;
+        security_error (ctx, NULL);
+        return -1;
     }
-    if (check_allowed) {
-        allowed_types = cf_get_in (sign->config, "allowed-types");
-        if (!mech_allowed (mechanism, allowed_types)) {
+    for (i = 0; i < count; i++) {
+        if (!inputs[i]) {
             errno = EINVAL;
-            security_error (ctx, "sign-unwrap: header mechanism=%s not allowed",
-                            mechanism);
-            goto error;
+            security_error (ctx, NULL);
+            return -1;
         }
     }
-    if (kv_get (header, "userid", KV_INT64, &userid) < 0) {
-        errno = EINVAL;
-        security_error (ctx, "sign-unwrap: header userid missing");
-        goto error;
+    /* Check the configuration and set up this thread's state, so that a
+     * config error is reported once for the whole batch.
+     */
+    if (!(sign = sign_init (ctx)))
+        return -1;
+    if (!(flags & FLUX_SIGN_NOVERIFY) && sign_now (ctx, &b.now) < 0)
+        return -1;
+    if (!(flags & FLUX_SIGN_NOVERIFY) && count > 0 && batch_can_defer (sign)
+        && !(b.deferred = calloc (count, sizeof (b.deferred[0])))) {
+        security_error (ctx, NULL);
+        return -1;
     }
-    /* Decode payload
+    nthreads = batch_nthreads (ctx, count);
+    b.stride = nthreads;
+    /* The calling thread takes the first share of the work.
      */
-    len = payload_decode_cpy (endptr + 1, &sign->unwrapbuf, &sign->unwrapbufsz,
-                              &endptr);
-    if (len < 0) {
-        security_error (ctx, "sign-unwrap: payload decode error: %s",
-                        strerror (errno));
-        goto error;
+    for (i = 1; i < nthreads; i++) {
+        w[i].batch = &b;
+        w[i].start = i;
+        if (pthread_create (&w[i].t, NULL, batch_worker, &w[i]) != 0)
+            break;
     }
-    /* Mech-specific verification (optional).
+    /* If thread creation failed, the calling thread takes the unclaimed
+     * shares too.
      */
-    if (!(flags & FLUX_SIGN_NOVERIFY)) {
-        int inputsz = endptr - input;
-        const char *signature = endptr + 1;
-        if (mech->init) {
-            if (mech->init (ctx, sign->config) < 0)
-                goto error;
-        }
-        if (mech->verify (ctx, header, input, inputsz, signature, flags) < 0)
-            goto error;
+    started = i;
+    failed = batch_run (&b, 0);
+    for (; i < nthreads; i++)
+        failed += batch_run (&b, i);
+    nthreads = started;
+    security_lock (ctx);
+    b.failed += failed;
+    security_unlock (ctx);
+    for (i = 1; i < nthreads; i++)
+        (void)pthread_join (w[i].t, NULL);
+    if (b.deferred) {
+        b.failed += batch_run_many (&b, sign);
+        batch_deferred_destroy (b.deferred, count);
     }
-    kv_destroy (header);
-    if (payload)
-        *payload = (len > 0 ? sign->unwrapbuf : NULL);
-    if (payloadsz)
-        *payloadsz = len;
-    if (mech_typep)
-        *mech_typep = mech->name;
-    if (useridp)
-        *useridp = userid;
-    return 0;
+    return b.failed;
+}
+
+int flux_sign_decode_payload (flux_security_t *ctx, const char *input,
+                              void *buf, int bufsz)
+{
+    struct unwrap_input in;
+    int len;
+
+    if (!ctx || !input || bufsz < 0 || (bufsz > 0 && buf == NULL)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return -1;
+    }
+    if (unwrap_tokenize (input, &in) < 0
+        || (len = base64_decoded_len (in.payload, in.payloadsz)) < 0)
+        goto error;
+    if (len > bufsz)
+        return len;
+    if (base64_decode (buf, bufsz, in.payload, in.payloadsz) < 0)
+        goto error;
+    return len;
 error:
-    kv_destroy (header);
+    security_error (ctx, "sign-unwrap: payload decode error: %s",
+                    strerror (errno));
     return -1;
 }
 
@@ -517,6 +1857,420 @@ int flux_sign_unwrap (flux_security_t *ctx, const char *input,
                         NULL, userid, flags, true);
 }
 
+/* Streaming interface.
+ * The signed text HEADER.PAYLOAD is hashed incrementally with SHA256 and
+ * the mechanism signs/verifies the digest, so neither the encoded nor the
+ * decoded payload is ever held in memory in its entirety.
+ */
+
+#define STREAM_CHUNK    3072            // raw bytes per base64 block (x3)
+#define STREAM_SIG_MAX  (64*1024)       // max SIGNATURE length on unwrap
+
+enum {
+    STREAM_HEADER,
+    STREAM_PAYLOAD,
+    STREAM_SIGNATURE,
+    STREAM_DONE,
+};
+
+struct flux_sign_stream {
+    flux_security_t *ctx;
+    struct sign *sign;
+    const struct sign_mech *mech;
+    bool wrap;
+    int flags;
+    int state;
+    flux_sign_write_f write_fn;
+    void *arg;
+    SHA256_CTX shx;
+    char carry[4];          // partial base64 group (raw on wrap, text unwrap)
+    int carrylen;
+    bool padded;            // unwrap: final (padded) group was decoded
+    char *buf;              // unwrap: HEADER, then SIGNATURE text
+    int bufsz;
+    int len;
+    struct kv *header;
+    int64_t userid;
+    char out[STREAM_CHUNK / 3 * 4 + 1];
+};
+
+void flux_sign_stream_destroy (flux_sign_stream_t *ss)
+{
+    if (ss) {
+        int saved_errno = errno;
+        kv_destroy (ss->header);
+        free (ss->buf);
+        free (ss);
+        errno = saved_errno;
+    }
+}
+
+static flux_sign_stream_t *stream_create (flux_security_t *ctx, bool wrap,
+                                          int flags,
+                                          flux_sign_write_f write_fn,
+                                          void *arg)
+{
+    flux_sign_stream_t *ss;
+
+    if (!(ss = calloc (1, sizeof (*ss)))) {
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    ss->ctx = ctx;
+    ss->wrap = wrap;
+    ss->flags = flags;
+    ss->write_fn = write_fn;
+    ss->arg = arg;
+    sha256_init (&ss->shx);
+    if (!(ss->sign = sign_init (ctx))) {
+        flux_sign_stream_destroy (ss);
+        return NULL;
+    }
+    return ss;
+}
+
+/* Emit signed text (HEADER.PAYLOAD) to the write callback and hash it.
+ */
+static int stream_emit (flux_sign_stream_t *ss, const char *buf, size_t len,
+                        bool hash)
+{
+    if (len == 0)
+        return 0;
+    if (hash)
+        sha256_update (&ss->shx, (const BYTE *)buf, len);
+    if (ss->write_fn (buf, len, ss->arg) < 0) {
+        security_error (ss->ctx, "sign-stream: write: %s", strerror (errno));
+        return -1;
+    }
+    return 0;
+}
+
+static bool mech_can_stream (flux_security_t *ctx,
+                             const struct sign_mech *mech)
+{
+    if (!mech->sign_digest || !mech->verify_digest) {
+        errno = EINVAL;
+        security_error (ctx, "sign-stream: mechanism=%s cannot stream",
+                        mech->name);
+        return false;
+    }
+    return true;
+}
+
+flux_sign_stream_t *flux_sign_wrap_stream (flux_security_t *ctx,
+                                           const char *mech_type, int flags,
+                                           flux_sign_write_f write_fn,
+                                           void *arg)
+{
+    flux_sign_stream_t *ss;
+    struct kv *header;
+
+    if (!ctx || flags != 0 || !write_fn) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    if (!(ss = stream_create (ctx, true, flags, write_fn, arg)))
+        return NULL;
+    /* The stream outlives the reused wrap header, so it keeps a copy.
+     */
+    if (!(header = header_create (ctx, ss->sign, getuid (), mech_type,
+                                  flags, &ss->mech)))
+        goto error;
+    if (!(ss->header = kv_copy (header))) {
+        security_error (ctx, NULL);
+        goto error;
+    }
+    if (!mech_can_stream (ctx, ss->mech))
+        goto error;
+    if (header_encode_cpy (ss->header, &ss->sign->wrapbuf,
+                           &ss->sign->wrapbufsz) < 0) {
+        security_error (ctx, NULL);
+        goto error;
+    }
+    if (stream_emit (ss, ss->sign->wrapbuf,
+                     strlen (ss->sign->wrapbuf), true) < 0
+        || stream_emit (ss, ".", 1, true) < 0)
+        goto error;
+    ss->state = STREAM_PAYLOAD;
+    return ss;
+error:
+    flux_sign_stream_destroy (ss);
+    return NULL;
+}
+
+flux_sign_stream_t *flux_sign_unwrap_stream (flux_security_t *ctx, int flags,
+                                             flux_sign_write_f write_fn,
+                                             void *arg)
+{
+    if (!ctx || !(flags == 0 || flags == FLUX_SIGN_NOVERIFY) || !write_fn) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    return stream_create (ctx, false, flags, write_fn, arg);
+}
+
+/* Base64 encode raw payload data, carrying partial groups between calls.
+ */
+static int wrap_update (flux_sign_stream_t *ss, const char *data, size_t len)
+{
+    while (ss->carrylen > 0 && ss->carrylen < 3 && len > 0) {
+        ss->carry[ss->carrylen++] = *data++;
+        len--;
+    }
+    if (ss->carrylen == 3) {
+        base64_encode (ss->out, ss->carry, 3);
+        if (stream_emit (ss, ss->out, 4, true) < 0)
+            return -1;
+        ss->carrylen = 0;
+    }
+    while (len >= 3) {
+        size_t n = len < STREAM_CHUNK ? len / 3 * 3 : STREAM_CHUNK;
+        base64_encode (ss->out, data, n);
+        if (stream_emit (ss, ss->out, n / 3 * 4, true) < 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    memcpy (ss->carry + ss->carrylen, data, len);
+    ss->carrylen += len;
+    return 0;
+}
+
+static int wrap_final (flux_sign_stream_t *ss)
+{
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    char *sig;
+    uint64_t t;
+
+    base64_encode (ss->out, ss->carry, ss->carrylen);
+    if (stream_emit (ss, ss->out, strlen (ss->out), true) < 0)
+        return -1;
+    sha256_final (&ss->shx, digest);
+    t = security_stats_start (ss->ctx);
+    sig = ss->mech->sign_digest (ss->ctx, digest, ss->flags);
+    security_stats_end (ss->ctx, ss->mech->stat_sign, t);
+    if (!sig)
+        return -1;
+    if (stream_emit (ss, ".", 1, false) < 0
+        || stream_emit (ss, sig, strlen (sig), false) < 0) {
+        free (sig);
+        return -1;
+    }
+    free (sig);
+    ss->userid = getuid ();
+    return 0;
+}
+
+/* Append text to ss->buf, up to 'max' bytes.
+ */
+static int stream_buf_append (flux_sign_stream_t *ss, const char *data,
+                              size_t len, int max)
+{
+    if (len >= (size_t)(max - ss->len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (grow_buf ((void **)&ss->buf, &ss->bufsz, ss->len + len + 1) < 0)
+        return -1;
+    memcpy (ss->buf + ss->len, data, len);
+    ss->len += len;
+    ss->buf[ss->len] = '\0';
+    return 0;
+}
+
+/* Decode and emit base64 payload text 'data', carrying partial groups.
+ */
+static int unwrap_payload (flux_sign_stream_t *ss, const char *data,
+                           size_t len)
+{
+    int n;
+
+    if (len > 0 && ss->padded)
+        goto inval;
+    while (ss->carrylen > 0 && ss->carrylen < 4 && len > 0) {
+        ss->carry[ss->carrylen++] = *data++;
+        len--;
+    }
+    if (ss->carrylen == 4) {
+        if ((n = base64_decode (ss->out, sizeof (ss->out), ss->carry, 4)) < 0)
+            goto inval;
+        if (ss->write_fn (ss->out, n, ss->arg) < 0)
+            goto error_write;
+        ss->padded = (n < 3);
+        ss->carrylen = 0;
+    }
+    while (len >= 4) {
+        size_t chunk = STREAM_CHUNK / 3 * 4;
+        if (ss->padded)
+            goto inval;
+        if (chunk > len)
+            chunk = len / 4 * 4;
+        if ((n = base64_decode (ss->out, sizeof (ss->out), data, chunk)) < 0)
+            goto inval;
+        if (ss->write_fn (ss->out, n, ss->arg) < 0)
+            goto error_write;
+        ss->padded = ((size_t)n < chunk / 4 * 3);
+        data += chunk;
+        len -= chunk;
+    }
+    if (len > 0 && ss->padded)
+        goto inval;
+    memcpy (ss->carry + ss->carrylen, data, len);
+    ss->carrylen += len;
+    return 0;
+inval:
+    errno = EINVAL;
+    security_error (ss->ctx, "sign-unwrap: payload decode error: %s",
+                    strerror (errno));
+    return -1;
+error_write:
+    security_error (ss->ctx, "sign-stream: write: %s", strerror (errno));
+    return -1;
+}
+
+/* Parse J text incrementally: accumulate HEADER, decode PAYLOAD on the
+ * fly, then accumulate SIGNATURE.
+ */
+static int unwrap_update (flux_sign_stream_t *ss, const char *data,
+                          size_t len)
+{
+    while (len > 0) {
+        const char *p = memchr (data, '.', len);
+        size_t n = p ? (size_t)(p - data) : len;
+
+        if (memchr (data, '\0', n)) {
+            errno = EINVAL;
+            security_error (ss->ctx, "sign-unwrap: unexpected NUL in input");
+            return -1;
+        }
+        switch (ss->state) {
+            case STREAM_HEADER:
+                if (stream_buf_append (ss, data, n, INT_MAX) < 0) {
+                    security_error (ss->ctx, NULL);
+                    return -1;
+                }
+                if (p) {
+                    struct unwrap_input in = {
+                        .header = ss->buf,
+                        .headersz = ss->len,
+                    };
+                    const struct kv *header;
+                    if (!(header = unwrap_header (ss->ctx, ss->sign, &in, true,
+                                                  &ss->mech, &ss->userid)))
+                        return -1;
+                    if (!mech_can_stream (ss->ctx, ss->mech))
+                        return -1;
+                    if (!(ss->header = kv_copy (header))) {
+                        security_error (ss->ctx, NULL);
+                        return -1;
+                    }
+                    sha256_update (&ss->shx, (const BYTE *)ss->buf, ss->len);
+                    sha256_update (&ss->shx, (const BYTE *)".", 1);
+                    /* Clear HEADER, so an empty SIGNATURE reads as "".
+                     */
+                    ss->len = 0;
+                    ss->buf[0] = '\0';
+                    ss->state = STREAM_PAYLOAD;
+                }
+                break;
+            case STREAM_PAYLOAD:
+                sha256_update (&ss->shx, (const BYTE *)data, n);
+                if (unwrap_payload (ss, data, n) < 0)
+                    return -1;
+                if (p) {
+                    if (ss->carrylen != 0) {
+                        errno = EINVAL;
+                        security_error (ss->ctx,
+                                        "sign-unwrap: payload decode error: %s",
+                                        strerror (errno));
+                        return -1;
+                    }
+                    ss->state = STREAM_SIGNATURE;
+                }
+                break;
+            case STREAM_SIGNATURE:
+                if (p || stream_buf_append (ss, data, n, STREAM_SIG_MAX) < 0) {
+                    errno = EINVAL;
+                    security_error (ss->ctx, "sign-unwrap: invalid signature");
+                    return -1;
+                }
+                break;
+        }
+        if (p)
+            n++;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int unwrap_final (flux_sign_stream_t *ss)
+{
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    time_t now;
+
+    if (ss->state != STREAM_SIGNATURE) {
+        errno = EINVAL;
+        security_error (ss->ctx, "sign-unwrap: truncated input");
+        return -1;
+    }
+    if (!(ss->flags & FLUX_SIGN_NOVERIFY)) {
+        uint64_t t;
+        int rc;
+
+        sha256_final (&ss->shx, digest);
+        if (mech_init (ss->ctx, ss->sign, ss->mech) < 0
+            || sign_now (ss->ctx, &now) < 0)
+            return -1;
+        t = security_stats_start (ss->ctx);
+        rc = ss->mech->verify_digest (ss->ctx, ss->header, digest,
+                                      ss->buf ? ss->buf : "", now,
+                                      ss->flags);
+        security_stats_end (ss->ctx, ss->mech->stat_verify, t);
+        if (rc < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int flux_sign_stream_update (flux_sign_stream_t *ss,
+                             const void *data, size_t len)
+{
+    if (!ss || (len > 0 && !data) || ss->state == STREAM_DONE) {
+        errno = EINVAL;
+        if (ss)
+            security_error (ss->ctx, NULL);
+        return -1;
+    }
+    if (ss->wrap ? wrap_update (ss, data, len) < 0
+                 : unwrap_update (ss, data, len) < 0) {
+        ss->state = STREAM_DONE;
+        return -1;
+    }
+    return 0;
+}
+
+int flux_sign_stream_final (flux_sign_stream_t *ss, int64_t *userid)
+{
+    int rc;
+
+    if (!ss || ss->state == STREAM_DONE) {
+        errno = EINVAL;
+        if (ss)
+            security_error (ss->ctx, NULL);
+        return -1;
+    }
+    rc = ss->wrap ? wrap_final (ss) : unwrap_final (ss);
+    ss->state = STREAM_DONE;
+    if (rc < 0)
+        return -1;
+    if (userid)
+        *userid = ss->userid;
+    return 0;
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
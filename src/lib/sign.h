@@ -15,6 +15,9 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "context.h"
 
 /* Overview:
@@ -47,6 +50,26 @@ extern "C" {
  * default-type = "none"            # mechanism name for wrap
  * allowed-types = [ "none" ]       # array of mechanism names for unwrap
  * max-ttl = 259200                 # signature maximum TTL in seconds
+ *
+ * Optional configuration:
+ *
+ * [sign]
+ * verify-cache-size = 0            # verified signatures to remember
+ * header-version = 1               # wrap header version (1 or 2)
+ *
+ * If verify-cache-size is nonzero, unwrap remembers that many recently
+ * verified inputs, so that unwrapping the exact same input again skips
+ * the mechanism's verification until the signature would expire.
+ * N.B. changes that are not time based, such as certificate revocation,
+ * are not noticed for cached signatures until they expire.
+ * In FLUX_SECURITY_THREADSAFE mode the cache is shared by all threads,
+ * and lookups in it take no locks.
+ *
+ * If header-version is 2, mechanisms may leave out of HEADER data that the
+ * verifier can obtain by other means, making the result smaller.  Currently
+ * only "curve" does this, replacing the signer's cert with its fingerprint.
+ * Version 2 output cannot be unwrapped by releases that only understand
+ * version 1, while unwrap accepts both versions.
  */
 
 enum {
@@ -75,6 +98,62 @@ const char *flux_sign_wrap_as (flux_security_t *ctx,
                                const char *mech_type,
                                int flags);
 
+/* Same as flux_sign_wrap_as(), but write the NULL terminated result to
+ * caller-supplied 'buf' of size 'bufsz' rather than an internal buffer.
+ * Like snprintf(3), the length of the result (excluding the terminating
+ * NUL) is returned, and if that is greater than or equal to 'bufsz', the
+ * contents of 'buf' are undefined and the caller should retry with a larger
+ * buffer.  Nothing is signed in that case, so the length is computed from
+ * an upper bound on the mechanism's signature and may exceed the length
+ * of the final result.  A size query may be made with buf=NULL, bufsz=0.
+ * On error, -1 is returned and context error state is updated.
+ */
+int flux_sign_wrap_as_into (flux_security_t *ctx,
+                            int64_t userid,
+                            const void *payload, int payloadsz,
+                            const char *mech_type,
+                            int flags,
+                            char *buf, int bufsz);
+
+/* Same as flux_sign_wrap_as_into() with userid set to the current user.
+ */
+int flux_sign_wrap_into (flux_security_t *ctx,
+                         const void *payload, int payloadsz,
+                         const char *mech_type,
+                         int flags,
+                         char *buf, int bufsz);
+
+/* Sign 'count' payloads pays[i]/payszs[i] as the same user with the same
+ * mechanism, storing the resulting NULL terminated strings in outputs[i].
+ * The security header is built, prepared by the mechanism, and encoded
+ * only once for the whole batch.  If 'ctx' was created with
+ * FLUX_SECURITY_THREADSAFE and the mechanism signs by calling out to a
+ * service, e.g. "munge", large batches are signed by short-lived worker
+ * threads so that several requests are in flight at once.  Mechanisms
+ * that sign many payloads at once, e.g. on a hardware device, are given
+ * the whole batch.
+ * Each outputs[i] must be freed by the caller with free(3).
+ * 'flags' currently must be set to 0.
+ * If 'mech_type' is NULL, use the configured 'default-type'.
+ * On success, 0 is returned.  On error, -1 is returned, all outputs[]
+ * are set to NULL, and context error state is updated.
+ */
+int flux_sign_wrap_batch (flux_security_t *ctx,
+                          const void **payloads, const int *payloadszs,
+                          int count,
+                          char **outputs,
+                          const char *mech_type,
+                          int flags);
+
+/* Same as flux_sign_wrap_batch(), but allow userid to be explicitly set.
+ */
+int flux_sign_wrap_batch_as (flux_security_t *ctx,
+                             int64_t userid,
+                             const void **payloads, const int *payloadszs,
+                             int count,
+                             char **outputs,
+                             const char *mech_type,
+                             int flags);
 
 /* Given a NULL-terminated 'input' string generated by flux_sign_wrap(),
  * decode its contents and verify the signature.  If payload/payloadsz are
@@ -99,6 +178,167 @@ int flux_sign_unwrap_anymech (flux_security_t *ctx, const char *input,
                               const char **mech_type,
                               int64_t *userid, int flags);
 
+/* Same as flux_sign_unwrap(), but decode the payload directly into
+ * caller-supplied 'buf' of size 'bufsz'.  The exact payload size is
+ * returned.  If it is greater than 'bufsz', nothing is decoded or verified,
+ * and the caller should retry with a buffer of at least the returned size.
+ * A size query may be made with buf=NULL, bufsz=0.
+ * On error, -1 is returned and context error state is updated.
+ */
+int flux_sign_unwrap_into (flux_security_t *ctx, const char *input,
+                           void *buf, int bufsz,
+                           int64_t *userid, int flags);
+
+/* Same as flux_sign_unwrap(), but only parse the header and verify the
+ * signature, without decoding the payload, which is only checked to be
+ * valid base64.  If 'payloadsz' is non-NULL, it is set to the exact decoded
+ * payload size.  The payload may be decoded later on demand with
+ * flux_sign_decode_payload(), using 'input' as the handle, which then
+ * cannot fail.  If 'mech_type' is non-NULL, it is set to the mechanism used.
+ * On success, 0 is returned; on error, -1 is returned and context error
+ * state is updated.
+ */
+int flux_sign_unwrap_header (flux_security_t *ctx, const char *input,
+                             const char **mech_type, int64_t *userid,
+                             int *payloadsz, int flags);
+
+/* Verify 'count' inputs[i] as flux_sign_unwrap_header() does, setting
+ * errnums[i] to 0 on success, or to an errno value on failure.  If non-NULL,
+ * userids[i] and payloadszs[i] are set as well.  Payloads may be decoded
+ * afterwards with flux_sign_decode_payload().  If 'ctx' was created with
+ * FLUX_SECURITY_THREADSAFE, large batches are verified in parallel by
+ * short-lived worker threads, otherwise the batch is verified serially.
+ * Inputs signed with a mechanism that verifies many signatures at once
+ * are parsed as above, then handed to the mechanism together.
+ * Per-input error messages are not retained.
+ * Returns the number of inputs that failed verification, or -1 on error
+ * (e.g. invalid arguments or configuration) with context error state updated.
+ */
+int flux_sign_unwrap_batch (flux_security_t *ctx,
+                            const char **inputs, int count,
+                            int64_t *userids, int *payloadszs, int *errnums,
+                            int flags);
+
+/* Decode the payload of 'input' into caller-supplied 'buf' of size 'bufsz',
+ * without parsing the header or verifying the signature, e.g. after a
+ * successful flux_sign_unwrap_header().  Returns the exact payload size.
+ * If it is greater than 'bufsz', nothing is decoded.
+ * On error, -1 is returned and context error state is updated.
+ */
+int flux_sign_decode_payload (flux_security_t *ctx, const char *input,
+                              void *buf, int bufsz);
+
+/* Streaming interface, for payloads too large to hold in memory.
+ *
+ * flux_sign_wrap_stream() creates a stream that signs data passed to
+ * flux_sign_stream_update() as the current user, emitting the J output
+ * HEADER.PAYLOAD.SIGNATURE (without a terminating NUL) incrementally to
+ * 'write_fn'.  The SIGNATURE is emitted by flux_sign_stream_final().
+ *
+ * flux_sign_unwrap_stream() creates a stream that parses J text passed
+ * to flux_sign_stream_update(), emitting the decoded payload incrementally
+ * to 'write_fn'.  The signature is verified by flux_sign_stream_final(),
+ * which also returns the userid.  N.B. payload data is emitted before it
+ * is verified, so it must be discarded if flux_sign_stream_final() fails.
+ *
+ * Only mechanisms that sign a digest of HEADER.PAYLOAD, e.g. "none" and
+ * "munge", support streaming.  The result is identical to, and
+ * interoperable with, flux_sign_wrap() and flux_sign_unwrap().
+ * 'write_fn' should return 0 on success, or -1 on error with errno set.
+ * Lengths are size_t, and a stream keeps no running payload size, so unlike
+ * the int sizes of the one-shot interface, the payload size is not limited.
+ * Functions return 0 (or stream) on success, or -1 (or NULL) on error with
+ * context error state updated.  A stream may not be updated after an error.
+ */
+typedef struct flux_sign_stream flux_sign_stream_t;
+typedef int (*flux_sign_write_f)(const void *buf, size_t len, void *arg);
+
+flux_sign_stream_t *flux_sign_wrap_stream (flux_security_t *ctx,
+                                           const char *mech_type,
+                                           int flags,
+                                           flux_sign_write_f write_fn,
+                                           void *arg);
+
+flux_sign_stream_t *flux_sign_unwrap_stream (flux_security_t *ctx,
+                                             int flags,
+                                             flux_sign_write_f write_fn,
+                                             void *arg);
+
+int flux_sign_stream_update (flux_sign_stream_t *ss,
+                             const void *buf, size_t len);
+
+int flux_sign_stream_final (flux_sign_stream_t *ss, int64_t *userid);
+
+void flux_sign_stream_destroy (flux_sign_stream_t *ss);
+
+/* Asynchronous interface, for event loops that must not block on a
+ * mechanism, e.g. for the munged round trip of "munge".
+ *
+ * flux_sign_async_create() starts 'nthreads' (1-32) worker threads, which
+ * perform the operations submitted with flux_sign_wrap_async() and
+ * flux_sign_unwrap_async() like flux_sign_wrap() and flux_sign_unwrap().
+ * 'ctx' must have been created with FLUX_SECURITY_THREADSAFE.  At most
+ * 'nthreads' operations are in progress at once; the rest wait in order.
+ * 'flags' currently must be set to 0.
+ *
+ * flux_sign_async_fd() returns a non-blocking file descriptor that is
+ * readable when operations have completed, for use with poll(2) or an
+ * event loop.  flux_sign_async_dispatch() then calls the callbacks of all
+ * completed operations in the calling thread, and returns the number
+ * called.  Callbacks may submit new operations, but must not destroy 'as'.
+ *
+ * A wrap callback is passed the NULL terminated J 'output'.  An unwrap
+ * callback is passed the payload and signing userid.  These are only valid
+ * during the callback.  On failure, 'errnum' is nonzero, 'errstr' describes
+ * the error, and 'output' or 'payload' is NULL.
+ *
+ * flux_sign_async_destroy() waits for operations in progress to finish,
+ * then discards any that have not been dispatched without calling their
+ * callbacks.
+ * Functions return 0 (or handle) on success, or -1 (or NULL) on error with
+ * context error state updated.
+ */
+typedef struct flux_sign_async flux_sign_async_t;
+
+typedef void (*flux_sign_wrap_f)(const char *output,
+                                 int errnum, const char *errstr, void *arg);
+typedef void (*flux_sign_unwrap_f)(const void *payload, int payloadsz,
+                                   int64_t userid,
+                                   int errnum, const char *errstr, void *arg);
+
+flux_sign_async_t *flux_sign_async_create (flux_security_t *ctx,
+                                           int nthreads,
+                                           int flags);
+
+void flux_sign_async_destroy (flux_sign_async_t *as);
+
+int flux_sign_async_fd (flux_sign_async_t *as);
+
+int flux_sign_async_dispatch (flux_sign_async_t *as);
+
+int flux_sign_wrap_async (flux_sign_async_t *as,
+                          const void *payload, int payloadsz,
+                          const char *mech_type,
+                          int flags,
+                          flux_sign_wrap_f cb,
+                          void *arg);
+
+/* Same as flux_sign_wrap_async(), but allow userid to be explicitly set.
+ */
+int flux_sign_wrap_as_async (flux_sign_async_t *as,
+                             int64_t userid,
+                             const void *payload, int payloadsz,
+                             const char *mech_type,
+                             int flags,
+                             flux_sign_wrap_f cb,
+                             void *arg);
+
+int flux_sign_unwrap_async (flux_sign_async_t *as,
+                            const char *input,
+                            int flags,
+                            flux_sign_unwrap_f cb,
+                            void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,389 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* sign_async.c - asynchronous wrap/unwrap
+ *
+ * Operations are queued for a fixed set of worker threads, which call
+ * flux_sign_wrap_as() or flux_sign_unwrap() with their own thread state
+ * in the (THREADSAFE) context.  Completed operations are moved to a done
+ * list, and a byte is written to a pipe when the list becomes non-empty,
+ * so the pipe is readable exactly when there are callbacks to dispatch.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "context.h"
+#include "context_private.h"
+#include "sign.h"
+
+static const int async_max_threads = 32;
+
+struct async_op {
+    struct async_op *next;
+    int64_t userid;         // userid to sign as (wrap), or signer (unwrap)
+    char *mech_type;
+    int flags;
+    void *buf;              // payload (wrap) or NULL terminated input (unwrap)
+    int bufsz;
+    flux_sign_wrap_f wrap_cb;
+    flux_sign_unwrap_f unwrap_cb;
+    void *arg;
+
+    /* result */
+    char *output;
+    void *payload;
+    int payloadsz;
+    int errnum;
+    char *errstr;
+};
+
+struct async_list {
+    struct async_op *head;
+    struct async_op *tail;
+};
+
+struct flux_sign_async {
+    flux_security_t *ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct async_list queue;    // protected by lock
+    struct async_list done;     // protected by lock
+    bool shutdown;              // protected by lock
+    int fds[2];
+    int nthreads;
+    pthread_t t[];
+};
+
+static void op_destroy (struct async_op *op)
+{
+    if (op) {
+        int saved_errno = errno;
+        free (op->mech_type);
+        free (op->buf);
+        free (op->output);
+        free (op->payload);
+        free (op->errstr);
+        free (op);
+        errno = saved_errno;
+    }
+}
+
+static void list_append (struct async_list *l, struct async_op *op)
+{
+    op->next = NULL;
+    if (l->tail)
+        l->tail->next = op;
+    else
+        l->head = op;
+    l->tail = op;
+}
+
+static struct async_op *list_pop (struct async_list *l)
+{
+    struct async_op *op = l->head;
+
+    if (op) {
+        if (!(l->head = op->next))
+            l->tail = NULL;
+    }
+    return op;
+}
+
+static void list_clear (struct async_list *l)
+{
+    struct async_op *op;
+
+    while ((op = list_pop (l)))
+        op_destroy (op);
+}
+
+/* Capture this thread's error state in 'op'.
+ */
+static void op_fail (flux_security_t *ctx, struct async_op *op)
+{
+    if ((op->errnum = flux_security_last_errnum (ctx)) == 0)
+        op->errnum = EINVAL;
+    op->errstr = strdup (flux_security_last_error (ctx));
+}
+
+static void op_run (flux_security_t *ctx, struct async_op *op)
+{
+    if (op->wrap_cb) {
+        const char *s;
+
+        if (!(s = flux_sign_wrap_as (ctx, op->userid, op->buf, op->bufsz,
+                                     op->mech_type, op->flags)))
+            op_fail (ctx, op);
+        else if (!(op->output = strdup (s)))
+            op->errnum = ENOMEM;
+    }
+    else {
+        const void *payload;
+
+        if (flux_sign_unwrap (ctx, op->buf, &payload, &op->payloadsz,
+                              &op->userid, op->flags) < 0)
+            op_fail (ctx, op);
+        else if (op->payloadsz > 0) {
+            if (!(op->payload = malloc (op->payloadsz)))
+                op->errnum = ENOMEM;
+            else
+                memcpy (op->payload, payload, op->payloadsz);
+        }
+    }
+}
+
+static void *worker (void *arg)
+{
+    flux_sign_async_t *as = arg;
+    struct async_op *op;
+
+    pthread_mutex_lock (&as->lock);
+    for (;;) {
+        while (!as->queue.head && !as->shutdown)
+            pthread_cond_wait (&as->cond, &as->lock);
+        if (as->shutdown)
+            break;
+        op = list_pop (&as->queue);
+        pthread_mutex_unlock (&as->lock);
+
+        op_run (as->ctx, op);
+
+        pthread_mutex_lock (&as->lock);
+        if (!as->done.head) {
+            char c = 0;
+            ssize_t n = write (as->fds[1], &c, 1);
+            (void)n; // pipe is nonblocking and holds a byte at most
+        }
+        list_append (&as->done, op);
+    }
+    pthread_mutex_unlock (&as->lock);
+    security_thread_exit (as->ctx);
+    return NULL;
+}
+
+static int set_fd_flags (int fd)
+{
+    int flags;
+
+    if ((flags = fcntl (fd, F_GETFL)) < 0
+        || fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0
+        || fcntl (fd, F_SETFD, FD_CLOEXEC) < 0)
+        return -1;
+    return 0;
+}
+
+flux_sign_async_t *flux_sign_async_create (flux_security_t *ctx,
+                                           int nthreads,
+                                           int flags)
+{
+    flux_sign_async_t *as;
+    int e;
+    int i;
+
+    if (!ctx || nthreads < 1 || nthreads > async_max_threads || flags != 0) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    if (!security_is_threadsafe (ctx)) {
+        errno = EINVAL;
+        security_error (ctx, "sign-async: context is not THREADSAFE");
+        return NULL;
+    }
+    if (!(as = calloc (1, sizeof (*as) + nthreads * sizeof (as->t[0])))) {
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    as->ctx = ctx;
+    as->fds[0] = as->fds[1] = -1;
+    pthread_mutex_init (&as->lock, NULL);
+    pthread_cond_init (&as->cond, NULL);
+    if (pipe (as->fds) < 0
+        || set_fd_flags (as->fds[0]) < 0
+        || set_fd_flags (as->fds[1]) < 0) {
+        security_error (ctx, "sign-async: pipe: %s", strerror (errno));
+        goto error;
+    }
+    for (i = 0; i < nthreads; i++) {
+        if ((e = pthread_create (&as->t[i], NULL, worker, as)) != 0) {
+            errno = e;
+            security_error (ctx, "sign-async: pthread_create: %s",
+                            strerror (errno));
+            goto error;
+        }
+        as->nthreads++;
+    }
+    return as;
+error:
+    flux_sign_async_destroy (as);
+    return NULL;
+}
+
+void flux_sign_async_destroy (flux_sign_async_t *as)
+{
+    if (as) {
+        int saved_errno = errno;
+        int i;
+
+        pthread_mutex_lock (&as->lock);
+        as->shutdown = true;
+        pthread_cond_broadcast (&as->cond);
+        pthread_mutex_unlock (&as->lock);
+        for (i = 0; i < as->nthreads; i++)
+            (void)pthread_join (as->t[i], NULL);
+        list_clear (&as->queue);
+        list_clear (&as->done);
+        if (as->fds[0] >= 0)
+            (void)close (as->fds[0]);
+        if (as->fds[1] >= 0)
+            (void)close (as->fds[1]);
+        pthread_cond_destroy (&as->cond);
+        pthread_mutex_destroy (&as->lock);
+        free (as);
+        errno = saved_errno;
+    }
+}
+
+int flux_sign_async_fd (flux_sign_async_t *as)
+{
+    if (!as) {
+        errno = EINVAL;
+        return -1;
+    }
+    return as->fds[0];
+}
+
+static int submit (flux_sign_async_t *as, struct async_op *op)
+{
+    pthread_mutex_lock (&as->lock);
+    list_append (&as->queue, op);
+    pthread_cond_signal (&as->cond);
+    pthread_mutex_unlock (&as->lock);
+    return 0;
+}
+
+int flux_sign_wrap_as_async (flux_sign_async_t *as,
+                             int64_t userid,
+                             const void *payload, int payloadsz,
+                             const char *mech_type,
+                             int flags,
+                             flux_sign_wrap_f cb,
+                             void *arg)
+{
+    struct async_op *op;
+
+    if (!as || userid < 0 || payloadsz < 0 || (payloadsz > 0 && !payload)
+        || !cb) {
+        errno = EINVAL;
+        security_error (as ? as->ctx : NULL, NULL);
+        return -1;
+    }
+    if (!(op = calloc (1, sizeof (*op)))
+        || (mech_type && !(op->mech_type = strdup (mech_type)))
+        || (payloadsz > 0 && !(op->buf = malloc (payloadsz))))
+        goto error;
+    if (payloadsz > 0)
+        memcpy (op->buf, payload, payloadsz);
+    op->bufsz = payloadsz;
+    op->userid = userid;
+    op->flags = flags;
+    op->wrap_cb = cb;
+    op->arg = arg;
+    return submit (as, op);
+error:
+    security_error (as->ctx, NULL);
+    op_destroy (op);
+    return -1;
+}
+
+int flux_sign_wrap_async (flux_sign_async_t *as,
+                          const void *payload, int payloadsz,
+                          const char *mech_type,
+                          int flags,
+                          flux_sign_wrap_f cb,
+                          void *arg)
+{
+    return flux_sign_wrap_as_async (as, getuid (), payload, payloadsz,
+                                    mech_type, flags, cb, arg);
+}
+
+int flux_sign_unwrap_async (flux_sign_async_t *as,
+                            const char *input,
+                            int flags,
+                            flux_sign_unwrap_f cb,
+                            void *arg)
+{
+    struct async_op *op;
+
+    if (!as || !input || !cb) {
+        errno = EINVAL;
+        security_error (as ? as->ctx : NULL, NULL);
+        return -1;
+    }
+    if (!(op = calloc (1, sizeof (*op)))
+        || !(op->buf = strdup (input)))
+        goto error;
+    op->flags = flags;
+    op->unwrap_cb = cb;
+    op->arg = arg;
+    return submit (as, op);
+error:
+    security_error (as->ctx, NULL);
+    op_destroy (op);
+    return -1;
+}
+
+int flux_sign_async_dispatch (flux_sign_async_t *as)
+{
+    struct async_list done;
+    struct async_op *op;
+    char buf[64];
+    int count = 0;
+
+    if (!as) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&as->lock);
+    done = as->done;
+    as->done.head = as->done.tail = NULL;
+    while (read (as->fds[0], buf, sizeof (buf)) > 0)
+        ;
+    pthread_mutex_unlock (&as->lock);
+
+    while ((op = list_pop (&done))) {
+        const char *errstr = NULL;
+
+        if (op->errnum)
+            errstr = op->errstr ? op->errstr : strerror (op->errnum);
+        if (op->wrap_cb)
+            op->wrap_cb (op->output, op->errnum, errstr, op->arg);
+        else
+            op->unwrap_cb (op->payload, op->payloadsz,
+                           op->errnum ? -1 : op->userid,
+                           op->errnum, errstr, op->arg);
+        op_destroy (op);
+        count++;
+    }
+    return count;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
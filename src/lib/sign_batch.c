@@ -0,0 +1,183 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* sign_batch.c - items handed to a mechanism's sign_many or verify_many
+ *
+ * Completions may arrive from any thread, so item results and the count
+ * of pending items are protected by a mutex, and the core waits for the
+ * count to reach zero on a condition variable.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "sign_batch.h"
+
+struct sign_batch_item {
+    const char *input;
+    int inputsz;
+    const struct kv *header;
+    const char *signature;
+
+    /* result */
+    bool done;
+    int errnum;
+    char *result;
+};
+
+struct sign_batch {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+    int pending;        // protected by lock
+    char *error;        // protected by lock
+    struct sign_batch_item items[];
+};
+
+struct sign_batch *sign_batch_create (int count)
+{
+    struct sign_batch *batch;
+
+    if (count < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(batch = calloc (1, sizeof (*batch)
+                             + count * sizeof (batch->items[0]))))
+        return NULL;
+    pthread_mutex_init (&batch->lock, NULL);
+    pthread_cond_init (&batch->cond, NULL);
+    batch->count = batch->pending = count;
+    return batch;
+}
+
+void sign_batch_destroy (struct sign_batch *batch)
+{
+    if (batch) {
+        int saved_errno = errno;
+        int i;
+        for (i = 0; i < batch->count; i++)
+            free (batch->items[i].result);
+        free (batch->error);
+        pthread_mutex_destroy (&batch->lock);
+        pthread_cond_destroy (&batch->cond);
+        free (batch);
+        errno = saved_errno;
+    }
+}
+
+void sign_batch_set (struct sign_batch *batch, int i,
+                     const char *input, int inputsz,
+                     const struct kv *header, const char *signature)
+{
+    batch->items[i].input = input;
+    batch->items[i].inputsz = inputsz;
+    batch->items[i].header = header;
+    batch->items[i].signature = signature;
+}
+
+int sign_batch_count (const struct sign_batch *batch)
+{
+    return batch->count;
+}
+
+const char *sign_batch_input (const struct sign_batch *batch, int i,
+                              int *inputsz)
+{
+    *inputsz = batch->items[i].inputsz;
+    return batch->items[i].input;
+}
+
+const struct kv *sign_batch_header (const struct sign_batch *batch, int i)
+{
+    return batch->items[i].header;
+}
+
+const char *sign_batch_signature (const struct sign_batch *batch, int i)
+{
+    return batch->items[i].signature;
+}
+
+/* Complete item 'i' with lock held.  A second completion is ignored.
+ */
+static void complete_locked (struct sign_batch *batch, int i,
+                             char *signature, int errnum, const char *error)
+{
+    struct sign_batch_item *item = &batch->items[i];
+
+    if (item->done) {
+        free (signature);
+        return;
+    }
+    item->done = true;
+    if (errnum != 0) {
+        item->errnum = errnum;
+        if (!batch->error && error)
+            batch->error = strdup (error);
+        free (signature);
+    }
+    else
+        item->result = signature;
+    if (--batch->pending == 0)
+        pthread_cond_broadcast (&batch->cond);
+}
+
+void sign_batch_complete (struct sign_batch *batch, int i,
+                          char *signature, int errnum, const char *error)
+{
+    pthread_mutex_lock (&batch->lock);
+    complete_locked (batch, i, signature, errnum, error);
+    pthread_mutex_unlock (&batch->lock);
+}
+
+void sign_batch_fail_pending (struct sign_batch *batch,
+                              int errnum, const char *error)
+{
+    int i;
+
+    pthread_mutex_lock (&batch->lock);
+    for (i = 0; i < batch->count; i++)
+        complete_locked (batch, i, NULL, errnum, error);
+    pthread_mutex_unlock (&batch->lock);
+}
+
+void sign_batch_wait (struct sign_batch *batch)
+{
+    pthread_mutex_lock (&batch->lock);
+    while (batch->pending > 0)
+        pthread_cond_wait (&batch->cond, &batch->lock);
+    pthread_mutex_unlock (&batch->lock);
+}
+
+int sign_batch_result (struct sign_batch *batch, int i, char **signature)
+{
+    struct sign_batch_item *item = &batch->items[i];
+
+    if (item->errnum == 0 && signature) {
+        *signature = item->result;
+        item->result = NULL;
+    }
+    return item->errnum;
+}
+
+const char *sign_batch_error (const struct sign_batch *batch)
+{
+    return batch->error;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,100 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _FLUX_SECURITY_SIGN_BATCH_H
+#define _FLUX_SECURITY_SIGN_BATCH_H
+
+#include "src/libutil/kv.h"
+
+/* A batch of items to be signed or verified by a mechanism's sign_many
+ * or verify_many callback (see sign_mech.h).  Each item is HEADER.PAYLOAD
+ * input, plus the parsed HEADER and SIGNATURE when verifying.
+ *
+ * The mechanism reports the result of each item exactly once with
+ * sign_batch_complete(), in any order, from any thread, before or after
+ * the callback returns, e.g. from the completion handler of a device
+ * that services requests asynchronously.  The batch and its items remain
+ * valid until every item is complete.
+ *
+ * Unlike the rest of the mechanism interface, sign_batch_complete() is
+ * safe to call from threads that do not otherwise use the security
+ * context, so errors are passed to it rather than set in the context.
+ */
+
+struct sign_batch;
+
+/* Functions for mechanisms.
+ */
+
+/* Return the number of items in the batch.
+ */
+int sign_batch_count (const struct sign_batch *batch);
+
+/* Return HEADER.PAYLOAD input of item 'i', which is not NULL terminated,
+ * and set 'inputsz' to its length.
+ */
+const char *sign_batch_input (const struct sign_batch *batch, int i,
+                              int *inputsz);
+
+/* Return the parsed HEADER of item 'i', or NULL if signing.
+ */
+const struct kv *sign_batch_header (const struct sign_batch *batch, int i);
+
+/* Return the NULL terminated SIGNATURE of item 'i', or NULL if signing.
+ */
+const char *sign_batch_signature (const struct sign_batch *batch, int i);
+
+/* Report the result of item 'i'.  On success, 'errnum' is 0, and when
+ * signing, 'signature' is a NULL terminated signature string which the
+ * batch takes ownership of.  On failure, 'errnum' is an errno value and
+ * 'error' is an optional message.
+ */
+void sign_batch_complete (struct sign_batch *batch, int i,
+                          char *signature, int errnum, const char *error);
+
+/* Functions for the core.
+ */
+
+struct sign_batch *sign_batch_create (int count);
+void sign_batch_destroy (struct sign_batch *batch);
+
+/* Set input of item 'i', and for verification, its parsed 'header' and
+ * 'signature'.  These are not copied, and must remain valid until the
+ * batch is destroyed.
+ */
+void sign_batch_set (struct sign_batch *batch, int i,
+                     const char *input, int inputsz,
+                     const struct kv *header, const char *signature);
+
+/* Complete all items that are not yet complete with 'errnum' and 'error',
+ * e.g. after the mechanism's callback failed.
+ */
+void sign_batch_fail_pending (struct sign_batch *batch,
+                              int errnum, const char *error);
+
+/* Wait until every item is complete.
+ */
+void sign_batch_wait (struct sign_batch *batch);
+
+/* After sign_batch_wait(), return the errnum of item 'i', and if it is 0,
+ * and 'signature' is non-NULL, take ownership of its signature.
+ */
+int sign_batch_result (struct sign_batch *batch, int i, char **signature);
+
+/* After sign_batch_wait(), return the first error message reported with
+ * a failed item, or NULL if there was none.
+ */
+const char *sign_batch_error (const struct sign_batch *batch);
+
+#endif /* !_FLUX_SECURITY_SIGN_BATCH_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,289 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sign_cache.h"
+
+/* Entries are kept in an array and linked by index, both into hash
+ * chains and into a doubly-linked LRU list (head = most recent).
+ * Unused entries are kept on a free list threaded through 'next'.
+ * Since many caches stay nearly empty, e.g. in one of many contexts, the
+ * buckets are allocated on first insert and the array grows as needed,
+ * up to 'size' entries.
+ */
+struct cache_entry {
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    time_t expires;
+    int64_t userid;
+    int mech;
+    void *data;
+    int next;           // hash chain, or free list
+    int prev_lru;
+    int next_lru;
+};
+
+static const int min_alloc = 8;
+
+struct sign_cache {
+    struct cache_entry *entries;
+    int size;
+    int alloc;          // number of entries allocated
+    int count;
+    int *buckets;       // NULL until first insert
+    unsigned int mask;  // number of buckets - 1
+    int lru_head;
+    int lru_tail;
+    int free;
+    sign_cache_free_f free_fn;
+};
+
+/* The key is a cryptographic digest, so any 4 bytes of it are already
+ * uniformly distributed.
+ */
+static unsigned int bucket_of (const struct sign_cache *cache,
+                               const uint8_t *digest)
+{
+    unsigned int h;
+
+    memcpy (&h, digest, sizeof (h));
+    return h & cache->mask;
+}
+
+struct sign_cache *sign_cache_create (int size, sign_cache_free_f free_fn)
+{
+    struct sign_cache *cache;
+    unsigned int nbuckets = 1;
+
+    if (size <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    while (nbuckets < (unsigned int)size * 2)
+        nbuckets <<= 1;
+    if (!(cache = calloc (1, sizeof (*cache))))
+        return NULL;
+    cache->size = size;
+    cache->free_fn = free_fn;
+    cache->mask = nbuckets - 1;
+    cache->lru_head = cache->lru_tail = -1;
+    cache->free = -1;
+    return cache;
+}
+
+void sign_cache_destroy (struct sign_cache *cache)
+{
+    if (cache) {
+        int saved_errno = errno;
+        if (cache->free_fn) {
+            int i;
+            for (i = cache->lru_head; i >= 0; i = cache->entries[i].next_lru)
+                cache->free_fn (cache->entries[i].data);
+        }
+        free (cache->entries);
+        free (cache->buckets);
+        free (cache);
+        errno = saved_errno;
+    }
+}
+
+int sign_cache_count (struct sign_cache *cache)
+{
+    return cache ? cache->count : 0;
+}
+
+static void lru_unlink (struct sign_cache *cache, int i)
+{
+    struct cache_entry *e = &cache->entries[i];
+
+    if (e->prev_lru >= 0)
+        cache->entries[e->prev_lru].next_lru = e->next_lru;
+    else
+        cache->lru_head = e->next_lru;
+    if (e->next_lru >= 0)
+        cache->entries[e->next_lru].prev_lru = e->prev_lru;
+    else
+        cache->lru_tail = e->prev_lru;
+}
+
+static void lru_push (struct sign_cache *cache, int i)
+{
+    struct cache_entry *e = &cache->entries[i];
+
+    e->prev_lru = -1;
+    e->next_lru = cache->lru_head;
+    if (cache->lru_head >= 0)
+        cache->entries[cache->lru_head].prev_lru = i;
+    cache->lru_head = i;
+    if (cache->lru_tail < 0)
+        cache->lru_tail = i;
+}
+
+/* Allocate the buckets.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int alloc_buckets (struct sign_cache *cache)
+{
+    unsigned int i;
+
+    if (!(cache->buckets = malloc ((cache->mask + 1)
+                                   * sizeof (cache->buckets[0]))))
+        return -1;
+    for (i = 0; i <= cache->mask; i++)
+        cache->buckets[i] = -1;
+    return 0;
+}
+
+/* Grow the entries array, doubling it up to 'size', and put the new
+ * entries on the free list, which is empty.
+ * Return 0 on success, -1 if the cache is full or on allocation failure.
+ */
+static int grow (struct sign_cache *cache)
+{
+    struct cache_entry *entries;
+    int n;
+    int i;
+
+    if (cache->alloc == cache->size)
+        return -1;
+    n = cache->alloc > 0 ? cache->alloc * 2 : min_alloc;
+    if (n > cache->size)
+        n = cache->size;
+    if (!(entries = realloc (cache->entries, n * sizeof (entries[0]))))
+        return -1;
+    for (i = cache->alloc; i < n; i++)
+        entries[i].next = i + 1 < n ? i + 1 : -1;
+    cache->free = cache->alloc;
+    cache->entries = entries;
+    cache->alloc = n;
+    return 0;
+}
+
+/* Find entry for 'digest', setting 'linkp' to the chain link that
+ * refers to it.  Return its index, or -1 if not found.
+ */
+static int find (struct sign_cache *cache, const uint8_t *digest, int **linkp)
+{
+    int *link;
+
+    if (!cache->buckets)
+        return -1;
+    link = &cache->buckets[bucket_of (cache, digest)];
+
+    while (*link >= 0) {
+        struct cache_entry *e = &cache->entries[*link];
+        if (!memcmp (e->digest, digest, SHA256_BLOCK_SIZE)) {
+            *linkp = link;
+            return *link;
+        }
+        link = &e->next;
+    }
+    return -1;
+}
+
+/* Remove entry 'i', referred to by chain 'link', and put it on the free list.
+ */
+static void drop (struct sign_cache *cache, int i, int *link)
+{
+    struct cache_entry *e = &cache->entries[i];
+
+    *link = e->next;
+    lru_unlink (cache, i);
+    if (cache->free_fn)
+        cache->free_fn (e->data);
+    e->data = NULL;
+    e->next = cache->free;
+    cache->free = i;
+    cache->count--;
+}
+
+int sign_cache_lookup (struct sign_cache *cache,
+                       const uint8_t digest[SHA256_BLOCK_SIZE],
+                       time_t now,
+                       int *mech,
+                       int64_t *userid,
+                       void **data)
+{
+    int *link = NULL;
+    int i;
+
+    if (cache && (i = find (cache, digest, &link)) >= 0) {
+        struct cache_entry *e = &cache->entries[i];
+        if (now <= e->expires) {
+            lru_unlink (cache, i);
+            lru_push (cache, i);
+            if (mech)
+                *mech = e->mech;
+            if (userid)
+                *userid = e->userid;
+            if (data)
+                *data = e->data;
+            return 0;
+        }
+        drop (cache, i, link);
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+int sign_cache_insert (struct sign_cache *cache,
+                       const uint8_t digest[SHA256_BLOCK_SIZE],
+                       time_t expires,
+                       int mech,
+                       int64_t userid,
+                       void *data)
+{
+    struct cache_entry *e;
+    int *link = NULL;
+    int i;
+
+    if (!cache) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!cache->buckets && alloc_buckets (cache) < 0)
+        goto nomem;
+    if ((i = find (cache, digest, &link)) >= 0)
+        drop (cache, i, link);
+    if (cache->free < 0 && grow (cache) < 0) {
+        if (cache->count == 0)
+            goto nomem;
+        struct cache_entry *tail = &cache->entries[cache->lru_tail];
+        int rc = find (cache, tail->digest, &link);
+        drop (cache, rc, link);
+    }
+    i = cache->free;
+    e = &cache->entries[i];
+    cache->free = e->next;
+
+    memcpy (e->digest, digest, SHA256_BLOCK_SIZE);
+    e->expires = expires;
+    e->mech = mech;
+    e->userid = userid;
+    e->data = data;
+    link = &cache->buckets[bucket_of (cache, digest)];
+    e->next = *link;
+    *link = i;
+    lru_push (cache, i);
+    cache->count++;
+    return 0;
+nomem:
+    errno = ENOMEM;
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,73 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _FLUX_SECURITY_SIGN_CACHE_H
+#define _FLUX_SECURITY_SIGN_CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "src/libutil/sha256.h"
+
+/* Bounded LRU cache of verification results, keyed by a SHA256 digest of
+ * the verified data, e.g. the complete HEADER.PAYLOAD.SIGNATURE input.
+ * Each entry records the mechanism (an index chosen by the caller), the
+ * userid, optional caller data, and the time after which the verification
+ * result is no longer valid.
+ * The cache is not thread safe.
+ */
+
+typedef void (*sign_cache_free_f)(void *data);
+
+struct sign_cache;
+
+/* Create a cache holding at most 'size' entries (size > 0).
+ * If 'free_fn' is non-NULL, it is called on the data of each entry that
+ * is dropped from the cache.
+ */
+struct sign_cache *sign_cache_create (int size, sign_cache_free_f free_fn);
+
+void sign_cache_destroy (struct sign_cache *cache);
+
+/* Look up 'digest', and if found and 'now' is not past its expiration,
+ * mark it most recently used and set 'mech', 'userid', and 'data' (each
+ * may be NULL).  'data' remains owned by the cache, and is only valid
+ * until the cache is next modified.  An expired entry is dropped.
+ * Return 0 on hit, or -1 with errno = ENOENT on miss.
+ */
+int sign_cache_lookup (struct sign_cache *cache,
+                       const uint8_t digest[SHA256_BLOCK_SIZE],
+                       time_t now,
+                       int *mech,
+                       int64_t *userid,
+                       void **data);
+
+/* Add 'digest' to the cache, replacing any existing entry for it, and
+ * evicting the least recently used entry if the cache is full.
+ * On success, the cache takes ownership of 'data' (may be NULL).
+ * Entries are allocated as the cache fills, so this may fail.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int sign_cache_insert (struct sign_cache *cache,
+                       const uint8_t digest[SHA256_BLOCK_SIZE],
+                       time_t expires,
+                       int mech,
+                       int64_t userid,
+                        void *data);
+
+/* Return the number of entries in the cache.
+ */
+int sign_cache_count (struct sign_cache *cache);
+
+#endif /* !_FLUX_SECURITY_SIGN_CACHE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -13,7 +13,10 @@
 #endif /* HAVE_CONFIG_H */
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
 #include <pwd.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
@@ -23,29 +26,101 @@
 #include "context_private.h"
 #include "sign.h"
 #include "sign_mech.h"
+#include "sign_cache.h"
 #include "src/libca/sigcert.h"
 #include "src/libca/ca.h"
+#include "src/libutil/sha256.h"
+#include "src/libutil/base64.h"
 
 struct sign_curve {
-    struct sigcert *cert;
     int64_t max_ttl;
-    const cf_t *curve_config;
+    bool require_ca;
+    char *cert_path;            // copied from config, or NULL
     struct ca *ca;
+    int cert_cache_size;
+    int home_cert_ttl;
+    int cert_reload_interval;
+};
+
+/* This thread's signing cert.  The files it was loaded from are checked
+ * for rotation at most once per cert-reload-interval.  'generation'
+ * changes each time a new cert is loaded.
+ */
+struct signer {
+    struct sigcert *cert;
+    char *path;                 // path to secret cert
+    struct stat st;
+    struct stat st_pub;
+    time_t checked;
+    int generation;
+};
+
+/* Cached cert from a user's home directory (require-ca = false).
+ * 'st' identifies the file it was read from.
+ */
+struct home_cert {
+    struct sigcert *cert;
+    uint8_t fingerprint[SHA256_BLOCK_SIZE];
+    char *path;                 // path to .pub file
+    struct stat st;
 };
 
 static const struct cf_option curve_opts[] = {
     {"require-ca",              CF_BOOL,        true},
     {"cert-path",               CF_STRING,      false},
+    {"cert-cache-size",         CF_INT64,       false},
+    {"home-cert-ttl",           CF_INT64,       false},
+    {"cert-reload-interval",    CF_INT64,       false},
     CF_OPTIONS_TABLE_END,
 };
 
-static const char *auxname = "flux::sign_curve";
+// curve_opts indices
+enum {
+    CURVE_REQUIRE_CA,
+    CURVE_CERT_PATH,
+    CURVE_CERT_CACHE_SIZE,
+    CURVE_HOME_CERT_TTL,
+    CURVE_CERT_RELOAD_INTERVAL,
+    CURVE_NOPTS,
+};
+
+static struct security_aux_key auxkey = {
+    .name = "flux::sign_curve",
+};
+static struct security_aux_key cert_cache_auxkey = {
+    .name = "flux::sign_curve_certs",
+};
+static struct security_aux_key home_cache_auxkey = {
+    .name = "flux::sign_curve_home",
+};
+static struct security_aux_key signer_auxkey = {
+    .name = "flux::sign_curve_signer",
+};
+static struct security_aux_key split_auxkey = {
+    .name = "flux::sign_curve_split",
+};
+
+/* Curve state, shared and per-thread, is recreated if any of these change
+ * on reconfiguration.  The split scratch kv does not depend on config.
+ */
+static const char *const curve_deps[] = {
+    "sign.max-ttl",
+    "sign.curve",
+    "ca",
+    NULL,
+};
+
+static const int default_cert_cache_size = 256;
+static const int max_cert_cache_size = 1024*1024;
+static const int default_home_cert_ttl = 60;
+static const int home_cache_size = 1024;
+static const int default_cert_reload_interval = 60;
 
 static void sc_destroy (struct sign_curve *sc)
 {
     if (sc) {
         ca_destroy (sc->ca);
-        sigcert_destroy (sc->cert);
+        free (sc->cert_path);
         free (sc);
     }
 }
@@ -54,25 +129,73 @@ static void sc_destroy (struct sign_curve *sc)
  */
 static int op_init (flux_security_t *ctx, const cf_t *cf)
 {
-    struct sign_curve *sc = flux_security_aux_get (ctx, auxname);
+    struct sign_curve *sc = security_aux_key_get (ctx, &auxkey);
     struct cf_error cfe;
+    const cf_t *curve_config;
+    const cf_t *val[CURVE_NOPTS];
+    const cf_t *entry;
 
     if (sc != NULL)
         return 0;
     if (!(sc = calloc (1, sizeof (*sc))))
         goto error;
     sc->max_ttl = cf_int64 (cf_get_in (cf, "max-ttl"));
-    if (!(sc->curve_config = cf_get_in (cf, "curve"))) {
+    if (!(curve_config = cf_get_in (cf, "curve"))) {
         security_error (ctx, "sign-curve-init: [sign.curve] config missing");
         goto error_nomsg;
     }
-    if (cf_check (sc->curve_config, curve_opts, CF_STRICT, &cfe) < 0) {
+    /* Options are resolved once here, so they are plain members of 'sc'
+     * on the signing and verification paths.
+     */
+    if (cf_resolve (curve_config, curve_opts, CF_STRICT, val, &cfe) < 0) {
         security_error (ctx, "sign-curve-init: [curve] config: %s", cfe.errbuf);
         goto error_nomsg;
     }
-    if (flux_security_aux_set (ctx, auxname, sc,
-                               (flux_security_free_f)sc_destroy) < 0)
+    sc->require_ca = cf_bool (val[CURVE_REQUIRE_CA]);
+    if ((entry = val[CURVE_CERT_PATH])
+        && !(sc->cert_path = strdup (cf_string (entry))))
         goto error;
+    sc->cert_cache_size = default_cert_cache_size;
+    if ((entry = val[CURVE_CERT_CACHE_SIZE])) {
+        int64_t size = cf_int64 (entry);
+        if (size < 0 || size > max_cert_cache_size) {
+            errno = EINVAL;
+            security_error (ctx,
+                            "sign-curve-init: cert-cache-size must be 0-%d",
+                            max_cert_cache_size);
+            goto error_nomsg;
+        }
+        sc->cert_cache_size = size;
+    }
+    sc->home_cert_ttl = default_home_cert_ttl;
+    if ((entry = val[CURVE_HOME_CERT_TTL])) {
+        int64_t ttl = cf_int64 (entry);
+        if (ttl < 0 || ttl > INT_MAX) {
+            errno = EINVAL;
+            security_error (ctx, "sign-curve-init: home-cert-ttl is invalid");
+            goto error_nomsg;
+        }
+        sc->home_cert_ttl = ttl;
+    }
+    sc->cert_reload_interval = default_cert_reload_interval;
+    if ((entry = val[CURVE_CERT_RELOAD_INTERVAL])) {
+        int64_t interval = cf_int64 (entry);
+        if (interval < 0 || interval > INT_MAX) {
+            errno = EINVAL;
+            security_error (ctx,
+                            "sign-curve-init: cert-reload-interval is invalid");
+            goto error_nomsg;
+        }
+        sc->cert_reload_interval = interval;
+    }
+    if (security_aux_key_set (ctx, &auxkey, sc,
+                              (flux_security_free_f)sc_destroy) < 0)
+        goto error;
+    if (security_aux_depends (ctx, auxkey.name, curve_deps) < 0
+        || security_aux_depends (ctx, cert_cache_auxkey.name, curve_deps) < 0
+        || security_aux_depends (ctx, home_cache_auxkey.name, curve_deps) < 0
+        || security_aux_depends (ctx, signer_auxkey.name, curve_deps) < 0)
+        return -1;
     return 0;
 error:
     security_error (ctx, NULL);
@@ -104,139 +227,565 @@ error:
     return -1;
 }
 
-/* Get cert from security header.
+/* Compute SHA256 digest over the cert in security header, without
+ * decoding it.  Identical digests imply identical certs.
+ */
+static void header_cert_digest (const struct kv *header, const char *prefix,
+                                uint8_t *digest)
+{
+    SHA256_CTX shx;
+    struct kv_iter it;
+    int n = strlen (prefix);
+
+    sha256_init (&shx);
+    kv_iter_init (&it);
+    while (kv_iter_next (header, &it)) {
+        if (it.keylen >= n && !memcmp (it.key, prefix, n))
+            sha256_update (&shx, (const BYTE *)it.key, it.entry_len);
+    }
+    sha256_final (&shx, digest);
+}
+
+/* Compute the fingerprint of 'cert', which is the digest that
+ * header_cert_digest() computes over a header containing it.
+ * Return 0 on success, -1 on error with errno set.
+ */
+static int cert_fingerprint (struct sigcert *cert, uint8_t *digest)
+{
+    struct kv *kv;
+
+    if (!(kv = kv_create ()))
+        return -1;
+    if (header_put_cert (kv, "curve.cert.", cert) < 0) {
+        kv_destroy (kv);
+        return -1;
+    }
+    header_cert_digest (kv, "curve.cert.", digest);
+    kv_destroy (kv);
+    return 0;
+}
+
+/* Return the version of security 'header', or 1 if it cannot be read.
+ */
+static int64_t header_version (const struct kv *header)
+{
+    int64_t version;
+
+    if (kv_get (header, "version", KV_INT64, &version) < 0)
+        return 1;
+    return version;
+}
+
+/* Get this thread's cache of CA-verified certs, creating it on first use.
+ * Return NULL if the cache is disabled or cannot be created.
+ */
+static struct sign_cache *cert_cache_get (flux_security_t *ctx,
+                                          struct sign_curve *sc)
+{
+    struct sign_cache *cache;
+
+    if (sc->cert_cache_size == 0)
+        return NULL;
+    if (!(cache = security_thread_aux_key_get (ctx, &cert_cache_auxkey))) {
+        if (!(cache = sign_cache_create (sc->cert_cache_size,
+                                         (sign_cache_free_f)sigcert_destroy)))
+            return NULL;
+        if (security_thread_aux_key_set (ctx, &cert_cache_auxkey, cache,
+                            (flux_security_free_f)sign_cache_destroy) < 0) {
+            sign_cache_destroy (cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* Get cert from security header.  The cert is extracted into this
+ * thread's scratch kv object, so no allocation is needed for that once
+ * it is large enough.
  * Return cert on success, NULL on error with errno set.
  */
-static struct sigcert *header_get_cert (const struct kv *header,
+static struct sigcert *header_get_cert (flux_security_t *ctx,
+                                        const struct kv *header,
                                         const char *prefix)
 {
     struct kv *kv;
     const char *buf;
     int len;
+
+    if (!(kv = security_thread_aux_key_get (ctx, &split_auxkey))) {
+        if (!(kv = kv_create ()))
+            return NULL;
+        if (security_thread_aux_key_set (ctx, &split_auxkey, kv,
+                                (flux_security_free_f)kv_destroy) < 0) {
+            kv_destroy (kv);
+            return NULL;
+        }
+    }
+    if (kv_split_into (header, prefix, kv) < 0
+        || kv_encode (kv, &buf, &len) < 0)
+        return NULL;
+    return sigcert_decode (buf, len);
+}
+
+/* Return true if 'st1' and 'st2' describe the same, unmodified file.
+ */
+static bool same_file (const struct stat *st1, const struct stat *st2)
+{
+    return st1->st_dev == st2->st_dev
+        && st1->st_ino == st2->st_ino
+        && st1->st_size == st2->st_size
+        && st1->st_mtim.tv_sec == st2->st_mtim.tv_sec
+        && st1->st_mtim.tv_nsec == st2->st_mtim.tv_nsec
+        && st1->st_ctim.tv_sec == st2->st_ctim.tv_sec
+        && st1->st_ctim.tv_nsec == st2->st_ctim.tv_nsec;
+}
+
+static void signer_destroy (struct signer *sig)
+{
+    if (sig) {
+        int saved_errno = errno;
+        sigcert_destroy (sig->cert);
+        free (sig->path);
+        free (sig);
+        errno = saved_errno;
+    }
+}
+
+/* Stat secret cert 'path' and its .pub file.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int signer_stat (const char *path, struct stat *st, struct stat *st_pub)
+{
+    char path_pub[PATH_MAX + 1];
+
+    if (snprintf (path_pub, sizeof (path_pub), "%s.pub", path)
+                                                >= (int)sizeof (path_pub)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (stat (path, st) < 0 || stat (path_pub, st_pub) < 0)
+        return -1;
+    return 0;
+}
+
+/* (Re-)load the signing cert from sig->path.  The files are stat'ed
+ * before they are read, so if they are replaced while being read, the
+ * change is noticed by the next check.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int signer_load (struct signer *sig)
+{
+    struct stat st;
+    struct stat st_pub;
     struct sigcert *cert;
 
-    if (!(kv = kv_split (header, prefix)))
+    if (signer_stat (sig->path, &st, &st_pub) < 0)
+        return -1;
+    if (!(cert = sigcert_load (sig->path, true)))
+        return -1;
+    sigcert_destroy (sig->cert);
+    sig->cert = cert;
+    sig->st = st;
+    sig->st_pub = st_pub;
+    sig->generation++;
+    return 0;
+}
+
+/* Create signer and load the signing cert for the real user.
+ * Return signer on success, NULL on failure with ctx error state updated.
+ */
+static struct signer *signer_create (flux_security_t *ctx,
+                                     struct sign_curve *sc,
+                                     time_t now)
+{
+    struct signer *sig;
+    char path[PATH_MAX + 1];
+    int n = -1;
+
+    if (!(sig = calloc (1, sizeof (*sig)))) {
+        security_error (ctx, NULL);
         return NULL;
-    if (kv_encode (kv, &buf, &len) < 0)
+    }
+    if (sc->cert_path) // test
+        n = snprintf (path, sizeof (path), "%s", sc->cert_path);
+    else {
+        struct passwd *pw;
+
+        security_lock (ctx);
+        if ((pw = getpwuid (getuid ())))
+            n = snprintf (path, sizeof (path), "%s/.flux/curve/sig",
+                          pw->pw_dir);
+        security_unlock (ctx);
+    }
+    if (n < 0 || n >= (int)sizeof (path)) {
+        errno = EINVAL;
+        security_error (ctx, NULL);
         goto error;
-    if (!(cert = sigcert_decode (buf, len)))
+    }
+    if (!(sig->path = strdup (path))) {
+        security_error (ctx, NULL);
         goto error;
-    kv_destroy (kv);
-    return cert;
+    }
+    if (signer_load (sig) < 0) {
+        security_error (ctx, "sign-curve-prep: load %s: %s",
+                        sig->path, strerror (errno));
+        goto error;
+    }
+    sig->checked = now;
+    return sig;
 error:
-    kv_destroy (kv);
+    signer_destroy (sig);
     return NULL;
 }
 
-/* prep - add to security header
- *   curve.cert    signer's public certificate
- *   curve.ctime   signature creation time
- *   curve.xtime   signature expiration time
+/* Get this thread's signer, loading the signing cert on first use.
+ * Return NULL on failure with ctx error state updated.
  */
-static int op_prep (flux_security_t *ctx, struct kv *header, int flags)
+static struct signer *signer_get (flux_security_t *ctx,
+                                  struct sign_curve *sc,
+                                  time_t now)
 {
-    struct sign_curve *sc = flux_security_aux_get (ctx, auxname);
-    time_t ctime;
-    time_t xtime;
+    struct signer *sig;
+
+    if (!(sig = security_thread_aux_key_get (ctx, &signer_auxkey))) {
+        if (!(sig = signer_create (ctx, sc, now)))
+            return NULL;
+        if (security_thread_aux_key_set (ctx, &signer_auxkey, sig,
+                            (flux_security_free_f)signer_destroy) < 0) {
+            signer_destroy (sig);
+            return NULL;
+        }
+        return sig;
+    }
+    /* Check for rotation.  If the new cert cannot be loaded, e.g. because
+     * it is only partially written, keep signing with the old one.
+     */
+    if (now - sig->checked >= sc->cert_reload_interval) {
+        struct stat st;
+        struct stat st_pub;
+
+        sig->checked = now;
+        if (signer_stat (sig->path, &st, &st_pub) == 0
+            && (!same_file (&st, &sig->st)
+                || !same_file (&st_pub, &sig->st_pub)))
+            (void)signer_load (sig);
+    }
+    return sig;
+}
+
+/* generation - check for signing cert rotation, and return a number that
+ * changes when the cert does, so the cert added by prep_static is replaced.
+ */
+static int op_generation (flux_security_t *ctx, time_t now, int flags)
+{
+    struct sign_curve *sc = security_aux_key_get (ctx, &auxkey);
+    struct signer *sig;
 
     assert (sc != NULL);
 
-    if (!sc->cert) { // load signing cert on first use
-        char buf[PATH_MAX + 1];
-        int bufsz = sizeof (buf);
-        const char *certpath;
-        struct sigcert *cert;
-        const cf_t *entry;
-        if ((entry = cf_get_in (sc->curve_config, "cert-path"))) // test
-            certpath = cf_string (entry);
-        else {
-            uid_t real_uid = getuid ();
-            struct passwd *pw = getpwuid (real_uid);
-            if (!pw || snprintf (buf, bufsz, "%s/.flux/curve/sig",
-                                                    pw->pw_dir) >= bufsz) {
-                errno = EINVAL;
-                goto error;
-            }
-            certpath = buf;
-        }
-        if (!(cert = sigcert_load (certpath, true))) {
-            security_error (ctx, "sign-curve-prep: load %s: %s",
-                            certpath, strerror (errno));
-            goto error_nomsg;
-        }
-        sigcert_destroy (sc->cert);
-        sc->cert = cert;
+    if (!(sig = signer_get (ctx, sc, now)))
+        return -1;
+    return sig->generation;
+}
+
+/* Get the signing cert loaded by op_generation(), without checking for
+ * rotation, so that the cert in the header is the one that signs.
+ */
+static struct sigcert *signer_cert (flux_security_t *ctx)
+{
+    struct signer *sig = security_thread_aux_key_get (ctx, &signer_auxkey);
+
+    assert (sig != NULL);
+    return sig->cert;
+}
+
+/* prep_static - add to security header
+ *   curve.cert         signer's public certificate (version 1)
+ *   curve.fingerprint  signer's cert fingerprint, base64 (version 2)
+ * sign.c caches the result, avoiding a cert encode/decode per signature,
+ * until op_generation() reports that the signing cert has been rotated.
+ */
+static int op_prep_static (flux_security_t *ctx, struct kv *header,
+                           time_t now, int flags)
+{
+    struct sigcert *cert = signer_cert (ctx);
+
+    if (header_version (header) >= 2) {
+        uint8_t digest[SHA256_BLOCK_SIZE];
+        char fp[64];
+
+        if (cert_fingerprint (cert, digest) < 0)
+            goto error;
+        base64_encode (fp, digest, sizeof (digest));
+        if (kv_put (header, "curve.fingerprint", KV_STRING, fp) < 0)
+            goto error;
     }
-    if ((ctime = time (NULL)) == (time_t)-1)
-        goto error;
-    xtime = ctime + sc->max_ttl;
-    if (header_put_cert (header, "curve.cert.", sc->cert) < 0
-            || kv_put (header, "curve.ctime", KV_TIMESTAMP, ctime) < 0
-            || kv_put (header, "curve.xtime", KV_TIMESTAMP, xtime) < 0)
+    else if (header_put_cert (header, "curve.cert.", cert) < 0)
         goto error;
     return 0;
 error:
     security_error (ctx, NULL);
-error_nomsg:
     return -1;
 }
 
+/* prep - add to security header
+ *   curve.ctime   signature creation time
+ *   curve.xtime   signature expiration time
+ */
+static int op_prep (flux_security_t *ctx, struct kv *header,
+                    time_t now, int flags)
+{
+    struct sign_curve *sc = security_aux_key_get (ctx, &auxkey);
+
+    assert (sc != NULL);
+
+    if (kv_put_unique (header, "curve.ctime", KV_TIMESTAMP, now) < 0
+            || kv_put_unique (header, "curve.xtime", KV_TIMESTAMP,
+                              now + sc->max_ttl) < 0) {
+        security_error (ctx, NULL);
+        return -1;
+    }
+    return 0;
+}
+
 /* sign - sign HEADER.PAYLOAD
  */
 static char *op_sign (flux_security_t *ctx,
                       const char *input, int inputsz, int flags)
 {
-    struct sign_curve *sc = flux_security_aux_get (ctx, auxname);
     char *sign;
 
-    assert (sc != NULL);
-
-    if (!(sign = sigcert_sign_detached (sc->cert, (uint8_t *)input, inputsz))) {
+    if (!(sign = sigcert_sign_detached (signer_cert (ctx),
+                                        (uint8_t *)input, inputsz))) {
         security_error (ctx, "sign-curve: %s", strerror (errno));
         return NULL;
     }
     return sign;
 }
 
-/* Verify that cert authenticates userid, because it exists in that user's
- * home directory.
+/* sign_into - sign HEADER.PAYLOAD directly into caller's buffer
  */
-static int verify_cert_home (flux_security_t *ctx, struct sign_curve *sc,
-                             const struct sigcert *cert, int64_t userid)
+static int op_sign_into (flux_security_t *ctx,
+                         const char *input, int inputsz,
+                         char *buf, int bufsz, int flags)
+{
+    int n;
+
+    if ((n = sigcert_sign_detached_into (signer_cert (ctx),
+                                         (uint8_t *)input, inputsz,
+                                         buf, bufsz)) < 0) {
+        security_error (ctx, "sign-curve: %s", strerror (errno));
+        return -1;
+    }
+    return n;
+}
+
+static void home_cert_destroy (struct home_cert *hc)
+{
+    if (hc) {
+        int saved_errno = errno;
+        sigcert_destroy (hc->cert);
+        free (hc->path);
+        free (hc);
+        errno = saved_errno;
+    }
+}
+
+/* Read public cert from hc->path, recording the file's identity in hc->st.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int home_cert_read (struct home_cert *hc)
+{
+    FILE *fp;
+    struct sigcert *cert;
+    int saved_errno;
+
+    if (!(fp = fopen (hc->path, "r")))
+        return -1;
+    if (fstat (fileno (fp), &hc->st) < 0
+            || !(cert = sigcert_fread_public (fp)))
+        goto error;
+    if (cert_fingerprint (cert, hc->fingerprint) < 0) {
+        sigcert_destroy (cert);
+        goto error;
+    }
+    (void)fclose (fp);
+    sigcert_destroy (hc->cert);
+    hc->cert = cert;
+    return 0;
+error:
+    saved_errno = errno;
+    (void)fclose (fp);
+    errno = saved_errno;
+    return -1;
+}
+
+/* Look up the home directory of 'userid' and load its cert.
+ * Return home_cert on success, NULL on failure with ctx error state updated.
+ */
+static struct home_cert *home_cert_create (flux_security_t *ctx,
+                                           int64_t userid)
 {
     char buf[PATH_MAX + 1] = "unknown user";
+    char path[PATH_MAX + 1];
     int bufsz = sizeof (buf);
-    struct passwd *pw = getpwuid (userid);
-    struct sigcert *ucert = NULL;
+    struct passwd *pw;
+    struct home_cert *hc;
 
+    if (!(hc = calloc (1, sizeof (*hc)))) {
+        security_error (ctx, NULL);
+        return NULL;
+    }
+    security_lock (ctx); // getpwuid(3) is not reentrant
+    pw = getpwuid (userid);
     if (!pw || snprintf (buf, bufsz, "%s/.flux/curve/sig", pw->pw_dir) >= bufsz
-                                || (!(ucert = sigcert_load (buf, false)))) {
-        errno = EINVAL;
-        security_error (ctx, "sign-curve-verify: error loading cert from %s",
-                        buf);
-        return -1;
+            || snprintf (path, sizeof (path), "%s.pub", buf)
+                                            >= (int)sizeof (path)) {
+        security_unlock (ctx);
+        goto error;
     }
-    if (!sigcert_equal (ucert, cert)) {
+    security_unlock (ctx);
+    if (!(hc->path = strdup (path))) {
+        security_error (ctx, NULL);
+        home_cert_destroy (hc);
+        return NULL;
+    }
+    if (home_cert_read (hc) < 0)
+        goto error;
+    return hc;
+error:
+    errno = EINVAL;
+    security_error (ctx, "sign-curve-verify: error loading cert from %s", buf);
+    home_cert_destroy (hc);
+    return NULL;
+}
+
+/* Get this thread's cache of home directory certs, creating it on first use.
+ * Return NULL if the cache is disabled or cannot be created.
+ */
+static struct sign_cache *home_cache_get (flux_security_t *ctx,
+                                          struct sign_curve *sc)
+{
+    struct sign_cache *cache;
+
+    if (sc->home_cert_ttl == 0)
+        return NULL;
+    if (!(cache = security_thread_aux_key_get (ctx, &home_cache_auxkey))) {
+        if (!(cache = sign_cache_create (home_cache_size,
+                                         (sign_cache_free_f)home_cert_destroy)))
+            return NULL;
+        if (security_thread_aux_key_set (ctx, &home_cache_auxkey, cache,
+                            (flux_security_free_f)sign_cache_destroy) < 0) {
+            sign_cache_destroy (cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+static void userid_key (int64_t userid, uint8_t *key)
+{
+    SHA256_CTX shx;
+
+    sha256_init (&shx);
+    sha256_update (&shx, (const BYTE *)&userid, sizeof (userid));
+    sha256_final (&shx, key);
+}
+
+/* Get the cert in the home directory of 'userid'.  Home directory certs are
+ * cached for home-cert-ttl seconds, during which the home directory is not
+ * looked up again, and the cert file is only re-read if stat(2) shows that
+ * it has changed.  If the cache is disabled, '*owned' is set to true and
+ * the caller must destroy the result.
+ * Return home_cert on success, NULL on failure with ctx error state updated.
+ */
+static struct home_cert *home_cert_get (flux_security_t *ctx,
+                                        struct sign_curve *sc,
+                                        int64_t userid,
+                                        time_t now,
+                                        bool *owned)
+{
+    struct sign_cache *cache = home_cache_get (ctx, sc);
+    uint8_t key[SHA256_BLOCK_SIZE];
+    struct home_cert *hc = NULL;
+
+    if (cache) {
+        void *data;
+        userid_key (userid, key);
+        if (sign_cache_lookup (cache, key, now, NULL, NULL, &data) == 0) {
+            struct stat st;
+            hc = data;
+            if (stat (hc->path, &st) == 0
+                    && (same_file (&st, &hc->st) || home_cert_read (hc) == 0)) {
+                security_stats_count (ctx, STAT_CURVE_HOME_CACHE_HIT);
+                *owned = false;
+                return hc;
+            }
+        }
+        security_stats_count (ctx, STAT_CURVE_HOME_CACHE_MISS);
+    }
+    if (!(hc = home_cert_create (ctx, userid)))
+        return NULL;
+    *owned = !cache || sign_cache_insert (cache, key, now + sc->home_cert_ttl,
+                                          0, userid, hc) < 0;
+    return hc;
+}
+
+/* Verify that cert authenticates userid, because it exists in that user's
+ * home directory.
+ */
+static int verify_cert_home (flux_security_t *ctx, struct sign_curve *sc,
+                             const struct sigcert *cert, int64_t userid,
+                             time_t now)
+{
+    struct home_cert *hc;
+    bool owned;
+    int rc = 0;
+
+    if (!(hc = home_cert_get (ctx, sc, userid, now, &owned)))
+        return -1;
+    if (!sigcert_equal (hc->cert, cert)) {
         errno = EINVAL;
         security_error (ctx, "sign-curve-verify: cert verification failed");
-        sigcert_destroy (ucert);
-        return -1;
+        rc = -1;
     }
-    sigcert_destroy (ucert);
-    return 0;
+    if (owned)
+        home_cert_destroy (hc);
+    return rc;
 }
 
 /* Verify that cert authenticates userid, because it was signed by the CA,
- * and the cert contains the same userid.
+ * and the cert contains the same userid.  If 'cached' is true, the cert
+ * was already verified by ca_verify(), so just check that it has not been
+ * revoked since then.
  */
 static int verify_cert_ca (flux_security_t *ctx, struct sign_curve *sc,
                            const struct sigcert *cert, int64_t userid,
-                           time_t now, time_t ctime)
+                           time_t now, time_t ctime, bool cached)
 {
     int64_t cert_max_sign_ttl;
     int64_t cert_userid;
     ca_error_t e;
 
+    if (cached) {
+        const char *uuid;
+
+        if (sigcert_meta_get (cert, "uuid", SM_STRING, &uuid) < 0
+                || sigcert_meta_get (cert, "userid", SM_INT64,
+                                     &cert_userid) < 0
+                || sigcert_meta_get (cert, "max-sign-ttl", SM_INT64,
+                                     &cert_max_sign_ttl) < 0) {
+            security_error (ctx, "sign-curve-verify: ca: %s", strerror (errno));
+            return -1;
+        }
+        if (ca_check_revocation (sc->ca, uuid, e) < 0) {
+            security_error (ctx, "sign-curve-verify: ca: %s", e);
+            return -1;
+        }
+        goto check;
+    }
+
+    security_lock (ctx);
     if (!sc->ca) { // load CA context on first use
         const cf_t *ca_config;
         struct ca *ca;
@@ -244,19 +793,24 @@ static int verify_cert_ca (flux_security_t *ctx, struct sign_curve *sc,
 
         if (!(ca_config = security_get_config (ctx, "ca"))) {
             security_error (ctx, "sign-curve-verify: [ca] config missing");
+            security_unlock (ctx);
             return -1;
         }
         if (!(ca = ca_create (ca_config, e)) || ca_load (ca, false, e)) {
             security_error (ctx, "sign-curve-verify: ca: %s", e);
             ca_destroy (ca);
+            security_unlock (ctx);
             return -1;
         }
         sc->ca = ca;
     }
-    if (ca_verify (sc->ca, cert, &cert_userid, &cert_max_sign_ttl, e) < 0) {
+    security_unlock (ctx);
+    if (ca_verify_at (sc->ca, cert, now, &cert_userid, &cert_max_sign_ttl,
+                      e) < 0) {
         security_error (ctx, "sign-curve-verify: ca: %s", e);
         return -1;
     }
+check:
     if (cert_userid != userid) {
         security_error (ctx, "sign-curve-verify: ca: userid mismatch");
         return -1;
@@ -268,73 +822,235 @@ static int verify_cert_ca (flux_security_t *ctx, struct sign_curve *sc,
     return 0;
 }
 
+/* Get the cert fingerprint from a version 2 'header', if present.
+ * Return 1 if found, 0 if not, or -1 if it is invalid.
+ */
+static int header_get_fingerprint (const struct kv *header, uint8_t *digest)
+{
+    const char *fp;
+
+    if (kv_get (header, "curve.fingerprint", KV_STRING, &fp) < 0)
+        return 0;
+    if (header_version (header) < 2
+            || base64_decode (digest, SHA256_BLOCK_SIZE, fp, strlen (fp))
+                                                        != SHA256_BLOCK_SIZE)
+        return -1;
+    return 1;
+}
+
 /* verify - verify HEADER.PAYLOAD.SIGNATURE, e.g.
  * - enclosed cert created SIGNATURE over HEADER.PAYLOAD
  * - enclosed cert authenticates header userid (two methods)
  * - xtime has not passed
  * - ctime plus configured max-ttl has not passed
+ * A version 2 header may identify the cert by fingerprint instead of
+ * enclosing it.  With require-ca = true, the fingerprint is resolved through
+ * the cache of CA-verified certs, so the cert must have been seen recently
+ * in a version 1 header.  Otherwise, it must match the fingerprint of the
+ * cert in the user's home directory.
  */
 static int op_verify (flux_security_t *ctx, const struct kv *header,
                       const char *input, int inputsz,
-                      const char *signature, int flags)
+                      const char *signature, time_t now, int flags)
 {
-    struct sign_curve *sc = flux_security_aux_get (ctx, auxname);
+    struct sign_curve *sc = security_aux_key_get (ctx, &auxkey);
     struct sigcert *cert = NULL;
-    time_t now;
+    const struct sigcert *vcert = NULL;
+    struct sign_cache *cache = NULL;
+    struct home_cert *hc = NULL;
+    bool hc_owned = false;
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    int by_fingerprint;
+    bool require_ca;
     time_t ctime;
     time_t xtime;
     int64_t userid;
+    uint64_t t;
+    int rc;
 
     assert (sc != NULL);
 
-    if ((now = time (NULL)) == (time_t)-1)
-        goto error;
-
-    if (!(cert = header_get_cert (header, "curve.cert."))
-            || kv_get (header, "curve.xtime", KV_TIMESTAMP, &xtime) < 0
+    if (kv_get (header, "curve.xtime", KV_TIMESTAMP, &xtime) < 0
             || kv_get (header, "curve.ctime", KV_TIMESTAMP, &ctime) < 0
             || kv_get (header, "userid", KV_INT64, &userid) < 0) {
         security_error (ctx, "sign-curve-verify: incomplete header");
-        goto error_nomsg;
+        goto error;
     }
-    if (sigcert_verify_detached (cert, signature,
-                                 (uint8_t *)input, inputsz) < 0) {
+    if ((by_fingerprint = header_get_fingerprint (header, digest)) < 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-curve-verify: invalid cert fingerprint");
+        goto error;
+    }
+    /* CA-verified certs are cached, keyed by a digest of the encoded cert,
+     * so a hit saves decoding it and verifying the CA signature on it.
+     */
+    require_ca = sc->require_ca;
+    if (require_ca && (cache = cert_cache_get (ctx, sc))) {
+        void *data;
+        if (!by_fingerprint)
+            header_cert_digest (header, "curve.cert.", digest);
+        if (sign_cache_lookup (cache, digest, now, NULL, NULL, &data) == 0) {
+            security_stats_count (ctx, STAT_CURVE_CERT_CACHE_HIT);
+            vcert = data;
+        }
+        else
+            security_stats_count (ctx, STAT_CURVE_CERT_CACHE_MISS);
+    }
+    if (!vcert && by_fingerprint) {
+        if (require_ca) {
+            errno = EINVAL;
+            security_error (ctx, "sign-curve-verify: ca: unknown cert"
+                            " fingerprint");
+            goto error;
+        }
+        t = security_stats_start (ctx);
+        hc = home_cert_get (ctx, sc, userid, now, &hc_owned);
+        security_stats_end (ctx, STAT_CURVE_HOME, t);
+        if (!hc)
+            goto error;
+        if (memcmp (hc->fingerprint, digest, SHA256_BLOCK_SIZE) != 0) {
+            errno = EINVAL;
+            security_error (ctx, "sign-curve-verify: cert verification failed");
+            goto error;
+        }
+        vcert = hc->cert;
+    }
+    if (!vcert) {
+        t = security_stats_start (ctx);
+        cert = header_get_cert (ctx, header, "curve.cert.");
+        security_stats_end (ctx, STAT_CURVE_GET_CERT, t);
+        if (!cert) {
+            security_error (ctx, "sign-curve-verify: incomplete header");
+            goto error;
+        }
+        vcert = cert;
+    }
+    t = security_stats_start (ctx);
+    rc = sigcert_verify_detached (vcert, signature, (uint8_t *)input, inputsz);
+    security_stats_end (ctx, STAT_CURVE_SIGNATURE, t);
+    if (rc < 0) {
         security_error (ctx, "sign-curve-verify: verification failure");
-        goto error_nomsg;
+        goto error;
     }
-    if (cf_bool (cf_get_in (sc->curve_config, "require-ca"))) {
-        if (verify_cert_ca (ctx, sc, cert, userid, now, ctime) < 0)
-            goto error_nomsg;
+    if (require_ca) {
+        time_t cert_xtime;
+
+        /* A cached cert only needs the revocation check.
+         */
+        t = security_stats_start (ctx);
+        rc = verify_cert_ca (ctx, sc, vcert, userid, now, ctime, !cert);
+        security_stats_end (ctx, cert ? STAT_CURVE_CA
+                                      : STAT_CURVE_CA_REVOCATION, t);
+        if (rc < 0)
+            goto error;
+        if (cert && cache
+                && sigcert_meta_get (cert, "xtime", SM_TIMESTAMP,
+                                     &cert_xtime) == 0
+                && sign_cache_insert (cache, digest, cert_xtime,
+                                      0, userid, cert) == 0)
+            cert = NULL;
     }
-    else {          // require-ca = false
-        if (verify_cert_home (ctx, sc, cert, userid) < 0)
-            goto error_nomsg;
+    else if (!hc) { // require-ca = false, and cert is enclosed
+        t = security_stats_start (ctx);
+        rc = verify_cert_home (ctx, sc, vcert, userid, now);
+        security_stats_end (ctx, STAT_CURVE_HOME, t);
+        if (rc < 0)
+            goto error;
     }
     if (xtime < now || ctime + sc->max_ttl < now) {
         errno = EINVAL;
         security_error (ctx, "sign-curve-verify: xtime or max-ttl exceeded");
-        goto error_nomsg;
+        goto error;
     }
     if (ctime > now) {
         errno = EINVAL;
         security_error (ctx, "sign-curve-verify: ctime is in the future");
-        goto error_nomsg;
+        goto error;
     }
+    if (hc_owned)
+        home_cert_destroy (hc);
     sigcert_destroy (cert);
     return 0;
 error:
-    security_error (ctx, NULL);
-error_nomsg:
+    if (hc_owned)
+        home_cert_destroy (hc);
     sigcert_destroy (cert);
     return -1;
 }
 
+/* expires - return time after which verification of 'header' fails:
+ * - xtime
+ * - ctime plus configured max-ttl
+ * - if require-ca = true, cert xtime and ctime plus cert max-sign-ttl
+ */
+static time_t op_expires (flux_security_t *ctx, const struct kv *header)
+{
+    struct sign_curve *sc = security_aux_key_get (ctx, &auxkey);
+    time_t ctime;
+    time_t xtime;
+    time_t expires;
+
+    assert (sc != NULL);
+
+    if (kv_get (header, "curve.xtime", KV_TIMESTAMP, &xtime) < 0
+            || kv_get (header, "curve.ctime", KV_TIMESTAMP, &ctime) < 0)
+        return (time_t)-1;
+    expires = xtime;
+    if (ctime + sc->max_ttl < expires)
+        expires = ctime + sc->max_ttl;
+    if (sc->require_ca) {
+        struct sigcert *cert = NULL;
+        const struct sigcert *vcert;
+        uint8_t digest[SHA256_BLOCK_SIZE];
+        time_t cert_xtime;
+        int64_t cert_max_sign_ttl;
+        int by_fingerprint;
+
+        if ((by_fingerprint = header_get_fingerprint (header, digest)) < 0)
+            return (time_t)-1;
+        /* op_verify() just found the cert in the cache.  Since ctime is not
+         * after the time it was looked up, it will be found again.
+         */
+        if (by_fingerprint) {
+            struct sign_cache *cache = cert_cache_get (ctx, sc);
+            void *data;
+
+            if (!cache || sign_cache_lookup (cache, digest, ctime,
+                                             NULL, NULL, &data) < 0)
+                return (time_t)-1;
+            vcert = data;
+        }
+        else if (!(vcert = cert = header_get_cert (ctx, header,
+                                                   "curve.cert.")))
+            return (time_t)-1;
+        if (sigcert_meta_get (vcert, "xtime", SM_TIMESTAMP, &cert_xtime) < 0
+                || sigcert_meta_get (vcert, "max-sign-ttl", SM_INT64,
+                                     &cert_max_sign_ttl) < 0) {
+            sigcert_destroy (cert);
+            return (time_t)-1;
+        }
+        sigcert_destroy (cert);
+        if (cert_xtime < expires)
+            expires = cert_xtime;
+        if (ctime + cert_max_sign_ttl < expires)
+            expires = ctime + cert_max_sign_ttl;
+    }
+    return expires;
+}
+
 const struct sign_mech sign_mech_curve = {
     .name = "curve",
+    .stat_sign = STAT_CURVE_SIGN,
+    .stat_verify = STAT_CURVE_VERIFY,
+    .sig_max = SIGCERT_SIGNATURE_LEN,
     .init = op_init,
+    .generation = op_generation,
+    .prep_static = op_prep_static,
     .prep = op_prep,
     .sign = op_sign,
+    .sign_into = op_sign_into,
     .verify = op_verify,
+    .expires = op_expires,
 };
 
 /*
@@ -11,21 +11,31 @@
 #ifndef _FLUX_SECURITY_SIGN_MECH_H
 #define _FLUX_SECURITY_SIGN_MECH_H
 
+#include <time.h>
+
 #include "sign.h"
+#include "context_private.h"
+#include "sign_batch.h"
 
 #include "src/libutil/cf.h"
 #include "src/libutil/kv.h"
 
 /* Mechanisms define the following callbacks privately, and collect them
  * in a global 'struct sign_mech'.  To add a new mechanism, create code
- * in sign_<name>.c, add extern def for sign_mech_<name> below, and update
- * sign.c::lookup_mech() to map <name> to the extern def.
+ * in sign_<name>.c, add extern def for sign_mech_<name> below, and add
+ * the extern def to sign.c::mechtab[].
+ *
+ * Callbacks that take a 'now' parameter should use it instead of reading
+ * the clock.  It is taken once per wrap or unwrap operation (or batch),
+ * so that all time checks within the operation are consistent.
  */
 
 /* init (optional)
  * Called on first use of the mechanism, if defined.  Initialize any
  * local context for the mechanism, and check mechanism configuration, if any.
- * Local context is stored in 'ctx', with destructor.
+ * Local context is stored in 'ctx', with destructor.  Declare the config
+ * it was derived from with security_aux_depends(), so it is recreated if
+ * that changes on reconfiguration.  It may depend on [sign] and [ca] only.
  * 'cf' is the [sign] security configuration.
  * This function must be idempotent.
  * Return 0 on success, or -1 on error with errno and context error set.
@@ -39,7 +49,27 @@ typedef int (*sign_mech_init_f)(flux_security_t *ctx, const cf_t *cf);
  * Return 0 on success, or -1 on error with errno and context error set.
  */
 typedef int (*sign_mech_prep_f)(flux_security_t *ctx, struct kv *header,
-                                int flags);
+                                time_t now, int flags);
+
+/* prep_static (optional)
+ * Like prep, but only add data that is the same for every signature made
+ * with 'ctx', e.g. the signer's certificate.  The result is cached, so this
+ * is only called the first time a given userid signs with the mechanism,
+ * or after generation returns a new value.
+ * Each header starts with a copy of the cached data, then prep adds the
+ * data that changes, such as timestamps.  Uses the prep prototype.
+ * Return 0 on success, or -1 on error with errno and context error set.
+ */
+
+/* generation (optional)
+ * Called before each signature, prior to prep_static and prep, if defined.
+ * Return a non-negative number that changes whenever prep_static would add
+ * different data, e.g. because the signer's certificate was replaced,
+ * invalidating the cached result.  This should be cheap.
+ * Return -1 on error with errno and context error set.
+ */
+typedef int (*sign_mech_generation_f)(flux_security_t *ctx, time_t now,
+                                      int flags);
 
 /* sign (required)
  * Sign input/inputsz (input != NULL, inputsz > 0), generating a
@@ -50,6 +80,17 @@ typedef int (*sign_mech_prep_f)(flux_security_t *ctx, struct kv *header,
 typedef char *(*sign_mech_sign_f)(flux_security_t *ctx,
                                   const char *input, int inputsz, int flags);
 
+/* sign_into (optional)
+ * Same as sign, but write the NULL-terminated signature to caller-supplied
+ * 'buf' of size 'bufsz'.  Like snprintf(3), return the signature length
+ * (excluding the terminating NUL).  If that is greater than or equal to
+ * 'bufsz', nothing is signed, so the caller may retry with a larger buffer.
+ * Return -1 on error with errno and context error set.
+ */
+typedef int (*sign_mech_sign_into_f)(flux_security_t *ctx,
+                                     const char *input, int inputsz,
+                                     char *buf, int bufsz, int flags);
+
 /* verify (required)
  * Verify null-terminated 'signature' (signature != NULL) over
  * input/inputsz (input != NULL, inputsz > 0).
@@ -60,14 +101,89 @@ typedef char *(*sign_mech_sign_f)(flux_security_t *ctx,
 typedef int (*sign_mech_verify_f)(flux_security_t *ctx,
                                   const struct kv *header,
 				  const char *input, int inputsz,
-				  const char *signature, int flags);
+				  const char *signature, time_t now, int flags);
+
+/* sign_digest, verify_digest (optional)
+ * Same as sign/verify, but given the SHA256 digest of HEADER.PAYLOAD
+ * (SHA256_BLOCK_SIZE bytes) rather than the text itself.  The signature
+ * must be identical to the one produced by sign over the same input.
+ * Mechanisms defining these may be used with the streaming interface.
+ */
+typedef char *(*sign_mech_sign_digest_f)(flux_security_t *ctx,
+                                         const uint8_t *digest, int flags);
+typedef int (*sign_mech_verify_digest_f)(flux_security_t *ctx,
+                                         const struct kv *header,
+                                         const uint8_t *digest,
+                                         const char *signature, time_t now,
+                                         int flags);
+
+/* expires (optional)
+ * Called immediately after 'header' has been successfully verified, if
+ * defined.  Return the time after which verification would fail on the
+ * basis of time alone, e.g. signature expiration, or (time_t)-1 if the
+ * result should not be cached.  Mechanisms that do not define this are
+ * never added to the verified signature cache.
+ */
+typedef time_t (*sign_mech_expires_f)(flux_security_t *ctx,
+                                      const struct kv *header);
+
+/* sign_many, verify_many (optional)
+ * Sign or verify every item of 'batch', for mechanisms where each
+ * operation has a latency that is better amortized over many, e.g. a
+ * request to a hardware security module.  Each item must be reported
+ * with sign_batch_complete(), possibly asynchronously (see sign_batch.h).
+ * flux_sign_wrap_batch() and flux_sign_unwrap_batch() call these when
+ * defined, instead of sign or verify once per item, which remain required
+ * for single operations.  Results of verify_many are not cached.
+ * 'flags' and 'now' are as for sign and verify.
+ * Return 0 if every item has been or will be completed, or -1 with errno
+ * and context error set if no item will be completed after returning,
+ * in which case the core fails any items not yet completed.
+ */
+typedef int (*sign_mech_sign_many_f)(flux_security_t *ctx,
+                                     struct sign_batch *batch, int flags);
+typedef int (*sign_mech_verify_many_f)(flux_security_t *ctx,
+                                       struct sign_batch *batch,
+                                       time_t now, int flags);
+
+/* stat_sign, stat_verify (optional)
+ * Statistics that sign.c records the time spent in sign and verify in,
+ * in FLUX_SECURITY_STATS mode.  Mechanisms may record finer grained
+ * phases themselves with security_stats_start/end().
+ */
+
+/* sign_parallel (optional)
+ * Set if sign waits on an external service, e.g. a munged round trip.
+ * Large batches are then signed by several threads, each with its own
+ * mechanism state, so that requests to the service overlap.  The signer's
+ * identity must not come from per-thread state that may differ between
+ * threads, since HEADER is prepared once by the calling thread.
+ */
+
+/* sig_max (required)
+ * Upper bound on the length of SIGNATURE (excluding NUL), used to report
+ * the size of flux_sign_wrap_into() output when it does not fit, without
+ * signing.
+ */
 
 struct sign_mech {
     const char *name;
+    enum security_stat stat_sign;
+    enum security_stat stat_verify;
+    bool sign_parallel;
+    int sig_max;
     sign_mech_init_f init;
+    sign_mech_generation_f generation;
+    sign_mech_prep_f prep_static;
     sign_mech_prep_f prep;
     sign_mech_sign_f sign;
+    sign_mech_sign_into_f sign_into;
     sign_mech_verify_f verify;
+    sign_mech_sign_digest_f sign_digest;
+    sign_mech_verify_digest_f verify_digest;
+    sign_mech_expires_f expires;
+    sign_mech_sign_many_f sign_many;
+    sign_mech_verify_many_f verify_many;
 };
 
 extern const struct sign_mech sign_mech_none;
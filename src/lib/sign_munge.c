@@ -23,10 +23,21 @@
 #include "context_private.h"
 #include "sign.h"
 #include "sign_mech.h"
+#include "sign_cache.h"
 
 struct sign_munge {
     munge_ctx_t munge;
     int64_t max_ttl;
+    struct sign_cache *creds;
+    time_t encode_time;     // of the cred last verified
+};
+
+/* Result of decoding a munge cred, cached by a digest of the cred text.
+ */
+struct munge_cred {
+    uid_t uid;
+    time_t encode_time;
+    uint8_t digest[SHA256_BLOCK_SIZE];
 };
 
 /* Single byte codes to indicate hash type used.
@@ -36,15 +47,55 @@ enum {
     HASH_TYPE_SHA256 = 1,
 };
 
+/* Upper bound on the length of a munge credential encoding the one byte
+ * hash type plus SHA256 digest, allowing for the largest cipher, MAC,
+ * and realm munged may be configured with.
+ */
+#define MUNGE_SIG_MAX 1024
+
 /* [sign.munge] table is optional since it contains
  * only optional keys at this point.
  */
 static const struct cf_option munge_opts[] = {
     {"socket-path",     CF_STRING,      false},
+    {"cred-cache-size", CF_INT64,       false},
     CF_OPTIONS_TABLE_END,
 };
 
-static const char *auxname = "flux::sign_munge";
+static struct security_aux_key auxkey = { .name = "flux::sign_munge" };
+
+/* Recreate munge state if any of these change on reconfiguration.
+ */
+static const char *const munge_deps[] = {
+    "sign.max-ttl",
+    "sign.munge",
+    NULL,
+};
+
+static const int default_cred_cache_size = 256;
+
+/* Count munge error 'e' in FLUX_SECURITY_STATS mode.
+ */
+static void count_error (flux_security_t *ctx, munge_err_t e)
+{
+    if (e >= EMUNGE_SNAFU && e <= EMUNGE_CRED_UNAUTHORIZED)
+        security_stats_count (ctx, STAT_MUNGE_ERROR_SNAFU + (e - EMUNGE_SNAFU));
+}
+
+/* Hash 'input' as HEADER.PAYLOAD for signing or verification.
+ */
+static void input_hash (flux_security_t *ctx, const char *input, int inputsz,
+                        BYTE *digest)
+{
+    uint64_t t = security_stats_start (ctx);
+    SHA256_CTX shx;
+
+    sha256_init (&shx);
+    sha256_update (&shx, (const BYTE *)input, inputsz);
+    sha256_final (&shx, digest);
+    security_stats_end (ctx, STAT_MUNGE_HASH, t);
+}
+static const int max_cred_cache_size = 1024*1024;
 
 static void sm_destroy (struct sign_munge *sm)
 {
@@ -52,6 +103,7 @@ static void sm_destroy (struct sign_munge *sm)
         int saved_errno = errno;
         if (sm->munge)
             munge_ctx_destroy (sm->munge);
+        sign_cache_destroy (sm->creds);
         free (sm);
         errno = saved_errno;
     }
@@ -59,9 +111,10 @@ static void sm_destroy (struct sign_munge *sm)
 
 static int op_init (flux_security_t *ctx, const cf_t *cf)
 {
-    struct sign_munge *sm = flux_security_aux_get (ctx, auxname);
+    struct sign_munge *sm = security_thread_aux_key_get (ctx, &auxkey);
     const cf_t *munge_config;
     const char *socket_path = NULL;
+    int64_t cache_size = default_cred_cache_size;
 
     if (sm != NULL)
         return 0;
@@ -69,9 +122,6 @@ static int op_init (flux_security_t *ctx, const cf_t *cf)
         goto error;
     if (!(sm->munge = munge_ctx_create ()))
         goto error;
-    if (flux_security_aux_set (ctx, auxname, sm,
-                               (flux_security_free_f)sm_destroy) < 0)
-        goto error;
     sm->max_ttl = cf_int64 (cf_get_in (cf, "max-ttl"));
     if ((munge_config = cf_get_in (cf, "munge"))) {
         struct cf_error cfe;
@@ -82,7 +132,19 @@ static int op_init (flux_security_t *ctx, const cf_t *cf)
         }
         if ((entry = cf_get_in (munge_config, "socket-path")))
             socket_path = cf_string (entry);
+        if ((entry = cf_get_in (munge_config, "cred-cache-size"))) {
+            cache_size = cf_int64 (entry);
+            if (cache_size < 0 || cache_size > max_cred_cache_size) {
+                errno = EINVAL;
+                security_error (ctx,
+                                "sign-munge-init: cred-cache-size must be 0-%d",
+                                max_cred_cache_size);
+                goto error_nomsg;
+            }
+        }
     }
+    if (cache_size > 0 && !(sm->creds = sign_cache_create (cache_size, free)))
+        goto error;
     if (socket_path) {
         munge_err_t e;
         e = munge_ctx_set (sm->munge, MUNGE_OPT_SOCKET, socket_path);
@@ -92,6 +154,13 @@ static int op_init (flux_security_t *ctx, const cf_t *cf)
             goto error_nomsg;
         }
     }
+    /* munge_ctx_t may not be shared between threads.
+     */
+    if (security_thread_aux_key_set (ctx, &auxkey, sm,
+                                     (flux_security_free_f)sm_destroy) < 0)
+        goto error;
+    if (security_aux_depends (ctx, auxkey.name, munge_deps) < 0)
+        return -1;
     return 0;
 error:
     security_error (ctx, NULL);
@@ -100,25 +169,25 @@ error_nomsg:
     return -1;
 }
 
-/* Compute hash over HEADER.PAYLOAD (input), then "sign" the hash,
- * producing a munge credential.
+/* "Sign" SHA256 'digest' of HEADER.PAYLOAD, producing a munge credential.
  * Reserve first byte of munge payload to indicate which hash algorithm.
  */
-static char *op_sign (flux_security_t *ctx,
-                      const char *input, int inputsz, int flags)
+static char *op_sign_digest (flux_security_t *ctx,
+                             const uint8_t *digest, int flags)
 {
-    struct sign_munge *sm = flux_security_aux_get (ctx, auxname);
-    BYTE digest[SHA256_BLOCK_SIZE + 1] = { HASH_TYPE_SHA256 };
-    SHA256_CTX shx;
+    struct sign_munge *sm = security_thread_aux_key_get (ctx, &auxkey);
+    BYTE buf[SHA256_BLOCK_SIZE + 1] = { HASH_TYPE_SHA256 };
     char *cred;
     munge_err_t e;
+    uint64_t t;
 
     assert (sm != NULL);
-    sha256_init (&shx);
-    sha256_update (&shx, (const BYTE *)input, inputsz);
-    sha256_final (&shx, digest + 1);
-    e = munge_encode (&cred, sm->munge, digest, sizeof (digest));
+    memcpy (buf + 1, digest, SHA256_BLOCK_SIZE);
+    t = security_stats_start (ctx);
+    e = munge_encode (&cred, sm->munge, buf, sizeof (buf));
+    security_stats_end (ctx, STAT_MUNGE_ENCODE, t);
     if (e != EMUNGE_SUCCESS) {
+        count_error (ctx, e);
         errno = EINVAL;
         security_error (ctx, "sign-munge-sign: %s",
                         munge_ctx_strerror (sm->munge));
@@ -127,30 +196,37 @@ static char *op_sign (flux_security_t *ctx,
     return cred;
 }
 
-/* Recompute hash over HEADER.PAYLOAD portion of input, then munge_decode
- * the SIGNATURE portion of input as a munge cred, and check:
- * - munge cred's payload matches the computed hash
- * - security header userid matches munge cred uid
- * - munge encode time plus configured max-ttl is not past.
+/* Compute hash over HEADER.PAYLOAD (input), then "sign" the hash.
  */
-static int op_verify (flux_security_t *ctx, const struct kv *header,
-                      const char *input, int inputsz,
-                      const char *signature, int flags)
+static char *op_sign (flux_security_t *ctx,
+                      const char *input, int inputsz, int flags)
+{
+    BYTE digest[SHA256_BLOCK_SIZE];
+
+    input_hash (ctx, input, inputsz, digest);
+    return op_sign_digest (ctx, digest, flags);
+}
+
+/* munge_decode 'signature' into 'cred'.  The cred's payload must be a
+ * SHA256 digest.  Replayed and expired creds are accepted, since the
+ * caller checks the encode time against max-ttl.
+ * Return 0 on success, -1 on failure with errno and context error set.
+ */
+static int cred_decode (flux_security_t *ctx, struct sign_munge *sm,
+                        const char *signature, struct munge_cred *cred)
 {
-    struct sign_munge *sm = flux_security_aux_get (ctx, auxname);
     munge_err_t e;
     char *indigest = NULL;
     int indigestsz = 0;
-    uid_t uid;
-    uint64_t userid;
-    time_t now;
-    time_t encode_time;
     int saved_errno;
+    uint64_t t;
 
-    assert (sm != NULL);
-
+    t = security_stats_start (ctx);
     e = munge_decode (signature, sm->munge, (void **)&indigest,
-                                                     &indigestsz, &uid, NULL);
+                                                &indigestsz, &cred->uid, NULL);
+    security_stats_end (ctx, STAT_MUNGE_DECODE, t);
+    if (e != EMUNGE_SUCCESS)
+        count_error (ctx, e);
     if (e != EMUNGE_SUCCESS && e != EMUNGE_CRED_REPLAYED
                             && e != EMUNGE_CRED_EXPIRED) {
         errno = EINVAL;
@@ -161,19 +237,12 @@ static int op_verify (flux_security_t *ctx, const struct kv *header,
 
     switch (indigestsz > 0 ? indigest[0] : HASH_TYPE_INVALID) {
         case HASH_TYPE_SHA256: {
-            BYTE refdigest[SHA256_BLOCK_SIZE + 1] = { HASH_TYPE_SHA256 };
-            SHA256_CTX shx;
-
-            sha256_init (&shx);
-            sha256_update (&shx, (const BYTE *)input, inputsz);
-            sha256_final (&shx, refdigest + 1);
-
-            if (indigestsz != sizeof (refdigest)
-                        || memcmp (refdigest, indigest, indigestsz) != 0) {
+            if (indigestsz != SHA256_BLOCK_SIZE + 1) {
                 errno = EINVAL;
                 security_error (ctx, "sign-munge-verify: SHA256 hash mismatch");
                 goto error;
             }
+            memcpy (cred->digest, indigest + 1, SHA256_BLOCK_SIZE);
             break;
         }
         default:
@@ -182,25 +251,13 @@ static int op_verify (flux_security_t *ctx, const struct kv *header,
             goto error;
     }
 
-    if (kv_get (header, "userid", KV_INT64, &userid) < 0 || userid != uid) {
-        errno = EINVAL;
-        security_error (ctx, "sign-munge-verify: uid mismatch");
-        goto error;
-    }
-    e = munge_ctx_get (sm->munge, MUNGE_OPT_ENCODE_TIME, &encode_time);
+    e = munge_ctx_get (sm->munge, MUNGE_OPT_ENCODE_TIME, &cred->encode_time);
     if (e != EMUNGE_SUCCESS) {
         errno = EINVAL;
         security_error (ctx, "sign-munge-verify: munge_ctx_get ENCODE_TIME: %s",
                         munge_ctx_strerror (sm->munge));
         goto error;
     }
-    if ((now = time (NULL)) == (time_t)-1)
-        goto error;
-    if (encode_time + sm->max_ttl < now) {
-        errno = EINVAL;
-        security_error (ctx, "sign-munge-verify: max-ttl exceeded");
-        goto error;
-    }
     free (indigest);
     return 0;
 error:
@@ -210,12 +267,124 @@ error:
     return -1;
 }
 
+/* Add decoded 'cred' to the cache under 'key', until the cred's TTL or
+ * max-ttl, whichever is sooner, has passed.
+ */
+static void cred_cache_insert (struct sign_munge *sm,
+                               const uint8_t *key,
+                               const struct munge_cred *cred)
+{
+    struct munge_cred *cpy;
+    time_t expires = cred->encode_time + sm->max_ttl;
+    int ttl;
+
+    if (munge_ctx_get (sm->munge, MUNGE_OPT_TTL, &ttl) == EMUNGE_SUCCESS
+        && cred->encode_time + ttl < expires)
+        expires = cred->encode_time + ttl;
+    if (!(cpy = malloc (sizeof (*cpy))))
+        return;
+    *cpy = *cred;
+    if (sign_cache_insert (sm->creds, key, expires, 0, cred->uid, cpy) < 0)
+        free (cpy);
+}
+
+/* Given SHA256 'digest' of HEADER.PAYLOAD, munge_decode 'signature'
+ * as a munge cred, and check:
+ * - munge cred's payload matches the computed hash
+ * - security header userid matches munge cred uid
+ * - munge encode time plus configured max-ttl is not past.
+ * Decoded creds are cached by a digest of 'signature', so that the same
+ * cred is decoded by munged once, even if it is verified repeatedly.
+ */
+static int op_verify_digest (flux_security_t *ctx, const struct kv *header,
+                             const uint8_t *digest,
+                             const char *signature, time_t now, int flags)
+{
+    struct sign_munge *sm = security_thread_aux_key_get (ctx, &auxkey);
+    struct munge_cred cred;
+    uint8_t key[SHA256_BLOCK_SIZE];
+    uint64_t userid;
+    void *data;
+
+    assert (sm != NULL);
+
+    if (sm->creds) {
+        SHA256_CTX shx;
+
+        sha256_init (&shx);
+        sha256_update (&shx, (const BYTE *)signature, strlen (signature));
+        sha256_final (&shx, key);
+    }
+    if (sm->creds
+        && sign_cache_lookup (sm->creds, key, now, NULL, NULL, &data) == 0) {
+        security_stats_count (ctx, STAT_MUNGE_CRED_CACHE_HIT);
+        cred = *(struct munge_cred *)data;
+    }
+    else {
+        if (sm->creds)
+            security_stats_count (ctx, STAT_MUNGE_CRED_CACHE_MISS);
+        if (cred_decode (ctx, sm, signature, &cred) < 0)
+            return -1;
+        if (sm->creds)
+            cred_cache_insert (sm, key, &cred);
+    }
+    if (memcmp (digest, cred.digest, SHA256_BLOCK_SIZE) != 0) {
+        errno = EINVAL;
+        security_error (ctx, "sign-munge-verify: SHA256 hash mismatch");
+        return -1;
+    }
+    if (kv_get (header, "userid", KV_INT64, &userid) < 0
+        || userid != cred.uid) {
+        errno = EINVAL;
+        security_error (ctx, "sign-munge-verify: uid mismatch");
+        return -1;
+    }
+    if (cred.encode_time + sm->max_ttl < now) {
+        errno = EINVAL;
+        security_error (ctx, "sign-munge-verify: max-ttl exceeded");
+        return -1;
+    }
+    sm->encode_time = cred.encode_time;
+    return 0;
+}
+
+/* Recompute hash over HEADER.PAYLOAD portion of input, then verify
+ * the munge cred as above.
+ */
+static int op_verify (flux_security_t *ctx, const struct kv *header,
+                      const char *input, int inputsz,
+                      const char *signature, time_t now, int flags)
+{
+    BYTE digest[SHA256_BLOCK_SIZE];
+
+    input_hash (ctx, input, inputsz, digest);
+    return op_verify_digest (ctx, header, digest, signature, now, flags);
+}
+
+/* Return munge encode time of the cred just verified, plus max-ttl.
+ */
+static time_t op_expires (flux_security_t *ctx, const struct kv *header)
+{
+    struct sign_munge *sm = security_thread_aux_key_get (ctx, &auxkey);
+
+    assert (sm != NULL);
+
+    return sm->encode_time + sm->max_ttl;
+}
+
 const struct sign_mech sign_mech_munge = {
     .name = "munge",
+    .stat_sign = STAT_MUNGE_SIGN,
+    .stat_verify = STAT_MUNGE_VERIFY,
+    .sign_parallel = true,
+    .sig_max = MUNGE_SIG_MAX,
     .init = op_init,
     .prep = NULL,
     .sign = op_sign,
     .verify = op_verify,
+    .sign_digest = op_sign_digest,
+    .verify_digest = op_verify_digest,
+    .expires = op_expires,
 };
 
 /*
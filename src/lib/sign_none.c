@@ -36,7 +36,7 @@ static char *op_sign (flux_security_t *ctx,
 
 static int op_verify (flux_security_t *ctx, const struct kv *header,
                       const char *input, int inputsz,
-                      const char *signature, int flags)
+                      const char *signature, time_t now, int flags)
 {
     int64_t userid;
     int64_t real_userid = getuid ();
@@ -56,12 +56,63 @@ static int op_verify (flux_security_t *ctx, const struct kv *header,
     return 0;
 }
 
+static char *op_sign_digest (flux_security_t *ctx,
+                             const uint8_t *digest, int flags)
+{
+    return op_sign (ctx, NULL, 0, flags);
+}
+
+static int op_verify_digest (flux_security_t *ctx, const struct kv *header,
+                             const uint8_t *digest,
+                             const char *signature, time_t now, int flags)
+{
+    return op_verify (ctx, header, NULL, 0, signature, now, flags);
+}
+
+/* The batch callbacks complete each item before returning, but use the
+ * same interface as mechanisms that complete asynchronously.
+ */
+static int op_sign_many (flux_security_t *ctx, struct sign_batch *batch,
+                         int flags)
+{
+    int i;
+
+    for (i = 0; i < sign_batch_count (batch); i++) {
+        char *sig = strdup ("none");
+        sign_batch_complete (batch, i, sig, sig ? 0 : ENOMEM, NULL);
+    }
+    return 0;
+}
+
+static int op_verify_many (flux_security_t *ctx, struct sign_batch *batch,
+                           time_t now, int flags)
+{
+    int i;
+
+    for (i = 0; i < sign_batch_count (batch); i++) {
+        if (op_verify (ctx, sign_batch_header (batch, i), NULL, 0,
+                       sign_batch_signature (batch, i), now, flags) < 0)
+            sign_batch_complete (batch, i, NULL, errno,
+                                 flux_security_last_error (ctx));
+        else
+            sign_batch_complete (batch, i, NULL, 0, NULL);
+    }
+    return 0;
+}
+
 const struct sign_mech sign_mech_none = {
     .name = "none",
+    .stat_sign = STAT_NONE_SIGN,
+    .stat_verify = STAT_NONE_VERIFY,
+    .sig_max = 4,
     .init = NULL,
     .prep = NULL,
     .sign = op_sign,
     .verify = op_verify,
+    .sign_digest = op_sign_digest,
+    .verify_digest = op_verify_digest,
+    .sign_many = op_sign_many,
+    .verify_many = op_verify_many,
 };
 
 /*
@@ -0,0 +1,661 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* bench.c - time flux_sign_wrap/unwrap across mechanisms and payload sizes
+ *
+ * Usage: bench_sign [-j] [-n iterations] [-c contexts] [-m mech,mech,...]
+ *                   [-s size,size,...] [-t threads,threads,...]
+ *
+ * For each mechanism (default none,munge,curve,curve-ca), payload size
+ * in bytes (default 64,1024,65536,1048576,10485760), and thread count
+ * (default 1,2,4,8), each thread wraps and then unwraps a payload
+ * 'iterations' times (default 1000, reduced for large payloads so that
+ * each thread moves at most 256MB).  Wrap and unwrap are reported as
+ * aggregate ops/sec over all threads and latency percentiles.  With -j,
+ * results are printed as one JSON object per line.
+ *
+ * First, as a memory usage report, 'contexts' contexts (default 1000,
+ * 0 to skip) are created for each mechanism, as a service with one context
+ * per tenant would, and each wraps and unwraps one payload so mechanism
+ * state is initialized.  The growth in resident set size is reported
+ * per context.
+ *
+ * curve-ca signs with a cert issued by a CA generated in a temporary
+ * directory.  curve verifies against the signer's ~/.flux/curve/sig.pub
+ * and munge requires a running munged; each is skipped if unavailable.
+ *
+ * Run with 'make bench', passing options with BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pwd.h>
+#include <pthread.h>
+
+#include "src/libutil/cf.h"
+#include "src/libca/sigcert.h"
+#include "src/libca/ca.h"
+#include "src/lib/context.h"
+#include "src/lib/sign.h"
+
+#define MAX_BYTES_PER_THREAD (256*1024*1024)
+
+const char *prog = "bench_sign";
+
+const char *ca_conf_tmpl = \
+"max-cert-ttl = 3600\n" \
+"max-sign-ttl = 3600\n" \
+"cert-path = \"%s/ca-cert\"\n" \
+"revoke-dir = \"%s/revoke.d\"\n" \
+"revoke-allow = true\n" \
+"domain = \"FLUX.BENCH\"\n";
+
+static char tmpdir[PATH_MAX + 1];
+static bool json;
+
+struct timer {
+    double *samples;    // nanoseconds
+    int count;
+    struct timespec t0;
+};
+
+struct worker {
+    pthread_t t;
+    flux_security_t *ctx;
+    const char *mech;
+    const char *payload;
+    int size;
+    int iter;
+    struct timer wrap;
+    struct timer unwrap;
+    char error[200];    // copied, since thread state is freed on exit
+};
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: bench_sign [-j] [-n iterations] [-c contexts]"
+                     " [-m mech,...] [-s size,...] [-t threads,...]\n");
+    exit (1);
+}
+
+static void timer_init (struct timer *t, int n)
+{
+    if (n < 1 || !(t->samples = calloc (n, sizeof (t->samples[0]))))
+        die ("out of memory");
+    t->count = 0;
+}
+
+static void timer_start (struct timer *t)
+{
+    clock_gettime (CLOCK_MONOTONIC, &t->t0);
+}
+
+static void timer_stop (struct timer *t)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t->samples[t->count++] = (t1.tv_sec - t->t0.tv_sec) * 1E9
+                           + (t1.tv_nsec - t->t0.tv_nsec);
+}
+
+/* Append samples of 't2' to 't', freeing 't2' samples.
+ * 't' must have room for them.
+ */
+static void timer_merge (struct timer *t, struct timer *t2)
+{
+    memcpy (t->samples + t->count, t2->samples,
+            t2->count * sizeof (t->samples[0]));
+    t->count += t2->count;
+    free (t2->samples);
+    t2->samples = NULL;
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile (const struct timer *t, int p)
+{
+    return t->samples[(t->count - 1) * p / 100] / 1E3;
+}
+
+/* Print one line of results and free the samples.  Since threads run
+ * concurrently, ops/sec is the sum over threads of each thread's rate.
+ */
+static void timer_report (struct timer *t,
+                          const char *op,
+                          const char *mech,
+                          int size,
+                          int threads)
+{
+    double total = 0;
+    double rate;
+    int i;
+
+    for (i = 0; i < t->count; i++)
+        total += t->samples[i];
+    rate = total > 0 ? (double)t->count * threads / (total / 1E9) : 0;
+    qsort (t->samples, t->count, sizeof (t->samples[0]), sample_cmp);
+    if (json) {
+        printf ("{\"op\":\"%s\",\"mech\":\"%s\",\"size\":%d,\"threads\":%d,"
+                "\"count\":%d,\"ops_per_sec\":%.1f,\"p50_us\":%.1f,"
+                "\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+                op, mech, size, threads, t->count, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    }
+    else {
+        char name[64];
+
+        (void)snprintf (name, sizeof (name), "%s %s %dB x%d",
+                        op, mech, size, threads);
+        printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+                name, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    }
+    fflush (stdout);
+    free (t->samples);
+    t->samples = NULL;
+}
+
+static void write_file (const char *path, const char *fmt, ...)
+{
+    va_list ap;
+    FILE *f;
+
+    if (!(f = fopen (path, "w")))
+        die ("%s: %s", path, strerror (errno));
+    va_start (ap, fmt);
+    (void)vfprintf (f, fmt, ap);
+    va_end (ap);
+    if (fclose (f) != 0)
+        die ("%s: %s", path, strerror (errno));
+}
+
+static void rmpath (const char *fmt, ...)
+{
+    va_list ap;
+    char path[PATH_MAX + 1];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (path, sizeof (path), fmt, ap);
+    va_end (ap);
+    if (unlink (path) < 0 && rmdir (path) < 0 && errno != ENOENT)
+        die ("%s: %s", path, strerror (errno));
+}
+
+/* Generate a CA and a cert for the current user signed by it, in tmpdir.
+ */
+static void ca_setup (void)
+{
+    char conf[2 * PATH_MAX + 256];
+    char path[PATH_MAX + 64];
+    struct cf_error error;
+    cf_t *cf;
+    struct ca *ca;
+    struct sigcert *cert;
+    ca_error_t e;
+
+    if (snprintf (conf, sizeof (conf), ca_conf_tmpl,
+                  tmpdir, tmpdir) >= (int)sizeof (conf))
+        die ("conf buffer overflow");
+    snprintf (path, sizeof (path), "%s/revoke.d", tmpdir);
+    if (mkdir (path, 0755) < 0)
+        die ("mkdir %s: %s", path, strerror (errno));
+    if (!(cf = cf_create ()))
+        die ("cf_create: %s", strerror (errno));
+    if (cf_update (cf, conf, strlen (conf), &error) < 0)
+        die ("cf_update: %s", error.errbuf);
+    if (!(ca = ca_create (cf, e))
+        || ca_keygen (ca, 0, 0, e) < 0
+        || ca_store (ca, e) < 0)
+        die ("ca: %s", e);
+    if (!(cert = sigcert_create ()))
+        die ("sigcert_create: %s", strerror (errno));
+    if (ca_sign (ca, cert, 0, 0, getuid (), e) < 0)
+        die ("ca_sign: %s", e);
+    snprintf (path, sizeof (path), "%s/cert", tmpdir);
+    if (sigcert_store (cert, path) < 0)
+        die ("sigcert_store: %s", strerror (errno));
+    sigcert_destroy (cert);
+    ca_destroy (ca);
+    cf_destroy (cf);
+}
+
+static void ca_cleanup (void)
+{
+    rmpath ("%s/cert", tmpdir);
+    rmpath ("%s/cert.pub", tmpdir);
+    rmpath ("%s/ca-cert", tmpdir);
+    rmpath ("%s/ca-cert.pub", tmpdir);
+    rmpath ("%s/revoke.d", tmpdir);
+}
+
+static bool home_cert_exists (void)
+{
+    struct passwd *pw;
+    char path[PATH_MAX + 1];
+
+    if (!(pw = getpwuid (getuid ()))
+        || snprintf (path, sizeof (path), "%s/.flux/curve/sig.pub",
+                     pw->pw_dir) >= (int)sizeof (path))
+        return false;
+    return access (path, R_OK) == 0;
+}
+
+/* Write the config for 'mech'.
+ * Return false if the mechanism is unavailable here.
+ */
+static bool config_write (const char *mech)
+{
+    char path[PATH_MAX + 64];
+
+    snprintf (path, sizeof (path), "%s/sign.toml", tmpdir);
+    if (!strcmp (mech, "curve-ca")) {
+        char ca_conf[2 * PATH_MAX + 256];
+
+        (void)snprintf (ca_conf, sizeof (ca_conf), ca_conf_tmpl,
+                        tmpdir, tmpdir);
+        write_file (path,
+                    "[sign]\nmax-ttl = 3600\n"
+                    "default-type = \"curve\"\nallowed-types = [\"curve\"]\n"
+                    "[sign.curve]\nrequire-ca = true\n"
+                    "cert-path = \"%s/cert\"\n"
+                    "[ca]\n%s",
+                    tmpdir, ca_conf);
+    }
+    else if (!strcmp (mech, "curve")) {
+        if (!home_cert_exists ()) {
+            fprintf (stderr, "%s: skipping curve: no ~/.flux/curve/sig.pub\n",
+                     prog);
+            return false;
+        }
+        write_file (path,
+                    "[sign]\nmax-ttl = 3600\n"
+                    "default-type = \"curve\"\nallowed-types = [\"curve\"]\n"
+                    "[sign.curve]\nrequire-ca = false\n");
+    }
+    else
+        write_file (path,
+                    "[sign]\nmax-ttl = 3600\n"
+                    "default-type = \"%s\"\nallowed-types = [\"%s\"]\n",
+                    mech, mech);
+    return true;
+}
+
+/* Create a context using the config written by config_write().
+ */
+static flux_security_t *context_create (void)
+{
+    char path[PATH_MAX + 64];
+    flux_security_t *ctx;
+
+    snprintf (path, sizeof (path), "%s/sign.toml", tmpdir);
+    if (!(ctx = flux_security_create (FLUX_SECURITY_THREADSAFE)))
+        die ("flux_security_create: %s", strerror (errno));
+    if (flux_security_configure (ctx, path) < 0)
+        die ("flux_security_configure: %s", flux_security_last_error (ctx));
+    return ctx;
+}
+
+static const char *mech_type (const char *mech)
+{
+    return !strncmp (mech, "curve", 5) ? "curve" : mech;
+}
+
+static void worker_error (struct worker *w)
+{
+    const char *s = flux_security_last_error (w->ctx);
+
+    snprintf (w->error, sizeof (w->error), "%s", s ? s : "unknown error");
+}
+
+static void *worker_thread (void *arg)
+{
+    struct worker *w = arg;
+    char *buf;
+    void *out;
+    int bufsz;
+    int len;
+    int64_t userid;
+    int i;
+
+    /* Size the output buffer with an untimed size query, which reports
+     * an upper bound on the signature length, e.g. of a munge credential.
+     */
+    if ((bufsz = flux_sign_wrap_into (w->ctx, w->payload, w->size,
+                                      mech_type (w->mech), 0, NULL, 0)) < 0
+        || !(buf = malloc (++bufsz))
+        || !(out = malloc (w->size > 0 ? w->size : 1))) {
+        worker_error (w);
+        return NULL;
+    }
+    for (i = 0; i < w->iter; i++) {
+        timer_start (&w->wrap);
+        len = flux_sign_wrap_into (w->ctx, w->payload, w->size,
+                                   mech_type (w->mech), 0, buf, bufsz);
+        timer_stop (&w->wrap);
+        if (len < 0 || len >= bufsz) {
+            worker_error (w);
+            break;
+        }
+        timer_start (&w->unwrap);
+        len = flux_sign_unwrap_into (w->ctx, buf, out, w->size, &userid, 0);
+        timer_stop (&w->unwrap);
+        if (len != w->size) {
+            worker_error (w);
+            break;
+        }
+    }
+    free (out);
+    free (buf);
+    return NULL;
+}
+
+/* Run wrap/unwrap of 'size' byte payloads in 'threads' threads.
+ * Return false if the mechanism failed, e.g. munged is not running.
+ */
+static bool bench_sign (flux_security_t *ctx,
+                        const char *mech,
+                        const char *payload,
+                        int size,
+                        int threads,
+                        int n)
+{
+    struct worker *w;
+    struct timer wrap;
+    struct timer unwrap;
+    const char *error = NULL;
+    int iter = n;
+    int i;
+
+    if (size > 0 && (long)size * iter > MAX_BYTES_PER_THREAD)
+        iter = MAX_BYTES_PER_THREAD / size > 10
+               ? MAX_BYTES_PER_THREAD / size : 10;
+    if (!(w = calloc (threads, sizeof (w[0]))))
+        die ("out of memory");
+    for (i = 0; i < threads; i++) {
+        w[i].ctx = ctx;
+        w[i].mech = mech;
+        w[i].payload = payload;
+        w[i].size = size;
+        w[i].iter = iter;
+        timer_init (&w[i].wrap, iter);
+        timer_init (&w[i].unwrap, iter);
+        if ((errno = pthread_create (&w[i].t, NULL, worker_thread, &w[i])))
+            die ("pthread_create: %s", strerror (errno));
+    }
+    timer_init (&wrap, iter * threads);
+    timer_init (&unwrap, iter * threads);
+    for (i = 0; i < threads; i++) {
+        if ((errno = pthread_join (w[i].t, NULL)))
+            die ("pthread_join: %s", strerror (errno));
+        if (*w[i].error && !error)
+            error = w[i].error;
+        timer_merge (&wrap, &w[i].wrap);
+        timer_merge (&unwrap, &w[i].unwrap);
+    }
+    if (error) {
+        fprintf (stderr, "%s: skipping %s: %s\n", prog, mech, error);
+        free (w);
+        free (wrap.samples);
+        free (unwrap.samples);
+        return false;
+    }
+    free (w);
+    timer_report (&wrap, "wrap", mech, size, threads);
+    timer_report (&unwrap, "unwrap", mech, size, threads);
+    return true;
+}
+
+/* Return the resident set size of this process in bytes.
+ */
+static long rss_bytes (void)
+{
+    FILE *f;
+    long size;
+    long resident;
+
+    if (!(f = fopen ("/proc/self/statm", "r")))
+        die ("/proc/self/statm: %s", strerror (errno));
+    if (fscanf (f, "%ld %ld", &size, &resident) != 2)
+        die ("/proc/self/statm: parse error");
+    fclose (f);
+    return resident * sysconf (_SC_PAGESIZE);
+}
+
+/* Create 'count' contexts for 'mech', each of which wraps and unwraps a
+ * small payload, and report the growth in resident set size per context.
+ * Return false if the mechanism failed, e.g. munged is not running.
+ */
+static bool bench_memory (const char *mech, int count)
+{
+    flux_security_t **ctxs;
+    const char *error = NULL;
+    long rss;
+    long grown;
+    int i;
+
+    if (!(ctxs = calloc (count, sizeof (ctxs[0]))))
+        die ("out of memory");
+    rss = rss_bytes ();
+    for (i = 0; i < count && !error; i++) {
+        const char *s;
+        const void *out;
+        int outsz;
+        int64_t userid;
+
+        ctxs[i] = context_create ();
+        if (!(s = flux_sign_wrap (ctxs[i], "bench", 5, mech_type (mech), 0))
+            || flux_sign_unwrap (ctxs[i], s, &out, &outsz, &userid, 0) < 0)
+            error = flux_security_last_error (ctxs[i]);
+    }
+    grown = rss_bytes () - rss;
+    if (error) {
+        fprintf (stderr, "%s: skipping %s: %s\n", prog, mech, error);
+        count = i;
+    }
+    else if (json) {
+        printf ("{\"op\":\"memory\",\"mech\":\"%s\",\"contexts\":%d,"
+                "\"rss_bytes\":%ld,\"bytes_per_context\":%.0f}\n",
+                mech, count, grown, (double)grown / count);
+    }
+    else {
+        char name[64];
+
+        (void)snprintf (name, sizeof (name), "memory %s x%d", mech, count);
+        printf ("%-32s %12ld %12.0f\n", name, grown, (double)grown / count);
+    }
+    fflush (stdout);
+    for (i = 0; i < count; i++)
+        flux_security_destroy (ctxs[i]);
+    free (ctxs);
+    return error == NULL;
+}
+
+static int *parse_list (const char *s, int *count)
+{
+    char *cpy;
+    char *tok;
+    char *saveptr = NULL;
+    int *list = NULL;
+    int n = 0;
+
+    if (!(cpy = strdup (s)))
+        die ("out of memory");
+    for (tok = strtok_r (cpy, ",", &saveptr); tok != NULL;
+         tok = strtok_r (NULL, ",", &saveptr)) {
+        if (!(list = realloc (list, (n + 1) * sizeof (list[0]))))
+            die ("out of memory");
+        list[n++] = strtol (tok, NULL, 10);
+    }
+    free (cpy);
+    *count = n;
+    return list;
+}
+
+int main (int argc, char *argv[])
+{
+    const char *t = getenv ("TMPDIR");
+    const char *mechs = "none,munge,curve,curve-ca";
+    const char *sizes_arg = "64,1024,65536,1048576,10485760";
+    const char *threads_arg = "1,2,4,8";
+    int *sizes;
+    int *threads;
+    int nsizes;
+    int nthreads;
+    int maxsize = 0;
+    char *payload;
+    char *cpy;
+    char *mech;
+    char *saveptr = NULL;
+    int n = 1000;
+    int contexts = 1000;
+    int c;
+    int i;
+    int j;
+
+    while ((c = getopt (argc, argv, "jn:c:m:s:t:")) != -1) {
+        switch (c) {
+            case 'j':
+                json = true;
+                break;
+            case 'n':
+                if ((n = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'c':
+                if ((contexts = strtol (optarg, NULL, 10)) < 0)
+                    usage ();
+                break;
+            case 'm':
+                mechs = optarg;
+                break;
+            case 's':
+                sizes_arg = optarg;
+                break;
+            case 't':
+                threads_arg = optarg;
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc)
+        usage ();
+    sizes = parse_list (sizes_arg, &nsizes);
+    threads = parse_list (threads_arg, &nthreads);
+    for (i = 0; i < nsizes; i++) {
+        if (sizes[i] < 0)
+            usage ();
+        if (sizes[i] > maxsize)
+            maxsize = sizes[i];
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (threads[i] < 1)
+            usage ();
+    }
+    if (!(payload = malloc (maxsize + 1)))
+        die ("out of memory");
+    for (i = 0; i < maxsize; i++)
+        payload[i] = (char)(i * 31 + 7);
+
+    if (snprintf (tmpdir, sizeof (tmpdir), "%s/bench-sign-XXXXXX",
+                  t ? t : "/tmp") >= (int)sizeof (tmpdir))
+        die ("tmpdir buffer overflow");
+    if (!mkdtemp (tmpdir))
+        die ("mkdtemp: %s", strerror (errno));
+    ca_setup ();
+
+    /* Measure memory first, before the timing runs grow the heap.
+     */
+    if (contexts > 0) {
+        if (!json)
+            printf ("%-32s %12s %12s\n",
+                    "operation", "rss(bytes)", "bytes/ctx");
+        if (!(cpy = strdup (mechs)))
+            die ("out of memory");
+        for (mech = strtok_r (cpy, ",", &saveptr); mech != NULL;
+             mech = strtok_r (NULL, ",", &saveptr)) {
+            if (config_write (mech))
+                (void)bench_memory (mech, contexts);
+        }
+        free (cpy);
+        saveptr = NULL;
+    }
+
+    if (!json)
+        printf ("%-32s %10s %9s %9s %9s %9s\n",
+                "operation", "ops/sec",
+                "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    if (!(cpy = strdup (mechs)))
+        die ("out of memory");
+    for (mech = strtok_r (cpy, ",", &saveptr); mech != NULL;
+         mech = strtok_r (NULL, ",", &saveptr)) {
+        flux_security_t *ctx;
+        bool ok = true;
+
+        if (!config_write (mech))
+            continue;
+        ctx = context_create ();
+        for (i = 0; i < nsizes && ok; i++) {
+            for (j = 0; j < nthreads && ok; j++)
+                ok = bench_sign (ctx, mech, payload, sizes[i], threads[j], n);
+        }
+        flux_security_destroy (ctx);
+    }
+    free (cpy);
+
+    ca_cleanup ();
+    rmpath ("%s/sign.toml", tmpdir);
+    rmpath ("%s", tmpdir);
+    free (payload);
+    free (threads);
+    free (sizes);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
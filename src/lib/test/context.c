@@ -12,7 +12,9 @@
 #include "config.h"
 #endif
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/param.h>
 
 #include "src/libtap/tap.h"
@@ -121,6 +123,97 @@ void test_set_config (void)
     flux_security_destroy (ctx);
 }
 
+static void set_config_str (flux_security_t *ctx, const char *s)
+{
+    cf_t *cf;
+
+    if (!(cf = cf_create ())
+        || cf_update (cf, s, strlen (s), NULL) < 0
+        || security_set_config (ctx, cf) < 0)
+        BAIL_OUT ("failed to set config");
+    cf_destroy (cf);
+}
+
+void test_reconfig (void)
+{
+    flux_security_t *ctx;
+    static const char *const tab_deps[] = { "tab.a", NULL };
+    static const char *const top_deps[] = { "top", NULL };
+    int x, y, z;
+
+    if (!(ctx = flux_security_create (0)))
+        BAIL_OUT ("flux_security_create failed");
+    set_config_str (ctx, "top = 1\n[tab]\na = 1\nb = 1\n");
+    if (flux_security_aux_set (ctx, "x", &x, NULL) < 0
+        || security_thread_aux_set (ctx, "y", &y, NULL) < 0
+        || flux_security_aux_set (ctx, "z", &z, NULL) < 0)
+        BAIL_OUT ("flux_security_aux_set failed");
+    ok (security_aux_depends (ctx, "x", tab_deps) == 0
+        && security_aux_depends (ctx, "y", top_deps) == 0,
+        "security_aux_depends works");
+
+    set_config_str (ctx, "top = 1\n[tab]\na = 1\nb = 2\n");
+    ok (flux_security_aux_get (ctx, "x") == &x
+        && flux_security_aux_get (ctx, "y") == &y,
+        "items are kept when only other keys change");
+
+    set_config_str (ctx, "top = 1\n[tab]\na = 2\nb = 2\n");
+    ok (flux_security_aux_get (ctx, "x") == NULL,
+        "item is deleted when a nested key it depends on changes");
+    ok (flux_security_aux_get (ctx, "y") == &y,
+        "item with other dependencies is kept");
+
+    set_config_str (ctx, "[tab]\na = 2\nb = 2\n");
+    ok (flux_security_aux_get (ctx, "y") == NULL,
+        "item is deleted when a key it depends on is removed");
+    ok (flux_security_aux_get (ctx, "z") == &z,
+        "item without dependencies is kept");
+
+    errno = 0;
+    ok (security_aux_depends (ctx, NULL, top_deps) < 0 && errno == EINVAL,
+        "security_aux_depends name=NULL fails with EINVAL");
+    errno = 0;
+    ok (security_aux_depends (ctx, "x", NULL) < 0 && errno == EINVAL,
+        "security_aux_depends keys=NULL fails with EINVAL");
+
+    flux_security_destroy (ctx);
+}
+
+void test_shared_config (void)
+{
+    flux_security_t *ctx1;
+    flux_security_t *ctx2;
+    char pattern[PATH_MAX + 1];
+    const cf_t *cf;
+
+    if (snprintf (pattern, sizeof (pattern), "%s/*.toml", tmpdir)
+        >= (int)sizeof (pattern))
+        BAIL_OUT ("pattern buffer overflow");
+    if (!(ctx1 = flux_security_create (0))
+        || !(ctx2 = flux_security_create (0)))
+        BAIL_OUT ("flux_security_create failed");
+    ok (flux_security_configure (ctx1, pattern) == 0
+        && flux_security_configure (ctx2, pattern) == 0,
+        "two contexts are configured with the same pattern");
+    ok (security_get_config (ctx1, NULL) == security_get_config (ctx2, NULL),
+        "they share one copy of the config");
+
+    set_config_str (ctx2, "foo = 43\n");
+    cf = security_get_config (ctx2, "foo");
+    ok (security_get_config (ctx1, NULL) != security_get_config (ctx2, NULL)
+        && cf != NULL && cf_int64 (cf) == 43,
+        "reconfiguring one context gives it its own config");
+    cf = security_get_config (ctx1, "foo");
+    ok (cf != NULL && cf_int64 (cf) == 42,
+        "the other context keeps the shared config");
+
+    flux_security_destroy (ctx1);
+    cf = security_get_config (ctx2, "foo");
+    ok (cf != NULL && cf_int64 (cf) == 43,
+        "config is valid after another context is destroyed");
+    flux_security_destroy (ctx2);
+}
+
 void test_error (void)
 {
     flux_security_t *ctx;
@@ -202,6 +295,117 @@ void test_aux (void)
         "flux_security_destroy called aux destructor for each item");
 }
 
+#define NTHREADS 8
+
+struct thread_arg {
+    pthread_t t;
+    flux_security_t *ctx;
+    int id;
+    int errors;
+};
+
+static void *thread_error (void *arg)
+{
+    struct thread_arg *a = arg;
+    char buf[64];
+    char key[64];
+    const char *s;
+    int i;
+
+    snprintf (key, sizeof (key), "thread-%d", a->id);
+    if (flux_security_aux_get (a->ctx, key) != a)
+        a->errors++;
+    for (i = 0; i < 1000; i++) {
+        snprintf (buf, sizeof (buf), "error-%d-%d", a->id, i);
+        errno = a->id + 1;
+        security_error (a->ctx, "%s", buf);
+        if (!(s = flux_security_last_error (a->ctx)) || strcmp (s, buf) != 0
+            || flux_security_last_errnum (a->ctx) != a->id + 1)
+            a->errors++;
+        if (security_thread_aux_get (a->ctx, key) != NULL)
+            a->errors++;
+    }
+    if (security_thread_aux_set (a->ctx, key, a, NULL) < 0
+        || security_thread_aux_get (a->ctx, key) != a)
+        a->errors++;
+    return NULL;
+}
+
+static int thread_aux_freed;
+
+static void thread_aux_free (void *arg)
+{
+    __atomic_fetch_add (&thread_aux_freed, 1, __ATOMIC_RELAXED);
+}
+
+static void *thread_aux (void *arg)
+{
+    flux_security_t *ctx = arg;
+
+    if (security_thread_aux_set (ctx, "foo", ctx, thread_aux_free) < 0)
+        return arg;
+    return NULL;
+}
+
+void test_threadsafe (void)
+{
+    flux_security_t *ctx;
+    struct thread_arg a[NTHREADS];
+    char key[64];
+    int errors;
+    int i;
+
+    ctx = flux_security_create (FLUX_SECURITY_THREADSAFE);
+    ok (ctx != NULL,
+        "flux_security_create FLUX_SECURITY_THREADSAFE works");
+    if (!ctx)
+        BAIL_OUT ("flux_security_create failed");
+    for (i = 0; i < NTHREADS; i++) {
+        a[i].ctx = ctx;
+        a[i].id = i;
+        a[i].errors = 0;
+        snprintf (key, sizeof (key), "thread-%d", i);
+        if (flux_security_aux_set (ctx, key, &a[i], NULL) < 0)
+            BAIL_OUT ("flux_security_aux_set failed");
+    }
+    errno = 99999;
+    security_error (ctx, "main-error");
+    for (i = 0; i < NTHREADS; i++) {
+        if (pthread_create (&a[i].t, NULL, thread_error, &a[i]) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    errors = 0;
+    for (i = 0; i < NTHREADS; i++) {
+        if (pthread_join (a[i].t, NULL) != 0)
+            BAIL_OUT ("pthread_join failed");
+        errors += a[i].errors;
+    }
+    ok (errors == 0,
+        "%d threads have private error state and thread aux", NTHREADS);
+    ok (flux_security_last_errnum (ctx) == 99999
+        && !strcmp (flux_security_last_error (ctx), "main-error"),
+        "main thread error state was not disturbed");
+    ok (security_thread_aux_get (ctx, "thread-0") == NULL,
+        "main thread does not see other threads' thread aux");
+
+    for (i = 0; i < NTHREADS; i++) {
+        void *rc;
+        if (pthread_create (&a[i].t, NULL, thread_aux, ctx) != 0
+            || pthread_join (a[i].t, &rc) != 0 || rc != NULL)
+            BAIL_OUT ("thread_aux failed");
+    }
+    ok (__atomic_load_n (&thread_aux_freed, __ATOMIC_RELAXED) == NTHREADS,
+        "state of exited threads is destroyed without security_thread_exit");
+    flux_security_destroy (ctx);
+
+    if (!(ctx = flux_security_create (0)))
+        BAIL_OUT ("flux_security_create failed");
+    ok (security_thread_aux_set (ctx, "foo", ctx, NULL) == 0
+        && flux_security_aux_get (ctx, "foo") == ctx,
+        "security_thread_aux_set is shared aux without THREADSAFE");
+    flux_security_destroy (ctx);
+}
+
 void test_corner (void)
 {
     flux_security_t *ctx;
@@ -210,7 +414,7 @@ void test_corner (void)
         BAIL_OUT ("flux_security_create failed");
 
     errno = 0;
-    ok (flux_security_create (1) == NULL && errno == EINVAL,
+    ok (flux_security_create (0x100) == NULL && errno == EINVAL,
         "flux_security_create with unknown flag fails with EINVAL");
 
     errno = 0;
@@ -259,6 +463,159 @@ void test_corner (void)
 
 }
 
+static void *stats_thread (void *arg)
+{
+    flux_security_t *ctx = arg;
+    int i;
+
+    for (i = 0; i < 5; i++)
+        security_stats_count (ctx, STAT_MUNGE_ERROR_SOCKET);
+    return NULL;
+}
+
+static void *stats_thread_exit (void *arg)
+{
+    stats_thread (arg);
+    security_thread_exit (arg);
+    return NULL;
+}
+
+/* Counts from a thread that exited without calling security_thread_exit()
+ * and one that called it are both included.
+ */
+static void test_stats_threads (flux_security_t *ctx)
+{
+    struct flux_security_stats stats;
+    pthread_t t1, t2;
+
+    if (pthread_create (&t1, NULL, stats_thread, ctx) != 0
+        || pthread_join (t1, NULL) != 0
+        || pthread_create (&t2, NULL, stats_thread_exit, ctx) != 0
+        || pthread_join (t2, NULL) != 0)
+        BAIL_OUT ("pthread_create/join failed");
+    ok (flux_security_stats_get (ctx, "munge.error.socket", &stats) == 0
+        && stats.count == 10,
+        "per-thread counters are summed on read");
+}
+
+void test_stats (void)
+{
+    flux_security_t *ctx;
+    struct flux_security_stats stats;
+    char *json;
+    char pattern[PATH_MAX + 1];
+    const char *name;
+    uint64_t sum;
+    uint64_t t;
+    int count;
+    int n;
+    int i;
+
+    if (!(ctx = flux_security_create (0)))
+        BAIL_OUT ("flux_security_create failed");
+    errno = 0;
+    ok (flux_security_stats_get (ctx, "none.sign", &stats) < 0
+        && errno == EINVAL,
+        "flux_security_stats_get without FLUX_SECURITY_STATS fails");
+    diag ("%s", flux_security_last_error (ctx));
+    ok (security_stats_start (ctx) == 0,
+        "security_stats_start returns 0 without FLUX_SECURITY_STATS");
+    flux_security_destroy (ctx);
+
+    ctx = flux_security_create (FLUX_SECURITY_STATS
+                                | FLUX_SECURITY_THREADSAFE);
+    ok (ctx != NULL,
+        "flux_security_create FLUX_SECURITY_STATS works");
+    if (!ctx)
+        BAIL_OUT ("flux_security_create failed");
+
+    count = 0;
+    name = NULL;
+    while ((name = flux_security_stats_next (ctx, name))) {
+        if (flux_security_stats_get (ctx, name, &stats) == 0
+            && stats.count == 0 && stats.total_ns == 0)
+            count++;
+        else
+            break;
+    }
+    ok (count == STAT_COUNT - 1,
+        "flux_security_stats_next iterates over %d zeroed statistics",
+        count);
+
+    errno = 0;
+    ok (flux_security_stats_get (ctx, "nope", &stats) < 0 && errno == ENOENT,
+        "flux_security_stats_get name=unknown fails with ENOENT");
+    diag ("%s", flux_security_last_error (ctx));
+    errno = 0;
+    ok (flux_security_stats_get (ctx, NULL, &stats) < 0 && errno == EINVAL,
+        "flux_security_stats_get name=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_security_stats_get (ctx, "none.sign", NULL) < 0
+        && errno == EINVAL,
+        "flux_security_stats_get stats=NULL fails with EINVAL");
+    ok (flux_security_stats_next (NULL, NULL) == NULL,
+        "flux_security_stats_next ctx=NULL returns NULL");
+
+    for (i = 0; i < 3; i++) {
+        t = security_stats_start (ctx);
+        security_stats_end (ctx, STAT_CURVE_CA, t);
+    }
+    ok (flux_security_stats_get (ctx, "curve.verify.ca", &stats) == 0
+        && stats.count == 3,
+        "security_stats_end counts samples");
+    sum = 0;
+    for (i = 0; i < FLUX_SECURITY_STATS_BUCKETS; i++)
+        sum += stats.hist[i];
+    ok (sum == 3,
+        "histogram buckets add up to the sample count");
+    ok (flux_security_stats_get (ctx, "curve.verify", &stats) == 0
+        && stats.count == 0,
+        "other statistics are unaffected");
+
+    security_stats_count (ctx, STAT_MUNGE_ERROR_SOCKET);
+    security_stats_count (ctx, STAT_MUNGE_ERROR_SOCKET);
+    ok (flux_security_stats_get (ctx, "munge.error.socket", &stats) == 0
+        && stats.count == 2 && stats.total_ns == 0 && stats.hist[0] == 0,
+        "security_stats_count counts events without timing them");
+    ok (stats.elapsed_ns > 0,
+        "elapsed_ns is set");
+
+    security_stats_end (ctx, STAT_CURVE_CA, 0);
+    ok (flux_security_stats_get (ctx, "curve.verify.ca", &stats) == 0
+        && stats.count == 3,
+        "security_stats_end ignores start=0");
+
+    n = sizeof (pattern);
+    if (snprintf (pattern, n, "%s/*.toml", tmpdir) >= n)
+        BAIL_OUT ("pattern buffer overflow");
+    if (flux_security_configure (ctx, pattern) < 0)
+        BAIL_OUT ("flux_security_configure failed");
+    ok (flux_security_stats_get (ctx, "config.load", &stats) == 0
+        && stats.count == 1,
+        "flux_security_configure records config.load");
+
+    flux_security_stats_reset (ctx);
+    ok (flux_security_stats_get (ctx, "curve.verify.ca", &stats) == 0
+        && stats.count == 0 && stats.total_ns == 0 && stats.hist[0] == 0,
+        "flux_security_stats_reset zeroes statistics");
+
+    test_stats_threads (ctx);
+
+    errno = 0;
+    ok (flux_security_stats_json (NULL) == NULL && errno == EINVAL,
+        "flux_security_stats_json ctx=NULL fails with EINVAL");
+    if (!(json = flux_security_stats_json (ctx)))
+        BAIL_OUT ("flux_security_stats_json failed");
+    ok (strncmp (json, "{\"elapsed_ns\":", 14) == 0
+        && strstr (json, "\"munge.error.socket\":{\"count\":10,")
+        && json[strlen (json) - 1] == '}',
+        "flux_security_stats_json includes all statistics");
+    diag ("%.60s...", json);
+    free (json);
+
+    flux_security_destroy (ctx);
+}
+
 int main (int argc, char *argv[])
 {
     plan (NO_PLAN);
@@ -267,9 +624,13 @@ int main (int argc, char *argv[])
 
     test_basic ();
     test_set_config ();
+    test_reconfig ();
+    test_shared_config ();
     test_error ();
     test_aux ();
+    test_threadsafe ();
     test_corner ();
+    test_stats ();
 
     conf_fini ();
 
@@ -12,8 +12,12 @@
 #include "config.h"
 #endif
 #include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/param.h>
+#include <poll.h>
 #include <sodium.h>
 
 #include "src/libtap/tap.h"
@@ -69,6 +73,20 @@ const char *badconf_nonstring_allowed_types = \
 "default-type = \"none\"\n" \
 "allowed-types = [ 1 ]\n";
 
+const char *badconf_neg_verify_cache_size = \
+"[sign]\n" \
+"max-ttl = 30\n" \
+"default-type = \"none\"\n" \
+"allowed-types = [ \"none\" ]\n" \
+"verify-cache-size = -1\n";
+
+const char *conf_verify_cache = \
+"[sign]\n" \
+"max-ttl = 30\n" \
+"default-type = \"none\"\n" \
+"allowed-types = [ \"none\" ]\n" \
+"verify-cache-size = 16\n";
+
 
 static char tmpdir[PATH_MAX + 1];
 static char cfpath[PATH_MAX + 1];
@@ -95,7 +113,7 @@ void cfpath_fini (void)
         BAIL_OUT ("rmdir %s: %s", tmpdir, strerror (errno));
 }
 
-flux_security_t *context_init (const char *config_buf)
+flux_security_t *context_init_flags (const char *config_buf, int flags)
 {
     FILE *f;
     int n;
@@ -110,7 +128,7 @@ flux_security_t *context_init (const char *config_buf)
     if (fclose (f) != 0)
         BAIL_OUT ("fclose failed");
 
-    if (!(ctx = flux_security_create (0)))
+    if (!(ctx = flux_security_create (flags)))
         BAIL_OUT ("flux_security_create failed");
     n = sizeof (pattern);
     if (snprintf (pattern, n, "%s/*.toml", tmpdir) >= n)
@@ -121,6 +139,11 @@ flux_security_t *context_init (const char *config_buf)
     return ctx;
 }
 
+flux_security_t *context_init (const char *config_buf)
+{
+    return context_init_flags (config_buf, 0);
+}
+
 void test_config (void)
 {
     flux_security_t *ctx;
@@ -188,6 +211,20 @@ void test_config (void)
         "flux_sign_wrap with nonstring allowed-types config fails with EINVAL");
     diag ("%s", flux_security_last_error (ctx));
     flux_security_destroy (ctx);
+
+    if (!(ctx = context_init (badconf_neg_verify_cache_size)))
+        BAIL_OUT ("failed to set up test config");
+    errno = 0;
+    ok (flux_sign_wrap (ctx, "foo", 3, NULL, 0) == NULL && errno == EINVAL,
+        "flux_sign_wrap with negative verify-cache-size fails with EINVAL");
+    diag ("%s", flux_security_last_error (ctx));
+    flux_security_destroy (ctx);
+
+    if (!(ctx = context_init (conf_verify_cache)))
+        BAIL_OUT ("failed to set up test config");
+    ok (flux_sign_wrap (ctx, "foo", 3, NULL, 0) != NULL,
+        "flux_sign_wrap with verify-cache-size works");
+    flux_security_destroy (ctx);
 }
 
 void test_basic (flux_security_t *ctx)
@@ -271,6 +308,593 @@ void test_basic (flux_security_t *ctx)
     diag ("%s", flux_security_last_error (ctx));
 }
 
+void test_batch (flux_security_t *ctx)
+{
+    const void *pays[] = { "foo", NULL, "hello world" };
+    int payszs[] = { 3, 0, 11 };
+    int count = sizeof (payszs) / sizeof (payszs[0]);
+    char *outputs[3];
+    const void *outmsg;
+    int outmsgsz;
+    int64_t userid;
+    int i;
+    int errors;
+
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, count, outputs, NULL, 0) == 0,
+        "flux_sign_wrap_batch works");
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        diag ("%s", outputs[i]);
+        if (flux_sign_unwrap (ctx, outputs[i], &outmsg, &outmsgsz,
+                              &userid, 0) < 0
+            || outmsgsz != payszs[i]
+            || (outmsgsz > 0 && memcmp (outmsg, pays[i], outmsgsz) != 0)
+            || userid != getuid ())
+            errors++;
+        free (outputs[i]);
+    }
+    ok (errors == 0,
+        "flux_sign_unwrap verifies each batch output");
+
+    ok (flux_sign_wrap_batch_as (ctx, 42, pays, payszs, count,
+                                 outputs, "none", 0) == 0,
+        "flux_sign_wrap_batch_as works");
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        if (flux_sign_unwrap (ctx, outputs[i], NULL, NULL, &userid,
+                              FLUX_SIGN_NOVERIFY) < 0
+            || userid != 42)
+            errors++;
+        free (outputs[i]);
+    }
+    ok (errors == 0,
+        "batch outputs contain userid argument to flux_sign_wrap_batch_as()");
+
+    ok (flux_sign_wrap_batch (ctx, NULL, NULL, 0, NULL, NULL, 0) == 0,
+        "flux_sign_wrap_batch count=0 works");
+
+    errno = 0;
+    ok (flux_sign_wrap_batch (NULL, pays, payszs, count, outputs,
+                              NULL, 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch ctx=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, -1, outputs,
+                              NULL, 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch count=-1 fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, count, NULL,
+                              NULL, 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch outputs=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, count, outputs,
+                              NULL, 0xff) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch flags=0xff fails with EINVAL");
+    errno = 0;
+    payszs[1] = 1;
+    for (i = 0; i < count; i++)
+        outputs[i] = (char *)"unset";
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, count, outputs,
+                              NULL, 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch pay=NULL paysz > 0 fails with EINVAL");
+    ok (outputs[0] == NULL && outputs[1] == NULL && outputs[2] == NULL,
+        "outputs after the invalid payload are set to NULL too");
+    payszs[1] = 0;
+    errno = 0;
+    ok (flux_sign_wrap_batch (ctx, pays, payszs, count, outputs,
+                              "foo", 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch mech_type=foo fails with EINVAL");
+    ok (outputs[0] == NULL && outputs[1] == NULL && outputs[2] == NULL,
+        "outputs are set to NULL on failure");
+    errno = 0;
+    ok (flux_sign_wrap_batch_as (ctx, -1, pays, payszs, count, outputs,
+                                 NULL, 0) < 0 && errno == EINVAL,
+        "flux_sign_wrap_batch_as userid=-1 fails with EINVAL");
+}
+
+void test_into (flux_security_t *ctx)
+{
+    const char *inmsg = "hello world";
+    int inmsgsz = strlen (inmsg);
+    char buf[256];
+    char outmsg[64];
+    const char *s;
+    int len;
+    int64_t userid;
+
+    if (!(s = flux_sign_wrap_as (ctx, 42, inmsg, inmsgsz, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap_as: %s", flux_security_last_error (ctx));
+    len = flux_sign_wrap_as_into (ctx, 42, inmsg, inmsgsz, NULL, 0,
+                                  buf, sizeof (buf));
+    ok (len == (int)strlen (s) && !strcmp (buf, s),
+        "flux_sign_wrap_as_into works");
+    ok (flux_sign_wrap_as_into (ctx, 42, inmsg, inmsgsz, NULL, 0,
+                                NULL, 0) == len,
+        "flux_sign_wrap_as_into buf=NULL reports required size");
+    ok (flux_sign_wrap_as_into (ctx, 42, inmsg, inmsgsz, NULL, 0,
+                                buf, len) == len,
+        "flux_sign_wrap_as_into with no room for NUL reports required size");
+    ok (flux_sign_wrap_as_into (ctx, 42, inmsg, inmsgsz, NULL, 0,
+                                buf, len + 1) == len && !strcmp (buf, s),
+        "flux_sign_wrap_as_into with exact size works");
+
+    len = flux_sign_wrap_into (ctx, inmsg, inmsgsz, NULL, 0,
+                               buf, sizeof (buf));
+    ok (len > 0 && len < (int)sizeof (buf),
+        "flux_sign_wrap_into works");
+
+    ok (flux_sign_unwrap_into (ctx, buf, NULL, 0, NULL, 0) == inmsgsz,
+        "flux_sign_unwrap_into buf=NULL reports payload size");
+    userid = -1;
+    memset (outmsg, 0, sizeof (outmsg));
+    ok (flux_sign_unwrap_into (ctx, buf, outmsg, inmsgsz, &userid, 0)
+        == inmsgsz
+        && !memcmp (outmsg, inmsg, inmsgsz)
+        && userid == getuid (),
+        "flux_sign_unwrap_into works");
+
+    ok (flux_sign_wrap_into (ctx, NULL, 0, NULL, 0, buf, sizeof (buf)) > 0,
+        "flux_sign_wrap_into payload=NULL works");
+    ok (flux_sign_unwrap_into (ctx, buf, NULL, 0, NULL, 0) == 0,
+        "flux_sign_unwrap_into works on empty payload");
+
+    errno = 0;
+    ok (flux_sign_wrap_into (ctx, inmsg, inmsgsz, NULL, 0, NULL, 1) < 0
+        && errno == EINVAL,
+        "flux_sign_wrap_into buf=NULL bufsz > 0 fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_wrap_into (ctx, inmsg, inmsgsz, NULL, 0xff,
+                             buf, sizeof (buf)) < 0
+        && errno == EINVAL,
+        "flux_sign_wrap_into flags=0xff fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_into (ctx, s, NULL, 1, NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_into buf=NULL bufsz > 0 fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_into (ctx, "a.b.c", outmsg, sizeof (outmsg),
+                               NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_into fails on bad input with EINVAL");
+    diag ("%s", flux_security_last_error (ctx));
+    if (!(s = flux_sign_wrap_as (ctx, 42, inmsg, inmsgsz, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap_as: %s", flux_security_last_error (ctx));
+    errno = 0;
+    ok (flux_sign_unwrap_into (ctx, s, outmsg, sizeof (outmsg), NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_into VERIFY fails with flux_sign_wrap_as()");
+    diag ("%s", flux_security_last_error (ctx));
+}
+
+#define NTHREADS 8
+
+struct thread_arg {
+    pthread_t t;
+    flux_security_t *ctx;
+    int id;
+    int errors;
+};
+
+static void *thread_wrap_unwrap (void *arg)
+{
+    struct thread_arg *a = arg;
+    char inmsg[64];
+    const void *outmsg;
+    int outmsgsz;
+    const char *s;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        int inmsgsz = snprintf (inmsg, sizeof (inmsg), "%d-%d", a->id, i);
+        if (!(s = flux_sign_wrap (a->ctx, inmsg, inmsgsz, NULL, 0))
+            || flux_sign_unwrap (a->ctx, s, &outmsg, &outmsgsz, NULL, 0) < 0
+            || outmsgsz != inmsgsz
+            || memcmp (outmsg, inmsg, inmsgsz) != 0)
+            a->errors++;
+    }
+    return NULL;
+}
+
+void test_threadsafe (const char *config, const char *name)
+{
+    flux_security_t *ctx;
+    struct thread_arg a[NTHREADS];
+    int errors;
+    int i;
+
+    ctx = context_init_flags (config, FLUX_SECURITY_THREADSAFE);
+    for (i = 0; i < NTHREADS; i++) {
+        a[i].ctx = ctx;
+        a[i].id = i;
+        a[i].errors = 0;
+        if (pthread_create (&a[i].t, NULL, thread_wrap_unwrap, &a[i]) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    errors = 0;
+    for (i = 0; i < NTHREADS; i++) {
+        if (pthread_join (a[i].t, NULL) != 0)
+            BAIL_OUT ("pthread_join failed");
+        errors += a[i].errors;
+    }
+    ok (errors == 0,
+        "%d threads can wrap/unwrap concurrently with one THREADSAFE context%s",
+        NTHREADS, name);
+    flux_security_destroy (ctx);
+}
+
+/* Wrap a batch in which every 7th input fails verification (wrong userid)
+ * and every 11th is garbage, then verify it with flux_sign_unwrap_batch().
+ */
+void check_unwrap_batch (flux_security_t *ctx, int count, const char *name)
+{
+    char **inputs = NULL;
+    int64_t *userids = NULL;
+    int *payloadszs = NULL;
+    int *errnums = NULL;
+    int expected = 0;
+    int errors = 0;
+    int i;
+
+    if (!(inputs = calloc (count, sizeof (inputs[0])))
+        || !(userids = calloc (count, sizeof (userids[0])))
+        || !(payloadszs = calloc (count, sizeof (payloadszs[0])))
+        || !(errnums = calloc (count, sizeof (errnums[0]))))
+        BAIL_OUT ("calloc failed");
+    for (i = 0; i < count; i++) {
+        const char *s;
+        int pay[2] = { i, i };
+        if (i % 11 == 3)
+            s = "bad.input";
+        else if (!(s = flux_sign_wrap_as (ctx,
+                                          i % 7 == 1 ? 42 : getuid (),
+                                          pay, sizeof (i) * (i % 3),
+                                          NULL, 0)))
+            BAIL_OUT ("flux_sign_wrap_as: %s", flux_security_last_error (ctx));
+        if (!(inputs[i] = strdup (s)))
+            BAIL_OUT ("strdup failed");
+        if (i % 11 == 3 || i % 7 == 1)
+            expected++;
+    }
+    ok (flux_sign_unwrap_batch (ctx, (const char **)inputs, count,
+                                userids, payloadszs, errnums, 0) == expected,
+        "%s: flux_sign_unwrap_batch count=%d reports %d failures",
+        name, count, expected);
+    for (i = 0; i < count; i++) {
+        if (i % 11 == 3 || i % 7 == 1) {
+            if (errnums[i] != EINVAL)
+                errors++;
+        }
+        else if (errnums[i] != 0
+                 || userids[i] != getuid ()
+                 || payloadszs[i] != (int)sizeof (i) * (i % 3))
+            errors++;
+    }
+    ok (errors == 0,
+        "%s: flux_sign_unwrap_batch per-item results are correct", name);
+    for (i = 0; i < count; i++)
+        free (inputs[i]);
+    free (inputs);
+    free (userids);
+    free (payloadszs);
+    free (errnums);
+}
+
+void test_unwrap_batch (flux_security_t *ctx)
+{
+    const char *input = "x";
+    int errnum;
+
+    check_unwrap_batch (ctx, 100, "serial");
+    ok (flux_sign_unwrap_batch (ctx, NULL, 0, NULL, NULL, NULL, 0) == 0,
+        "flux_sign_unwrap_batch count=0 works");
+    errno = 0;
+    ok (flux_sign_unwrap_batch (NULL, &input, 1, NULL, NULL, &errnum, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_batch ctx=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_batch (ctx, &input, 1, NULL, NULL, NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_batch errnums=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_batch (ctx, &input, 1, NULL, NULL, &errnum, 2) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_batch flags=2 fails with EINVAL");
+}
+
+void test_unwrap_batch_threadsafe (void)
+{
+    flux_security_t *ctx;
+
+    ctx = context_init_flags (conf, FLUX_SECURITY_THREADSAFE);
+    check_unwrap_batch (ctx, 1000, "threadsafe");
+    check_unwrap_batch (ctx, 1000, "threadsafe (again)");
+    flux_security_destroy (ctx);
+}
+
+void test_deferred (flux_security_t *ctx)
+{
+    const char *inmsg = "hello world";
+    int inmsgsz = strlen (inmsg);
+    char outmsg[64];
+    const char *mech_type;
+    const char *s;
+    char *cpy;
+    int64_t userid;
+    int len;
+
+    if (!(s = flux_sign_wrap (ctx, inmsg, inmsgsz, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    if (!(cpy = strdup (s)))
+        BAIL_OUT ("strdup failed");
+    len = -1;
+    userid = -1;
+    mech_type = NULL;
+    ok (flux_sign_unwrap_header (ctx, cpy, &mech_type, &userid, &len, 0) == 0,
+        "flux_sign_unwrap_header works");
+    ok (len == inmsgsz,
+        "payload size was reported");
+    ok (userid == getuid (),
+        "userid was reported");
+    ok (mech_type != NULL && !strcmp (mech_type, "none"),
+        "mech_type was reported");
+    ok (flux_sign_unwrap_header (ctx, cpy, NULL, NULL, NULL,
+                                 FLUX_SIGN_NOVERIFY) == 0,
+        "flux_sign_unwrap_header NOVERIFY works");
+
+    ok (flux_sign_decode_payload (ctx, cpy, NULL, 0) == inmsgsz,
+        "flux_sign_decode_payload buf=NULL reports payload size");
+    memset (outmsg, 0, sizeof (outmsg));
+    ok (flux_sign_decode_payload (ctx, cpy, outmsg, sizeof (outmsg))
+        == inmsgsz
+        && !memcmp (outmsg, inmsg, inmsgsz),
+        "flux_sign_decode_payload works");
+    strchr (cpy, '.')[1] = '!';
+    errno = 0;
+    ok (flux_sign_unwrap_header (ctx, cpy, NULL, NULL, NULL,
+                                 FLUX_SIGN_NOVERIFY) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_header fails on invalid payload with EINVAL");
+    free (cpy);
+
+    if (!(s = flux_sign_wrap_as (ctx, 42, inmsg, inmsgsz, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap_as: %s", flux_security_last_error (ctx));
+    ok (flux_sign_unwrap_header (ctx, s, NULL, NULL, NULL, 0) < 0,
+        "flux_sign_unwrap_header VERIFY fails with flux_sign_wrap_as()");
+    diag ("%s", flux_security_last_error (ctx));
+
+    errno = 0;
+    ok (flux_sign_unwrap_header (ctx, "a.b", NULL, NULL, NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_header fails on truncated input with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_header (NULL, s, NULL, NULL, NULL, 0) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_header ctx=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_header (ctx, s, NULL, NULL, NULL, 0xff) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_header flags=0xff fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_decode_payload (ctx, "a.bbbbb.c", outmsg,
+                                  sizeof (outmsg)) < 0
+        && errno == EINVAL,
+        "flux_sign_decode_payload fails on bad payload with EINVAL");
+    errno = 0;
+    ok (flux_sign_decode_payload (ctx, s, NULL, 1) < 0 && errno == EINVAL,
+        "flux_sign_decode_payload buf=NULL bufsz > 0 fails with EINVAL");
+}
+
+struct membuf {
+    char *buf;
+    size_t len;
+    int fail;
+};
+
+static int membuf_write (const void *buf, size_t len, void *arg)
+{
+    struct membuf *mb = arg;
+    char *new;
+
+    if (mb->fail) {
+        errno = EIO;
+        return -1;
+    }
+    if (!(new = realloc (mb->buf, mb->len + len + 1)))
+        return -1;
+    mb->buf = new;
+    memcpy (mb->buf + mb->len, buf, len);
+    mb->len += len;
+    mb->buf[mb->len] = '\0';
+    return 0;
+}
+
+/* Feed 'buf' to stream in chunks of varying size.
+ */
+static int stream_feed (flux_sign_stream_t *ss, const char *buf, size_t len)
+{
+    size_t chunk = 1;
+
+    while (len > 0) {
+        size_t n = chunk < len ? chunk : len;
+        if (flux_sign_stream_update (ss, buf, n) < 0)
+            return -1;
+        buf += n;
+        len -= n;
+        chunk = (chunk * 7 + 3) % 5000;
+    }
+    return 0;
+}
+
+void test_stream (flux_security_t *ctx)
+{
+    struct membuf wrapped = { 0 };
+    struct membuf unwrapped = { 0 };
+    flux_sign_stream_t *ss;
+    char *pay;
+    size_t paysz = 100000;
+    const void *outmsg;
+    int outmsgsz;
+    int64_t userid;
+    const char *s;
+    size_t i;
+
+    if (!(pay = malloc (paysz)))
+        BAIL_OUT ("malloc failed");
+    for (i = 0; i < paysz; i++)
+        pay[i] = i * 31;
+
+    ss = flux_sign_wrap_stream (ctx, NULL, 0, membuf_write, &wrapped);
+    ok (ss != NULL,
+        "flux_sign_wrap_stream works");
+    ok (stream_feed (ss, pay, paysz) == 0,
+        "flux_sign_stream_update works on wrap stream");
+    ok (flux_sign_stream_final (ss, &userid) == 0 && userid == getuid (),
+        "flux_sign_stream_final works on wrap stream");
+    flux_sign_stream_destroy (ss);
+    ok (wrapped.buf != NULL
+        && flux_sign_unwrap (ctx, wrapped.buf, &outmsg, &outmsgsz,
+                             NULL, 0) == 0
+        && outmsgsz == (int)paysz
+        && !memcmp (outmsg, pay, paysz),
+        "flux_sign_unwrap verifies streamed wrap output");
+
+    if (!(s = flux_sign_wrap (ctx, pay, paysz, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    ok (!strcmp (s, wrapped.buf),
+        "streamed wrap output is identical to flux_sign_wrap()");
+
+    ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &unwrapped);
+    ok (ss != NULL,
+        "flux_sign_unwrap_stream works");
+    ok (stream_feed (ss, wrapped.buf, wrapped.len) == 0,
+        "flux_sign_stream_update works on unwrap stream");
+    userid = -1;
+    ok (flux_sign_stream_final (ss, &userid) == 0 && userid == getuid (),
+        "flux_sign_stream_final verifies signature");
+    ok (unwrapped.len == paysz && !memcmp (unwrapped.buf, pay, paysz),
+        "unwrap stream emitted original payload");
+    errno = 0;
+    ok (flux_sign_stream_update (ss, "x", 1) < 0 && errno == EINVAL,
+        "flux_sign_stream_update after final fails with EINVAL");
+    flux_sign_stream_destroy (ss);
+
+    /* Empty payload
+     */
+    free (wrapped.buf);
+    wrapped.buf = NULL;
+    wrapped.len = 0;
+    if (!(ss = flux_sign_wrap_stream (ctx, NULL, 0, membuf_write, &wrapped))
+        || flux_sign_stream_final (ss, NULL) < 0)
+        BAIL_OUT ("streamed wrap of empty payload failed");
+    flux_sign_stream_destroy (ss);
+    ok (flux_sign_unwrap (ctx, wrapped.buf, &outmsg, &outmsgsz, NULL, 0) == 0
+        && outmsgsz == 0,
+        "streamed wrap of empty payload works");
+
+    /* Signature failure is detected at final
+     */
+    if (!(s = flux_sign_wrap_as (ctx, 42, pay, 1000, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap_as: %s", flux_security_last_error (ctx));
+    unwrapped.len = 0;
+    if (!(ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &unwrapped)))
+        BAIL_OUT ("flux_sign_unwrap_stream failed");
+    ok (stream_feed (ss, s, strlen (s)) == 0
+        && flux_sign_stream_final (ss, NULL) < 0,
+        "unwrap stream final fails verification with flux_sign_wrap_as()");
+    diag ("%s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+
+    if (!(ss = flux_sign_unwrap_stream (ctx, FLUX_SIGN_NOVERIFY,
+                                        membuf_write, &unwrapped)))
+        BAIL_OUT ("flux_sign_unwrap_stream failed");
+    ok (stream_feed (ss, s, strlen (s)) == 0
+        && flux_sign_stream_final (ss, &userid) == 0 && userid == 42,
+        "unwrap stream NOVERIFY works with flux_sign_wrap_as()");
+    flux_sign_stream_destroy (ss);
+
+    /* Bad input
+     */
+    if (!(ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &unwrapped)))
+        BAIL_OUT ("flux_sign_unwrap_stream failed");
+    errno = 0;
+    ok (stream_feed (ss, s, strlen (s) / 2) == 0
+        && flux_sign_stream_final (ss, NULL) < 0 && errno == EINVAL,
+        "unwrap stream final fails on truncated input with EINVAL");
+    diag ("%s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+
+    if (!(s = flux_sign_wrap (ctx, pay, 1000, NULL, 0)))
+        BAIL_OUT ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    if (!(ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &unwrapped)))
+        BAIL_OUT ("flux_sign_unwrap_stream failed");
+    errno = 0;
+    ok (stream_feed (ss, s, strrchr (s, '.') - s + 1) == 0
+        && flux_sign_stream_final (ss, NULL) < 0 && errno == EINVAL,
+        "unwrap stream final fails on empty signature with EINVAL");
+    diag ("%s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+
+    if (!(ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &unwrapped)))
+        BAIL_OUT ("flux_sign_unwrap_stream failed");
+    errno = 0;
+    ok (flux_sign_stream_update (ss, "bm9uZQ==.", 9) < 0 && errno == EINVAL,
+        "unwrap stream fails on bad header with EINVAL");
+    diag ("%s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+
+    wrapped.fail = 1;
+    errno = 0;
+    ok (flux_sign_wrap_stream (ctx, NULL, 0, membuf_write, &wrapped) == NULL
+        && errno == EIO,
+        "flux_sign_wrap_stream fails if write callback fails");
+
+    errno = 0;
+    ok (flux_sign_wrap_stream (ctx, NULL, 0, NULL, NULL) == NULL
+        && errno == EINVAL,
+        "flux_sign_wrap_stream write_fn=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_wrap_stream (ctx, NULL, 0xff, membuf_write, &wrapped) == NULL
+        && errno == EINVAL,
+        "flux_sign_wrap_stream flags=0xff fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_stream (NULL, 0, membuf_write, &wrapped) == NULL
+        && errno == EINVAL,
+        "flux_sign_unwrap_stream ctx=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_stream_update (NULL, "x", 1) < 0 && errno == EINVAL,
+        "flux_sign_stream_update ss=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_stream_final (NULL, NULL) < 0 && errno == EINVAL,
+        "flux_sign_stream_final ss=NULL fails with EINVAL");
+
+    free (wrapped.buf);
+    free (unwrapped.buf);
+    free (pay);
+}
+
+/* Alternate userids so the cached header prefix is rebuilt, and check
+ * that each output carries the right userid.
+ */
+void test_prefix (flux_security_t *ctx)
+{
+    int64_t ids[] = { 42, 42, 43, 42, 0 };
+    int i;
+    int errors = 0;
+
+    ids[4] = getuid ();
+    for (i = 0; i < (int)(sizeof (ids) / sizeof (ids[0])); i++) {
+        const char *s;
+        int64_t userid;
+
+        if (!(s = flux_sign_wrap_as (ctx, ids[i], "foo", 3, NULL, 0))
+            || flux_sign_unwrap (ctx, s, NULL, NULL, &userid,
+                                 FLUX_SIGN_NOVERIFY) < 0
+            || userid != ids[i])
+            errors++;
+    }
+    ok (errors == 0,
+        "wrap with changing userid uses the right header each time");
+}
+
 void test_mechselect (flux_security_t *ctx)
 {
     const char *inmsg = "hello world";
@@ -399,6 +1023,18 @@ void test_badheader (flux_security_t *ctx)
 
     header = make_header (2, "none", getuid ());
     snprintf (input, sizeof (input), "%s.aGkK.none", header);
+    ok (flux_sign_unwrap (ctx, input, NULL, NULL, NULL, 0) == 0,
+        "flux_sign_unwrap version=2 works");
+    free (header);
+
+    header = make_header (3, "none", getuid ());
+    snprintf (input, sizeof (input), "%s.aGkK.none", header);
+    ok (flux_sign_unwrap (ctx, input, NULL, NULL, NULL, 0) == 0,
+        "flux_sign_unwrap version=3 works");
+    free (header);
+
+    header = make_header (4, "none", getuid ());
+    snprintf (input, sizeof (input), "%s.aGkK.none", header);
     errno = 0;
     ok (flux_sign_unwrap (ctx, input, NULL, NULL, NULL, 0) < 0
         && errno == EINVAL,
@@ -548,6 +1184,215 @@ void test_corner (flux_security_t *ctx)
     free (cpy);
 }
 
+void test_stats (void)
+{
+    flux_security_t *ctx;
+    struct flux_security_stats sign_stats;
+    struct flux_security_stats verify_stats;
+    const char *s;
+    char *cpy;
+    flux_sign_stream_t *ss;
+    struct membuf mb = { 0 };
+    struct membuf out = { 0 };
+    int64_t userid;
+
+    ctx = context_init_flags (conf, FLUX_SECURITY_STATS);
+    if (!(s = flux_sign_wrap (ctx, "foo", 3, "none", 0))
+        || !(cpy = strdup (s)))
+        BAIL_OUT ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    if (flux_sign_unwrap (ctx, cpy, NULL, NULL, NULL, 0) < 0)
+        BAIL_OUT ("flux_sign_unwrap: %s", flux_security_last_error (ctx));
+    ok (flux_security_stats_get (ctx, "none.sign", &sign_stats) == 0
+        && sign_stats.count == 1
+        && flux_security_stats_get (ctx, "none.verify", &verify_stats) == 0
+        && verify_stats.count == 1,
+        "none.sign and none.verify count wrap and unwrap");
+    ok (flux_security_stats_get (ctx, "wrap", &sign_stats) == 0
+        && sign_stats.count == 1
+        && flux_security_stats_get (ctx, "unwrap", &verify_stats) == 0
+        && verify_stats.count == 1,
+        "wrap and unwrap count calls");
+    ok (flux_security_stats_get (ctx, "wrap.bytes", &sign_stats) == 0
+        && sign_stats.count == 3
+        && flux_security_stats_get (ctx, "unwrap.bytes", &verify_stats) == 0
+        && verify_stats.count == 3,
+        "wrap.bytes and unwrap.bytes count payload bytes");
+
+    if (!(ss = flux_sign_wrap_stream (ctx, "none", 0, membuf_write, &mb))
+        || flux_sign_stream_update (ss, "foo", 3) < 0
+        || flux_sign_stream_final (ss, NULL) < 0)
+        BAIL_OUT ("wrap stream failed: %s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+    if (!(ss = flux_sign_unwrap_stream (ctx, 0, membuf_write, &out))
+        || flux_sign_stream_update (ss, mb.buf, mb.len) < 0
+        || flux_sign_stream_final (ss, &userid) < 0)
+        BAIL_OUT ("unwrap stream failed: %s", flux_security_last_error (ctx));
+    flux_sign_stream_destroy (ss);
+    free (mb.buf);
+    free (out.buf);
+    ok (flux_security_stats_get (ctx, "none.sign", &sign_stats) == 0
+        && sign_stats.count == 2
+        && flux_security_stats_get (ctx, "none.verify", &verify_stats) == 0
+        && verify_stats.count == 2,
+        "none.sign and none.verify count streamed wrap and unwrap");
+
+    if (flux_sign_unwrap (ctx, cpy, NULL, NULL, NULL, FLUX_SIGN_NOVERIFY) < 0)
+        BAIL_OUT ("flux_sign_unwrap: %s", flux_security_last_error (ctx));
+    ok (flux_security_stats_get (ctx, "none.verify", &verify_stats) == 0
+        && verify_stats.count == 2,
+        "none.verify does not count unwrap with FLUX_SIGN_NOVERIFY");
+
+    ok (flux_sign_wrap_into (ctx, "foo", 3, "none", 0, NULL, 0) > 0
+        && flux_security_stats_get (ctx, "none.sign", &sign_stats) == 0
+        && sign_stats.count == 2,
+        "none.sign does not count flux_sign_wrap_into size query");
+
+    flux_security_stats_reset (ctx);
+    ok (flux_security_stats_get (ctx, "none.sign", &sign_stats) == 0
+        && sign_stats.count == 0,
+        "flux_security_stats_reset zeroes none.sign");
+    free (cpy);
+    flux_security_destroy (ctx);
+}
+
+#define NASYNC 64
+
+struct async_result {
+    int count;
+    int errors;
+    char *outputs[NASYNC];
+};
+
+static void async_wrap_cb (const char *output, int errnum, const char *errstr,
+                           void *arg)
+{
+    struct async_result *r = arg;
+
+    if (errnum != 0 || !output || !(r->outputs[r->count] = strdup (output)))
+        r->errors++;
+    r->count++;
+}
+
+static void async_unwrap_cb (const void *payload, int payloadsz,
+                             int64_t userid, int errnum, const char *errstr,
+                             void *arg)
+{
+    struct async_result *r = arg;
+
+    if (errnum != 0 || payloadsz != 5 || memcmp (payload, "hello", 5) != 0
+        || userid != getuid ())
+        r->errors++;
+    r->count++;
+}
+
+static void async_fail_cb (const void *payload, int payloadsz,
+                           int64_t userid, int errnum, const char *errstr,
+                           void *arg)
+{
+    struct async_result *r = arg;
+
+    diag ("%s", errstr ? errstr : "(null)");
+    if (errnum != EINVAL || payload != NULL || !errstr)
+        r->errors++;
+    r->count++;
+}
+
+/* Poll the async fd and dispatch until 'r' has 'count' results.
+ */
+static void async_wait (flux_sign_async_t *as, struct async_result *r,
+                        int count)
+{
+    struct pollfd pfd = { .fd = flux_sign_async_fd (as), .events = POLLIN };
+
+    while (r->count < count) {
+        if (poll (&pfd, 1, 10000) != 1)
+            BAIL_OUT ("poll on async fd failed or timed out");
+        if (flux_sign_async_dispatch (as) < 0)
+            BAIL_OUT ("flux_sign_async_dispatch failed");
+    }
+}
+
+void test_async (void)
+{
+    flux_security_t *ctx;
+    flux_sign_async_t *as;
+    struct async_result wr = { 0 };
+    struct async_result ur = { 0 };
+    struct async_result fr = { 0 };
+    int i;
+
+    ctx = context_init (conf);
+    errno = 0;
+    ok (flux_sign_async_create (ctx, 4, 0) == NULL && errno == EINVAL,
+        "flux_sign_async_create fails without THREADSAFE");
+    flux_security_destroy (ctx);
+
+    ctx = context_init_flags (conf, FLUX_SECURITY_THREADSAFE);
+    errno = 0;
+    ok (flux_sign_async_create (ctx, 0, 0) == NULL && errno == EINVAL,
+        "flux_sign_async_create nthreads=0 fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_async_create (ctx, 4, 1) == NULL && errno == EINVAL,
+        "flux_sign_async_create flags=1 fails with EINVAL");
+    as = flux_sign_async_create (ctx, 4, 0);
+    ok (as != NULL,
+        "flux_sign_async_create works");
+    if (!as)
+        BAIL_OUT ("flux_sign_async_create failed");
+    ok (flux_sign_async_fd (as) >= 0,
+        "flux_sign_async_fd works");
+    ok (flux_sign_async_dispatch (as) == 0,
+        "flux_sign_async_dispatch returns 0 with nothing completed");
+
+    errno = 0;
+    ok (flux_sign_wrap_async (as, "hello", 5, NULL, 0, NULL, NULL) < 0
+        && errno == EINVAL,
+        "flux_sign_wrap_async cb=NULL fails with EINVAL");
+    errno = 0;
+    ok (flux_sign_unwrap_async (as, NULL, 0, async_unwrap_cb, &ur) < 0
+        && errno == EINVAL,
+        "flux_sign_unwrap_async input=NULL fails with EINVAL");
+
+    for (i = 0; i < NASYNC; i++) {
+        if (flux_sign_wrap_async (as, "hello", 5, NULL, 0,
+                                  async_wrap_cb, &wr) < 0)
+            BAIL_OUT ("flux_sign_wrap_async: %s",
+                      flux_security_last_error (ctx));
+    }
+    async_wait (as, &wr, NASYNC);
+    ok (wr.count == NASYNC && wr.errors == 0,
+        "%d async wraps completed", NASYNC);
+
+    for (i = 0; i < NASYNC; i++) {
+        if (flux_sign_unwrap_async (as, wr.outputs[i], 0,
+                                    async_unwrap_cb, &ur) < 0)
+            BAIL_OUT ("flux_sign_unwrap_async: %s",
+                      flux_security_last_error (ctx));
+    }
+    async_wait (as, &ur, NASYNC);
+    ok (ur.count == NASYNC && ur.errors == 0,
+        "%d async unwraps completed and verified", NASYNC);
+
+    if (flux_sign_unwrap_async (as, "bad.input", 0, async_fail_cb, &fr) < 0)
+        BAIL_OUT ("flux_sign_unwrap_async: %s", flux_security_last_error (ctx));
+    async_wait (as, &fr, 1);
+    ok (fr.count == 1 && fr.errors == 0,
+        "async unwrap of bad input fails with EINVAL");
+
+    /* Leave operations pending at destroy.
+     */
+    for (i = 0; i < NASYNC; i++)
+        (void)flux_sign_unwrap_async (as, wr.outputs[i], 0,
+                                      async_unwrap_cb, &ur);
+    flux_sign_async_destroy (as);
+    ok (ur.count == NASYNC,
+        "flux_sign_async_destroy discards pending operations");
+
+    for (i = 0; i < NASYNC; i++)
+        free (wr.outputs[i]);
+    flux_security_destroy (ctx);
+}
+
 int main (int argc, char *argv[])
 {
     flux_security_t *ctx;
@@ -560,6 +1405,12 @@ int main (int argc, char *argv[])
 
     ctx = context_init (conf);
     test_basic (ctx);
+    test_batch (ctx);
+    test_into (ctx);
+    test_deferred (ctx);
+    test_unwrap_batch (ctx);
+    test_stream (ctx);
+    test_prefix (ctx);
     test_mechselect (ctx);
     test_badheader (ctx);
     test_badpayload (ctx);
@@ -567,6 +1418,12 @@ int main (int argc, char *argv[])
     test_corner (ctx);
     flux_security_destroy (ctx);
 
+    test_threadsafe (conf, "");
+    test_threadsafe (conf_verify_cache, " and shared verify cache");
+    test_unwrap_batch_threadsafe ();
+    test_stats ();
+    test_async ();
+
     cfpath_fini ();
 
     done_testing ();
@@ -0,0 +1,156 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "src/libtap/tap.h"
+#include "src/lib/sign_batch.h"
+
+#define NTHREADS 4
+
+struct completer {
+    struct sign_batch *batch;
+    int start;
+    pthread_t t;
+};
+
+/* Complete a strided subset of the batch in reverse order, as a device
+ * completion handler might.  Every 5th item fails.
+ */
+static void *completer (void *arg)
+{
+    struct completer *c = arg;
+    int count = sign_batch_count (c->batch);
+    int i;
+
+    for (i = count - 1 - c->start; i >= 0; i -= NTHREADS) {
+        char *sig;
+        int inputsz;
+        const char *input = sign_batch_input (c->batch, i, &inputsz);
+
+        if (i % 5 == 0)
+            sign_batch_complete (c->batch, i, NULL, EPERM, "item failed");
+        else if (asprintf (&sig, "sig-%.*s", inputsz, input) < 0)
+            sign_batch_complete (c->batch, i, NULL, ENOMEM, NULL);
+        else
+            sign_batch_complete (c->batch, i, sig, 0, NULL);
+    }
+    return NULL;
+}
+
+void test_basic (void)
+{
+    struct sign_batch *batch;
+    int inputsz;
+
+    ok (sign_batch_create (-1) == NULL && errno == EINVAL,
+        "sign_batch_create count=-1 fails with EINVAL");
+
+    batch = sign_batch_create (0);
+    ok (batch != NULL && sign_batch_count (batch) == 0,
+        "sign_batch_create count=0 works");
+    sign_batch_wait (batch);
+    ok (sign_batch_error (batch) == NULL,
+        "sign_batch_wait returns immediately for empty batch");
+    sign_batch_destroy (batch);
+
+    batch = sign_batch_create (2);
+    ok (batch != NULL && sign_batch_count (batch) == 2,
+        "sign_batch_create count=2 works");
+    sign_batch_set (batch, 0, "abc.def", 7, NULL, NULL);
+    ok (sign_batch_input (batch, 0, &inputsz) != NULL && inputsz == 7
+        && sign_batch_header (batch, 0) == NULL
+        && sign_batch_signature (batch, 0) == NULL,
+        "sign_batch_set sets input of item for signing");
+    sign_batch_set (batch, 1, "abc.def.sig", 7, NULL, "sig");
+    ok (!strcmp (sign_batch_signature (batch, 1), "sig"),
+        "sign_batch_set sets signature of item for verifying");
+
+    sign_batch_complete (batch, 1, NULL, 0, NULL);
+    sign_batch_complete (batch, 1, NULL, EPERM, "late");
+    sign_batch_fail_pending (batch, EIO, "pending failed");
+    sign_batch_wait (batch);
+    ok (sign_batch_result (batch, 1, NULL) == 0,
+        "a second completion of an item is ignored");
+    ok (sign_batch_result (batch, 0, NULL) == EIO,
+        "sign_batch_fail_pending fails items not yet complete");
+    ok (sign_batch_error (batch)
+        && !strcmp (sign_batch_error (batch), "pending failed"),
+        "sign_batch_error returns first error message");
+    sign_batch_destroy (batch);
+}
+
+void test_threads (void)
+{
+    struct sign_batch *batch;
+    struct completer c[NTHREADS];
+    char inputs[100][16];
+    int count = 100;
+    int errors = 0;
+    int i;
+
+    if (!(batch = sign_batch_create (count)))
+        BAIL_OUT ("sign_batch_create failed");
+    for (i = 0; i < count; i++) {
+        snprintf (inputs[i], sizeof (inputs[i]), "%d", i);
+        sign_batch_set (batch, i, inputs[i], strlen (inputs[i]), NULL, NULL);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        c[i].batch = batch;
+        c[i].start = i;
+        if (pthread_create (&c[i].t, NULL, completer, &c[i]) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    sign_batch_wait (batch);
+    for (i = 0; i < count; i++) {
+        char expected[32];
+        char *sig = NULL;
+        int errnum = sign_batch_result (batch, i, &sig);
+
+        snprintf (expected, sizeof (expected), "sig-%d", i);
+        if (i % 5 == 0) {
+            if (errnum != EPERM || sig != NULL)
+                errors++;
+        }
+        else if (errnum != 0 || !sig || strcmp (sig, expected) != 0)
+            errors++;
+        free (sig);
+    }
+    ok (errors == 0,
+        "sign_batch_wait returns after %d threads complete %d items",
+        NTHREADS, count);
+    ok (sign_batch_error (batch)
+        && !strcmp (sign_batch_error (batch), "item failed"),
+        "sign_batch_error returns message of failed item");
+    for (i = 0; i < NTHREADS; i++)
+        pthread_join (c[i].t, NULL);
+    sign_batch_destroy (batch);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    test_basic ();
+    test_threads ();
+
+    done_testing ();
+}
+
+/*
+ * vi: ts=4 sw=4 expandtab
+ */
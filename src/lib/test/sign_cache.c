@@ -0,0 +1,244 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "src/libtap/tap.h"
+#include "src/lib/sign_cache.h"
+
+static void make_digest (uint8_t *digest, int n)
+{
+    SHA256_CTX shx;
+
+    sha256_init (&shx);
+    sha256_update (&shx, (const BYTE *)&n, sizeof (n));
+    sha256_final (&shx, digest);
+}
+
+void test_basic (void)
+{
+    struct sign_cache *cache;
+    uint8_t d1[SHA256_BLOCK_SIZE];
+    uint8_t d2[SHA256_BLOCK_SIZE];
+    int mech;
+    int64_t userid;
+
+    make_digest (d1, 1);
+    make_digest (d2, 2);
+
+    cache = sign_cache_create (4, NULL);
+    ok (cache != NULL,
+        "sign_cache_create works");
+    ok (sign_cache_count (cache) == 0,
+        "cache is empty");
+    errno = 0;
+    ok (sign_cache_lookup (cache, d1, 100, &mech, &userid, NULL) < 0
+        && errno == ENOENT,
+        "sign_cache_lookup on empty cache fails with ENOENT");
+
+    sign_cache_insert (cache, d1, 200, 2, 42, NULL);
+    ok (sign_cache_count (cache) == 1,
+        "sign_cache_insert added an entry");
+    mech = -1;
+    userid = -1;
+    ok (sign_cache_lookup (cache, d1, 100, &mech, &userid, NULL) == 0
+        && mech == 2 && userid == 42,
+        "sign_cache_lookup finds entry");
+    ok (sign_cache_lookup (cache, d1, 200, &mech, &userid, NULL) == 0,
+        "sign_cache_lookup finds entry at expiration time");
+    errno = 0;
+    ok (sign_cache_lookup (cache, d2, 100, &mech, &userid, NULL) < 0
+        && errno == ENOENT,
+        "sign_cache_lookup of unknown digest fails with ENOENT");
+
+    sign_cache_insert (cache, d1, 300, 1, 43, NULL);
+    ok (sign_cache_count (cache) == 1
+        && sign_cache_lookup (cache, d1, 250, &mech, &userid, NULL) == 0
+        && mech == 1 && userid == 43,
+        "sign_cache_insert replaces existing entry");
+
+    errno = 0;
+    ok (sign_cache_lookup (cache, d1, 301, &mech, &userid, NULL) < 0
+        && errno == ENOENT,
+        "sign_cache_lookup after expiration fails with ENOENT");
+    ok (sign_cache_count (cache) == 0,
+        "expired entry was dropped");
+
+    sign_cache_destroy (cache);
+
+    errno = 0;
+    ok (sign_cache_create (0, NULL) == NULL && errno == EINVAL,
+        "sign_cache_create size=0 fails with EINVAL");
+    errno = 0;
+    ok (sign_cache_lookup (NULL, d1, 0, &mech, &userid, NULL) < 0
+        && errno == ENOENT,
+        "sign_cache_lookup cache=NULL fails with ENOENT");
+    lives_ok ({sign_cache_insert (NULL, d1, 0, 0, 0, NULL);},
+        "sign_cache_insert cache=NULL doesn't crash");
+    lives_ok ({sign_cache_destroy (NULL);},
+        "sign_cache_destroy NULL doesn't crash");
+}
+
+void test_lru (void)
+{
+    struct sign_cache *cache;
+    uint8_t d[SHA256_BLOCK_SIZE];
+    int mech;
+    int64_t userid;
+    int i;
+    int errors;
+
+    if (!(cache = sign_cache_create (8, NULL)))
+        BAIL_OUT ("sign_cache_create failed");
+    for (i = 0; i < 8; i++) {
+        make_digest (d, i);
+        sign_cache_insert (cache, d, 100, 0, i, NULL);
+    }
+    ok (sign_cache_count (cache) == 8,
+        "filled cache with 8 entries");
+
+    /* Touch entry 0 so entry 1 becomes least recently used.
+     */
+    make_digest (d, 0);
+    ok (sign_cache_lookup (cache, d, 0, &mech, &userid, NULL) == 0
+        && userid == 0,
+        "looked up entry 0");
+    make_digest (d, 8);
+    sign_cache_insert (cache, d, 100, 0, 8, NULL);
+    ok (sign_cache_count (cache) == 8,
+        "insert into full cache does not grow it");
+    make_digest (d, 1);
+    ok (sign_cache_lookup (cache, d, 0, &mech, &userid, NULL) < 0,
+        "least recently used entry was evicted");
+    make_digest (d, 0);
+    ok (sign_cache_lookup (cache, d, 0, &mech, &userid, NULL) == 0,
+        "recently used entry was retained");
+
+    for (i = 9; i < 1000; i++) {
+        make_digest (d, i);
+        sign_cache_insert (cache, d, 100, 0, i, NULL);
+    }
+    errors = 0;
+    for (i = 0; i < 1000; i++) {
+        int rc;
+        make_digest (d, i);
+        rc = sign_cache_lookup (cache, d, 0, &mech, &userid, NULL);
+        if (i < 992 ? rc == 0 : (rc < 0 || userid != i))
+            errors++;
+    }
+    ok (errors == 0 && sign_cache_count (cache) == 8,
+        "after many inserts, only the 8 most recent remain");
+
+    sign_cache_destroy (cache);
+}
+
+static int freed;
+
+static void free_data (void *data)
+{
+    freed++;
+    free (data);
+}
+
+void test_data (void)
+{
+    struct sign_cache *cache;
+    uint8_t d[SHA256_BLOCK_SIZE];
+    void *data;
+    int i;
+
+    if (!(cache = sign_cache_create (2, free_data)))
+        BAIL_OUT ("sign_cache_create failed");
+    for (i = 0; i < 3; i++) {
+        int *p;
+        if (!(p = malloc (sizeof (*p))))
+            BAIL_OUT ("malloc failed");
+        *p = i;
+        make_digest (d, i);
+        sign_cache_insert (cache, d, 100, 0, 0, p);
+    }
+    ok (freed == 1,
+        "data of evicted entry was freed");
+    make_digest (d, 2);
+    data = NULL;
+    ok (sign_cache_lookup (cache, d, 0, NULL, NULL, &data) == 0
+        && data != NULL && *(int *)data == 2,
+        "sign_cache_lookup returns entry data");
+    ok (sign_cache_lookup (cache, d, 101, NULL, NULL, &data) < 0
+        && freed == 2,
+        "data of expired entry was freed");
+    sign_cache_destroy (cache);
+    ok (freed == 3,
+        "sign_cache_destroy freed remaining data");
+}
+
+/* Entries are allocated as the cache fills, so check that LRU order and
+ * lookups survive the entries array moving as it grows.
+ */
+void test_grow (void)
+{
+    struct sign_cache *cache;
+    uint8_t d[SHA256_BLOCK_SIZE];
+    int64_t userid;
+    int i;
+    int errors;
+
+    if (!(cache = sign_cache_create (100, NULL)))
+        BAIL_OUT ("sign_cache_create failed");
+    errors = 0;
+    for (i = 0; i < 100; i++) {
+        make_digest (d, i);
+        if (sign_cache_insert (cache, d, 100, 0, i, NULL) < 0)
+            errors++;
+        make_digest (d, 0);
+        if (sign_cache_lookup (cache, d, 0, NULL, &userid, NULL) < 0
+            || userid != 0)
+            errors++;
+    }
+    ok (errors == 0 && sign_cache_count (cache) == 100,
+        "filled cache of size 100 while entry 0 stays most recent");
+    make_digest (d, 100);
+    ok (sign_cache_insert (cache, d, 100, 0, 100, NULL) == 0
+        && sign_cache_count (cache) == 100,
+        "insert into full cache does not grow it");
+    errors = 0;
+    for (i = 0; i <= 100; i++) {
+        int rc;
+        make_digest (d, i);
+        rc = sign_cache_lookup (cache, d, 0, NULL, &userid, NULL);
+        if (i == 1 ? rc == 0 : (rc < 0 || userid != i))
+            errors++;
+    }
+    ok (errors == 0,
+        "least recently used entry was evicted, the rest retained");
+    errno = 0;
+    ok (sign_cache_insert (NULL, d, 0, 0, 0, NULL) < 0 && errno == EINVAL,
+        "sign_cache_insert cache=NULL fails with EINVAL");
+
+    sign_cache_destroy (cache);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    test_basic ();
+    test_lru ();
+    test_grow ();
+    test_data ();
+
+    done_testing ();
+}
+
+/*
+ * vi: ts=4 sw=4 expandtab
+ */
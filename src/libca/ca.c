@@ -14,6 +14,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,16 +23,68 @@
 #include <stdarg.h>
 #include <uuid.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "src/libutil/cf.h"
 #include "sigcert.h"
+#include "revoke.h"
+#include "vcache.h"
 #include "ca.h"
 
 #define UUID_STRING_SIZE    37  // see uuid_unparse(3)
 
+/* Check revoke-dir and revoke-list for changes at most this often (seconds).
+ */
+static const double revoke_interval = 1.;
+
+/* An intermediate CA cert, verified against the CA cert when it was added.
+ */
+struct intermediate {
+    struct sigcert *cert;
+    const char *uuid;           // points into cert metadata
+    time_t not_valid_before_time;
+    time_t xtime;
+};
+
+/* A public CA cert loaded by ca_load(), shared by all ca objects in the
+ * process that loaded the same file.  The file is identified by the
+ * path, inode and mtime of its public part.
+ */
+struct cert_cache {
+    struct cert_cache *next;
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    struct sigcert *cert;
+    int refcount;
+};
+
+static pthread_mutex_t cert_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cert_cache *cert_cache;   // protected by cert_cache_lock
+
 struct ca {
-    cf_t *cf;                   // config table is cached
     struct sigcert *ca_cert;    // the CA certificate
+    struct cert_cache *ca_cert_ref; // set if ca_cert is shared
+    const char *ca_uuid;        // uuid of ca_cert, or NULL
+    bool ca_capability;         // ca_cert has ca-capability = true
+    struct intermediate *intermediates;
+    int intermediate_count;
+    struct vcache *vcache;      // verified certs from verified-cache, or NULL
+    struct revoke *revoke;      // revoked cert uuids from revoke-dir/list
+
+    /* options resolved from config
+     */
+    int64_t max_cert_ttl;
+    int64_t max_sign_ttl;
+    char *cert_path;
+    char *revoke_dir;
+    bool revoke_allow;
+    char *revoke_list;          // NULL if not configured
+    char *intermediate_dir;     // NULL if not configured
+    char *verified_cache;       // NULL if not configured
+    char *domain;
 };
 
 static const struct cf_option ca_opts[] = {
@@ -40,10 +93,27 @@ static const struct cf_option ca_opts[] = {
     {"cert-path",       CF_STRING,   true},
     {"revoke-dir",      CF_STRING,   true},
     {"revoke-allow",    CF_BOOL,     true},
+    {"revoke-list",     CF_STRING,   false},
+    {"intermediate-dir", CF_STRING,  false},
+    {"verified-cache",  CF_STRING,   false},
     {"domain",          CF_STRING,   true},
     CF_OPTIONS_TABLE_END,
 };
 
+// ca_opts indices
+enum {
+    CA_MAX_CERT_TTL,
+    CA_MAX_SIGN_TTL,
+    CA_CERT_PATH,
+    CA_REVOKE_DIR,
+    CA_REVOKE_ALLOW,
+    CA_REVOKE_LIST,
+    CA_INTERMEDIATE_DIR,
+    CA_VERIFIED_CACHE,
+    CA_DOMAIN,
+    CA_NOPTS,
+};
+
 /* Update 'e' if non-NULL.
  * If 'fmt' is non-NULL, build message; otherwise use strerror (errno).
  */
@@ -64,17 +134,49 @@ static void ca_error (ca_error_t e, const char *fmt, ...)
     }
 }
 
+/* Copy optional string 'val' to 'sp', or set it to NULL if 'val' is NULL.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int opt_strdup (const cf_t *val, char **sp)
+{
+    *sp = NULL;
+    if (val && !(*sp = strdup (cf_string (val))))
+        return -1;
+    return 0;
+}
+
+/* Resolve the options of 'cf', which has been checked against ca_opts,
+ * once so they need not be looked up on each use.  Only the resolved
+ * values are copied, since the config may be large and is often shared
+ * with a security context.
+ */
 static struct ca *ca_alloc (const cf_t *cf)
 {
     struct ca *ca;
+    const cf_t *val[CA_NOPTS];
 
     if (!(ca = calloc (1, sizeof (*ca))))
         return NULL;
-    if (!(ca->cf = cf_copy (cf))) {
-        ca_destroy (ca);
-        return NULL;
-    }
+    if (cf_resolve (cf, ca_opts, CF_STRICT, val, NULL) < 0)
+        goto error;
+    ca->max_cert_ttl = cf_int64 (val[CA_MAX_CERT_TTL]);
+    ca->max_sign_ttl = cf_int64 (val[CA_MAX_SIGN_TTL]);
+    ca->revoke_allow = cf_bool (val[CA_REVOKE_ALLOW]);
+    if (opt_strdup (val[CA_CERT_PATH], &ca->cert_path) < 0
+        || opt_strdup (val[CA_REVOKE_DIR], &ca->revoke_dir) < 0
+        || opt_strdup (val[CA_REVOKE_LIST], &ca->revoke_list) < 0
+        || opt_strdup (val[CA_INTERMEDIATE_DIR], &ca->intermediate_dir) < 0
+        || opt_strdup (val[CA_VERIFIED_CACHE], &ca->verified_cache) < 0
+        || opt_strdup (val[CA_DOMAIN], &ca->domain) < 0)
+        goto error;
+    if (!(ca->revoke = revoke_create (ca->revoke_dir,
+                                      ca->revoke_list,
+                                      revoke_interval)))
+        goto error;
     return ca;
+error:
+    ca_destroy (ca);
+    return NULL;
 }
 
 /* N.B. ensure 'error' (if set) is valid on EINVAL return
@@ -104,28 +206,149 @@ error:
     return NULL;
 }
 
+static void intermediates_clear (struct ca *ca)
+{
+    int i;
+
+    for (i = 0; i < ca->intermediate_count; i++)
+        sigcert_destroy (ca->intermediates[i].cert);
+    free (ca->intermediates);
+    ca->intermediates = NULL;
+    ca->intermediate_count = 0;
+}
+
+static bool cert_cache_match (const struct cert_cache *entry,
+                              const char *path, const struct stat *st)
+{
+    return entry->dev == st->st_dev
+        && entry->ino == st->st_ino
+        && entry->size == st->st_size
+        && entry->mtime.tv_sec == st->st_mtim.tv_sec
+        && entry->mtime.tv_nsec == st->st_mtim.tv_nsec
+        && strcmp (entry->path, path) == 0;
+}
+
+static int stat_pub (const char *path, struct stat *st)
+{
+    char name_pub[PATH_MAX + 1];
+
+    if (snprintf (name_pub, sizeof (name_pub), "%s.pub", path)
+        >= sizeof (name_pub)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return stat (name_pub, st);
+}
+
+/* Drop a reference on a shared CA cert, destroying it with the last one.
+ */
+static void cert_cache_put (struct cert_cache *entry)
+{
+    struct cert_cache **pp;
+
+    if (!entry)
+        return;
+    pthread_mutex_lock (&cert_cache_lock);
+    if (--entry->refcount > 0) {
+        pthread_mutex_unlock (&cert_cache_lock);
+        return;
+    }
+    for (pp = &cert_cache; *pp; pp = &(*pp)->next) {
+        if (*pp == entry) {
+            *pp = entry->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&cert_cache_lock);
+    sigcert_destroy (entry->cert);
+    free (entry->path);
+    free (entry);
+}
+
+/* Get a reference on the shared public CA cert at 'path', loading it
+ * if it is not cached or the file has changed.
+ * Return entry on success, NULL on failure with errno set.
+ */
+static struct cert_cache *cert_cache_get (const char *path)
+{
+    struct cert_cache *entry;
+    struct stat st;
+    struct stat st2;
+
+    if (stat_pub (path, &st) < 0)
+        return NULL;
+    pthread_mutex_lock (&cert_cache_lock);
+    for (entry = cert_cache; entry; entry = entry->next) {
+        if (cert_cache_match (entry, path, &st)) {
+            entry->refcount++;
+            pthread_mutex_unlock (&cert_cache_lock);
+            return entry;
+        }
+    }
+    pthread_mutex_unlock (&cert_cache_lock);
+
+    if (!(entry = calloc (1, sizeof (*entry))))
+        return NULL;
+    entry->refcount = 1;
+    if (!(entry->path = strdup (path))
+        || !(entry->cert = sigcert_load (path, false)))
+        goto error;
+    /* If the file changed while it was loaded, it cannot be identified by
+     * 'st', so leave the entry out of the cache.
+     */
+    if (stat_pub (path, &st2) < 0)
+        goto error;
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    if (cert_cache_match (entry, path, &st2)) {
+        pthread_mutex_lock (&cert_cache_lock);
+        entry->next = cert_cache;
+        cert_cache = entry;
+        pthread_mutex_unlock (&cert_cache_lock);
+    }
+    return entry;
+error:
+    cert_cache_put (entry);
+    return NULL;
+}
+
 void ca_destroy (struct ca *ca)
 {
     if (ca) {
         int saved_errno = errno;
-        sigcert_destroy (ca->ca_cert);
-        cf_destroy (ca->cf);
+        intermediates_clear (ca);
+        vcache_close (ca->vcache);
+        if (ca->ca_cert_ref)
+            cert_cache_put (ca->ca_cert_ref);
+        else
+            sigcert_destroy (ca->ca_cert);
+        revoke_destroy (ca->revoke);
+        free (ca->cert_path);
+        free (ca->revoke_dir);
+        free (ca->revoke_list);
+        free (ca->intermediate_dir);
+        free (ca->verified_cache);
+        free (ca->domain);
         free (ca);
         errno = saved_errno;
     }
 }
 
+/* Sign 'cert' with 'ca_cert', using 'now' as the creation time.
+ */
 static int sign_with (const struct ca *ca, const struct sigcert *ca_cert,
-                      struct sigcert *cert, time_t not_valid_before_time,
+                      struct sigcert *cert, time_t now,
+                      time_t not_valid_before_time,
                       int64_t ttl, int64_t userid,
                       bool ca_capability, ca_error_t e)
 {
-    int64_t max_cert_ttl = cf_int64 (cf_get_in (ca->cf, "max-cert-ttl"));
-    int64_t max_sign_ttl = cf_int64 (cf_get_in (ca->cf, "max-sign-ttl"));
-    const char *domain = cf_string (cf_get_in (ca->cf, "domain"));
+    int64_t max_cert_ttl = ca->max_cert_ttl;
+    int64_t max_sign_ttl = ca->max_sign_ttl;
+    const char *domain = ca->domain;
     uuid_t uuid_bin;
     char uuid[UUID_STRING_SIZE];
-    time_t now;
     const char *ca_uuid;
 
     if (ttl > max_cert_ttl) {
@@ -135,8 +358,6 @@ static int sign_with (const struct ca *ca, const struct sigcert *ca_cert,
     }
     if (ttl == 0)
         ttl = max_cert_ttl;
-    if (time (&now) == (time_t)-1)
-        goto error;
     if (not_valid_before_time == 0)
         not_valid_before_time = now;
 
@@ -177,31 +398,115 @@ error:
     return -1;
 }
 
+/* Replace the CA cert with 'cert', taking ownership of it.
+ * Properties of the CA cert that verification depends on are checked here,
+ * once, rather than on every ca_verify().  Intermediates and the verified
+ * cert cache, which are only valid for the old CA cert, are dropped.
+ */
+/* Replace the CA cert with 'cert', which is shared via 'ref' if non-NULL.
+ */
+static void set_ca_cert (struct ca *ca, struct sigcert *cert,
+                         struct cert_cache *ref)
+{
+    bool ca_capability;
+    const char *uuid;
+
+    if (sigcert_meta_get (cert, "ca-capability", SM_BOOL,
+                          &ca_capability) < 0)
+        ca_capability = false;
+    if (sigcert_meta_get (cert, "uuid", SM_STRING, &uuid) < 0)
+        uuid = NULL;
+    intermediates_clear (ca);
+    vcache_close (ca->vcache);
+    ca->vcache = NULL;
+    if (ca->ca_cert_ref)
+        cert_cache_put (ca->ca_cert_ref);
+    else
+        sigcert_destroy (ca->ca_cert);
+    ca->ca_cert = cert;
+    ca->ca_cert_ref = ref;
+    ca->ca_uuid = uuid;
+    ca->ca_capability = ca_capability;
+}
+
+/* Fail if the CA cannot sign user certs.
+ */
+static int check_can_sign (const struct ca *ca, ca_error_t e)
+{
+    if (!ca->ca_cert) {
+        errno = EINVAL;
+        ca_error (e, "CA cert has not been loaded/generated");
+        return -1;
+    }
+    if (!sigcert_has_secret (ca->ca_cert)) {
+        errno = EINVAL;
+        ca_error (e, "CA cert does not contain secret key");
+        return -1;
+    }
+    return 0;
+}
+
 int ca_sign (const struct ca *ca, struct sigcert *cert,
              time_t not_valid_before_time, int64_t ttl,
              int64_t userid, ca_error_t e)
 {
+    time_t now;
+
     if (!ca || !cert || ttl < 0 || not_valid_before_time < 0 || userid < 0) {
         errno = EINVAL;
         ca_error (e, NULL);
         return -1;
     }
-    if (!ca->ca_cert) {
-        errno = EINVAL;
-        ca_error (e, "CA cert has not been loaded/generated");
+    if (check_can_sign (ca, e) < 0)
+        return -1;
+    if (time (&now) == (time_t)-1) {
+        ca_error (e, NULL);
         return -1;
     }
-    if (!sigcert_has_secret (ca->ca_cert)) {
+    return sign_with (ca, ca->ca_cert, cert, now, not_valid_before_time, ttl,
+                      userid, false, e);
+}
+
+int ca_sign_batch (const struct ca *ca, struct sigcert **certs, int count,
+                   time_t not_valid_before_time, int64_t ttl,
+                   const int64_t *userids, ca_error_t e)
+{
+    time_t now;
+    int i;
+
+    if (!ca || count < 0 || (count > 0 && (!certs || !userids))
+        || ttl < 0 || not_valid_before_time < 0) {
         errno = EINVAL;
-        ca_error (e, "CA cert does not contain secret key");
+        ca_error (e, NULL);
         return -1;
     }
-    return sign_with (ca, ca->ca_cert, cert, not_valid_before_time, ttl,
-                      userid, false, e);
+    for (i = 0; i < count; i++) {
+        if (!certs[i] || userids[i] < 0) {
+            errno = EINVAL;
+            ca_error (e, "cert %d: %s", i, strerror (errno));
+            return -1;
+        }
+    }
+    if (check_can_sign (ca, e) < 0)
+        return -1;
+    if (time (&now) == (time_t)-1) {
+        ca_error (e, NULL);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        ca_error_t error;
+        if (sign_with (ca, ca->ca_cert, certs[i], now, not_valid_before_time,
+                       ttl, userids[i], false, error) < 0) {
+            ca_error (e, "cert %d: %s", i, error);
+            return -1;
+        }
+    }
+    return count;
 }
 
 int ca_revoke (const struct ca *ca, const char *uuid, ca_error_t e)
 {
+    const char *list;
     const char *dir;
     char path[PATH_MAX + 1];
     int fd;
@@ -210,11 +515,18 @@ int ca_revoke (const struct ca *ca, const char *uuid, ca_error_t e)
         errno = EINVAL;
         goto error;
     }
-    if (!cf_bool (cf_get_in (ca->cf, "revoke-allow"))) {
+    if (!ca->revoke_allow) {
         ca_error (e, "revocation not permitted on this node");
         return -1;
     }
-    dir = cf_string (cf_get_in (ca->cf, "revoke-dir"));
+    if ((list = ca->revoke_list)) {
+        if (revoke_append (ca->revoke, uuid) < 0) {
+            ca_error (e, "%s: %s", list, strerror (errno));
+            return -1;
+        }
+        return 0;
+    }
+    dir = ca->revoke_dir;
     if (mkdir (dir, 0755) < 0) {
         if (errno != EEXIST)
             goto error;
@@ -231,23 +543,28 @@ int ca_revoke (const struct ca *ca, const char *uuid, ca_error_t e)
         ca_error (e, "%s: %s", path, strerror (errno));
         return -1;
     }
+    if (revoke_add (ca->revoke, uuid) < 0)
+        goto error;
     return 0;
 error:
     ca_error (e, NULL);
     return -1;
 }
 
-static int check_revocation (const struct ca *ca, const char *uuid,
-                             ca_error_t e)
+int ca_check_revocation (const struct ca *ca, const char *uuid, ca_error_t e)
 {
-    char path[PATH_MAX + 1];
-    const char *dir = cf_string (cf_get_in (ca->cf, "revoke-dir"));
-    if (snprintf (path, sizeof (path), "%s/%s", dir, uuid) >= sizeof (path)) {
+    bool revoked;
+
+    if (!ca || !uuid) {
         errno = EINVAL;
         ca_error (e, NULL);
         return -1;
     }
-    if (access (path, F_OK) == 0) {
+    if (revoke_check (ca->revoke, uuid, &revoked) < 0) {
+        ca_error (e, "revocation check failed: %s", strerror (errno));
+        return -1;
+    }
+    if (revoked) {
         errno = EINVAL;
         ca_error (e, "cert has been revoked");
         return -1;
@@ -255,90 +572,518 @@ static int check_revocation (const struct ca *ca, const char *uuid,
     return 0;
 }
 
-int ca_verify (const struct ca *ca, const struct sigcert *cert,
-               int64_t *useridp, int64_t *max_sign_ttlp, ca_error_t e)
+int ca_revoke_publish (const struct ca *ca, const char *path, ca_error_t e)
 {
-    int64_t max_sign_ttl;
-    int64_t userid;
-    time_t ctime;
-    time_t xtime;
-    time_t not_valid_before_time;
+    if (!ca || !path) {
+        errno = EINVAL;
+        ca_error (e, NULL);
+        return -1;
+    }
+    if (revoke_publish (ca->revoke, path) < 0) {
+        ca_error (e, "%s: %s", path, strerror (errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Verify that 'cert' was signed by 'signer', is valid at 'now', and has
+ * not been revoked.
+ */
+static int verify_with (const struct ca *ca, const struct sigcert *signer,
+                        const struct sigcert *cert, time_t now,
+                        int64_t *useridp, int64_t *max_sign_ttlp,
+                        ca_error_t e)
+{
+    struct sigcert_claims c;
+
+    if (sigcert_verify_cert (signer, cert) < 0) {
+        ca_error (e, "signature verification failed");
+        errno = EINVAL;
+        return -1;
+    }
+    if (sigcert_get_claims (cert, &c) < 0) {
+        ca_error (e, "required metadata is missing from cert");
+        errno = EINVAL;
+        return -1;
+    }
+    if (c.xtime < now) {
+        ca_error (e, "cert has expired");
+        errno = EINVAL;
+        return -1;
+    }
+    if (c.not_valid_before_time > now) {
+        ca_error (e, "cert is not yet valid");
+        errno = EINVAL;
+        return -1;
+    }
+    if (ca_check_revocation (ca, c.uuid, e) < 0)
+        return -1;
+    if (useridp)
+        *useridp = c.userid;
+    if (max_sign_ttlp)
+        *max_sign_ttlp = c.max_sign_ttl;
+    return 0;
+}
+
+/* Return the cached intermediate that issued 'cert', or NULL.
+ */
+static const struct intermediate *find_issuer (const struct ca *ca,
+                                               const struct sigcert *cert)
+{
+    const char *issuer;
+    int i;
+
+    if (ca->intermediate_count == 0
+        || sigcert_meta_get (cert, "issuer", SM_STRING, &issuer) < 0
+        || (ca->ca_uuid && !strcmp (issuer, ca->ca_uuid)))
+        return NULL;
+    for (i = 0; i < ca->intermediate_count; i++) {
+        if (!strcmp (ca->intermediates[i].uuid, issuer))
+            return &ca->intermediates[i];
+    }
+    return NULL;
+}
+
+/* Check the cached validity window and revocation status of 'im'.
+ * Its signature against the CA cert was verified when it was added.
+ */
+static int check_intermediate (const struct ca *ca,
+                               const struct intermediate *im,
+                               time_t now,
+                               ca_error_t e)
+{
+    bool revoked;
+
+    if (im->xtime < now) {
+        ca_error (e, "intermediate CA cert has expired");
+        errno = EINVAL;
+        return -1;
+    }
+    if (im->not_valid_before_time > now) {
+        ca_error (e, "intermediate CA cert is not yet valid");
+        errno = EINVAL;
+        return -1;
+    }
+    if (revoke_check (ca->revoke, im->uuid, &revoked) < 0) {
+        ca_error (e, "revocation check failed: %s", strerror (errno));
+        return -1;
+    }
+    if (revoked) {
+        ca_error (e, "intermediate CA cert has been revoked");
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Verify 'cert' using the verified cert cache, which holds the metadata of
+ * certs that were fully verified, keyed by signed digest.
+ * Return 1 if verified, 0 if the cert is not in the cache and must be
+ * fully verified, or -1 on failure.
+ */
+static int verify_cached (const struct ca *ca, const struct sigcert *cert,
+                          time_t now, int64_t *useridp, int64_t *max_sign_ttlp,
+                          ca_error_t e)
+{
+    struct vcache_entry entry;
+    uint8_t digest[SIGCERT_FINGERPRINT_SIZE];
+    const struct intermediate *im;
+    const char *issuer;
+
+    if (sigcert_signed_digest (cert, digest) < 0
+        || vcache_lookup (ca->vcache, digest, &entry) < 0
+        || sigcert_meta_get (cert, "issuer", SM_STRING, &issuer) < 0)
+        return 0;
+    /* If the issuer is an intermediate, it must still be trusted here.
+     */
+    if (!ca->ca_uuid || strcmp (issuer, ca->ca_uuid) != 0) {
+        if (!(im = find_issuer (ca, cert)))
+            return 0;
+        if (check_intermediate (ca, im, now, e) < 0)
+            return -1;
+    }
+    if (entry.xtime < now) {
+        ca_error (e, "cert has expired");
+        errno = EINVAL;
+        return -1;
+    }
+    if (entry.not_valid_before_time > now) {
+        ca_error (e, "cert is not yet valid");
+        errno = EINVAL;
+        return -1;
+    }
+    if (ca_check_revocation (ca, entry.uuid, e) < 0)
+        return -1;
+    if (useridp)
+        *useridp = entry.userid;
+    if (max_sign_ttlp)
+        *max_sign_ttlp = entry.max_sign_ttl;
+    return 1;
+}
+
+int ca_verified_cache_write (const struct ca *ca, const char *path,
+                             struct sigcert *const *certs, int count,
+                             ca_error_t e)
+{
+    struct vcache_entry *entries = NULL;
     time_t now;
-    const char *uuid;
-    bool ca_capability;
+    int n = 0;
+    int i;
+
+    if (!ca || !path || count < 0 || (count > 0 && !certs)) {
+        errno = EINVAL;
+        ca_error (e, NULL);
+        return -1;
+    }
+    if (!ca->ca_cert) {
+        ca_error (e, "CA cert has not been loaded/generated");
+        errno = EINVAL;
+        return -1;
+    }
+    if (time (&now) == (time_t)-1
+        || (count > 0 && !(entries = calloc (count, sizeof (*entries))))) {
+        ca_error (e, NULL);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        struct vcache_entry *entry = &entries[n];
+        const struct intermediate *im;
+        const struct sigcert *signer = ca->ca_cert;
+        struct sigcert_claims c;
+
+        /* Verify fully, bypassing any cache already in use.
+         */
+        if (!certs[i])
+            continue;
+        if ((im = find_issuer (ca, certs[i]))) {
+            if (check_intermediate (ca, im, now, NULL) < 0)
+                continue;
+            signer = im->cert;
+        }
+        if (verify_with (ca, signer, certs[i], now, &entry->userid,
+                         &entry->max_sign_ttl, NULL) < 0)
+            continue;
+        /* verify_with() succeeded, so the claims are present.
+         */
+        if (sigcert_get_claims (certs[i], &c) < 0
+            || strlen (c.uuid) >= sizeof (entry->uuid))
+            continue;
+        entry->not_valid_before_time = c.not_valid_before_time;
+        entry->xtime = c.xtime;
+        strcpy (entry->uuid, c.uuid);
+        if (sigcert_signed_digest (certs[i], entry->digest) < 0)
+            continue;
+        n++;
+    }
+    if (vcache_write (path, sigcert_fingerprint (ca->ca_cert), entries,
+                      n) < 0) {
+        ca_error (e, "%s: %s", path, strerror (errno));
+        free (entries);
+        return -1;
+    }
+    free (entries);
+    return n;
+}
+
+int ca_verify_at (const struct ca *ca, const struct sigcert *cert, time_t now,
+                  int64_t *useridp, int64_t *max_sign_ttlp, ca_error_t e)
+{
+    const struct intermediate *im;
 
     if (!ca || !cert) {
         errno = EINVAL;
-        goto error;
+        ca_error (e, NULL);
+        return -1;
     }
     if (!ca->ca_cert) {
         ca_error (e, "CA cert has not been loaded/generated");
         errno = EINVAL;
         return -1;
     }
-    if (sigcert_meta_get (ca->ca_cert, "ca-capability", SM_BOOL,
-                          &ca_capability) < 0 || ca_capability == false) {
+    if (!ca->ca_capability) {
         errno = EINVAL;
         ca_error (e, "ca certificate lacks ca-capability");
         return -1;
     }
-    if (time (&now) == (time_t)-1)
-        goto error;
-    if (sigcert_verify_cert (ca->ca_cert, cert) < 0) {
-        ca_error (e, "signature verification failed");
+    if (ca->vcache) {
+        int rc = verify_cached (ca, cert, now, useridp, max_sign_ttlp, e);
+        if (rc != 0)
+            return rc < 0 ? -1 : 0;
+    }
+    if ((im = find_issuer (ca, cert))) {
+        if (check_intermediate (ca, im, now, e) < 0)
+            return -1;
+        return verify_with (ca, im->cert, cert, now, useridp, max_sign_ttlp,
+                            e);
+    }
+    return verify_with (ca, ca->ca_cert, cert, now, useridp, max_sign_ttlp, e);
+}
+
+int ca_add_intermediate (struct ca *ca, const struct sigcert *cert,
+                         ca_error_t e)
+{
+    struct intermediate im;
+    struct intermediate *new;
+    struct sigcert_claims c;
+    time_t now;
+
+    if (!ca || !cert) {
         errno = EINVAL;
+        ca_error (e, NULL);
         return -1;
     }
-    if (sigcert_meta_get (cert, "uuid", SM_STRING, &uuid) < 0)
-        goto error_cert;
-    if (sigcert_meta_get (cert, "not-valid-before-time", SM_TIMESTAMP,
-                          &not_valid_before_time) < 0)
-        goto error_cert;
-    if (sigcert_meta_get (cert, "ctime", SM_TIMESTAMP, &ctime) < 0)
-        goto error_cert;
-    if (sigcert_meta_get (cert, "xtime", SM_TIMESTAMP, &xtime) < 0)
-        goto error_cert;
-    if (sigcert_meta_get (cert, "userid", SM_INT64, &userid) < 0)
-        goto error_cert;
-    if (sigcert_meta_get (cert, "max-sign-ttl", SM_INT64, &max_sign_ttl) < 0)
-        goto error_cert;
-    if (xtime < now) {
-        ca_error (e, "cert has expired");
+    if (!ca->ca_cert) {
+        ca_error (e, "CA cert has not been loaded/generated");
         errno = EINVAL;
         return -1;
     }
-    if (not_valid_before_time > now) {
-        ca_error (e, "cert is not yet valid");
+    if (sigcert_get_claims (cert, &c) < 0 || !c.ca_capability) {
+        ca_error (e, "intermediate cert lacks ca-capability");
         errno = EINVAL;
         return -1;
     }
-    if (check_revocation (ca, uuid, e) < 0)
+    if (time (&now) == (time_t)-1) {
+        ca_error (e, NULL);
         return -1;
-    if (useridp)
-        *useridp = userid;
-    if (max_sign_ttlp)
-        *max_sign_ttlp = max_sign_ttl;
+    }
+    if (ca_verify_at (ca, cert, now, NULL, NULL, e) < 0)
+        return -1;
+    if (find_issuer (ca, cert)) {
+        ca_error (e, "intermediate cert must be signed by the CA cert");
+        errno = EINVAL;
+        return -1;
+    }
+    /* ca_verify_at() succeeded, so the claims are present.
+     */
+    if (!(im.cert = sigcert_copy (cert))
+        || sigcert_get_claims (im.cert, &c) < 0) {
+        ca_error (e, NULL);
+        sigcert_destroy (im.cert);
+        return -1;
+    }
+    im.uuid = c.uuid;
+    im.not_valid_before_time = c.not_valid_before_time;
+    im.xtime = c.xtime;
+    if (!(new = realloc (ca->intermediates,
+                         sizeof (*new) * (ca->intermediate_count + 1)))) {
+        ca_error (e, NULL);
+        sigcert_destroy (im.cert);
+        return -1;
+    }
+    ca->intermediates = new;
+    ca->intermediates[ca->intermediate_count++] = im;
     return 0;
-error_cert:
-    ca_error (e, "required metadata is missing from cert");
-    errno = EINVAL;
-    return -1;
-error:
-    ca_error (e, NULL);
-    return -1;
+}
+
+int ca_sign_intermediate (const struct ca *ca, struct sigcert *cert,
+                          time_t not_valid_before_time, int64_t ttl,
+                          ca_error_t e)
+{
+    time_t now;
+
+    if (!ca || !cert || ttl < 0 || not_valid_before_time < 0) {
+        errno = EINVAL;
+        ca_error (e, NULL);
+        return -1;
+    }
+    if (check_can_sign (ca, e) < 0)
+        return -1;
+    if (time (&now) == (time_t)-1) {
+        ca_error (e, NULL);
+        return -1;
+    }
+    return sign_with (ca, ca->ca_cert, cert, now, not_valid_before_time, ttl,
+                      getuid (), true, e);
+}
+
+/* Load and add each public cert "name.pub" in 'dir' as an intermediate.
+ */
+static int load_intermediates (struct ca *ca, const char *dir, ca_error_t e)
+{
+    DIR *d;
+    struct dirent *ent;
+    char path[PATH_MAX + 1];
+    int rc = -1;
+
+    if (!(d = opendir (dir))) {
+        if (errno == ENOENT)
+            return 0;
+        ca_error (e, "%s: %s", dir, strerror (errno));
+        return -1;
+    }
+    while ((errno = 0, ent = readdir (d))) {
+        size_t len = strlen (ent->d_name);
+        struct sigcert *cert;
+        ca_error_t error;
+
+        if (len <= 4 || strcmp (ent->d_name + len - 4, ".pub") != 0)
+            continue;
+        if (snprintf (path, sizeof (path), "%s/%.*s",
+                      dir, (int)(len - 4), ent->d_name) >= sizeof (path)) {
+            errno = EINVAL;
+            ca_error (e, "%s: %s", dir, strerror (errno));
+            goto done;
+        }
+        if (!(cert = sigcert_load (path, false))) {
+            ca_error (e, "%s: %s", path, strerror (errno));
+            goto done;
+        }
+        if (ca_add_intermediate (ca, cert, error) < 0) {
+            ca_error (e, "%s: %s", path, error);
+            sigcert_destroy (cert);
+            goto done;
+        }
+        sigcert_destroy (cert);
+    }
+    if (errno != 0) {
+        ca_error (e, "%s: %s", dir, strerror (errno));
+        goto done;
+    }
+    rc = 0;
+done:
+    (void)closedir (d);
+    return rc;
+}
+
+int ca_verify (const struct ca *ca, const struct sigcert *cert,
+               int64_t *useridp, int64_t *max_sign_ttlp, ca_error_t e)
+{
+    time_t now;
+
+    if (time (&now) == (time_t)-1) {
+        ca_error (e, NULL);
+        return -1;
+    }
+    return ca_verify_at (ca, cert, now, useridp, max_sign_ttlp, e);
+}
+
+/* ca_verify_many() state shared by workers.  Workers claim chunks of
+ * certs by advancing 'next'.
+ */
+struct verify_many {
+    const struct ca *ca;
+    struct sigcert *const *certs;
+    struct ca_verify_result *results;
+    int count;
+    time_t now;
+    pthread_mutex_t lock;
+    int next;                   // protected by lock
+    int verified;               // protected by lock
+};
+
+static const int verify_chunk = 64;
+
+static void *verify_worker (void *arg)
+{
+    struct verify_many *vm = arg;
+    int start;
+    int end;
+    int verified;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock (&vm->lock);
+        start = vm->next;
+        end = vm->next = start + verify_chunk < vm->count
+                       ? start + verify_chunk : vm->count;
+        pthread_mutex_unlock (&vm->lock);
+        if (start == end)
+            break;
+        verified = 0;
+        for (i = start; i < end; i++) {
+            struct ca_verify_result *r = &vm->results[i];
+
+            memset (r, 0, sizeof (*r));
+            r->userid = r->max_sign_ttl = -1;
+            if (!vm->certs[i]) {
+                r->errnum = EINVAL;
+                ca_error (r->error, "cert is NULL");
+                continue;
+            }
+            if (ca_verify_at (vm->ca, vm->certs[i], vm->now, &r->userid,
+                              &r->max_sign_ttl, r->error) < 0) {
+                r->errnum = errno ? errno : EINVAL;
+                continue;
+            }
+            verified++;
+        }
+        pthread_mutex_lock (&vm->lock);
+        vm->verified += verified;
+        pthread_mutex_unlock (&vm->lock);
+    }
+    return NULL;
+}
+
+int ca_verify_many (const struct ca *ca, struct sigcert *const *certs,
+                    int count, int nthreads, struct ca_verify_result *results,
+                    ca_error_t e)
+{
+    struct verify_many vm;
+    pthread_t *t;
+    int started = 0;
+    int rc;
+    int i;
+
+    if (!ca || count < 0 || (count > 0 && (!certs || !results))
+        || nthreads < 0) {
+        errno = EINVAL;
+        ca_error (e, NULL);
+        return -1;
+    }
+    memset (&vm, 0, sizeof (vm));
+    vm.ca = ca;
+    vm.certs = certs;
+    vm.results = results;
+    vm.count = count;
+    if (time (&vm.now) == (time_t)-1) {
+        ca_error (e, NULL);
+        return -1;
+    }
+    if (nthreads == 0) {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? ncpu : 1;
+    }
+    if (nthreads > (count + verify_chunk - 1) / verify_chunk)
+        nthreads = (count + verify_chunk - 1) / verify_chunk;
+    pthread_mutex_init (&vm.lock, NULL);
+    if (nthreads > 1) {
+        if (!(t = calloc (nthreads - 1, sizeof (t[0])))) {
+            ca_error (e, NULL);
+            pthread_mutex_destroy (&vm.lock);
+            return -1;
+        }
+        /* If a thread cannot be created, the remaining threads (including
+         * this one) still verify every cert.
+         */
+        for (i = 0; i < nthreads - 1; i++) {
+            if (pthread_create (&t[i], NULL, verify_worker, &vm) != 0)
+                break;
+            started++;
+        }
+    }
+    else
+        t = NULL;
+    (void)verify_worker (&vm);
+    for (i = 0; i < started; i++)
+        (void)pthread_join (t[i], NULL);
+    free (t);
+    rc = vm.verified;
+    pthread_mutex_destroy (&vm.lock);
+    return rc;
 }
 
 int ca_keygen (struct ca *ca, time_t not_valid_before_time,
                int64_t ttl, ca_error_t e)
 {
     struct sigcert *cert = NULL;
+    time_t now;
 
     if (!ca || ttl < 0 || not_valid_before_time < 0) {
         errno = EINVAL;
         ca_error (e, NULL);
         return -1;
     }
-    if (!(cert = sigcert_create ())) {
+    if (time (&now) == (time_t)-1 || !(cert = sigcert_create ())) {
         ca_error (e, NULL);
         return -1;
     }
@@ -346,13 +1091,12 @@ int ca_keygen (struct ca *ca, time_t not_valid_before_time,
      * we would add to a user certificate, except that
      * ca-capability = true.
      */
-    if (sign_with (ca, cert, cert, not_valid_before_time, ttl,
+    if (sign_with (ca, cert, cert, now, not_valid_before_time, ttl,
                    getuid (), true, e) < 0) {
         sigcert_destroy (cert);
         return -1;
     }
-    sigcert_destroy (ca->ca_cert);
-    ca->ca_cert = cert;
+    set_ca_cert (ca, cert, NULL);
     return 0;
 }
 
@@ -365,7 +1109,7 @@ int ca_store (const struct ca *ca, ca_error_t e)
         ca_error (e, NULL);
         return -1;
     }
-    path = cf_string (cf_get_in (ca->cf, "cert-path"));
+    path = ca->cert_path;
     if (!ca->ca_cert) {
         errno = EINVAL;
         ca_error (e, "CA cert was not initialized");
@@ -387,19 +1131,49 @@ int ca_load (struct ca *ca, bool secret, ca_error_t e)
 {
     const char *path;
     struct sigcert *cert;
+    struct cert_cache *ref = NULL;
 
     if (!ca) {
         errno = EINVAL;
         ca_error (e, NULL);
         return -1;
     }
-    path = cf_string (cf_get_in (ca->cf, "cert-path"));
-    if (!(cert = sigcert_load (path, secret))) {
+    path = ca->cert_path;
+    /* The public CA cert is shared with other ca objects that loaded the
+     * same file.  Secret keys are never kept in the shared cache.
+     */
+    if (secret)
+        cert = sigcert_load (path, true);
+    else if ((ref = cert_cache_get (path)))
+        cert = ref->cert;
+    else
+        cert = NULL;
+    if (!cert) {
         ca_error (e, "%s: %s", path, strerror (errno));
         return -1;
     }
-    sigcert_destroy (ca->ca_cert);
-    ca->ca_cert = cert;
+    if (revoke_refresh (ca->revoke) < 0) {
+        ca_error (e, "revocation set: %s", strerror (errno));
+        if (ref)
+            cert_cache_put (ref);
+        else
+            sigcert_destroy (cert);
+        return -1;
+    }
+    set_ca_cert (ca, cert, ref);
+    if (ca->intermediate_dir
+        && load_intermediates (ca, ca->intermediate_dir, e) < 0) {
+        int saved_errno = errno;
+        intermediates_clear (ca);
+        errno = saved_errno;
+        return -1;
+    }
+    /* The verified cert cache is optional: if it is missing, untrusted,
+     * or was written for another CA cert, certs are verified in full.
+     */
+    if (ca->verified_cache)
+        ca->vcache = vcache_open (ca->verified_cache,
+                                  sigcert_fingerprint (ca->ca_cert));
     return 0;
 }
 
@@ -426,8 +1200,7 @@ int ca_set_cert (struct ca *ca, const struct sigcert *ca_cert, ca_error_t e)
         ca_error (e, NULL);
         return -1;
     }
-    sigcert_destroy (ca->ca_cert);
-    ca->ca_cert = cpy;
+    set_ca_cert (ca, cpy, NULL);
     return 0;
 }
 
@@ -33,7 +33,18 @@
  * environments that will authenticate messages.
  *
  * Cert revocation consists of placing the uuid of a cert in a directory
- * that is propagated along with the CA public key.
+ * that is propagated along with the CA public key.  The directory is read
+ * into memory by ca_load() and re-read when it changes, checked at most
+ * once per second, so a revocation takes effect within about a second.
+ *
+ * Intermediate CA certs let sites sign user certs without sharing the
+ * secret key of the CA cert.  An intermediate is a cert with ca-capability
+ * signed by the CA cert.  A site uses it as its own CA cert ('cert-path')
+ * for signing, while verifiers load the CA cert plus the public parts of
+ * intermediates from 'intermediate-dir'.  Each intermediate is verified once
+ * when it is added; a user cert whose issuer is a cached intermediate is
+ * then verified with one signature check against it.  An intermediate may
+ * be revoked like any other cert.
  */
 
 typedef char ca_error_t[200];
@@ -57,16 +68,47 @@ int ca_sign (const struct ca *ca, struct sigcert *cert,
              time_t not_valid_before_time, int64_t ttl,
              int64_t userid, ca_error_t error);
 
+/* Sign 'count' certs in 'certs' as ca_sign() would, setting the userid of
+ * certs[i] to userids[i].  The current time is sampled once, so all certs
+ * in the batch have the same ctime.  Signing stops at the first failure,
+ * leaving later certs unsigned.  Return 'count' on success, -1 on failure
+ * with errno set.  On failure, if 'error' is non-NULL, it will contain a
+ * textual error message that includes the index of the failed cert.
+ */
+int ca_sign_batch (const struct ca *ca, struct sigcert **certs, int count,
+                   time_t not_valid_before_time, int64_t ttl,
+                   const int64_t *userids, ca_error_t error);
+
 /* Add cert identified by 'uuid' to the revocation list.
- * This creates an empty file named 'uuid' in 'revoke-dir'.
+ * If 'revoke-list' is configured, this appends 'uuid' to that file;
+ * otherwise it creates an empty file named 'uuid' in 'revoke-dir'.
  * This function fails if 'revoke-allow' is false on this node,
- * or if the process does not have write permission to that directory.
+ * or if the process does not have write permission to the file/directory.
  * Return 0 on success, -1 on failure with errno set.
  * On failure, if 'error' is non-NULL, it will contain a textual error message.
  */
 int ca_revoke (const struct ca *ca, const char *uuid, ca_error_t error);
 
-/* Verify that cert was signed by CA and has not expired or been revoked.
+/* Write the revocation set (uuids in 'revoke-dir' and 'revoke-list')
+ * to a compact, sorted revocation list file 'path', e.g. for distribution
+ * to nodes that set 'revoke-list' to a copy of it.  The file is replaced
+ * atomically.  Return 0 on success, -1 on failure with errno set.
+ * On failure, if 'error' is non-NULL, it will contain a textual error message.
+ */
+int ca_revoke_publish (const struct ca *ca, const char *path,
+                       ca_error_t error);
+
+/* Fail if cert identified by 'uuid' is in the revocation list.
+ * This is part of ca_verify(), provided separately for callers that cache
+ * verified certs.  It is a lookup in the in-memory revocation set, which
+ * is refreshed first if due.  Return 0 if not revoked, -1 on failure with errno set.
+ * On failure, if 'error' is non-NULL, it will contain a textual error message.
+ */
+int ca_check_revocation (const struct ca *ca, const char *uuid,
+                         ca_error_t error);
+
+/* Verify that cert was signed by CA, or by an intermediate that was added
+ * with ca_add_intermediate(), and that neither has expired or been revoked.
  * This function fails if the CA public key has not been loaded with ca_load
  * or ca_keygen.  Return the userid in 'userid' if non-NULL.
  * Return the max-sign-ttl in 'max_sign_ttl' if non-NULL.
@@ -76,6 +118,68 @@ int ca_revoke (const struct ca *ca, const char *uuid, ca_error_t error);
 int ca_verify (const struct ca *ca, const struct sigcert *cert,
                int64_t *userid, int64_t *max_sign_ttl, ca_error_t error);
 
+/* Same as ca_verify(), but check cert validity times against 'now' rather
+ * than the current time, e.g. so a batch of verifications is consistent.
+ */
+int ca_verify_at (const struct ca *ca, const struct sigcert *cert, time_t now,
+                  int64_t *userid, int64_t *max_sign_ttl, ca_error_t error);
+
+/* Result of one cert verification by ca_verify_many().
+ */
+struct ca_verify_result {
+    int errnum;             // 0 if verified, else errno from ca_verify()
+    int64_t userid;         // -1 if not verified
+    int64_t max_sign_ttl;   // -1 if not verified
+    ca_error_t error;       // textual error message if errnum != 0
+};
+
+/* Verify 'count' certs as ca_verify() would, spreading the work across
+ * 'nthreads' threads (0 = one per online CPU), and store the outcome for
+ * certs[i] in results[i].  The current time is sampled once for the whole
+ * set.  Each cert must appear only once in 'certs'.
+ * Return the number of certs that verified, or -1 on failure with errno
+ * set (in which case no results are stored).
+ * On failure, if 'error' is non-NULL, it will contain a textual error message.
+ */
+int ca_verify_many (const struct ca *ca, struct sigcert *const *certs,
+                    int count, int nthreads, struct ca_verify_result *results,
+                    ca_error_t error);
+
+/* Verify intermediate CA cert 'cert' against the CA cert, and add a copy
+ * to the set of intermediates trusted for ca_verify().  The cert must have
+ * ca-capability, be directly signed by the CA cert, and be valid now.
+ * Intermediates are dropped when the CA cert is replaced.
+ * Return 0 on success, -1 on failure with errno set.
+ * On failure, if 'error' is non-NULL, it will contain a textual error message.
+ */
+int ca_add_intermediate (struct ca *ca, const struct sigcert *cert,
+                         ca_error_t error);
+
+/* Sign 'cert' as an intermediate CA cert.  This is like ca_sign(), except
+ * ca-capability is set to true and the userid is that of the caller.
+ * Return 0 on success, -1 on failure with errno set.
+ * On failure, if 'error' is non-NULL, it will contain a textual error message.
+ */
+int ca_sign_intermediate (const struct ca *ca, struct sigcert *cert,
+                          time_t not_valid_before_time, int64_t ttl,
+                          ca_error_t error);
+
+/* Fully verify each of 'count' certs in 'certs', and write those that pass
+ * to a verified cert cache file 'path' for this CA cert, replacing it
+ * atomically.  This is meant to be run by a trusted (root) process.
+ * Other processes on the node that set 'verified-cache' to 'path' may then
+ * skip the CA signature check in ca_verify() for those certs; validity
+ * times and revocation are still checked on every call.  The file is
+ * only used if it is owned by root (or the process's effective uid) and
+ * is not writable by group or other.
+ * Return the number of certs written on success, -1 on failure with errno
+ * set.  On failure, if 'error' is non-NULL, it will contain a textual
+ * error message.
+ */
+int ca_verified_cache_write (const struct ca *ca, const char *path,
+                             struct sigcert *const *certs, int count,
+                             ca_error_t error);
+
 /* Generate new CA cert in memory, replacing any cached cert with the new one.
  * Return 0 on success, -1 on failure with errno set.
  * On failure, if 'error' is non-NULL, it will contain a textual error message.
@@ -92,6 +196,15 @@ int ca_store (const struct ca *ca, ca_error_t error);
 /* Load CA cert from configured path, replacing any cached cert with load one.
  * Call with secret=true to load secret key for signing certs.
  * Call with secret=false to load only public key for verifying certs.
+ * A public CA cert is parsed once per process and shared by every ca
+ * object that loads the same file; it is re-read when the file's inode
+ * or mtime changes.
+ * The revocation directory is also (re-)read, and if 'intermediate-dir' is
+ * configured, each "name.pub" cert in it is added with ca_add_intermediate().
+ * If any intermediate fails verification, ca_load() fails, leaving the new
+ * CA cert loaded with no intermediates.
+ * If 'verified-cache' is configured, that file is mapped for ca_verify()
+ * (see ca_verified_cache_write()); it is ignored if it cannot be used.
  * Return 0 on success, -1 on failure with errno set.
  * On failure, if 'error' is non-NULL, it will contain a textual error message.
  */
@@ -99,6 +212,7 @@ int ca_load (struct ca *ca, bool secret, ca_error_t error);
 
 /* Accessors for the CA cert.
  * (Mainly for test at this time).
+ * The cert returned by ca_get_cert() may be shared with other ca objects.
  */
 const struct sigcert *ca_get_cert (struct ca *ca, ca_error_t error);
 int ca_set_cert (struct ca *ca, const struct sigcert *cert, ca_error_t error);
@@ -0,0 +1,724 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* revoke.c - in-memory set of revoked cert uuids
+ *
+ * The uuids from the directory are kept in a sorted array of strings.
+ * A refresh stat()s the directory and re-reads it only if its inode, mtime
+ * or ctime changed.  Since a file may be added in the same timestamp "tick"
+ * as the directory was read, the directory is re-read regardless at the
+ * next refresh if it was modified within a second of being read.
+ *
+ * The revocation list file, if any, is memory mapped, and remapped when
+ * its inode, size, mtime or ctime changes.  Its format is (integers are
+ * big-endian):
+ *
+ *   magic        8 bytes "FLUXCRL1"
+ *   bloom_size   4 bytes, size of bloom filter in bytes (power of 2)
+ *   bloom_k      4 bytes, number of bloom filter hash functions
+ *   sorted       4 bytes, number of sorted records
+ *   reserved     4 bytes (zero)
+ *   bloom        bloom_size bytes, covering the sorted records
+ *   records      16 byte binary uuids, 'sorted' in memcmp() order,
+ *                followed by any number appended in arbitrary order
+ *
+ * A lookup tests the bloom filter, then does a binary search of the sorted
+ * records only if that is positive, then scans the appended records.
+ * revoke_publish() rewrites everything as sorted records, so appended
+ * records stay few.  A trailing partial record (an append in progress)
+ * is ignored.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <uuid.h>
+#include <sodium.h>
+
+#include "revoke.h"
+
+#define LIST_MAGIC          "FLUXCRL1"
+#define LIST_HDRSIZE        24
+#define LIST_RECSIZE        16
+#define LIST_BLOOM_K        7
+#define LIST_BLOOM_MINSIZE  64
+#define LIST_BLOOM_BITS_PER_ENTRY 10
+
+struct revoke_list {
+    char *path;
+    const uint8_t *map;         // NULL if file does not exist or is empty
+    size_t mapsz;
+    const uint8_t *bloom;
+    uint32_t bloom_size;
+    uint32_t bloom_k;
+    const uint8_t *sorted;
+    uint32_t sorted_count;
+    const uint8_t *tail;
+    size_t tail_count;
+    struct stat st;             // file attributes when mapped
+};
+
+struct revoke {
+    char *dir;
+    double interval;
+    pthread_mutex_t lock;
+
+    char **uuids;               // sorted
+    int count;
+    int size;
+
+    bool loaded;
+    bool fallback;              // dir cannot be read, check files instead
+    bool unstable;              // dir changed within a second of reading it
+    struct timespec checked;    // CLOCK_MONOTONIC time of last refresh
+    struct stat st;             // dir attributes when last read
+
+    struct revoke_list list;    // list.path is NULL if there is no list
+};
+
+static void list_unmap (struct revoke_list *l)
+{
+    if (l->map)
+        (void)munmap ((void *)l->map, l->mapsz);
+    l->map = NULL;
+    l->mapsz = 0;
+    l->sorted_count = 0;
+    l->tail_count = 0;
+}
+
+static void uuids_free (char **uuids, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        free (uuids[i]);
+    free (uuids);
+}
+
+void revoke_destroy (struct revoke *r)
+{
+    if (r) {
+        int saved_errno = errno;
+        uuids_free (r->uuids, r->count);
+        list_unmap (&r->list);
+        free (r->list.path);
+        pthread_mutex_destroy (&r->lock);
+        free (r->dir);
+        free (r);
+        errno = saved_errno;
+    }
+}
+
+struct revoke *revoke_create (const char *dir, const char *list,
+                              double interval)
+{
+    struct revoke *r;
+
+    if (!dir || interval < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(r = calloc (1, sizeof (*r))))
+        return NULL;
+    pthread_mutex_init (&r->lock, NULL);
+    r->interval = interval;
+    if (!(r->dir = strdup (dir))
+        || (list && !(r->list.path = strdup (list)))) {
+        revoke_destroy (r);
+        return NULL;
+    }
+    return r;
+}
+
+static void put_be32 (uint8_t *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static uint32_t get_be32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+         | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Set 'h1' and 'h2' for double hashing of 'rec' in the bloom filter.
+ */
+static void bloom_hash (const uint8_t *rec, uint64_t *h1, uint64_t *h2)
+{
+    uint8_t digest[16];
+
+    crypto_generichash (digest, sizeof (digest), rec, LIST_RECSIZE, NULL, 0);
+    memcpy (h1, digest, 8);
+    memcpy (h2, digest + 8, 8);
+    *h2 |= 1;
+}
+
+static bool bloom_test (const uint8_t *bloom, uint32_t size, uint32_t k,
+                        const uint8_t *rec)
+{
+    uint64_t h1, h2;
+    uint64_t mask = (uint64_t)size * 8 - 1;
+    uint32_t i;
+
+    bloom_hash (rec, &h1, &h2);
+    for (i = 0; i < k; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        if (!(bloom[bit / 8] & (1 << (bit % 8))))
+            return false;
+    }
+    return true;
+}
+
+static void bloom_set (uint8_t *bloom, uint32_t size, uint32_t k,
+                       const uint8_t *rec)
+{
+    uint64_t h1, h2;
+    uint64_t mask = (uint64_t)size * 8 - 1;
+    uint32_t i;
+
+    bloom_hash (rec, &h1, &h2);
+    for (i = 0; i < k; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        bloom[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+/* Map list file, which has attributes 'st', or unmap if it is empty.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int list_map (struct revoke_list *l, const struct stat *st)
+{
+    const uint8_t *map = NULL;
+    size_t off;
+    int fd;
+
+    list_unmap (l);
+    if (st->st_size > 0) {
+        if ((fd = open (l->path, O_RDONLY | O_CLOEXEC)) < 0)
+            return -1;
+        map = mmap (NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+        (void)close (fd);
+        if (map == MAP_FAILED)
+            return -1;
+        l->map = map;
+        l->mapsz = st->st_size;
+        if (l->mapsz < LIST_HDRSIZE
+            || memcmp (map, LIST_MAGIC, 8) != 0)
+            goto inval;
+        l->bloom_size = get_be32 (map + 8);
+        l->bloom_k = get_be32 (map + 12);
+        l->sorted_count = get_be32 (map + 16);
+        if (l->bloom_size < 8 || (l->bloom_size & (l->bloom_size - 1))
+            || l->bloom_k < 1 || l->bloom_k > 32)
+            goto inval;
+        off = LIST_HDRSIZE + l->bloom_size;
+        if (off > l->mapsz
+            || l->sorted_count > (l->mapsz - off) / LIST_RECSIZE)
+            goto inval;
+        l->bloom = map + LIST_HDRSIZE;
+        l->sorted = map + off;
+        off += (size_t)l->sorted_count * LIST_RECSIZE;
+        l->tail = map + off;
+        l->tail_count = (l->mapsz - off) / LIST_RECSIZE;
+    }
+    l->st = *st;
+    return 0;
+inval:
+    list_unmap (l);
+    errno = EINVAL;
+    return -1;
+}
+
+static int rec_cmp (const void *a, const void *b)
+{
+    return memcmp (a, b, LIST_RECSIZE);
+}
+
+static bool list_lookup (struct revoke_list *l, const uint8_t *rec)
+{
+    size_t i;
+
+    if (!l->map)
+        return false;
+    if (l->sorted_count > 0
+        && bloom_test (l->bloom, l->bloom_size, l->bloom_k, rec)
+        && bsearch (rec, l->sorted, l->sorted_count, LIST_RECSIZE, rec_cmp))
+        return true;
+    for (i = 0; i < l->tail_count; i++) {
+        if (!memcmp (l->tail + i * LIST_RECSIZE, rec, LIST_RECSIZE))
+            return true;
+    }
+    return false;
+}
+
+static int uuid_cmp (const void *a, const void *b)
+{
+    return strcmp (*(char * const *)a, *(char * const *)b);
+}
+
+/* Find 'uuid' in the set, returning its index, or if not found,
+ * -1 minus the index at which it would be inserted.
+ */
+static int uuids_search (struct revoke *r, const char *uuid)
+{
+    int lo = 0;
+    int hi = r->count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int rc = strcmp (uuid, r->uuids[mid]);
+        if (rc == 0)
+            return mid;
+        if (rc < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    return -1 - lo;
+}
+
+static int uuids_append (char ***uuids, int *count, int *size,
+                         const char *uuid)
+{
+    if (*count == *size) {
+        int newsize = *size ? *size * 2 : 64;
+        char **new;
+        if (!(new = realloc (*uuids, newsize * sizeof (new[0]))))
+            return -1;
+        *uuids = new;
+        *size = newsize;
+    }
+    if (!((*uuids)[*count] = strdup (uuid)))
+        return -1;
+    (*count)++;
+    return 0;
+}
+
+/* Replace the set with the contents of the directory.
+ * If the directory cannot be read, switch to fallback mode.
+ */
+static int revoke_load (struct revoke *r, const struct stat *st)
+{
+    DIR *dir;
+    struct dirent *dent;
+    char **uuids = NULL;
+    int count = 0;
+    int size = 0;
+    int saved_errno;
+
+    if (!(dir = opendir (r->dir))) {
+        if (errno == ENOENT)
+            goto done; // removed since stat - empty set
+        r->fallback = true;
+        return 0;
+    }
+    errno = 0;
+    while ((dent = readdir (dir))) {
+        if (dent->d_name[0] == '.')
+            continue;
+        if (uuids_append (&uuids, &count, &size, dent->d_name) < 0)
+            goto error;
+    }
+    if (errno != 0)
+        goto error;
+    (void)closedir (dir);
+    qsort (uuids, count, sizeof (uuids[0]), uuid_cmp);
+done:
+    uuids_free (r->uuids, r->count);
+    r->uuids = uuids;
+    r->count = count;
+    r->size = size;
+    r->fallback = false;
+    r->unstable = (time (NULL) - st->st_mtime <= 1);
+    r->st = *st;
+    return 0;
+error:
+    saved_errno = errno;
+    (void)closedir (dir);
+    uuids_free (uuids, count);
+    errno = saved_errno;
+    return -1;
+}
+
+static bool same_dir (const struct stat *st1, const struct stat *st2)
+{
+    return st1->st_dev == st2->st_dev
+        && st1->st_ino == st2->st_ino
+        && st1->st_mtim.tv_sec == st2->st_mtim.tv_sec
+        && st1->st_mtim.tv_nsec == st2->st_mtim.tv_nsec
+        && st1->st_ctim.tv_sec == st2->st_ctim.tv_sec
+        && st1->st_ctim.tv_nsec == st2->st_ctim.tv_nsec;
+}
+
+static bool same_file (const struct stat *st1, const struct stat *st2)
+{
+    return same_dir (st1, st2) && st1->st_size == st2->st_size;
+}
+
+/* Call with r->lock held.
+ */
+static int list_refresh (struct revoke_list *l)
+{
+    struct stat st;
+
+    if (stat (l->path, &st) < 0) {
+        if (errno != ENOENT)
+            return -1;
+        list_unmap (l);
+        memset (&l->st, 0, sizeof (l->st));
+        return 0;
+    }
+    if (l->st.st_ino != 0 && same_file (&st, &l->st))
+        return 0;
+    return list_map (l, &st);
+}
+
+static double elapsed (const struct timespec *t0, const struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + 1E-9 * (t1->tv_nsec - t0->tv_nsec);
+}
+
+/* Call with r->lock held.
+ */
+static int revoke_refresh_locked (struct revoke *r, bool force)
+{
+    struct timespec now;
+    struct stat st;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &now) < 0)
+        return -1;
+    if (!force && r->loaded && elapsed (&r->checked, &now) < r->interval)
+        return 0;
+    r->checked = now;
+    if (r->list.path && list_refresh (&r->list) < 0) {
+        memset (&r->list.st, 0, sizeof (r->list.st)); // retry next time
+        return -1;
+    }
+    if (stat (r->dir, &st) < 0) {
+        if (errno != ENOENT) {
+            r->fallback = true;
+            r->loaded = true;
+            return 0;
+        }
+        memset (&st, 0, sizeof (st)); // no directory - empty set
+        if (revoke_load (r, &st) < 0)
+            return -1;
+        r->unstable = false;
+        r->loaded = true;
+        return 0;
+    }
+    if (r->loaded && !r->fallback && !r->unstable && same_dir (&st, &r->st))
+        return 0;
+    if (revoke_load (r, &st) < 0)
+        return -1;
+    r->loaded = true;
+    return 0;
+}
+
+int revoke_refresh (struct revoke *r)
+{
+    int rc;
+
+    if (!r) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    rc = revoke_refresh_locked (r, true);
+    pthread_mutex_unlock (&r->lock);
+    return rc;
+}
+
+int revoke_check (struct revoke *r, const char *uuid, bool *revoked)
+{
+    int rc = -1;
+
+    if (!r || !uuid || !revoked) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    if (revoke_refresh_locked (r, false) < 0)
+        goto done;
+    if (r->list.path) {
+        uuid_t rec;
+        if (uuid_parse (uuid, rec) == 0 && list_lookup (&r->list, rec)) {
+            *revoked = true;
+            rc = 0;
+            goto done;
+        }
+    }
+    if (r->fallback) {
+        char path[PATH_MAX + 1];
+
+        if (snprintf (path, sizeof (path), "%s/%s", r->dir, uuid)
+            >= sizeof (path)) {
+            errno = EINVAL;
+            goto done;
+        }
+        *revoked = (access (path, F_OK) == 0);
+    }
+    else
+        *revoked = (uuids_search (r, uuid) >= 0);
+    rc = 0;
+done:
+    pthread_mutex_unlock (&r->lock);
+    return rc;
+}
+
+int revoke_add (struct revoke *r, const char *uuid)
+{
+    int rc = -1;
+    int i;
+
+    if (!r || !uuid || strlen (uuid) == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    if (!r->loaded || r->fallback || (i = uuids_search (r, uuid)) >= 0) {
+        rc = 0;
+        goto done;
+    }
+    i = -1 - i;
+    if (uuids_append (&r->uuids, &r->count, &r->size, uuid) < 0)
+        goto done;
+    if (i < r->count - 1) {
+        char *s = r->uuids[r->count - 1];
+        memmove (&r->uuids[i + 1], &r->uuids[i],
+                 (r->count - 1 - i) * sizeof (r->uuids[0]));
+        r->uuids[i] = s;
+    }
+    rc = 0;
+done:
+    pthread_mutex_unlock (&r->lock);
+    return rc;
+}
+
+int revoke_count (struct revoke *r)
+{
+    int count;
+
+    if (!r) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    count = r->fallback ? 0 : r->count;
+    count += r->list.sorted_count + r->list.tail_count;
+    pthread_mutex_unlock (&r->lock);
+    return count;
+}
+
+/* Write 'count' records from 'recs' (sorted, no duplicates) to a new list
+ * file at 'path', replacing it atomically.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int list_write (const char *path, const uint8_t *recs, size_t count)
+{
+    char tmp[PATH_MAX + 1];
+    uint8_t hdr[LIST_HDRSIZE];
+    uint8_t *bloom = NULL;
+    uint32_t bloom_size = LIST_BLOOM_MINSIZE;
+    FILE *fp = NULL;
+    int fd;
+    size_t i;
+    int saved_errno;
+
+    if (count > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    while (bloom_size < 0x80000000
+           && bloom_size * 8 < count * LIST_BLOOM_BITS_PER_ENTRY)
+        bloom_size *= 2;
+    if (!(bloom = calloc (1, bloom_size)))
+        return -1;
+    for (i = 0; i < count; i++)
+        bloom_set (bloom, bloom_size, LIST_BLOOM_K, recs + i * LIST_RECSIZE);
+    memset (hdr, 0, sizeof (hdr));
+    memcpy (hdr, LIST_MAGIC, 8);
+    put_be32 (hdr + 8, bloom_size);
+    put_be32 (hdr + 12, LIST_BLOOM_K);
+    put_be32 (hdr + 16, count);
+
+    if (snprintf (tmp, sizeof (tmp), "%s.XXXXXX", path) >= sizeof (tmp)) {
+        errno = EINVAL;
+        goto error;
+    }
+    if ((fd = mkstemp (tmp)) < 0)
+        goto error;
+    if (fchmod (fd, 0644) < 0 || !(fp = fdopen (fd, "w"))) {
+        saved_errno = errno;
+        (void)close (fd);
+        (void)unlink (tmp);
+        errno = saved_errno;
+        goto error;
+    }
+    if (fwrite (hdr, sizeof (hdr), 1, fp) != 1
+        || fwrite (bloom, bloom_size, 1, fp) != 1
+        || (count > 0 && fwrite (recs, LIST_RECSIZE, count, fp) != count)
+        || fflush (fp) != 0
+        || fsync (fileno (fp)) < 0) {
+        saved_errno = errno;
+        (void)fclose (fp);
+        (void)unlink (tmp);
+        errno = saved_errno;
+        goto error;
+    }
+    if (fclose (fp) != 0 || rename (tmp, path) < 0) {
+        saved_errno = errno;
+        (void)unlink (tmp);
+        errno = saved_errno;
+        goto error;
+    }
+    free (bloom);
+    return 0;
+error:
+    saved_errno = errno;
+    free (bloom);
+    errno = saved_errno;
+    return -1;
+}
+
+int revoke_append (struct revoke *r, const char *uuid)
+{
+    uuid_t rec;
+    struct stat st;
+    int fd;
+    int rc = -1;
+
+    if (!r || !uuid || !r->list.path || uuid_parse (uuid, rec) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    if (stat (r->list.path, &st) < 0) {
+        if (errno != ENOENT)
+            goto done;
+        st.st_size = 0;
+    }
+    if (st.st_size == 0 && list_write (r->list.path, NULL, 0) < 0)
+        goto done;
+    if ((fd = open (r->list.path, O_WRONLY | O_APPEND | O_CLOEXEC)) < 0)
+        goto done;
+    if (write (fd, rec, LIST_RECSIZE) != LIST_RECSIZE) {
+        if (errno == 0)
+            errno = EIO;
+        (void)close (fd);
+        goto done;
+    }
+    if (close (fd) < 0)
+        goto done;
+    if (list_refresh (&r->list) < 0)
+        goto done;
+    rc = 0;
+done:
+    pthread_mutex_unlock (&r->lock);
+    return rc;
+}
+
+static int recs_append (uint8_t **recs, size_t *count, size_t *size,
+                        const uint8_t *rec)
+{
+    if (*count == *size) {
+        size_t newsize = *size ? *size * 2 : 1024;
+        uint8_t *new;
+        if (!(new = realloc (*recs, newsize * LIST_RECSIZE)))
+            return -1;
+        *recs = new;
+        *size = newsize;
+    }
+    memcpy (*recs + *count * LIST_RECSIZE, rec, LIST_RECSIZE);
+    (*count)++;
+    return 0;
+}
+
+int revoke_publish (struct revoke *r, const char *path)
+{
+    uint8_t *recs = NULL;
+    size_t count = 0;
+    size_t size = 0;
+    size_t i, n;
+    int rc = -1;
+    int saved_errno;
+
+    if (!r || !path) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&r->lock);
+    if (revoke_refresh_locked (r, true) < 0)
+        goto done;
+    if (r->fallback) {
+        errno = EACCES;
+        goto done;
+    }
+    for (i = 0; i < r->count; i++) {
+        uuid_t rec;
+        if (uuid_parse (r->uuids[i], rec) == 0
+            && recs_append (&recs, &count, &size, rec) < 0)
+            goto done;
+    }
+    for (i = 0; i < r->list.sorted_count; i++) {
+        if (recs_append (&recs, &count, &size,
+                         r->list.sorted + i * LIST_RECSIZE) < 0)
+            goto done;
+    }
+    for (i = 0; i < r->list.tail_count; i++) {
+        if (recs_append (&recs, &count, &size,
+                         r->list.tail + i * LIST_RECSIZE) < 0)
+            goto done;
+    }
+    if (count > 0)
+        qsort (recs, count, LIST_RECSIZE, rec_cmp);
+    for (i = 0, n = 0; i < count; i++) {
+        if (n > 0 && !memcmp (recs + (n - 1) * LIST_RECSIZE,
+                              recs + i * LIST_RECSIZE, LIST_RECSIZE))
+            continue;
+        if (n != i)
+            memcpy (recs + n * LIST_RECSIZE, recs + i * LIST_RECSIZE,
+                    LIST_RECSIZE);
+        n++;
+    }
+    if (list_write (path, recs, n) < 0)
+        goto done;
+    if (r->list.path && list_refresh (&r->list) < 0)
+        goto done;
+    rc = 0;
+done:
+    saved_errno = errno;
+    pthread_mutex_unlock (&r->lock);
+    free (recs);
+    errno = saved_errno;
+    return rc;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,83 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _UTIL_REVOKE_H
+#define _UTIL_REVOKE_H
+
+#include <stdbool.h>
+
+/* In-memory set of revoked cert uuids, loaded from a revocation directory
+ * containing one (empty) file per uuid.
+ *
+ * The directory is re-read when its modification time changes, which is
+ * checked at most once per 'interval' seconds, so a lookup is normally a
+ * binary search with no filesystem access.  If the directory exists but
+ * cannot be read, lookups fall back to checking for the uuid file directly.
+ *
+ * Optionally, uuids may also be kept in a single revocation list file,
+ * which is easier to distribute than a directory.  It is memory mapped and
+ * holds sorted binary uuids behind a bloom filter, followed by any uuids
+ * appended since it was last published.  The set is the union of the
+ * directory and the list.  The set is thread safe.
+ */
+
+struct revoke;
+
+/* Create revocation set for 'dir' and, if non-NULL, list file 'list'.
+ * Neither is read until the first revoke_check().
+ * Return set on success, NULL with errno set.
+ */
+struct revoke *revoke_create (const char *dir, const char *list,
+                              double interval);
+void revoke_destroy (struct revoke *r);
+
+/* Set 'revoked' to true if 'uuid' is in the set, first refreshing the set
+ * if 'interval' has elapsed since it was last refreshed.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int revoke_check (struct revoke *r, const char *uuid, bool *revoked);
+
+/* Refresh the set now, re-reading the directory if it has changed.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int revoke_refresh (struct revoke *r);
+
+/* Add 'uuid' to the set, e.g. after creating its file in the directory,
+ * so it takes effect in this process without waiting for a refresh.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int revoke_add (struct revoke *r, const char *uuid);
+
+/* Return the number of uuids in the set.  A uuid that is in both the
+ * directory and the list, or appended to the list more than once,
+ * is counted more than once.
+ */
+int revoke_count (struct revoke *r);
+
+/* Append 'uuid' to the list file, creating it if it doesn't exist.
+ * Appends are atomic, so concurrent readers see the list with or without
+ * the new uuid.  Return 0 on success, -1 on failure with errno set
+ * (EINVAL if the set has no list or 'uuid' is not a valid uuid).
+ */
+int revoke_append (struct revoke *r, const char *uuid);
+
+/* Write the whole set, sorted and without duplicates, to a new list file
+ * 'path', replacing any existing file atomically.  'path' may be the set's
+ * own list file, to fold appended uuids into the sorted section.  Entries
+ * in the directory that are not valid uuids are omitted.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int revoke_publish (struct revoke *r, const char *path);
+
+#endif /* !_UTIL_REVOKE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
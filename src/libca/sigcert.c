@@ -13,6 +13,8 @@
 #endif /* HAVE_CONFIG_H */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -28,6 +30,7 @@
 
 #include "src/libutil/tomltk.h"
 #include "src/libutil/kv.h"
+#include "src/libutil/timestamp.h"
 #include "src/libutil/macros.h"
 
 #include "sigcert.h"
@@ -50,35 +53,389 @@ static const size_t cert_read_limit = (1024*1024*10); // 10mb
 #define SIGN_BASE64_SIZE \
     (sodium_base64_ENCODED_LEN (crypto_sign_BYTES, \
                                 sodium_base64_VARIANT_ORIGINAL))
+#if SIGN_BASE64_SIZE != SIGCERT_SIGNATURE_LEN + 1
+#error SIGCERT_SIGNATURE_LEN does not match crypto_sign_BYTES
+#endif
+
+/* Metadata that is read on every CA verify is indexed with parsed values
+ * once a cert has been decoded or loaded, so sigcert_meta_get() of these
+ * keys need not scan the kv buffer and parse the value.
+ */
+static const char *meta_index_keys[] = {
+    "uuid",
+    "issuer",
+    "domain",
+    "userid",
+    "max-sign-ttl",
+    "ctime",
+    "xtime",
+    "not-valid-before-time",
+    "ca-capability",
+};
+#define META_INDEX_SIZE \
+    (sizeof (meta_index_keys) / sizeof (meta_index_keys[0]))
+
+struct meta_value {
+    enum kv_type type;          // KV_UNKNOWN if key is not set
+    union {
+        const char *s;          // points into meta kv buffer
+        int64_t i;
+        double d;
+        bool b;
+        time_t t;
+    } val;
+};
 
 #define FLUX_SIGCERT_MAGIC 0x2349c0ed
 struct sigcert {
     int magic;
+    struct sigcert *next;       // free list
 
     uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
-    uint8_t secret_key[crypto_sign_SECRETKEYBYTES];
+    uint8_t *secret_key;        // NULL if no secret key slot
     uint8_t signature[crypto_sign_BYTES];
+    uint8_t fingerprint[SIGCERT_FINGERPRINT_SIZE];
 
     struct kv *meta;
+    struct meta_value meta_index[META_INDEX_SIZE];
+    bool meta_indexed;          // cleared by any change to meta
+    struct sigcert_claims claims;
+    bool claims_valid;          // only meaningful if meta_indexed
 
     bool secret_valid;
     bool signature_valid;
 
     struct kv *enc;
+
+    char *tbs;                  // cached bytes covered by signature
+    int tbslen;
+    int tbssz;
+    bool tbs_valid;             // cleared by any change to meta
+};
+
+static int meta_index_lookup (const char *key)
+{
+    int i;
+
+    for (i = 0; i < META_INDEX_SIZE; i++) {
+        if (!strcmp (key, meta_index_keys[i]))
+            return i;
+    }
+    return -1;
+}
+
+static int claims_build (const struct sigcert *cert,
+                         struct sigcert_claims *c);
+
+/* (Re-)build the index of 'cert' metadata.  Since string values point
+ * into the kv buffer, this must be called again after any change to meta.
+ */
+static void meta_index (struct sigcert *cert)
+{
+    struct kv_iter it;
+    const char *key;
+    int i;
+
+    memset (cert->meta_index, 0, sizeof (cert->meta_index));
+    kv_iter_init (&it);
+    while (kv_iter_next (cert->meta, &it)) {
+        struct meta_value *mv;
+
+        key = it.key;
+        if ((i = meta_index_lookup (key)) < 0)
+            continue;
+        mv = &cert->meta_index[i];
+        switch ((mv->type = it.type)) {
+            case KV_STRING:
+                mv->val.s = it.val;
+                break;
+            case KV_INT64:
+                mv->val.i = kv_val_int64 (key);
+                break;
+            case KV_DOUBLE:
+                mv->val.d = kv_val_double (key);
+                break;
+            case KV_BOOL:
+                mv->val.b = kv_val_bool (key);
+                break;
+            case KV_TIMESTAMP:
+                mv->val.t = kv_val_timestamp (key);
+                break;
+            default:
+                mv->type = KV_UNKNOWN;
+                break;
+        }
+    }
+    cert->meta_indexed = true;
+    cert->claims_valid = claims_build (cert, &cert->claims) == 0;
+}
+
+/* Get indexed meta value.  Returns 0 on success, -1 on failure with errno
+ * set, with the same semantics as kv_vget().
+ */
+static int meta_index_vget (const struct meta_value *mv,
+                            enum kv_type type,
+                            va_list ap)
+{
+    if (mv->type == KV_UNKNOWN || mv->type != type) {
+        errno = ENOENT;
+        return -1;
+    }
+    switch (type) {
+        case KV_STRING: {
+            const char **val = va_arg (ap, const char **);
+            if (val)
+                *val = mv->val.s;
+            break;
+        }
+        case KV_INT64: {
+            int64_t *val = va_arg (ap, int64_t *);
+            if (val)
+                *val = mv->val.i;
+            break;
+        }
+        case KV_DOUBLE: {
+            double *val = va_arg (ap, double *);
+            if (val)
+                *val = mv->val.d;
+            break;
+        }
+        case KV_BOOL: {
+            bool *val = va_arg (ap, bool *);
+            if (val)
+                *val = mv->val.b;
+            break;
+        }
+        case KV_TIMESTAMP: {
+            time_t *val = va_arg (ap, time_t *);
+            if (val)
+                *val = mv->val.t;
+            break;
+        }
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    return 0;
+}
+
+/* Compute the fingerprint of 'cert'.  This must be called again after any
+ * change to the public key or signature.
+ */
+static void fingerprint_update (struct sigcert *cert)
+{
+    crypto_generichash_state state;
+
+    crypto_generichash_init (&state, NULL, 0, sizeof (cert->fingerprint));
+    crypto_generichash_update (&state, cert->public_key,
+                               sizeof (cert->public_key));
+    if (cert->signature_valid)
+        crypto_generichash_update (&state, cert->signature,
+                                   sizeof (cert->signature));
+    crypto_generichash_final (&state, cert->fingerprint,
+                              sizeof (cert->fingerprint));
+}
+
+/* Build the bytes covered by a cert signature into 'buf' of size 'bufsz':
+ * the kv encoding of the base64 public key as "curve.public_key", followed
+ * by the metadata with a "meta." prefix on each key.  Since the meta keys
+ * of a kv are unique and contain no '.', this is byte for byte what
+ * kv_put() of the public key followed by kv_join() of the metadata would
+ * produce, but is computed directly from the metadata encoding.
+ * Like snprintf(3), return the length, writing nothing if it is greater
+ * than 'bufsz'.  Return -1 on failure with errno set.
+ */
+static int tbs_build (const struct sigcert *cert, char *buf, int bufsz)
+{
+    static const char pubkey_key[] = "curve.public_key";
+    const char *meta;
+    int metalen;
+    struct kv_iter it;
+    int len;
+    char *p;
+
+    if (kv_encode (cert->meta, &meta, &metalen) < 0)
+        return -1;
+    len = sizeof (pubkey_key) + 1 + PUBLICKEY_BASE64_SIZE + metalen;
+    kv_iter_init (&it);
+    while (kv_iter_next (cert->meta, &it))
+        len += 5; // "meta."
+    if (len > bufsz)
+        return len;
+    p = buf;
+    memcpy (p, pubkey_key, sizeof (pubkey_key));
+    p += sizeof (pubkey_key);
+    *p++ = KV_STRING;
+    sodium_bin2base64 (p, PUBLICKEY_BASE64_SIZE,
+                       cert->public_key, sizeof (cert->public_key),
+                       sodium_base64_VARIANT_ORIGINAL);
+    p += PUBLICKEY_BASE64_SIZE;
+    kv_iter_init (&it);
+    while (kv_iter_next (cert->meta, &it)) {
+        memcpy (p, "meta.", 5);
+        p += 5;
+        memcpy (p, it.key, it.entry_len);
+        p += it.entry_len;
+    }
+    return len;
+}
+
+/* Update the cached signed bytes of 'cert', reusing its buffer.
+ * This must be called again after any change to public key or metadata.
+ */
+static int tbs_update (struct sigcert *cert)
+{
+    int len;
+
+    cert->tbs_valid = false;
+    if ((len = tbs_build (cert, cert->tbs, cert->tbssz)) < 0)
+        return -1;
+    if (len > cert->tbssz) {
+        char *tbs;
+        if (!(tbs = realloc (cert->tbs, len)))
+            return -1;
+        cert->tbs = tbs;
+        cert->tbssz = len;
+        if (tbs_build (cert, cert->tbs, cert->tbssz) != len) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    cert->tbslen = len;
+    cert->tbs_valid = true;
+    return 0;
+}
+
+/* Secret keys are not stored inline in the cert, but in slots carved from
+ * chunks of locked, guarded memory obtained from sodium_malloc(), so that
+ * the cost of mlock and guard pages is paid once per chunk rather than per
+ * key.  Public-only certs, the common case when verifying, have no secret
+ * memory at all.  Empty chunks are released, except for the last one.
+ */
+#define SECRET_SLOTS 64
+
+struct secret_chunk {
+    struct secret_chunk *next;
+    uint64_t used;              // bitmap of allocated slots
+    uint8_t *keys;              // SECRET_SLOTS keys, from sodium_malloc()
 };
 
+static pthread_mutex_t secret_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct secret_chunk *secret_chunks;
+
+static struct secret_chunk *secret_chunk_create (void)
+{
+    struct secret_chunk *chunk;
+
+    if (!(chunk = calloc (1, sizeof (*chunk))))
+        return NULL;
+    if (!(chunk->keys = sodium_malloc (SECRET_SLOTS
+                                       * crypto_sign_SECRETKEYBYTES))) {
+        free (chunk);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return chunk;
+}
+
+/* Allocate a secret key slot.
+ * Return slot on success, NULL on failure with errno set.
+ */
+static uint8_t *secret_alloc (void)
+{
+    struct secret_chunk *chunk;
+    uint8_t *key = NULL;
+    int slot;
+
+    pthread_mutex_lock (&secret_lock);
+    for (chunk = secret_chunks; chunk != NULL; chunk = chunk->next) {
+        if (chunk->used != UINT64_MAX)
+            break;
+    }
+    if (!chunk) {
+        if (!(chunk = secret_chunk_create ()))
+            goto done;
+        chunk->next = secret_chunks;
+        secret_chunks = chunk;
+    }
+    slot = __builtin_ctzll (~chunk->used);
+    chunk->used |= 1ULL << slot;
+    key = chunk->keys + slot * crypto_sign_SECRETKEYBYTES;
+done:
+    pthread_mutex_unlock (&secret_lock);
+    return key;
+}
+
+/* Clear and free a secret key slot.
+ */
+static void secret_free (uint8_t *key)
+{
+    struct secret_chunk **chunkp;
+    struct secret_chunk *chunk;
+
+    if (!key)
+        return;
+    sodium_memzero (key, crypto_sign_SECRETKEYBYTES);
+    pthread_mutex_lock (&secret_lock);
+    for (chunkp = &secret_chunks; (chunk = *chunkp); chunkp = &chunk->next) {
+        if (key >= chunk->keys
+            && key < chunk->keys + SECRET_SLOTS * crypto_sign_SECRETKEYBYTES)
+            break;
+    }
+    assert (chunk != NULL);
+    chunk->used &= ~(1ULL << ((key - chunk->keys)
+                              / crypto_sign_SECRETKEYBYTES));
+    if (chunk->used == 0 && (chunkp != &secret_chunks || chunk->next)) {
+        *chunkp = chunk->next;
+        sodium_free (chunk->keys);
+        free (chunk);
+    }
+    pthread_mutex_unlock (&secret_lock);
+}
+
+/* Destroyed certs are kept on a free list for reuse, along with their
+ * (emptied) metadata kv and signed bytes buffer, since the curve mechanism may decode a cert for
+ * every verify.
+ */
+static const int cert_freelist_max = 64;
+
+static pthread_mutex_t cert_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigcert *cert_freelist;
+static int cert_freelist_count;
+
 void sigcert_destroy (struct sigcert *cert)
 {
     if (cert) {
         int saved_errno = errno;
+        struct kv *meta;
+        char *tbs;
+        int tbssz;
         assert (cert->magic == FLUX_SIGCERT_MAGIC);
         kv_destroy (cert->enc);
-        kv_destroy (cert->meta);
-        memset (cert->public_key, 0, crypto_sign_PUBLICKEYBYTES);
-        memset (cert->secret_key, 0, crypto_sign_SECRETKEYBYTES);
-        memset (cert->signature, 0, crypto_sign_BYTES);
+        secret_free (cert->secret_key);
+        meta = cert->meta;
+        tbs = cert->tbs;
+        tbssz = cert->tbssz;
+        memset (cert, 0, sizeof (*cert));
         cert->magic = ~FLUX_SIGCERT_MAGIC;
-        free (cert);
+        if (meta && kv_decode_into (meta, NULL, 0) == 0) {
+            pthread_mutex_lock (&cert_lock);
+            if (cert_freelist_count < cert_freelist_max) {
+                cert->meta = meta;
+                cert->tbs = tbs;
+                cert->tbssz = tbssz;
+                cert->next = cert_freelist;
+                cert_freelist = cert;
+                cert_freelist_count++;
+                cert = NULL;
+            }
+            pthread_mutex_unlock (&cert_lock);
+        }
+        if (cert) {
+            kv_destroy (meta);
+            free (tbs);
+            free (cert);
+        }
         errno = saved_errno;
     }
 }
@@ -99,6 +456,17 @@ static struct sigcert *sigcert_alloc (void)
         }
         sodium_initialized = true;
     }
+    pthread_mutex_lock (&cert_lock);
+    if ((cert = cert_freelist)) {
+        cert_freelist = cert->next;
+        cert_freelist_count--;
+    }
+    pthread_mutex_unlock (&cert_lock);
+    if (cert) {
+        cert->next = NULL;
+        cert->magic = FLUX_SIGCERT_MAGIC;
+        return cert;
+    }
     if (!(cert = calloc (1, sizeof (*cert))))
         return NULL;
     cert->magic = FLUX_SIGCERT_MAGIC;
@@ -112,14 +480,27 @@ error:
     return NULL;
 }
 
+/* Ensure 'cert' has a secret key slot (contents unspecified).
+ * Return 0 on success, -1 on failure with errno set.
+ */
+static int sigcert_alloc_secret (struct sigcert *cert)
+{
+    if (!cert->secret_key && !(cert->secret_key = secret_alloc ()))
+        return -1;
+    return 0;
+}
+
 struct sigcert *sigcert_create (void)
 {
     struct sigcert *cert;
 
     if (!(cert = sigcert_alloc ()))
         goto error;
+    if (sigcert_alloc_secret (cert) < 0)
+        goto error;
     if (crypto_sign_keypair (cert->public_key, cert->secret_key) < 0)
         goto error;
+    fingerprint_update (cert);
     if (sigcert_meta_set (cert, "algorithm", SM_STRING, "ed25519") < 0)
         goto error;
     cert->secret_valid = true;
@@ -129,30 +510,121 @@ error:
     return NULL;
 }
 
+struct create_job {
+    struct sigcert **certs;
+    int count;
+    int next;                           // next index to create (atomic)
+    int errnum;                         // first error (atomic), or 0
+};
+
+static void *create_worker (void *arg)
+{
+    struct create_job *job = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED))
+           < job->count) {
+        if (!(job->certs[i] = sigcert_create ())) {
+            int expected = 0;
+            (void)__atomic_compare_exchange_n (&job->errnum, &expected,
+                                               errno, false,
+                                               __ATOMIC_RELAXED,
+                                               __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Key generation is CPU bound, so split it among threads.  The calling
+ * thread works too, so if threads cannot be created, certs are simply
+ * created serially.
+ */
+int sigcert_create_many (struct sigcert **certs, int count, int nthreads)
+{
+    struct create_job job = { .certs = certs, .count = count };
+    pthread_t *t = NULL;
+    int n = 0;
+    int i;
+
+    if (count < 0 || (count > 0 && !certs) || nthreads < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count == 0)
+        return 0;
+    memset (certs, 0, count * sizeof (certs[0]));
+    /* Create the first cert here, so that one-time sodium initialization
+     * in sigcert_alloc() is done before threads start.
+     */
+    if (!(certs[0] = sigcert_create ()))
+        return -1;
+    job.next = 1;
+    if (nthreads == 0)
+        nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+    if (nthreads > count)
+        nthreads = count;
+    if (nthreads > 1 && (t = calloc (nthreads - 1, sizeof (t[0])))) {
+        while (n < nthreads - 1
+               && pthread_create (&t[n], NULL, create_worker, &job) == 0)
+            n++;
+    }
+    (void)create_worker (&job);
+    for (i = 0; i < n; i++)
+        (void)pthread_join (t[i], NULL);
+    free (t);
+    if (job.errnum != 0) {
+        for (i = 0; i < count; i++) {
+            sigcert_destroy (certs[i]);
+            certs[i] = NULL;
+        }
+        errno = job.errnum;
+        return -1;
+    }
+    return count;
+}
+
 struct sigcert *sigcert_copy (const struct sigcert *cert)
 {
     struct sigcert *cpy;
-    struct kv *metacpy;
+    const char *buf;
+    int len;
 
     if (!cert) {
         errno = EINVAL;
         return NULL;
     }
-    if (!(metacpy = kv_copy (cert->meta)))
-        return NULL;
-    if (!(cpy = malloc (sizeof (*cpy)))) {
-        kv_destroy (metacpy);
+    if (!(cpy = sigcert_alloc ()))
         return NULL;
+    if (kv_encode (cert->meta, &buf, &len) < 0
+        || kv_decode_into (cpy->meta, buf, len) < 0)
+        goto error;
+    if (cert->secret_valid) {
+        if (sigcert_alloc_secret (cpy) < 0)
+            goto error;
+        memcpy (cpy->secret_key, cert->secret_key,
+                crypto_sign_SECRETKEYBYTES);
+        cpy->secret_valid = true;
     }
-    memcpy (cpy, cert, sizeof (*cpy));
-    cpy->meta = metacpy;
+    memcpy (cpy->public_key, cert->public_key, crypto_sign_PUBLICKEYBYTES);
+    memcpy (cpy->signature, cert->signature, crypto_sign_BYTES);
+    memcpy (cpy->fingerprint, cert->fingerprint, SIGCERT_FINGERPRINT_SIZE);
+    cpy->signature_valid = cert->signature_valid;
+    if (cert->meta_indexed)
+        meta_index (cpy);
+    if (cert->tbs_valid)
+        (void)tbs_update (cpy);
     return cpy;
+error:
+    sigcert_destroy (cpy);
+    return NULL;
 }
 
 void sigcert_forget_secret (struct sigcert *cert)
 {
-    if (cert && cert->secret_valid) {
-        memset (cert->secret_key, 0, crypto_sign_SECRETKEYBYTES);
+    if (cert && cert->secret_key) {
+        secret_free (cert->secret_key);
+        cert->secret_key = NULL;
         cert->secret_valid = false;
     }
 }
@@ -192,6 +664,8 @@ static int sigcert_meta_vset (struct sigcert *cert, const char *key,
         errno = EINVAL;
         return -1;
     }
+    cert->meta_indexed = false;
+    cert->tbs_valid = false;
     return kv_vput (cert->meta, key, type_tokv (type), ap);
 }
 
@@ -215,6 +689,12 @@ static int sigcert_meta_vget (const struct sigcert *cert, const char *key,
         errno = EINVAL;
         return -1;
     }
+    if (cert->meta_indexed && type != SM_UNKNOWN) {
+        int i;
+        if ((i = meta_index_lookup (key)) >= 0)
+            return meta_index_vget (&cert->meta_index[i],
+                                    type_tokv (type), ap);
+    }
     return kv_vget (cert->meta, key, type_tokv (type), ap);
 }
 
@@ -231,6 +711,46 @@ int sigcert_meta_get (const struct sigcert *cert, const char *key,
     return rc;
 }
 
+static int claims_build (const struct sigcert *cert,
+                         struct sigcert_claims *c)
+{
+    if (sigcert_meta_get (cert, "uuid", SM_STRING, &c->uuid) < 0
+        || sigcert_meta_get (cert, "not-valid-before-time", SM_TIMESTAMP,
+                             &c->not_valid_before_time) < 0
+        || sigcert_meta_get (cert, "ctime", SM_TIMESTAMP, &c->ctime) < 0
+        || sigcert_meta_get (cert, "xtime", SM_TIMESTAMP, &c->xtime) < 0
+        || sigcert_meta_get (cert, "userid", SM_INT64, &c->userid) < 0
+        || sigcert_meta_get (cert, "max-sign-ttl", SM_INT64,
+                             &c->max_sign_ttl) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (sigcert_meta_get (cert, "issuer", SM_STRING, &c->issuer) < 0)
+        c->issuer = NULL;
+    if (sigcert_meta_get (cert, "ca-capability", SM_BOOL,
+                          &c->ca_capability) < 0)
+        c->ca_capability = false;
+    return 0;
+}
+
+int sigcert_get_claims (const struct sigcert *cert,
+                        struct sigcert_claims *claims)
+{
+    if (!cert || !claims) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (cert->meta_indexed) {
+        if (!cert->claims_valid) {
+            errno = EINVAL;
+            return -1;
+        }
+        *claims = cert->claims;
+        return 0;
+    }
+    return claims_build (cert, claims);
+}
+
 /* Decode a base64 string string to 'dst', a buffer of size 'dstsz'.
  * The decoded size must exactly match 'dstsz'.
  * Return 0 on success, -1 on error.
@@ -281,7 +801,7 @@ static int sigcert_fwrite_secret (const struct sigcert *cert, FILE *fp)
     if (fprintf (fp, "[curve]\n") < 0)
         return -1;
     sodium_bin2base64 (seckey, sizeof (seckey),
-                       cert->secret_key, sizeof (cert->secret_key),
+                       cert->secret_key, crypto_sign_SECRETKEYBYTES,
                        sodium_base64_VARIANT_ORIGINAL);
     if (fprintf (fp, "    secret-key = \"%s\"\n", seckey) < 0)
         return -1;
@@ -315,11 +835,18 @@ int sigcert_fwrite_public (const struct sigcert *cert, FILE *fp)
                     goto error;
                 break;
             case KV_BOOL:       // kv_val_string is "true" or "false"
-            case KV_TIMESTAMP:  // kv_val_string is ISO 8601 time string
                 if (fprintf (fp, "    %s = %s\n",
                              key, kv_val_string (key)) < 0)
                     goto error;
                 break;
+            case KV_TIMESTAMP: { // value may be binary encoded
+                char s[80];
+                if (timestamp_tostr (kv_val_timestamp (key),
+                                     s, sizeof (s)) < 0
+                    || fprintf (fp, "    %s = %s\n", key, s) < 0)
+                    goto error;
+                break;
+            }
             default:
                 errno = EINVAL;
                 goto error;
@@ -387,6 +914,81 @@ error:
     return -1;
 }
 
+/* Flush the filesystem containing the directory of 'name', unless a
+ * filesystem with the same device was already flushed, per 'devs' of
+ * size 'ndevs'.  syncfs(2) commits all files written to the filesystem,
+ * and the directory entries for them, in one go.
+ */
+static int sync_dir_of (const char *name, dev_t *devs, int *ndevs)
+{
+    char dir[PATH_MAX + 1];
+    const char *p;
+    struct stat sb;
+    int saved_errno;
+    int fd;
+    int i;
+
+    if (!(p = strrchr (name, '/')))
+        snprintf (dir, sizeof (dir), ".");
+    else if (p == name)
+        snprintf (dir, sizeof (dir), "/");
+    else if (snprintf (dir, sizeof (dir), "%.*s",
+                       (int)(p - name), name) >= sizeof (dir)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fd = open (dir, O_RDONLY | O_DIRECTORY)) < 0)
+        return -1;
+    if (fstat (fd, &sb) < 0)
+        goto error;
+    for (i = 0; i < *ndevs; i++) {
+        if (devs[i] == sb.st_dev)
+            break;
+    }
+    if (i == *ndevs) {
+        if (syncfs (fd) < 0)
+            goto error;
+        devs[(*ndevs)++] = sb.st_dev;
+    }
+    return close (fd);
+error:
+    saved_errno = errno;
+    (void)close (fd);
+    errno = saved_errno;
+    return -1;
+}
+
+int sigcert_store_many (struct sigcert *const *certs,
+                        const char *const *names, int count)
+{
+    dev_t *devs;
+    int ndevs = 0;
+    int saved_errno;
+    int rc = -1;
+    int i;
+
+    if (count < 0 || (count > 0 && (!certs || !names))) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (sigcert_store (certs[i], names[i]) < 0)
+            return -1;
+    }
+    if (!(devs = calloc (count + 1, sizeof (devs[0]))))
+        return -1;
+    for (i = 0; i < count; i++) {
+        if (sync_dir_of (names[i], devs, &ndevs) < 0)
+            goto done;
+    }
+    rc = 0;
+done:
+    saved_errno = errno;
+    free (devs);
+    errno = saved_errno;
+    return rc;
+}
+
 /* Decode a TOML string string to 'dst', a buffer of size 'dstsz'.
  * The decoded size must exactly match 'dstsz'.
  * Return 0 on success, -1 on error with errno set.
@@ -416,9 +1018,16 @@ static int parse_toml_meta_set (const char *raw, struct sigcert *cert,
     int64_t i;
     double d;
     int b;
-    toml_timestamp_t ts;
+    time_t t;
 
-    if (toml_rtos (raw, &s) == 0) {
+    /* Cert timestamps are written in canonical form, which cannot be
+     * mistaken for another type, so check for that first.
+     */
+    if (timestamp_fromstr_exact (raw, &t) == 0) {
+        if (sigcert_meta_set (cert, key, SM_TIMESTAMP, t) < 0)
+            goto done;
+    }
+    else if (toml_rtos (raw, &s) == 0) {
         if (sigcert_meta_set (cert, key, SM_STRING, s) < 0)
             goto done;
     }
@@ -434,10 +1043,7 @@ static int parse_toml_meta_set (const char *raw, struct sigcert *cert,
         if (sigcert_meta_set (cert, key, SM_DOUBLE, d) < 0)
             goto done;
     }
-    else if (toml_rtots (raw, &ts) == 0) {
-        time_t t;
-        if (tomltk_ts_to_epoch (&ts, &t) < 0)
-            goto done;
+    else if (tomltk_raw_to_epoch (raw, &t) == 0) {
         if (sigcert_meta_set (cert, key, SM_TIMESTAMP, t) < 0)
             goto done;
     }
@@ -490,41 +1096,41 @@ error:
     return NULL;
 }
 
-/* Read in secret-key.
+/* Parse secret-key from NULL terminated TOML 'conf'.
  */
-static int sigcert_fread_secret (struct sigcert *cert, FILE *fp)
+static int sigcert_parse_secret (struct sigcert *cert, char *conf)
 {
     toml_table_t *cert_table = NULL;
     toml_table_t *curve_table;
     const char *raw;
     char errbuf[200];
-    char *conf;
 
-    if (!(conf = freads_limited (fp, cert_read_limit)))
-        return -1;
     if (!(cert_table = toml_parse (conf, errbuf, sizeof (errbuf))))
         goto inval;
     if (!(curve_table = toml_table_in (cert_table, "curve")))
         goto inval;
     if (!(raw = toml_raw_in (curve_table, "secret-key")))
         goto inval;
+    if (sigcert_alloc_secret (cert) < 0) {
+        toml_free (cert_table);
+        return -1;
+    }
     if (parse_toml_base64_exact (raw, cert->secret_key,
-                                 sizeof (cert->secret_key)) < 0)
+                                 crypto_sign_SECRETKEYBYTES) < 0)
         goto inval;
     cert->secret_valid = true;
-    free (conf);
     toml_free (cert_table);
     return 0;
 inval:
-    free (conf);
     toml_free (cert_table);
+    sigcert_forget_secret (cert);
     errno = EINVAL;
     return -1;
 }
 
-/* Read public cert contents from 'fp' in TOML format.
+/* Parse public cert contents from NULL terminated TOML 'conf'.
  */
-struct sigcert *sigcert_fread_public (FILE *fp)
+static struct sigcert *sigcert_parse_public (char *conf)
 {
     struct sigcert *cert;
     toml_table_t *cert_table = NULL;
@@ -534,14 +1140,9 @@ struct sigcert *sigcert_fread_public (FILE *fp)
     const char *raw;
     int i;
     char errbuf[200];
-    char *conf;
 
     if (!(cert = sigcert_alloc ()))
         return NULL;
-    if (!(conf = freads_limited (fp, cert_read_limit))) {
-        sigcert_destroy (cert);
-        return NULL;
-    }
     if (!(cert_table = toml_parse (conf, errbuf, sizeof (errbuf))))
         goto inval;
 
@@ -569,56 +1170,445 @@ struct sigcert *sigcert_fread_public (FILE *fp)
             goto inval;
         cert->signature_valid = true;
     }
-    free (conf);
     toml_free (cert_table);
+    meta_index (cert);
+    fingerprint_update (cert);
+    (void)tbs_update (cert);
     return cert;
 inval:
-    free (conf);
     toml_free (cert_table);
     sigcert_destroy (cert);
     errno = EINVAL;
     return NULL;
 }
 
-struct sigcert *sigcert_load (const char *name, bool secret)
+/* Read public cert contents from 'fp' in TOML format.
+ */
+struct sigcert *sigcert_fread_public (FILE *fp)
 {
-    FILE *fp = NULL;
-    char name_pub[PATH_MAX + 1];
-    int saved_errno;
-    struct sigcert *cert = NULL;
+    struct sigcert *cert;
+    char *conf;
 
-    if (!name)
-        goto inval;
-    if (snprintf (name_pub, PATH_MAX + 1, "%s.pub", name) >= PATH_MAX + 1)
-        goto inval;
-    // name.pub - public
-    if (!(fp = fopen (name_pub, "r")))
-        goto error;
-    if (!(cert = sigcert_fread_public (fp)))
-        goto error;
-    if (fclose (fp) < 0)
-        goto error;
-    // name - secret
-    if (secret) {
-        if (!(fp = fopen (name, "r")))
-            goto error;
-        if (sigcert_fread_secret (cert, fp) < 0)
-            goto error;
-        if (fclose (fp) < 0)
-            goto error;
-    }
-    return cert;
-inval:
-    errno = EINVAL;
+    if (!(conf = freads_limited (fp, cert_read_limit)))
+        return NULL;
+    cert = sigcert_parse_public (conf);
+    free (conf);
+    return cert;
+}
+
+/* Scanner for certs in exactly the layout written by sigcert_store():
+ * [metadata] and [curve] tables of "key = value" lines, with bare keys,
+ * strings without escapes, and values formatted as sigcert_fwrite_public()
+ * formats them.  It works on the unterminated mapped file, and anything
+ * it does not recognize (comments, escapes, other tables, duplicate keys,
+ * etc.) makes the scan fail so the caller can fall back to the TOML parser,
+ * which has the final say on whether the file is valid.
+ */
+struct scan {
+    const char *p;
+    const char *end;
+    const char *table;
+    bool have_metadata;
+    bool have_curve;
+};
+
+struct scan_line {
+    const char *key;
+    int keylen;
+    const char *val;
+    int vallen;
+};
+
+static bool is_blank (char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_bare_key_char (char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+/* Get the next "key = value" line, tracking the current table.
+ * Return 1 on success, 0 at end of input, or -1 if the line is not
+ * recognized.
+ */
+static int scan_next (struct scan *s, struct scan_line *line)
+{
+    while (s->p < s->end) {
+        const char *p = s->p;
+        const char *eol;
+
+        if (!(eol = memchr (p, '\n', s->end - p)))
+            eol = s->end;
+        s->p = eol < s->end ? eol + 1 : eol;
+        while (p < eol && is_blank (*p))
+            p++;
+        while (eol > p && is_blank (eol[-1]))
+            eol--;
+        if (p == eol)
+            continue;
+        if (*p == '[') {
+            if (eol - p == 10 && !strncmp (p, "[metadata]", 10)
+                && !s->have_metadata) {
+                s->table = "metadata";
+                s->have_metadata = true;
+            }
+            else if (eol - p == 7 && !strncmp (p, "[curve]", 7)
+                     && !s->have_curve) {
+                s->table = "curve";
+                s->have_curve = true;
+            }
+            else
+                return -1;
+            continue;
+        }
+        if (!s->table)
+            return -1;
+        line->key = p;
+        while (p < eol && is_bare_key_char (*p))
+            p++;
+        if ((line->keylen = p - line->key) == 0 || line->keylen >= 128)
+            return -1;
+        while (p < eol && is_blank (*p))
+            p++;
+        if (p == eol || *p++ != '=')
+            return -1;
+        while (p < eol && is_blank (*p))
+            p++;
+        if (p == eol)
+            return -1;
+        line->val = p;
+        line->vallen = eol - p;
+        return 1;
+    }
+    return 0;
+}
+
+static bool scan_key_is (const struct scan_line *line, const char *key)
+{
+    return line->keylen == strlen (key)
+        && !strncmp (line->key, key, line->keylen);
+}
+
+/* Decode a quoted base64 value to 'dst' of exactly 'dstsz' bytes.
+ */
+static int scan_base64_exact (const struct scan_line *line,
+                              uint8_t *dst, size_t dstsz)
+{
+    size_t dstlen;
+
+    if (line->vallen < 2
+        || line->val[0] != '"'
+        || line->val[line->vallen - 1] != '"')
+        return -1;
+    if (sodium_base642bin (dst, dstsz, line->val + 1, line->vallen - 2,
+                           NULL, &dstlen, NULL,
+                           sodium_base64_VARIANT_ORIGINAL) < 0
+        || dstlen != dstsz)
+        return -1;
+    return 0;
+}
+
+static bool scan_digits (const char **p, const char *end)
+{
+    const char *start = *p;
+
+    while (*p < end && **p >= '0' && **p <= '9')
+        (*p)++;
+    return *p > start;
+}
+
+/* Set metadata 'line' in 'cert', accepting values only in the forms
+ * that sigcert_fwrite_public() writes.
+ */
+static int scan_meta_set (const struct scan_line *line, struct sigcert *cert)
+{
+    const char *val = line->val;
+    const char *end = line->val + line->vallen;
+    char key[128];
+    char buf[64];
+    int rc;
+
+    memcpy (key, line->key, line->keylen);
+    key[line->keylen] = '\0';
+    /* N.B. a KV_UNKNOWN lookup fails with ENOENT only if key is absent.
+     */
+    if (kv_get (cert->meta, key, KV_UNKNOWN) == 0 || errno != ENOENT)
+        return -1; // duplicate or invalid key
+    if (*val == '"') {
+        const char *p;
+        char *s;
+
+        if (line->vallen < 2 || end[-1] != '"')
+            return -1;
+        for (p = val + 1; p < end - 1; p++) {
+            if (*p == '"' || *p == '\\' || (unsigned char)*p < 0x20
+                || *p == 0x7f)
+                return -1;
+        }
+        if (!(s = malloc (line->vallen - 1)))
+            return -1;
+        memcpy (s, val + 1, line->vallen - 2);
+        s[line->vallen - 2] = '\0';
+        rc = sigcert_meta_set (cert, key, SM_STRING, s);
+        free (s);
+        return rc;
+    }
+    if (line->vallen == 4 && !strncmp (val, "true", 4))
+        return sigcert_meta_set (cert, key, SM_BOOL, true);
+    if (line->vallen == 5 && !strncmp (val, "false", 5))
+        return sigcert_meta_set (cert, key, SM_BOOL, false);
+    if (line->vallen >= sizeof (buf))
+        return -1;
+    memcpy (buf, val, line->vallen);
+    buf[line->vallen] = '\0';
+    if (line->vallen == 20 && buf[4] == '-' && buf[10] == 'T') {
+        struct tm tm;
+        char *cp;
+        time_t t;
+
+        memset (&tm, 0, sizeof (tm));
+        if (!(cp = strptime (buf, "%Y-%m-%dT%H:%M:%SZ", &tm)) || *cp != '\0'
+            || (t = timegm (&tm)) < 0)
+            return -1;
+        return sigcert_meta_set (cert, key, SM_TIMESTAMP, t);
+    }
+    else {
+        const char *p = buf;
+        const char *bufend = buf + line->vallen;
+        bool is_double = false;
+
+        if (*p == '-')
+            p++;
+        if (!scan_digits (&p, bufend))
+            return -1;
+        if (p < bufend && *p == '.') {
+            p++;
+            if (!scan_digits (&p, bufend))
+                return -1;
+            is_double = true;
+        }
+        if (p != bufend)
+            return -1;
+        p = buf[0] == '-' ? buf + 1 : buf;
+        if (p[0] == '0' && p[1] >= '0' && p[1] <= '9')
+            return -1; // leading zero
+        errno = 0;
+        if (is_double) {
+            double d = strtod (buf, NULL);
+            if (errno != 0)
+                return -1;
+            return sigcert_meta_set (cert, key, SM_DOUBLE, d);
+        }
+        else {
+            int64_t i = strtoll (buf, NULL, 10);
+            if (errno != 0)
+                return -1;
+            return sigcert_meta_set (cert, key, SM_INT64, i);
+        }
+    }
+}
+
+/* Scan public cert contents from 'buf' of length 'len'.
+ * Return cert on success, or NULL if not recognized.
+ */
+static struct sigcert *scan_public (const char *buf, size_t len)
+{
+    struct scan s = { .p = buf, .end = buf + len };
+    struct scan_line line;
+    struct sigcert *cert;
+    bool have_pubkey = false;
+    int rc;
+
+    if (!(cert = sigcert_alloc ()))
+        return NULL;
+    while ((rc = scan_next (&s, &line)) == 1) {
+        if (!strcmp (s.table, "metadata")) {
+            if (scan_meta_set (&line, cert) < 0)
+                goto error;
+        }
+        else if (scan_key_is (&line, "public-key") && !have_pubkey) {
+            if (scan_base64_exact (&line, cert->public_key,
+                                   sizeof (cert->public_key)) < 0)
+                goto error;
+            have_pubkey = true;
+        }
+        else if (scan_key_is (&line, "signature") && !cert->signature_valid) {
+            if (scan_base64_exact (&line, cert->signature,
+                                   sizeof (cert->signature)) < 0)
+                goto error;
+            cert->signature_valid = true;
+        }
+        else
+            goto error;
+    }
+    if (rc < 0 || !s.have_metadata || !have_pubkey)
+        goto error;
+    meta_index (cert);
+    fingerprint_update (cert);
+    (void)tbs_update (cert);
+    return cert;
 error:
-    saved_errno = errno;
-    if (fp)
-        (void)fclose (fp);
     sigcert_destroy (cert);
+    return NULL;
+}
+
+/* Scan secret-key from 'buf' of length 'len'.
+ * Return 0 on success, or -1 if not recognized.
+ */
+static int scan_secret (struct sigcert *cert, const char *buf, size_t len)
+{
+    struct scan s = { .p = buf, .end = buf + len };
+    struct scan_line line;
+    uint8_t key[crypto_sign_SECRETKEYBYTES];
+    bool have_seckey = false;
+    int rc;
+
+    while ((rc = scan_next (&s, &line)) == 1) {
+        if (strcmp (s.table, "curve") != 0
+            || !scan_key_is (&line, "secret-key")
+            || have_seckey
+            || scan_base64_exact (&line, key, sizeof (key)) < 0)
+            goto error;
+        have_seckey = true;
+    }
+    if (rc < 0 || !have_seckey)
+        goto error;
+    if (sigcert_alloc_secret (cert) < 0)
+        goto error;
+    memcpy (cert->secret_key, key, sizeof (key));
+    sodium_memzero (key, sizeof (key));
+    cert->secret_valid = true;
+    return 0;
+error:
+    sodium_memzero (key, sizeof (key));
+    return -1;
+}
+
+/* Map 'path' read-only, placing its size in 'sizep'.
+ * An empty file is returned as a zero-length, non-NULL buffer.
+ * Return the mapping on success, NULL on failure with errno set.
+ */
+static const char *map_file (const char *path, size_t *sizep)
+{
+    static const char empty[1];
+    struct stat sb;
+    void *buf;
+    int fd;
+    int saved_errno;
+
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+    if (fstat (fd, &sb) < 0)
+        goto error;
+    if (!S_ISREG (sb.st_mode) || sb.st_size > cert_read_limit) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (sb.st_size == 0)
+        buf = (void *)empty;
+    else if ((buf = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+             == MAP_FAILED)
+        goto error;
+    (void)close (fd);
+    *sizep = sb.st_size;
+    return buf;
+error:
+    saved_errno = errno;
+    (void)close (fd);
     errno = saved_errno;
     return NULL;
 }
 
+static void unmap_file (const char *buf, size_t size)
+{
+    if (size > 0)
+        (void)munmap ((void *)buf, size);
+}
+
+/* Copy 'buf' of length 'len' to a new NULL-terminated string.
+ */
+static char *copy_conf (const char *buf, size_t len)
+{
+    char *conf;
+
+    if (!(conf = malloc (len + 1)))
+        return NULL;
+    memcpy (conf, buf, len);
+    conf[len] = '\0';
+    return conf;
+}
+
+/* Load public cert from 'path', trying the scanner first.
+ */
+static struct sigcert *sigcert_load_public (const char *path)
+{
+    const char *buf;
+    size_t size;
+    struct sigcert *cert;
+    char *conf;
+
+    if (!(buf = map_file (path, &size)))
+        return NULL;
+    if (!(cert = scan_public (buf, size))) {
+        if ((conf = copy_conf (buf, size))) {
+            cert = sigcert_parse_public (conf);
+            free (conf);
+        }
+    }
+    unmap_file (buf, size);
+    return cert;
+}
+
+/* Load secret-key from 'path' into 'cert', trying the scanner first.
+ */
+static int sigcert_load_secret (struct sigcert *cert, const char *path)
+{
+    const char *buf;
+    size_t size;
+    char *conf;
+    int rc = -1;
+
+    if (!(buf = map_file (path, &size)))
+        return -1;
+    if ((rc = scan_secret (cert, buf, size)) < 0) {
+        if ((conf = copy_conf (buf, size))) {
+            rc = sigcert_parse_secret (cert, conf);
+            sodium_memzero (conf, size);
+            free (conf);
+        }
+    }
+    unmap_file (buf, size);
+    return rc;
+}
+
+struct sigcert *sigcert_load (const char *name, bool secret)
+{
+    char name_pub[PATH_MAX + 1];
+    struct sigcert *cert = NULL;
+
+    if (!name)
+        goto inval;
+    if (snprintf (name_pub, PATH_MAX + 1, "%s.pub", name) >= PATH_MAX + 1)
+        goto inval;
+    // name.pub - public
+    if (!(cert = sigcert_load_public (name_pub)))
+        return NULL;
+    // name - secret
+    if (secret) {
+        if (sigcert_load_secret (cert, name) < 0)
+            goto error;
+    }
+    return cert;
+inval:
+    errno = EINVAL;
+error:
+    sigcert_destroy (cert);
+    return NULL;
+}
+
 /* Decode a kv string key to 'dst', a buffer of size 'dstsz'.
  * The decoded size must exactly match 'dstsz'.
  * Return 0 on success, -1 on error with errno set.
@@ -662,6 +1652,9 @@ struct sigcert *sigcert_decode (const char *s, int len)
     else if (errno != ENOENT)
         goto error;
     kv_destroy (kv);
+    meta_index (cert);
+    fingerprint_update (cert);
+    (void)tbs_update (cert);
     return cert;
 error:
     kv_destroy (kv);
@@ -685,25 +1678,211 @@ int sigcert_encode (const struct sigcert *cert, const char **buf, int *len)
     sodium_bin2base64 (pubkey, sizeof (pubkey),
                        cert->public_key, sizeof (cert->public_key),
                        sodium_base64_VARIANT_ORIGINAL);
-    if (kv_put (cert->enc, "curve.public-key", KV_STRING, pubkey) < 0)
+    if (kv_put_unique (cert->enc, "curve.public-key", KV_STRING, pubkey) < 0)
         return -1;
     if (cert->signature_valid) {
         char sign[SIGN_BASE64_SIZE];
         sodium_bin2base64 (sign, sizeof (sign),
                            cert->signature, sizeof (cert->signature),
                            sodium_base64_VARIANT_ORIGINAL);
-        if (kv_put (cert->enc, "curve.signature", KV_STRING, sign) < 0)
+        if (kv_put_unique (cert->enc, "curve.signature", KV_STRING, sign) < 0)
             return -1;
     }
     return kv_encode (cert->enc, buf, len);
 }
 
+/* Binary encoding (integers are big-endian):
+ *   magic       4 bytes
+ *   flags       4 bytes (BINARY_FLAG_SIGNATURE if signature is valid)
+ *   public-key  crypto_sign_PUBLICKEYBYTES
+ *   signature   crypto_sign_BYTES (zero if not valid)
+ *   metalen     4 bytes
+ *   meta        metalen bytes of kv encoding
+ */
+#define BINARY_MAGIC            0x53434231 // "SCB1"
+#define BINARY_FLAG_SIGNATURE   1
+#define BINARY_HDRSIZE          (12 + crypto_sign_PUBLICKEYBYTES \
+                                    + crypto_sign_BYTES)
+
+static void put_be32 (uint8_t *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static uint32_t get_be32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+         | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int sigcert_encode_binary (const struct sigcert *cert, void *buf, int bufsz)
+{
+    const char *meta;
+    int metalen;
+    uint8_t *p = buf;
+
+    if (!cert || bufsz < 0 || (bufsz > 0 && !buf)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (kv_encode (cert->meta, &meta, &metalen) < 0)
+        return -1;
+    if (metalen > INT_MAX - BINARY_HDRSIZE) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    if (bufsz < BINARY_HDRSIZE + metalen)
+        return BINARY_HDRSIZE + metalen;
+    put_be32 (p, BINARY_MAGIC);
+    put_be32 (p + 4, cert->signature_valid ? BINARY_FLAG_SIGNATURE : 0);
+    p += 8;
+    memcpy (p, cert->public_key, crypto_sign_PUBLICKEYBYTES);
+    p += crypto_sign_PUBLICKEYBYTES;
+    if (cert->signature_valid)
+        memcpy (p, cert->signature, crypto_sign_BYTES);
+    else
+        memset (p, 0, crypto_sign_BYTES);
+    p += crypto_sign_BYTES;
+    put_be32 (p, metalen);
+    if (metalen > 0)
+        memcpy (p + 4, meta, metalen);
+    return BINARY_HDRSIZE + metalen;
+}
+
+int sigcert_decode_binary_into (struct sigcert *cert, const void *buf, int len)
+{
+    const uint8_t *p = buf;
+    uint32_t flags;
+
+    if (!cert || !buf || len < BINARY_HDRSIZE
+        || get_be32 (p) != BINARY_MAGIC
+        || ((flags = get_be32 (p + 4)) & ~BINARY_FLAG_SIGNATURE)
+        || get_be32 (p + BINARY_HDRSIZE - 4) != len - BINARY_HDRSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    p += 8;
+    cert->meta_indexed = false;
+    cert->tbs_valid = false;
+    if (kv_decode_into (cert->meta, (const char *)buf + BINARY_HDRSIZE,
+                        len - BINARY_HDRSIZE) < 0)
+        return -1;
+    meta_index (cert);
+    sigcert_forget_secret (cert);
+    memcpy (cert->public_key, p, crypto_sign_PUBLICKEYBYTES);
+    p += crypto_sign_PUBLICKEYBYTES;
+    if ((cert->signature_valid = (flags & BINARY_FLAG_SIGNATURE)))
+        memcpy (cert->signature, p, crypto_sign_BYTES);
+    else
+        memset (cert->signature, 0, crypto_sign_BYTES);
+    fingerprint_update (cert);
+    (void)tbs_update (cert);
+    return 0;
+}
+
+struct sigcert *sigcert_decode_binary (const void *buf, int len)
+{
+    struct sigcert *cert;
+
+    if (!(cert = sigcert_alloc ()))
+        return NULL;
+    if (sigcert_decode_binary_into (cert, buf, len) < 0) {
+        sigcert_destroy (cert);
+        return NULL;
+    }
+    return cert;
+}
+
+int sigcert_fwrite_binary (const struct sigcert *cert, FILE *fp)
+{
+    uint8_t stackbuf[1024];
+    uint8_t *buf = stackbuf;
+    int len;
+    int rc = -1;
+
+    if (!fp) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((len = sigcert_encode_binary (cert, stackbuf, sizeof (stackbuf))) < 0)
+        return -1;
+    if (len > sizeof (stackbuf)) {
+        if (!(buf = malloc (len)))
+            return -1;
+        if (sigcert_encode_binary (cert, buf, len) != len)
+            goto done;
+    }
+    if (fwrite (buf, len, 1, fp) != 1)
+        goto done;
+    rc = 0;
+done:
+    if (buf != stackbuf) {
+        int saved_errno = errno;
+        free (buf);
+        errno = saved_errno;
+    }
+    return rc;
+}
+
+struct sigcert *sigcert_fread_binary (FILE *fp)
+{
+    uint8_t hdr[BINARY_HDRSIZE];
+    uint8_t *buf = NULL;
+    uint32_t metalen;
+    size_t n;
+    struct sigcert *cert = NULL;
+    int saved_errno;
+
+    if (!fp) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((n = fread (hdr, 1, sizeof (hdr), fp)) < sizeof (hdr)) {
+        if (ferror (fp))
+            return NULL;
+        errno = n == 0 ? ENODATA : EPROTO;
+        return NULL;
+    }
+    metalen = get_be32 (hdr + BINARY_HDRSIZE - 4);
+    if (get_be32 (hdr) != BINARY_MAGIC || metalen > cert_read_limit) {
+        errno = EPROTO;
+        return NULL;
+    }
+    if (!(buf = malloc (BINARY_HDRSIZE + metalen)))
+        return NULL;
+    memcpy (buf, hdr, BINARY_HDRSIZE);
+    if (metalen > 0
+        && fread (buf + BINARY_HDRSIZE, metalen, 1, fp) != 1) {
+        if (!ferror (fp))
+            errno = EPROTO;
+        goto done;
+    }
+    cert = sigcert_decode_binary (buf, BINARY_HDRSIZE + metalen);
+done:
+    saved_errno = errno;
+    free (buf);
+    errno = saved_errno;
+    return cert;
+}
+
+const uint8_t *sigcert_fingerprint (const struct sigcert *cert)
+{
+    if (!cert) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return cert->fingerprint;
+}
+
 bool sigcert_equal (const struct sigcert *cert1,
                     const struct sigcert *cert2)
 {
     if (!cert1 || !cert2)
         return false;
-    if (!kv_equal (cert1->meta, cert2->meta))
+    if (!kv_equal_unordered (cert1->meta, cert2->meta))
         return false;
     if (memcmp (cert1->public_key, cert2->public_key,
                                    crypto_sign_PUBLICKEYBYTES) != 0)
@@ -718,25 +1897,46 @@ bool sigcert_equal (const struct sigcert *cert1,
     return true;
 }
 
-char *sigcert_sign_detached (const struct sigcert *cert,
-                             const uint8_t *buf, int len)
+/* N.B. crypto_sign_detached() re-derives the expanded secret key from the
+ * seed on each call.  That is one SHA-512 over 32 bytes, around 1% of the
+ * cost of a signature, and libsodium offers no way to sign with expanded
+ * key state short of composing Ed25519 from its low level scalar and point
+ * primitives, so the seed-based API is used as is.
+ */
+int sigcert_sign_detached_into (const struct sigcert *cert,
+                                const uint8_t *buf, int len,
+                                char *sig, int sigsz)
 {
-    uint8_t sig[crypto_sign_BYTES];
-    char *sig_base64;
+    uint8_t bin[crypto_sign_BYTES];
 
-    if (!cert || !cert->secret_valid || len < 0 || (len > 0 && buf == NULL)) {
+    if (!cert || !cert->secret_valid || len < 0 || (len > 0 && buf == NULL)
+        || sigsz < 0 || (sigsz > 0 && sig == NULL)) {
         errno = EINVAL;
-        return NULL;
+        return -1;
     }
-    if (crypto_sign_detached (sig, NULL, buf, len, cert->secret_key) < 0) {
+    if (sigsz < SIGN_BASE64_SIZE)
+        return SIGN_BASE64_SIZE - 1;
+    if (crypto_sign_detached (bin, NULL, buf, len, cert->secret_key) < 0) {
         errno = EINVAL;
-        return NULL;
+        return -1;
     }
+    sodium_bin2base64 (sig, sigsz, bin, sizeof (bin),
+                       sodium_base64_VARIANT_ORIGINAL);
+    return SIGN_BASE64_SIZE - 1;
+}
+
+char *sigcert_sign_detached (const struct sigcert *cert,
+                             const uint8_t *buf, int len)
+{
+    char *sig_base64;
+
     if (!(sig_base64 = calloc (1, SIGN_BASE64_SIZE)))
         return NULL;
-    sodium_bin2base64 (sig_base64, SIGN_BASE64_SIZE,
-                       sig, sizeof (sig),
-                       sodium_base64_VARIANT_ORIGINAL);
+    if (sigcert_sign_detached_into (cert, buf, len,
+                                    sig_base64, SIGN_BASE64_SIZE) < 0) {
+        free (sig_base64);
+        return NULL;
+    }
     return sig_base64;
 }
 
@@ -767,73 +1967,96 @@ int sigcert_verify_detached (const struct sigcert *cert,
 int sigcert_sign_cert (const struct sigcert *cert1,
                        struct sigcert *cert2)
 {
-    struct kv *kv;
-    const char *kv_s;
-    int kv_len;
-    int rc = -1;
-    char pubkey[PUBLICKEY_BASE64_SIZE];
-
     if (!cert1 || !cert2 || !cert1->secret_valid) {
         errno = EINVAL;
         return -1;
     }
-    if (!(kv = kv_create()))
+    if (!cert2->tbs_valid && tbs_update (cert2) < 0)
         return -1;
-    sodium_bin2base64 (pubkey, sizeof (pubkey),
-                       cert2->public_key, sizeof (cert2->public_key),
-                       sodium_base64_VARIANT_ORIGINAL);
-    if (kv_put (kv, "curve.public_key", KV_STRING, pubkey) < 0)
-        goto done;
-    if (kv_join (kv, cert2->meta, "meta.") < 0)
-        goto done;
-    if (kv_encode (kv, &kv_s, &kv_len) < 0)
-        goto done;
     if (crypto_sign_detached (cert2->signature, NULL,
-                              (uint8_t *)kv_s, kv_len,
+                              (uint8_t *)cert2->tbs, cert2->tbslen,
                               cert1->secret_key) < 0) {
         errno = EINVAL;
-        goto done;
+        return -1;
     }
     cert2->signature_valid = true;
-    rc = 0;
-done:
-    kv_destroy (kv);
-    return rc;
+    fingerprint_update (cert2);
+    return 0;
+}
+
+/* Set 'tbs' and 'len' to the bytes of 'cert' covered by its signature.
+ * N.B. cert may be shared, so if its signed bytes are not cached (it has
+ * been modified since it was decoded), they are built in a temporary buffer
+ * returned in 'tmp', which the caller must free, rather than cached.
+ */
+static int tbs_get (const struct sigcert *cert, char **tmp,
+                    const char **tbs, int *len)
+{
+    *tmp = NULL;
+    if (cert->tbs_valid) {
+        *tbs = cert->tbs;
+        *len = cert->tbslen;
+        return 0;
+    }
+    if ((*len = tbs_build (cert, NULL, 0)) < 0)
+        return -1;
+    if (!(*tmp = malloc (*len)))
+        return -1;
+    if (tbs_build (cert, *tmp, *len) != *len) {
+        free (*tmp);
+        *tmp = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    *tbs = *tmp;
+    return 0;
+}
+
+int sigcert_signed_digest (const struct sigcert *cert, uint8_t *digest)
+{
+    crypto_generichash_state state;
+    char *tmp;
+    const char *tbs;
+    int len;
+
+    if (!cert || !digest || !cert->signature_valid) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (tbs_get (cert, &tmp, &tbs, &len) < 0)
+        return -1;
+    crypto_generichash_init (&state, NULL, 0, SIGCERT_FINGERPRINT_SIZE);
+    crypto_generichash_update (&state, (const uint8_t *)tbs, len);
+    crypto_generichash_update (&state, cert->signature,
+                               sizeof (cert->signature));
+    crypto_generichash_final (&state, digest, SIGCERT_FINGERPRINT_SIZE);
+    free (tmp);
+    return 0;
 }
 
 int sigcert_verify_cert (const struct sigcert *cert1,
                          const struct sigcert *cert2)
 {
-    struct kv *kv;
-    const char *kv_s;
-    int kv_len;
+    char *tmp = NULL;
+    const char *tbs;
+    int len;
     int rc = -1;
-    char pubkey[PUBLICKEY_BASE64_SIZE];
 
     if (!cert1 || !cert2 || !cert2->signature_valid) {
         errno = EINVAL;
         return -1;
     }
-    if (!(kv = kv_create()))
+    if (tbs_get (cert2, &tmp, &tbs, &len) < 0)
         return -1;
-    sodium_bin2base64 (pubkey, sizeof (pubkey),
-                       cert2->public_key, sizeof (cert2->public_key),
-                       sodium_base64_VARIANT_ORIGINAL);
-    if (kv_put (kv, "curve.public_key", KV_STRING, pubkey) < 0)
-        goto done;
-    if (kv_join (kv, cert2->meta, "meta.") < 0)
-        goto done;
-    if (kv_encode (kv, &kv_s, &kv_len) < 0)
-        goto done;
     if (crypto_sign_verify_detached (cert2->signature,
-                                     (uint8_t *)kv_s, kv_len,
+                                     (const uint8_t *)tbs, len,
                                      cert1->public_key) < 0) {
         errno = EINVAL;
         goto done;
     }
     rc = 0;
 done:
-    kv_destroy (kv);
+    free (tmp);
     return rc;
 }
 
@@ -30,6 +30,14 @@ extern "C" {
 
 struct sigcert;
 
+/* Size of a cert fingerprint in bytes.
+ */
+#define SIGCERT_FINGERPRINT_SIZE 32
+
+/* Length of a base64 detached signature (excluding NUL).
+ */
+#define SIGCERT_SIGNATURE_LEN 88
+
 /* Destroy cert.
  */
 void sigcert_destroy (struct sigcert *cert);
@@ -38,6 +46,12 @@ void sigcert_destroy (struct sigcert *cert);
  */
 struct sigcert *sigcert_create (void);
 
+/* Create 'count' certs with new keys in certs[], generating keys with up
+ * to 'nthreads' threads (0 = one per online CPU).  Return 'count' on
+ * success, -1 on failure with errno set (no certs are returned).
+ */
+int sigcert_create_many (struct sigcert **certs, int count, int nthreads);
+
 /* Copy cert.
  */
 struct sigcert *sigcert_copy (const struct sigcert *cert);
@@ -59,6 +73,13 @@ struct sigcert *sigcert_load (const char *name, bool secret);
  */
 int sigcert_store (const struct sigcert *cert, const char *name);
 
+/* Store certs[i] to names[i] and names[i].pub for 'count' certs, then
+ * flush them to stable storage, syncing each filesystem once rather than
+ * each file.  Return 0 on success, -1 on failure with errno set.
+ */
+int sigcert_store_many (struct sigcert *const *certs,
+                        const char *const *names, int count);
+
 /* Write public portion of cert to 'fp'.
  */
 int sigcert_fwrite_public (const struct sigcert *cert, FILE *fp);
@@ -75,7 +96,58 @@ struct sigcert *sigcert_decode (const char *s, int len);
  */
 int sigcert_encode (const struct sigcert *cert, const char **bp, int *len);
 
-/* Return true if two certificates have the same keys.
+/* Encode public portion of cert to a fixed-layout binary buffer, which
+ * carries the raw public key and signature and the kv encoding of metadata.
+ * Like snprintf(3), the encoded length is returned, and if that is greater
+ * than 'bufsz', nothing is written.  A size query may be made with
+ * buf=NULL, bufsz=0.  Returns -1 on failure with errno set.
+ */
+int sigcert_encode_binary (const struct sigcert *cert, void *buf, int bufsz);
+
+/* Decode binary buffer to cert.
+ */
+struct sigcert *sigcert_decode_binary (const void *buf, int len);
+
+/* Decode binary buffer into an existing cert, replacing its contents and
+ * dropping any secret key.  The metadata buffer of 'cert' is reused, so
+ * no allocation is needed once it is large enough.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int sigcert_decode_binary_into (struct sigcert *cert, const void *buf, int len);
+
+/* Write binary encoding of public portion of cert to 'fp'.
+ * Binary certs are self-delimiting, so a stream of them may be written
+ * back to back.  Returns 0 on success, -1 on failure with errno set.
+ */
+int sigcert_fwrite_binary (const struct sigcert *cert, FILE *fp);
+
+/* Read the next binary cert from 'fp'.  Returns cert on success, or NULL
+ * on failure with errno set.  If 'fp' is at end of file, errno is ENODATA;
+ * if the stream is malformed or truncated, errno is EPROTO.
+ */
+struct sigcert *sigcert_fread_binary (FILE *fp);
+
+/* Return the fingerprint of cert, a SIGCERT_FINGERPRINT_SIZE byte BLAKE2b
+ * digest over the public key and, if the cert is signed, the signature.
+ * Since the signature covers the metadata, signed certs with equal
+ * fingerprints are the same cert.  The fingerprint is computed when the
+ * cert is created, decoded, loaded or signed, and remains valid for the
+ * lifetime of the cert (or until it is next signed).
+ * Returns NULL on failure with errno set.
+ */
+const uint8_t *sigcert_fingerprint (const struct sigcert *cert);
+
+/* Compute a SIGCERT_FINGERPRINT_SIZE byte BLAKE2b digest of signed 'cert'
+ * over the bytes covered by its signature (public key and metadata) and the
+ * signature itself.  Unlike the fingerprint, it reflects any change to the
+ * metadata, so certs with equal signed digests are identical in all the
+ * content their signer vouched for.
+ * Returns 0 on success, -1 on failure with errno set (EINVAL if unsigned).
+ */
+int sigcert_signed_digest (const struct sigcert *cert, uint8_t *digest);
+
+/* Return true if two certificates have the same keys and metadata.
+ * The order of metadata entries does not matter.
  */
 bool sigcert_equal (const struct sigcert *cert1,
                     const struct sigcert *cert2);
@@ -86,6 +158,17 @@ bool sigcert_equal (const struct sigcert *cert1,
 char *sigcert_sign_detached (const struct sigcert *cert,
                              const uint8_t *buf, int len);
 
+/* Same as sigcert_sign_detached(), but write the NULL terminated signature
+ * to caller-supplied 'sig' of size 'sigsz'.  Like snprintf(3), the length
+ * of the signature (excluding the terminating NUL) is returned, and if that
+ * is greater than or equal to 'sigsz', nothing is signed or written.
+ * A size query may be made with sig=NULL, sigsz=0.
+ * Returns -1 on failure.
+ */
+int sigcert_sign_detached_into (const struct sigcert *cert,
+                                const uint8_t *buf, int len,
+                                char *sig, int sigsz);
+
 /* Verify a detached signature (base64 string) over buf, len.
  * Returns 0 on success, -1 on failure.
  */
@@ -131,6 +214,28 @@ int sigcert_meta_set (struct sigcert *cert, const char *key,
 int sigcert_meta_get (const struct sigcert *cert, const char *key,
                       enum sigcert_meta_type type, ...);
 
+/* Metadata that cert verification depends on, in one struct.
+ * String members point into cert metadata, valid until it changes.
+ */
+struct sigcert_claims {
+    time_t not_valid_before_time;
+    time_t ctime;
+    time_t xtime;
+    int64_t userid;
+    int64_t max_sign_ttl;
+    const char *uuid;
+    const char *issuer;         // NULL if not set
+    bool ca_capability;         // false if not set
+};
+
+/* Get claims from cert metadata.  They are extracted when metadata is
+ * loaded or decoded, so this is usually a copy.
+ * Returns 0 on success, -1 with errno = EINVAL if uuid, ctime, xtime,
+ * not-valid-before-time, userid or max-sign-ttl is missing or mistyped.
+ */
+int sigcert_get_claims (const struct sigcert *cert,
+                        struct sigcert_claims *claims);
+
 #ifdef __cplusplus
 }
 #endif
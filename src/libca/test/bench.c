@@ -0,0 +1,559 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* bench.c - time CA and cert operations
+ *
+ * Usage: bench_ca [-n iterations] [-r size,size,...]
+ *
+ * Each operation is run 'iterations' times (default 1000) and reported
+ * as ops/sec and latency percentiles.  ca_check_revocation() is timed once
+ * for each revocation set size given with -r (default 0,100,1000,10000),
+ * using a revoke-dir populated with that many entries.  Timestamp
+ * conversion, done for each cert validity field, is compared with libc.
+ * Bulk onboarding of 'iterations' users (parallel keygen, batch signing,
+ * one sync) is reported per cert.
+ *
+ * Run with 'make bench', passing options with BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <uuid.h>
+
+#include "src/libutil/cf.h"
+#include "src/libutil/timestamp.h"
+#include "sigcert.h"
+#include "ca.h"
+
+const char *prog = "bench_ca";
+
+const char *conf_tmpl = \
+"max-cert-ttl = 3600\n" \
+"max-sign-ttl = 30\n" \
+"cert-path = \"%s/ca-cert\"\n" \
+"revoke-dir = \"%s/%s\"\n" \
+"revoke-allow = true\n" \
+"domain = \"FLUX.BENCH\"\n" \
+"%s";
+
+static char tmpdir[PATH_MAX + 1];
+
+struct timer {
+    double *samples;    // nanoseconds
+    int count;
+    struct timespec t0;
+};
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: bench_ca [-n iterations] [-r size,size,...]\n");
+    exit (1);
+}
+
+static void timer_init (struct timer *t, int n)
+{
+    if (n < 1 || !(t->samples = calloc (n, sizeof (t->samples[0]))))
+        die ("out of memory");
+    t->count = 0;
+}
+
+static void timer_start (struct timer *t)
+{
+    clock_gettime (CLOCK_MONOTONIC, &t->t0);
+}
+
+static void timer_stop (struct timer *t)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t->samples[t->count++] = (t1.tv_sec - t->t0.tv_sec) * 1E9
+                           + (t1.tv_nsec - t->t0.tv_nsec);
+}
+
+/* Stop timing a batch of 'count' operations, recording the average as
+ * 'count' samples.
+ */
+static void timer_stop_batch (struct timer *t, int count)
+{
+    struct timespec t1;
+    double ns;
+    int i;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    ns = (t1.tv_sec - t->t0.tv_sec) * 1E9 + (t1.tv_nsec - t->t0.tv_nsec);
+    for (i = 0; i < count; i++)
+        t->samples[t->count++] = ns / count;
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile (const struct timer *t, int p)
+{
+    return t->samples[(t->count - 1) * p / 100] / 1E3;
+}
+
+/* Print one line of results and free the samples.
+ */
+static void timer_report (struct timer *t, const char *fmt, ...)
+{
+    va_list ap;
+    char name[64];
+    double total = 0;
+    int i;
+
+    va_start (ap, fmt);
+    (void)vsnprintf (name, sizeof (name), fmt, ap);
+    va_end (ap);
+    for (i = 0; i < t->count; i++)
+        total += t->samples[i];
+    qsort (t->samples, t->count, sizeof (t->samples[0]), sample_cmp);
+    printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+            name,
+            total > 0 ? t->count / (total / 1E9) : 0,
+            percentile (t, 50),
+            percentile (t, 90),
+            percentile (t, 99),
+            percentile (t, 100));
+    free (t->samples);
+    t->samples = NULL;
+}
+
+static cf_t *config_create (const char *revoke_dir, const char *extra)
+{
+    cf_t *cf;
+    struct cf_error error;
+    char conf[3 * PATH_MAX + 256];
+
+    if (snprintf (conf, sizeof (conf), conf_tmpl, tmpdir, tmpdir,
+                  revoke_dir, extra) >= sizeof (conf))
+        die ("conf buffer overflow");
+    if (!(cf = cf_create ()))
+        die ("cf_create: %s", strerror (errno));
+    if (cf_update (cf, conf, strlen (conf), &error) < 0)
+        die ("cf_update: %s", error.errbuf);
+    return cf;
+}
+
+static void rmpath (const char *fmt, ...)
+{
+    va_list ap;
+    char path[PATH_MAX + 1];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (path, sizeof (path), fmt, ap);
+    va_end (ap);
+    if (unlink (path) < 0 && rmdir (path) < 0)
+        die ("%s: %s", path, strerror (errno));
+}
+
+/* Create directory 'name' in tmpdir, holding 'size' revoked uuids.
+ */
+static void revoke_dir_create (const char *name, int size)
+{
+    char path[PATH_MAX + 64];
+    char uuid[37];
+    uuid_t u;
+    int fd;
+    int i;
+
+    if (snprintf (path, sizeof (path), "%s/%s", tmpdir, name) >= sizeof (path))
+        die ("path buffer overflow");
+    if (mkdir (path, 0755) < 0)
+        die ("mkdir %s: %s", path, strerror (errno));
+    for (i = 0; i < size; i++) {
+        uuid_generate (u);
+        uuid_unparse (u, uuid);
+        if (snprintf (path, sizeof (path), "%s/%s/%s",
+                      tmpdir, name, uuid) >= sizeof (path))
+            die ("path buffer overflow");
+        if ((fd = open (path, O_WRONLY | O_CREAT, 0644)) < 0 || close (fd) < 0)
+            die ("%s: %s", path, strerror (errno));
+    }
+}
+
+static void revoke_dir_destroy (const char *name)
+{
+    char path[PATH_MAX + 64];
+    char cmd[PATH_MAX + 128];
+
+    if (snprintf (path, sizeof (path), "%s/%s", tmpdir, name) >= sizeof (path)
+        || snprintf (cmd, sizeof (cmd), "rm -rf '%s'", path) >= sizeof (cmd)
+        || system (cmd) != 0)
+        die ("failed to remove %s", path);
+}
+
+static void bench_ca (int n)
+{
+    cf_t *cf;
+    struct ca *ca;
+    struct ca *ca_cached;
+    ca_error_t e;
+    struct sigcert **certs;
+    struct sigcert *cert;
+    struct timer t;
+    const char *buf;
+    int len;
+    char *enc;
+    char path[PATH_MAX + 64];
+    int i;
+
+    cf = config_create ("ca-revoke", "");
+    if (!(ca = ca_create (cf, e)))
+        die ("ca_create: %s", e);
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (ca_keygen (ca, 0, 0, e) < 0)
+            die ("ca_keygen: %s", e);
+        timer_stop (&t);
+    }
+    timer_report (&t, "ca_keygen");
+    if (ca_store (ca, e) < 0)
+        die ("ca_store: %s", e);
+
+    if (!(certs = calloc (n, sizeof (certs[0]))))
+        die ("out of memory");
+    for (i = 0; i < n; i++) {
+        if (!(certs[i] = sigcert_create ()))
+            die ("sigcert_create: %s", strerror (errno));
+    }
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (ca_sign (ca, certs[i], 0, 0, 1000 + i, e) < 0)
+            die ("ca_sign: %s", e);
+        timer_stop (&t);
+    }
+    timer_report (&t, "ca_sign");
+
+    /* Cold: decode the cert, as a verifier receiving it would.
+     */
+    if (sigcert_encode (certs[0], &buf, &len) < 0 || !(enc = malloc (len)))
+        die ("sigcert_encode: %s", strerror (errno));
+    memcpy (enc, buf, len);
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (!(cert = sigcert_decode (enc, len))
+            || ca_verify (ca, cert, NULL, NULL, e) < 0)
+            die ("sigcert_decode/ca_verify: %s", e);
+        timer_stop (&t);
+        sigcert_destroy (cert);
+    }
+    timer_report (&t, "decode+ca_verify (cold)");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (ca_verify (ca, certs[0], NULL, NULL, e) < 0)
+            die ("ca_verify: %s", e);
+        timer_stop (&t);
+    }
+    timer_report (&t, "ca_verify (warm)");
+
+    /* Verified cert cache, as written by a trusted process.
+     */
+    snprintf (path, sizeof (path), "%s/ca-vc", tmpdir);
+    if (ca_verified_cache_write (ca, path, certs, n, e) != n)
+        die ("ca_verified_cache_write: %s", e);
+    cf_destroy (cf);
+    snprintf (path, sizeof (path), "verified-cache = \"%s/ca-vc\"\n", tmpdir);
+    cf = config_create ("ca-revoke", path);
+    if (!(ca_cached = ca_create (cf, e)) || ca_load (ca_cached, false, e) < 0)
+        die ("ca_load: %s", e);
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (!(cert = sigcert_decode (enc, len))
+            || ca_verify (ca_cached, cert, NULL, NULL, e) < 0)
+            die ("sigcert_decode/ca_verify: %s", e);
+        timer_stop (&t);
+        sigcert_destroy (cert);
+    }
+    timer_report (&t, "decode+ca_verify (vcache)");
+    ca_destroy (ca_cached);
+    rmpath ("%s/ca-vc", tmpdir);
+
+    snprintf (path, sizeof (path), "%s/cert", tmpdir);
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (sigcert_store (certs[i], path) < 0)
+            die ("sigcert_store: %s", strerror (errno));
+        timer_stop (&t);
+    }
+    timer_report (&t, "sigcert_store");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (!(cert = sigcert_load (path, true)))
+            die ("sigcert_load: %s", strerror (errno));
+        timer_stop (&t);
+        sigcert_destroy (cert);
+    }
+    timer_report (&t, "sigcert_load");
+    rmpath ("%s/cert", tmpdir);
+    rmpath ("%s/cert.pub", tmpdir);
+
+    for (i = 0; i < n; i++)
+        sigcert_destroy (certs[i]);
+    free (certs);
+    free (enc);
+    ca_destroy (ca);
+    cf_destroy (cf);
+}
+
+/* Bulk onboarding: generate keys in parallel, sign as a batch, and store
+ * with one sync, compared with creating keys one at a time.
+ */
+static void bench_onboard (int n)
+{
+    cf_t *cf;
+    struct ca *ca;
+    ca_error_t e;
+    struct sigcert **certs;
+    char **names;
+    int64_t *userids;
+    struct timer t;
+    int i;
+
+    cf = config_create ("ca-revoke", "");
+    if (!(ca = ca_create (cf, e)) || ca_load (ca, true, e) < 0)
+        die ("ca_load: %s", e);
+    if (!(certs = calloc (n, sizeof (certs[0])))
+        || !(names = calloc (n, sizeof (names[0])))
+        || !(userids = calloc (n, sizeof (userids[0]))))
+        die ("out of memory");
+    for (i = 0; i < n; i++) {
+        if (asprintf (&names[i], "%s/onboard%d", tmpdir, i) < 0)
+            die ("out of memory");
+        userids[i] = 1000 + i;
+    }
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (!(certs[i] = sigcert_create ()))
+            die ("sigcert_create: %s", strerror (errno));
+        timer_stop (&t);
+        sigcert_destroy (certs[i]);
+    }
+    timer_report (&t, "sigcert_create");
+
+    timer_init (&t, n);
+    timer_start (&t);
+    if (sigcert_create_many (certs, n, 0) < 0)
+        die ("sigcert_create_many: %s", strerror (errno));
+    timer_stop_batch (&t, n);
+    timer_report (&t, "sigcert_create_many (per cert)");
+    for (i = 0; i < n; i++)
+        sigcert_destroy (certs[i]);
+
+    timer_init (&t, n);
+    timer_start (&t);
+    if (sigcert_create_many (certs, n, 0) < 0)
+        die ("sigcert_create_many: %s", strerror (errno));
+    if (ca_sign_batch (ca, certs, n, 0, 0, userids, e) < 0)
+        die ("ca_sign_batch: %s", e);
+    if (sigcert_store_many (certs, (const char **)names, n) < 0)
+        die ("sigcert_store_many: %s", strerror (errno));
+    timer_stop_batch (&t, n);
+    timer_report (&t, "create+sign+store_many (per cert)");
+
+    for (i = 0; i < n; i++) {
+        sigcert_destroy (certs[i]);
+        rmpath ("%s", names[i]);
+        rmpath ("%s.pub", names[i]);
+        free (names[i]);
+    }
+    free (certs);
+    free (names);
+    free (userids);
+    ca_destroy (ca);
+    cf_destroy (cf);
+}
+
+static void bench_revocation (int n, int size)
+{
+    cf_t *cf;
+    struct ca *ca;
+    ca_error_t e;
+    struct timer t;
+    char uuid[37];
+    uuid_t u;
+    int i;
+
+    revoke_dir_create ("ca-revoke-bench", size);
+    cf = config_create ("ca-revoke-bench", "");
+    if (!(ca = ca_create (cf, e)))
+        die ("ca_create: %s", e);
+
+    /* ca_load() reads the whole revoke-dir, so limit its iterations.
+     */
+    timer_init (&t, n < 100 ? n : 100);
+    for (i = 0; i < n && i < 100; i++) {
+        timer_start (&t);
+        if (ca_load (ca, false, e) < 0)
+            die ("ca_load: %s", e);
+        timer_stop (&t);
+    }
+    timer_report (&t, "ca_load (revoked=%d)", size);
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        uuid_generate (u);
+        uuid_unparse (u, uuid);
+        timer_start (&t);
+        if (ca_check_revocation (ca, uuid, e) < 0)
+            die ("ca_check_revocation: %s", e);
+        timer_stop (&t);
+    }
+    timer_report (&t, "check_revocation (revoked=%d)", size);
+
+    ca_destroy (ca);
+    cf_destroy (cf);
+    revoke_dir_destroy ("ca-revoke-bench");
+}
+
+static void bench_timestamp (int n)
+{
+    struct timer t;
+    struct tm tm;
+    time_t now = time (NULL);
+    time_t ts;
+    char buf[64];
+    int i;
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (timestamp_tostr (now + i, buf, sizeof (buf)) < 0)
+            die ("timestamp_tostr failed");
+        timer_stop (&t);
+    }
+    timer_report (&t, "timestamp_tostr");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        time_t tt = now + i;
+        timer_start (&t);
+        if (!gmtime_r (&tt, &tm) || strftime (buf, sizeof (buf),
+                                              "%FT%TZ", &tm) == 0)
+            die ("strftime failed");
+        timer_stop (&t);
+    }
+    timer_report (&t, "gmtime_r+strftime");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (timestamp_fromstr (buf, &ts) < 0)
+            die ("timestamp_fromstr failed");
+        timer_stop (&t);
+    }
+    timer_report (&t, "timestamp_fromstr");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (!strptime (buf, "%FT%TZ", &tm) || timegm (&tm) < 0)
+            die ("strptime failed");
+        timer_stop (&t);
+    }
+    timer_report (&t, "strptime+timegm");
+}
+
+int main (int argc, char *argv[])
+{
+    const char *t = getenv ("TMPDIR");
+    const char *sizes = "0,100,1000,10000";
+    char *cpy;
+    char *tok;
+    char *saveptr = NULL;
+    int n = 1000;
+    int c;
+
+    while ((c = getopt (argc, argv, "n:r:")) != -1) {
+        switch (c) {
+            case 'n':
+                if ((n = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'r':
+                sizes = optarg;
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc)
+        usage ();
+
+    if (snprintf (tmpdir, sizeof (tmpdir), "%s/bench-ca-XXXXXX",
+                  t ? t : "/tmp") >= sizeof (tmpdir))
+        die ("tmpdir buffer overflow");
+    if (!mkdtemp (tmpdir))
+        die ("mkdtemp: %s", strerror (errno));
+
+    printf ("%-32s %10s %9s %9s %9s %9s\n",
+            "operation", "ops/sec",
+            "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    bench_ca (n);
+    bench_onboard (n);
+    bench_timestamp (n);
+    if (!(cpy = strdup (sizes)))
+        die ("out of memory");
+    for (tok = strtok_r (cpy, ",", &saveptr); tok != NULL;
+         tok = strtok_r (NULL, ",", &saveptr))
+        bench_revocation (n, strtol (tok, NULL, 10));
+    free (cpy);
+
+    rmpath ("%s/ca-cert", tmpdir);
+    rmpath ("%s/ca-cert.pub", tmpdir);
+    rmpath ("%s", tmpdir);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -13,6 +13,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
@@ -156,6 +157,20 @@ void test_basic (void)
     ok (ttl == 30,
         "max-sign-ttl is correct");
 
+    /* Verify cert at a given time ('t' is xtime)
+     */
+    ok (ca_verify_at (ca, cert, t, NULL, NULL, e) == 0,
+        "ca_verify_at now=xtime works");
+    errno = 0;
+    ok (ca_verify_at (ca, cert, t + 1, NULL, NULL, e) < 0 && errno == EINVAL,
+        "ca_verify_at now=xtime+1 fails with EINVAL");
+    diag ("%s", e);
+    errno = 0;
+    ok (ca_verify_at (ca, cert, not_valid_before_time - 1, NULL, NULL, e) < 0
+        && errno == EINVAL,
+        "ca_verify_at now=not-valid-before-time-1 fails with EINVAL");
+    diag ("%s", e);
+
     /* Save/restore CA cert to file system
      */
     ok (ca_store (ca, e) == 0,
@@ -188,14 +203,26 @@ void test_basic (void)
      */
     if (sigcert_meta_get (cert, "uuid", SM_STRING, &uuid) < 0)
         BAIL_OUT ("failed to read cert uuid: %s", strerror (errno));
+    ok (ca_check_revocation (ca, uuid, e) == 0,
+        "ca_check_revocation works on unrevoked cert");
     ok (ca_revoke (ca, uuid, e) == 0,
         "sigcert revoke works");
     errno = 0;
+    ok (ca_check_revocation (ca, uuid, e) < 0 && errno == EINVAL,
+        "ca_check_revocation fails on revoked cert with EINVAL");
+    diag ("%s", e);
+    errno = 0;
     ok (ca_verify (ca, badcert, NULL, NULL, e) < 0 && errno == EINVAL,
         "ca_verify fails with EINVAL");
     diag ("%s", e);
     sigcert_destroy (badcert);
 
+    snprintf (path, sizeof (path), "%s/ca-crl", tmpdir);
+    ok (ca_revoke_publish (ca, path, e) == 0 && access (path, R_OK) == 0,
+        "ca_revoke_publish works");
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+
     /* clean up revocation dir */
     snprintf (path, sizeof (path), "%s/ca-revoke/%s", tmpdir, uuid);
     if (unlink (path) < 0)
@@ -208,6 +235,401 @@ void test_basic (void)
     ca_destroy (ca);
 }
 
+void test_sign_batch (void)
+{
+    struct ca *ca;
+    ca_error_t e;
+    struct sigcert *certs[4];
+    int64_t userids[4] = { 1, 2, 3, 4 };
+    int64_t userid;
+    time_t ctime0, ctime;
+    int i;
+    int errors;
+
+    if (!(ca = ca_create (cf, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    for (i = 0; i < 4; i++) {
+        if (!(certs[i] = sigcert_create ()))
+            BAIL_OUT ("sigcert_create failed");
+    }
+    errno = 0;
+    ok (ca_sign_batch (ca, certs, 4, 0, 0, userids, e) < 0 && errno == EINVAL,
+        "ca_sign_batch fails with EINVAL before CA cert is loaded");
+    if (ca_keygen (ca, 0, 0, e) < 0)
+        BAIL_OUT ("ca_keygen: %s", e);
+    ok (ca_sign_batch (ca, certs, 4, 0, 0, userids, e) == 4,
+        "ca_sign_batch signed 4 certs");
+    errors = 0;
+    if (sigcert_meta_get (certs[0], "ctime", SM_TIMESTAMP, &ctime0) < 0)
+        errors++;
+    for (i = 0; i < 4; i++) {
+        if (ca_verify (ca, certs[i], &userid, NULL, e) < 0
+            || userid != userids[i]
+            || sigcert_meta_get (certs[i], "ctime", SM_TIMESTAMP, &ctime) < 0
+            || ctime != ctime0)
+            errors++;
+    }
+    ok (errors == 0,
+        "batch certs verify with expected userid and common ctime");
+    ok (ca_sign_batch (ca, certs, 0, 0, 0, NULL, e) == 0,
+        "ca_sign_batch count=0 works");
+
+    userids[2] = -1;
+    errno = 0;
+    *e = '\0';
+    ok (ca_sign_batch (ca, certs, 4, 0, 0, userids, e) < 0 && errno == EINVAL
+        && strstr (e, "cert 2") != NULL,
+        "ca_sign_batch with invalid userid fails with EINVAL naming cert");
+    errno = 0;
+    ok (ca_sign_batch (ca, certs, 4, 0, 0, NULL, e) < 0 && errno == EINVAL,
+        "ca_sign_batch userids=NULL fails with EINVAL");
+    errno = 0;
+    ok (ca_sign_batch (NULL, certs, 4, 0, 0, userids, e) < 0
+        && errno == EINVAL,
+        "ca_sign_batch ca=NULL fails with EINVAL");
+
+    for (i = 0; i < 4; i++)
+        sigcert_destroy (certs[i]);
+    ca_destroy (ca);
+}
+
+void test_verify_many (void)
+{
+    struct ca *ca;
+    ca_error_t e;
+    struct sigcert *certs[300];
+    struct ca_verify_result results[300];
+    int nthreads[] = { 1, 4, 0 };
+    int errors;
+    int i;
+    int j;
+
+    if (!(ca = ca_create (cf, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    if (ca_keygen (ca, 0, 0, e) < 0)
+        BAIL_OUT ("ca_keygen: %s", e);
+    for (i = 0; i < 300; i++) {
+        if (!(certs[i] = sigcert_create ()))
+            BAIL_OUT ("sigcert_create failed");
+        if (i != 5 && ca_sign (ca, certs[i], 0, 0, 1000 + i, e) < 0)
+            BAIL_OUT ("ca_sign: %s", e);
+    }
+    /* certs[5] is unsigned, certs[7] is missing, certs[9] is altered.
+     */
+    sigcert_destroy (certs[7]);
+    certs[7] = NULL;
+    if (sigcert_meta_set (certs[9], "userid", SM_INT64, (int64_t)0) < 0)
+        BAIL_OUT ("sigcert_meta_set failed");
+
+    for (j = 0; j < sizeof (nthreads) / sizeof (nthreads[0]); j++) {
+        memset (results, 0xff, sizeof (results));
+        ok (ca_verify_many (ca, certs, 300, nthreads[j], results, e) == 297,
+            "ca_verify_many nthreads=%d verified 297 of 300 certs",
+            nthreads[j]);
+        errors = 0;
+        for (i = 0; i < 300; i++) {
+            if (i == 5 || i == 7 || i == 9) {
+                if (results[i].errnum == 0 || results[i].userid != -1
+                    || strlen (results[i].error) == 0)
+                    errors++;
+            }
+            else if (results[i].errnum != 0
+                     || results[i].userid != 1000 + i
+                     || results[i].max_sign_ttl != 30)
+                errors++;
+        }
+        ok (errors == 0,
+            "ca_verify_many nthreads=%d results are correct", nthreads[j]);
+    }
+    diag ("%s", results[9].error);
+
+    ok (ca_verify_many (ca, NULL, 0, 4, NULL, e) == 0,
+        "ca_verify_many count=0 returns 0");
+    errno = 0;
+    ok (ca_verify_many (NULL, certs, 300, 4, results, e) < 0
+        && errno == EINVAL,
+        "ca_verify_many ca=NULL fails with EINVAL");
+    errno = 0;
+    ok (ca_verify_many (ca, certs, 300, -1, results, e) < 0
+        && errno == EINVAL,
+        "ca_verify_many nthreads=-1 fails with EINVAL");
+
+    for (i = 0; i < 300; i++)
+        sigcert_destroy (certs[i]);
+    ca_destroy (ca);
+}
+
+void test_intermediate (void)
+{
+    struct ca *root;
+    struct ca *site;
+    struct ca *ca;
+    ca_error_t e;
+    struct sigcert *im;
+    struct sigcert *im2;
+    struct sigcert *leaf;
+    const char *im_uuid;
+    int64_t userid;
+    cf_t *cf2;
+    struct cf_error error;
+    char conf[PATH_MAX + 64];
+    char path[PATH_MAX + 64];
+
+    if (!(root = ca_create (cf, e)) || !(site = ca_create (cf, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    if (ca_keygen (root, 0, 0, e) < 0)
+        BAIL_OUT ("ca_keygen: %s", e);
+
+    /* Root signs an intermediate, which the site uses as its CA cert.
+     */
+    im = sigcert_create ();
+    im2 = sigcert_create ();
+    leaf = sigcert_create ();
+    if (!im || !im2 || !leaf)
+        BAIL_OUT ("sigcert_create failed");
+    ok (ca_sign_intermediate (root, im, 0, 0, e) == 0,
+        "ca_sign_intermediate works");
+    if (ca_set_cert (site, im, e) < 0)
+        BAIL_OUT ("ca_set_cert: %s", e);
+    ok (ca_sign (site, leaf, 0, 0, 42, e) == 0,
+        "site signed leaf cert with intermediate");
+    ok (ca_verify (site, leaf, &userid, NULL, e) == 0 && userid == 42,
+        "site verifies its own leaf cert");
+    errno = 0;
+    ok (ca_verify (root, leaf, NULL, NULL, e) < 0 && errno == EINVAL,
+        "root cannot verify leaf before intermediate is added");
+    diag ("%s", e);
+
+    sigcert_forget_secret (im);
+    ok (ca_add_intermediate (root, im, e) == 0,
+        "ca_add_intermediate works");
+    ok (ca_verify (root, leaf, &userid, NULL, e) == 0 && userid == 42,
+        "root verifies leaf cert signed by intermediate");
+
+    errno = 0;
+    ok (ca_add_intermediate (root, leaf, e) < 0 && errno == EINVAL,
+        "ca_add_intermediate fails on cert without ca-capability");
+    diag ("%s", e);
+    ok (ca_sign_intermediate (site, im2, 0, 0, e) == 0,
+        "site signed a second level intermediate");
+    errno = 0;
+    ok (ca_add_intermediate (root, im2, e) < 0 && errno == EINVAL,
+        "ca_add_intermediate fails on cert not signed by root");
+    diag ("%s", e);
+
+    /* Revoke the intermediate.
+     */
+    if (sigcert_meta_get (im, "uuid", SM_STRING, &im_uuid) < 0)
+        BAIL_OUT ("sigcert_meta_get uuid failed");
+    if (ca_revoke (root, im_uuid, e) < 0)
+        BAIL_OUT ("ca_revoke: %s", e);
+    errno = 0;
+    ok (ca_verify (root, leaf, NULL, NULL, e) < 0 && errno == EINVAL,
+        "root cannot verify leaf once intermediate is revoked");
+    diag ("%s", e);
+    snprintf (path, sizeof (path), "%s/ca-revoke/%s", tmpdir, im_uuid);
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+
+    /* Load intermediate from intermediate-dir.
+     */
+    if (ca_store (root, e) < 0)
+        BAIL_OUT ("ca_store: %s", e);
+    snprintf (path, sizeof (path), "%s/ca-im", tmpdir);
+    if (mkdir (path, 0755) < 0)
+        BAIL_OUT ("mkdir %s: %s", path, strerror (errno));
+    snprintf (path, sizeof (path), "%s/ca-im/site1", tmpdir);
+    if (sigcert_store (im, path) < 0)
+        BAIL_OUT ("sigcert_store: %s", strerror (errno));
+    if (!(cf2 = cf_copy (cf)))
+        BAIL_OUT ("cf_copy: %s", strerror (errno));
+    if (snprintf (conf, sizeof (conf), "intermediate-dir = \"%s/ca-im\"\n",
+                  tmpdir) >= sizeof (conf))
+        BAIL_OUT ("conf buffer overflow");
+    if (cf_update (cf2, conf, strlen (conf), &error) < 0)
+        BAIL_OUT ("cf_update: %s", error.errbuf);
+    if (!(ca = ca_create (cf2, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    ok (ca_load (ca, false, e) == 0,
+        "ca_load with intermediate-dir works");
+    ok (ca_verify (ca, leaf, &userid, NULL, e) == 0 && userid == 42,
+        "loaded ca verifies leaf cert signed by intermediate");
+    ok (ca_keygen (ca, 0, 0, e) == 0
+        && ca_verify (ca, leaf, NULL, NULL, e) < 0,
+        "intermediates are dropped when CA cert is replaced");
+    ca_destroy (ca);
+    cf_destroy (cf2);
+
+    snprintf (path, sizeof (path), "%s/ca-im/site1.pub", tmpdir);
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+    snprintf (path, sizeof (path), "%s/ca-im", tmpdir);
+    if (rmdir (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+    snprintf (path, sizeof (path), "%s/ca-revoke", tmpdir);
+    if (rmdir (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+
+    errno = 0;
+    ok (ca_add_intermediate (NULL, im, e) < 0 && errno == EINVAL,
+        "ca_add_intermediate ca=NULL fails with EINVAL");
+    errno = 0;
+    ok (ca_sign_intermediate (NULL, im, 0, 0, e) < 0 && errno == EINVAL,
+        "ca_sign_intermediate ca=NULL fails with EINVAL");
+
+    sigcert_destroy (im);
+    sigcert_destroy (im2);
+    sigcert_destroy (leaf);
+    ca_destroy (site);
+    ca_destroy (root);
+}
+
+void test_shared_cert (void)
+{
+    struct ca *ca;
+    struct ca *ca1;
+    struct ca *ca2;
+    struct ca *ca3;
+    ca_error_t e;
+    const struct sigcert *cert1;
+    char path[PATH_MAX + 64];
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000, 0 } };
+
+    if (!(ca = ca_create (cf, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    if (ca_keygen (ca, 0, 0, e) < 0 || ca_store (ca, e) < 0)
+        BAIL_OUT ("ca_keygen/store: %s", e);
+    ca1 = ca_create (cf, e);
+    ca2 = ca_create (cf, e);
+    ca3 = ca_create (cf, e);
+    if (!ca1 || !ca2 || !ca3)
+        BAIL_OUT ("ca_create: %s", e);
+
+    ok (ca_load (ca1, false, e) == 0 && ca_load (ca2, false, e) == 0,
+        "ca_load secret=false works for two ca objects");
+    cert1 = ca_get_cert (ca1, e);
+    ok (cert1 != NULL && cert1 == ca_get_cert (ca2, e),
+        "both share the same CA cert");
+    ok (ca_load (ca3, true, e) == 0 && ca_get_cert (ca3, e) != cert1,
+        "ca_load secret=true does not use the shared cert");
+    ok (ca_load (ca1, false, e) == 0 && ca_get_cert (ca1, e) == cert1,
+        "reloading an unchanged file reuses the shared cert");
+
+    /* Set an explicit mtime so the change is seen even if it happens
+     * within the filesystem timestamp granularity.
+     */
+    if (ca_keygen (ca, 0, 0, e) < 0 || ca_store (ca, e) < 0)
+        BAIL_OUT ("ca_keygen/store: %s", e);
+    snprintf (path, sizeof (path), "%s/ca-cert.pub", tmpdir);
+    if (utimensat (AT_FDCWD, path, times, 0) < 0)
+        BAIL_OUT ("utimensat %s: %s", path, strerror (errno));
+    ok (ca_load (ca2, false, e) == 0
+        && memcmp (sigcert_fingerprint (ca_get_cert (ca2, e)),
+                   sigcert_fingerprint (ca_get_cert (ca, e)),
+                   SIGCERT_FINGERPRINT_SIZE) == 0,
+        "ca_load re-reads the cert after the file changes");
+    ok (ca_get_cert (ca1, e) == cert1,
+        "other ca object keeps the cert it loaded");
+    ok (ca_load (ca1, false, e) == 0
+        && ca_get_cert (ca1, e) == ca_get_cert (ca2, e),
+        "ca objects share the new cert after reloading");
+
+    ca_destroy (ca3);
+    ca_destroy (ca2);
+    ca_destroy (ca1);
+    ca_destroy (ca);
+}
+
+void test_verified_cache (void)
+{
+    struct ca *ca;
+    struct ca *ca2;
+    ca_error_t e;
+    struct sigcert *certs[2];
+    struct sigcert *leaf;
+    struct sigcert *cpy;
+    const char *uuid;
+    int64_t userid;
+    cf_t *cf2;
+    struct cf_error error;
+    char conf[PATH_MAX + 64];
+    char path[PATH_MAX + 64];
+
+    if (!(cf2 = cf_copy (cf)))
+        BAIL_OUT ("cf_copy: %s", strerror (errno));
+    if (snprintf (conf, sizeof (conf), "verified-cache = \"%s/ca-vc\"\n",
+                  tmpdir) >= sizeof (conf))
+        BAIL_OUT ("conf buffer overflow");
+    if (cf_update (cf2, conf, strlen (conf), &error) < 0)
+        BAIL_OUT ("cf_update: %s", error.errbuf);
+    if (!(ca = ca_create (cf2, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    if (ca_keygen (ca, 0, 0, e) < 0 || ca_store (ca, e) < 0)
+        BAIL_OUT ("ca_keygen/store: %s", e);
+    leaf = sigcert_create ();
+    certs[1] = sigcert_create ();
+    if (!leaf || !certs[1])
+        BAIL_OUT ("sigcert_create failed");
+    certs[0] = leaf;
+    if (ca_sign (ca, leaf, 0, 0, 42, e) < 0)
+        BAIL_OUT ("ca_sign: %s", e);
+
+    snprintf (path, sizeof (path), "%s/ca-vc", tmpdir);
+    ok (ca_verified_cache_write (ca, path, certs, 2, e) == 1,
+        "ca_verified_cache_write stored the one valid cert");
+
+    if (!(ca2 = ca_create (cf2, e)))
+        BAIL_OUT ("ca_create: %s", e);
+    ok (ca_load (ca2, false, e) == 0,
+        "ca_load with verified-cache works");
+    ok (ca_verify (ca2, leaf, &userid, NULL, e) == 0 && userid == 42,
+        "cached cert verifies with correct userid");
+
+    /* A copy with altered metadata has a different signed digest, so it
+     * falls through to full verification and fails.
+     */
+    if (!(cpy = sigcert_copy (leaf)))
+        BAIL_OUT ("sigcert_copy failed");
+    if (sigcert_meta_set (cpy, "userid", SM_INT64, (int64_t)0) < 0)
+        BAIL_OUT ("sigcert_meta_set failed");
+    errno = 0;
+    ok (ca_verify (ca2, cpy, NULL, NULL, e) < 0 && errno == EINVAL,
+        "cached cert with altered metadata fails verification");
+    diag ("%s", e);
+    sigcert_destroy (cpy);
+
+    /* Revocation is still checked for cached certs.
+     */
+    if (sigcert_meta_get (leaf, "uuid", SM_STRING, &uuid) < 0)
+        BAIL_OUT ("sigcert_meta_get uuid failed");
+    if (ca_revoke (ca2, uuid, e) < 0)
+        BAIL_OUT ("ca_revoke: %s", e);
+    errno = 0;
+    ok (ca_verify (ca2, leaf, NULL, NULL, e) < 0 && errno == EINVAL,
+        "revoked cached cert fails verification");
+    diag ("%s", e);
+
+    errno = 0;
+    ok (ca_verified_cache_write (NULL, path, certs, 2, e) < 0
+        && errno == EINVAL,
+        "ca_verified_cache_write ca=NULL fails with EINVAL");
+
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+    snprintf (path, sizeof (path), "%s/ca-revoke/%s", tmpdir, uuid);
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+    snprintf (path, sizeof (path), "%s/ca-revoke", tmpdir);
+    if (rmdir (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+
+    sigcert_destroy (leaf);
+    sigcert_destroy (certs[1]);
+    ca_destroy (ca2);
+    ca_destroy (ca);
+    cf_destroy (cf2);
+}
+
 void test_ca_meta (void)
 {
     ca_error_t e;
@@ -288,6 +710,14 @@ void test_ca_capability (void)
         "but ca_verify fails with EINVAL and updates e");
     diag ("ca_verify: %s", e);
 
+    if (sigcert_meta_set (ca_cert, "ca-capability", SM_BOOL, true) < 0)
+        BAIL_OUT ("sigcert_meta_set failed");
+    ok (ca_set_cert (ca, ca_cert, e) == 0,
+        "ca_set_cert set cert with ca-capability=true");
+    ok (ca_sign (ca, cert, 0, 0, getuid (), e) == 0
+        && ca_verify (ca, cert, NULL, NULL, e) == 0,
+        "ca_verify works once CA cert is replaced with capable one");
+
     ca_destroy (ca);
     sigcert_destroy (cert);
     sigcert_destroy (ca_cert);
@@ -442,6 +872,18 @@ void test_corner (void)
         "ca_revoke ca=NULL fails with EINVAL and updates e");
     errno = 0;
     *e = '\0';
+    ok (ca_revoke_publish (NULL, "xyz", e) < 0 && errno == EINVAL && *e,
+        "ca_revoke_publish ca=NULL fails with EINVAL and updates e");
+    errno = 0;
+    *e = '\0';
+    ok (ca_check_revocation (NULL, "xyz", e) < 0 && errno == EINVAL && *e,
+        "ca_check_revocation ca=NULL fails with EINVAL and updates e");
+    errno = 0;
+    *e = '\0';
+    ok (ca_check_revocation (ca, NULL, e) < 0 && errno == EINVAL && *e,
+        "ca_check_revocation uuid=NULL fails with EINVAL and updates e");
+    errno = 0;
+    *e = '\0';
     ok (ca_revoke (ca, NULL, e) < 0 && errno == EINVAL && *e,
         "ca_revoke uuid=NULL fails with EINVAL and updates e");
     errno = 0;
@@ -477,6 +919,11 @@ int main (int argc, char *argv[])
     cf_init ();
 
     test_basic ();
+    test_sign_batch ();
+    test_verify_many ();
+    test_intermediate ();
+    test_verified_cache ();
+    test_shared_cert ();
     test_ca_meta ();
     test_ca_capability ();
     test_expiration ();
@@ -0,0 +1,315 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "src/libtap/tap.h"
+#include "revoke.h"
+
+static char tmpdir[PATH_MAX + 1];
+static char dir[PATH_MAX + 1];
+static char list[PATH_MAX + 1];
+static char list2[PATH_MAX + 1];
+
+static const char *uuid1 = "68a4ba26-3a7b-4c2c-9a0e-0d2c3ffbe4a1";
+static const char *uuid2 = "0b1f3d50-8f7c-4a3c-b6a1-5f5d2b7c9e10";
+static const char *uuid3 = "f3c2e1d0-1234-4abc-8def-0123456789ab";
+
+static void touch (const char *name)
+{
+    char path[PATH_MAX + 1];
+    int fd;
+
+    if (snprintf (path, sizeof (path), "%s/%s", dir, name) >= sizeof (path))
+        BAIL_OUT ("path buffer overflow");
+    if ((fd = open (path, O_WRONLY | O_CREAT, 0644)) < 0 || close (fd) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+}
+
+static void rm (const char *name)
+{
+    char path[PATH_MAX + 1];
+
+    if (snprintf (path, sizeof (path), "%s/%s", dir, name) >= sizeof (path))
+        BAIL_OUT ("path buffer overflow");
+    if (unlink (path) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+}
+
+static bool is_revoked (struct revoke *r, const char *uuid)
+{
+    bool revoked;
+
+    if (revoke_check (r, uuid, &revoked) < 0)
+        BAIL_OUT ("revoke_check: %s", strerror (errno));
+    return revoked;
+}
+
+void test_basic (void)
+{
+    struct revoke *r;
+
+    ok ((r = revoke_create (dir, NULL, 0)) != NULL,
+        "revoke_create interval=0 works on missing directory");
+    ok (is_revoked (r, "abc") == false,
+        "uuid is not revoked when directory is missing");
+    ok (revoke_count (r) == 0,
+        "revoke_count is 0");
+
+    if (mkdir (dir, 0755) < 0)
+        BAIL_OUT ("mkdir %s: %s", dir, strerror (errno));
+    touch ("abc");
+    touch ("def");
+    ok (is_revoked (r, "abc") == true && is_revoked (r, "def") == true,
+        "uuids are revoked once files are created");
+    ok (is_revoked (r, "xyz") == false,
+        "other uuid is not revoked");
+    ok (revoke_count (r) == 2,
+        "revoke_count is 2");
+
+    rm ("abc");
+    ok (is_revoked (r, "abc") == false,
+        "uuid is no longer revoked once file is removed");
+    rm ("def");
+
+    errno = 0;
+    ok (revoke_check (r, NULL, NULL) < 0 && errno == EINVAL,
+        "revoke_check uuid=NULL fails with EINVAL");
+    errno = 0;
+    ok (revoke_add (r, "") < 0 && errno == EINVAL,
+        "revoke_add uuid=(empty) fails with EINVAL");
+    errno = 0;
+    ok (revoke_create (NULL, NULL, 0) == NULL && errno == EINVAL,
+        "revoke_create dir=NULL fails with EINVAL");
+    errno = 0;
+    ok (revoke_create (dir, NULL, -1) == NULL && errno == EINVAL,
+        "revoke_create interval=-1 fails with EINVAL");
+
+    revoke_destroy (r);
+}
+
+/* With a long interval, changes are only seen after revoke_refresh().
+ */
+void test_interval (void)
+{
+    struct revoke *r;
+
+    if (!(r = revoke_create (dir, NULL, 3600)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    ok (is_revoked (r, "abc") == false,
+        "uuid is not revoked");
+    touch ("abc");
+    ok (is_revoked (r, "abc") == false,
+        "new revocation is not seen before interval elapses");
+    ok (revoke_refresh (r) == 0 && is_revoked (r, "abc") == true,
+        "new revocation is seen after revoke_refresh");
+    touch ("aaa");
+    touch ("ccc");
+    ok (revoke_add (r, "ccc") == 0 && revoke_add (r, "aaa") == 0
+        && is_revoked (r, "ccc") == true && is_revoked (r, "aaa") == true,
+        "revoke_add takes effect before interval elapses");
+    ok (revoke_add (r, "abc") == 0 && revoke_count (r) == 3,
+        "revoke_add of existing uuid works");
+    ok (revoke_refresh (r) == 0 && revoke_count (r) == 3
+        && is_revoked (r, "aaa") && is_revoked (r, "abc")
+        && is_revoked (r, "ccc"),
+        "uuids added locally and in directory are counted once");
+    rm ("aaa");
+    rm ("abc");
+    rm ("ccc");
+    revoke_destroy (r);
+}
+
+/* If the directory can be searched but not read, files are checked directly.
+ */
+void test_fallback (void)
+{
+    struct revoke *r;
+
+    skip (geteuid () == 0, 2, "directory permissions do not apply to root");
+    if (!(r = revoke_create (dir, NULL, 0)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    touch ("abc");
+    if (chmod (dir, 0311) < 0)
+        BAIL_OUT ("chmod %s: %s", dir, strerror (errno));
+    ok (is_revoked (r, "abc") == true,
+        "uuid is revoked with unreadable directory");
+    ok (is_revoked (r, "def") == false,
+        "other uuid is not revoked with unreadable directory");
+    if (chmod (dir, 0755) < 0)
+        BAIL_OUT ("chmod %s: %s", dir, strerror (errno));
+    rm ("abc");
+    revoke_destroy (r);
+    end_skip;
+}
+
+static off_t file_size (const char *path)
+{
+    struct stat st;
+
+    if (stat (path, &st) < 0)
+        BAIL_OUT ("stat %s: %s", path, strerror (errno));
+    return st.st_size;
+}
+
+static void append_bytes (const char *path, const void *buf, size_t len)
+{
+    int fd;
+
+    if ((fd = open (path, O_WRONLY | O_APPEND)) < 0
+        || write (fd, buf, len) != len
+        || close (fd) < 0)
+        BAIL_OUT ("%s: %s", path, strerror (errno));
+}
+
+/* Revocation list file: append, publish, and lookup in the sorted section.
+ */
+void test_list (void)
+{
+    struct revoke *r;
+    struct revoke *r2;
+    off_t size;
+    char uuid[64];
+    int i;
+    int errors;
+    bool revoked;
+
+    if (!(r = revoke_create (dir, list, 0)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    ok (is_revoked (r, uuid1) == false && revoke_count (r) == 0,
+        "uuid is not revoked when list is missing");
+    ok (revoke_append (r, uuid1) == 0 && is_revoked (r, uuid1) == true,
+        "revoke_append creates list and uuid is revoked");
+    ok (is_revoked (r, uuid2) == false,
+        "other uuid is not revoked");
+    size = file_size (list);
+    ok (revoke_append (r, uuid2) == 0 && file_size (list) == size + 16,
+        "revoke_append adds a 16 byte record");
+    ok (is_revoked (r, uuid1) == true && is_revoked (r, uuid2) == true
+        && revoke_count (r) == 2,
+        "both appended uuids are revoked");
+    append_bytes (list, "\x01\x02\x03", 3);
+    ok (is_revoked (r, uuid2) == true && revoke_count (r) == 2,
+        "trailing partial record is ignored");
+
+    touch ("abc");
+    touch (uuid3);
+    ok (is_revoked (r, "abc") == true && is_revoked (r, uuid3) == true,
+        "uuids in directory are also revoked");
+
+    ok (revoke_publish (r, list2) == 0,
+        "revoke_publish works");
+    rm ("abc");
+    rm (uuid3);
+    if (!(r2 = revoke_create (dir, list2, 3600)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    ok (is_revoked (r2, uuid1) == true && is_revoked (r2, uuid2) == true
+        && is_revoked (r2, uuid3) == true,
+        "published list contains appended and directory uuids");
+    ok (is_revoked (r2, "abc") == false,
+        "published list omits non-uuid directory entry");
+    ok (revoke_count (r2) == 3,
+        "published list contains 3 uuids");
+    ok (revoke_append (r2, uuid3) == 0 && revoke_count (r2) == 4,
+        "revoke_append to published list works");
+    ok (revoke_publish (r2, list2) == 0 && revoke_count (r2) == 3,
+        "revoke_publish over own list folds in appended duplicate");
+
+    /* Many uuids: exercise the bloom filter and binary search
+     */
+    for (i = 0; i < 1000; i++) {
+        snprintf (uuid, sizeof (uuid),
+                  "00000000-0000-4000-8000-%012d", i * 2);
+        if (revoke_append (r2, uuid) < 0)
+            BAIL_OUT ("revoke_append: %s", strerror (errno));
+    }
+    ok (revoke_publish (r2, list2) == 0 && revoke_count (r2) == 1003,
+        "revoke_publish of 1003 uuids works");
+    errors = 0;
+    for (i = 0; i < 2000; i++) {
+        snprintf (uuid, sizeof (uuid),
+                  "00000000-0000-4000-8000-%012d", i);
+        if (is_revoked (r2, uuid) != (i % 2 == 0))
+            errors++;
+    }
+    ok (errors == 0,
+        "lookups in sorted list are correct");
+    revoke_destroy (r2);
+
+    errno = 0;
+    ok (revoke_append (r, "abc") < 0 && errno == EINVAL,
+        "revoke_append of invalid uuid fails with EINVAL");
+    if (!(r2 = revoke_create (dir, NULL, 0)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    errno = 0;
+    ok (revoke_append (r2, uuid1) < 0 && errno == EINVAL,
+        "revoke_append without list fails with EINVAL");
+    revoke_destroy (r2);
+    revoke_destroy (r);
+
+    /* A corrupt list fails closed.
+     */
+    if (truncate (list2, 0) < 0)
+        BAIL_OUT ("truncate: %s", strerror (errno));
+    append_bytes (list2, "NOTACRL1xxxxxxxxxxxxxxxx", 24);
+    if (!(r = revoke_create (dir, list2, 0)))
+        BAIL_OUT ("revoke_create: %s", strerror (errno));
+    errno = 0;
+    ok (revoke_check (r, uuid1, &revoked) < 0 && errno == EINVAL,
+        "revoke_check fails with EINVAL on invalid list");
+    revoke_destroy (r);
+
+    if (unlink (list) < 0 || unlink (list2) < 0)
+        BAIL_OUT ("cleanup: %s", strerror (errno));
+}
+
+int main (int argc, char *argv[])
+{
+    const char *t = getenv ("TMPDIR");
+
+    plan (NO_PLAN);
+
+    if (snprintf (tmpdir, sizeof (tmpdir), "%s/revoke-XXXXXX",
+                  t ? t : "/tmp") >= sizeof (tmpdir))
+        BAIL_OUT ("tmpdir buffer overflow");
+    if (!mkdtemp (tmpdir))
+        BAIL_OUT ("mkdtemp: %s", strerror (errno));
+    if (snprintf (dir, sizeof (dir), "%s/revoke", tmpdir) >= sizeof (dir))
+        BAIL_OUT ("dir buffer overflow");
+    if (snprintf (list, sizeof (list), "%s/crl", tmpdir) >= sizeof (list)
+        || snprintf (list2, sizeof (list2), "%s/crl2",
+                     tmpdir) >= sizeof (list2))
+        BAIL_OUT ("list buffer overflow");
+
+    test_basic ();
+    test_interval ();
+    test_fallback ();
+    test_list ();
+
+    if (rmdir (dir) < 0 || rmdir (tmpdir) < 0)
+        BAIL_OUT ("rmdir: %s", strerror (errno));
+
+    done_testing ();
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -17,8 +17,10 @@
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <sodium.h>
 
 #include "src/libtap/tap.h"
+#include "src/libutil/kv.h"
 #include "sigcert.h"
 
 static char scratch[PATH_MAX + 1];
@@ -117,6 +119,229 @@ void test_meta (void)
     sigcert_destroy (cert);
 }
 
+void test_meta_index (void)
+{
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    struct sigcert *cert3;
+    const char *buf;
+    int len;
+    const char *s;
+    int64_t i;
+    bool b;
+    time_t t;
+    time_t tnow = time (NULL);
+
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    if (sigcert_meta_set (cert, "uuid", SM_STRING, "abc") < 0
+        || sigcert_meta_set (cert, "userid", SM_INT64, 1000LL) < 0
+        || sigcert_meta_set (cert, "xtime", SM_TIMESTAMP, tnow) < 0
+        || sigcert_meta_set (cert, "ca-capability", SM_BOOL, true) < 0
+        || sigcert_meta_set (cert, "foo", SM_STRING, "bar") < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    if (sigcert_encode (cert, &buf, &len) < 0
+        || !(cert2 = sigcert_decode (buf, len)))
+        BAIL_OUT ("sigcert_encode/decode");
+
+    /* Indexed keys
+     */
+    ok (sigcert_meta_get (cert2, "uuid", SM_STRING, &s) == 0
+        && !strcmp (s, "abc"),
+        "sigcert_meta_get uuid works on decoded cert");
+    ok (sigcert_meta_get (cert2, "userid", SM_INT64, &i) == 0 && i == 1000,
+        "sigcert_meta_get userid works on decoded cert");
+    ok (sigcert_meta_get (cert2, "xtime", SM_TIMESTAMP, &t) == 0
+        && t == tnow,
+        "sigcert_meta_get xtime works on decoded cert");
+    ok (sigcert_meta_get (cert2, "ca-capability", SM_BOOL, &b) == 0
+        && b == true,
+        "sigcert_meta_get ca-capability works on decoded cert");
+    errno = 0;
+    ok (sigcert_meta_get (cert2, "ctime", SM_TIMESTAMP, &t) < 0
+        && errno == ENOENT,
+        "sigcert_meta_get of unset indexed key fails with ENOENT");
+    errno = 0;
+    ok (sigcert_meta_get (cert2, "userid", SM_STRING, &s) < 0
+        && errno == ENOENT,
+        "sigcert_meta_get of indexed key with wrong type fails with ENOENT");
+
+    /* Unindexed key
+     */
+    ok (sigcert_meta_get (cert2, "foo", SM_STRING, &s) == 0
+        && !strcmp (s, "bar"),
+        "sigcert_meta_get foo works on decoded cert");
+
+    /* Index is not used (and stale) after the cert is changed,
+     * and a copy gets its own index.
+     */
+    ok (sigcert_meta_set (cert2, "userid", SM_INT64, 42LL) == 0
+        && sigcert_meta_set (cert2, "ctime", SM_TIMESTAMP, tnow) == 0,
+        "sigcert_meta_set userid, ctime works on decoded cert");
+    ok (sigcert_meta_get (cert2, "userid", SM_INT64, &i) == 0 && i == 42
+        && sigcert_meta_get (cert2, "ctime", SM_TIMESTAMP, &t) == 0
+        && t == tnow,
+        "sigcert_meta_get returns new values");
+    if (!(cert3 = sigcert_decode (buf, len)))
+        BAIL_OUT ("sigcert_decode");
+    sigcert_destroy (cert2);
+    cert2 = sigcert_copy (cert3);
+    sigcert_destroy (cert3);
+    ok (cert2 != NULL
+        && sigcert_meta_get (cert2, "uuid", SM_STRING, &s) == 0
+        && !strcmp (s, "abc"),
+        "sigcert_meta_get uuid works on copy of decoded cert");
+
+    sigcert_destroy (cert2);
+    sigcert_destroy (cert);
+}
+
+/* Exercise secret key slots across more than one chunk, and cert reuse.
+ */
+void test_claims (void)
+{
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    struct sigcert_claims c;
+    const char *buf;
+    int len;
+    time_t tnow = time (NULL);
+
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    errno = 0;
+    ok (sigcert_get_claims (cert, &c) < 0 && errno == EINVAL,
+        "sigcert_get_claims fails with EINVAL on cert without metadata");
+    if (sigcert_meta_set (cert, "uuid", SM_STRING, "abc") < 0
+        || sigcert_meta_set (cert, "userid", SM_INT64, 1000LL) < 0
+        || sigcert_meta_set (cert, "max-sign-ttl", SM_INT64, 30LL) < 0
+        || sigcert_meta_set (cert, "ctime", SM_TIMESTAMP, tnow) < 0
+        || sigcert_meta_set (cert, "xtime", SM_TIMESTAMP, tnow + 60) < 0
+        || sigcert_meta_set (cert, "not-valid-before-time", SM_TIMESTAMP,
+                             tnow - 1) < 0)
+        BAIL_OUT ("sigcert_meta_set");
+
+    ok (sigcert_get_claims (cert, &c) == 0
+        && !strcmp (c.uuid, "abc")
+        && c.userid == 1000
+        && c.max_sign_ttl == 30
+        && c.ctime == tnow
+        && c.xtime == tnow + 60
+        && c.not_valid_before_time == tnow - 1
+        && c.issuer == NULL
+        && c.ca_capability == false,
+        "sigcert_get_claims works on unindexed cert");
+
+    if (sigcert_meta_set (cert, "issuer", SM_STRING, "def") < 0
+        || sigcert_meta_set (cert, "ca-capability", SM_BOOL, true) < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    if (sigcert_encode (cert, &buf, &len) < 0
+        || !(cert2 = sigcert_decode (buf, len)))
+        BAIL_OUT ("sigcert_encode/decode");
+    ok (sigcert_get_claims (cert2, &c) == 0
+        && !strcmp (c.uuid, "abc")
+        && c.userid == 1000
+        && c.xtime == tnow + 60
+        && c.issuer && !strcmp (c.issuer, "def")
+        && c.ca_capability == true,
+        "sigcert_get_claims works on decoded cert");
+    ok (sigcert_meta_set (cert2, "userid", SM_INT64, 42LL) == 0
+        && sigcert_get_claims (cert2, &c) == 0
+        && c.userid == 42,
+        "sigcert_get_claims returns new value after change");
+    sigcert_destroy (cert2);
+
+    if (sigcert_meta_set (cert, "xtime", SM_STRING, "soon") < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    if (sigcert_encode (cert, &buf, &len) < 0
+        || !(cert2 = sigcert_decode (buf, len)))
+        BAIL_OUT ("sigcert_encode/decode");
+    errno = 0;
+    ok (sigcert_get_claims (cert2, &c) < 0 && errno == EINVAL,
+        "sigcert_get_claims fails with EINVAL on mistyped xtime");
+    errno = 0;
+    ok (sigcert_get_claims (NULL, &c) < 0 && errno == EINVAL,
+        "sigcert_get_claims cert=NULL fails with EINVAL");
+    sigcert_destroy (cert2);
+    sigcert_destroy (cert);
+}
+
+void test_alloc (void)
+{
+    struct sigcert *certs[200];
+    struct sigcert *cert;
+    struct sigcert *cpy;
+    const uint8_t data[] = "hello";
+    char *sig;
+    const char *s;
+    int len;
+    int i;
+    int errors;
+
+    for (i = 0; i < 200; i++) {
+        if (!(certs[i] = sigcert_create ()))
+            BAIL_OUT ("sigcert_create: %s", strerror (errno));
+    }
+    for (i = 0; i < 200; i += 2) {
+        sigcert_destroy (certs[i]);
+        certs[i] = NULL;
+    }
+    for (i = 0; i < 200; i += 4) {
+        if (!(certs[i] = sigcert_create ()))
+            BAIL_OUT ("sigcert_create: %s", strerror (errno));
+    }
+    errors = 0;
+    for (i = 0; i < 200; i++) {
+        if (!certs[i])
+            continue;
+        if (!(sig = sigcert_sign_detached (certs[i], data, sizeof (data)))
+            || sigcert_verify_detached (certs[i], sig, data,
+                                        sizeof (data)) < 0)
+            errors++;
+        if (i > 0 && certs[i - 1] && sig
+            && sigcert_verify_detached (certs[i - 1], sig, data,
+                                        sizeof (data)) == 0)
+            errors++;
+        free (sig);
+    }
+    ok (errors == 0,
+        "many certs with secret keys sign and verify independently");
+
+    cpy = sigcert_copy (certs[1]);
+    ok (cpy != NULL && sigcert_has_secret (cpy)
+        && sigcert_equal (cpy, certs[1]),
+        "sigcert_copy copies secret key");
+    sigcert_forget_secret (certs[1]);
+    ok (sigcert_has_secret (certs[1]) == false && sigcert_has_secret (cpy),
+        "forgetting secret of original does not affect copy");
+    sig = sigcert_sign_detached (cpy, data, sizeof (data));
+    ok (sig != NULL
+        && sigcert_verify_detached (certs[1], sig, data, sizeof (data)) == 0,
+        "copy can still sign");
+    free (sig);
+    sigcert_destroy (cpy);
+
+    for (i = 0; i < 200; i++)
+        sigcert_destroy (certs[i]);
+
+    /* A cert reused after destroy doesn't retain old contents.
+     */
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    if (sigcert_meta_set (cert, "foo", SM_STRING, "bar") < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    sigcert_forget_secret (cert);
+    if (sigcert_encode (cert, &s, &len) < 0)
+        BAIL_OUT ("sigcert_encode");
+    sigcert_destroy (cert);
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    errno = 0;
+    ok (sigcert_meta_get (cert, "foo", SM_STRING, &s) < 0 && errno == ENOENT,
+        "new cert does not have metadata of destroyed cert");
+    sigcert_destroy (cert);
+}
+
 void test_load_store (void)
 {
     struct sigcert *cert;
@@ -311,6 +536,47 @@ void test_sign_verify_detached (void)
     sigcert_destroy (cert2);
 }
 
+void test_sign_detached_into (void)
+{
+    struct sigcert *cert;
+    uint8_t message[] = "foo-bar-baz";
+    char buf[128];
+    char *sig;
+    int n;
+
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create: %s", strerror (errno));
+    if (!(sig = sigcert_sign_detached (cert, message, sizeof (message))))
+        BAIL_OUT ("sigcert_sign_detached: %s", strerror (errno));
+
+    n = sigcert_sign_detached_into (cert, message, sizeof (message), NULL, 0);
+    ok (n == strlen (sig),
+        "sigcert_sign_detached_into sig=NULL returns signature length");
+    memset (buf, 'x', sizeof (buf));
+    ok (sigcert_sign_detached_into (cert, message, sizeof (message),
+                                    buf, n) == n
+        && buf[0] == 'x',
+        "sigcert_sign_detached_into sigsz=len writes nothing");
+    ok (sigcert_sign_detached_into (cert, message, sizeof (message),
+                                    buf, n + 1) == n
+        && !strcmp (buf, sig),
+        "sigcert_sign_detached_into sigsz=len+1 works");
+    ok (sigcert_verify_detached (cert, buf, message, sizeof (message)) == 0,
+        "sigcert_verify_detached accepts the signature");
+    errno = 0;
+    ok (sigcert_sign_detached_into (cert, message, -1, buf, sizeof (buf)) < 0
+        && errno == EINVAL,
+        "sigcert_sign_detached_into len=-1 fails with EINVAL");
+    errno = 0;
+    ok (sigcert_sign_detached_into (cert, message, sizeof (message),
+                                    NULL, 1) < 0
+        && errno == EINVAL,
+        "sigcert_sign_detached_into sig=NULL sigsz=1 fails with EINVAL");
+
+    free (sig);
+    sigcert_destroy (cert);
+}
+
 void test_codec (void)
 {
     struct sigcert *cert;
@@ -361,6 +627,242 @@ void test_codec (void)
     sigcert_destroy (cert2);
 }
 
+void test_codec_binary (void)
+{
+    struct sigcert *ca;
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    char buf[1024];
+    int len;
+    int n;
+
+    if (!(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    if (sigcert_meta_set (cert, "foo", SM_STRING, "bar") < 0
+        || sigcert_meta_set (cert, "bar", SM_INT64, 42LL) < 0
+        || sigcert_meta_set (cert, "time", SM_TIMESTAMP, time (NULL)) < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    sigcert_forget_secret (cert);
+
+    len = sigcert_encode_binary (cert, NULL, 0);
+    ok (len > 0,
+        "sigcert_encode_binary size query works");
+    ok (len < sizeof (buf) && sigcert_encode_binary (cert, buf, len) == len,
+        "sigcert_encode_binary works");
+    cert2 = sigcert_decode_binary (buf, len);
+    ok (cert2 != NULL && sigcert_equal (cert, cert2),
+        "sigcert_decode_binary returns equal cert");
+    ok (sigcert_verify_cert (cert2, cert2) < 0,
+        "decoded cert has no signature");
+    sigcert_destroy (cert2);
+
+    /* Sign with a CA cert so signature is carried, then decode into an
+     * existing cert that has a secret key.
+     */
+    if (!(ca = sigcert_create ()) || !(cert2 = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    ok (sigcert_sign_cert (ca, cert) == 0,
+        "sigcert_sign_cert works");
+    len = sigcert_encode_binary (cert, buf, sizeof (buf));
+    ok (len > 0 && len < sizeof (buf),
+        "sigcert_encode_binary works on signed cert");
+    ok (sigcert_decode_binary_into (cert2, buf, len) == 0,
+        "sigcert_decode_binary_into works");
+    ok (sigcert_has_secret (cert2) == false,
+        "sigcert_decode_binary_into dropped secret key");
+    ok (sigcert_equal (cert, cert2),
+        "the two certs are equal");
+    ok (sigcert_verify_cert (ca, cert2) == 0,
+        "decoded cert signature verifies with CA cert");
+    sigcert_destroy (cert2);
+    sigcert_destroy (ca);
+
+    errno = 0;
+    ok (sigcert_encode_binary (NULL, buf, sizeof (buf)) < 0 && errno == EINVAL,
+        "sigcert_encode_binary cert=NULL fails with EINVAL");
+    errno = 0;
+    ok (sigcert_encode_binary (cert, NULL, 1) < 0 && errno == EINVAL,
+        "sigcert_encode_binary buf=NULL bufsz=1 fails with EINVAL");
+    n = sigcert_encode_binary (cert, buf, 10);
+    ok (n == len,
+        "sigcert_encode_binary short buffer returns needed size");
+    errno = 0;
+    ok (sigcert_decode_binary (NULL, len) == NULL && errno == EINVAL,
+        "sigcert_decode_binary buf=NULL fails with EINVAL");
+    errno = 0;
+    ok (sigcert_decode_binary (buf, len - 1) == NULL && errno == EINVAL,
+        "sigcert_decode_binary truncated buffer fails with EINVAL");
+    errno = 0;
+    ok (sigcert_decode_binary (buf, 20) == NULL && errno == EINVAL,
+        "sigcert_decode_binary short buffer fails with EINVAL");
+    buf[0] = 'x';
+    errno = 0;
+    ok (sigcert_decode_binary (buf, len) == NULL && errno == EINVAL,
+        "sigcert_decode_binary bad magic fails with EINVAL");
+    buf[0] = 'S';
+    buf[4] = 1;
+    errno = 0;
+    ok (sigcert_decode_binary (buf, len) == NULL && errno == EINVAL,
+        "sigcert_decode_binary unknown flags fails with EINVAL");
+    buf[4] = 0;
+    buf[len - 1] = 'x';
+    errno = 0;
+    ok (sigcert_decode_binary (buf, len) == NULL && errno == EINVAL,
+        "sigcert_decode_binary corrupt metadata fails with EINVAL");
+
+    sigcert_destroy (cert);
+}
+
+void test_fread_fwrite_binary (void)
+{
+    struct sigcert *cert[3];
+    struct sigcert *cert2;
+    const char *name;
+    FILE *fp;
+    long size;
+    int i;
+    int errors;
+
+    name = new_keypath ("test");
+    for (i = 0; i < 3; i++) {
+        if (!(cert[i] = sigcert_create ()))
+            BAIL_OUT ("sigcert_create: %s", strerror (errno));
+        if (sigcert_meta_set (cert[i], "index", SM_INT64, (int64_t)i) < 0)
+            BAIL_OUT ("sigcert_meta_set: %s", strerror (errno));
+    }
+    if (sigcert_sign_cert (cert[0], cert[1]) < 0)
+        BAIL_OUT ("sigcert_sign_cert: %s", strerror (errno));
+    for (i = 0; i < 3; i++)
+        sigcert_forget_secret (cert[i]);
+
+    /* write a stream of certs to name */
+    if (!(fp = fopen (name, "w+")))
+        BAIL_OUT ("fopen %s: %s", name, strerror (errno));
+    errors = 0;
+    for (i = 0; i < 3; i++) {
+        if (sigcert_fwrite_binary (cert[i], fp) < 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "sigcert_fwrite_binary works");
+    size = ftell (fp);
+
+    /* read them back */
+    rewind (fp);
+    errors = 0;
+    for (i = 0; i < 3; i++) {
+        if (!(cert2 = sigcert_fread_binary (fp))
+            || !sigcert_equal (cert[i], cert2))
+            errors++;
+        sigcert_destroy (cert2);
+    }
+    ok (errors == 0,
+        "sigcert_fread_binary reads certs back in order");
+    errno = 0;
+    ok (sigcert_fread_binary (fp) == NULL && errno == ENODATA,
+        "sigcert_fread_binary at end of file fails with ENODATA");
+    fclose (fp);
+
+    /* truncate the last cert */
+    if (truncate (name, size - 1) < 0)
+        BAIL_OUT ("truncate %s: %s", name, strerror (errno));
+    if (!(fp = fopen (name, "r")))
+        BAIL_OUT ("fopen %s: %s", name, strerror (errno));
+    for (i = 0; i < 2; i++)
+        sigcert_destroy (sigcert_fread_binary (fp));
+    errno = 0;
+    ok (sigcert_fread_binary (fp) == NULL && errno == EPROTO,
+        "sigcert_fread_binary on truncated cert fails with EPROTO");
+    fclose (fp);
+
+    errno = 0;
+    ok (sigcert_fread_binary (NULL) == NULL && errno == EINVAL,
+        "sigcert_fread_binary fp=NULL fails with EINVAL");
+    errno = 0;
+    ok (sigcert_fwrite_binary (cert[0], NULL) < 0 && errno == EINVAL,
+        "sigcert_fwrite_binary fp=NULL fails with EINVAL");
+
+    for (i = 0; i < 3; i++)
+        sigcert_destroy (cert[i]);
+    cleanup_keypath ("test");
+}
+
+static bool fingerprint_equal (const struct sigcert *cert1,
+                               const struct sigcert *cert2)
+{
+    const uint8_t *fp1 = sigcert_fingerprint (cert1);
+    const uint8_t *fp2 = sigcert_fingerprint (cert2);
+
+    return fp1 && fp2 && !memcmp (fp1, fp2, SIGCERT_FINGERPRINT_SIZE);
+}
+
+void test_fingerprint (void)
+{
+    struct sigcert *ca;
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    uint8_t unsigned_fp[SIGCERT_FINGERPRINT_SIZE];
+    char buf[1024];
+    const char *s;
+    int len;
+    const char *name;
+
+    if (!(ca = sigcert_create ()) || !(cert = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    ok (sigcert_fingerprint (cert) != NULL,
+        "sigcert_fingerprint works");
+    ok (!fingerprint_equal (ca, cert),
+        "different certs have different fingerprints");
+    if (!(cert2 = sigcert_copy (cert)))
+        BAIL_OUT ("sigcert_copy");
+    ok (fingerprint_equal (cert, cert2),
+        "copied cert has the same fingerprint");
+    sigcert_destroy (cert2);
+    if (sigcert_encode (cert, &s, &len) < 0
+        || !(cert2 = sigcert_decode (s, len)))
+        BAIL_OUT ("sigcert_encode/decode");
+    ok (fingerprint_equal (cert, cert2),
+        "decoded cert has the same fingerprint");
+    sigcert_destroy (cert2);
+
+    memcpy (unsigned_fp, sigcert_fingerprint (cert), sizeof (unsigned_fp));
+    if (sigcert_sign_cert (ca, cert) < 0)
+        BAIL_OUT ("sigcert_sign_cert");
+    ok (memcmp (unsigned_fp, sigcert_fingerprint (cert),
+                sizeof (unsigned_fp)) != 0,
+        "signing cert changes its fingerprint");
+    if (sigcert_encode (cert, &s, &len) < 0
+        || !(cert2 = sigcert_decode (s, len)))
+        BAIL_OUT ("sigcert_encode/decode");
+    ok (fingerprint_equal (cert, cert2),
+        "decoded signed cert has the same fingerprint");
+    sigcert_destroy (cert2);
+    len = sigcert_encode_binary (cert, buf, sizeof (buf));
+    if (len < 0 || len >= sizeof (buf)
+        || !(cert2 = sigcert_decode_binary (buf, len)))
+        BAIL_OUT ("sigcert_encode/decode_binary");
+    ok (fingerprint_equal (cert, cert2),
+        "binary decoded signed cert has the same fingerprint");
+    sigcert_destroy (cert2);
+
+    name = new_keypath ("test");
+    if (sigcert_store (cert, name) < 0)
+        BAIL_OUT ("sigcert_store");
+    cert2 = sigcert_load (name, false);
+    ok (cert2 != NULL && fingerprint_equal (cert, cert2),
+        "loaded cert has the same fingerprint");
+    sigcert_destroy (cert2);
+    cleanup_keypath ("test");
+    cleanup_keypath ("test.pub");
+
+    errno = 0;
+    ok (sigcert_fingerprint (NULL) == NULL && errno == EINVAL,
+        "sigcert_fingerprint cert=NULL fails with EINVAL");
+
+    sigcert_destroy (cert);
+    sigcert_destroy (ca);
+}
+
 void test_corner (void)
 {
     struct sigcert *cert;
@@ -619,6 +1121,11 @@ void test_sign_cert (void)
         "sigcert_decode works on signed cert");
     ok (sigcert_verify_cert (ca, cert2) == 0,
         "sigcert_verify_cert works after JSON dumps/loads");
+    ok (sigcert_meta_set (cert2, "username", SM_STRING, "noitsme") == 0,
+        "sigcert_meta_set changes decoded cert");
+    errno = 0;
+    ok (sigcert_verify_cert (ca, cert2) < 0 && errno == EINVAL,
+        "sigcert_verify_cert fails on modified decoded cert");
     sigcert_destroy (cert2);
 
     /* Verification of a signed cert still works after TOML serialization.
@@ -647,6 +1154,64 @@ void test_sign_cert (void)
     sigcert_destroy (ca);
 }
 
+/* Check that the signature covers the same bytes as it always has:
+ * the kv encoding of the base64 public key as "curve.public_key" joined
+ * with the metadata under "meta.".  The raw public key and signature are
+ * extracted from the binary encoding (see sigcert.c).
+ */
+void test_sign_cert_compat (void)
+{
+    struct sigcert *cert;
+    struct sigcert *ca;
+    uint8_t certbin[1024];
+    uint8_t cabin[1024];
+    char pubkey[sodium_base64_ENCODED_LEN (crypto_sign_PUBLICKEYBYTES,
+                                           sodium_base64_VARIANT_ORIGINAL)];
+    struct kv *meta;
+    struct kv *kv;
+    const char *s;
+    int len;
+    const uint8_t *cert_pubkey = certbin + 8;
+    const uint8_t *cert_sig = certbin + 8 + crypto_sign_PUBLICKEYBYTES;
+    const uint8_t *ca_pubkey = cabin + 8;
+
+    if (!(cert = sigcert_create ()) || !(ca = sigcert_create ()))
+        BAIL_OUT ("sigcert_create: %s", strerror (errno));
+    if (sigcert_meta_set (cert, "username", SM_STRING, "itsme") < 0
+        || sigcert_meta_set (cert, "userid", SM_INT64, 1000LL) < 0
+        || sigcert_meta_set (cert, "xtime", SM_TIMESTAMP, time (NULL)) < 0)
+        BAIL_OUT ("sigcert_meta_set failed");
+    if (sigcert_sign_cert (ca, cert) < 0)
+        BAIL_OUT ("sigcert_sign_cert: %s", strerror (errno));
+    if (!(meta = kv_create ()))
+        BAIL_OUT ("kv_create");
+    len = sigcert_encode_binary (cert, certbin, sizeof (certbin));
+    if (len < 0 || len > sizeof (certbin)
+        || kv_decode_into (meta,
+                           (char *)certbin + 8 + crypto_sign_PUBLICKEYBYTES
+                           + crypto_sign_BYTES + 4,
+                           len - (8 + crypto_sign_PUBLICKEYBYTES
+                                  + crypto_sign_BYTES + 4)) < 0)
+        BAIL_OUT ("sigcert_encode_binary");
+    if (sigcert_encode_binary (ca, cabin, sizeof (cabin)) < 0)
+        BAIL_OUT ("sigcert_encode_binary");
+    sodium_bin2base64 (pubkey, sizeof (pubkey),
+                       cert_pubkey, crypto_sign_PUBLICKEYBYTES,
+                       sodium_base64_VARIANT_ORIGINAL);
+    if (!(kv = kv_create ())
+        || kv_put (kv, "curve.public_key", KV_STRING, pubkey) < 0
+        || kv_join (kv, meta, "meta.") < 0
+        || kv_encode (kv, &s, &len) < 0)
+        BAIL_OUT ("kv failure");
+    ok (crypto_sign_verify_detached (cert_sig, (const uint8_t *)s, len,
+                                     ca_pubkey) == 0,
+        "cert signature covers kv encoding of public key and metadata");
+    kv_destroy (kv);
+    kv_destroy (meta);
+    sigcert_destroy (cert);
+    sigcert_destroy (ca);
+}
+
 static const char *goodcert_pub =
   "[metadata]\n"
   "[curve]\n"
@@ -778,6 +1343,205 @@ bool check_secret_file (const char *content)
     return valid;
 }
 
+/* Load public cert 'name' with sigcert_load() and with the TOML reader
+ * sigcert_fread_public(), and return true if both succeed and agree.
+ */
+static bool load_matches_fread (const char *name)
+{
+    char path[PATH_MAX + 1];
+    struct sigcert *cert;
+    struct sigcert *cert2 = NULL;
+    FILE *fp;
+    bool match = false;
+
+    snprintf (path, sizeof (path), "%s.pub", name);
+    if (!(cert = sigcert_load (name, false)))
+        return false;
+    if ((fp = fopen (path, "r"))) {
+        cert2 = sigcert_fread_public (fp);
+        fclose (fp);
+    }
+    if (cert2 && sigcert_equal (cert, cert2))
+        match = true;
+    sigcert_destroy (cert);
+    sigcert_destroy (cert2);
+    return match;
+}
+
+static const char *scancert_pub[] = {
+  // 0 - comment
+  "# comment\n"
+  "[metadata]\n"
+  "    foo = \"bar\"\n"
+  "[curve]\n"
+  "    public-key = \"/Q5g8sj5Hl4XUF9GKn4mNjnwbC/0gTYAG2d9yReTJwc=\"\n",
+
+  // 1 - literal string, no indent, CRLF
+  "[metadata]\r\n"
+  "foo = 'bar'\r\n"
+  "[curve]\r\n"
+  "public-key = '/Q5g8sj5Hl4XUF9GKn4mNjnwbC/0gTYAG2d9yReTJwc='\r\n",
+
+  // 2 - escape in string, exponent in double, tables swapped
+  "[curve]\n"
+  "    public-key = \"/Q5g8sj5Hl4XUF9GKn4mNjnwbC/0gTYAG2d9yReTJwc=\"\n"
+  "[metadata]\n"
+  "    foo = \"b\\tar\"\n"
+  "    baz = 4.2e-26\n",
+
+  // 3 - unterminated last line, timestamp with offset
+  "[metadata]\n"
+  "    time = 2018-01-10T18:22:17-08:00\n"
+  "[curve]\n"
+  "    public-key = \"/Q5g8sj5Hl4XUF9GKn4mNjnwbC/0gTYAG2d9yReTJwc=\"",
+};
+static const int scancert_pub_count = sizeof (scancert_pub)
+                                      / sizeof (scancert_pub[0]);
+
+void test_create_store_many (void)
+{
+    struct sigcert *certs[20];
+    char names[20][PATH_MAX + 1];
+    const char *namep[20];
+    struct sigcert *cert;
+    int errors;
+    int i;
+
+    errno = 0;
+    ok (sigcert_create_many (NULL, 1, 0) < 0 && errno == EINVAL,
+        "sigcert_create_many certs=NULL fails with EINVAL");
+    errno = 0;
+    ok (sigcert_create_many (certs, -1, 0) < 0 && errno == EINVAL,
+        "sigcert_create_many count=-1 fails with EINVAL");
+    ok (sigcert_create_many (certs, 0, 0) == 0,
+        "sigcert_create_many count=0 works");
+    ok (sigcert_create_many (certs, 20, 4) == 20,
+        "sigcert_create_many count=20 nthreads=4 works");
+    errors = 0;
+    for (i = 0; i < 20; i++) {
+        if (!certs[i] || !sigcert_has_secret (certs[i])
+            || (i > 0 && sigcert_equal (certs[0], certs[i])))
+            errors++;
+    }
+    ok (errors == 0,
+        "each cert has a secret key and differs from the first");
+
+    for (i = 0; i < 20; i++) {
+        unsigned int n;
+        n = snprintf (names[i], sizeof (names[i]), "%s/many%d", scratch, i);
+        if (n >= sizeof (names[i]))
+            BAIL_OUT ("store_many path overflow");
+        namep[i] = names[i];
+    }
+    errno = 0;
+    ok (sigcert_store_many (certs, NULL, 20) < 0 && errno == EINVAL,
+        "sigcert_store_many names=NULL fails with EINVAL");
+    ok (sigcert_store_many (certs, namep, 0) == 0,
+        "sigcert_store_many count=0 works");
+    ok (sigcert_store_many (certs, namep, 20) == 0,
+        "sigcert_store_many count=20 works");
+    errors = 0;
+    for (i = 0; i < 20; i++) {
+        if (!(cert = sigcert_load (names[i], true))
+            || !sigcert_equal (certs[i], cert))
+            errors++;
+        sigcert_destroy (cert);
+    }
+    ok (errors == 0,
+        "each stored cert loads back the same");
+    namep[0] = "/noexist/many";
+    ok (sigcert_store_many (certs, namep, 20) < 0,
+        "sigcert_store_many fails if a path cannot be written");
+
+    for (i = 0; i < 20; i++) {
+        char name[64];
+        snprintf (name, sizeof (name), "many%d", i);
+        cleanup_keypath (name);
+        snprintf (name, sizeof (name), "many%d.pub", i);
+        cleanup_keypath (name);
+        sigcert_destroy (certs[i]);
+    }
+}
+
+void test_load_scan (void)
+{
+    struct sigcert *ca;
+    struct sigcert *cert;
+    struct sigcert *cert2;
+    const char *name;
+    const char *s;
+    int64_t i;
+    double d;
+    bool b;
+    time_t t, now = time (NULL);
+    int n;
+
+    /* Store a cert with every metadata type, then check that sigcert_load()
+     * agrees with the TOML reader.
+     */
+    if (!(cert = sigcert_create ()) || !(ca = sigcert_create ()))
+        BAIL_OUT ("sigcert_create");
+    if (sigcert_meta_set (cert, "foo", SM_STRING, "a string = 'x' [y]") < 0
+        || sigcert_meta_set (cert, "empty", SM_STRING, "") < 0
+        || sigcert_meta_set (cert, "bar", SM_INT64, -55LL) < 0
+        || sigcert_meta_set (cert, "zero", SM_INT64, 0LL) < 0
+        || sigcert_meta_set (cert, "baz", SM_DOUBLE, -2.718) < 0
+        || sigcert_meta_set (cert, "flag", SM_BOOL, true) < 0
+        || sigcert_meta_set (cert, "time", SM_TIMESTAMP, now) < 0)
+        BAIL_OUT ("sigcert_meta_set");
+    if (sigcert_sign_cert (ca, cert) < 0)
+        BAIL_OUT ("sigcert_sign_cert");
+    sigcert_destroy (ca);
+    name = new_keypath ("test");
+    if (sigcert_store (cert, name) < 0)
+        BAIL_OUT ("sigcert_store");
+    ok (load_matches_fread (name),
+        "sigcert_load and sigcert_fread_public agree on stored cert");
+    ok ((cert2 = sigcert_load (name, true)) != NULL
+        && sigcert_equal (cert, cert2),
+        "sigcert_load works on stored cert");
+    ok (sigcert_meta_get (cert2, "foo", SM_STRING, &s) == 0
+        && !strcmp (s, "a string = 'x' [y]")
+        && sigcert_meta_get (cert2, "empty", SM_STRING, &s) == 0
+        && !strcmp (s, "")
+        && sigcert_meta_get (cert2, "bar", SM_INT64, &i) == 0 && i == -55
+        && sigcert_meta_get (cert2, "zero", SM_INT64, &i) == 0 && i == 0
+        && sigcert_meta_get (cert2, "baz", SM_DOUBLE, &d) == 0 && d == -2.718
+        && sigcert_meta_get (cert2, "flag", SM_BOOL, &b) == 0 && b == true
+        && sigcert_meta_get (cert2, "time", SM_TIMESTAMP, &t) == 0
+        && t == now,
+        "sigcert_load restored all metadata");
+    sigcert_destroy (cert2);
+    sigcert_destroy (cert);
+
+    /* Files not in the sigcert_store() layout are handled by TOML.
+     */
+    for (n = 0; n < scancert_pub_count; n++) {
+        name = new_keypath ("test.pub");
+        create_file_content (name, scancert_pub[n], strlen (scancert_pub[n]));
+        name = new_keypath ("test");
+        ok (load_matches_fread (name),
+            "sigcert_load and sigcert_fread_public agree on cert %d", n);
+    }
+
+    /* Duplicate keys are rejected whichever reader sees them.
+     */
+    s = "[metadata]\n"
+        "    foo = 1\n"
+        "    foo = 2\n"
+        "[curve]\n"
+        "    public-key = \"/Q5g8sj5Hl4XUF9GKn4mNjnwbC/0gTYAG2d9yReTJwc=\"\n";
+    name = new_keypath ("test.pub");
+    create_file_content (name, s, strlen (s));
+    name = new_keypath ("test");
+    errno = 0;
+    ok (sigcert_load (name, false) == NULL && errno == EINVAL,
+        "sigcert_load fails on duplicate metadata key with EINVAL");
+
+    cleanup_keypath ("test");
+    cleanup_keypath ("test.pub");
+}
+
 void test_badcert (void)
 {
     int i;
@@ -803,11 +1567,21 @@ int main (int argc, char *argv[])
     new_scratchdir ();
 
     test_meta ();
+    test_meta_index ();
+    test_claims ();
+    test_alloc ();
     test_load_store ();
+    test_create_store_many ();
+    test_load_scan ();
     test_sign_verify_detached ();
+    test_sign_detached_into ();
     test_codec ();
+    test_codec_binary ();
+    test_fread_fwrite_binary ();
+    test_fingerprint ();
     test_corner ();
     test_sign_cert ();
+    test_sign_cert_compat ();
     test_badcert ();
     test_fread_fwrite ();
 
@@ -0,0 +1,160 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "src/libtap/tap.h"
+#include "vcache.h"
+
+static char tmpdir[PATH_MAX + 1];
+static char path[PATH_MAX + 1];
+
+static void make_entry (struct vcache_entry *entry, int i)
+{
+    memset (entry, 0, sizeof (*entry));
+    memset (entry->digest, i, sizeof (entry->digest));
+    entry->digest[0] = i % 7;
+    entry->userid = 1000 + i;
+    entry->max_sign_ttl = 60;
+    entry->not_valid_before_time = 100 + i;
+    entry->xtime = 1000 + i;
+    snprintf (entry->uuid, sizeof (entry->uuid), "uuid-%d", i);
+}
+
+void test_basic (void)
+{
+    uint8_t ca_fp[SIGCERT_FINGERPRINT_SIZE];
+    uint8_t other_fp[SIGCERT_FINGERPRINT_SIZE];
+    struct vcache_entry entries[100];
+    struct vcache_entry entry;
+    struct vcache_entry expect;
+    struct vcache *vc;
+    int i;
+    int errors;
+
+    memset (ca_fp, 0xca, sizeof (ca_fp));
+    memset (other_fp, 0xcb, sizeof (other_fp));
+    for (i = 0; i < 100; i++)
+        make_entry (&entries[i], i);
+
+    errno = 0;
+    ok (vcache_open (path, ca_fp) == NULL && errno == ENOENT,
+        "vcache_open fails with ENOENT on missing file");
+
+    ok (vcache_write (path, ca_fp, entries, 100) == 0,
+        "vcache_write works");
+    vc = vcache_open (path, ca_fp);
+    ok (vc != NULL,
+        "vcache_open works");
+    ok (vcache_count (vc) == 100,
+        "vcache_count returns 100");
+    errors = 0;
+    for (i = 0; i < 100; i++) {
+        make_entry (&expect, i);
+        if (vcache_lookup (vc, expect.digest, &entry) < 0
+            || memcmp (&entry, &expect, sizeof (entry)) != 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "vcache_lookup finds all entries with correct values");
+    make_entry (&expect, 100);
+    errno = 0;
+    ok (vcache_lookup (vc, expect.digest, &entry) < 0 && errno == ENOENT,
+        "vcache_lookup of unknown digest fails with ENOENT");
+    vcache_close (vc);
+
+    errno = 0;
+    ok (vcache_open (path, other_fp) == NULL && errno == EINVAL,
+        "vcache_open fails with EINVAL for another CA");
+
+    /* Duplicates are dropped, empty cache works.
+     */
+    entries[1] = entries[0];
+    ok (vcache_write (path, ca_fp, entries, 100) == 0
+        && (vc = vcache_open (path, ca_fp)) != NULL
+        && vcache_count (vc) == 99,
+        "vcache_write drops duplicate digest");
+    vcache_close (vc);
+    ok (vcache_write (path, ca_fp, NULL, 0) == 0
+        && (vc = vcache_open (path, ca_fp)) != NULL
+        && vcache_count (vc) == 0
+        && vcache_lookup (vc, expect.digest, &entry) < 0,
+        "vcache_write of empty cache works");
+    vcache_close (vc);
+
+    /* File that others could modify is not trusted.
+     */
+    if (chmod (path, 0664) < 0)
+        BAIL_OUT ("chmod %s: %s", path, strerror (errno));
+    errno = 0;
+    ok (vcache_open (path, ca_fp) == NULL && errno == EPERM,
+        "vcache_open fails with EPERM on group writable file");
+    if (chmod (path, 0644) < 0)
+        BAIL_OUT ("chmod %s: %s", path, strerror (errno));
+
+    /* Corrupt file.
+     */
+    if (truncate (path, 20) < 0)
+        BAIL_OUT ("truncate %s: %s", path, strerror (errno));
+    errno = 0;
+    ok (vcache_open (path, ca_fp) == NULL && errno == EINVAL,
+        "vcache_open fails with EINVAL on truncated file");
+
+    errno = 0;
+    ok (vcache_write (NULL, ca_fp, entries, 1) < 0 && errno == EINVAL,
+        "vcache_write path=NULL fails with EINVAL");
+    errno = 0;
+    ok (vcache_open (NULL, ca_fp) == NULL && errno == EINVAL,
+        "vcache_open path=NULL fails with EINVAL");
+    errno = 0;
+    ok (vcache_lookup (NULL, ca_fp, &entry) < 0 && errno == EINVAL,
+        "vcache_lookup vc=NULL fails with EINVAL");
+    vcache_close (NULL);
+
+    if (unlink (path) < 0)
+        BAIL_OUT ("unlink %s: %s", path, strerror (errno));
+}
+
+int main (int argc, char *argv[])
+{
+    const char *t = getenv ("TMPDIR");
+
+    plan (NO_PLAN);
+
+    if (snprintf (tmpdir, sizeof (tmpdir), "%s/vcache-XXXXXX",
+                  t ? t : "/tmp") >= sizeof (tmpdir))
+        BAIL_OUT ("tmpdir buffer overflow");
+    if (!mkdtemp (tmpdir))
+        BAIL_OUT ("mkdtemp: %s", strerror (errno));
+    if (snprintf (path, sizeof (path), "%s/verified", tmpdir) >= sizeof (path))
+        BAIL_OUT ("path buffer overflow");
+
+    test_basic ();
+
+    if (rmdir (tmpdir) < 0)
+        BAIL_OUT ("rmdir: %s", strerror (errno));
+
+    done_testing ();
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,299 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* vcache.c - verified cert cache file
+ *
+ * File format (integers are big-endian):
+ *
+ *   magic          8 bytes "FLUXVC01"
+ *   count          4 bytes, number of entries
+ *   reserved       4 bytes (zero)
+ *   ca_fingerprint SIGCERT_FINGERPRINT_SIZE bytes
+ *   entries        'count' entries sorted by digest in memcmp() order:
+ *     digest                 SIGCERT_FINGERPRINT_SIZE bytes
+ *     userid                 8 bytes
+ *     max_sign_ttl           8 bytes
+ *     not_valid_before_time  8 bytes
+ *     xtime                  8 bytes
+ *     uuid                   VCACHE_UUID_SIZE bytes, NULL padded
+ *
+ * The file is immutable once written, so a mapping of it may be shared
+ * by threads without locking.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "vcache.h"
+
+#define VCACHE_MAGIC    "FLUXVC01"
+#define VCACHE_HDRSIZE  (16 + SIGCERT_FINGERPRINT_SIZE)
+#define VCACHE_RECSIZE  (SIGCERT_FINGERPRINT_SIZE + 32 + VCACHE_UUID_SIZE)
+
+struct vcache {
+    const uint8_t *map;
+    size_t mapsz;
+    const uint8_t *recs;
+    uint32_t count;
+};
+
+static void put_be32 (uint8_t *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static uint32_t get_be32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+         | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be64 (uint8_t *p, int64_t val)
+{
+    put_be32 (p, (uint64_t)val >> 32);
+    put_be32 (p + 4, (uint64_t)val);
+}
+
+static int64_t get_be64 (const uint8_t *p)
+{
+    return (int64_t)(((uint64_t)get_be32 (p) << 32) | get_be32 (p + 4));
+}
+
+void vcache_close (struct vcache *vc)
+{
+    if (vc) {
+        int saved_errno = errno;
+        if (vc->map)
+            (void)munmap ((void *)vc->map, vc->mapsz);
+        free (vc);
+        errno = saved_errno;
+    }
+}
+
+/* Only trust a file that could not have been written by another user.
+ */
+static bool is_trusted (const struct stat *st)
+{
+    if (!S_ISREG (st->st_mode))
+        return false;
+    if (st->st_uid != 0 && st->st_uid != geteuid ())
+        return false;
+    if ((st->st_mode & (S_IWGRP | S_IWOTH)))
+        return false;
+    return true;
+}
+
+struct vcache *vcache_open (const char *path, const uint8_t *ca_fingerprint)
+{
+    struct vcache *vc;
+    struct stat st;
+    int fd;
+    void *map;
+
+    if (!path || !ca_fingerprint) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+    if (fstat (fd, &st) < 0) {
+        int saved_errno = errno;
+        (void)close (fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    if (!is_trusted (&st)) {
+        (void)close (fd);
+        errno = EPERM;
+        return NULL;
+    }
+    if (st.st_size < VCACHE_HDRSIZE) {
+        (void)close (fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    (void)close (fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    if (!(vc = calloc (1, sizeof (*vc)))) {
+        int saved_errno = errno;
+        (void)munmap (map, st.st_size);
+        errno = saved_errno;
+        return NULL;
+    }
+    vc->map = map;
+    vc->mapsz = st.st_size;
+    vc->count = get_be32 (vc->map + 8);
+    vc->recs = vc->map + VCACHE_HDRSIZE;
+    if (memcmp (vc->map, VCACHE_MAGIC, 8) != 0
+        || memcmp (vc->map + 16, ca_fingerprint,
+                   SIGCERT_FINGERPRINT_SIZE) != 0
+        || vc->count != (vc->mapsz - VCACHE_HDRSIZE) / VCACHE_RECSIZE
+        || (vc->mapsz - VCACHE_HDRSIZE) % VCACHE_RECSIZE != 0) {
+        vcache_close (vc);
+        errno = EINVAL;
+        return NULL;
+    }
+    return vc;
+}
+
+static int rec_cmp (const void *key, const void *rec)
+{
+    return memcmp (key, rec, SIGCERT_FINGERPRINT_SIZE);
+}
+
+int vcache_lookup (const struct vcache *vc, const uint8_t *digest,
+                   struct vcache_entry *entry)
+{
+    const uint8_t *p;
+
+    if (!vc || !digest || !entry) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(p = bsearch (digest, vc->recs, vc->count, VCACHE_RECSIZE,
+                       rec_cmp))) {
+        errno = ENOENT;
+        return -1;
+    }
+    memcpy (entry->digest, p, SIGCERT_FINGERPRINT_SIZE);
+    p += SIGCERT_FINGERPRINT_SIZE;
+    entry->userid = get_be64 (p);
+    entry->max_sign_ttl = get_be64 (p + 8);
+    entry->not_valid_before_time = get_be64 (p + 16);
+    entry->xtime = get_be64 (p + 24);
+    memcpy (entry->uuid, p + 32, VCACHE_UUID_SIZE);
+    entry->uuid[VCACHE_UUID_SIZE - 1] = '\0';
+    return 0;
+}
+
+int vcache_count (const struct vcache *vc)
+{
+    if (!vc) {
+        errno = EINVAL;
+        return -1;
+    }
+    return vc->count;
+}
+
+static int entry_cmp (const void *a, const void *b)
+{
+    const struct vcache_entry *e1 = a;
+    const struct vcache_entry *e2 = b;
+
+    return memcmp (e1->digest, e2->digest, SIGCERT_FINGERPRINT_SIZE);
+}
+
+static void encode_entry (uint8_t *p, const struct vcache_entry *entry)
+{
+    memcpy (p, entry->digest, SIGCERT_FINGERPRINT_SIZE);
+    p += SIGCERT_FINGERPRINT_SIZE;
+    put_be64 (p, entry->userid);
+    put_be64 (p + 8, entry->max_sign_ttl);
+    put_be64 (p + 16, entry->not_valid_before_time);
+    put_be64 (p + 24, entry->xtime);
+    memset (p + 32, 0, VCACHE_UUID_SIZE);
+    memcpy (p + 32, entry->uuid, strnlen (entry->uuid, VCACHE_UUID_SIZE - 1));
+}
+
+int vcache_write (const char *path, const uint8_t *ca_fingerprint,
+                  const struct vcache_entry *entries, int count)
+{
+    struct vcache_entry *sorted = NULL;
+    char tmp[PATH_MAX + 1];
+    uint8_t hdr[VCACHE_HDRSIZE];
+    uint8_t rec[VCACHE_RECSIZE];
+    FILE *fp = NULL;
+    uint32_t n = 0;
+    int fd = -1;
+    int i;
+    int saved_errno;
+
+    if (!path || !ca_fingerprint || count < 0 || (count > 0 && !entries)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count > 0) {
+        if (!(sorted = malloc (sizeof (*sorted) * count)))
+            return -1;
+        memcpy (sorted, entries, sizeof (*sorted) * count);
+        qsort (sorted, count, sizeof (*sorted), entry_cmp);
+        for (i = 0; i < count; i++) {
+            if (n > 0 && entry_cmp (&sorted[n - 1], &sorted[i]) == 0)
+                continue;
+            sorted[n++] = sorted[i];
+        }
+    }
+    memset (hdr, 0, sizeof (hdr));
+    memcpy (hdr, VCACHE_MAGIC, 8);
+    put_be32 (hdr + 8, n);
+    memcpy (hdr + 16, ca_fingerprint, SIGCERT_FINGERPRINT_SIZE);
+
+    if (snprintf (tmp, sizeof (tmp), "%s.XXXXXX", path) >= sizeof (tmp)) {
+        errno = EINVAL;
+        goto error;
+    }
+    if ((fd = mkstemp (tmp)) < 0)
+        goto error;
+    if (fchmod (fd, 0644) < 0 || !(fp = fdopen (fd, "w")))
+        goto error_unlink;
+    fd = -1;
+    if (fwrite (hdr, sizeof (hdr), 1, fp) != 1)
+        goto error_unlink;
+    for (i = 0; i < n; i++) {
+        encode_entry (rec, &sorted[i]);
+        if (fwrite (rec, sizeof (rec), 1, fp) != 1)
+            goto error_unlink;
+    }
+    if (fflush (fp) != 0 || fsync (fileno (fp)) < 0)
+        goto error_unlink;
+    if (fclose (fp) != 0) {
+        fp = NULL;
+        goto error_unlink;
+    }
+    fp = NULL;
+    if (rename (tmp, path) < 0)
+        goto error_unlink;
+    free (sorted);
+    return 0;
+error_unlink:
+    saved_errno = errno;
+    if (fp)
+        (void)fclose (fp);
+    if (fd >= 0)
+        (void)close (fd);
+    (void)unlink (tmp);
+    errno = saved_errno;
+error:
+    saved_errno = errno;
+    free (sorted);
+    errno = saved_errno;
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,76 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _UTIL_VCACHE_H
+#define _UTIL_VCACHE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sigcert.h"
+
+/* Verified cert cache file, shared by processes on a node.
+ *
+ * A trusted process (e.g. a root daemon) verifies certs against the CA and
+ * writes their signed digests (see sigcert_signed_digest()), with the
+ * metadata that verification depends on, to a file.  Other processes map
+ * it read-only, and may skip the CA signature check for a cert whose
+ * signed digest is present, since it is exactly a cert that was verified.
+ *
+ * A file is only used if it is a regular file owned by root (or the
+ * effective uid) that is not writable by group or other, and if it was
+ * written for the same CA cert.  Revocation is not recorded in the file.
+ */
+
+#define VCACHE_UUID_SIZE 40
+
+struct vcache_entry {
+    uint8_t digest[SIGCERT_FINGERPRINT_SIZE];   // signed digest of cert
+    int64_t userid;
+    int64_t max_sign_ttl;
+    int64_t not_valid_before_time;
+    int64_t xtime;
+    char uuid[VCACHE_UUID_SIZE];    // NULL terminated
+};
+
+struct vcache;
+
+/* Map the cache file at 'path', written for CA cert 'ca_fingerprint'.
+ * Return cache on success, NULL on failure with errno set: ENOENT if
+ * the file does not exist, EPERM if its ownership or mode cannot be
+ * trusted, or EINVAL if it is malformed or was written for another CA.
+ */
+struct vcache *vcache_open (const char *path, const uint8_t *ca_fingerprint);
+void vcache_close (struct vcache *vc);
+
+/* Look up signed digest 'digest' and copy its entry to 'entry'.
+ * Return 0 on success, -1 with errno = ENOENT if not found.
+ */
+int vcache_lookup (const struct vcache *vc, const uint8_t *digest,
+                   struct vcache_entry *entry);
+
+/* Return the number of entries in the cache.
+ */
+int vcache_count (const struct vcache *vc);
+
+/* Write 'count' entries to a new cache file 'path' for CA cert
+ * 'ca_fingerprint', replacing any existing file atomically.  The file is
+ * created with mode 0644.  'entries' need not be sorted, and duplicate
+ * digests are dropped.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int vcache_write (const char *path, const uint8_t *ca_fingerprint,
+                  const struct vcache_entry *entries, int count);
+
+#endif /* !_UTIL_VCACHE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -328,6 +328,155 @@ void parse_extra (void)
 
 }
 
+/* Wide tables are looked up through a hash index once they have
+ * enough keys, including keys added to them by later table headers.
+ */
+void parse_wide (void)
+{
+    char buf[16384];
+    char e[200];
+    char key[32];
+    toml_table_t *conf;
+    toml_table_t *tab;
+    int len = 0;
+    int errors = 0;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        switch (i % 3) {
+            case 0:
+                len += snprintf (buf + len, sizeof (buf) - len,
+                                 "v%d = %d\n", i, i);
+                break;
+            case 1:
+                len += snprintf (buf + len, sizeof (buf) - len,
+                                 "a%d = [ %d ]\n", i, i);
+                break;
+            case 2:
+                len += snprintf (buf + len, sizeof (buf) - len,
+                                 "t%d = { x = %d }\n", i, i);
+                break;
+        }
+    }
+    for (i = 0; i < 100; i++)
+        len += snprintf (buf + len, sizeof (buf) - len,
+                         "[h%d.sub]\n'quoted key %d' = \"s\\t%d\"\n", i, i, i);
+    if (len >= (int)sizeof (buf))
+        BAIL_OUT ("parse_wide: buffer overflow");
+
+    conf = toml_parse (buf, e, sizeof (e));
+    ok (conf != NULL,
+        "parsed wide table");
+    if (!conf) {
+        diag ("%s", e);
+        return;
+    }
+    ok (toml_table_nkval (conf) == 34
+        && toml_table_narr (conf) == 33
+        && toml_table_ntab (conf) == 133,
+        "wide table has expected number of keys");
+    for (i = 0; i < 100; i++) {
+        const char *raw;
+        int64_t n;
+
+        snprintf (key, sizeof (key), "%c%d", "vat"[i % 3], i);
+        switch (i % 3) {
+            case 0:
+                if (!(raw = toml_raw_in (conf, key))
+                    || toml_rtoi (raw, &n) < 0 || n != i
+                    || toml_array_in (conf, key) || toml_table_in (conf, key))
+                    errors++;
+                break;
+            case 1:
+                if (!toml_array_in (conf, key) || toml_raw_in (conf, key))
+                    errors++;
+                break;
+            case 2:
+                if (!(tab = toml_table_in (conf, key))
+                    || !(raw = toml_raw_in (tab, "x"))
+                    || toml_rtoi (raw, &n) < 0 || n != i
+                    || toml_raw_in (conf, key))
+                    errors++;
+                break;
+        }
+        snprintf (key, sizeof (key), "h%d", i);
+        if (!(tab = toml_table_in (conf, key))
+            || !(tab = toml_table_in (tab, "sub")))
+            errors++;
+        else {
+            snprintf (key, sizeof (key), "quoted key %d", i);
+            if (!toml_raw_in (tab, key))
+                errors++;
+        }
+    }
+    ok (errors == 0,
+        "all keys of wide table were found with the right kind");
+    ok (toml_raw_in (conf, "v1") == NULL
+        && toml_table_in (conf, "v100") == NULL
+        && toml_array_in (conf, "") == NULL,
+        "missing keys of wide table are not found");
+    toml_free (conf);
+
+    /* Duplicate key after the index is built.
+     */
+    len = 0;
+    for (i = 0; i < 50; i++)
+        len += snprintf (buf + len, sizeof (buf) - len, "k%d = %d\n", i, i);
+    len += snprintf (buf + len, sizeof (buf) - len,
+                     "s = \"\"\"\n\n\"\"\"  # comment\nk42 = 1\n");
+    conf = toml_parse (buf, e, sizeof (e));
+    ok (conf == NULL,
+        "duplicate key in wide table fails");
+    diag ("%s", e);
+    is (e, "line 54: key k42 exists",
+        "error has the line number after a multi-line string");
+    toml_free (conf);
+}
+
+void parse_deep (void)
+{
+    char *buf;
+    char e[200];
+    toml_table_t *conf;
+    int depth = 100000;
+    int len;
+    int i;
+
+    if (!(buf = malloc (depth * 2 + 16)))
+        BAIL_OUT ("parse_deep: out of memory");
+
+    len = sprintf (buf, "a = ");
+    for (i = 0; i < 100; i++)
+        buf[len++] = '[';
+    for (i = 0; i < 100; i++)
+        buf[len++] = ']';
+    buf[len] = '\0';
+    conf = toml_parse (buf, e, sizeof (e));
+    ok (conf != NULL && toml_array_in (conf, "a") != NULL,
+        "array nested 100 deep is allowed");
+    toml_free (conf);
+
+    len = sprintf (buf, "a = ");
+    for (i = 0; i < depth; i++)
+        buf[len++] = '[';
+    for (i = 0; i < depth; i++)
+        buf[len++] = ']';
+    buf[len] = '\0';
+    conf = toml_parse (buf, e, sizeof (e));
+    ok (conf == NULL,
+        "array nested %d deep fails", depth);
+    is (e, "line 1: nesting too deep",
+        "error says nesting is too deep");
+
+    len = sprintf (buf, "a = ");
+    for (i = 0; i < depth / 4; i++)
+        len += sprintf (buf + len, "{b=");
+    conf = toml_parse (buf, e, sizeof (e));
+    ok (conf == NULL && !strcmp (e, "line 1: nesting too deep"),
+        "inline table nested %d deep fails", depth / 4);
+    free (buf);
+}
+
 void check_ucs_to_utf8 (void)
 {
     char buf[6];
@@ -442,6 +591,8 @@ int main (int argc, char *argv[])
     parse_bad_input ();
 
     parse_extra ();
+    parse_wide ();
+    parse_deep ();
 
     check_ucs_to_utf8 ();
     check_utf8_to_ucs ();
@@ -260,6 +260,7 @@ int toml_ucs_to_utf8(int64_t code, char buf[6])
  *	Each of them can have identification key.
  */
 typedef struct toml_keyval_t toml_keyval_t;
+typedef struct toml_keyslot_t toml_keyslot_t;
 struct toml_keyval_t {
 	const char* key;		/* key to this value */
 	const char* val;		/* the raw value */
@@ -295,12 +296,129 @@ struct toml_table_t {
 	/* tables in the table */
 	int		   ntab;
 	toml_table_t** tab;
+
+	/* hashed index of all keys above, for wide tables (or NULL) */
+	toml_keyslot_t* index;
+	int nslot;			/* number of slots: 0 or a power of 2 */
 };
 
 
 static inline void xfree(const void* x) { if (x) FREE((void*)x); }
 
 
+/*
+ *	Tables with at least KEYINDEX_MIN keys get an open addressing
+ *	hash index, kept at most half full.  It is updated as keys are added
+ *	during parsing, so lookups never modify the table.  If the index
+ *	cannot be allocated, lookups fall back to a linear scan.
+ */
+#define KEYINDEX_MIN 8
+
+struct toml_keyslot_t {
+	const char* key;	/* NULL if slot is empty */
+	unsigned hash;
+	int kind;			/* 'v'alue, 'a'rray or 't'able */
+	int idx;			/* index in tab->kval, tab->arr, or tab->tab */
+};
+
+static unsigned key_hash(const char* key)
+{
+	unsigned h = 2166136261u;	/* FNV-1a */
+	for ( ; *key; key++) {
+		h ^= (unsigned char) *key;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void keyindex_put(toml_keyslot_t* index, int nslot,
+						 const char* key, int kind, int idx)
+{
+	unsigned h = key_hash(key);
+	int i = h & (nslot - 1);
+
+	while (index[i].key)
+		i = (i + 1) & (nslot - 1);
+	index[i].key = key;
+	index[i].hash = h;
+	index[i].kind = kind;
+	index[i].idx = idx;
+}
+
+/* Rebuild the index with 'nslot' slots. */
+static void keyindex_build(toml_table_t* tab, int nslot)
+{
+	toml_keyslot_t* index;
+	int i;
+
+	xfree(tab->index);
+	tab->index = 0;
+	tab->nslot = 0;
+	if (0 == (index = CALLOC(nslot, sizeof(*index))))
+		return;
+	for (i = 0; i < tab->nkval; i++)
+		keyindex_put(index, nslot, tab->kval[i]->key, 'v', i);
+	for (i = 0; i < tab->narr; i++)
+		keyindex_put(index, nslot, tab->arr[i]->key, 'a', i);
+	for (i = 0; i < tab->ntab; i++)
+		keyindex_put(index, nslot, tab->tab[i]->key, 't', i);
+	tab->index = index;
+	tab->nslot = nslot;
+}
+
+/* Call after appending element 'idx' of 'kind' to 'tab'. */
+static void keyindex_add(toml_table_t* tab, const char* key, int kind, int idx)
+{
+	int nkeys = tab->nkval + tab->narr + tab->ntab;
+	int nslot = 4 * KEYINDEX_MIN;
+
+	if (nkeys < KEYINDEX_MIN)
+		return;
+	if (tab->index && 2 * nkeys <= tab->nslot) {
+		keyindex_put(tab->index, tab->nslot, key, kind, idx);
+		return;
+	}
+	while (nslot < 2 * nkeys)
+		nslot *= 2;
+	keyindex_build(tab, nslot);
+}
+
+/*
+ * Look up key in tab. Return 0 if not found, or
+ * 'v'alue, 'a'rray or 't'able depending on the element, with its
+ * position in the corresponding list in *idx.
+ */
+static int find_key(const toml_table_t* tab, const char* key, int* idx)
+{
+	int i;
+
+	if (tab->index) {
+		unsigned h = key_hash(key);
+		for (i = h & (tab->nslot - 1); tab->index[i].key;
+			 i = (i + 1) & (tab->nslot - 1)) {
+			if (tab->index[i].hash == h && 0 == strcmp(key, tab->index[i].key)) {
+				*idx = tab->index[i].idx;
+				return tab->index[i].kind;
+			}
+		}
+		return 0;
+	}
+	for (i = 0; i < tab->nkval; i++) {
+		if (0 == strcmp(key, tab->kval[i]->key))
+			return *idx = i, 'v';
+	}
+	for (i = 0; i < tab->narr; i++) {
+		if (0 == strcmp(key, tab->arr[i]->key))
+			return *idx = i, 'a';
+	}
+	for (i = 0; i < tab->ntab; i++) {
+		if (0 == strcmp(key, tab->tab[i]->key))
+			return *idx = i, 't';
+	}
+	return 0;
+}
+
+
 enum tokentype_t {
 	INVALID,
 	DOT,
@@ -343,8 +461,14 @@ struct context_t {
 		token_t tok[10];
 	} tpath;
 
+	int depth;	/* nesting of inline tables and arrays */
 };
 
+/* Inline tables and arrays are parsed recursively, so limit their nesting
+ * to keep hostile input from exhausting the stack.
+ */
+#define MAX_DEPTH 100
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x)	 STRINGIFY(x)
 #define FLINE __FILE__ ":" TOSTRING(__LINE__)
@@ -411,7 +535,8 @@ static char* norm_lit_str(const char* src, int srclen,
 	/* scan forward on src */
 	for (;;) {
 		if (off >=	max - 10) { /* have some slack for misc stuff */
-			char* x = REALLOC(dst, max += 50);
+			/* output is never longer than input, so this runs once */
+			char* x = REALLOC(dst, max += srclen + 11);
 			if (!x) {
 				xfree(dst);
 				snprintf(errbuf, errbufsz, "out of memory");
@@ -464,7 +589,8 @@ static char* norm_basic_str(const char* src, int srclen,
 	/* scan forward on src */
 	for (;;) {
 		if (off >=	max - 10) { /* have some slack for misc stuff */
-			char* x = REALLOC(dst, max += 50);
+			/* output is never longer than input, so this runs once */
+			char* x = REALLOC(dst, max += srclen + 11);
 			if (!x) {
 				xfree(dst);
 				snprintf(errbuf, errbufsz, "out of memory");
@@ -642,6 +768,7 @@ static int check_key(toml_table_t* tab, const char* key,
 					 toml_table_t** ret_tab)
 {
 	int i;
+	int kind;
 	void* dummy;
 
 	if (!ret_tab) ret_tab = (toml_table_t**) &dummy;
@@ -649,26 +776,13 @@ static int check_key(toml_table_t* tab, const char* key,
 	if (!ret_val) ret_val = (toml_keyval_t**) &dummy;
 
 	*ret_tab = 0; *ret_arr = 0; *ret_val = 0;
-	
-	for (i = 0; i < tab->nkval; i++) {
-		if (0 == strcmp(key, tab->kval[i]->key)) {
-			*ret_val = tab->kval[i];
-			return 'v';
-		}
-	}
-	for (i = 0; i < tab->narr; i++) {
-		if (0 == strcmp(key, tab->arr[i]->key)) {
-			*ret_arr = tab->arr[i];
-			return 'a';
-		}
-	}
-	for (i = 0; i < tab->ntab; i++) {
-		if (0 == strcmp(key, tab->tab[i]->key)) {
-			*ret_tab = tab->tab[i];
-			return 't';
-		}
+
+	switch (kind = find_key(tab, key, &i)) {
+	case 'v': *ret_val = tab->kval[i]; break;
+	case 'a': *ret_arr = tab->arr[i]; break;
+	case 't': *ret_tab = tab->tab[i]; break;
 	}
-	return 0;
+	return kind;
 }
 
 
@@ -714,6 +828,7 @@ static toml_keyval_t* create_keyval_in_table(context_t* ctx, toml_table_t* tab,
 
 	/* save the key in the new value struct */
 	dest->key = newkey;
+	keyindex_add(tab, newkey, 'v', n);
 	return dest;
 }
 
@@ -762,6 +877,7 @@ static toml_table_t* create_keytable_in_table(context_t* ctx, toml_table_t* tab,
 	
 	/* save the key in the new table struct */
 	dest->key = newkey;
+	keyindex_add(tab, newkey, 't', n);
 	return dest;
 }
 
@@ -806,6 +922,7 @@ static toml_array_t* create_keyarray_in_table(context_t* ctx,
 	/* save the key in the new array struct */
 	dest->key = newkey;
 	dest->kind = kind;
+	keyindex_add(tab, newkey, 'a', n);
 	return dest;
 }
 
@@ -865,6 +982,10 @@ static void parse_keyval(context_t* ctx, toml_table_t* tab);
  */
 static void parse_table(context_t* ctx, toml_table_t* tab)
 {
+	if (++ctx->depth > MAX_DEPTH) {
+		e_syntax_error(ctx, ctx->tok.lineno, "nesting too deep");
+		return;		/* not reached */
+	}
 	EAT_TOKEN(ctx, LBRACE, 1);
 
 	for (;;) {
@@ -901,6 +1022,7 @@ static void parse_table(context_t* ctx, toml_table_t* tab)
 	}
 
 	EAT_TOKEN(ctx, RBRACE, 1);
+	ctx->depth--;
 }
 
 static int valtype(const char* val)
@@ -922,6 +1044,10 @@ static int valtype(const char* val)
 /* We are at '[...]' */
 static void parse_array(context_t* ctx, toml_array_t* arr)
 {
+	if (++ctx->depth > MAX_DEPTH) {
+		e_syntax_error(ctx, ctx->tok.lineno, "nesting too deep");
+		return;		/* not reached */
+	}
 	EAT_TOKEN(ctx, LBRACKET, 0);
 
 	for (;;) {
@@ -1020,6 +1146,7 @@ static void parse_array(context_t* ctx, toml_array_t* arr)
 	}
 
 	EAT_TOKEN(ctx, RBRACKET, 1);
+	ctx->depth--;
 }
 
 
@@ -1213,6 +1340,7 @@ static void walk_tabpath(context_t* ctx)
 				}
 		
 				nexttab = curtab->tab[curtab->ntab++];
+				keyindex_add(curtab, nexttab->key, 't', n);
 		
 				/* tabs created by walk_tabpath are considered implicit */
 				nexttab->implicit = 1;
@@ -1506,6 +1634,7 @@ static void xfree_tab(toml_table_t* p)
 	for (i = 0; i < p->ntab; i++) xfree_tab(p->tab[i]);
 	xfree(p->tab);
 
+	xfree(p->index);
 	xfree(p);
 }
 
@@ -1589,6 +1718,8 @@ static tokentype_t scan_string(context_t* ctx, char* p, int lineno, int dotisspe
 		int escape = 0;
 		int qcnt = 0;		/* count quote */
 		for (p += 3; *p && qcnt < 3; p++) {
+			if (!escape && !hexreq && !qcnt && !(p += strcspn(p, "\\\""), *p))
+				break;
 			if (escape) {
 				escape = 0;
 				if (strchr("btnfr\"\\", *p)) continue;
@@ -1616,7 +1747,8 @@ static tokentype_t scan_string(context_t* ctx, char* p, int lineno, int dotisspe
 	}
 
 	if ('\'' == *p) {
-		for (p++; *p && *p != '\n' && *p != '\''; p++);
+		p++;
+		p += strcspn(p, "\n'");
 		if (*p != '\'') {
 			e_syntax_error(ctx, lineno, "unterminated s-quote");
 			return 0;		/* not reached */
@@ -1629,6 +1761,8 @@ static tokentype_t scan_string(context_t* ctx, char* p, int lineno, int dotisspe
 		int hexreq = 0;		/* #hex required */
 		int escape = 0;
 		for (p++; *p; p++) {
+			if (!escape && !hexreq && !(p += strcspn(p, "\\\"\n"), *p))
+				break;
 			if (escape) {
 				escape = 0;
 				if (strchr("btnfr\"\\", *p)) continue;
@@ -1683,19 +1817,21 @@ static tokentype_t next_token(context_t* ctx, int dotisspecial)
 {
 	int	  lineno = ctx->tok.lineno;
 	char* p = ctx->tok.ptr;
-	int i;
 
-	/* eat this tok */
-	for (i = 0; i < ctx->tok.len; i++) {
-		if (*p++ == '\n')
-			lineno++;
+	/* eat this tok, counting the newlines in it */
+	char* q = p + ctx->tok.len;
+	while ((p = memchr(p, '\n', q - p))) {
+		lineno++;
+		p++;
 	}
+	p = q;
 
 	/* make next tok */
 	while (p < ctx->stop) {
 		/* skip comment. stop just before the \n. */
 		if (*p == '#') {
-			for (p++; p < ctx->stop && *p != '\n'; p++);
+			if (! (p = memchr(p, '\n', ctx->stop - p)))
+				p = ctx->stop;
 			continue;
 		}
 
@@ -1712,7 +1848,7 @@ static tokentype_t next_token(context_t* ctx, int dotisspecial)
 		case '\n': return ret_token(ctx, NEWLINE, lineno, p, 1);
 		case '\r': case ' ': case '\t':
 			/* ignore white spaces */
-			p++;
+			p += strspn(p, " \t\r");
 			continue;
 		}
 
@@ -1740,32 +1876,20 @@ const char* toml_key_in(toml_table_t* tab, int keyidx)
 const char* toml_raw_in(toml_table_t* tab, const char* key)
 {
 	int i;
-	for (i = 0; i < tab->nkval; i++) {
-		if (0 == strcmp(key, tab->kval[i]->key))
-			return tab->kval[i]->val;
-	}
-	return 0;
+	return 'v' == find_key(tab, key, &i) ? tab->kval[i]->val : 0;
 }
 
 toml_array_t* toml_array_in(toml_table_t* tab, const char* key)
 {
 	int i;
-	for (i = 0; i < tab->narr; i++) {
-		if (0 == strcmp(key, tab->arr[i]->key))
-			return tab->arr[i];
-	}
-	return 0;
+	return 'a' == find_key(tab, key, &i) ? tab->arr[i] : 0;
 }
 
 
 toml_table_t* toml_table_in(toml_table_t* tab, const char* key)
 {
 	int i;
-	for (i = 0; i < tab->ntab; i++) {
-		if (0 == strcmp(key, tab->tab[i]->key))
-			return tab->tab[i];
-	}
-	return 0;
+	return 't' == find_key(tab, key, &i) ? tab->tab[i] : 0;
 }
 
 const char* toml_raw_at(toml_array_t* arr, int idx)
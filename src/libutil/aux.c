@@ -14,148 +14,256 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "aux.h"
 
-struct aux_item {
-    char *key;
+/* Keys are interned in a process-wide registry, which assigns each
+ * distinct key a small integer handle (starting at 1).  An aux container
+ * indexes its items by handle, so aux_get_key() is an array lookup.
+ * Registry strings are never freed, so items may point to them.
+ */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **registry;
+static int registry_count;
+
+struct aux_entry {
+    int key;                // 0 for anonymous items
+    const char *name;       // registry string, NULL for anonymous items
     void *val;
     aux_free_f free_fn;
-    struct aux_item *next;
+    struct aux_entry *next;
 };
 
-/* Destroy an aux item.
- * It is assumed to already be unlinked from list.
+struct aux_item {
+    struct aux_entry *head; // most recently set first
+    struct aux_entry **index;
+    int size;               // size of index array
+};
+
+/* Find 'key' in registry.  Call with registry_lock held.
+ * Return handle, or 0 if not found.
  */
-static void aux_item_destroy (struct aux_item *aux)
+static int registry_find (const char *key)
 {
-    if (aux) {
-        int saved_errno = errno;
-        if (aux->free_fn && aux->val)
-            aux->free_fn (aux->val);
-        free (aux->key);
-        free (aux);
-        errno = saved_errno;
+    int i;
+
+    for (i = 0; i < registry_count; i++) {
+        if (!strcmp (registry[i], key))
+            return i + 1;
     }
+    return 0;
 }
 
-/* Create an aux item.
- * Return item on success, NULL on failure with errno set (ENOMEM).
- */
-static struct aux_item *aux_item_create (const char *key,
-                                         void *val, aux_free_f free_fn)
+int aux_key_register (const char *key)
 {
-    struct aux_item *aux;
+    char **new;
+    char *cpy;
+    int k;
 
-    if (!(aux = calloc (1, sizeof (*aux))))
-        return NULL;
-    if (key && !(aux->key = strdup (key)))
+    if (!key) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&registry_lock);
+    if ((k = registry_find (key)) > 0)
+        goto done;
+    if (!(cpy = strdup (key)))
+        goto error;
+    if (!(new = realloc (registry, sizeof (*new) * (registry_count + 1)))) {
+        free (cpy);
         goto error;
-    aux->val = val;
-    aux->free_fn = free_fn;
-    return aux;
+    }
+    registry = new;
+    registry[registry_count++] = cpy;
+    k = registry_count;
+done:
+    pthread_mutex_unlock (&registry_lock);
+    return k;
 error:
-    aux_item_destroy (aux);
-    return NULL;
+    pthread_mutex_unlock (&registry_lock);
+    errno = ENOMEM;
+    return -1;
 }
 
-/* Delete from 'head' an aux item that was stored under 'key', if any.
- * 'head' is an in/out parameter.
+/* Return the string for handle 'key', or NULL if not registered.
  */
-static void aux_item_delete (struct aux_item **head, const char *key)
+static const char *registry_name (int key)
 {
-    if (key && head) {
-        struct aux_item *item;
-
-        while ((item = *head)) {
-            if (item->key && !strcmp (item->key, key)) {
-                *head = item->next;
-                aux_item_destroy (item);
-                break;
-            }
-            head = &item->next;
-        }
+    const char *name = NULL;
+
+    pthread_mutex_lock (&registry_lock);
+    if (key > 0 && key <= registry_count)
+        name = registry[key - 1];
+    pthread_mutex_unlock (&registry_lock);
+    return name;
+}
+
+/* Destroy an aux entry.
+ * It is assumed to already be unlinked from list.
+ */
+static void aux_entry_destroy (struct aux_entry *entry)
+{
+    if (entry) {
+        int saved_errno = errno;
+        if (entry->free_fn && entry->val)
+            entry->free_fn (entry->val);
+        free (entry);
+        errno = saved_errno;
     }
 }
 
-/* Find in 'head' an aux item stored under 'key'.
- * Returns item on success, NULL on failure.
+/* Unlink 'entry' from list and index of 'aux', and destroy it.
  */
-static struct aux_item *aux_item_find (struct aux_item *head, const char *key)
+static void aux_entry_delete (struct aux_item *aux, struct aux_entry *entry)
 {
-    if (key) {
-        while (head) {
-            if (head->key && !strcmp (key, head->key))
-                return head;
-            head = head->next;
-        }
+    struct aux_entry **prev = &aux->head;
+
+    while (*prev != entry)
+        prev = &(*prev)->next;
+    *prev = entry->next;
+    if (entry->key > 0)
+        aux->index[entry->key] = NULL;
+    aux_entry_destroy (entry);
+}
+
+/* Insert at the beginning of list a new entry.
+ * Create container on first use, and grow index if needed.
+ * Returns 0 on success, -1 on failure with errno set (ENOMEM).
+ */
+static int aux_entry_insert (struct aux_item **aux,
+                             int key,
+                             const char *name,
+                             void *val,
+                             aux_free_f free_fn)
+{
+    struct aux_entry *entry;
+
+    if (!*aux && !(*aux = calloc (1, sizeof (**aux))))
+        return -1;
+    if (key >= (*aux)->size) {
+        int size = key + 8;
+        struct aux_entry **new;
+        if (!(new = realloc ((*aux)->index, sizeof (*new) * size)))
+            return -1;
+        memset (new + (*aux)->size, 0,
+                sizeof (*new) * (size - (*aux)->size));
+        (*aux)->index = new;
+        (*aux)->size = size;
     }
-    return NULL;
+    if (!(entry = calloc (1, sizeof (*entry))))
+        return -1;
+    entry->key = key;
+    entry->name = name;
+    entry->val = val;
+    entry->free_fn = free_fn;
+    entry->next = (*aux)->head;
+    (*aux)->head = entry;
+    if (key > 0)
+        (*aux)->index[key] = entry;
+    return 0;
 }
 
-/* Insert at the beginning of 'head' an aux 'item'.
- * 'head' is an in/out parameter.
+/* Look up handle 'key' in 'aux'.
+ * Returns value on success, NULL on failure with errno set (EINVAL, ENOENT).
  */
-static void aux_item_insert (struct aux_item **head, struct aux_item *item)
+void *aux_get_key (struct aux_item *aux, int key)
 {
-    if (head && item) {
-        if (*head)
-            item->next = *head;
-        *head = item;
+    if (key < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!aux || key >= aux->size || !aux->index[key]) {
+        errno = ENOENT;
+        return NULL;
     }
+    return aux->index[key]->val;
 }
 
-/* Look up 'key' in 'head'.
+/* Look up 'key' in 'aux', by comparing strings.
  * Returns value on success, NULL on failure with errno set (EINVAL, ENOENT).
  */
-void *aux_get (struct aux_item *head, const char *key)
+void *aux_get (struct aux_item *aux, const char *key)
 {
-    struct aux_item *item;
+    struct aux_entry *entry;
 
     if (!key) {
         errno = EINVAL;
         return NULL;
     }
-    if (!(item = aux_item_find (head, key))) {
-        errno = ENOENT;
-        return NULL;
+    if (aux) {
+        for (entry = aux->head; entry != NULL; entry = entry->next) {
+            if (entry->name && !strcmp (key, entry->name))
+                return entry->val;
+        }
     }
-    return item->val;
+    errno = ENOENT;
+    return NULL;
 }
 
-/* Insert ('key', 'value', 'free_fn') tuple in 'head'.
- * If 'key' is present in list, remove it first.
- * 'head' is an in/out parameter.
+/* Insert ('key', 'value', 'free_fn') tuple in 'aux'.
+ * If 'key' is present, remove it first.
+ * 'aux' is an in/out parameter.
  * Returns 0 on success, -1 on failure with errno set (EINVAL, ENOMEM).
  */
-int aux_set (struct aux_item **head,
-             const char *key, void *val, aux_free_f free_fn)
+int aux_set_key (struct aux_item **aux, int key, void *val, aux_free_f free_fn)
 {
-    struct aux_item *item;
+    const char *name;
 
-    if (!head || (!key && !val) || (!val && free_fn) || (!key && !free_fn)) {
+    if (!aux || key < 1 || (!val && free_fn)) {
         errno = EINVAL;
         return -1;
     }
-    aux_item_delete (head, key);
-    if (val) {
-        if (!(item = aux_item_create (key, val, free_fn)))
-            return -1;
-        aux_item_insert (head, item);
+    if (!(name = registry_name (key))) {
+        errno = EINVAL;
+        return -1;
     }
+    if (*aux && key < (*aux)->size && (*aux)->index[key])
+        aux_entry_delete (*aux, (*aux)->index[key]);
+    if (val)
+        return aux_entry_insert (aux, key, name, val, free_fn);
     return 0;
 }
 
-/* Destroy aux list 'head', calling destructors on items that have them.
+int aux_set (struct aux_item **aux,
+             const char *key, void *val, aux_free_f free_fn)
+{
+    int k;
+
+    if (!aux || (!key && !val) || (!val && free_fn) || (!key && !free_fn)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!key)
+        return aux_entry_insert (aux, 0, NULL, val, free_fn);
+    /* Deleting a key that was never registered is a no-op.
+     */
+    if (!val) {
+        pthread_mutex_lock (&registry_lock);
+        k = registry_find (key);
+        pthread_mutex_unlock (&registry_lock);
+        if (k == 0)
+            return 0;
+    }
+    else if ((k = aux_key_register (key)) < 0)
+        return -1;
+    return aux_set_key (aux, k, val, free_fn);
+}
+
+/* Destroy 'aux', calling destructors on items that have them,
+ * most recently set first.
  */
-void aux_destroy (struct aux_item **head)
+void aux_destroy (struct aux_item **aux)
 {
-    if (head) {
-        while (*head) {
-            struct aux_item *next = (*head)->next;
-            aux_item_destroy (*head);
-            *head = next;
+    if (aux && *aux) {
+        while ((*aux)->head) {
+            struct aux_entry *next = (*aux)->head->next;
+            aux_entry_destroy ((*aux)->head);
+            (*aux)->head = next;
         }
+        free ((*aux)->index);
+        free (*aux);
+        *aux = NULL;
     }
 }
 
@@ -27,6 +27,12 @@
  *
  * It is legal to aux_set (key!=NULL, value=NULL).  Any value previously
  * stored under key is deleted, calling its destructor, if any.
+ *
+ * Keys may be registered with aux_key_register (), which returns a small
+ * integer handle that is the same for every caller in the process.
+ * aux_get_key ()/aux_set_key () use the handle directly, without string
+ * comparisons, and should be used on hot paths.  aux_get ()/aux_set ()
+ * with a string key are equivalent, and register the key as needed.
  */
 
 typedef void (*aux_free_f)(void *arg);
@@ -38,6 +44,17 @@ int aux_set (struct aux_item **aux, const char *key,
 
 void *aux_get (struct aux_item *aux, const char *key);
 
+/* Register 'key' and return its handle (> 0), or -1 on failure with
+ * errno set.  Registering the same key again returns the same handle.
+ * Safe to call from multiple threads.
+ */
+int aux_key_register (const char *key);
+
+int aux_set_key (struct aux_item **aux, int key,
+                 void *val, aux_free_f free_fn);
+
+void *aux_get_key (struct aux_item *aux, int key);
+
 void aux_destroy (struct aux_item **aux);
 
 #endif /* !_UTIL_AUX_H */
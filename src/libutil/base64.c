@@ -0,0 +1,308 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define HAVE_BASE64_SSSE3 1
+#endif
+
+#include "base64.h"
+
+static const char enc_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Map characters to 6-bit values, or 0xff if not in the alphabet.
+ */
+static const uint8_t dec_table[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff,   62, 0xff, 0xff, 0xff,   63, // '+' '/'
+      52,   53,   54,   55,   56,   57,   58,   59, // '0' - '7'
+      60,   61, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // '8' '9'
+    0xff,    0,    1,    2,    3,    4,    5,    6, // 'A' - 'G'
+       7,    8,    9,   10,   11,   12,   13,   14,
+      15,   16,   17,   18,   19,   20,   21,   22,
+      23,   24,   25, 0xff, 0xff, 0xff, 0xff, 0xff, // 'X' - 'Z'
+    0xff,   26,   27,   28,   29,   30,   31,   32, // 'a' - 'g'
+      33,   34,   35,   36,   37,   38,   39,   40,
+      41,   42,   43,   44,   45,   46,   47,   48,
+      49,   50,   51, 0xff, 0xff, 0xff, 0xff, 0xff, // 'x' - 'z'
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+size_t base64_encoded_len (size_t srclen)
+{
+    return ((srclen + 2) / 3) * 4 + 1;
+}
+
+#ifdef HAVE_BASE64_SSSE3
+static int have_ssse3 (void)
+{
+    return __builtin_cpu_supports ("ssse3");
+}
+
+/* Encode 12 input bytes (from a 16 byte load) to 16 characters.
+ * Algorithm by Wojciech Muła, as used in aklomp/base64.
+ */
+__attribute__((target("ssse3")))
+static size_t encode_ssse3 (char *dst, const uint8_t *src, size_t srclen)
+{
+    const __m128i shuf = _mm_set_epi8 (10, 11,  9, 10,
+                                        7,  8,  6,  7,
+                                        4,  5,  3,  4,
+                                        1,  2,  0,  1);
+    const __m128i lut = _mm_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4,
+                                       -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t n = 0;
+
+    while (srclen - n >= 16) {
+        __m128i in = _mm_loadu_si128 ((const __m128i *)(src + n));
+        __m128i t0, t1, t2, t3, idx, mask, out;
+
+        in = _mm_shuffle_epi8 (in, shuf);
+        t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0FC0FC00));
+        t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+        t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003F03F0));
+        t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+        in = _mm_or_si128 (t1, t3);
+
+        idx = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+        mask = _mm_cmpgt_epi8 (in, _mm_set1_epi8 (25));
+        idx = _mm_sub_epi8 (idx, mask);
+        out = _mm_add_epi8 (in, _mm_shuffle_epi8 (lut, idx));
+        _mm_storeu_si128 ((__m128i *)dst, out);
+
+        dst += 16;
+        n += 12;
+    }
+    return n;
+}
+
+/* Decode 16 characters to 12 bytes, stopping at the first block
+ * containing a character outside the alphabet (including padding),
+ * which is left to the scalar code.  At least 16 bytes of 'dst' must
+ * remain for each block since each store is 16 bytes wide.
+ */
+__attribute__((target("ssse3")))
+static size_t decode_ssse3 (uint8_t *dst, size_t dstsz,
+                            const char *src, size_t srclen, size_t *dstlen)
+{
+    const __m128i lut_lo = _mm_setr_epi8 (0x15, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1A,
+                                          0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8 (0x10, 0x10, 0x01, 0x02,
+                                          0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71,
+                                            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8 (0x2f);
+    const __m128i pack = _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                        14, 13, 12, -1, -1, -1, -1);
+    size_t n = 0;
+    size_t len = 0;
+
+    while (srclen - n >= 16 && dstsz - len >= 16) {
+        __m128i str = _mm_loadu_si128 ((const __m128i *)(src + n));
+        __m128i hi_nibbles, lo_nibbles, hi, lo, eq_2f, roll, out;
+
+        hi_nibbles = _mm_and_si128 (_mm_srli_epi32 (str, 4), mask_2f);
+        lo_nibbles = _mm_and_si128 (str, mask_2f);
+        hi = _mm_shuffle_epi8 (lut_hi, hi_nibbles);
+        lo = _mm_shuffle_epi8 (lut_lo, lo_nibbles);
+        if (_mm_movemask_epi8 (_mm_cmpgt_epi8 (_mm_and_si128 (lo, hi),
+                                               _mm_setzero_si128 ())) != 0)
+            break;
+        eq_2f = _mm_cmpeq_epi8 (str, mask_2f);
+        roll = _mm_shuffle_epi8 (lut_roll, _mm_add_epi8 (eq_2f, hi_nibbles));
+        str = _mm_add_epi8 (str, roll);
+
+        str = _mm_maddubs_epi16 (str, _mm_set1_epi32 (0x01400140));
+        str = _mm_madd_epi16 (str, _mm_set1_epi32 (0x00011000));
+        out = _mm_shuffle_epi8 (str, pack);
+        _mm_storeu_si128 ((__m128i *)(dst + len), out);
+
+        len += 12;
+        n += 16;
+    }
+    *dstlen = len;
+    return n;
+}
+#endif /* HAVE_BASE64_SSSE3 */
+
+void base64_encode (char *dst, const void *src, size_t srclen)
+{
+    const uint8_t *s = src;
+    size_t n = 0;
+
+#ifdef HAVE_BASE64_SSSE3
+    if (srclen >= 16 && have_ssse3 ()) {
+        n = encode_ssse3 (dst, s, srclen);
+        dst += n / 3 * 4;
+    }
+#endif
+    for (; srclen - n >= 3; n += 3) {
+        uint32_t v = (s[n] << 16) | (s[n + 1] << 8) | s[n + 2];
+        *dst++ = enc_table[(v >> 18) & 0x3f];
+        *dst++ = enc_table[(v >> 12) & 0x3f];
+        *dst++ = enc_table[(v >> 6) & 0x3f];
+        *dst++ = enc_table[v & 0x3f];
+    }
+    if (srclen - n == 1) {
+        uint32_t v = s[n] << 16;
+        *dst++ = enc_table[(v >> 18) & 0x3f];
+        *dst++ = enc_table[(v >> 12) & 0x3f];
+        *dst++ = '=';
+        *dst++ = '=';
+    }
+    else if (srclen - n == 2) {
+        uint32_t v = (s[n] << 16) | (s[n + 1] << 8);
+        *dst++ = enc_table[(v >> 18) & 0x3f];
+        *dst++ = enc_table[(v >> 12) & 0x3f];
+        *dst++ = enc_table[(v >> 6) & 0x3f];
+        *dst++ = '=';
+    }
+    *dst = '\0';
+}
+
+int base64_decode (void *dst, size_t dstsz, const char *src, size_t srclen)
+{
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t *d = dst;
+    size_t declen;
+    size_t len = 0;
+    size_t n = 0;
+    int pad = 0;
+
+    if (srclen % 4 != 0)
+        goto inval;
+    if (srclen > 0 && s[srclen - 1] == '=')
+        pad++;
+    if (srclen > 1 && s[srclen - 2] == '=')
+        pad++;
+    declen = srclen / 4 * 3 - pad;
+    if (declen > dstsz) {
+        errno = ERANGE;
+        return -1;
+    }
+#ifdef HAVE_BASE64_SSSE3
+    if (srclen >= 16 && dstsz >= 16 && have_ssse3 ())
+        n = decode_ssse3 (d, dstsz, src, srclen - (pad ? 4 : 0), &len);
+#endif
+    /* Full quads, except for the final one if it contains padding.
+     */
+    for (; n + 4 <= srclen - (pad ? 4 : 0); n += 4) {
+        uint8_t a = dec_table[s[n]];
+        uint8_t b = dec_table[s[n + 1]];
+        uint8_t c = dec_table[s[n + 2]];
+        uint8_t e = dec_table[s[n + 3]];
+        uint32_t v;
+
+        if ((a | b | c | e) == 0xff)
+            goto inval;
+        v = (a << 18) | (b << 12) | (c << 6) | e;
+        d[len++] = v >> 16;
+        d[len++] = (v >> 8) & 0xff;
+        d[len++] = v & 0xff;
+    }
+    /* Final quad with padding.  Unused bits must be zero (canonical).
+     */
+    if (pad) {
+        uint8_t a = dec_table[s[n]];
+        uint8_t b = dec_table[s[n + 1]];
+        uint8_t c = pad == 1 ? dec_table[s[n + 2]] : 0;
+        uint32_t v;
+
+        if ((a | b | c) == 0xff)
+            goto inval;
+        v = (a << 18) | (b << 12) | (c << 6);
+        if (pad == 2 && (v & 0xffff) != 0)
+            goto inval;
+        if (pad == 1 && (v & 0xff) != 0)
+            goto inval;
+        d[len++] = v >> 16;
+        if (pad == 1)
+            d[len++] = (v >> 8) & 0xff;
+    }
+    return len;
+inval:
+    errno = EINVAL;
+    return -1;
+}
+
+int base64_check (const char *src, size_t srclen)
+{
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t bad = 0;
+    size_t n;
+    int pad = 0;
+
+    if (srclen % 4 != 0)
+        goto inval;
+    if (srclen > 0 && s[srclen - 1] == '=')
+        pad++;
+    if (srclen > 1 && s[srclen - 2] == '=')
+        pad++;
+    /* Invalid characters decode to 0xff, and valid ones are < 64, so
+     * OR-ing the table entries is 0xff iff any character is invalid.
+     */
+    for (n = 0; n < srclen - (pad ? 4 : 0); n++)
+        bad |= dec_table[s[n]];
+    if (bad == 0xff)
+        goto inval;
+    if (pad) {
+        uint8_t a = dec_table[s[n]];
+        uint8_t b = dec_table[s[n + 1]];
+        uint8_t c = pad == 1 ? dec_table[s[n + 2]] : 0;
+        uint32_t v;
+
+        if ((a | b | c) == 0xff)
+            goto inval;
+        v = (a << 18) | (b << 12) | (c << 6);
+        if (pad == 2 && (v & 0xffff) != 0)
+            goto inval;
+        if (pad == 1 && (v & 0xff) != 0)
+            goto inval;
+    }
+    return srclen / 4 * 3 - pad;
+inval:
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,54 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _UTIL_BASE64_H
+#define _UTIL_BASE64_H
+
+/* Standard (RFC 4648 section 4) padded base64, producing and accepting
+ * exactly what libsodium's sodium_base64_VARIANT_ORIGINAL does, with
+ * ignore=NULL.  Unlike libsodium's codec, this one is not constant-time,
+ * so do not use it for secret data such as keys.
+ *
+ * On x86_64, SSSE3 is used for the bulk of the data when the CPU
+ * supports it, selected at runtime, with a scalar fallback.
+ */
+
+#include <stddef.h>
+
+/* Return the size of the buffer required to encode 'srclen' bytes,
+ * including the terminating NUL.
+ */
+size_t base64_encoded_len (size_t srclen);
+
+/* Encode 'srclen' bytes of 'src' to NUL-terminated 'dst', which must
+ * be at least base64_encoded_len (srclen) bytes.
+ */
+void base64_encode (char *dst, const void *src, size_t srclen);
+
+/* Decode 'srclen' characters of base64 'src' to 'dst' of size 'dstsz'.
+ * Input must be canonical and properly padded.
+ * Return the decoded length on success, or -1 on failure with errno set:
+ *   EINVAL - invalid input
+ *   ERANGE - 'dstsz' is too small
+ */
+int base64_decode (void *dst, size_t dstsz, const char *src, size_t srclen);
+
+/* Check that 'srclen' characters of 'src' would be accepted by
+ * base64_decode(), without decoding them.
+ * Return the decoded length on success, or -1 on failure with errno set:
+ *   EINVAL - invalid input
+ */
+int base64_check (const char *src, size_t srclen);
+
+#endif /* !_UTIL_BASE64_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -11,16 +11,27 @@
 #if HAVE_CONFIG_H
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <glob.h>
+#include <pthread.h>
+#include <time.h>
 #include <jansson.h>
 
 #include "src/libtomlc99/toml.h"
 #include "tomltk.h"
+#include "hash.h"
 #include "cf.h"
 
 #define ERRBUFSZ 200
+#define MEMCACHE_SIZE 8
 
 cf_t *cf_create (void)
 {
@@ -55,6 +66,13 @@ cf_t *cf_copy (const cf_t *cf)
     return cpy;
 }
 
+bool cf_equal (const cf_t *a, const cf_t *b)
+{
+    if (!a || !b)
+        return a == b;
+    return json_equal ((cf_t *)a, (cf_t *)b) ? true : false;
+}
+
 static void __attribute__ ((format (printf, 4, 5)))
 errprintf (struct cf_error *error,
            const char *filename, int lineno,
@@ -210,24 +228,113 @@ bool cf_array_contains (const cf_t *cf, const char *str)
     return false;
 }
 
+struct cf_set {
+    hash_t hash;
+};
+
+cf_set_t *cf_set_create (const cf_t *cf)
+{
+    cf_set_t *set;
+    int size = cf_array_size (cf);
+
+    if (!(set = calloc (1, sizeof (*set))))
+        return NULL;
+    if (!(set->hash = hash_create (size > 0 ? size : 1,
+                                   (hash_key_f) hash_key_string,
+                                   (hash_cmp_f) strcmp,
+                                   NULL)))
+        goto error;
+    for (int i = 0; i < size; i++) {
+        const cf_t *entry = cf_get_at (cf, i);
+        const char *str;
+
+        if (cf_typeof (entry) != CF_STRING)
+            continue;
+        str = cf_string (entry);
+        if (!hash_insert (set->hash, str, (void *) str) && errno != EEXIST)
+            goto error;
+    }
+    return set;
+error:
+    cf_set_destroy (set);
+    return NULL;
+}
+
+void cf_set_destroy (cf_set_t *set)
+{
+    if (set) {
+        int saved_errno = errno;
+        if (set->hash)
+            hash_destroy (set->hash);
+        free (set);
+        errno = saved_errno;
+    }
+}
+
+bool cf_set_contains (const cf_set_t *set, const char *str)
+{
+    if (!set || !str)
+        return false;
+    return hash_find (set->hash, str) != NULL;
+}
+
+int cf_set_size (const cf_set_t *set)
+{
+    return set ? hash_count (set->hash) : 0;
+}
+
+static uint64_t monotime_ns (void)
+{
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Record the size of 'filename' and start timing its parse, if 'fs'
+ * is non-NULL.  Return the start time.
+ */
+static uint64_t file_stats_start (struct cf_file_stats *fs,
+                                  const char *filename)
+{
+    struct stat st;
+
+    if (!fs)
+        return 0;
+    if (stat (filename, &st) == 0)
+        fs->size = st.st_size;
+    return monotime_ns ();
+}
+
 /* Parse some TOML and merge it with 'cf' object.
  * If filename is non-NULL, take TOML from file, o/w use buf, len.
  */
+/* Parse TOML from 'filename' or 'buf' and update 'cf' with the result.
+ * If 'inplace' is true, tables are converted directly into 'cf', which
+ * saves building and merging a temporary object, but leaves 'cf' partially
+ * updated if conversion fails.  If 'fs' is non-NULL, record load statistics
+ * for 'filename' there.
+ */
 static int update_object (cf_t *cf,
                           const char *filename,
                           const char *buf, int len,
+                          bool inplace,
+                          struct cf_file_stats *fs,
                           struct cf_error *error)
 {
     struct tomltk_error toml_error;
     toml_table_t *tab;
     json_t *obj = NULL;
     int saved_errno;
+    uint64_t t;
 
     if (!cf || json_typeof ((json_t *)cf) != JSON_OBJECT) {
         errprintf (error, filename, -1, "invalid config object");
         errno = EINVAL;
         return -1;
     }
+    t = file_stats_start (fs, filename);
     if (filename)
         tab = tomltk_parse_file (filename, &toml_error);
     else
@@ -237,6 +344,21 @@ static int update_object (cf_t *cf,
                    "%s", toml_error.errbuf);
         goto error;
     }
+    if (fs) {
+        fs->parse_ns = monotime_ns () - t;
+        t = monotime_ns ();
+    }
+    if (inplace) {
+        if (tomltk_table_update (cf, tab) < 0) {
+            errprintf (error, filename, -1, "converting TOML to JSON: %s",
+                       strerror (errno));
+            goto error;
+        }
+        if (fs)
+            fs->merge_ns = monotime_ns () - t;
+        toml_free (tab);
+        return 0;
+    }
     if (!(obj = tomltk_table_to_json (tab))) {
         errprintf (error, filename, -1, "converting TOML to JSON: %s",
                    strerror (errno));
@@ -247,6 +369,8 @@ static int update_object (cf_t *cf,
         errno = ENOMEM;
         goto error;
     }
+    if (fs)
+        fs->merge_ns = monotime_ns () - t;
     json_decref (obj);
     toml_free (tab);
     return 0;
@@ -260,30 +384,202 @@ error:
 
 int cf_update (cf_t *cf, const char *buf, int len, struct cf_error *error)
 {
-    return update_object (cf, NULL, buf, len, error);
+    return update_object (cf, NULL, buf, len, false, NULL, error);
 }
 
 int cf_update_file (cf_t *cf, const char *filename, struct cf_error *error)
 {
-    return update_object (cf, filename, NULL, 0, error);
+    return update_object (cf, filename, NULL, 0, false, NULL, error);
 }
 
-int cf_update_glob (cf_t *cf, const char *pattern, struct cf_error *error)
+/* Drop-in sets with at least this many files are read and parsed by
+ * worker threads, then merged in glob order by the calling thread.
+ */
+static const int parallel_min_files = 4;
+static const int parallel_max_threads = 8;
+
+struct parse_job {
+    char **paths;
+    int count;
+    int next;                           // next index to parse (atomic)
+    toml_table_t **tabs;
+    struct tomltk_error *errors;
+    int *errnums;
+    struct cf_file_stats *files;        // NULL unless recording stats
+};
+
+static void *parse_worker (void *arg)
+{
+    struct parse_job *job = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED))
+           < job->count) {
+        struct cf_file_stats *fs = job->files ? &job->files[i] : NULL;
+        uint64_t t = file_stats_start (fs, job->paths[i]);
+
+        job->tabs[i] = tomltk_parse_file (job->paths[i], &job->errors[i]);
+        job->errnums[i] = job->tabs[i] ? 0 : errno;
+        if (fs)
+            fs->parse_ns = monotime_ns () - t;
+    }
+    return NULL;
+}
+
+/* Parse 'count' files in parallel and update 'cf' with each in order.
+ * The calling thread parses too, so if threads cannot be created, the
+ * files are simply parsed serially.  As with the serial loop, the first
+ * file (in glob order) that fails is reported, and 'cf' may be partially
+ * updated on failure.  If 'files' is non-NULL, record load statistics
+ * for each file there.
+ */
+static int update_parallel (cf_t *cf, char **paths, int count,
+                            struct cf_file_stats *files,
+                            struct cf_error *error)
+{
+    struct parse_job job = { .paths = paths, .count = count, .files = files };
+    pthread_t t[parallel_max_threads];
+    int nthreads = 0;
+    uint64_t t0;
+    int rc = -1;
+    int i;
+
+    if (!cf) {
+        errprintf (error, NULL, -1, "Out of memory");
+        errno = ENOMEM;
+        return -1;
+    }
+    if (!(job.tabs = calloc (count, sizeof (job.tabs[0])))
+        || !(job.errors = calloc (count, sizeof (job.errors[0])))
+        || !(job.errnums = calloc (count, sizeof (job.errnums[0])))) {
+        errprintf (error, NULL, -1, "Out of memory");
+        errno = ENOMEM;
+        goto done;
+    }
+    while (nthreads < parallel_max_threads && nthreads < count - 1
+           && pthread_create (&t[nthreads], NULL, parse_worker, &job) == 0)
+        nthreads++;
+    (void)parse_worker (&job);
+    for (i = 0; i < nthreads; i++)
+        (void)pthread_join (t[i], NULL);
+
+    for (i = 0; i < count; i++) {
+        if (!job.tabs[i]) {
+            errprintf (error, job.errors[i].filename, job.errors[i].lineno,
+                       "%s", job.errors[i].errbuf);
+            errno = job.errnums[i];
+            goto done;
+        }
+        t0 = files ? monotime_ns () : 0;
+        if (tomltk_table_update (cf, job.tabs[i]) < 0) {
+            errprintf (error, paths[i], -1, "converting TOML to JSON: %s",
+                       strerror (errno));
+            goto done;
+        }
+        if (files)
+            files[i].merge_ns = monotime_ns () - t0;
+    }
+    rc = 0;
+done:
+    if (job.tabs) {
+        int saved_errno = errno;
+        for (i = 0; i < count; i++)
+            toml_free (job.tabs[i]);
+        errno = saved_errno;
+    }
+    free (job.tabs);
+    free (job.errors);
+    free (job.errnums);
+    return rc;
+}
+
+void cf_stats_destroy (struct cf_stats *stats)
+{
+    if (stats) {
+        int saved_errno = errno;
+        int i;
+        for (i = 0; i < stats->count; i++)
+            free (stats->files[i].filename);
+        free (stats->files);
+        free (stats);
+        errno = saved_errno;
+    }
+}
+
+/* Allocate stats for the files in 'gl'.
+ */
+static struct cf_stats *stats_create (glob_t *gl, uint64_t glob_ns)
+{
+    struct cf_stats *stats;
+    size_t i;
+
+    if (!(stats = calloc (1, sizeof (*stats))))
+        return NULL;
+    stats->glob_ns = glob_ns;
+    if (gl->gl_pathc > 0) {
+        if (!(stats->files = calloc (gl->gl_pathc, sizeof (stats->files[0]))))
+            goto error;
+        for (i = 0; i < gl->gl_pathc; i++) {
+            if (!(stats->files[i].filename = strdup (gl->gl_pathv[i])))
+                goto error;
+            stats->count++;
+        }
+    }
+    return stats;
+error:
+    cf_stats_destroy (stats);
+    return NULL;
+}
+
+/* Update 'cf' from files matching 'pattern', as described for
+ * cf_update_glob().  If 'statsp' is non-NULL, record load statistics
+ * and on success, assign them to '*statsp'.
+ */
+static int update_glob (cf_t *cf, const char *pattern,
+                        struct cf_stats **statsp, struct cf_error *error)
 {
     cf_t *tmp;
     glob_t gl;
     size_t i;
     int count = -1;
     int errnum = 0;
+    uint64_t t = statsp ? monotime_ns () : 0;
     int rc = glob (pattern, GLOB_ERR, NULL, &gl);
+    struct cf_stats *stats = NULL;
 
     tmp = cf_create ();
 
+    if (statsp && (rc == 0 || rc == GLOB_NOMATCH)
+        && !(stats = stats_create (&gl, monotime_ns () - t))) {
+        errprintf (error, pattern, -1, "Out of memory");
+        errno = ENOMEM;
+        globfree (&gl);
+        cf_destroy (tmp);
+        return -1;
+    }
+
     switch (rc) {
         case 0:
             count = 0;
+            if (gl.gl_pathc >= parallel_min_files) {
+                /* 'tmp' is discarded on error, so update it in place.
+                 */
+                if (update_parallel (tmp, gl.gl_pathv, gl.gl_pathc,
+                                     stats ? stats->files : NULL,
+                                     error) < 0) {
+                    errnum = errno;
+                    count = -1;
+                }
+                else
+                    count = gl.gl_pathc;
+                break;
+            }
             for (i = 0; i < gl.gl_pathc; i++) {
-                if (cf_update_file (tmp, gl.gl_pathv[i], error) < 0) {
+                /* 'tmp' is discarded on error, so update it in place.
+                 */
+                if (update_object (tmp, gl.gl_pathv[i], NULL, 0, true,
+                                   stats ? &stats->files[i] : NULL,
+                                   error) < 0) {
                     errnum = errno;
                     count = -1;
                     break;
@@ -316,10 +612,327 @@ int cf_update_glob (cf_t *cf, const char *pattern, struct cf_error *error)
         count = -1;
     }
     cf_destroy (tmp);
+    if (statsp && count >= 0)
+        *statsp = stats;
+    else
+        cf_stats_destroy (stats);
     errno = errnum;
     return (count);
 }
 
+int cf_update_glob (cf_t *cf, const char *pattern, struct cf_error *error)
+{
+    return update_glob (cf, pattern, NULL, error);
+}
+
+int cf_update_glob_stats (cf_t *cf, const char *pattern,
+                          struct cf_stats **stats, struct cf_error *error)
+{
+    if (!stats) {
+        errprintf (error, pattern, -1, "invalid argument");
+        errno = EINVAL;
+        return -1;
+    }
+    return update_glob (cf, pattern, stats, error);
+}
+
+/* Config cache file format (JSON):
+ *   {"version":1, "pattern":s, "sources":[[path, size, ino, sec, nsec],...],
+ *    "config":o}
+ * where "sources" lists the files matching 'pattern' in glob(3) order,
+ * as they were when "config" was parsed from them.
+ */
+static const int cache_version = 1;
+
+int cf_cache_path (const char *pattern, char *buf, int size)
+{
+    const char *p;
+    int n;
+
+    if (!pattern || !buf || size <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    n = (p = strrchr (pattern, '/')) ? p - pattern + 1 : 0;
+    if (snprintf (buf, size, "%.*s.cf-cache", n, pattern) >= size) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    return 0;
+}
+
+/* Build the "sources" array for files matching 'pattern'.
+ * Return the number of files, or -1 on error (including no match).
+ */
+static int cache_sources (const char *pattern, json_t **sourcesp)
+{
+    json_t *sources;
+    glob_t gl;
+    size_t i;
+
+    if (glob (pattern, GLOB_ERR, NULL, &gl) != 0)
+        return -1;
+    if (!(sources = json_array ()))
+        goto error;
+    for (i = 0; i < gl.gl_pathc; i++) {
+        struct stat st;
+        json_t *o;
+
+        if (stat (gl.gl_pathv[i], &st) < 0
+            || !(o = json_pack ("[s,I,I,I,I]",
+                                gl.gl_pathv[i],
+                                (json_int_t)st.st_size,
+                                (json_int_t)st.st_ino,
+                                (json_int_t)st.st_mtim.tv_sec,
+                                (json_int_t)st.st_mtim.tv_nsec))
+            || json_array_append_new (sources, o) < 0)
+            goto error;
+    }
+    globfree (&gl);
+    *sourcesp = sources;
+    return i;
+error:
+    json_decref (sources);
+    globfree (&gl);
+    return -1;
+}
+
+/* Configs loaded through a trusted cache file are also kept in memory,
+ * keyed the same way, so repeated loads in one process (several contexts,
+ * reconfiguration) neither read nor parse anything.  Entries are replaced
+ * round robin.  Configs are copied in and out, so callers never share them.
+ */
+struct memcache_entry {
+    char *pattern;
+    json_t *sources;
+    json_t *config;
+};
+
+static pthread_mutex_t memcache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct memcache_entry memcache[MEMCACHE_SIZE]; // protected by lock
+static int memcache_next;
+
+static void memcache_entry_clear (struct memcache_entry *entry)
+{
+    free (entry->pattern);
+    json_decref (entry->sources);
+    json_decref (entry->config);
+    memset (entry, 0, sizeof (*entry));
+}
+
+/* Return a copy of the config cached for 'pattern' and 'sources', or NULL.
+ */
+static json_t *memcache_get (const char *pattern, const json_t *sources)
+{
+    json_t *config = NULL;
+    int i;
+
+    pthread_mutex_lock (&memcache_lock);
+    for (i = 0; i < MEMCACHE_SIZE; i++) {
+        if (memcache[i].pattern
+            && !strcmp (memcache[i].pattern, pattern)
+            && json_equal (memcache[i].sources, (json_t *)sources)) {
+            config = json_deep_copy (memcache[i].config);
+            break;
+        }
+    }
+    pthread_mutex_unlock (&memcache_lock);
+    return config;
+}
+
+/* Cache a copy of 'config', replacing any entry for 'pattern'.
+ * Errors are not reported, since the cache is only an optimization.
+ */
+static void memcache_put (const char *pattern,
+                          json_t *sources,
+                          const json_t *config)
+{
+    struct memcache_entry new = { 0 };
+    int i;
+
+    if (!(new.pattern = strdup (pattern))
+        || !(new.config = json_deep_copy (config))) {
+        memcache_entry_clear (&new);
+        return;
+    }
+    new.sources = json_incref (sources);
+    pthread_mutex_lock (&memcache_lock);
+    for (i = 0; i < MEMCACHE_SIZE; i++) {
+        if (memcache[i].pattern && !strcmp (memcache[i].pattern, pattern))
+            break;
+    }
+    if (i == MEMCACHE_SIZE) {
+        i = memcache_next;
+        memcache_next = (memcache_next + 1) % MEMCACHE_SIZE;
+    }
+    memcache_entry_clear (&memcache[i]);
+    memcache[i] = new;
+    pthread_mutex_unlock (&memcache_lock);
+}
+
+/* Only trust a cache that could not have been written by another user.
+ */
+static bool cache_is_trusted (const struct stat *st)
+{
+    if (!S_ISREG (st->st_mode))
+        return false;
+    if (st->st_uid != 0 && st->st_uid != geteuid ())
+        return false;
+    if ((st->st_mode & (S_IWGRP | S_IWOTH)))
+        return false;
+    return true;
+}
+
+/* Read 'cachefile' and return its config if it is valid for 'pattern'
+ * and matches 'sources'.  Otherwise return NULL, setting 'stale' to true
+ * if a trusted cache exists but is out of date.  If the cache is trusted
+ * and a matching config is in memory, the file is not read.
+ */
+static json_t *cache_read (const char *cachefile,
+                           const char *pattern,
+                           const json_t *sources,
+                           bool *stale)
+{
+    struct stat st;
+    json_t *o = NULL;
+    json_t *config;
+    json_t *cache_sources;
+    const char *cache_pattern;
+    int version;
+    char *buf = NULL;
+    int fd;
+
+    *stale = false;
+    if ((fd = open (cachefile, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+    if (fstat (fd, &st) < 0 || !cache_is_trusted (&st))
+        goto out;
+    if ((config = memcache_get (pattern, sources))) {
+        (void)close (fd);
+        return config;
+    }
+    if (!(buf = malloc (st.st_size + 1))
+        || read (fd, buf, st.st_size) != st.st_size)
+        goto out;
+    *stale = true;
+    if (!(o = json_loadb (buf, st.st_size, 0, NULL))
+        || json_unpack (o, "{s:i s:s s:o s:o}",
+                        "version", &version,
+                        "pattern", &cache_pattern,
+                        "sources", &cache_sources,
+                        "config", &config) < 0
+        || version != cache_version
+        || strcmp (cache_pattern, pattern) != 0
+        || !json_equal (cache_sources, (json_t *)sources)
+        || !json_is_object (config))
+        goto out;
+    *stale = false;
+    memcache_put (pattern, (json_t *)sources, config);
+    json_incref (config);
+    json_decref (o);
+    free (buf);
+    (void)close (fd);
+    return config;
+out:
+    json_decref (o);
+    free (buf);
+    (void)close (fd);
+    return NULL;
+}
+
+/* Replace 'cachefile' atomically.  Errors are not reported, since the
+ * cache is only an optimization.
+ */
+static void cache_write (const char *cachefile,
+                         const char *pattern,
+                         json_t *sources,
+                         json_t *config)
+{
+    char tmp[PATH_MAX + 1];
+    json_t *o;
+    FILE *fp = NULL;
+    int fd;
+
+    if (snprintf (tmp, sizeof (tmp), "%s.XXXXXX", cachefile) >= sizeof (tmp))
+        return;
+    if (!(o = json_pack ("{s:i s:s s:O s:O}",
+                         "version", cache_version,
+                         "pattern", pattern,
+                         "sources", sources,
+                         "config", config)))
+        return;
+    if ((fd = mkstemp (tmp)) < 0)
+        goto out;
+    if (fchmod (fd, 0644) < 0 || !(fp = fdopen (fd, "w"))) {
+        (void)close (fd);
+        goto out_unlink;
+    }
+    if (json_dumpf (o, fp, JSON_COMPACT) < 0
+        || fflush (fp) != 0
+        || fsync (fileno (fp)) < 0) {
+        (void)fclose (fp);
+        goto out_unlink;
+    }
+    if (fclose (fp) != 0 || rename (tmp, cachefile) < 0)
+        goto out_unlink;
+    json_decref (o);
+    return;
+out_unlink:
+    (void)unlink (tmp);
+out:
+    json_decref (o);
+}
+
+int cf_update_glob_cache (cf_t *cf, const char *pattern,
+                          const char *cachefile, struct cf_error *error)
+{
+    json_t *sources = NULL;
+    json_t *config;
+    cf_t *tmp;
+    bool stale;
+    int count;
+
+    if (!cf || json_typeof ((json_t *)cf) != JSON_OBJECT || !pattern
+        || !cachefile
+        || (count = cache_sources (pattern, &sources)) <= 0)
+        return cf_update_glob (cf, pattern, error);
+
+    if ((config = cache_read (cachefile, pattern, sources, &stale))) {
+        int rc = json_object_update (cf, config);
+        json_decref (config);
+        json_decref (sources);
+        if (rc < 0) {
+            errprintf (error, cachefile, -1,
+                       "updating JSON object: out of memory");
+            errno = ENOMEM;
+            return -1;
+        }
+        return count;
+    }
+    /* Parse the files, then refresh an existing cache that is stale.
+     */
+    if (!(tmp = cf_create ())) {
+        errprintf (error, pattern, -1, "Out of memory");
+        json_decref (sources);
+        return -1;
+    }
+    if ((count = cf_update_glob (tmp, pattern, error)) > 0) {
+        if (json_object_update (cf, tmp) < 0) {
+            errprintf (error, pattern, -1,
+                       "updating JSON object: out of memory");
+            errno = ENOMEM;
+            count = -1;
+        }
+        else if (stale) {
+            cache_write (cachefile, pattern, sources, tmp);
+            memcache_put (pattern, sources, tmp);
+        }
+    }
+    json_decref (sources);
+    cf_destroy (tmp);
+    return count;
+}
+
 static bool is_end_marker (struct cf_option opt)
 {
     const struct cf_option end = CF_OPTIONS_TABLE_END;
@@ -343,6 +956,8 @@ static const struct cf_option *find_option (const struct cf_option opts[],
 
 /* Make sure all keys in 'cf' are known in 'opts'.
  * If 'anytab' is true, keys representing tables need not be known.
+ * N.B. this is O(keys * options), so it is only called once
+ * count_unknown_keys() has found that an unknown key exists.
  */
 static int check_unknown_keys (const cf_t *cf,
                                const struct cf_option opts[], bool anytab,
@@ -370,50 +985,104 @@ static int check_unknown_keys (const cf_t *cf,
     return 0;
 }
 
-static int check_expected_keys (const cf_t *cf,
-                                const struct cf_option opts[],
-                                struct cf_error *error)
+/* Keys of 'cf' that are options, counted by lookup_options().
+ */
+struct option_count {
+    size_t keys;
+    size_t tables;
+};
+
+/* Return the number of keys in 'cf' that are not options, not counting
+ * tables if 'anytab' is true.  Option keys are distinct keys of 'cf', so
+ * this follows from the sizes alone, without matching key names.
+ */
+static size_t count_unknown_keys (const cf_t *cf,
+                                  const struct option_count *count,
+                                  bool anytab)
+{
+    size_t size = json_object_size ((json_t *)cf);
+    size_t tables = 0;
+
+    if (anytab) {
+        const char *key;
+        json_t *obj;
+
+        json_object_foreach ((json_t *)cf, key, obj) {
+            if (json_is_object (obj))
+                tables++;
+        }
+        return (size - tables) - (count->keys - count->tables);
+    }
+    return size - count->keys;
+}
+
+/* Look up each option in 'cf', storing its value in 'val' if non-NULL,
+ * and count the option keys that are present.  Return the index of the
+ * first option that is missing but required, or has the wrong type,
+ * or -1 if all are valid.
+ */
+static int lookup_options (const cf_t *cf,
+                           const struct cf_option opts[],
+                           const cf_t *val[],
+                           struct option_count *count)
 {
+    int bad = -1;
     int i;
 
     if (opts) {
         for (i = 0; !is_end_marker (opts[i]); i++) {
             json_t *obj = json_object_get (cf, opts[i].key);
 
-            if (!obj && opts[i].required) {
-                errprintf (error, NULL, -1, "'%s' must be set", opts[i].key);
-                errno = EINVAL;
-                return -1;
-            }
-            if (obj && cf_typeof (obj) != opts[i].type) {
-                errprintf (error, NULL, -1, "'%s' must be of type %s",
-                           opts[i].key, cf_typedesc (opts[i].type));
-                errno = EINVAL;
-                return -1;
+            if (val)
+                val[i] = obj;
+            if (obj) {
+                count->keys++;
+                if (json_is_object (obj))
+                    count->tables++;
             }
+            if (bad < 0 && ((!obj && opts[i].required)
+                            || (obj && cf_typeof (obj) != opts[i].type)))
+                bad = i;
         }
     }
-    return 0;
+    return bad;
 }
 
-int cf_check (const cf_t *cf,
-              const struct cf_option opts[], int flags,
-              struct cf_error *error)
+int cf_resolve (const cf_t *cf, const struct cf_option opts[], int flags,
+                const cf_t *val[], struct cf_error *error)
 {
+    struct option_count count = { 0, 0 };
+    int bad;
+
     if (!cf || json_typeof ((json_t *)cf) != JSON_OBJECT) {
         errprintf (error, NULL, -1, "invalid config object");
         errno = EINVAL;
         return -1;
     }
-    if ((flags & CF_STRICT)) {
-        if (check_unknown_keys (cf, opts, (flags & CF_ANYTAB), error) < 0)
-            return -1;
-    }
-    if (check_expected_keys (cf, opts, error) < 0)
+    bad = lookup_options (cf, opts, val, &count);
+    if ((flags & CF_STRICT)
+        && count_unknown_keys (cf, &count, (flags & CF_ANYTAB)) > 0
+        && check_unknown_keys (cf, opts, (flags & CF_ANYTAB), error) < 0)
+        return -1;
+    if (bad >= 0) {
+        if (!json_object_get (cf, opts[bad].key))
+            errprintf (error, NULL, -1, "'%s' must be set", opts[bad].key);
+        else
+            errprintf (error, NULL, -1, "'%s' must be of type %s",
+                       opts[bad].key, cf_typedesc (opts[bad].type));
+        errno = EINVAL;
         return -1;
+    }
     return 0;
 }
 
+int cf_check (const cf_t *cf,
+              const struct cf_option opts[], int flags,
+              struct cf_error *error)
+{
+    return cf_resolve (cf, opts, flags, NULL, error);
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
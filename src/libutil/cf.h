@@ -66,6 +66,11 @@ void cf_destroy (cf_t *cf);
  */
 cf_t *cf_copy (const cf_t *cf);
 
+/* Return true if 'a' and 'b' have the same type and value, comparing
+ * tables and arrays recursively, or if both are NULL.
+ */
+bool cf_equal (const cf_t *a, const cf_t *b);
+
 /* Get type of cf_t object.
  */
 enum cf_type cf_typeof (const cf_t *cf);
@@ -97,6 +102,26 @@ int cf_array_size (const cf_t *cf);
  */
 bool cf_array_contains (const cf_t *cf, const char *str);
 
+/* Create a set of the strings in array 'cf', so that membership in a long
+ * allow list can be tested without scanning it.  Strings are not copied,
+ * so the set is only valid as long as 'cf'.  Non-string elements are
+ * ignored, and a NULL or non-array 'cf' gives an empty set.
+ * Return NULL on failure with errno set.  Destroy with cf_set_destroy().
+ */
+typedef struct cf_set cf_set_t;
+
+cf_set_t *cf_set_create (const cf_t *cf);
+void cf_set_destroy (cf_set_t *set);
+
+/* Return true if set contains string str.
+ * Return false if set or str is NULL, or set doesn't contain str.
+ */
+bool cf_set_contains (const cf_set_t *set, const char *str);
+
+/* Get number of distinct strings in set.
+ */
+int cf_set_size (const cf_set_t *set);
+
 /* Update table 'cf' with info parsed from TOML 'buf' or 'filename'.
  * On success return 0.  On failure, return -1 with errno set.
  * If error is non-NULL, write error description there.
@@ -117,13 +142,73 @@ int cf_update_file (cf_t *cf, const char *filename, struct cf_error *error);
  */
 int cf_update_glob (cf_t *cf, const char *pattern, struct cf_error *error);
 
+/* Load statistics recorded by cf_update_glob_stats(), with one entry per
+ * file matching the pattern, in glob order.  Times are in nanoseconds.
+ * 'glob_ns' is the time spent expanding the pattern, 'parse_ns' the time
+ * spent reading and parsing a file, and 'merge_ns' the time spent
+ * converting it and merging it into the result.
+ */
+struct cf_file_stats {
+    char *filename;
+    int64_t size;
+    uint64_t parse_ns;
+    uint64_t merge_ns;
+};
+
+struct cf_stats {
+    uint64_t glob_ns;
+    int count;
+    struct cf_file_stats *files;
+};
+
+/* Same as cf_update_glob(), but on success also set '*stats' to load
+ * statistics, which the caller must free with cf_stats_destroy().
+ * Files are only timed if this is used, so cf_update_glob() pays nothing.
+ */
+int cf_update_glob_stats (cf_t *cf, const char *pattern,
+                          struct cf_stats **stats, struct cf_error *error);
+void cf_stats_destroy (struct cf_stats *stats);
+
+/* Same as cf_update_glob(), but take the parsed result from the cache file
+ * 'cachefile' when it is valid, so no TOML is parsed.  The cache is valid
+ * if it was written for 'pattern' from exactly the files that now match it
+ * (same paths, sizes, inodes, and modification times), and it is a regular
+ * file owned by root (or the effective uid) that is not writable by group
+ * or other.  Otherwise the files are parsed, and if a trusted cache file
+ * exists but is out of date, it is rewritten.  So caching is enabled by
+ * creating the cache file, e.g. an empty one.  While the cache file is
+ * trusted, the result is also kept in memory, so loading the same unchanged
+ * files again in this process does not read the cache file either.
+ * Problems with the cache are not errors.  Return values are as for
+ * cf_update_glob().
+ */
+int cf_update_glob_cache (cf_t *cf, const char *pattern,
+                          const char *cachefile, struct cf_error *error);
+
+/* Put the default cache file path for 'pattern' in 'buf' of size 'size':
+ * ".cf-cache" in the directory part of 'pattern'.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int cf_cache_path (const char *pattern, char *buf, int size);
+
 /* Apply 'opts' to table 'cf' according to flags.
+ * Keys in 'opts' must be unique.  Checking is linear in the number of
+ * options unless 'cf' has an unknown key.
  * On success return 0.  On failure, return -1 with errno set.
  * If error is non-NULL, write error description there.
  */
 int cf_check (const cf_t *cf, const struct cf_option opts[], int flags,
               struct cf_error *error);
 
+/* Same as cf_check(), but also store the value of each option in 'val',
+ * an array with a slot for each entry of 'opts' (excluding the end marker)
+ * in the same order, or NULL if the option is not set.  Values remain
+ * valid as long as 'cf'.  This lets callers resolve options once, when
+ * config is loaded, instead of looking keys up on each use.
+ */
+int cf_resolve (const cf_t *cf, const struct cf_option opts[], int flags,
+                const cf_t *val[], struct cf_error *error);
+
 #endif /* !_UTIL_CF_H */
 
 /*
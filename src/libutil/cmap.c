@@ -0,0 +1,386 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* cmap.c - concurrent read-mostly map
+ *
+ * The map is an open-addressed table of pointers to immutable entries.
+ * Writers, serialized by a mutex, publish new entries and tables with
+ * atomic stores, and replace removed entries with a tombstone so that
+ * probe sequences of other keys are not broken.
+ *
+ * Memory a reader may be using (a replaced or removed entry, or a table
+ * replaced by a larger one) is freed only after a grace period, as in
+ * sleepable RCU: each lookup increments a counter for the current phase
+ * (0 or 1) on entry and decrements it on exit.  To wait for lookups in
+ * progress, a writer flips the phase and waits for the counters of the
+ * old phase to drain, then does the same again for the other phase.
+ * A lookup may load the phase, then increment its counter much later,
+ * after other writers have flipped the phase, so draining only one phase
+ * could miss it.  Since both phases are drained after the update, and
+ * every access here is sequentially consistent, a lookup which the
+ * writer did not wait for incremented its counter after the writer
+ * looked at it, and therefore sees the writer's update.  Flipping before
+ * each drain keeps new lookups out of the phase being drained.
+ * Counters are spread over cache line sized slots by thread, so lookups
+ * in different threads do not write to the same cache line.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "cmap.h"
+
+#define CMAP_MIN_SIZE 16
+#define CMAP_READERS 64
+#define CMAP_CACHELINE 64
+
+struct cmap_entry {
+    unsigned int hash;
+    unsigned char data[];   // key, then value
+};
+
+struct cmap_table {
+    size_t size;            // power of 2
+    struct cmap_entry *slots[];
+};
+
+struct cmap_reader {
+    unsigned long count[2];
+    char pad[CMAP_CACHELINE - 2 * sizeof (unsigned long)];
+};
+
+struct cmap {
+    size_t keysz;
+    size_t valsz;
+    struct cmap_table *table;
+    struct cmap_reader *readers;
+    unsigned int phase;
+    int count;              // live entries
+    int tombs;              // tombstones in table
+    pthread_mutex_t lock;
+};
+
+/* Marks a removed entry.  Never dereferenced.
+ */
+static char tombstone_mark;
+#define TOMBSTONE ((struct cmap_entry *)&tombstone_mark)
+
+static int next_reader;
+static __thread int reader = -1;
+
+static struct cmap_reader *reader_get (struct cmap *map)
+{
+    if (reader < 0)
+        reader = __atomic_fetch_add (&next_reader, 1, __ATOMIC_RELAXED)
+                 % CMAP_READERS;
+    return &map->readers[reader];
+}
+
+static struct cmap_table *table_create (size_t size)
+{
+    struct cmap_table *t;
+
+    if (!(t = calloc (1, sizeof (*t) + size * sizeof (t->slots[0]))))
+        return NULL;
+    t->size = size;
+    return t;
+}
+
+/* Find 'key' in table 't'.  Safe in a lookup or with map->lock held.
+ * If 'freep' is non-NULL, set it to the first slot a new entry for 'key'
+ * could use (valid if 'key' is not found).
+ */
+static struct cmap_entry **table_find (struct cmap *map,
+                                       struct cmap_table *t,
+                                       const void *key,
+                                       unsigned int hash,
+                                       struct cmap_entry ***freep)
+{
+    size_t mask = t->size - 1;
+    size_t i = hash & mask;
+    struct cmap_entry **freeslot = NULL;
+
+    for (;;) {
+        struct cmap_entry *e = __atomic_load_n (&t->slots[i],
+                                                __ATOMIC_SEQ_CST);
+        if (!e) {
+            if (freep)
+                *freep = freeslot ? freeslot : &t->slots[i];
+            return NULL;
+        }
+        if (e == TOMBSTONE) {
+            if (!freeslot)
+                freeslot = &t->slots[i];
+        }
+        else if (e->hash == hash && !memcmp (e->data, key, map->keysz))
+            return &t->slots[i];
+        i = (i + 1) & mask;
+    }
+}
+
+/* Wait until lookups which may have seen the state before the last
+ * update have finished.  Call with map->lock held.
+ */
+static void cmap_synchronize (struct cmap *map)
+{
+    int flip;
+    int i;
+
+    for (flip = 0; flip < 2; flip++) {
+        unsigned int old = map->phase;
+
+        __atomic_store_n (&map->phase, old ^ 1, __ATOMIC_SEQ_CST);
+        for (i = 0; i < CMAP_READERS; i++) {
+            while (__atomic_load_n (&map->readers[i].count[old],
+                                    __ATOMIC_SEQ_CST) != 0)
+                sched_yield ();
+        }
+    }
+}
+
+/* Move entries to a new table with room for at least 'count' entries
+ * at 1/2 load, dropping tombstones.  Call with map->lock held.
+ */
+static int cmap_rebuild (struct cmap *map, int count)
+{
+    struct cmap_table *old = map->table;
+    struct cmap_table *t;
+    size_t size = CMAP_MIN_SIZE;
+    size_t i;
+
+    while (size < (size_t)count * 2)
+        size *= 2;
+    if (!(t = table_create (size)))
+        return -1;
+    for (i = 0; i < old->size; i++) {
+        struct cmap_entry *e = old->slots[i];
+        if (e && e != TOMBSTONE) {
+            size_t j = e->hash & (size - 1);
+            while (t->slots[j])
+                j = (j + 1) & (size - 1);
+            t->slots[j] = e;
+        }
+    }
+    __atomic_store_n (&map->table, t, __ATOMIC_SEQ_CST);
+    map->tombs = 0;
+    cmap_synchronize (map);
+    free (old);
+    return 0;
+}
+
+struct cmap *cmap_create (size_t keysz, size_t valsz)
+{
+    struct cmap *map;
+    void *readers;
+
+    if (keysz == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(map = calloc (1, sizeof (*map))))
+        return NULL;
+    map->keysz = keysz;
+    map->valsz = valsz;
+    if (!(map->table = table_create (CMAP_MIN_SIZE)))
+        goto error;
+    if ((errno = posix_memalign (&readers, CMAP_CACHELINE,
+                                 CMAP_READERS * sizeof (struct cmap_reader))))
+        goto error;
+    memset (readers, 0, CMAP_READERS * sizeof (struct cmap_reader));
+    map->readers = readers;
+    pthread_mutex_init (&map->lock, NULL);
+    return map;
+error:
+    free (map->table);
+    free (map);
+    return NULL;
+}
+
+void cmap_destroy (struct cmap *map)
+{
+    if (map) {
+        int saved_errno = errno;
+        size_t i;
+        for (i = 0; i < map->table->size; i++) {
+            if (map->table->slots[i] != TOMBSTONE)
+                free (map->table->slots[i]);
+        }
+        free (map->table);
+        free (map->readers);
+        pthread_mutex_destroy (&map->lock);
+        free (map);
+        errno = saved_errno;
+    }
+}
+
+int cmap_get (struct cmap *map, const void *key, void *val)
+{
+    struct cmap_reader *r;
+    struct cmap_table *t;
+    struct cmap_entry **slot;
+    unsigned int hash;
+    unsigned int phase;
+    int rc = -1;
+
+    if (!map || !key) {
+        errno = EINVAL;
+        return -1;
+    }
+    hash = hash_key_bytes (key, map->keysz);
+    r = reader_get (map);
+    phase = __atomic_load_n (&map->phase, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add (&r->count[phase], 1, __ATOMIC_SEQ_CST);
+
+    t = __atomic_load_n (&map->table, __ATOMIC_SEQ_CST);
+    if ((slot = table_find (map, t, key, hash, NULL))) {
+        struct cmap_entry *e = __atomic_load_n (slot, __ATOMIC_SEQ_CST);
+        if (e != TOMBSTONE) {
+            if (val)
+                memcpy (val, e->data + map->keysz, map->valsz);
+            rc = 0;
+        }
+    }
+
+    __atomic_fetch_sub (&r->count[phase], 1, __ATOMIC_SEQ_CST);
+    if (rc < 0)
+        errno = ENOENT;
+    return rc;
+}
+
+int cmap_put (struct cmap *map, const void *key, const void *val)
+{
+    struct cmap_entry *e;
+    struct cmap_entry *old;
+    struct cmap_entry **slot;
+    struct cmap_entry **freeslot;
+
+    if (!map || !key || (!val && map->valsz > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(e = malloc (sizeof (*e) + map->keysz + map->valsz)))
+        return -1;
+    e->hash = hash_key_bytes (key, map->keysz);
+    memcpy (e->data, key, map->keysz);
+    if (map->valsz > 0)
+        memcpy (e->data + map->keysz, val, map->valsz);
+
+    pthread_mutex_lock (&map->lock);
+    if ((slot = table_find (map, map->table, key, e->hash, &freeslot))) {
+        old = *slot;
+        __atomic_store_n (slot, e, __ATOMIC_SEQ_CST);
+        cmap_synchronize (map);
+        free (old);
+        pthread_mutex_unlock (&map->lock);
+        return 0;
+    }
+    /* Keep at least 1/4 of slots empty, so probes are short and end.
+     */
+    if ((size_t)(map->count + map->tombs + 1) * 4 > map->table->size * 3) {
+        if (cmap_rebuild (map, map->count + 1) < 0) {
+            pthread_mutex_unlock (&map->lock);
+            free (e);
+            return -1;
+        }
+        (void)table_find (map, map->table, key, e->hash, &freeslot);
+    }
+    if (*freeslot == TOMBSTONE)
+        map->tombs--;
+    __atomic_store_n (freeslot, e, __ATOMIC_SEQ_CST);
+    map->count++;
+    pthread_mutex_unlock (&map->lock);
+    return 0;
+}
+
+int cmap_remove (struct cmap *map, const void *key)
+{
+    struct cmap_entry **slot;
+    struct cmap_entry *old;
+
+    if (!map || !key) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&map->lock);
+    if (!(slot = table_find (map,
+                             map->table,
+                             key,
+                             hash_key_bytes (key, map->keysz),
+                             NULL))) {
+        pthread_mutex_unlock (&map->lock);
+        errno = ENOENT;
+        return -1;
+    }
+    old = *slot;
+    __atomic_store_n (slot, TOMBSTONE, __ATOMIC_SEQ_CST);
+    map->count--;
+    map->tombs++;
+    cmap_synchronize (map);
+    free (old);
+    pthread_mutex_unlock (&map->lock);
+    return 0;
+}
+
+int cmap_remove_if (struct cmap *map, cmap_match_f fn, void *arg)
+{
+    struct cmap_entry **removed;
+    struct cmap_table *t;
+    size_t i;
+    int n = 0;
+
+    if (!map || !fn) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock (&map->lock);
+    if (!(removed = calloc (map->count + 1, sizeof (removed[0])))) {
+        pthread_mutex_unlock (&map->lock);
+        return -1;
+    }
+    t = map->table;
+    for (i = 0; i < t->size; i++) {
+        struct cmap_entry *e = t->slots[i];
+        if (e && e != TOMBSTONE
+            && fn (e->data, e->data + map->keysz, arg)) {
+            __atomic_store_n (&t->slots[i], TOMBSTONE, __ATOMIC_SEQ_CST);
+            removed[n++] = e;
+        }
+    }
+    if (n > 0) {
+        map->count -= n;
+        map->tombs += n;
+        cmap_synchronize (map);
+    }
+    pthread_mutex_unlock (&map->lock);
+    for (i = 0; i < (size_t)n; i++)
+        free (removed[i]);
+    free (removed);
+    return n;
+}
+
+int cmap_count (struct cmap *map)
+{
+    if (!map) {
+        errno = EINVAL;
+        return -1;
+    }
+    return __atomic_load_n (&map->count, __ATOMIC_RELAXED);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,69 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _UTIL_CMAP_H
+#define _UTIL_CMAP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* cmap - concurrent read-mostly map with fixed size keys and values
+ *
+ * Lookups take no locks and may run in any number of threads while
+ * another thread updates the map.  Updates are serialized by a mutex,
+ * and wait for lookups in progress before memory they may be reading is
+ * freed, so they are much more expensive than lookups.  Use for caches
+ * which are read on every operation and updated occasionally.
+ *
+ * Keys and values are copied into and out of the map.
+ */
+
+struct cmap;
+
+/* Create a map with keys of 'keysz' bytes and values of 'valsz' bytes.
+ * Return NULL on failure with errno set.
+ */
+struct cmap *cmap_create (size_t keysz, size_t valsz);
+
+/* Destroy map.  No other thread may be using it.
+ */
+void cmap_destroy (struct cmap *map);
+
+/* Look up 'key' and copy its value to 'val' (may be NULL).
+ * Return 0 on success, -1 with errno = ENOENT if not found.
+ */
+int cmap_get (struct cmap *map, const void *key, void *val);
+
+/* Set 'key' to 'val', replacing any existing value.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int cmap_put (struct cmap *map, const void *key, const void *val);
+
+/* Remove 'key'.
+ * Return 0 on success, -1 with errno = ENOENT if not found.
+ */
+int cmap_remove (struct cmap *map, const void *key);
+
+/* Remove entries for which 'fn' returns true.  'fn' is called with the
+ * map locked and must not call other cmap functions on 'map'.
+ * Return the number removed, or -1 on failure with errno set.
+ */
+typedef bool (*cmap_match_f)(const void *key, const void *val, void *arg);
+int cmap_remove_if (struct cmap *map, cmap_match_f fn, void *arg);
+
+/* Return the number of entries in the map.
+ */
+int cmap_count (struct cmap *map);
+
+#endif /* !_UTIL_CMAP_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -37,86 +37,86 @@
 #  include "config.h"
 #endif /* HAVE_CONFIG_H */
 
-#include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/random.h>
 #include "hash.h"
 
-/* Disable thread safety */
-#define lsd_mutex_init(mutex)
-#define lsd_mutex_lock(mutex)
-#define lsd_mutex_unlock(mutex)
-#define lsd_mutex_destroy(mutex)
-
 
 /*****************************************************************************
  *  Constants
  *****************************************************************************/
 
-#define HASH_DEF_SIZE           1213
-#define HASH_NODE_ALLOC_NUM     1024
+#define HASH_MIN_SIZE           16
+/*
+ *  Minimum number of slots.  Tables grow as needed, so this is small.
+ */
+
+#define HASH_LOAD_NUM           3
+#define HASH_LOAD_DEN           4
+/*
+ *  The table is doubled when an insertion would leave it more than 3/4 full.
+ *  Since the load is always below 1, every probe sequence ends at an
+ *    empty slot.
+ */
 
 
 /*****************************************************************************
  *  Data Types
  *****************************************************************************/
 
-struct hash_node {
-    struct hash_node   *next;           /* next node in list                 */
+struct hash_slot {
     void               *data;           /* ptr to hashed item                */
     const void         *hkey;           /* ptr to hashed item's key          */
+    unsigned int        hval;           /* key_f() of hkey                   */
+    unsigned int        dist;           /* probe distance + 1, 0 if empty    */
 };
 
 struct hash {
     int                 count;          /* number of items in hash table     */
-    int                 size;           /* num slots allocated in hash table */
-    struct hash_node  **table;          /* hash table array of node ptrs     */
+    int                 size;           /* num slots, always a power of 2    */
+    struct hash_slot   *table;          /* open-addressed array of slots     */
     hash_cmp_f          cmp_f;          /* key comparison function           */
     hash_del_f          del_f;          /* item deletion function            */
     hash_key_f          key_f;          /* key hash function                 */
-#if WITH_PTHREADS
-    pthread_mutex_t     mutex;          /* mutex to protect access to hash   */
-#endif /* WITH_PTHREADS */
 };
+/*
+ *  Items are stored with Robin Hood linear probing: on insertion, an item
+ *    which has probed further than the occupant of a slot takes that slot,
+ *    and the occupant continues probing.  This bounds the variance of probe
+ *    lengths, and lets a lookup stop as soon as it reaches a slot whose
+ *    occupant is closer to home than the key being sought would be.
+ *    Removal shifts the following items of the run back by one slot, so
+ *    no tombstones are needed.  The key_f() value is stored with each item,
+ *    so that probing compares keys only when hash values match, and
+ *    resizing does not call key_f() again.
+ */
 
 
 /*****************************************************************************
  *  Prototypes
  *****************************************************************************/
 
-static struct hash_node * hash_node_alloc (void);
+static unsigned int hash_home (unsigned int hval, unsigned int mask);
 
-static void hash_node_free (struct hash_node *node);
+static struct hash_slot * hash_lookup (hash_t h, const void *key,
+    unsigned int hval);
 
+static void hash_place (struct hash_slot *table, int size,
+    struct hash_slot item);
 
-/*****************************************************************************
- *  Variables
- *****************************************************************************/
+static void hash_erase (hash_t h, unsigned int i);
 
-static struct hash_node *hash_mem_list = NULL;
-/*
- *  Singly-linked list for tracking memory allocations from hash_node_alloc()
- *    for eventual de-allocation via hash_drop_memory().  Each block allocation
- *    begins with a pointer for chaining these allocations together.  The block
- *    is broken up into individual hash_node structs and placed on the
- *    hash_free_list.
- */
-
-static struct hash_node *hash_free_list = NULL;
-/*
- *  Singly-linked list of hash_node structs available for use.  These are
- *    allocated via hash_node_alloc() in blocks of HASH_NODE_ALLOC_NUM.  This
- *    bulk approach uses less RAM and CPU than allocating/de-allocating objects
- *    individually as needed.
- */
+static int hash_resize (hash_t h, int size);
 
-#if WITH_PTHREADS
-static pthread_mutex_t hash_free_list_lock = PTHREAD_MUTEX_INITIALIZER;
-/*
- *  Mutex for protecting access to hash_mem_list and hash_free_list.
- */
-#endif /* WITH_PTHREADS */
+static int hash_start (hash_t h);
 
 
 /*****************************************************************************
@@ -127,27 +127,30 @@ hash_t
 hash_create (int size, hash_key_f key_f, hash_cmp_f cmp_f, hash_del_f del_f)
 {
     hash_t h;
+    int n = HASH_MIN_SIZE;
 
     if (!cmp_f || !key_f) {
         errno = EINVAL;
         return (NULL);
     }
-    if (size <= 0) {
-        size = HASH_DEF_SIZE;
+    /*  Treat [size] as a hint of the number of items to be stored.
+     */
+    while (n < INT_MAX / HASH_LOAD_DEN
+           && (long) n * HASH_LOAD_NUM < (long) size * HASH_LOAD_DEN) {
+        n *= 2;
     }
     if (!(h = malloc (sizeof (*h)))) {
         return (NULL);
     }
-    if (!(h->table = calloc (size, sizeof (struct hash_node *)))) {
+    if (!(h->table = calloc (n, sizeof (struct hash_slot)))) {
         free (h);
         return (NULL);
     }
     h->count = 0;
-    h->size = size;
+    h->size = n;
     h->cmp_f = cmp_f;
     h->del_f = del_f;
     h->key_f = key_f;
-    lsd_mutex_init (&h->mutex);
     return (h);
 }
 
@@ -155,24 +158,11 @@ hash_create (int size, hash_key_f key_f, hash_cmp_f cmp_f, hash_del_f del_f)
 void
 hash_destroy (hash_t h)
 {
-    int i;
-    struct hash_node *p, *q;
-
     if (!h) {
         errno = EINVAL;
         return;
     }
-    lsd_mutex_lock (&h->mutex);
-    for (i = 0; i < h->size; i++) {
-        for (p = h->table[i]; p != NULL; p = q) {
-            q = p->next;
-            if (h->del_f)
-                h->del_f (p->data);
-            hash_node_free (p);
-        }
-    }
-    lsd_mutex_unlock (&h->mutex);
-    lsd_mutex_destroy (&h->mutex);
+    hash_reset (h);
     free (h->table);
     free (h);
     return;
@@ -182,24 +172,17 @@ hash_destroy (hash_t h)
 void hash_reset (hash_t h)
 {
     int i;
-    struct hash_node *p, *q;
 
     if (!h) {
         errno = EINVAL;
         return;
     }
-    lsd_mutex_lock (&h->mutex);
     for (i = 0; i < h->size; i++) {
-        for (p = h->table[i]; p != NULL; p = q) {
-            q = p->next;
-            if (h->del_f)
-                h->del_f (p->data);
-            hash_node_free (p);
-        }
-        h->table[i] = NULL;
+        if (h->table[i].dist && h->del_f)
+            h->del_f (h->table[i].data);
     }
+    memset (h->table, 0, h->size * sizeof (struct hash_slot));
     h->count = 0;
-    lsd_mutex_unlock (&h->mutex);
     return;
 }
 
@@ -207,103 +190,70 @@ void hash_reset (hash_t h)
 int
 hash_is_empty (hash_t h)
 {
-    int n;
-
     if (!h) {
         errno = EINVAL;
         return (0);
     }
-    lsd_mutex_lock (&h->mutex);
-    n = h->count;
-    lsd_mutex_unlock (&h->mutex);
-    return (n == 0);
+    return (h->count == 0);
 }
 
 
 int
 hash_count (hash_t h)
 {
-    int n;
-
     if (!h) {
         errno = EINVAL;
         return (0);
     }
-    lsd_mutex_lock (&h->mutex);
-    n = h->count;
-    lsd_mutex_unlock (&h->mutex);
-    return (n);
+    return (h->count);
 }
 
 
 void *
 hash_find (hash_t h, const void *key)
 {
-    unsigned int slot;
-    int cmpval;
-    struct hash_node *p;
-    void *data = NULL;
+    struct hash_slot *p;
 
     if (!h || !key) {
         errno = EINVAL;
         return (NULL);
     }
     errno = 0;
-    lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (p = h->table[slot]; p != NULL; p = p->next) {
-        cmpval = h->cmp_f (p->hkey, key);
-        if (cmpval < 0) {
-            continue;
-        }
-        if (cmpval == 0) {
-            data = p->data;
-        }
-        break;
+    if (!(p = hash_lookup (h, key, h->key_f (key)))) {
+        return (NULL);
     }
-    lsd_mutex_unlock (&h->mutex);
-    return (data);
+    return (p->data);
 }
 
 
 void *
 hash_insert (hash_t h, const void *key, void *data)
 {
-    unsigned int slot;
-    int cmpval;
-    struct hash_node **pp;
-    struct hash_node *p;
+    struct hash_slot item;
 
     if (!h || !key || !data) {
         errno = EINVAL;
         return (NULL);
     }
-    lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (pp = &(h->table[slot]); (p = *pp) != NULL; pp = &(p->next)) {
-        cmpval = h->cmp_f (p->hkey, key);
-        if (cmpval < 0) {
-            continue;
-        }
-        if (cmpval == 0) {
-            errno = EEXIST;
-            data = NULL;
-            goto end;
-        }
-        break;
+    item.hval = h->key_f (key);
+    if (hash_lookup (h, key, item.hval)) {
+        errno = EEXIST;
+        return (NULL);
     }
-    if (!(p = hash_node_alloc ())) {
-        data = NULL;
-        goto end;
+    if ((long) (h->count + 1) * HASH_LOAD_DEN
+        > (long) h->size * HASH_LOAD_NUM) {
+        if (h->size > INT_MAX / 2) {
+            errno = ENOMEM;
+            return (NULL);
+        }
+        if (hash_resize (h, h->size * 2) < 0)
+            return (NULL);
     }
-    p->hkey = key;
-    p->data = data;
-    p->next = *pp;
-    *pp = p;
+    item.data = data;
+    item.hkey = key;
+    item.dist = 1;
+    hash_place (h->table, h->size, item);
     h->count++;
-
-end:
-    lsd_mutex_unlock (&h->mutex);
     return (data);
 }
 
@@ -311,33 +261,19 @@ end:
 void *
 hash_remove (hash_t h, const void *key)
 {
-    unsigned int slot;
-    int cmpval;
-    struct hash_node **pp;
-    struct hash_node *p;
-    void *data = NULL;
+    struct hash_slot *p;
+    void *data;
 
     if (!h || !key) {
         errno = EINVAL;
         return (NULL);
     }
     errno = 0;
-    lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (pp = &(h->table[slot]); (p = *pp) != NULL; pp = &(p->next)) {
-        cmpval = h->cmp_f (p->hkey, key);
-        if (cmpval < 0) {
-            continue;
-        }
-        if (cmpval == 0) {
-            data = p->data;
-            *pp = p->next;
-            hash_node_free (p);
-            h->count--;
-        }
-        break;
+    if (!(p = hash_lookup (h, key, h->key_f (key)))) {
+        return (NULL);
     }
-    lsd_mutex_unlock (&h->mutex);
+    data = p->data;
+    hash_erase (h, p - h->table);
     return (data);
 }
 
@@ -346,32 +282,31 @@ int
 hash_delete_if (hash_t h, hash_arg_f arg_f, void *arg)
 {
     int i;
-    struct hash_node **pp;
-    struct hash_node *p;
+    int k;
     int n = 0;
 
     if (!h || !arg_f) {
         errno = EINVAL;
         return (-1);
     }
-    lsd_mutex_lock (&h->mutex);
-    for (i = 0; i < h->size; i++) {
-        pp = &(h->table[i]);
-        while ((p = *pp) != NULL) {
-            if (arg_f (p->data, p->hkey, arg) > 0) {
-                if (h->del_f)
-                    h->del_f (p->data);
-                *pp = p->next;
-                hash_node_free (p);
-                h->count--;
-                n++;
-            }
-            else {
-                pp = &(p->next);
-            }
+    /*  Visit slots from the start of a run, so items shifted back by
+     *    hash_erase() always come from slots not yet visited.  After a
+     *    deletion, the same slot is visited again for the shifted item.
+     */
+    i = hash_start (h);
+    for (k = 0; k < h->size; ) {
+        struct hash_slot *p = &h->table[i];
+        if (p->dist && arg_f (p->data, p->hkey, arg) > 0) {
+            if (h->del_f)
+                h->del_f (p->data);
+            hash_erase (h, i);
+            n++;
+            if (p->dist)
+                continue;
         }
+        i = (i + 1) & (h->size - 1);
+        k++;
     }
-    lsd_mutex_unlock (&h->mutex);
     return (n);
 }
 
@@ -380,22 +315,18 @@ int
 hash_for_each (hash_t h, hash_arg_f arg_f, void *arg)
 {
     int i;
-    struct hash_node *p;
     int n = 0;
 
     if (!h || !arg_f) {
         errno = EINVAL;
         return (-1);
     }
-    lsd_mutex_lock (&h->mutex);
     for (i = 0; i < h->size; i++) {
-        for (p = h->table[i]; p != NULL; p = p->next) {
-            if (arg_f (p->data, p->hkey, arg) > 0) {
-                n++;
-            }
+        struct hash_slot *p = &h->table[i];
+        if (p->dist && arg_f (p->data, p->hkey, arg) > 0) {
+            n++;
         }
     }
-    lsd_mutex_unlock (&h->mutex);
     return (n);
 }
 
@@ -403,16 +334,9 @@ hash_for_each (hash_t h, hash_arg_f arg_f, void *arg)
 void
 hash_drop_memory (void)
 {
-    struct hash_node *p;
-
-    lsd_mutex_lock (&hash_free_list_lock);
-    while (hash_mem_list != NULL) {
-        p = hash_mem_list;
-        hash_mem_list = p->next;
-        free (p);
-    }
-    hash_free_list = NULL;
-    lsd_mutex_unlock (&hash_free_list_lock);
+/*  Items are stored in per-table arrays, so there is no shared memory
+ *    to free.  Retained for compatibility.
+ */
     return;
 }
 
@@ -421,17 +345,91 @@ hash_drop_memory (void)
  *  Hash Functions
  *****************************************************************************/
 
-unsigned int
-hash_key_string (const char *str)
+static uint64_t hash_seed[2];
+static pthread_once_t hash_seed_once = PTHREAD_ONCE_INIT;
+
+static void
+hash_seed_init (void)
 {
-    unsigned char *p;
-    unsigned int hval = 0;
-    const unsigned int multiplier = 31;
+/*  Seed hash_key_string() randomly for each process, so that sets of keys
+ *    which collide cannot be chosen in advance to degrade a table.
+ */
+    if (getrandom (hash_seed, sizeof (hash_seed), GRND_NONBLOCK)
+        != sizeof (hash_seed)) {
+        struct timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        hash_seed[0] = ((uint64_t) ts.tv_sec << 32) ^ ts.tv_nsec;
+        hash_seed[1] = ((uint64_t) getpid () << 32)
+                     ^ (uint64_t) (uintptr_t) &ts;
+    }
+    return;
+}
+
+#define ROTL64(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                            \
+    do {                                                                    \
+        v0 += v1; v1 = ROTL64 (v1, 13); v1 ^= v0; v0 = ROTL64 (v0, 32);    \
+        v2 += v3; v3 = ROTL64 (v3, 16); v3 ^= v2;                           \
+        v0 += v3; v3 = ROTL64 (v3, 21); v3 ^= v0;                           \
+        v2 += v1; v1 = ROTL64 (v1, 17); v1 ^= v2; v2 = ROTL64 (v2, 32);    \
+    } while (0)
 
-    for (p = (unsigned char *) str; *p != '\0'; p++) {
-        hval += (multiplier * hval) + *p;
+static uint64_t
+siphash13 (const uint64_t key[2], const unsigned char *in, size_t len)
+{
+/*  SipHash-1-3: one compression round per 8 byte block and three
+ *    finalization rounds.
+ */
+    uint64_t v0 = UINT64_C (0x736f6d6570736575) ^ key[0];
+    uint64_t v1 = UINT64_C (0x646f72616e646f6d) ^ key[1];
+    uint64_t v2 = UINT64_C (0x6c7967656e657261) ^ key[0];
+    uint64_t v3 = UINT64_C (0x7465646279746573) ^ key[1];
+    uint64_t b = (uint64_t) len << 56;
+    const unsigned char *end = in + (len & ~(size_t) 7);
+    uint64_t m;
+
+    for (; in != end; in += 8) {
+        memcpy (&m, in, sizeof (m));
+        m = le64toh (m);
+        v3 ^= m;
+        SIPROUND;
+        v0 ^= m;
+    }
+    switch (len & 7) {
+        case 7: b |= (uint64_t) in[6] << 48;    /* fall through */
+        case 6: b |= (uint64_t) in[5] << 40;    /* fall through */
+        case 5: b |= (uint64_t) in[4] << 32;    /* fall through */
+        case 4: b |= (uint64_t) in[3] << 24;    /* fall through */
+        case 3: b |= (uint64_t) in[2] << 16;    /* fall through */
+        case 2: b |= (uint64_t) in[1] << 8;     /* fall through */
+        case 1: b |= (uint64_t) in[0];          /* fall through */
+        case 0: break;
     }
-    return (hval);
+    v3 ^= b;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return (v0 ^ v1 ^ v2 ^ v3);
+}
+
+unsigned int
+hash_key_bytes (const void *buf, size_t len)
+{
+    uint64_t hval;
+
+    pthread_once (&hash_seed_once, hash_seed_init);
+    hval = siphash13 (hash_seed, buf, len);
+    return ((unsigned int) (hval ^ (hval >> 32)));
+}
+
+unsigned int
+hash_key_string (const char *str)
+{
+    return (hash_key_bytes (str, strlen (str)));
 }
 
 
@@ -439,57 +437,131 @@ hash_key_string (const char *str)
  *  Internal Functions
  *****************************************************************************/
 
-static struct hash_node *
-hash_node_alloc (void)
+static unsigned int
+hash_home (unsigned int hval, unsigned int mask)
 {
-/*  Allocates a hash node from the freelist.
- *  Returns a ptr to the object, or NULL if memory allocation fails.
+/*  Returns the preferred slot for an item with hash value [hval].
+ *  The value is mixed first since key_f() need not distribute its low
+ *    bits well (e.g. a hash of pointers).
  */
-    size_t size;
-    struct hash_node *p;
-    int i;
+    hval ^= hval >> 16;
+    hval *= 0x85ebca6b;
+    hval ^= hval >> 13;
+    hval *= 0xc2b2ae35;
+    hval ^= hval >> 16;
+    return (hval & mask);
+}
 
-    assert (HASH_NODE_ALLOC_NUM > 0);
-    lsd_mutex_lock (&hash_free_list_lock);
 
-    if (!hash_free_list) {
-        size = sizeof (p) + (HASH_NODE_ALLOC_NUM * sizeof (*p));
-        p = malloc (size);
+static struct hash_slot *
+hash_lookup (hash_t h, const void *key, unsigned int hval)
+{
+/*  Returns the slot holding [key], or NULL if it is not in the table.
+ */
+    unsigned int mask = h->size - 1;
+    unsigned int i = hash_home (hval, mask);
+    unsigned int dist = 1;
+
+    for (;;) {
+        struct hash_slot *p = &h->table[i];
+        if (p->dist < dist) {
+            return (NULL);
+        }
+        if (p->hval == hval && h->cmp_f (p->hkey, key) == 0) {
+            return (p);
+        }
+        i = (i + 1) & mask;
+        dist++;
+    }
+}
 
-        if (p != NULL) {
-            p->next = hash_mem_list;
-            hash_mem_list = p;
-            hash_free_list = (struct hash_node *)
-                    ((unsigned char *) p + sizeof (p));
 
-            for (i = 0; i < HASH_NODE_ALLOC_NUM - 1; i++) {
-                hash_free_list[i].next = &hash_free_list[i+1];
-            }
-            hash_free_list[i].next = NULL;
+static void
+hash_place (struct hash_slot *table, int size, struct hash_slot item)
+{
+/*  Places [item], which is not already present, into [table] of [size]
+ *    slots, displacing items closer to their home slot as it goes.
+ */
+    struct hash_slot tmp;
+    unsigned int mask = size - 1;
+    unsigned int i = hash_home (item.hval, mask);
+
+    for (;;) {
+        if (table[i].dist == 0) {
+            table[i] = item;
+            return;
         }
+        if (table[i].dist < item.dist) {
+            tmp = table[i];
+            table[i] = item;
+            item = tmp;
+        }
+        i = (i + 1) & mask;
+        item.dist++;
     }
-    if (hash_free_list) {
-        p = hash_free_list;
-        hash_free_list = p->next;
-        memset (p, 0, sizeof (*p));
+}
+
+
+static void
+hash_erase (hash_t h, unsigned int i)
+{
+/*  Removes the item in slot [i], shifting back any following items
+ *    which are not in their home slot.
+ */
+    unsigned int mask = h->size - 1;
+    unsigned int next = (i + 1) & mask;
+
+    while (h->table[next].dist > 1) {
+        h->table[i] = h->table[next];
+        h->table[i].dist--;
+        i = next;
+        next = (next + 1) & mask;
     }
-    else {
+    memset (&h->table[i], 0, sizeof (struct hash_slot));
+    h->count--;
+    return;
+}
+
+
+static int
+hash_resize (hash_t h, int size)
+{
+/*  Moves all items to a new table of [size] slots.
+ *  Returns 0 on success, or -1 with errno=ENOMEM.
+ */
+    struct hash_slot *table;
+    int i;
+
+    if (!(table = calloc (size, sizeof (struct hash_slot)))) {
         errno = ENOMEM;
+        return (-1);
     }
-    lsd_mutex_unlock (&hash_free_list_lock);
-    return (p);
+    for (i = 0; i < h->size; i++) {
+        if (h->table[i].dist) {
+            struct hash_slot item = h->table[i];
+            item.dist = 1;
+            hash_place (table, size, item);
+        }
+    }
+    free (h->table);
+    h->table = table;
+    h->size = size;
+    return (0);
 }
 
 
-static void
-hash_node_free (struct hash_node *node)
+static int
+hash_start (hash_t h)
 {
-/*  De-allocates the object [node], returning it to the freelist.
+/*  Returns the index of a slot which is empty or holds an item in its
+ *    home slot, i.e. the start of a run.  One exists since the table is
+ *    never full.
  */
-    assert (node != NULL);
-    lsd_mutex_lock (&hash_free_list_lock);
-    node->next = hash_free_list;
-    hash_free_list = node;
-    lsd_mutex_unlock (&hash_free_list_lock);
-    return;
+    int i;
+
+    for (i = 0; i < h->size; i++) {
+        if (h->table[i].dist <= 1)
+            break;
+    }
+    return (i);
 }
@@ -36,6 +36,8 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stddef.h>
+
 
 /*****************************************************************************
  *  Notes
@@ -44,7 +46,11 @@
  *  If an item's key is modified after insertion, the hash will be unable to
  *  locate it if the new key should hash to a different slot in the table.
  *
- *  If WITH_PTHREADS is defined, these routines will be thread-safe.
+ *  These routines are not thread-safe.
+ *
+ *  The table grows as items are inserted, so the [size] given to
+ *    hash_create() is only a hint.  Iteration order is unspecified and
+ *    differs between processes, since hash_key_string() is randomly seeded.
  */
 
 
@@ -96,9 +102,8 @@ hash_t hash_create (int size,
  *  Creates and returns a new hash table on success.
  *    Returns lsd_nomem_error() with errno=ENOMEM if memory allocation fails.
  *    Returns NULL with errno=EINVAL if [keyf] or [cmpf] is not specified.
- *  The [size] is the number of slots in the table; a larger table requires
- *    more memory, but generally provide quicker access times.  If set <= 0,
- *    the default size is used.
+ *  The [size] is the number of items expected; the table is sized to hold
+ *    them without growing.  If set <= 0, a small default size is used.
  *  The [keyf] function converts a key into a hash value.
  *  The [cmpf] function determines whether two keys are equal.
  *  The [delf] function de-allocates memory used by items in the hash;
@@ -176,16 +181,19 @@ int hash_for_each (hash_t h, hash_arg_f argf, void *arg);
 
 unsigned int hash_key_string (const char *str);
 /*
- *  A hash_key_f function that hashes the string [str].
+ *  A hash_key_f function that hashes the string [str] with SipHash-1-3,
+ *    using a key chosen randomly for each process.
+ */
+
+unsigned int hash_key_bytes (const void *buf, size_t len);
+/*
+ *  Hashes [len] bytes at [buf] as hash_key_string() hashes a string.
  */
 
 void hash_drop_memory (void);
 /*
- *  Frees memory that has been internally allocated.  No reference counting is
- *    performed to determine whether memory regions are still in use.
- *  This may be useful for explicitly de-allocating memory before program
- *    termination when checking for memory leaks.
- *  WARNING: Do not call this routine until ALL hashes have been destroyed.
+ *  Does nothing: each table's memory is freed by hash_destroy().
+ *  Retained for compatibility.
  */
 
 
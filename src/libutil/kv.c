@@ -23,26 +23,187 @@
 #include <assert.h>
 
 #include "timestamp.h"
+#include "hash.h"
 #include "kv.h"
 
-#define KV_CHUNK 4096
+/* Minimum buffer size.  Small, since headers are small and many objects,
+ * e.g. the reused headers of each context, are long lived.
+ */
+#define KV_CHUNK 256
+
+/* Objects with at least this many entries get a key index.
+ */
+#define KV_INDEX_MIN 16
+
+/* Type hints of binary encoded values: eight bytes, big-endian.
+ */
+#define KV_INT64_BINARY     'I'
+#define KV_DOUBLE_BINARY    'D'
+#define KV_TIMESTAMP_BINARY 'T'
+#define KV_BINARY_SIZE      8
 
 struct kv {
     char *buf;
     int bufsz;
     int len;
+    int count;          // number of entries
+    int *index;         // open addressing table of entry offset + 1, or NULL
+    int indexsz;        // power of 2, at least twice 'count'
+    bool dups;          // some key occurs more than once (index has first)
+    enum kv_encoding encoding;  // of numbers added by kv_put()
 };
 
 void kv_destroy (struct kv *kv)
 {
     if (kv) {
         int saved_errno = errno;
+        free (kv->index);
         free (kv->buf);
         free (kv);
         errno = saved_errno;
     }
 }
 
+/* Keys may come from untrusted input, e.g. a J header, so use a randomly
+ * seeded hash, for which colliding keys cannot be chosen in advance.
+ */
+static unsigned int key_hash (const char *key)
+{
+    return hash_key_string (key);
+}
+
+/* Only the first occurrence of a key is indexed, since that is the one
+ * a lookup returns.  Indexing duplicates too would pile them into one
+ * probe sequence, making decode of input with many copies of a key
+ * quadratic.
+ */
+static void index_insert (struct kv *kv, int offset)
+{
+    unsigned int mask = kv->indexsz - 1;
+    const char *key = kv->buf + offset;
+    unsigned int i = key_hash (key) & mask;
+
+    while (kv->index[i] != 0) {
+        if (!strcmp (key, kv->buf + kv->index[i] - 1)) {
+            kv->dups = true;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    kv->index[i] = offset + 1;
+}
+
+static void index_drop (struct kv *kv)
+{
+    free (kv->index);
+    kv->index = NULL;
+    kv->indexsz = 0;
+}
+
+/* Build the key index of 'kv' from scratch, given a valid 'count'.
+ * The index is optional: lookups fall back to a scan without it, so
+ * allocation failure here is not an error.
+ */
+static void index_build (struct kv *kv)
+{
+    struct kv_iter it;
+    int size = 32;
+
+    if (kv->count < KV_INDEX_MIN) {
+        index_drop (kv);
+        return;
+    }
+    while (size < kv->count * 2)
+        size *= 2;
+    if (size != kv->indexsz) {
+        index_drop (kv);
+        if (!(kv->index = calloc (size, sizeof (kv->index[0]))))
+            return;
+        kv->indexsz = size;
+    }
+    else
+        memset (kv->index, 0, size * sizeof (kv->index[0]));
+    kv->dups = false;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it))
+        index_insert (kv, it.key - kv->buf);
+}
+
+/* (Re-)build the key index of 'kv' from scratch, recounting entries.
+ */
+static void index_rebuild (struct kv *kv)
+{
+    struct kv_iter it;
+
+    kv->count = 0;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it))
+        kv->count++;
+    index_build (kv);
+}
+
+/* Account for a new entry at 'offset', which was appended to the buffer.
+ */
+static void index_add (struct kv *kv, int offset)
+{
+    kv->count++;
+    if (kv->index && kv->count * 2 <= kv->indexsz)
+        index_insert (kv, offset);
+    else if (kv->index || kv->count >= KV_INDEX_MIN)
+        index_rebuild (kv);
+}
+
+/* Remove the index slot of the entry at 'offset', which is about to be
+ * deleted, shifting later slots in its probe sequence back, so no
+ * tombstone is needed.  Call before the entry is overwritten.
+ */
+static void index_remove (struct kv *kv, int offset)
+{
+    unsigned int mask = kv->indexsz - 1;
+    unsigned int i = key_hash (kv->buf + offset) & mask;
+    unsigned int j;
+
+    while (kv->index[i] != offset + 1)
+        i = (i + 1) & mask;
+    for (j = (i + 1) & mask; kv->index[j] != 0; j = (j + 1) & mask) {
+        unsigned int k = key_hash (kv->buf + kv->index[j] - 1) & mask;
+        /* The entry at j may fill slot i unless its home slot k lies
+         * cyclically in (i, j].
+         */
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            kv->index[i] = kv->index[j];
+            i = j;
+        }
+    }
+    kv->index[i] = 0;
+}
+
+/* Entries after 'offset' moved down by 'len' bytes.  Fix their offsets.
+ */
+static void index_shift (struct kv *kv, int offset, int len)
+{
+    int i;
+
+    for (i = 0; i < kv->indexsz; i++) {
+        if (kv->index[i] > offset + 1)
+            kv->index[i] -= len;
+    }
+}
+
+static const char *index_lookup (const struct kv *kv, const char *key)
+{
+    unsigned int mask = kv->indexsz - 1;
+    unsigned int i = key_hash (key) & mask;
+
+    while (kv->index[i] != 0) {
+        const char *entry = kv->buf + kv->index[i] - 1;
+        if (!strcmp (key, entry))
+            return entry;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
 /* Create kv object from 'buf' and 'len'.
  * If len == 0, create an empty object.
  * Returns object on success, NULL on failure with errno set.
@@ -75,11 +236,17 @@ struct kv *kv_create (void)
 
 struct kv *kv_copy (const struct kv *kv)
 {
+    struct kv *cpy;
+
     if (!kv) {
         errno = EINVAL;
         return NULL;
     }
-    return kv_create_from (kv->buf, kv->len);
+    if (!(cpy = kv_create_from (kv->buf, kv->len)))
+        return NULL;
+    cpy->encoding = kv->encoding;
+    index_rebuild (cpy);
+    return cpy;
 }
 
 bool kv_equal (const struct kv *kv1, const struct kv *kv2)
@@ -93,18 +260,74 @@ bool kv_equal (const struct kv *kv1, const struct kv *kv2)
     return true;
 }
 
-/* Grow kv buffer until it can accommodate 'needsz' new characters.
+static int kv_resize (struct kv *kv, int newsz)
+{
+    char *new;
+
+    if (!(new = realloc (kv->buf, newsz)))
+        return -1;
+    kv->buf = new;
+    kv->bufsz = newsz;
+    return 0;
+}
+
+/* Grow kv buffer so it can accommodate 'needsz' new characters, at least
+ * doubling its size (from a minimum of KV_CHUNK) so that a series of
+ * appends is linear overall.
  * Returns 0 on success, -1 on failure with errno set.
  */
 static int kv_expand (struct kv *kv, int needsz)
 {
-    char *new;
-    while (kv->bufsz - kv->len < needsz) {
-        if (!(new = realloc (kv->buf, kv->bufsz + KV_CHUNK)))
-            return -1;
-        kv->buf = new;
-        kv->bufsz += KV_CHUNK;
+    int newsz;
+
+    if (kv->bufsz - kv->len >= needsz)
+        return 0;
+    newsz = kv->bufsz < KV_CHUNK ? KV_CHUNK : kv->bufsz * 2;
+    if (newsz < kv->len + needsz)
+        newsz = kv->len + needsz;
+    return kv_resize (kv, newsz);
+}
+
+int kv_set_encoding (struct kv *kv, enum kv_encoding encoding)
+{
+    if (!kv || (encoding != KV_ENCODING_TEXT
+                && encoding != KV_ENCODING_BINARY)) {
+        errno = EINVAL;
+        return -1;
     }
+    kv->encoding = encoding;
+    return 0;
+}
+
+int kv_reserve (struct kv *kv, int needsz)
+{
+    if (!kv || needsz < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (kv->bufsz - kv->len >= needsz)
+        return 0;
+    return kv_resize (kv, kv->len + needsz);
+}
+
+int kv_copy_into (struct kv *dst, const struct kv *src)
+{
+    if (!dst || !src || dst == src) {
+        errno = EINVAL;
+        return -1;
+    }
+    dst->len = 0;
+    if (dst->bufsz < src->len && kv_resize (dst, src->len) < 0) {
+        index_drop (dst);
+        dst->count = 0;
+        return -1;
+    }
+    if (src->len > 0)
+        memcpy (dst->buf, src->buf, src->len);
+    dst->len = src->len;
+    dst->count = src->count;
+    dst->encoding = src->encoding;
+    index_build (dst);
     return 0;
 }
 
@@ -122,15 +345,26 @@ static const char *kv_find (const struct kv *kv, const char *key,
                             enum kv_type type)
 {
     const char *entry = NULL;
+    struct kv_iter it;
+    int keylen;
 
     if (!kv || !valid_key (key)) {
         errno = EINVAL;
         return NULL;
     }
-    while ((entry = kv_next (kv, entry))) {
-        if (!strcmp (key, entry)) {
-            if (type == KV_UNKNOWN || kv_typeof (entry) == type)
-                return entry;
+    if (kv->index) {
+        if ((entry = index_lookup (kv, key))
+            && (type == KV_UNKNOWN || kv_typeof (entry) == type))
+            return entry;
+        errno = ENOENT;
+        return NULL;
+    }
+    keylen = strlen (key);
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        if (it.keylen == keylen && !memcmp (key, it.key, keylen)) {
+            if (type == KV_UNKNOWN || it.type == type)
+                return it.key;
             break;
         }
     }
@@ -138,6 +372,13 @@ static const char *kv_find (const struct kv *kv, const char *key,
     return NULL;
 }
 
+static bool is_binary_hint (char hint)
+{
+    return hint == KV_INT64_BINARY
+        || hint == KV_DOUBLE_BINARY
+        || hint == KV_TIMESTAMP_BINARY;
+}
+
 /* Return length, not to exceed maxlen, of entry consisting of key\0Tvalue\0
  * Return -1 on invalid entry.
  */
@@ -151,6 +392,14 @@ static int entry_length (const char *entry, int maxlen)
         return -1;
     entry += keylen + 1;
     maxlen -= keylen + 1;
+    /* A binary value may contain NULs, so its fixed size is used.
+     */
+    if (maxlen > 0 && is_binary_hint (entry[0])) {
+        vallen = 1 + KV_BINARY_SIZE;
+        if (vallen >= maxlen || entry[vallen] != '\0')
+            return -1;
+        return keylen + vallen + 2;
+    }
     vallen = strnlen (entry, maxlen);
     if (vallen == 0 || vallen == maxlen)
         return -1;
@@ -162,64 +411,148 @@ int kv_delete (struct kv *kv, const char *key)
     const char *entry;
     int entry_offset;
     int entry_len;
+    int next_offset = -1;
 
     if (!(entry = kv_find (kv, key, KV_UNKNOWN)))
         return -1;
     entry_offset = entry - kv->buf;
     entry_len = entry_length (entry, kv->len - entry_offset);
     assert (entry_len >= 0);
+    if (kv->index) {
+        index_remove (kv, entry_offset);
+        /* A later duplicate of the key, if any, now gets the index slot.
+         */
+        if (kv->dups) {
+            struct kv_iter it;
+
+            kv_iter_init (&it);
+            it.offset = entry_offset + entry_len;
+            while (kv_iter_next (kv, &it)) {
+                if (!strcmp (entry, it.key)) {
+                    next_offset = it.key - kv->buf - entry_len;
+                    break;
+                }
+            }
+        }
+    }
     memmove (kv->buf + entry_offset,
              kv->buf + entry_offset + entry_len,
              kv->len - entry_offset - entry_len);
     kv->len -= entry_len;
+    /* Later entries moved, so adjust their offsets in the index rather
+     * than rehashing every key.
+     */
+    if (kv->index) {
+        index_shift (kv, entry_offset, entry_len);
+        if (next_offset >= 0)
+            index_insert (kv, next_offset);
+    }
+    kv->count--;
     return 0;
 }
 
-/* Put 'val' of a given type that has been already been converted to a string.
+/* Append 'val' of length 'vallen' that has already been encoded for type
+ * hint 'hint', without checking whether 'key' is already present.
  * Returns 0 on success, -1 on failure with errno set.
  */
-static int kv_put_raw (struct kv *kv, const char *key, enum kv_type type,
-                       const char *val)
+static int kv_append_raw (struct kv *kv, const char *key, char hint,
+                          const char *val, int vallen)
 {
     if (!kv || !valid_key (key) || !val) {
         errno = EINVAL;
         return -1;
     }
-    if (kv_delete (kv, key) < 0) {
-        if (errno != ENOENT)
-            return -1;
-    }
     int keylen = strlen (key);
-    int vallen = strlen (val);
+    int offset = kv->len;
     if (kv_expand (kv, keylen + vallen + 3) < 0) // key\0Tval\0
         return -1;
-    strncpy (&kv->buf[kv->len], key, keylen + 1);
+    memcpy (&kv->buf[kv->len], key, keylen + 1);
     kv->len += keylen + 1;
-    kv->buf[kv->len++] = type;
-    strncpy (&kv->buf[kv->len], val, vallen + 1);
-    kv->len += vallen + 1;
+    kv->buf[kv->len++] = hint;
+    memcpy (&kv->buf[kv->len], val, vallen);
+    kv->len += vallen;
+    kv->buf[kv->len++] = '\0';
+    index_add (kv, offset);
     return 0;
 }
 
-int kv_vput (struct kv *kv, const char *key, enum kv_type type, va_list ap)
+/* Put encoded 'val' as for kv_append_raw(), replacing any existing entry
+ * for 'key'.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int kv_put_raw (struct kv *kv, const char *key, char hint,
+                       const char *val, int vallen)
+{
+    if (!kv || !valid_key (key) || !val) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (kv_delete (kv, key) < 0) {
+        if (errno != ENOENT)
+            return -1;
+    }
+    return kv_append_raw (kv, key, hint, val, vallen);
+}
+
+static void put_be64 (char *p, uint64_t val)
+{
+    int i;
+
+    for (i = KV_BINARY_SIZE - 1; i >= 0; i--) {
+        p[i] = val & 0xff;
+        val >>= 8;
+    }
+}
+
+static uint64_t get_be64 (const char *p)
+{
+    uint64_t val = 0;
+    int i;
+
+    for (i = 0; i < KV_BINARY_SIZE; i++)
+        val = (val << 8) | (unsigned char)p[i];
+    return val;
+}
+
+/* Encode the value of 'type' in 'ap' for 'encoding', using 's' of size
+ * 'size' as storage if needed.  Set 'hint' to the type hint and 'vallen'
+ * to the value length.  Return value or NULL if invalid.
+ */
+static const char *val_encode (enum kv_type type, enum kv_encoding encoding,
+                               va_list ap, char *s, int size,
+                               char *hint, int *vallen)
 {
-    char s[80];
     const char *val = NULL;
+    bool binary = (encoding == KV_ENCODING_BINARY);
 
-    if (!kv || !valid_key (key))
-        goto inval;
+    *hint = type;
     switch (type) {
         case KV_STRING:
             val = va_arg (ap, const char *);
             break;
         case KV_INT64:
-            if (vsnprintf (s, sizeof (s), "%" PRIi64, ap) >= sizeof (s))
-                goto inval;
+            if (binary) {
+                put_be64 (s, va_arg (ap, int64_t));
+                *hint = KV_INT64_BINARY;
+                *vallen = KV_BINARY_SIZE;
+                return s;
+            }
+            if (vsnprintf (s, size, "%" PRIi64, ap) >= size)
+                return NULL;
             val = s;
             break;
         case KV_DOUBLE:
-            if (vsnprintf (s, sizeof (s), "%f", ap) >= sizeof (s))
-                goto inval;
+            if (binary) {
+                double d = va_arg (ap, double);
+                uint64_t u;
+                memcpy (&u, &d, sizeof (u));
+                put_be64 (s, u);
+                *hint = KV_DOUBLE_BINARY;
+                *vallen = KV_BINARY_SIZE;
+                return s;
+            }
+            if (vsnprintf (s, size, "%f", ap) >= size)
+                return NULL;
             val = s;
             break;
         case KV_BOOL: {
@@ -229,20 +562,56 @@ int kv_vput (struct kv *kv, const char *key, enum kv_type type, va_list ap)
         }
         case KV_TIMESTAMP: {
             time_t t = va_arg (ap, time_t);
-            if (timestamp_tostr (t, s, sizeof (s)) < 0)
-                goto inval;
+            if (binary) {
+                put_be64 (s, (int64_t)t);
+                *hint = KV_TIMESTAMP_BINARY;
+                *vallen = KV_BINARY_SIZE;
+                return s;
+            }
+            if (timestamp_tostr (t, s, size) < 0)
+                return NULL;
             val = s;
             break;
         }
         default:
-            goto inval;
+            break;
     }
-    if (!val)
-        goto inval;
-    return kv_put_raw (kv, key, type, val);
-inval:
-    errno = EINVAL;
-    return -1;
+    if (val)
+        *vallen = strlen (val);
+    return val;
+}
+
+int kv_vput (struct kv *kv, const char *key, enum kv_type type, va_list ap)
+{
+    char s[80];
+    const char *val;
+    char hint;
+    int vallen;
+
+    if (!kv || !valid_key (key)
+        || !(val = val_encode (type, kv->encoding, ap, s, sizeof (s),
+                               &hint, &vallen))) {
+        errno = EINVAL;
+        return -1;
+    }
+    return kv_put_raw (kv, key, hint, val, vallen);
+}
+
+int kv_vput_unique (struct kv *kv, const char *key, enum kv_type type,
+                    va_list ap)
+{
+    char s[80];
+    const char *val;
+    char hint;
+    int vallen;
+
+    if (!kv || !valid_key (key)
+        || !(val = val_encode (type, kv->encoding, ap, s, sizeof (s),
+                               &hint, &vallen))) {
+        errno = EINVAL;
+        return -1;
+    }
+    return kv_append_raw (kv, key, hint, val, vallen);
 }
 
 int kv_put (struct kv *kv, const char *key, enum kv_type type, ...)
@@ -256,6 +625,17 @@ int kv_put (struct kv *kv, const char *key, enum kv_type type, ...)
     return rc;
 }
 
+int kv_put_unique (struct kv *kv, const char *key, enum kv_type type, ...)
+{
+    va_list ap;
+    int rc;
+
+    va_start (ap, type);
+    rc = kv_vput_unique (kv, key, type, ap);
+    va_end (ap);
+    return rc;
+}
+
 const char *kv_next (const struct kv *kv, const char *key)
 {
     int entry_len;
@@ -281,13 +661,26 @@ const char *kv_val_string (const char *key)
     return &key[strlen (key) + 2];
 }
 
+static char val_hint (const char *key)
+{
+    return key ? key[strlen (key) + 1] : 0;
+}
+
 int64_t kv_val_int64 (const char *key)
 {
+    if (val_hint (key) == KV_INT64_BINARY)
+        return (int64_t)get_be64 (kv_val_string (key));
     return strtoll (kv_val_string (key), NULL, 10);
 }
 
 double kv_val_double (const char *key)
 {
+    if (val_hint (key) == KV_DOUBLE_BINARY) {
+        uint64_t u = get_be64 (kv_val_string (key));
+        double d;
+        memcpy (&d, &u, sizeof (d));
+        return d;
+    }
     return strtod (kv_val_string (key), NULL);
 }
 
@@ -304,28 +697,67 @@ time_t kv_val_timestamp (const char *key)
 {
     time_t t;
     const char *s = kv_val_string (key);
+    if (val_hint (key) == KV_TIMESTAMP_BINARY)
+        return (time_t)(int64_t)get_be64 (s);
     if (timestamp_fromstr (s, &t) < 0)
         return 0;
     return t;
 }
 
-enum kv_type kv_typeof (const char *key)
+static enum kv_type hint_type (char hint)
 {
-    if (!key)
-        return KV_UNKNOWN;
-    enum kv_type type = key[strlen (key) + 1];
-    switch (type) {
+    switch (hint) {
         case KV_STRING:
+            return KV_STRING;
+        case KV_BOOL:
+            return KV_BOOL;
         case KV_INT64:
+        case KV_INT64_BINARY:
+            return KV_INT64;
         case KV_DOUBLE:
-        case KV_BOOL:
+        case KV_DOUBLE_BINARY:
+            return KV_DOUBLE;
         case KV_TIMESTAMP:
-            return type;
+        case KV_TIMESTAMP_BINARY:
+            return KV_TIMESTAMP;
         default:
             return KV_UNKNOWN;
     }
 }
 
+enum kv_type kv_typeof (const char *key)
+{
+    return hint_type (val_hint (key));
+}
+
+void kv_iter_init (struct kv_iter *it)
+{
+    if (it)
+        memset (it, 0, sizeof (*it));
+}
+
+bool kv_iter_next (const struct kv *kv, struct kv_iter *it)
+{
+    const char *p;
+    char hint;
+
+    if (!kv || !it || it->offset < 0 || it->offset >= kv->len)
+        return false;
+    p = kv->buf + it->offset;
+    it->key = p;
+    it->keylen = strlen (p);
+    hint = p[it->keylen + 1];
+    it->type = hint_type (hint);
+    it->val = p + it->keylen + 2;
+    if (is_binary_hint (hint))
+        it->vallen = KV_BINARY_SIZE;
+    else
+        it->vallen = strlen (it->val);
+    it->entry_len = it->keylen + it->vallen + 3;
+    it->offset += it->entry_len;
+    return true;
+}
+
 int kv_vget (const struct kv *kv, const char *key,
              enum kv_type type, va_list ap)
 {
@@ -381,45 +813,87 @@ int kv_get (const struct kv *kv, const char *key, enum kv_type type, ...)
     return rc;
 }
 
-/* Validate a just-decoded kv buffer.
+static bool valid_hint (char hint)
+{
+    switch (hint) {
+        case KV_STRING:
+        case KV_INT64:
+        case KV_DOUBLE:
+        case KV_BOOL:
+        case KV_TIMESTAMP:
+        case KV_INT64_BINARY:
+        case KV_DOUBLE_BINARY:
+        case KV_TIMESTAMP_BINARY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Validate a just-decoded kv buffer in a single pass, and set the entry
+ * count, so the index can be built without walking it again.
  * Return 0 on success, -1 on failure with errno set.
  */
 static int kv_check_integrity (struct kv *kv)
 {
-    int nullcount;
-    int i;
-    const char *key = NULL;
+    const char *p = kv->buf;
+    const char *end = kv->buf + kv->len;
+    int count = 0;
 
-    /* properly terminated
+    /* Entries, each with nonzero key length and a valid type hint char,
+     * must exactly cover the buffer.  Binary values may contain NULs, so
+     * their fixed size is used rather than scanning for the terminator.
      */
-    if (kv->len > 0 && kv->buf[kv->len - 1] != '\0')
-        goto inval;
-
-    /* even number of nulls
-     */
-    nullcount = 0;
-    for (i = 0; i < kv->len; i++) {
-        if (kv->buf[i] == '\0')
-            nullcount++;
-    }
-    if (nullcount % 2 != 0)
-        goto inval;
-
-    /* nonzero key length
-     * value has valid type hint char
-     */
-    while ((key = kv_next (kv, key))) {
-        if (strlen (key) == 0)
+    while (p < end) {
+        const char *hint;
+        if (!(hint = memchr (p, '\0', end - p)) || hint == p)
             goto inval;
-        if (kv_typeof (key) == KV_UNKNOWN)
+        if (++hint == end || !valid_hint (*hint))
             goto inval;
+        if (is_binary_hint (*hint)) {
+            p = hint + 1 + KV_BINARY_SIZE;
+            if (p >= end || *p != '\0')
+                goto inval;
+        }
+        else if (!(p = memchr (hint, '\0', end - hint)))
+            goto inval;
+        p++;
+        count++;
     }
+    kv->count = count;
     return 0;
 inval:
     errno = EINVAL;
     return -1;
 }
 
+int kv_decode_into (struct kv *kv, const char *buf, int len)
+{
+    if (!kv || len < 0 || (len > 0 && !buf)) {
+        errno = EINVAL;
+        return -1;
+    }
+    kv->len = 0;
+    if (kv_expand (kv, len) < 0)
+        goto error;
+    if (len > 0)
+        memcpy (kv->buf, buf, len);
+    kv->len = len;
+    if (kv_check_integrity (kv) < 0) {
+        kv->len = 0;
+        goto error;
+    }
+    /* The entry count is known from the check.  The index allocation is
+     * reused if the count is similar.
+     */
+    index_build (kv);
+    return 0;
+error:
+    index_drop (kv);
+    kv->count = 0;
+    return -1;
+}
+
 int kv_encode (const struct kv *kv, const char **buf, int *len)
 {
     if (!kv || !buf || !len) {
@@ -431,6 +905,37 @@ int kv_encode (const struct kv *kv, const char **buf, int *len)
     return 0;
 }
 
+int kv_decode_swap (struct kv *kv, char **buf, int *bufsz, int len)
+{
+    char *oldbuf;
+    int oldsz;
+
+    if (!kv || !buf || !bufsz || len < 0 || len > *bufsz
+        || (len > 0 && !*buf)) {
+        errno = EINVAL;
+        return -1;
+    }
+    oldbuf = kv->buf;
+    oldsz = kv->bufsz;
+    kv->buf = *buf;
+    kv->bufsz = *bufsz;
+    kv->len = len;
+    if (kv_check_integrity (kv) < 0) {
+        int saved_errno = errno;
+        kv->buf = oldbuf;
+        kv->bufsz = oldsz;
+        kv->len = 0;
+        index_drop (kv);
+        kv->count = 0;
+        errno = saved_errno;
+        return -1;
+    }
+    index_build (kv);
+    *buf = oldbuf;
+    *bufsz = oldsz;
+    return 0;
+}
+
 struct kv *kv_decode (const char *buf, int len)
 {
     struct kv *kv;
@@ -441,64 +946,336 @@ struct kv *kv_decode (const char *buf, int len)
         kv_destroy (kv);
         return NULL;
     }
+    index_build (kv);
     return kv;
 }
 
-/* Wrapper for kv_put_raw() which adds 'prefix' to key, if non-NULL.
+static bool has_key_prefix (const struct kv *kv, const char *prefix, int n)
+{
+    struct kv_iter it;
+
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        if (it.keylen >= n && !memcmp (it.key, prefix, n))
+            return true;
+    }
+    return false;
+}
+
+/* Append all entries of kv2 to kv1 in one pass, adding 'prefix' of length
+ * 'n' to each key.  The caller ensures none of the new keys is in kv1.
  * Returns 0 on success, -1 on failure with errno set (ENOMEM).
  */
-static int kv_put_prefix (struct kv *kv, const char *prefix, const char *key,
-                          enum kv_type type, const char *val)
+static int kv_join_append (struct kv *kv1, const struct kv *kv2,
+                           const char *prefix, int n)
 {
-    char *newkey = NULL;
+    struct kv_iter it;
+    char *p;
 
-    if (prefix) {
-        if (asprintf (&newkey, "%s%s", prefix, key) < 0)
-            return -1;
-        key = newkey;
+    if (kv_expand (kv1, kv2->len + kv2->count * n) < 0)
+        return -1;
+    p = kv1->buf + kv1->len;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv2, &it)) {
+        memcpy (p, prefix, n);
+        memcpy (p + n, it.key, it.entry_len);
+        p += n + it.entry_len;
     }
-    if (kv_put_raw (kv, key, type, val) < 0) {
-        int saved_errno = errno;
-        free (newkey);
-        errno = saved_errno;
+    kv1->len = p - kv1->buf;
+    index_rebuild (kv1);
+    return 0;
+}
+
+/* Rebuild kv1 as its entries that are not replaced by a prefixed key of
+ * kv2, followed by all entries of kv2 with 'prefix' of length 'n' added.
+ * The result is the same as kv_put() of each kv2 entry would give, but
+ * is made in one pass, rather than moving the tail of kv1 for each
+ * replaced key.  The caller ensures keys of kv2 are unique.
+ * Returns 0 on success, -1 on failure with errno set (ENOMEM).
+ */
+static int kv_join_merge (struct kv *kv1, const struct kv *kv2,
+                          const char *prefix, int n)
+{
+    struct kv_iter it;
+    int size = kv1->len + kv2->len + kv2->count * n;
+    char *buf;
+    char *p;
+
+    if (!(buf = malloc (size > 0 ? size : 1)))
         return -1;
+    p = buf;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv1, &it)) {
+        if (it.keylen > n && !memcmp (it.key, prefix, n)
+            && kv_find (kv2, it.key + n, KV_UNKNOWN))
+            continue;
+        memcpy (p, it.key, it.entry_len);
+        p += it.entry_len;
     }
-    free (newkey);
+    kv_iter_init (&it);
+    while (kv_iter_next (kv2, &it)) {
+        memcpy (p, prefix, n);
+        memcpy (p + n, it.key, it.entry_len);
+        p += n + it.entry_len;
+    }
+    free (kv1->buf);
+    kv1->buf = buf;
+    kv1->bufsz = size > 0 ? size : 1;
+    kv1->len = p - buf;
+    index_rebuild (kv1);
     return 0;
 }
 
+/* Return true if some key occurs more than once in 'kv'.  An index
+ * records this as it is built (the flag may outlive a deleted duplicate,
+ * which is harmless here), so only a small, unindexed object is scanned.
+ */
+static bool has_dup_keys (const struct kv *kv)
+{
+    struct kv_iter it;
+
+    if (kv->index)
+        return kv->dups;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        if (kv_find (kv, it.key, KV_UNKNOWN) != it.key)
+            return true;
+    }
+    return false;
+}
+
+/* Put each entry of kv2 into kv1 with 'prefix' of length 'n' added to its
+ * key, so that a later duplicate key of kv2 replaces an earlier one.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int kv_join_put (struct kv *kv1, const struct kv *kv2,
+                        const char *prefix, int n)
+{
+    struct kv_iter it;
+    char *key = NULL;
+    int keysz = 0;
+    int saved_errno;
+    int rc = -1;
+
+    kv_iter_init (&it);
+    while (kv_iter_next (kv2, &it)) {
+        if (n + it.keylen + 1 > keysz) {
+            char *newkey;
+            if (!(newkey = realloc (key, n + it.keylen + 1)))
+                goto done;
+            key = newkey;
+            keysz = n + it.keylen + 1;
+        }
+        memcpy (key, prefix, n);
+        memcpy (key + n, it.key, it.keylen + 1);
+        if (kv_put_raw (kv1,
+                        key,
+                        it.key[it.keylen + 1],
+                        it.key + it.keylen + 2,
+                        it.entry_len - it.keylen - 3) < 0)
+            goto done;
+    }
+    rc = 0;
+done:
+    saved_errno = errno;
+    free (key);
+    errno = saved_errno;
+    return rc;
+}
+
 int kv_join (struct kv *kv1, const struct kv *kv2, const char *prefix)
 {
-    const char *key = NULL;
+    int n = prefix ? strlen (prefix) : 0;
 
-    while ((key = kv_next (kv2, key))) {
-        if (kv_put_prefix (kv1, prefix, key, kv_typeof (key),
-                                             kv_val_string (key)) < 0)
-            return -1;
+    if (!kv1 || kv1 == kv2) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!kv2)
+        return 0;
+    /* The one-pass joins copy kv2 entries as they are, so a decoded kv2
+     * with duplicate keys must instead be put one entry at a time.
+     */
+    if (has_dup_keys (kv2))
+        return kv_join_put (kv1, kv2, prefix, n);
+    /* Keys of kv2 are unique, so if no key of kv1 could collide with a
+     * prefixed key, there is nothing to replace.
+     */
+    if (n > 0 ? !has_key_prefix (kv1, prefix, n) : kv1->len == 0)
+        return kv_join_append (kv1, kv2, prefix, n);
+    return kv_join_merge (kv1, kv2, prefix, n);
+}
+
+int kv_split_into (const struct kv *kv1, const char *prefix, struct kv *kv2)
+{
+    struct kv_iter it;
+    int n = prefix ? strlen (prefix) : 0;
+    int need = 0;
+    char *p;
+
+    if (!kv1 || !kv2 || kv1 == kv2) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!prefix)
+        prefix = "";
+    /* Size the result, then copy matching entries without their prefix.
+     */
+    kv_iter_init (&it);
+    while (kv_iter_next (kv1, &it)) {
+        if (it.keylen > n && !memcmp (it.key, prefix, n))
+            need += it.entry_len - n;
     }
+    kv2->len = 0;
+    if (kv2->bufsz < need && kv_resize (kv2, need) < 0) {
+        index_rebuild (kv2);
+        return -1;
+    }
+    p = kv2->buf;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv1, &it)) {
+        if (it.keylen > n && !memcmp (it.key, prefix, n)) {
+            memcpy (p, it.key + n, it.entry_len - n);
+            p += it.entry_len - n;
+        }
+    }
+    kv2->len = need;
+    index_rebuild (kv2);
     return 0;
 }
 
 struct kv *kv_split (const struct kv *kv1, const char *prefix)
 {
-    const char *key = NULL;
     struct kv *kv2;
-    int n = prefix ? strlen (prefix) : 0;
 
     if (!(kv2 = kv_create ()))
         return NULL;
-    while ((key = kv_next (kv1, key))) {
-        if (strlen (key) > n && !strncmp (key, prefix, n)) {
-            if (kv_put_raw (kv2, key + n, kv_typeof (key),
-                                          kv_val_string (key)) < 0) {
-                kv_destroy (kv2);
-                return NULL;
-            }
-        }
+    if (kv_split_into (kv1, prefix, kv2) < 0) {
+        kv_destroy (kv2);
+        return NULL;
     }
     return kv2;
 }
 
+bool kv_equal_unordered (const struct kv *kv1, const struct kv *kv2)
+{
+    struct kv_iter it;
+    int saved_errno = errno;
+
+    if (!kv1 || !kv2)
+        return false;
+    if (kv1->len != kv2->len || kv1->count != kv2->count)
+        return false;
+    if (memcmp (kv1->buf, kv2->buf, kv1->len) == 0)
+        return true;
+    /* Keys are unique and the sizes match, so the objects are equal if
+     * each entry of kv1 is in kv2 byte for byte.
+     */
+    kv_iter_init (&it);
+    while (kv_iter_next (kv1, &it)) {
+        const char *entry = kv_find (kv2, it.key, KV_UNKNOWN);
+        if (!entry
+            || entry_length (entry, kv2->len - (entry - kv2->buf))
+                != it.entry_len
+            || memcmp (entry, it.key, it.entry_len) != 0) {
+            errno = saved_errno;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* splitmix64 finalizer, so that entry hashes combine well by addition.
+ */
+static uint64_t hash_mix (uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+uint64_t kv_hash (const struct kv *kv)
+{
+    struct kv_iter it;
+    uint64_t sum = 0;
+
+    /* Sum the FNV-1a hash of each encoded entry, which does not depend on
+     * the entry order.
+     */
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        uint64_t h = 14695981039346656037ULL;
+        int i;
+
+        for (i = 0; i < it.entry_len; i++) {
+            h ^= (unsigned char)it.key[i];
+            h *= 1099511628211ULL;
+        }
+        sum += hash_mix (h);
+    }
+    return sum;
+}
+
+struct sort_entry {
+    const char *key;
+    int len;
+};
+
+static int sort_entry_cmp (const void *a, const void *b)
+{
+    const struct sort_entry *e1 = a;
+    const struct sort_entry *e2 = b;
+
+    return strcmp (e1->key, e2->key);
+}
+
+int kv_sort (struct kv *kv)
+{
+    struct sort_entry *entries;
+    struct kv_iter it;
+    char *buf;
+    char *p;
+    int i;
+
+    if (!kv) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (kv->count < 2)
+        return 0;
+    if (!(entries = malloc (sizeof (entries[0]) * kv->count)))
+        return -1;
+    if (!(buf = malloc (kv->bufsz))) {
+        int saved_errno = errno;
+        free (entries);
+        errno = saved_errno;
+        return -1;
+    }
+    i = 0;
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        entries[i].key = it.key;
+        entries[i].len = it.entry_len;
+        i++;
+    }
+    qsort (entries, kv->count, sizeof (entries[0]), sort_entry_cmp);
+    p = buf;
+    for (i = 0; i < kv->count; i++) {
+        memcpy (p, entries[i].key, entries[i].len);
+        p += entries[i].len;
+    }
+    free (entries);
+    free (kv->buf);
+    kv->buf = buf;
+    /* Entries moved, so offsets in the index are stale.
+     */
+    index_build (kv);
+    return 0;
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
@@ -16,6 +16,16 @@
  *
  * T=single-char type hint:
  *   s=string, i=int64_t, d=double, b=bool, t=timestamp
+ *
+ * With the binary encoding (see kv_set_encoding()), int64_t, double, and
+ * timestamp values are instead stored as eight big-endian bytes, which may
+ * include NULs, with hints I, D, and T.  Decoding accepts either form, but
+ * readers that predate the binary encoding reject it, so a writer should
+ * only select it when its readers are known to support it.
+ *
+ * Objects with many entries also keep an index of key offsets, so kv_get()
+ * and kv_put() of a new key do not scan the buffer.  The encoding is the
+ * same with or without the index.
  */
 
 #include <stdbool.h>
@@ -23,6 +33,11 @@
 #include <stdarg.h>
 #include <time.h> // time_t
 
+enum kv_encoding {
+    KV_ENCODING_TEXT = 0,       // default
+    KV_ENCODING_BINARY = 1,
+};
+
 enum kv_type {
     KV_UNKNOWN = 0,
     KV_STRING = 's',
@@ -38,8 +53,17 @@ struct kv *kv_create (void);
 void kv_destroy (struct kv *kv);
 struct kv *kv_copy (const struct kv *kv);
 
+/* Replace the contents of existing object 'dst' with a copy of 'src',
+ * reusing its buffer, so no allocation is needed once it is large enough.
+ * On failure, dst is left empty.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_copy_into (struct kv *dst, const struct kv *src);
+
 /* Add kv2 entries to kv1, prepending 'prefix' to its keys (if non-NULL).
- * When there are key conflicts, values from kv2 override kv1.
+ * When there are key conflicts, values from kv2 override kv1.  If kv2 has
+ * duplicate keys (e.g. from kv_decode()), the last value of each is kept,
+ * as if each entry were added with kv_put().
  * Return 0 on success, -1 on failure with errno set.
  */
 int kv_join (struct kv *kv1, const struct kv *kv2, const char *prefix);
@@ -50,10 +74,33 @@ int kv_join (struct kv *kv1, const struct kv *kv2, const char *prefix);
  */
 struct kv *kv_split (const struct kv *kv, const char *prefix);
 
+/* Same as kv_split(), but replace the contents of existing object 'kv2',
+ * reusing its buffer, so no allocation is needed once it is large enough.
+ * On failure, kv2 is left empty.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_split_into (const struct kv *kv, const char *prefix, struct kv *kv2);
+
 /* Return true if kv1 is identical to kv2 (including entry order)
  */
 bool kv_equal (const struct kv *kv1, const struct kv *kv2);
 
+/* Return true if kv1 and kv2 have the same entries, in any order.
+ * Values must also have the same encoding (see kv_set_encoding()).
+ */
+bool kv_equal_unordered (const struct kv *kv1, const struct kv *kv2);
+
+/* Return a 64-bit hash of kv contents that does not depend on entry order,
+ * so it agrees with kv_equal_unordered().  It is not a cryptographic hash.
+ */
+uint64_t kv_hash (const struct kv *kv);
+
+/* Sort entries of kv by key, giving a canonical encoding of its contents,
+ * so that kv_equal() and kv_encode() are independent of insertion order.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_sort (struct kv *kv);
+
 /* Remove 'key' from kv object.
  * Return 0 on success, -1 on failure with errno set.
  *   EINVAL - invalid argument
@@ -71,6 +118,28 @@ int kv_delete (struct kv *kv, const char *key);
 int kv_vput (struct kv *kv, const char *key, enum kv_type type, va_list ap);
 int kv_put (struct kv *kv, const char *key, enum kv_type type, ...);
 
+/* Append key=val to kv object without looking for an existing entry.
+ * The caller must ensure 'key' is not already present, e.g. when building
+ * a new object from distinct keys.  Return values are as for kv_put().
+ */
+int kv_vput_unique (struct kv *kv, const char *key, enum kv_type type,
+                    va_list ap);
+int kv_put_unique (struct kv *kv, const char *key, enum kv_type type, ...);
+
+/* Select the encoding of KV_INT64, KV_DOUBLE, and KV_TIMESTAMP values
+ * added to kv object from now on.  Entries already present are unchanged.
+ * The binary encoding is faster to put and get, and keeps the full
+ * precision of doubles.  The setting is kept by kv_copy().
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_set_encoding (struct kv *kv, enum kv_encoding encoding);
+
+/* Ensure that 'needsz' bytes of entries can be added to kv object without
+ * reallocating.  If the buffer must grow, it grows to exactly that size.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_reserve (struct kv *kv, int needsz);
+
 /* Find key in kv object and get val (if non-NULL).
  * Return 0 on success, -1 on failure with errno set:
  *   EINVAL - invalid argument
@@ -90,6 +159,23 @@ int kv_encode (const struct kv *kv, const char **buf, int *len);
  */
 struct kv *kv_decode (const char *buf, int len);
 
+/* Replace the contents of kv object with binary encoding, reusing its
+ * internal buffer, so no allocation is needed if it is already large enough.
+ * On failure, kv is left empty.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_decode_into (struct kv *kv, const char *buf, int len);
+
+/* Replace the contents of kv object with the 'len' byte encoding in the
+ * caller's malloc'd buffer '*buf' of size '*bufsz', validating it in place
+ * rather than copying it.  The buffers are exchanged: kv keeps the caller's
+ * buffer, and '*buf' and '*bufsz' are set to the previous kv buffer (NULL
+ * for an object that had none), which the caller now owns.
+ * On failure, no buffers are exchanged and kv is left empty.
+ * Return 0 on success, -1 on failure with errno set.
+ */
+int kv_decode_swap (struct kv *kv, char **buf, int *bufsz, int len);
+
 /* Iteration example:
  *
  *   const char *key = NULL;
@@ -104,9 +190,38 @@ struct kv *kv_decode (const char *buf, int len);
 const char *kv_next (const struct kv *kv, const char *key);
 enum kv_type kv_typeof (const char *key);
 
+/* Iteration with entry lengths, found in one pass over each entry:
+ *
+ *   struct kv_iter it;
+ *
+ *   kv_iter_init (&it);
+ *   while (kv_iter_next (kv, &it)) {
+ *       // it.key, it.keylen, it.type, it.val, it.vallen
+ *       ...
+ *   }
+ *
+ * 'val' is the NULL terminated text of a text encoded value, or the
+ * 8 bytes of a binary encoded one.  'entry_len' is the length of the
+ * whole entry in the encoding, starting at 'key'.
+ * As with kv_next(), kv may not be modified during iteration.
+ */
+struct kv_iter {
+    const char *key;
+    int keylen;
+    enum kv_type type;
+    const char *val;
+    int vallen;
+    int entry_len;
+    int offset;     // private
+};
+
+void kv_iter_init (struct kv_iter *it);
+bool kv_iter_next (const struct kv *kv, struct kv_iter *it);
+
 /* Iteration value accessors for keys returned by kv_next().
  * Use kv_typeof() to choose the proper accessor; if type doesn't
- * match, returned value is undefined.
+ * match, returned value is undefined.  kv_val_string() of a binary
+ * encoded value does not return text.
  */
 const char *kv_val_string (const char *key); // N.B. never returns NULL
 int64_t kv_val_int64 (const char *key);
@@ -10,13 +10,30 @@
               Algorithm specification can be found here:
                * http://csrc.nist.gov/publications/fips/fips180-2/fips180-2withchangenotice.pdf
               This implementation uses little endian byte order.
+              Block processing uses SHA-NI (x86_64) or the ARMv8
+              cryptography extension when the CPU supports it, selected
+              at runtime, with the portable code as a fallback.
 *********************************************************************/
 
 /*************************** HEADER FILES ***************************/
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include "sha256.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_SHA256_SHANI 1
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HAVE_SHA256_ARMV8 1
+#endif
+
 /****************************** MACROS ******************************/
 #define ROTLEFT(a,b) (((a) << (b)) | ((a) >> (32-(b))))
 #define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
@@ -40,8 +57,11 @@ static const WORD k[64] = {
 	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
-/*********************** FUNCTION DEFINITIONS ***********************/
-void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+/**************************** KERNELS *******************************/
+// A kernel processes 'nblocks' consecutive 64 byte blocks of 'data'.
+typedef void (*sha256_blocks_f)(WORD state[8], const BYTE data[], size_t nblocks);
+
+static void sha256_block(WORD state[8], const BYTE data[])
 {
 	WORD a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
 
@@ -50,14 +70,14 @@ void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
 	for ( ; i < 64; ++i)
 		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
 
-	a = ctx->state[0];
-	b = ctx->state[1];
-	c = ctx->state[2];
-	d = ctx->state[3];
-	e = ctx->state[4];
-	f = ctx->state[5];
-	g = ctx->state[6];
-	h = ctx->state[7];
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
 
 	for (i = 0; i < 64; ++i) {
 		t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
@@ -72,14 +92,220 @@ void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
 		a = t1 + t2;
 	}
 
-	ctx->state[0] += a;
-	ctx->state[1] += b;
-	ctx->state[2] += c;
-	ctx->state[3] += d;
-	ctx->state[4] += e;
-	ctx->state[5] += f;
-	ctx->state[6] += g;
-	ctx->state[7] += h;
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+static void sha256_blocks_scalar(WORD state[8], const BYTE data[], size_t nblocks)
+{
+	while (nblocks-- > 0) {
+		sha256_block(state, data);
+		data += 64;
+	}
+}
+
+#ifdef HAVE_SHA256_SHANI
+static int have_shani(void)
+{
+	unsigned int a, b, c, d;
+
+	if (!__builtin_cpu_supports("sse4.1"))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+		return 0;
+	return (b & (1u << 29)) != 0;   // CPUID.(EAX=7,ECX=0):EBX.SHA
+}
+
+// Update message schedule words m0 with the next four, given m1-m3.
+#define SHANI_SCHED(m0, m1, m2, m3) \
+	m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), \
+	                                        _mm_alignr_epi8(m3, m2, 4)), m3)
+
+// Four rounds, starting at round 4 * g.
+#define SHANI_ROUNDS(m, g) do { \
+	__m128i t_ = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)&k[4 * (g)])); \
+	s1 = _mm_sha256rnds2_epu32(s1, s0, t_); \
+	s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(t_, 0x0e)); \
+} while (0)
+
+// The SHA-NI round instructions keep the state as ABEF and CDGH.
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(WORD state[8], const BYTE data[], size_t nblocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i s0, s1, t, save0, save1, m0, m1, m2, m3;
+	int g;
+
+	t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+	s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+	s0 = _mm_alignr_epi8(t, s1, 8);
+	s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+	while (nblocks-- > 0) {
+		save0 = s0;
+		save1 = s1;
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), bswap);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+		SHANI_ROUNDS(m0, 0);
+		SHANI_ROUNDS(m1, 1);
+		SHANI_ROUNDS(m2, 2);
+		SHANI_ROUNDS(m3, 3);
+		for (g = 4; g < 16; g += 4) {
+			SHANI_SCHED(m0, m1, m2, m3);
+			SHANI_ROUNDS(m0, g);
+			SHANI_SCHED(m1, m2, m3, m0);
+			SHANI_ROUNDS(m1, g + 1);
+			SHANI_SCHED(m2, m3, m0, m1);
+			SHANI_ROUNDS(m2, g + 2);
+			SHANI_SCHED(m3, m0, m1, m2);
+			SHANI_ROUNDS(m3, g + 3);
+		}
+		s0 = _mm_add_epi32(s0, save0);
+		s1 = _mm_add_epi32(s1, save1);
+		data += 64;
+	}
+
+	t = _mm_shuffle_epi32(s0, 0x1b);
+	s1 = _mm_shuffle_epi32(s1, 0xb1);
+	s0 = _mm_blend_epi16(t, s1, 0xf0);
+	s1 = _mm_alignr_epi8(s1, t, 8);
+	_mm_storeu_si128((__m128i *)&state[0], s0);
+	_mm_storeu_si128((__m128i *)&state[4], s1);
+}
+#endif /* HAVE_SHA256_SHANI */
+
+#ifdef HAVE_SHA256_ARMV8
+static int have_armv8(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+
+#define ARMV8_SCHED(m0, m1, m2, m3) \
+	m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3)
+
+#define ARMV8_ROUNDS(m, g) do { \
+	uint32x4_t t_ = vaddq_u32(m, vld1q_u32(&k[4 * (g)])); \
+	uint32x4_t abcd_ = s0; \
+	s0 = vsha256hq_u32(s0, s1, t_); \
+	s1 = vsha256h2q_u32(s1, abcd_, t_); \
+} while (0)
+
+__attribute__((target("+crypto")))
+static void sha256_blocks_armv8(WORD state[8], const BYTE data[], size_t nblocks)
+{
+	uint32x4_t s0, s1, save0, save1, m0, m1, m2, m3;
+	int g;
+
+	s0 = vld1q_u32(&state[0]);
+	s1 = vld1q_u32(&state[4]);
+
+	while (nblocks-- > 0) {
+		save0 = s0;
+		save1 = s1;
+		m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+		m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+		ARMV8_ROUNDS(m0, 0);
+		ARMV8_ROUNDS(m1, 1);
+		ARMV8_ROUNDS(m2, 2);
+		ARMV8_ROUNDS(m3, 3);
+		for (g = 4; g < 16; g += 4) {
+			ARMV8_SCHED(m0, m1, m2, m3);
+			ARMV8_ROUNDS(m0, g);
+			ARMV8_SCHED(m1, m2, m3, m0);
+			ARMV8_ROUNDS(m1, g + 1);
+			ARMV8_SCHED(m2, m3, m0, m1);
+			ARMV8_ROUNDS(m2, g + 2);
+			ARMV8_SCHED(m3, m0, m1, m2);
+			ARMV8_ROUNDS(m3, g + 3);
+		}
+		s0 = vaddq_u32(s0, save0);
+		s1 = vaddq_u32(s1, save1);
+		data += 64;
+	}
+
+	vst1q_u32(&state[0], s0);
+	vst1q_u32(&state[4], s1);
+}
+#endif /* HAVE_SHA256_ARMV8 */
+
+static const struct {
+	const char *name;
+	sha256_blocks_f fn;
+	int (*supported)(void);
+} kernels[] = {
+#ifdef HAVE_SHA256_SHANI
+	{ "shani", sha256_blocks_shani, have_shani },
+#endif
+#ifdef HAVE_SHA256_ARMV8
+	{ "armv8", sha256_blocks_armv8, have_armv8 },
+#endif
+	{ "scalar", sha256_blocks_scalar, NULL },
+};
+
+// Selected on first use.  Racing threads select the same kernel.
+static sha256_blocks_f blocks_fn;
+static const char *blocks_name;
+
+static void select_kernel(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		if (!kernels[i].supported || kernels[i].supported()) {
+			__atomic_store_n(&blocks_name, kernels[i].name, __ATOMIC_RELAXED);
+			__atomic_store_n(&blocks_fn, kernels[i].fn, __ATOMIC_RELEASE);
+			return;
+		}
+	}
+}
+
+static sha256_blocks_f get_kernel(void)
+{
+	sha256_blocks_f fn = __atomic_load_n(&blocks_fn, __ATOMIC_ACQUIRE);
+
+	if (!fn) {
+		select_kernel();
+		fn = __atomic_load_n(&blocks_fn, __ATOMIC_ACQUIRE);
+	}
+	return fn;
+}
+
+const char *sha256_kernel(void)
+{
+	(void)get_kernel();
+	return __atomic_load_n(&blocks_name, __ATOMIC_RELAXED);
+}
+
+int sha256_kernel_set(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		if (!strcmp(kernels[i].name, name)) {
+			if (kernels[i].supported && !kernels[i].supported())
+				return -1;
+			__atomic_store_n(&blocks_name, kernels[i].name, __ATOMIC_RELAXED);
+			__atomic_store_n(&blocks_fn, kernels[i].fn, __ATOMIC_RELEASE);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+{
+	get_kernel()(ctx->state, data, 1);
 }
 
 void sha256_init(SHA256_CTX *ctx)
@@ -98,17 +324,34 @@ void sha256_init(SHA256_CTX *ctx)
 
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 {
-	WORD i;
+	sha256_blocks_f blocks = get_kernel();
+	size_t n;
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
-		}
+	// Complete a partial block left by the previous call.
+	if (ctx->datalen > 0) {
+		n = 64 - ctx->datalen;
+		if (n > len)
+			n = len;
+		memcpy(ctx->data + ctx->datalen, data, n);
+		ctx->datalen += n;
+		data += n;
+		len -= n;
+		if (ctx->datalen < 64)
+			return;
+		blocks(ctx->state, ctx->data, 1);
+		ctx->bitlen += 512;
+		ctx->datalen = 0;
+	}
+	// Hash whole blocks in place.
+	if ((n = len / 64) > 0) {
+		blocks(ctx->state, data, n);
+		ctx->bitlen += 512ULL * n;
+		data += 64 * n;
+		len -= 64 * n;
 	}
+	if (len > 0)
+		memcpy(ctx->data, data, len);
+	ctx->datalen = len;
 }
 
 void sha256_final(SHA256_CTX *ctx, BYTE hash[])
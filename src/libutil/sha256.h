@@ -31,4 +31,13 @@ void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
 
+// The block function ("kernel") is chosen at runtime from "shani",
+// "armv8", and "scalar", according to CPU support.  sha256_kernel()
+// returns the name of the one in use.  sha256_kernel_set() forces the
+// named kernel for all contexts, e.g. for testing or benchmarking, and
+// returns -1 if it is unknown or unsupported.  It must not be called
+// while other threads are hashing.
+const char *sha256_kernel(void);
+int sha256_kernel_set(const char *name);
+
 #endif   // SHA256_H
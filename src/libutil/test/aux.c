@@ -20,6 +20,63 @@ void myfree (void *arg)
     myfree_count++;
 }
 
+static void test_key (void)
+{
+    struct aux_item *aux = NULL;
+    int frog, frog2, dog;
+
+    frog = aux_key_register ("frog");
+    ok (frog > 0,
+        "aux_key_register frog works");
+    frog2 = aux_key_register ("frog");
+    ok (frog2 == frog,
+        "aux_key_register frog again returns the same handle");
+    dog = aux_key_register ("dog");
+    ok (dog > 0 && dog != frog,
+        "aux_key_register dog returns a different handle");
+    errno = 0;
+    ok (aux_key_register (NULL) < 0 && errno == EINVAL,
+        "aux_key_register key=NULL fails with EINVAL");
+
+    errno = 0;
+    ok (aux_get_key (aux, frog) == NULL && errno == ENOENT,
+        "aux_get_key fails with ENOENT on empty aux");
+    ok (aux_set_key (&aux, frog, "ribbit", NULL) == 0,
+        "aux_set_key frog=ribbit works");
+    is (aux_get_key (aux, frog), "ribbit",
+        "aux_get_key frog returns ribbit");
+    is (aux_get (aux, "frog"), "ribbit",
+        "aux_get frog returns ribbit");
+    ok (aux_set (&aux, "dog", "woof", myfree) == 0,
+        "aux_set dog=woof works");
+    is (aux_get_key (aux, dog), "woof",
+        "aux_get_key dog returns woof");
+
+    myfree_count = 0;
+    ok (aux_set_key (&aux, dog, NULL, NULL) == 0 && myfree_count == 1,
+        "aux_set_key dog=NULL calls destructor");
+    errno = 0;
+    ok (aux_get_key (aux, dog) == NULL && errno == ENOENT,
+        "aux_get_key dog fails with ENOENT");
+    errno = 0;
+    ok (aux_get (aux, "dog") == NULL && errno == ENOENT,
+        "aux_get dog fails with ENOENT");
+
+    errno = 0;
+    ok (aux_get_key (aux, 0) == NULL && errno == EINVAL,
+        "aux_get_key key=0 fails with EINVAL");
+    errno = 0;
+    ok (aux_set_key (&aux, 0, "x", NULL) < 0 && errno == EINVAL,
+        "aux_set_key key=0 fails with EINVAL");
+    errno = 0;
+    ok (aux_set_key (&aux, 100000, "x", NULL) < 0 && errno == EINVAL,
+        "aux_set_key with unregistered key fails with EINVAL");
+    errno = 0;
+    ok (aux_set_key (NULL, frog, "x", NULL) < 0 && errno == EINVAL,
+        "aux_set_key aux=NULL fails with EINVAL");
+    aux_destroy (&aux);
+}
+
 int main (int argc, char *argv[])
 {
     struct aux_item *aux = NULL;
@@ -110,6 +167,8 @@ int main (int argc, char *argv[])
     lives_ok ({aux_destroy (NULL);},
         "aux_destroy aux=NULL doesn't crash");
 
+    test_key ();
+
     done_testing ();
     return 0;
 }
@@ -0,0 +1,200 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sodium.h>
+
+#include "src/libtap/tap.h"
+#include "src/libutil/base64.h"
+
+#define MAXLEN 1024
+
+static const struct {
+    const char *bin;
+    const char *b64;
+} vectors[] = {
+    { "", "" },
+    { "f", "Zg==" },
+    { "fo", "Zm8=" },
+    { "foo", "Zm9v" },
+    { "foob", "Zm9vYg==" },
+    { "fooba", "Zm9vYmE=" },
+    { "foobar", "Zm9vYmFy" },
+};
+
+void test_vectors (void)
+{
+    char b64[64];
+    char bin[64];
+    int i;
+
+    /* RFC 4648 section 10 test vectors
+     */
+    for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++) {
+        int len = strlen (vectors[i].bin);
+        base64_encode (b64, vectors[i].bin, len);
+        is (b64, vectors[i].b64,
+            "base64_encode \"%s\" works", vectors[i].bin);
+        ok (base64_decode (bin, sizeof (bin), b64, strlen (b64)) == len
+            && !memcmp (bin, vectors[i].bin, len),
+            "base64_decode \"%s\" works", vectors[i].b64);
+    }
+}
+
+/* Compare encoding of random data with libsodium for all lengths up to
+ * MAXLEN, exercising both the vector and scalar paths.
+ */
+void test_vs_sodium (void)
+{
+    unsigned char bin[MAXLEN];
+    unsigned char out[MAXLEN];
+    char b64[MAXLEN * 2];
+    char ref[MAXLEN * 2];
+    int len;
+    int errors = 0;
+
+    randombytes_buf (bin, sizeof (bin));
+    for (len = 0; len <= MAXLEN; len++) {
+        size_t reflen = sodium_base64_encoded_len (len,
+                                            sodium_base64_VARIANT_ORIGINAL);
+        if (base64_encoded_len (len) != reflen)
+            errors++;
+        sodium_bin2base64 (ref, sizeof (ref), bin, len,
+                           sodium_base64_VARIANT_ORIGINAL);
+        base64_encode (b64, bin, len);
+        if (strcmp (b64, ref) != 0)
+            errors++;
+        if (base64_decode (out, sizeof (out), b64, strlen (b64)) != len
+            || memcmp (out, bin, len) != 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "base64 matches libsodium ORIGINAL variant for lengths 0-%d",
+        MAXLEN);
+}
+
+/* Corrupt one character of a valid encoding and check that the decoder
+ * accepts or rejects it exactly as libsodium does.  N.B. only 7-bit
+ * characters are used, since libsodium's handling of (signed) chars with
+ * the high bit set accepts some of them, whereas base64_decode() rejects
+ * all non-ASCII input.
+ */
+void test_corrupt (void)
+{
+    unsigned char bin[256];
+    unsigned char out[256];
+    unsigned char ref[256];
+    char b64[512];
+    int i;
+    int errors = 0;
+    int check_errors = 0;
+
+    randombytes_buf (bin, sizeof (bin));
+    for (i = 0; i < 20000; i++) {
+        int len = randombytes_uniform (sizeof (bin));
+        int b64len;
+        int rc;
+        size_t reflen;
+        int refrc;
+
+        base64_encode (b64, bin, len);
+        b64len = strlen (b64);
+        if (b64len > 0)
+            b64[randombytes_uniform (b64len)] = randombytes_uniform (128);
+        refrc = sodium_base642bin (ref, sizeof (ref), b64, b64len,
+                                   NULL, &reflen, NULL,
+                                   sodium_base64_VARIANT_ORIGINAL);
+        rc = base64_decode (out, sizeof (out), b64, b64len);
+        if (refrc < 0) {
+            if (rc >= 0)
+                errors++;
+        }
+        else {
+            if (rc != reflen || memcmp (out, ref, reflen) != 0)
+                errors++;
+        }
+        if (base64_check (b64, b64len) != rc)
+            check_errors++;
+    }
+    ok (errors == 0,
+        "base64_decode accepts and rejects corrupted input like libsodium");
+    ok (check_errors == 0,
+        "base64_check accepts and rejects corrupted input like base64_decode");
+}
+
+void test_errors (void)
+{
+    char out[64];
+
+    errno = 0;
+    ok (base64_decode (out, sizeof (out), "Zm9", 3) < 0 && errno == EINVAL,
+        "base64_decode fails on unpadded input with EINVAL");
+    errno = 0;
+    ok (base64_decode (out, sizeof (out), "Zh==", 4) < 0 && errno == EINVAL,
+        "base64_decode fails on non-canonical input with EINVAL");
+    errno = 0;
+    ok (base64_decode (out, sizeof (out), "Zg==Zg==", 8) < 0
+        && errno == EINVAL,
+        "base64_decode fails on padding in the middle with EINVAL");
+    errno = 0;
+    ok (base64_decode (out, sizeof (out), "Zm9v.m9v", 8) < 0
+        && errno == EINVAL,
+        "base64_decode fails on invalid character with EINVAL");
+    errno = 0;
+    ok (base64_decode (out, sizeof (out), "Zm9v\xdam9v", 8) < 0
+        && errno == EINVAL,
+        "base64_decode fails on non-ASCII character with EINVAL");
+    errno = 0;
+    ok (base64_decode (out, sizeof (out),
+                       "Zm9vZm9vZm9vZm9v\xdam9vZm9vZm9vZm9v", 32) < 0
+        && errno == EINVAL,
+        "base64_decode fails on non-ASCII character in long input");
+    errno = 0;
+    ok (base64_decode (out, 2, "Zm9v", 4) < 0 && errno == ERANGE,
+        "base64_decode fails on short buffer with ERANGE");
+
+    ok (base64_check ("", 0) == 0,
+        "base64_check of empty input returns 0");
+    ok (base64_check ("Zm9vYg==", 8) == 4,
+        "base64_check returns decoded length");
+    errno = 0;
+    ok (base64_check ("Zm9", 3) < 0 && errno == EINVAL,
+        "base64_check fails on unpadded input with EINVAL");
+    errno = 0;
+    ok (base64_check ("Zh==", 4) < 0 && errno == EINVAL,
+        "base64_check fails on non-canonical input with EINVAL");
+    errno = 0;
+    ok (base64_check ("Zg==Zg==", 8) < 0 && errno == EINVAL,
+        "base64_check fails on padding in the middle with EINVAL");
+    errno = 0;
+    ok (base64_check ("Zm9v.m9v", 8) < 0 && errno == EINVAL,
+        "base64_check fails on invalid character with EINVAL");
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    if (sodium_init () < 0)
+        BAIL_OUT ("sodium_init failed");
+
+    test_vectors ();
+    test_vs_sodium ();
+    test_corrupt ();
+    test_errors ();
+
+    done_testing ();
+}
+
+/*
+ * vi: ts=4 sw=4 expandtab
+ */
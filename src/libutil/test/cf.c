@@ -13,6 +13,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
@@ -382,6 +383,17 @@ const struct cf_option opts_optional[] = { // for 't1'
     CF_OPTIONS_TABLE_END,
 };
 
+const struct cf_option opts_notab[] = { // for 't1'
+    { "i", CF_INT64, true },
+    { "d", CF_DOUBLE, true },
+    { "s", CF_STRING, true },
+    { "b", CF_BOOL, true },
+    { "ts", CF_TIMESTAMP, true },
+    { "ai", CF_ARRAY, true },
+    { "smurf", CF_TABLE, false },
+    CF_OPTIONS_TABLE_END,
+};
+
 const struct cf_option opts_wrongtype[] = { // for 't1'
     { "i", CF_DOUBLE , true }, // changed type
     { "d", CF_DOUBLE, true },
@@ -522,6 +534,287 @@ void test_update_glob (void)
 
 }
 
+void test_update_glob_parallel (void)
+{
+    const char *tmpdir = getenv ("TMPDIR");
+    char dir[PATH_MAX + 1];
+    char path[16][PATH_MAX + 1];
+    char invalid[2][PATH_MAX + 1];
+    char p[8192];
+    char prefix[16];
+    char contents[64];
+    struct cf_error error;
+    cf_t *cf;
+    int i;
+
+    snprintf (dir, sizeof (dir), "%s/cf.XXXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp (dir))
+        BAIL_OUT ("mkdtemp %s: %s", dir, strerror (errno));
+    for (i = 0; i < 16; i++) {
+        snprintf (prefix, sizeof (prefix), "%02d", i);
+        snprintf (contents, sizeof (contents),
+                  "last = %d\n[tab%d]\nid = %d\n", i, i, i);
+        create_test_file (dir, prefix, path[i], sizeof (path[i]), contents);
+    }
+    snprintf (p, sizeof (p), "%s/*.toml", dir);
+
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create: %s", strerror (errno));
+    ok (cf_update_glob (cf, p, &error) == 16,
+        "cf_update_glob parsed 16 files");
+    ok (cf_int64 (cf_get_in (cf, "last")) == 15,
+        "files were merged in glob order");
+    for (i = 0; i < 16; i++) {
+        snprintf (prefix, sizeof (prefix), "tab%d", i);
+        if (cf_int64 (cf_get_in (cf_get_in (cf, prefix), "id")) != i)
+            break;
+    }
+    ok (i == 16,
+        "tables from all files are present");
+    cf_destroy (cf);
+
+    /* With two bad files, the first in glob order is reported.
+     */
+    create_test_file (dir, "05a", invalid[0], sizeof (invalid[0]),
+                      "\n\nkey = \n");
+    create_test_file (dir, "09a", invalid[1], sizeof (invalid[1]),
+                      "key = \n");
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create: %s", strerror (errno));
+    errno = 0;
+    ok (cf_update_glob (cf, p, &error) < 0 && errno == EINVAL,
+        "cf_update_glob fails when some files fail to parse");
+    diag ("%s: %d: %s", error.filename, error.lineno, error.errbuf);
+    like (error.filename, "05a.*\\.toml",
+          "first failed file is contained in error.filename");
+    ok (error.lineno == 3,
+        "and error.lineno is from that file");
+    ok (cf_get_in (cf, "last") == NULL,
+        "keys from ok files not added to cf table when one file fails");
+    cf_destroy (cf);
+
+    for (i = 0; i < 16; i++) {
+        if (unlink (path[i]) < 0)
+            BAIL_OUT ("unlink: %s", strerror (errno));
+    }
+    if (unlink (invalid[0]) < 0 || unlink (invalid[1]) < 0)
+        BAIL_OUT ("unlink: %s", strerror (errno));
+    if (rmdir (dir) < 0)
+        BAIL_OUT ("rmdir: %s: %s", dir, strerror (errno));
+}
+
+/* Load 'count' files, with the serial path for a small count, and the
+ * parallel path for a large one, and check the stats.
+ */
+static void check_glob_stats (int count)
+{
+    const char *tmpdir = getenv ("TMPDIR");
+    char dir[PATH_MAX + 1];
+    char path[8][PATH_MAX + 1];
+    char p[8192];
+    char prefix[16];
+    char contents[64];
+    struct cf_error error;
+    struct cf_stats *stats = NULL;
+    cf_t *cf;
+    int errors;
+    int i;
+
+    snprintf (dir, sizeof (dir), "%s/cf.XXXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp (dir))
+        BAIL_OUT ("mkdtemp %s: %s", dir, strerror (errno));
+    for (i = 0; i < count; i++) {
+        snprintf (prefix, sizeof (prefix), "%02d", i);
+        snprintf (contents, sizeof (contents), "[tab%d]\nid = %d\n", i, i);
+        create_test_file (dir, prefix, path[i], sizeof (path[i]), contents);
+    }
+    snprintf (p, sizeof (p), "%s/*.toml", dir);
+
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create: %s", strerror (errno));
+    ok (cf_update_glob_stats (cf, p, &stats, &error) == count
+        && stats != NULL && stats->count == count,
+        "cf_update_glob_stats of %d files has an entry per file", count);
+    errors = 0;
+    for (i = 0; stats && i < stats->count; i++) {
+        snprintf (contents, sizeof (contents), "[tab%d]\nid = %d\n", i, i);
+        if (strcmp (stats->files[i].filename, path[i]) != 0
+            || stats->files[i].size != strlen (contents))
+            errors++;
+    }
+    ok (errors == 0,
+        "entries have the filename and size of each file in glob order");
+    ok (cf_int64 (cf_get_in (cf_get_in (cf, "tab0"), "id")) == 0,
+        "config was loaded");
+    cf_stats_destroy (stats);
+    cf_destroy (cf);
+
+    for (i = 0; i < count; i++) {
+        if (unlink (path[i]) < 0)
+            BAIL_OUT ("unlink: %s", strerror (errno));
+    }
+    if (rmdir (dir) < 0)
+        BAIL_OUT ("rmdir: %s: %s", dir, strerror (errno));
+}
+
+void test_update_glob_stats (void)
+{
+    struct cf_error error;
+    struct cf_stats *stats;
+    cf_t *cf;
+
+    check_glob_stats (2);
+    check_glob_stats (8);
+
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create: %s", strerror (errno));
+    stats = NULL;
+    ok (cf_update_glob_stats (cf, "/noexist*", &stats, &error) == 0
+        && stats != NULL && stats->count == 0,
+        "cf_update_glob_stats returns empty stats on no match");
+    cf_stats_destroy (stats);
+    errno = 0;
+    ok (cf_update_glob_stats (cf, "/noexist*", NULL, &error) < 0
+        && errno == EINVAL,
+        "cf_update_glob_stats stats=NULL fails with EINVAL");
+    cf_destroy (cf);
+}
+
+/* Overwrite 'path' in place with 'contents', then restore its mtime,
+ * so a change of the same size is invisible to the config cache.
+ */
+static void rewrite_file (const char *path, const char *contents)
+{
+    struct stat st;
+    struct timespec ts[2];
+    int fd;
+
+    if (stat (path, &st) < 0)
+        BAIL_OUT ("stat %s: %s", path, strerror (errno));
+    if ((fd = open (path, O_WRONLY | O_TRUNC)) < 0)
+        BAIL_OUT ("open %s: %s", path, strerror (errno));
+    if (write (fd, contents, strlen (contents)) != strlen (contents))
+        BAIL_OUT ("write %s: %s", path, strerror (errno));
+    if (close (fd) < 0)
+        BAIL_OUT ("close %s: %s", path, strerror (errno));
+    ts[0] = st.st_atim;
+    ts[1] = st.st_mtim;
+    if (utimensat (AT_FDCWD, path, ts, 0) < 0)
+        BAIL_OUT ("utimensat %s: %s", path, strerror (errno));
+}
+
+static int64_t get_i (const char *pattern, const char *cachefile, int *rc)
+{
+    struct cf_error error;
+    int64_t i = -1;
+    cf_t *cf;
+
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create: %s", strerror (errno));
+    *rc = cf_update_glob_cache (cf, pattern, cachefile, &error);
+    if (*rc < 0)
+        diag ("%s: %d: %s", error.filename, error.lineno, error.errbuf);
+    else if (cf_get_in (cf, "i"))
+        i = cf_int64 (cf_get_in (cf, "i"));
+    cf_destroy (cf);
+    return i;
+}
+
+void test_update_glob_cache (void)
+{
+    const char *tmpdir = getenv ("TMPDIR");
+    char dir[PATH_MAX + 1];
+    char path[PATH_MAX + 1];
+    char invalid[PATH_MAX + 1];
+    char cachefile[PATH_MAX + 1];
+    char p[8192];
+    char buf[16];
+    struct stat st;
+    struct timespec ts[2];
+    int fd;
+    int rc;
+
+    ok (cf_cache_path ("/a/b/*.toml", buf, sizeof (buf)) == 0
+        && !strcmp (buf, "/a/b/.cf-cache"),
+        "cf_cache_path puts cache in pattern directory");
+    ok (cf_cache_path ("*.toml", buf, sizeof (buf)) == 0
+        && !strcmp (buf, ".cf-cache"),
+        "cf_cache_path works with no directory");
+    errno = 0;
+    ok (cf_cache_path ("/a/b/c/d/e/*.toml", buf, sizeof (buf)) < 0
+        && errno == EOVERFLOW,
+        "cf_cache_path fails with EOVERFLOW if buffer is too small");
+    errno = 0;
+    ok (cf_cache_path (NULL, buf, sizeof (buf)) < 0 && errno == EINVAL,
+        "cf_cache_path pattern=NULL fails with EINVAL");
+
+    snprintf (dir, sizeof (dir), "%s/cf.XXXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp (dir))
+        BAIL_OUT ("mkdtemp %s: %s", dir, strerror (errno));
+    create_test_file (dir, "01", path, sizeof (path), "i = 1\n");
+    snprintf (p, sizeof (p), "%s/*.toml", dir);
+    if (cf_cache_path (p, cachefile, sizeof (cachefile)) < 0)
+        BAIL_OUT ("cf_cache_path: %s", strerror (errno));
+
+    ok (get_i (p, cachefile, &rc) == 1 && rc == 1,
+        "cf_update_glob_cache works with no cache file");
+    ok (stat (cachefile, &st) < 0 && errno == ENOENT,
+        "cache file is not created if it does not exist");
+
+    if ((fd = open (cachefile, O_WRONLY | O_CREAT, 0644)) < 0 || close (fd) < 0)
+        BAIL_OUT ("create %s: %s", cachefile, strerror (errno));
+    ok (get_i (p, cachefile, &rc) == 1 && rc == 1,
+        "cf_update_glob_cache works with empty cache file");
+    ok (stat (cachefile, &st) == 0 && st.st_size > 0
+        && (st.st_mode & 0777) == 0644,
+        "empty cache file was filled in with mode 0644");
+
+    rewrite_file (path, "i = 2\n");
+    ok (get_i (p, cachefile, &rc) == 1 && rc == 1,
+        "config is loaded from cache when sources look unchanged");
+
+    ts[0].tv_sec = ts[1].tv_sec = 1000;
+    ts[0].tv_nsec = ts[1].tv_nsec = 0;
+    if (utimensat (AT_FDCWD, path, ts, 0) < 0)
+        BAIL_OUT ("utimensat %s: %s", path, strerror (errno));
+    ok (get_i (p, cachefile, &rc) == 2 && rc == 1,
+        "cache is stale when a source mtime changes");
+    rewrite_file (path, "i = 3\n");
+    ok (get_i (p, cachefile, &rc) == 2 && rc == 1,
+        "stale cache was rewritten");
+
+    if (truncate (cachefile, 0) < 0)
+        BAIL_OUT ("truncate %s: %s", cachefile, strerror (errno));
+    ok (get_i (p, cachefile, &rc) == 2 && rc == 1,
+        "config is reused from memory while the cache file is trusted");
+    ok (stat (cachefile, &st) == 0 && st.st_size == 0,
+        "cache file was not read or rewritten");
+
+    if (chmod (cachefile, 0664) < 0)
+        BAIL_OUT ("chmod %s: %s", cachefile, strerror (errno));
+    ok (get_i (p, cachefile, &rc) == 3 && rc == 1,
+        "group writable cache file is ignored");
+    ok (stat (cachefile, &st) == 0 && (st.st_mode & 0777) == 0664,
+        "group writable cache file is not rewritten");
+    if (chmod (cachefile, 0644) < 0)
+        BAIL_OUT ("chmod %s: %s", cachefile, strerror (errno));
+
+    create_test_file (dir, "99", invalid, sizeof (invalid), "key = \n");
+    errno = 0;
+    ok (get_i (p, cachefile, &rc) < 0 && rc < 0 && errno == EINVAL,
+        "cf_update_glob_cache fails when a new file fails to parse");
+    if (unlink (invalid) < 0)
+        BAIL_OUT ("unlink: %s", strerror (errno));
+
+    ok (get_i ("/noexist*", cachefile, &rc) < 0 && rc == 0,
+        "cf_update_glob_cache returns 0 on no match");
+
+    if (unlink (path) < 0 || unlink (cachefile) < 0)
+        BAIL_OUT ("unlink: %s", strerror (errno));
+    if (rmdir (dir) < 0)
+        BAIL_OUT ("rmdir: %s: %s", dir, strerror (errno));
+}
+
 void test_check (void)
 {
     cf_t *cf;
@@ -545,6 +838,27 @@ void test_check (void)
     ok (rc < 0 && errno == EINVAL,
         "cf_check flags=CF_STRICT fails with extra key");
     cfdiag (rc, "cf_check", &error);
+    like (error.errbuf, "key 'i' is unknown",
+          "error names the extra key");
+
+    errno = 0;
+    rc = cf_check (cf, opts_extra, CF_STRICT | CF_ANYTAB, &error);
+    ok (rc < 0 && errno == EINVAL,
+        "cf_check flags=CF_STRICT|CF_ANYTAB fails with extra non-table key");
+    cfdiag (rc, "cf_check", &error);
+
+    rc = cf_check (cf, opts_notab, CF_STRICT | CF_ANYTAB, &error);
+    ok (rc == 0,
+        "cf_check flags=CF_STRICT|CF_ANYTAB allows extra table");
+    cfdiag (rc, "cf_check", &error);
+
+    errno = 0;
+    rc = cf_check (cf, opts_notab, CF_STRICT, &error);
+    ok (rc < 0 && errno == EINVAL,
+        "cf_check flags=CF_STRICT fails with extra table");
+    cfdiag (rc, "cf_check", &error);
+    like (error.errbuf, "key 'tab' is unknown",
+          "error names the extra table");
 
     /* Missing key.
      */
@@ -570,6 +884,43 @@ void test_check (void)
     cf_destroy (cf);
 }
 
+void test_resolve (void)
+{
+    cf_t *cf;
+    const cf_t *val[9];
+    struct cf_error error;
+    int rc;
+
+    if (!(cf = cf_create ()))
+        BAIL_OUT ("cf_create");
+    if (cf_update (cf, t1, strlen (t1), NULL) < 0)
+        BAIL_OUT ("cf_update");
+
+    memset (val, 0, sizeof (val));
+    val[8] = cf;
+    rc = cf_resolve (cf, opts_optional, CF_STRICT, val, &error);
+    ok (rc == 0,
+        "cf_resolve works");
+    cfdiag (rc, "cf_resolve", &error);
+    ok (val[0] == cf_get_in (cf, "i") && cf_int64 (val[0]) == 1
+        && cf_bool (val[3]) == true
+        && !strcmp (cf_string (val[2]), "foo")
+        && val[6] == cf_get_in (cf, "tab"),
+        "cf_resolve stored values in option order");
+    ok (val[7] == NULL,
+        "cf_resolve stored NULL for missing optional key");
+    ok (val[8] == cf,
+        "cf_resolve did not write past the end of the options");
+
+    errno = 0;
+    rc = cf_resolve (cf, opts_wrongtype, 0, val, &error);
+    ok (rc < 0 && errno == EINVAL,
+        "cf_resolve fails on wrong type");
+    cfdiag (rc, "cf_resolve", &error);
+
+    cf_destroy (cf);
+}
+
 void test_array_contains (void)
 {
     const char *array1 = "array = [ \"foo\", \"bar\", \"baz\" ]";
@@ -625,6 +976,89 @@ void test_array_contains (void)
     cf_destroy (tab);
 }
 
+void test_set (void)
+{
+    const char *input = "array = [ \"foo\", \"bar\", \"baz\", \"foo\" ]\n"
+                        "mixed = [ 1, 2 ]\n"
+                        "str = \"foo\"\n";
+    cf_t *tab;
+    cf_set_t *set;
+
+    if (!(tab = cf_create ()))
+        BAIL_OUT ("cf_create");
+    if (cf_update (tab, input, strlen (input), NULL) < 0)
+        BAIL_OUT ("cf_update");
+
+    set = cf_set_create (cf_get_in (tab, "array"));
+    ok (set != NULL,
+        "cf_set_create works");
+    ok (cf_set_size (set) == 3,
+        "cf_set_size returns number of distinct strings");
+    ok (cf_set_contains (set, "foo")
+        && cf_set_contains (set, "bar")
+        && cf_set_contains (set, "baz"),
+        "cf_set_contains returns true for all members");
+    ok (cf_set_contains (set, "foob") == false
+        && cf_set_contains (set, "fo") == false
+        && cf_set_contains (set, "") == false,
+        "cf_set_contains returns false for non-members");
+    ok (cf_set_contains (set, NULL) == false,
+        "cf_set_contains (set, NULL) returns false");
+    ok (cf_set_contains (NULL, "foo") == false,
+        "cf_set_contains (NULL, \"foo\") returns false");
+    cf_set_destroy (set);
+
+    set = cf_set_create (cf_get_in (tab, "mixed"));
+    ok (set != NULL && cf_set_size (set) == 0
+        && cf_set_contains (set, "1") == false,
+        "cf_set_create ignores non-string elements");
+    cf_set_destroy (set);
+
+    set = cf_set_create (NULL);
+    ok (set != NULL && cf_set_size (set) == 0,
+        "cf_set_create (NULL) creates empty set");
+    ok (cf_set_contains (set, "foo") == false,
+        "cf_set_contains returns false for empty set");
+    cf_set_destroy (set);
+
+    set = cf_set_create (cf_get_in (tab, "str"));
+    ok (set != NULL && cf_set_size (set) == 0,
+        "cf_set_create of a non-array creates empty set");
+    cf_set_destroy (set);
+
+    cf_set_destroy (NULL);
+    cf_destroy (tab);
+}
+
+void test_equal (void)
+{
+    const char *t1 = "a = 1\n[tab]\nb = [ \"x\", \"y\" ]\n";
+    const char *t2 = "a = 1\n[tab]\nb = [ \"x\", \"z\" ]\n";
+    cf_t *cf1;
+    cf_t *cf2;
+
+    if (!(cf1 = cf_create ()) || !(cf2 = cf_create ()))
+        BAIL_OUT ("cf_create");
+    if (cf_update (cf1, t1, strlen (t1), NULL) < 0
+        || cf_update (cf2, t2, strlen (t2), NULL) < 0)
+        BAIL_OUT ("cf_update");
+
+    ok (cf_equal (NULL, NULL) == true,
+        "cf_equal (NULL, NULL) returns true");
+    ok (cf_equal (cf1, NULL) == false && cf_equal (NULL, cf1) == false,
+        "cf_equal returns false if only one object is NULL");
+    ok (cf_equal (cf1, cf1) == true,
+        "cf_equal returns true for the same object");
+    ok (cf_equal (cf_get_in (cf1, "a"), cf_get_in (cf2, "a")) == true,
+        "cf_equal returns true for equal values in different tables");
+    ok (cf_equal (cf1, cf2) == false,
+        "cf_equal returns false if a nested array element differs");
+    ok (cf_equal (cf_get_in (cf1, "a"), cf_get_in (cf1, "tab")) == false,
+        "cf_equal returns false for objects of different type");
+
+    cf_destroy (cf1);
+    cf_destroy (cf2);
+}
 
 int main (int argc, char *argv[])
 {
@@ -635,8 +1069,14 @@ int main (int argc, char *argv[])
     test_corner ();
     test_update_file ();
     test_update_glob ();
+    test_update_glob_parallel ();
+    test_update_glob_stats ();
+    test_update_glob_cache ();
     test_check ();
+    test_resolve ();
     test_array_contains ();
+    test_set ();
+    test_equal ();
 
     done_testing ();
 }
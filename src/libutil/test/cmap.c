@@ -0,0 +1,357 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cmap.h"
+
+#include "src/libtap/tap.h"
+
+struct val {
+    uint64_t key;
+    uint64_t check;     // ~key, to detect torn reads
+};
+
+static void sanity_checks (void)
+{
+    struct cmap *map;
+
+    errno = 0;
+    ok (cmap_create (0, 8) == NULL && errno == EINVAL,
+        "cmap_create keysz=0 fails with EINVAL");
+    errno = 0;
+    ok (cmap_get (NULL, "x", NULL) < 0 && errno == EINVAL,
+        "cmap_get map=NULL fails with EINVAL");
+    errno = 0;
+    ok (cmap_put (NULL, "x", "y") < 0 && errno == EINVAL,
+        "cmap_put map=NULL fails with EINVAL");
+    errno = 0;
+    ok (cmap_remove (NULL, "x") < 0 && errno == EINVAL,
+        "cmap_remove map=NULL fails with EINVAL");
+    errno = 0;
+    ok (cmap_count (NULL) < 0 && errno == EINVAL,
+        "cmap_count map=NULL fails with EINVAL");
+
+    if (!(map = cmap_create (4, 4)))
+        BAIL_OUT ("cmap_create failed");
+    errno = 0;
+    ok (cmap_put (map, "abc", NULL) < 0 && errno == EINVAL,
+        "cmap_put val=NULL fails with EINVAL");
+    errno = 0;
+    ok (cmap_remove_if (map, NULL, NULL) < 0 && errno == EINVAL,
+        "cmap_remove_if fn=NULL fails with EINVAL");
+    cmap_destroy (map);
+    cmap_destroy (NULL);
+}
+
+static void test_basic (void)
+{
+    struct cmap *map;
+    char val[4];
+
+    if (!(map = cmap_create (4, 4)))
+        BAIL_OUT ("cmap_create failed");
+    ok (cmap_count (map) == 0,
+        "cmap_count on new map is 0");
+    errno = 0;
+    ok (cmap_get (map, "foo", val) < 0 && errno == ENOENT,
+        "cmap_get of missing key fails with ENOENT");
+    ok (cmap_put (map, "foo", "aaa") == 0,
+        "cmap_put foo=aaa works");
+    ok (cmap_put (map, "bar", "bbb") == 0,
+        "cmap_put bar=bbb works");
+    ok (cmap_count (map) == 2,
+        "cmap_count is 2");
+    ok (cmap_get (map, "foo", val) == 0 && !strcmp (val, "aaa"),
+        "cmap_get foo returns aaa");
+    ok (cmap_get (map, "bar", NULL) == 0,
+        "cmap_get bar with val=NULL works");
+    ok (cmap_put (map, "foo", "ccc") == 0,
+        "cmap_put foo=ccc replaces value");
+    ok (cmap_count (map) == 2,
+        "cmap_count is still 2");
+    ok (cmap_get (map, "foo", val) == 0 && !strcmp (val, "ccc"),
+        "cmap_get foo returns ccc");
+    ok (cmap_remove (map, "foo") == 0,
+        "cmap_remove foo works");
+    errno = 0;
+    ok (cmap_remove (map, "foo") < 0 && errno == ENOENT,
+        "cmap_remove foo again fails with ENOENT");
+    errno = 0;
+    ok (cmap_get (map, "foo", val) < 0 && errno == ENOENT,
+        "cmap_get foo fails with ENOENT");
+    ok (cmap_get (map, "bar", val) == 0 && !strcmp (val, "bbb"),
+        "cmap_get bar still returns bbb");
+    ok (cmap_count (map) == 1,
+        "cmap_count is 1");
+    cmap_destroy (map);
+}
+
+static bool match_odd (const void *key, const void *val, void *arg)
+{
+    uint64_t k;
+    int *calls = arg;
+
+    memcpy (&k, key, sizeof (k));
+    (*calls)++;
+    return (k % 2) == 1;
+}
+
+static void test_many (void)
+{
+    struct cmap *map;
+    struct val v;
+    uint64_t i;
+    int n = 10000;
+    int errors;
+    int calls = 0;
+
+    if (!(map = cmap_create (sizeof (uint64_t), sizeof (struct val))))
+        BAIL_OUT ("cmap_create failed");
+
+    errors = 0;
+    for (i = 0; i < n; i++) {
+        v.key = i;
+        v.check = ~i;
+        if (cmap_put (map, &i, &v) < 0)
+            errors++;
+    }
+    ok (errors == 0 && cmap_count (map) == n,
+        "cmap_put of %d keys works, growing the table", n);
+
+    errors = 0;
+    for (i = 0; i < n; i++) {
+        if (cmap_get (map, &i, &v) < 0 || v.key != i || v.check != ~i)
+            errors++;
+    }
+    ok (errors == 0,
+        "cmap_get of %d keys returns correct values", n);
+
+    ok (cmap_remove_if (map, match_odd, &calls) == n / 2,
+        "cmap_remove_if removed %d odd keys", n / 2);
+    ok (calls == n,
+        "cmap_remove_if called match function for each entry");
+    ok (cmap_count (map) == n / 2,
+        "cmap_count is %d", n / 2);
+
+    errors = 0;
+    for (i = 0; i < n; i++) {
+        int rc = cmap_get (map, &i, &v);
+        if ((i % 2 == 0 && (rc < 0 || v.key != i))
+            || (i % 2 == 1 && rc == 0))
+            errors++;
+    }
+    ok (errors == 0,
+        "only even keys remain");
+
+    /* Reinsert odd keys, reusing tombstones or rebuilding the table.
+     */
+    errors = 0;
+    for (i = 1; i < n; i += 2) {
+        v.key = i;
+        v.check = ~i;
+        if (cmap_put (map, &i, &v) < 0)
+            errors++;
+    }
+    for (i = 0; i < n; i++) {
+        if (cmap_get (map, &i, &v) < 0 || v.key != i || v.check != ~i)
+            errors++;
+    }
+    ok (errors == 0 && cmap_count (map) == n,
+        "odd keys can be reinserted");
+
+    /* Churn: repeated insert/remove must not exhaust empty slots.
+     */
+    errors = 0;
+    for (i = n; i < 20 * n; i++) {
+        v.key = i;
+        v.check = ~i;
+        if (cmap_put (map, &i, &v) < 0 || cmap_remove (map, &i) < 0)
+            errors++;
+    }
+    ok (errors == 0 && cmap_count (map) == n,
+        "insert/remove churn works");
+
+    cmap_destroy (map);
+}
+
+#define NREADERS 4
+#define NKEYS 1000
+
+struct stress {
+    struct cmap *map;
+    int done;
+    int errors;
+    long lookups;
+};
+
+static void *reader_thread (void *arg)
+{
+    struct stress *s = arg;
+    uint64_t i = 0;
+    long lookups = 0;
+    int errors = 0;
+    struct val v;
+
+    while (!__atomic_load_n (&s->done, __ATOMIC_ACQUIRE)) {
+        uint64_t key = i++ % NKEYS;
+        if (cmap_get (s->map, &key, &v) == 0) {
+            if (v.check != ~v.key || v.key % NKEYS != key)
+                errors++;
+        }
+        /* keys below NKEYS / 2 are never removed */
+        else if (key < NKEYS / 2)
+            errors++;
+        lookups++;
+    }
+    __atomic_fetch_add (&s->errors, errors, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&s->lookups, lookups, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void test_threads (void)
+{
+    struct stress s = { 0 };
+    pthread_t t[NREADERS];
+    struct val v;
+    uint64_t key;
+    int i;
+    int round;
+
+    if (!(s.map = cmap_create (sizeof (uint64_t), sizeof (struct val))))
+        BAIL_OUT ("cmap_create failed");
+    for (key = 0; key < NKEYS; key++) {
+        v.key = key;
+        v.check = ~key;
+        if (cmap_put (s.map, &key, &v) < 0)
+            BAIL_OUT ("cmap_put failed");
+    }
+    for (i = 0; i < NREADERS; i++) {
+        if (pthread_create (&t[i], NULL, reader_thread, &s) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    /* Replace values of all keys, and remove and reinsert the upper
+     * half, while readers run.
+     */
+    for (round = 1; round <= 50; round++) {
+        for (key = 0; key < NKEYS; key++) {
+            v.key = key + (uint64_t)round * NKEYS;
+            v.check = ~v.key;
+            if (key >= NKEYS / 2 && (key + round) % 3 == 0)
+                (void)cmap_remove (s.map, &key);
+            else
+                (void)cmap_put (s.map, &key, &v);
+        }
+    }
+    __atomic_store_n (&s.done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < NREADERS; i++)
+        pthread_join (t[i], NULL);
+
+    ok (s.errors == 0,
+        "%d readers saw consistent values during %d updates (%ld lookups)",
+        NREADERS, 50 * NKEYS, s.lookups);
+    cmap_destroy (s.map);
+}
+
+#define NWRITERS 4
+
+static void *same_key_reader (void *arg)
+{
+    struct stress *s = arg;
+    uint64_t key = 0;
+    long lookups = 0;
+    int errors = 0;
+    struct val v;
+
+    while (!__atomic_load_n (&s->done, __ATOMIC_ACQUIRE)) {
+        if (cmap_get (s->map, &key, &v) < 0 || v.check != ~v.key)
+            errors++;
+        lookups++;
+    }
+    __atomic_fetch_add (&s->errors, errors, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&s->lookups, lookups, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *same_key_writer (void *arg)
+{
+    struct stress *s = arg;
+    uint64_t key = 0;
+    struct val v;
+    int i;
+
+    for (i = 0; i < 20000; i++) {
+        v.key = i;
+        v.check = ~v.key;
+        if (cmap_put (s->map, &key, &v) < 0)
+            __atomic_fetch_add (&s->errors, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* Several writers replace the value of one key while readers look it up,
+ * so each replaced entry is freed while lookups that began under either
+ * phase may still be reading it.  Run under ASan/TSan to catch use after
+ * free.
+ */
+static void test_same_key (void)
+{
+    struct stress s = { 0 };
+    pthread_t r[NREADERS];
+    pthread_t w[NWRITERS];
+    struct val v = { .key = 0, .check = ~(uint64_t)0 };
+    uint64_t key = 0;
+    int i;
+
+    if (!(s.map = cmap_create (sizeof (uint64_t), sizeof (struct val))))
+        BAIL_OUT ("cmap_create failed");
+    if (cmap_put (s.map, &key, &v) < 0)
+        BAIL_OUT ("cmap_put failed");
+    for (i = 0; i < NREADERS; i++) {
+        if (pthread_create (&r[i], NULL, same_key_reader, &s) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    for (i = 0; i < NWRITERS; i++) {
+        if (pthread_create (&w[i], NULL, same_key_writer, &s) != 0)
+            BAIL_OUT ("pthread_create failed");
+    }
+    for (i = 0; i < NWRITERS; i++)
+        pthread_join (w[i], NULL);
+    __atomic_store_n (&s.done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < NREADERS; i++)
+        pthread_join (r[i], NULL);
+
+    ok (s.errors == 0,
+        "%d readers saw consistent values while %d writers replaced one key"
+        " (%ld lookups)", NREADERS, NWRITERS, s.lookups);
+    cmap_destroy (s.map);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    sanity_checks ();
+    test_basic ();
+    test_many ();
+    test_threads ();
+    test_same_key ();
+
+    done_testing ();
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -259,6 +259,91 @@ static void test_delete ()
 }
 
 
+static int strcmpf (const void *x, const void *y)
+{
+    return strcmp (x, y);
+}
+
+static int delete_odd (void *data, const void *key, void *arg)
+{
+    return ((unsigned long) data & 1);
+}
+
+/*  Insert enough items to force the table to grow several times,
+ *   then check every item can be found, removed and deleted.
+ */
+static void test_resize ()
+{
+    const int n = 10000;
+    char (*keys)[16];
+    hash_t h;
+    int i;
+    int found = 0;
+    int removed = 0;
+
+    if (!(keys = calloc (n, sizeof (*keys))))
+        BAIL_OUT ("calloc failed");
+    h = hash_create (0, (hash_key_f) hash_key_string, strcmpf, NULL);
+    ok (h != NULL, "hash_create for resize test");
+    for (i = 0; i < n; i++) {
+        snprintf (keys[i], sizeof (keys[i]), "key%d", i);
+        if (!hash_insert (h, keys[i], fake_data (i)))
+            break;
+    }
+    ok (i == n && hash_count (h) == n,
+        "inserted %d items into a growing table", n);
+    for (i = 0; i < n; i++) {
+        char key[16];
+        snprintf (key, sizeof (key), "key%d", i);
+        if (hash_find (h, key) == fake_data (i))
+            found++;
+    }
+    ok (found == n, "hash_find finds all items by equal key");
+    ok (hash_find (h, "key-1") == NULL && errno == 0,
+        "hash_find of missing key returns NULL with errno == 0");
+    ok (hash_insert (h, "key42", (void *) 0x1) == NULL && errno == EEXIST,
+        "hash_insert of duplicate key fails with EEXIST after resize");
+
+    for (i = 0; i < n; i += 3) {
+        if (hash_remove (h, keys[i]) == fake_data (i))
+            removed++;
+    }
+    ok (hash_count (h) == n - removed && removed == (n + 2) / 3,
+        "hash_remove removed %d items", removed);
+    found = 0;
+    for (i = 0; i < n; i++) {
+        void *x = hash_find (h, keys[i]);
+        if ((i % 3 == 0 && x == NULL) || (i % 3 != 0 && x == fake_data (i)))
+            found++;
+    }
+    ok (found == n, "remaining items are found after removals");
+
+    /*  fake_data (i) is odd for even i */
+    removed = hash_delete_if (h, delete_odd, NULL);
+    ok (hash_count (h) == n - (n + 2) / 3 - removed,
+        "hash_delete_if deleted %d items", removed);
+    ok (hash_for_each (h, delete_odd, NULL) == 0,
+        "no matching items remain after hash_delete_if");
+    ok (hash_for_each (h, (hash_arg_f) foreach, NULL) == hash_count (h),
+        "hash_for_each visits every remaining item");
+
+    hash_destroy (h);
+    free (keys);
+}
+
+static void test_key_string ()
+{
+    char a[] = "foo";
+    char b[] = "foo";
+
+    ok (hash_key_string (a) == hash_key_string (b),
+        "hash_key_string is equal for equal strings");
+    ok (hash_key_string ("foo") != hash_key_string ("bar"),
+        "hash_key_string differs for different strings");
+    ok (hash_key_string ("") == hash_key_string (""),
+        "hash_key_string works for empty string");
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -268,6 +353,8 @@ main (int argc, char *argv[])
     test_for_each ();
     test_chaining ();
     test_delete ();
+    test_resize ();
+    test_key_string ();
 
     hash_drop_memory ();
 
@@ -14,6 +14,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
@@ -196,8 +197,8 @@ static void check_expansion (void)
 
     /* Add entries
      * Each entry wil be 32+3 + 1 + 32 + 1 = 69 bytes.
-     * Add 100 of them to ensure 4096 byte "chunk size" is exceeded,
-     * so object has to grow at least once.
+     * Add 100 of them to ensure the minimum buffer size is exceeded,
+     * so object has to grow more than once.
      */
     for (i = 0; i < 100; i++) {
         snprintf (keybuf, sizeof (keybuf), "key%032d", i);
@@ -224,6 +225,7 @@ static void bad_parameters (void)
 {
     struct kv *kv;
     struct kv *kv2;
+    struct kv *kv3;
     const char *s;
     const char *entry;
     int len;
@@ -339,6 +341,16 @@ static void bad_parameters (void)
     errno = 0;
     ok (kv_decode ("foo\0sbar\0\0sfoobar\0", 18) == NULL && errno == EINVAL,
         "kv_decode buf=(empty key entry) fails with EINVAL");
+    errno = 0;
+    ok (kv_decode ("foo\0xbar\0", 9) == NULL && errno == EINVAL,
+        "kv_decode buf=(bad type hint) fails with EINVAL");
+    errno = 0;
+    ok (kv_decode ("foo\0sbar\0baz\0", 14) == NULL && errno == EINVAL,
+        "kv_decode buf=(key without value) fails with EINVAL");
+    ok ((kv3 = kv_decode ("foo\0s\0", 6)) != NULL
+        && kv_get (kv3, "foo", KV_STRING, &s) == 0 && !strcmp (s, ""),
+        "kv_decode buf=(empty string value) works");
+    kv_destroy (kv3);
 
     kv_destroy (kv);
     kv_destroy (kv2);
@@ -474,6 +486,759 @@ void join_split (void)
     kv_destroy (kv);
 }
 
+void decode_into (void)
+{
+    struct kv *kv;
+    const char *s;
+    int64_t i;
+
+    if (!(kv = kv_create ()))
+        BAIL_OUT ("kv_create failed");
+    ok (kv_decode_into (kv, "foo\0sbar\0", 9) == 0,
+        "kv_decode_into works");
+    ok (kv_get (kv, "foo", KV_STRING, &s) == 0 && !strcmp (s, "bar"),
+        "kv_get retrieves decoded entry");
+    ok (kv_decode_into (kv, "baz\0i42\0", 8) == 0,
+        "kv_decode_into works on already populated kv");
+    ok (kv_get (kv, "baz", KV_INT64, &i) == 0 && i == 42
+        && kv_get (kv, "foo", KV_STRING, &s) < 0,
+        "previous contents were replaced");
+    errno = 0;
+    ok (kv_decode_into (kv, "foo\0sbar", 8) < 0 && errno == EINVAL,
+        "kv_decode_into buf=(unterm) fails with EINVAL");
+    ok (kv_next (kv, NULL) == NULL,
+        "kv is empty after failure");
+    ok (kv_decode_into (kv, NULL, 0) == 0 && kv_next (kv, NULL) == NULL,
+        "kv_decode_into len=0 works");
+    errno = 0;
+    ok (kv_decode_into (NULL, "foo\0sbar\0", 9) < 0 && errno == EINVAL,
+        "kv_decode_into kv=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_decode_into (kv, NULL, 1) < 0 && errno == EINVAL,
+        "kv_decode_into buf=NULL len=1 fails with EINVAL");
+    kv_destroy (kv);
+}
+
+/* Objects large enough to have a key index.
+ */
+static int check_keys (struct kv *kv, int start, int end)
+{
+    char key[32];
+    int64_t val;
+    int errors = 0;
+    int i;
+
+    for (i = start; i < end; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if (kv_get (kv, key, KV_INT64, &val) < 0 || val != i)
+            errors++;
+    }
+    return errors;
+}
+
+void large_object (void)
+{
+    struct kv *kv;
+    struct kv *kv2;
+    char key[32];
+    const char *buf;
+    const char *entry;
+    const char *s;
+    int len;
+    int count;
+    int errors;
+    int i;
+
+    if (!(kv = kv_create ()))
+        BAIL_OUT ("kv_create failed");
+    errors = 0;
+    for (i = 0; i < 1000; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if (kv_put (kv, key, KV_INT64, (int64_t)i) < 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "kv_put of 1000 keys works");
+    ok (check_keys (kv, 0, 1000) == 0,
+        "kv_get finds all 1000 keys");
+    errno = 0;
+    ok (kv_get (kv, "key1000", KV_INT64, NULL) < 0 && errno == ENOENT,
+        "kv_get of missing key fails with ENOENT");
+    errno = 0;
+    ok (kv_get (kv, "key10", KV_STRING, NULL) < 0 && errno == ENOENT,
+        "kv_get of key with wrong type fails with ENOENT");
+
+    /* Encoding keeps insertion order, with an updated key moved to the end.
+     */
+    ok (kv_put (kv, "key500", KV_STRING, "updated") == 0
+        && kv_get (kv, "key500", KV_STRING, &s) == 0
+        && !strcmp (s, "updated"),
+        "kv_put updates a key");
+    count = 0;
+    entry = NULL;
+    while ((entry = kv_next (kv, entry))) {
+        snprintf (key, sizeof (key), "key%d", count < 500 ? count : count + 1);
+        if (count == 999)
+            snprintf (key, sizeof (key), "key500");
+        if (strcmp (entry, key) != 0)
+            break;
+        count++;
+    }
+    ok (count == 1000,
+        "encoding has entries in insertion order");
+    ok (check_keys (kv, 0, 500) == 0 && check_keys (kv, 501, 1000) == 0,
+        "kv_get finds other keys after update");
+
+    errors = 0;
+    for (i = 0; i < 1000; i += 2) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if (kv_delete (kv, key) < 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "kv_delete of even keys works");
+    errors = 0;
+    for (i = 0; i < 1000; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if ((kv_get (kv, key, KV_INT64, NULL) == 0) != (i % 2 == 1))
+            errors++;
+    }
+    ok (errors == 0,
+        "only odd keys remain");
+
+    /* Decoded and copied objects are indexed too.
+     */
+    if (kv_encode (kv, &buf, &len) < 0)
+        BAIL_OUT ("kv_encode failed");
+    ok ((kv2 = kv_decode (buf, len)) != NULL
+        && kv_equal (kv, kv2)
+        && check_keys (kv2, 999, 1000) == 0
+        && kv_get (kv2, "key998", KV_INT64, NULL) < 0,
+        "kv_decode of large object works");
+    kv_destroy (kv2);
+    ok ((kv2 = kv_copy (kv)) != NULL
+        && kv_equal (kv, kv2)
+        && check_keys (kv2, 1, 2) == 0
+        && kv_get (kv2, "key2", KV_INT64, NULL) < 0,
+        "kv_copy of large object works");
+
+    /* Decoding a small object into it drops the old index.
+     */
+    kv_destroy (kv);
+    if (!(kv = kv_create ()) || kv_put (kv, "a", KV_STRING, "b") < 0
+        || kv_encode (kv, &buf, &len) < 0)
+        BAIL_OUT ("kv_create/put/encode failed");
+    ok (kv_decode_into (kv2, buf, len) == 0
+        && kv_get (kv2, "a", KV_STRING, &s) == 0 && !strcmp (s, "b")
+        && kv_get (kv2, "key1", KV_INT64, NULL) < 0,
+        "kv_decode_into replaces indexed object");
+    kv_destroy (kv2);
+    kv_destroy (kv);
+}
+
+void join_replace (void)
+{
+    struct kv *kv1;
+    struct kv *kv2;
+    struct kv *expected;
+    struct kv_iter it;
+    char key[32];
+    int errors;
+    int i;
+
+    kv1 = kv_create ();
+    kv2 = kv_create ();
+    if (!kv1 || !kv2)
+        BAIL_OUT ("kv_create failed");
+    errors = 0;
+    for (i = 0; i < 1000; i++) {
+        snprintf (key, sizeof (key), "p.key%d", i);
+        if (kv_put (kv1, key, KV_INT64, (int64_t)i) < 0)
+            errors++;
+        if (i % 3 == 0) {
+            snprintf (key, sizeof (key), "key%d", i);
+            if (kv_put (kv2, key, KV_STRING, "replaced") < 0)
+                errors++;
+        }
+    }
+    if (kv_put (kv2, "new", KV_STRING, "added") < 0)
+        errors++;
+    if (errors > 0)
+        BAIL_OUT ("kv_put failed");
+
+    /* The join must leave entries in the order kv_put() of each would.
+     */
+    if (!(expected = kv_copy (kv1)))
+        BAIL_OUT ("kv_copy failed");
+    kv_iter_init (&it);
+    while (kv_iter_next (kv2, &it)) {
+        snprintf (key, sizeof (key), "p.%s", it.key);
+        if (kv_put (expected, key, KV_STRING, it.val) < 0)
+            BAIL_OUT ("kv_put failed");
+    }
+    ok (kv_join (kv1, kv2, "p.") == 0,
+        "kv_join replacing 334 of 1000 keys works");
+    ok (kv_equal (kv1, expected),
+        "kv_join result matches kv_put of each entry");
+    errors = 0;
+    for (i = 0; i < 1000; i++) {
+        int64_t val;
+        const char *s;
+        snprintf (key, sizeof (key), "p.key%d", i);
+        if (i % 3 == 0 ? kv_get (kv1, key, KV_STRING, &s) < 0
+                         || strcmp (s, "replaced") != 0
+                       : kv_get (kv1, key, KV_INT64, &val) < 0 || val != i)
+            errors++;
+    }
+    ok (errors == 0,
+        "kv_get finds replaced and other keys after kv_join");
+
+    kv_destroy (expected);
+    kv_destroy (kv2);
+    kv_destroy (kv1);
+}
+
+/* Decoded input may repeat a key.  A lookup finds the first occurrence,
+ * and deleting it exposes the next, with or without the index.
+ */
+void duplicate_keys (void)
+{
+    char buf[8192];
+    int len = 0;
+    struct kv *kv;
+    struct kv *kv2;
+    int64_t val;
+    int errors;
+    int i;
+
+    for (i = 0; i < 20; i++)
+        len += snprintf (buf + len, sizeof (buf) - len, "k%d%ci%d%c",
+                         i, '\0', i, '\0');
+    for (i = 0; i < 100; i++)
+        len += snprintf (buf + len, sizeof (buf) - len, "dup%ci%d%c",
+                         '\0', i, '\0');
+    if (!(kv = kv_decode (buf, len)))
+        BAIL_OUT ("kv_decode failed");
+    ok (kv_get (kv, "dup", KV_INT64, &val) == 0 && val == 0,
+        "kv_get of duplicated key finds first occurrence");
+    errors = 0;
+    for (i = 0; i < 100; i++) {
+        if (kv_get (kv, "dup", KV_INT64, &val) < 0 || val != i
+            || kv_delete (kv, "dup") < 0)
+            errors++;
+    }
+    ok (errors == 0,
+        "kv_delete of duplicated key exposes each later occurrence in turn");
+    errno = 0;
+    ok (kv_get (kv, "dup", KV_INT64, &val) < 0 && errno == ENOENT,
+        "kv_get fails with ENOENT once all occurrences are deleted");
+    errors = 0;
+    for (i = 0; i < 20; i++) {
+        char key[16];
+        snprintf (key, sizeof (key), "k%d", i);
+        if (kv_get (kv, key, KV_INT64, &val) < 0 || val != i)
+            errors++;
+    }
+    ok (errors == 0,
+        "other keys are still found");
+    kv_destroy (kv);
+
+    /* kv_join keeps the last of duplicated keys, as kv_put would,
+     * whether or not kv2 is large enough to be indexed.
+     */
+    if (!(kv = kv_decode (buf, len)) || !(kv2 = kv_create ()))
+        BAIL_OUT ("kv_decode failed");
+    ok (kv_join (kv2, kv, "p.") == 0
+        && kv_get (kv2, "p.dup", KV_INT64, &val) == 0 && val == 99
+        && kv_delete (kv2, "p.dup") == 0
+        && kv_get (kv2, "p.dup", KV_INT64, &val) < 0
+        && kv_get (kv2, "p.k19", KV_INT64, &val) == 0 && val == 19,
+        "kv_join of indexed kv2 with duplicate keys keeps the last value");
+    kv_destroy (kv);
+    kv_destroy (kv2);
+
+    len = 0;
+    for (i = 0; i < 3; i++)
+        len += snprintf (buf + len, sizeof (buf) - len, "dup%ci%d%c",
+                         '\0', i, '\0');
+    if (!(kv = kv_decode (buf, len)) || !(kv2 = kv_create ()))
+        BAIL_OUT ("kv_decode failed");
+    if (kv_put (kv2, "p.dup", KV_INT64, (int64_t)-1) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_join (kv2, kv, "p.") == 0
+        && kv_get (kv2, "p.dup", KV_INT64, &val) == 0 && val == 2
+        && kv_delete (kv2, "p.dup") == 0
+        && kv_get (kv2, "p.dup", KV_INT64, &val) < 0,
+        "kv_join of small kv2 with duplicate keys keeps the last value");
+    kv_destroy (kv);
+    kv_destroy (kv2);
+}
+
+void put_unique (void)
+{
+    struct kv *kv;
+    struct kv *kv2;
+    const char *buf;
+    const char *buf2;
+    int len;
+    int len2;
+    int64_t i;
+    const char *s;
+
+    if (!(kv = kv_create ()) || !(kv2 = kv_create ()))
+        BAIL_OUT ("kv_create failed");
+    ok (kv_reserve (kv, 64) == 0,
+        "kv_reserve works");
+    ok (kv_put_unique (kv, "a", KV_STRING, "foo") == 0
+        && kv_put_unique (kv, "b", KV_INT64, (int64_t)42) == 0
+        && kv_put_unique (kv, "c", KV_BOOL, true) == 0,
+        "kv_put_unique works");
+    ok (kv_get (kv, "a", KV_STRING, &s) == 0 && !strcmp (s, "foo")
+        && kv_get (kv, "b", KV_INT64, &i) == 0 && i == 42,
+        "kv_get finds values written with kv_put_unique");
+    if (kv_put (kv2, "a", KV_STRING, "foo") < 0
+        || kv_put (kv2, "b", KV_INT64, (int64_t)42) < 0
+        || kv_put (kv2, "c", KV_BOOL, true) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_encode (kv, &buf, &len) == 0 && kv_encode (kv2, &buf2, &len2) == 0
+        && len == len2 && !memcmp (buf, buf2, len),
+        "kv_put_unique encoding is the same as kv_put");
+    ok (kv_reserve (kv, 0) == 0,
+        "kv_reserve needsz=0 works");
+
+    errno = 0;
+    ok (kv_put_unique (NULL, "a", KV_STRING, "foo") < 0 && errno == EINVAL,
+        "kv_put_unique kv=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_put_unique (kv, "", KV_STRING, "foo") < 0 && errno == EINVAL,
+        "kv_put_unique key=\"\" fails with EINVAL");
+    errno = 0;
+    ok (kv_put_unique (kv, "d", KV_UNKNOWN, "foo") < 0 && errno == EINVAL,
+        "kv_put_unique type=KV_UNKNOWN fails with EINVAL");
+    errno = 0;
+    ok (kv_reserve (NULL, 1) < 0 && errno == EINVAL,
+        "kv_reserve kv=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_reserve (kv, -1) < 0 && errno == EINVAL,
+        "kv_reserve needsz=-1 fails with EINVAL");
+    kv_destroy (kv2);
+    kv_destroy (kv);
+}
+
+void split_into (void)
+{
+    struct kv *kv;
+    struct kv *kv1;
+    struct kv *kv2;
+    const char *s;
+    int64_t i;
+
+    kv = kv_create ();
+    kv1 = kv_create ();
+    kv2 = kv_create ();
+    if (!kv || !kv1 || !kv2)
+        BAIL_OUT ("kv_create failed");
+    if (kv_put (kv1, "a", KV_STRING, "x") < 0
+        || kv_put (kv1, "b", KV_INT64, (int64_t)1) < 0
+        || kv_put (kv, "top", KV_STRING, "y") < 0
+        || kv_put (kv, "p.b", KV_INT64, (int64_t)0) < 0)
+        BAIL_OUT ("kv_put failed");
+
+    /* kv has a key with the prefix, so the join replaces it.
+     */
+    ok (kv_join (kv, kv1, "p.") == 0
+        && kv_get (kv, "p.a", KV_STRING, &s) == 0 && !strcmp (s, "x")
+        && kv_get (kv, "p.b", KV_INT64, &i) == 0 && i == 1,
+        "kv_join replaces existing prefixed key");
+    ok (kv_join (kv, kv1, "q.") == 0
+        && kv_get (kv, "q.a", KV_STRING, &s) == 0 && !strcmp (s, "x")
+        && kv_get (kv, "top", KV_STRING, &s) == 0 && !strcmp (s, "y"),
+        "kv_join with new prefix appends");
+
+    if (kv_put (kv2, "stale", KV_STRING, "z") < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_split_into (kv, "q.", kv2) == 0 && kv_equal (kv1, kv2),
+        "kv_split_into replaces contents with split entries");
+    ok (kv_split_into (kv, "p.", kv2) == 0 && kv_equal (kv1, kv2),
+        "kv_split_into works again on the same object");
+    ok (kv_split_into (kv, "none.", kv2) == 0
+        && kv_get (kv2, "a", KV_STRING, NULL) < 0,
+        "kv_split_into with no match leaves empty object");
+
+    errno = 0;
+    ok (kv_split_into (NULL, "p.", kv2) < 0 && errno == EINVAL,
+        "kv_split_into kv=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_split_into (kv, "p.", NULL) < 0 && errno == EINVAL,
+        "kv_split_into kv2=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_split_into (kv, "p.", kv) < 0 && errno == EINVAL,
+        "kv_split_into kv2=kv fails with EINVAL");
+    errno = 0;
+    ok (kv_join (kv, kv, "p.") < 0 && errno == EINVAL,
+        "kv_join kv2=kv1 fails with EINVAL");
+
+    kv_destroy (kv2);
+    kv_destroy (kv1);
+    kv_destroy (kv);
+}
+
+void decode_swap (void)
+{
+    struct kv *kv;
+    struct kv *kv1;
+    const char *enc;
+    const char *s;
+    char *buf;
+    char *orig;
+    int bufsz;
+    int len;
+
+    kv = kv_create ();
+    kv1 = kv_create ();
+    if (!kv || !kv1)
+        BAIL_OUT ("kv_create failed");
+    if (kv_put (kv1, "a", KV_STRING, "x") < 0
+        || kv_put (kv1, "b", KV_INT64, (int64_t)1) < 0
+        || kv_put (kv, "stale", KV_STRING, "z") < 0)
+        BAIL_OUT ("kv_put failed");
+    if (kv_encode (kv1, &enc, &len) < 0)
+        BAIL_OUT ("kv_encode failed");
+    bufsz = len + 16;
+    if (!(buf = malloc (bufsz)))
+        BAIL_OUT ("malloc failed");
+    memcpy (buf, enc, len);
+    orig = buf;
+
+    ok (kv_decode_swap (kv, &buf, &bufsz, len) == 0 && kv_equal (kv, kv1),
+        "kv_decode_swap works");
+    ok (buf != orig && kv_encode (kv, &enc, &len) == 0 && enc == orig,
+        "kv_decode_swap adopted buffer and returned the old one");
+    ok (kv_get (kv, "stale", KV_STRING, &s) < 0,
+        "kv_decode_swap replaced previous contents");
+
+    /* Decode the returned buffer into another object, exchanging buffers
+     * again, as a caller reusing a single buffer would.
+     */
+    if (!buf || bufsz < len)
+        BAIL_OUT ("kv_decode_swap did not return a usable buffer");
+    memcpy (buf, enc, len);
+    orig = buf;
+    ok (kv_decode_swap (kv1, &buf, &bufsz, len) == 0 && kv_equal (kv, kv1),
+        "kv_decode_swap works with returned buffer");
+    ok (kv_encode (kv1, &enc, &len) == 0 && enc == orig,
+        "kv_decode_swap adopted returned buffer");
+
+    /* On failure the buffer is not exchanged and kv is emptied.
+     */
+    if (!buf)
+        BAIL_OUT ("kv_decode_swap did not return a buffer");
+    memcpy (buf, "junk", 4);
+    orig = buf;
+    errno = 0;
+    ok (kv_decode_swap (kv, &buf, &bufsz, 4) < 0 && errno == EINVAL
+        && buf == orig,
+        "kv_decode_swap of bad input fails with EINVAL, keeps buffer");
+    ok (kv_get (kv, "a", KV_STRING, &s) < 0
+        && kv_encode (kv, &enc, &len) == 0 && len == 0,
+        "kv_decode_swap failure leaves empty object");
+
+    errno = 0;
+    ok (kv_decode_swap (NULL, &buf, &bufsz, 0) < 0 && errno == EINVAL,
+        "kv_decode_swap kv=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_decode_swap (kv, NULL, &bufsz, 0) < 0 && errno == EINVAL,
+        "kv_decode_swap buf=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_decode_swap (kv, &buf, &bufsz, bufsz + 1) < 0 && errno == EINVAL,
+        "kv_decode_swap len > bufsz fails with EINVAL");
+
+    free (buf);
+    kv_destroy (kv1);
+    kv_destroy (kv);
+}
+
+void binary_encoding (void)
+{
+    struct kv *kv;
+    struct kv *kv2;
+    struct kv *kv3;
+    const char *buf;
+    const char *key;
+    int len;
+    int64_t i;
+    double d;
+    time_t t;
+    const char *s;
+    bool b;
+    int errors;
+    const int64_t ivals[] = { 0, 1, 256, -1, INT64_MIN, INT64_MAX };
+    const char bad[] = "a\0I\0\0\0\0\0\0\0";
+    int n;
+
+    kv = kv_create ();
+    if (!kv)
+        BAIL_OUT ("kv_create failed");
+    errno = 0;
+    ok (kv_set_encoding (kv, 42) < 0 && errno == EINVAL,
+        "kv_set_encoding encoding=42 fails with EINVAL");
+    errno = 0;
+    ok (kv_set_encoding (NULL, KV_ENCODING_BINARY) < 0 && errno == EINVAL,
+        "kv_set_encoding kv=NULL fails with EINVAL");
+    if (kv_put (kv, "text", KV_INT64, (int64_t)42) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_set_encoding (kv, KV_ENCODING_BINARY) == 0,
+        "kv_set_encoding KV_ENCODING_BINARY works");
+
+    errors = 0;
+    for (n = 0; n < sizeof (ivals) / sizeof (ivals[0]); n++) {
+        char name[16];
+        snprintf (name, sizeof (name), "i%d", n);
+        if (kv_put (kv, name, KV_INT64, ivals[n]) < 0
+            || kv_get (kv, name, KV_INT64, &i) < 0
+            || i != ivals[n])
+            errors++;
+    }
+    ok (errors == 0,
+        "binary int64 values round trip, including NUL bytes");
+    ok (kv_put (kv, "d", KV_DOUBLE, 1.0 / 3) == 0
+        && kv_get (kv, "d", KV_DOUBLE, &d) == 0 && d == 1.0 / 3,
+        "binary double keeps full precision");
+    ok (kv_put (kv, "t", KV_TIMESTAMP, (time_t)1700000000) == 0
+        && kv_get (kv, "t", KV_TIMESTAMP, &t) == 0 && t == 1700000000,
+        "binary timestamp round trips");
+    ok (kv_put (kv, "s", KV_STRING, "foo") == 0
+        && kv_put (kv, "b", KV_BOOL, true) == 0
+        && kv_get (kv, "s", KV_STRING, &s) == 0 && !strcmp (s, "foo")
+        && kv_get (kv, "b", KV_BOOL, &b) == 0 && b == true,
+        "string and bool values are unaffected");
+    ok (kv_get (kv, "text", KV_INT64, &i) == 0 && i == 42,
+        "text int64 added before kv_set_encoding is still readable");
+    ok (kv_put (kv, "text", KV_INT64, (int64_t)43) == 0
+        && kv_get (kv, "text", KV_INT64, &i) == 0 && i == 43,
+        "replacing text int64 with binary works");
+    ok (kv_get (kv, "t", KV_INT64, NULL) < 0 && errno == ENOENT,
+        "kv_get of binary timestamp as int64 fails with ENOENT");
+
+    key = NULL;
+    errors = 0;
+    while ((key = kv_next (kv, key))) {
+        if (key[0] == 'i' && kv_typeof (key) != KV_INT64)
+            errors++;
+    }
+    ok (errors == 0,
+        "kv_typeof returns KV_INT64 for binary int64 values");
+
+    if (kv_encode (kv, &buf, &len) < 0)
+        BAIL_OUT ("kv_encode failed");
+    kv2 = kv_decode (buf, len);
+    ok (kv2 != NULL && kv_equal (kv, kv2),
+        "binary encoding decodes");
+    ok (kv_get (kv2, "i4", KV_INT64, &i) == 0 && i == INT64_MIN
+        && kv_get (kv2, "d", KV_DOUBLE, &d) == 0 && d == 1.0 / 3,
+        "decoded object returns binary values");
+    kv_destroy (kv2);
+
+    kv2 = kv_create ();
+    if (!kv2 || kv_put (kv2, "x.d", KV_DOUBLE, 2.5) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_join (kv2, kv, "x.") == 0,
+        "kv_join of binary values replacing existing key works");
+    kv3 = kv_split (kv2, "x.");
+    ok (kv3 != NULL && kv_equal (kv, kv3),
+        "kv_join and kv_split keep binary values");
+    kv_destroy (kv3);
+    kv_destroy (kv2);
+
+    kv2 = kv_copy (kv);
+    ok (kv2 != NULL
+        && kv_put (kv2, "c", KV_INT64, (int64_t)0) == 0
+        && kv_encode (kv2, &buf, &len) == 0
+        && buf[len - 8 - 2] == 'I',
+        "kv_copy keeps the encoding setting");
+    kv_destroy (kv2);
+
+    ok (kv_delete (kv, "i0") == 0
+        && kv_get (kv, "i5", KV_INT64, &i) == 0 && i == INT64_MAX,
+        "kv_delete of binary value works");
+
+    errno = 0;
+    ok (kv_decode (bad, sizeof (bad) - 1) == NULL && errno == EINVAL,
+        "kv_decode of truncated binary value fails with EINVAL");
+
+    kv_destroy (kv);
+}
+
+void copy_into (void)
+{
+    struct kv *kv;
+    struct kv *kv2;
+    const char *buf;
+    const char *buf2;
+    char key[32];
+    int len;
+    int i;
+
+    kv = kv_create ();
+    kv2 = kv_create ();
+    if (!kv || !kv2)
+        BAIL_OUT ("kv_create failed");
+    for (i = 0; i < 100; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if (kv_put (kv, key, KV_INT64, (int64_t)i) < 0)
+            BAIL_OUT ("kv_put failed");
+    }
+    if (kv_put (kv2, "stale", KV_STRING, "z") < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_copy_into (kv2, kv) == 0 && kv_equal (kv, kv2)
+        && kv_get (kv2, "key99", KV_INT64, NULL) == 0
+        && kv_get (kv2, "stale", KV_STRING, NULL) < 0,
+        "kv_copy_into works");
+    if (kv_encode (kv2, &buf, &len) < 0)
+        BAIL_OUT ("kv_encode failed");
+    if (kv_delete (kv, "key0") < 0)
+        BAIL_OUT ("kv_delete failed");
+    ok (kv_copy_into (kv2, kv) == 0 && kv_equal (kv, kv2)
+        && kv_encode (kv2, &buf2, &len) == 0 && buf2 == buf,
+        "kv_copy_into reuses buffer");
+    ok (kv_put (kv2, "new", KV_STRING, "x") == 0
+        && kv_get (kv, "new", KV_STRING, NULL) < 0,
+        "kv_copy_into result is independent of source");
+
+    errno = 0;
+    ok (kv_copy_into (NULL, kv) < 0 && errno == EINVAL,
+        "kv_copy_into dst=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_copy_into (kv2, NULL) < 0 && errno == EINVAL,
+        "kv_copy_into src=NULL fails with EINVAL");
+    errno = 0;
+    ok (kv_copy_into (kv, kv) < 0 && errno == EINVAL,
+        "kv_copy_into dst=src fails with EINVAL");
+
+    kv_destroy (kv2);
+    kv_destroy (kv);
+}
+
+void iter (void)
+{
+    struct kv *kv;
+    struct kv_iter it;
+    const char *key = NULL;
+    int count = 0;
+    int errors = 0;
+
+    if (!(kv = kv_create ()))
+        BAIL_OUT ("kv_create failed");
+    kv_iter_init (&it);
+    ok (kv_iter_next (kv, &it) == false,
+        "kv_iter_next on empty object returns false");
+    if (kv_put (kv, "a", KV_STRING, "foo") < 0
+        || kv_put (kv, "bb", KV_INT64, (int64_t)-42) < 0
+        || kv_set_encoding (kv, KV_ENCODING_BINARY) < 0
+        || kv_put (kv, "ccc", KV_INT64, (int64_t)0) < 0
+        || kv_put (kv, "dddd", KV_BOOL, true) < 0)
+        BAIL_OUT ("kv_put failed");
+
+    kv_iter_init (&it);
+    while (kv_iter_next (kv, &it)) {
+        key = kv_next (kv, key);
+        if (it.key != key
+            || it.keylen != strlen (key)
+            || it.type != kv_typeof (key)
+            || it.val != kv_val_string (key))
+            errors++;
+        count++;
+    }
+    ok (count == 4 && errors == 0,
+        "kv_iter_next visits the same entries as kv_next");
+
+    kv_iter_init (&it);
+    ok (kv_iter_next (kv, &it)
+        && it.keylen == 1 && it.type == KV_STRING
+        && it.vallen == 3 && !strcmp (it.val, "foo")
+        && it.entry_len == 7,
+        "kv_iter_next returns string entry lengths");
+    ok (kv_iter_next (kv, &it)
+        && it.keylen == 2 && it.type == KV_INT64
+        && it.vallen == 3 && kv_val_int64 (it.key) == -42,
+        "kv_iter_next returns text int64 entry");
+    ok (kv_iter_next (kv, &it)
+        && it.keylen == 3 && it.type == KV_INT64
+        && it.vallen == 8 && it.entry_len == 14
+        && kv_val_int64 (it.key) == 0,
+        "kv_iter_next returns binary int64 entry with NUL bytes");
+    ok (kv_iter_next (kv, &it)
+        && it.keylen == 4 && it.type == KV_BOOL && kv_val_bool (it.key),
+        "kv_iter_next returns bool entry");
+    ok (kv_iter_next (kv, &it) == false,
+        "kv_iter_next returns false at the end");
+    ok (kv_iter_next (NULL, &it) == false && kv_iter_next (kv, NULL) == false,
+        "kv_iter_next with NULL argument returns false");
+
+    kv_destroy (kv);
+}
+
+void unordered (void)
+{
+    struct kv *kv1;
+    struct kv *kv2;
+    char key[32];
+    int i;
+
+    kv1 = kv_create ();
+    kv2 = kv_create ();
+    if (!kv1 || !kv2)
+        BAIL_OUT ("kv_create failed");
+    ok (kv_equal_unordered (kv1, kv2) && kv_hash (kv1) == kv_hash (kv2),
+        "empty objects are equal and have the same hash");
+    for (i = 0; i < 50; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        if (kv_put (kv1, key, KV_INT64, (int64_t)i) < 0)
+            BAIL_OUT ("kv_put failed");
+        snprintf (key, sizeof (key), "key%d", 49 - i);
+        if (kv_put (kv2, key, KV_INT64, (int64_t)(49 - i)) < 0)
+            BAIL_OUT ("kv_put failed");
+    }
+    ok (!kv_equal (kv1, kv2),
+        "kv_equal of objects with different order is false");
+    ok (kv_equal_unordered (kv1, kv2),
+        "kv_equal_unordered of objects with different order is true");
+    ok (kv_hash (kv1) == kv_hash (kv2),
+        "kv_hash does not depend on order");
+
+    if (kv_put (kv2, "key7", KV_INT64, (int64_t)8) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (!kv_equal_unordered (kv1, kv2) && kv_hash (kv1) != kv_hash (kv2),
+        "changed value makes objects unequal with different hash");
+    if (kv_put (kv2, "key7", KV_INT64, (int64_t)7) < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (kv_equal_unordered (kv1, kv2),
+        "restored value makes objects equal again");
+    if (kv_put (kv2, "key7", KV_STRING, "7") < 0)
+        BAIL_OUT ("kv_put failed");
+    ok (!kv_equal_unordered (kv1, kv2),
+        "value of different type makes objects unequal");
+    if (kv_delete (kv2, "key7") < 0
+        || kv_put (kv2, "key7", KV_INT64, (int64_t)7) < 0)
+        BAIL_OUT ("kv_put failed");
+
+    ok (kv_sort (kv1) == 0 && kv_sort (kv2) == 0 && kv_equal (kv1, kv2),
+        "kv_sort makes encodings identical");
+    ok (kv_get (kv1, "key42", KV_INT64, NULL) == 0
+        && kv_get (kv2, "key0", KV_INT64, NULL) == 0,
+        "kv_get works after kv_sort");
+    ok (strcmp (kv_next (kv1, NULL), "key0") == 0,
+        "kv_sort puts smallest key first");
+    errno = 0;
+    ok (kv_sort (NULL) < 0 && errno == EINVAL,
+        "kv_sort kv=NULL fails with EINVAL");
+    ok (!kv_equal_unordered (kv1, NULL),
+        "kv_equal_unordered kv2=NULL is false");
+
+    kv_destroy (kv2);
+    kv_destroy (kv1);
+}
+
 int main (int argc, char *argv[])
 {
     plan (NO_PLAN);
@@ -485,6 +1250,17 @@ int main (int argc, char *argv[])
     key_deletion ();
     key_update ();
     join_split ();
+    decode_into ();
+    large_object ();
+    join_replace ();
+    duplicate_keys ();
+    put_unique ();
+    split_into ();
+    decode_swap ();
+    binary_encoding ();
+    copy_into ();
+    iter ();
+    unordered ();
 
     done_testing ();
 }
@@ -14,8 +14,10 @@
 
 /*************************** HEADER FILES ***************************/
 #include <stdio.h>
+#include <stdlib.h>
 #include <memory.h>
 #include <string.h>
+#include <time.h>
 #include "src/libtap/tap.h"
 #include "src/libutil/sha256.h"
 
@@ -55,10 +57,99 @@ void sha256_test()
 	    "text3 OK");
 }
 
+static const char *kernels[] = { "scalar", "shani", "armv8" };
+
+static void digest_split(const BYTE *buf, size_t len, size_t split, BYTE hash[])
+{
+	SHA256_CTX ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, buf, split);
+	sha256_update(&ctx, buf + split, len - split);
+	sha256_final(&ctx, hash);
+}
+
+// Compare each supported kernel with the scalar one, for all lengths
+// up to a few blocks, split at various points.
+void kernel_test()
+{
+	BYTE buf[1024];
+	BYTE ref[SHA256_BLOCK_SIZE];
+	BYTE hash[SHA256_BLOCK_SIZE];
+	size_t len, split;
+	int i, errors;
+
+	for (i = 0; i < (int)sizeof(buf); i++)
+		buf[i] = rand();
+	ok (sha256_kernel() != NULL,
+	    "sha256_kernel returns %s", sha256_kernel());
+	ok (sha256_kernel_set("nope") < 0,
+	    "sha256_kernel_set fails on unknown kernel");
+	for (i = 1; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++) {
+		if (sha256_kernel_set(kernels[i]) < 0) {
+			diag("%s kernel is not supported", kernels[i]);
+			continue;
+		}
+		errors = 0;
+		for (len = 0; len <= 300; len++) {
+			for (split = 0; split <= len; split += 7) {
+				sha256_kernel_set("scalar");
+				digest_split(buf, len, split, ref);
+				sha256_kernel_set(kernels[i]);
+				digest_split(buf, len, split, hash);
+				if (memcmp(ref, hash, SHA256_BLOCK_SIZE) != 0)
+					errors++;
+			}
+		}
+		sha256_kernel_set("scalar");
+		digest_split(buf, sizeof(buf), 0, ref);
+		sha256_kernel_set(kernels[i]);
+		digest_split(buf, sizeof(buf), 0, hash);
+		if (memcmp(ref, hash, SHA256_BLOCK_SIZE) != 0)
+			errors++;
+		ok (errors == 0,
+		    "%s kernel matches scalar kernel", kernels[i]);
+		sha256_test();
+	}
+}
+
+// Report the throughput of each supported kernel.
+void kernel_bench()
+{
+	size_t len = 4 * 1024 * 1024;
+	BYTE hash[SHA256_BLOCK_SIZE];
+	struct timespec t0, t1;
+	SHA256_CTX ctx;
+	BYTE *buf;
+	double secs;
+	int i;
+
+	if (!(buf = calloc(1, len)))
+		BAIL_OUT("out of memory");
+	for (i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++) {
+		if (sha256_kernel_set(kernels[i]) < 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		sha256_init(&ctx);
+		sha256_update(&ctx, buf, len);
+		sha256_final(&ctx, hash);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1E-9;
+		diag("%s kernel: %.0f MB/s", kernels[i], len / secs / 1E6);
+	}
+	free(buf);
+}
+
 int main()
 {
+	const char *kernel;
+
 	plan (NO_PLAN);
 	sha256_test ();
+	kernel = sha256_kernel();
+	kernel_test ();
+	kernel_bench ();
+	sha256_kernel_set(kernel);
 	done_testing ();
 	return(0);
 }
@@ -0,0 +1,192 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/libtap/tap.h"
+#include "src/libutil/timestamp.h"
+
+/* The previous libc implementation, for comparison.
+ */
+static int ref_tostr (time_t t, char *buf, int size)
+{
+    struct tm tm;
+    if (t < 0 || !gmtime_r (&t, &tm))
+        return -1;
+    if (strftime (buf, size, "%FT%TZ", &tm) == 0)
+        return -1;
+    return 0;
+}
+
+static int ref_fromstr (const char *s, time_t *tp)
+{
+    struct tm tm;
+    time_t t;
+    if (!strptime (s, "%FT%TZ", &tm))
+        return -1;
+    if ((t = timegm (&tm)) < 0)
+        return -1;
+    if (tp)
+        *tp = t;
+    return 0;
+}
+
+void test_vectors (void)
+{
+    char buf[64];
+    time_t t;
+
+    ok (timestamp_tostr (0, buf, sizeof (buf)) == 0
+        && !strcmp (buf, "1970-01-01T00:00:00Z"),
+        "timestamp_tostr 0 works");
+    ok (timestamp_tostr (1061702090, buf, sizeof (buf)) == 0
+        && !strcmp (buf, "2003-08-24T05:14:50Z"),
+        "timestamp_tostr 1061702090 works");
+    ok (timestamp_tostr (951782400, buf, sizeof (buf)) == 0
+        && !strcmp (buf, "2000-02-29T00:00:00Z"),
+        "timestamp_tostr of leap day works");
+    ok (timestamp_fromstr ("2003-08-24T05:14:50Z", &t) == 0
+        && t == 1061702090,
+        "timestamp_fromstr works");
+    ok (timestamp_fromstr ("2000-02-29T00:00:00Z", &t) == 0 && t == 951782400,
+        "timestamp_fromstr of leap day works");
+    ok (timestamp_fromstr ("1970-01-01T00:00:00Z", NULL) == 0,
+        "timestamp_fromstr tp=NULL works");
+    ok (timestamp_tostr (-1, buf, sizeof (buf)) < 0,
+        "timestamp_tostr -1 fails");
+    ok (timestamp_tostr (0, buf, 20) < 0,
+        "timestamp_tostr with short buffer fails");
+    ok (timestamp_fromstr ("foo", &t) < 0,
+        "timestamp_fromstr foo fails");
+    ok (timestamp_fromstr ("2003-08-24", &t) < 0,
+        "timestamp_fromstr of date only fails");
+    ok (timestamp_fromstr ("1969-12-31T23:59:59Z", &t) < 0,
+        "timestamp_fromstr before epoch fails");
+
+    ok (timestamp_fromstr_exact ("2003-08-24T05:14:50Z", &t) == 0
+        && t == 1061702090,
+        "timestamp_fromstr_exact works");
+    ok (timestamp_fromstr_exact ("2018-01-01T00:00:00Zjunk", &t) < 0,
+        "timestamp_fromstr_exact fails with trailing characters");
+    ok (timestamp_fromstr_exact ("2019-02-29T00:00:00Z", &t) < 0,
+        "timestamp_fromstr_exact fails on a field libc would normalize");
+    ok (timestamp_fromfields (2003, 8, 24, 5, 14, 50, &t) == 0
+        && t == 1061702090,
+        "timestamp_fromfields works");
+    ok (timestamp_fromfields (1969, 12, 31, 23, 59, 59, &t) < 0,
+        "timestamp_fromfields before epoch fails");
+}
+
+/* Results must match the libc implementation exactly.
+ */
+void test_compare (void)
+{
+    static const char *inputs[] = {
+        "2019-02-29T00:00:00Z",     // normalized by timegm
+        "2018-13-01T00:00:00Z",
+        "2018-01-01T23:59:60Z",
+        "2018-1-1T1:2:3Z",
+        "2018-01-01T00:00:00",
+        "2018-01-01T00:00:00Zjunk",
+        " 2018-01-01T00:00:00Z",
+        "2100-02-29T00:00:00Z",
+        "2400-02-29T00:00:00Z",
+        "",
+    };
+    static const int fields[][6] = {
+        { 1979, 5, 27, 7, 32, 0 },
+        { 2000, 2, 29, 23, 59, 59 },
+        { 2019, 2, 29, 0, 0, 0 },
+        { 2018, 13, 1, 0, 0, 0 },
+        { 2018, 1, 1, 23, 59, 60 },
+        { 2018, 1, 1, 24, 0, 0 },
+    };
+    char buf[64];
+    char ref[64];
+    time_t t;
+    time_t tref;
+    int errors;
+    int i;
+
+    errors = 0;
+    for (t = 0; t < 20000L * 86400; t += 86400 / 4 + 7) {
+        if (timestamp_tostr (t, buf, sizeof (buf)) < 0
+            || ref_tostr (t, ref, sizeof (ref)) < 0
+            || strcmp (buf, ref) != 0
+            || timestamp_fromstr (buf, &tref) < 0
+            || tref != t)
+            errors++;
+    }
+    ok (errors == 0,
+        "timestamp_tostr and timestamp_fromstr match libc over 55 years");
+
+    errors = 0;
+    for (t = 253402300799L - 86400; t < 253402300799L + 86400; t += 3607) {
+        int rc = timestamp_tostr (t, buf, sizeof (buf));
+        int rc_ref = ref_tostr (t, ref, sizeof (ref));
+        if (rc != rc_ref || (rc == 0 && strcmp (buf, ref) != 0))
+            errors++;
+    }
+    ok (errors == 0,
+        "timestamp_tostr matches libc around year 9999");
+
+    errors = 0;
+    for (i = 0; i < sizeof (inputs) / sizeof (inputs[0]); i++) {
+        int rc = timestamp_fromstr (inputs[i], &t);
+        int rc_ref = ref_fromstr (inputs[i], &tref);
+        if (rc != rc_ref || (rc == 0 && t != tref)) {
+            diag ("%s: %d (%ld) != %d (%ld)", inputs[i],
+                  rc, (long)t, rc_ref, (long)tref);
+            errors++;
+        }
+    }
+    ok (errors == 0,
+        "timestamp_fromstr matches libc on unusual input");
+
+    errors = 0;
+    for (i = 0; i < sizeof (fields) / sizeof (fields[0]); i++) {
+        struct tm tm = {
+            .tm_year = fields[i][0] - 1900,
+            .tm_mon = fields[i][1] - 1,
+            .tm_mday = fields[i][2],
+            .tm_hour = fields[i][3],
+            .tm_min = fields[i][4],
+            .tm_sec = fields[i][5],
+        };
+        tref = timegm (&tm);
+        if (timestamp_fromfields (fields[i][0], fields[i][1], fields[i][2],
+                                  fields[i][3], fields[i][4], fields[i][5],
+                                  &t) < 0
+            || t != tref)
+            errors++;
+    }
+    ok (errors == 0,
+        "timestamp_fromfields matches timegm, including normalization");
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    test_vectors ();
+    test_compare ();
+
+    done_testing ();
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -94,6 +94,16 @@ void test_json_ts(void)
     ok (tomltk_json_to_epoch (obj, &t2) == 0 && t == t2,
         "tomltk_json_to_epoch works, correct value");
 
+    ok (tomltk_raw_to_epoch ("1979-05-27T07:32:00Z", &t) == 0
+        && t == 296638320,
+        "tomltk_raw_to_epoch works on a canonical timestamp");
+    ok (tomltk_raw_to_epoch ("1979-05-27T07:32:00.5Z", &t) == 0
+        && t == 296638320,
+        "tomltk_raw_to_epoch works on a timestamp with fractional seconds");
+    errno = 0;
+    ok (tomltk_raw_to_epoch ("42", &t) < 0 && errno == EINVAL,
+        "tomltk_raw_to_epoch fails with EINVAL on an integer");
+
     json_decref (obj);
 }
 
@@ -193,6 +203,86 @@ void test_tojson_t3 (void)
     toml_free (tab);
 }
 
+/* values whose types are guessed from their syntax */
+const char *t4 = \
+"h = 0xdead_beef\n" \
+"o = 0o755\n" \
+"n = -17\n" \
+"z = 0\n" \
+"e = 5e+22\n" \
+"f = -0.01\n" \
+"l = 'a:b'\n" \
+"b = false\n" \
+"ts = 1979-05-27 07:32:00Z\n";
+
+void test_typed (void)
+{
+    toml_table_t *tab;
+    json_t *obj;
+    json_t *ts;
+    json_int_t h, o, n, z;
+    double e, f;
+    const char *l;
+    int b;
+    struct tomltk_error error;
+
+    tab = tomltk_parse (t4, strlen (t4), &error);
+    ok (tab != NULL,
+        "t4: tomltk_parse works");
+    if (!tab)
+        BAIL_OUT ("line %d: %s\n", error.lineno, error.errbuf);
+    obj = tomltk_table_to_json (tab);
+    ok (obj != NULL,
+        "t4: tomltk_table_to_json works");
+    if (!obj)
+        BAIL_OUT ("tomltk_table_to_json: %s", strerror (errno));
+    jdiag ("t4", obj);
+    ok (json_unpack (obj, "{s:I s:I s:I s:I s:f s:f s:s s:b s:o}",
+                     "h", &h, "o", &o, "n", &n, "z", &z,
+                     "e", &e, "f", &f, "l", &l, "b", &b, "ts", &ts) == 0,
+        "t4: all values have the expected JSON types");
+    ok (h == 0xdeadbeef && o == 0755 && n == -17 && z == 0,
+        "t4: integers have the expected values");
+    ok (e == 5e+22 && f == -0.01,
+        "t4: doubles have the expected values");
+    ok (!strcmp (l, "a:b") && b == 0,
+        "t4: string and boolean have the expected values");
+    ok (check_ts (ts, "1979-05-27T07:32:00Z"),
+        "t4: timestamp has the expected value");
+    json_decref (obj);
+    toml_free (tab);
+}
+
+void test_update (void)
+{
+    toml_table_t *tab;
+    json_t *obj;
+    json_t *t;
+    int x, i;
+    struct tomltk_error error;
+
+    if (!(tab = tomltk_parse (t3, strlen (t3), &error)))
+        BAIL_OUT ("line %d: %s\n", error.lineno, error.errbuf);
+    if (!(obj = json_pack ("{s:i s:{s:i}}", "x", 1, "t", "y", 2)))
+        BAIL_OUT ("json_pack failed");
+    ok (tomltk_table_update (obj, tab) == 0,
+        "tomltk_table_update works");
+    jdiag ("t3 update", obj);
+    ok (json_unpack (obj, "{s:i s:o}", "x", &x, "t", &t) == 0
+        && json_unpack (t, "{s:{s:i}}", "a", "i", &i) == 0 && i == 42
+        && json_object_get (t, "y") == NULL,
+        "tomltk_table_update keeps other keys and replaces tables");
+
+    errno = 0;
+    ok (tomltk_table_update (NULL, tab) < 0 && errno == EINVAL,
+        "tomltk_table_update obj=NULL fails with EINVAL");
+    errno = 0;
+    ok (tomltk_table_update (obj, NULL) < 0 && errno == EINVAL,
+        "tomltk_table_update tab=NULL fails with EINVAL");
+    json_decref (obj);
+    toml_free (tab);
+}
+
 void test_parse_lineno (void)
 {
     toml_table_t *tab;
@@ -262,6 +352,8 @@ int main (int argc, char *argv[])
     test_tojson_t1 ();
     test_tojson_t2 ();
     test_tojson_t3 ();
+    test_typed ();
+    test_update ();
     test_parse_lineno ();
     test_corner ();
 
@@ -12,21 +12,90 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <stdbool.h>
+#include <string.h>
 #include <time.h>
 
 #include "timestamp.h"
 
-int timestamp_tostr (time_t t, char *buf, int size)
+/* Timestamps are always "YYYY-MM-DDTHH:MM:SSZ", so they are converted
+ * directly, without the locale and TZ handling of the libc functions.
+ * Conversions outside the common form fall back to libc, so results are
+ * the same as before for any input.
+ */
+#define TIMESTAMP_LEN 20
+
+/* Days since 1970-01-01 of civil date y-m-d (proleptic Gregorian).
+ * See http://howardhinnant.github.io/date_algorithms.html
+ */
+static long days_from_civil (long y, int m, int d)
+{
+    long era;
+    long yoe;
+    long doy;
+    long doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Inverse of days_from_civil(), for z >= 0.
+ */
+static void civil_from_days (long z, long *yp, int *mp, int *dp)
+{
+    long era;
+    long doe;
+    long yoe;
+    long doy;
+    long mp0;
+
+    z += 719468;
+    era = z / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp0 = (5 * doy + 2) / 153;
+    *dp = doy - (153 * mp0 + 2) / 5 + 1;
+    *mp = mp0 < 10 ? mp0 + 3 : mp0 - 9;
+    *yp = yoe + era * 400 + (*mp <= 2);
+}
+
+static void put_digits (char *p, long val, int width)
+{
+    while (width-- > 0) {
+        p[width] = '0' + val % 10;
+        val /= 10;
+    }
+}
+
+static bool get_digits (const char *p, int width, int *valp)
+{
+    int val = 0;
+
+    while (width-- > 0) {
+        if (*p < '0' || *p > '9')
+            return false;
+        val = val * 10 + (*p++ - '0');
+    }
+    *valp = val;
+    return true;
+}
+
+static int libc_tostr (time_t t, char *buf, int size)
 {
     struct tm tm;
-    if (t < 0 || !gmtime_r (&t, &tm))
+    if (!gmtime_r (&t, &tm))
         return -1;
     if (strftime (buf, size, "%FT%TZ", &tm) == 0)
         return -1;
     return 0;
 }
 
-int timestamp_fromstr (const char *s, time_t *tp)
+static int libc_fromstr (const char *s, time_t *tp)
 {
     struct tm tm;
     time_t t;
@@ -39,6 +108,118 @@ int timestamp_fromstr (const char *s, time_t *tp)
     return 0;
 }
 
+int timestamp_tostr (time_t t, char *buf, int size)
+{
+    long days;
+    long secs;
+    long y;
+    int m;
+    int d;
+
+    if (t < 0)
+        return -1;
+    days = t / 86400;
+    secs = t % 86400;
+    civil_from_days (days, &y, &m, &d);
+    if (y > 9999 || size < TIMESTAMP_LEN + 1)
+        return libc_tostr (t, buf, size);
+    put_digits (buf, y, 4);
+    buf[4] = '-';
+    put_digits (buf + 5, m, 2);
+    buf[7] = '-';
+    put_digits (buf + 8, d, 2);
+    buf[10] = 'T';
+    put_digits (buf + 11, secs / 3600, 2);
+    buf[13] = ':';
+    put_digits (buf + 14, secs / 60 % 60, 2);
+    buf[16] = ':';
+    put_digits (buf + 17, secs % 60, 2);
+    buf[19] = 'Z';
+    buf[20] = '\0';
+    return 0;
+}
+
+static bool fields_valid (int y, int m, int d, int hh, int mm, int ss)
+{
+    static const int mdays[] = { 31, 29, 31, 30, 31, 30,
+                                 31, 31, 30, 31, 30, 31 };
+
+    return y >= 1970 && y <= 9999 && m >= 1 && m <= 12
+        && d >= 1 && d <= mdays[m - 1]
+        && !(m == 2 && d == 29 && (y % 4 != 0
+                                   || (y % 100 == 0 && y % 400 != 0)))
+        && hh >= 0 && hh <= 23 && mm >= 0 && mm <= 59 && ss >= 0 && ss <= 59;
+}
+
+static time_t fields_to_epoch (int y, int m, int d, int hh, int mm, int ss)
+{
+    return (time_t)days_from_civil (y, m, d) * 86400
+           + hh * 3600 + mm * 60 + ss;
+}
+
+/* Parse the canonical form, returning false if 's' is not in it.
+ */
+static bool parse_fields (const char *s, int *y, int *m, int *d,
+                          int *hh, int *mm, int *ss)
+{
+    return get_digits (s, 4, y) && s[4] == '-'
+        && get_digits (s + 5, 2, m) && s[7] == '-'
+        && get_digits (s + 8, 2, d) && s[10] == 'T'
+        && get_digits (s + 11, 2, hh) && s[13] == ':'
+        && get_digits (s + 14, 2, mm) && s[16] == ':'
+        && get_digits (s + 17, 2, ss) && s[19] == 'Z'
+        && fields_valid (*y, *m, *d, *hh, *mm, *ss);
+}
+
+int timestamp_fromstr (const char *s, time_t *tp)
+{
+    int y, m, d, hh, mm, ss;
+
+    /* Anything unusual, e.g. a leap second, whitespace, or an out of
+     * range field that libc would normalize, is left to libc.
+     */
+    if (!parse_fields (s, &y, &m, &d, &hh, &mm, &ss))
+        return libc_fromstr (s, tp);
+    if (tp)
+        *tp = fields_to_epoch (y, m, d, hh, mm, ss);
+    return 0;
+}
+
+int timestamp_fromstr_exact (const char *s, time_t *tp)
+{
+    int y, m, d, hh, mm, ss;
+
+    if (!parse_fields (s, &y, &m, &d, &hh, &mm, &ss) || s[TIMESTAMP_LEN])
+        return -1;
+    if (tp)
+        *tp = fields_to_epoch (y, m, d, hh, mm, ss);
+    return 0;
+}
+
+int timestamp_fromfields (int year, int mon, int mday,
+                          int hour, int min, int sec, time_t *tp)
+{
+    struct tm tm;
+    time_t t;
+
+    if (fields_valid (year, mon, mday, hour, min, sec))
+        t = fields_to_epoch (year, mon, mday, hour, min, sec);
+    else {
+        memset (&tm, 0, sizeof (tm));
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = mday;
+        tm.tm_hour = hour;
+        tm.tm_min = min;
+        tm.tm_sec = sec;
+        if ((t = timegm (&tm)) < 0)
+            return -1;
+    }
+    if (tp)
+        *tp = t;
+    return 0;
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
@@ -22,6 +22,18 @@ int timestamp_tostr (time_t t, char *buf, int size);
  */
 int timestamp_fromstr (const char *s, time_t *tp);
 
+/* Same as timestamp_fromstr(), but only accept exactly the canonical form
+ * "YYYY-MM-DDTHH:MM:SSZ" with in range fields, and nothing after it.
+ * Return -1 for anything else, without trying the libc parser.
+ */
+int timestamp_fromstr_exact (const char *s, time_t *tp);
+
+/* Convert broken out UTC time (month 1-12) to time_t.  Out of range
+ * fields are normalized as by timegm(3).  Times before the epoch fail.
+ */
+int timestamp_fromfields (int year, int mon, int mday,
+                          int hour, int min, int sec, time_t *tp);
+
 
 #endif /* !_UTIL_TIMESTAMP_H */
 
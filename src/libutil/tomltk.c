@@ -13,6 +13,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <time.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <errno.h>
@@ -24,6 +25,7 @@
 #include "tomltk.h"
 
 static int table_to_json (toml_table_t *tab, json_t **op);
+static int table_update (json_t *obj, toml_table_t *tab);
 
 static void errprintf (struct tomltk_error *error,
                        const char *filename, int lineno,
@@ -65,69 +67,155 @@ static void errfromtoml (struct tomltk_error *error,
     }
 }
 
-/* Convert from TOML timestamp to struct tm (POSIX broken out time).
- */
-static int tstotm (toml_timestamp_t *ts, struct tm *tm)
+int tomltk_ts_to_epoch (toml_timestamp_t *ts, time_t *tp)
 {
-    if (!ts || !tm || !ts->year || !ts->month || !ts->day
-                   || !ts->hour  || !ts->minute || !ts->second)
+    if (!ts || !ts->year || !ts->month || !ts->day
+            || !ts->hour || !ts->minute || !ts->second
+            || timestamp_fromfields (*ts->year, *ts->month, *ts->day,
+                                     *ts->hour, *ts->minute, *ts->second,
+                                     tp) < 0) {
+        errno = EINVAL;
         return -1;
-    memset (tm, 0, sizeof (*tm));
-    tm->tm_year = *ts->year - 1900;
-    tm->tm_mon = *ts->month - 1;
-    tm->tm_mday = *ts->day;
-    tm->tm_hour = *ts->hour;
-    tm->tm_min = *ts->minute;
-    tm->tm_sec = *ts->second;
+    }
     return 0;
 }
 
-int tomltk_ts_to_epoch (toml_timestamp_t *ts, time_t *tp)
+int tomltk_raw_to_epoch (const char *raw, time_t *tp)
 {
-    struct tm tm;
-    time_t t;
+    toml_timestamp_t ts;
 
-    if (!ts || tstotm (ts, &tm) < 0 || (t = timegm (&tm)) < 0) {
+    if (!raw) {
         errno = EINVAL;
         return -1;
     }
-    if (tp)
-        *tp = t;
-    return 0;
+    if (timestamp_fromstr_exact (raw, tp) == 0)
+        return 0;
+    if (toml_rtots (raw, &ts) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tomltk_ts_to_epoch (&ts, tp);
 }
 
 int tomltk_json_to_epoch (const json_t *obj, time_t *tp)
 {
     const char *s;
 
-    /* N.B. 'O' specifier not used, hence obj is not in danger
-     * of being modified by json_unpack.
-     */
-    if (!obj || json_unpack ((json_t *)obj, "{s:s}", "iso-8601-ts", &s) < 0) {
-        errno = EINVAL;
-        return -1;
-    }
-    if (timestamp_fromstr (s, tp) < 0) {
+    if (!(s = json_string_value (json_object_get (obj, "iso-8601-ts")))
+        || timestamp_fromstr (s, tp) < 0) {
         errno = EINVAL;
         return -1;
     }
     return 0;
 }
 
+/* Build a timestamp JSON object from canonical timestamp string 's'.
+ */
+static json_t *timestr_to_json (const char *s)
+{
+    json_t *obj;
+    json_t *o;
+
+    if (!(obj = json_object ()))
+        goto nomem;
+    if (!(o = json_string_nocheck (s))
+        || json_object_set_new_nocheck (obj, "iso-8601-ts", o) < 0) {
+        json_decref (obj);
+        goto nomem;
+    }
+    return obj;
+nomem:
+    errno = ENOMEM;
+    return NULL;
+}
+
 json_t *tomltk_epoch_to_json (time_t t)
 {
     char timebuf[80];
-    json_t *obj;
 
     if (timestamp_tostr (t, timebuf, sizeof (timebuf)) < 0) {
         errno = EINVAL;
         return NULL;
     }
-    if (!(obj = json_pack ("{s:s}", "iso-8601-ts", timebuf))) {
-        errno = EINVAL;
-        return NULL;
+    return timestr_to_json (timebuf);
+}
+
+/* Guess the type of a raw TOML value from its syntax, so only one
+ * toml_rtoX() conversion needs to be tried.  The types are mutually
+ * exclusive, so a successful conversion of the guessed type gives the
+ * same result as trying them all in order.
+ */
+static char raw_type (const char *raw)
+{
+    if (raw[0] == '"' || raw[0] == '\'')
+        return 's';
+    if (raw[0] == 't' || raw[0] == 'f')
+        return 'b';
+    if (strchr (raw, ':')
+        || (isdigit (raw[0]) && isdigit (raw[1]) && isdigit (raw[2])
+            && isdigit (raw[3]) && raw[4] == '-'))
+        return 'T';
+    if (raw[0] == '0' && (raw[1] == 'x' || raw[1] == 'o' || raw[1] == 'b'))
+        return 'i';
+    if (strpbrk (raw, ".eEin"))
+        return 'd';
+    return 'i';
+}
+
+/* Convert raw TOML value of the type guessed by raw_type().
+ * Return 1 if the guess was wrong, so the caller can try all types.
+ */
+static int typed_value_to_json (const char *raw, json_t **op)
+{
+    char *s;
+    int b;
+    int64_t i;
+    double d;
+    toml_timestamp_t ts;
+    time_t t;
+
+    switch (raw_type (raw)) {
+        case 's':
+            if (toml_rtos (raw, &s) < 0)
+                return 1;
+            *op = json_string (s);
+            free (s);
+            break;
+        case 'b':
+            if (toml_rtob (raw, &b) < 0)
+                return 1;
+            *op = b ? json_true () : json_false ();
+            break;
+        case 'i':
+            if (toml_rtoi (raw, &i) < 0)
+                return 1;
+            *op = json_integer (i);
+            break;
+        case 'd':
+            if (toml_rtod (raw, &d) < 0)
+                return 1;
+            *op = json_real (d);
+            break;
+        default:
+            /* A timestamp already in canonical form is used as is.
+             */
+            if (timestamp_fromstr_exact (raw, NULL) == 0) {
+                if (!(*op = timestr_to_json (raw)))
+                    return -1;
+                return 0;
+            }
+            if (toml_rtots (raw, &ts) < 0)
+                return 1;
+            if (tomltk_ts_to_epoch (&ts, &t) < 0
+                || !(*op = tomltk_epoch_to_json (t)))
+                return -1;
+            return 0;
     }
-    return obj;
+    if (!*op) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
 }
 
 /* Convert raw TOML value from toml_raw_in() or toml_raw_at() to JSON.
@@ -140,7 +228,10 @@ static int value_to_json (const char *raw, json_t **op)
     double d;
     toml_timestamp_t ts;
     json_t *obj;
+    int rc;
 
+    if ((rc = typed_value_to_json (raw, op)) <= 0)
+        return rc;
     if (toml_rtos (raw, &s) == 0) {
         obj = json_string (s);
         free (s);
@@ -223,51 +314,68 @@ error:
     return -1;
 }
 
-/* Convert TOML table to JSON.
+/* Set the keys of TOML table 'tab' in JSON object 'obj'.
+ * Keys are visited by index in toml_key_in() order (values, then arrays,
+ * then tables), so each is looked up only in the list that holds it.
+ * On failure, 'obj' may be partially updated.
  */
-static int table_to_json (toml_table_t *tab, json_t **op)
+static int table_update (json_t *obj, toml_table_t *tab)
 {
+    int nkval = toml_table_nkval (tab);
+    int narr = toml_table_narr (tab);
     int i;
-    int saved_errno;
-    json_t *obj;
 
-    if (!(obj = json_object ()))
-        goto nomem;
     for (i = 0; ; i++) {
         const char *key;
-        const char *raw;
-        toml_table_t *subtab;
-        toml_array_t *arr;
         json_t *val = NULL;
+        int rc;
 
         if (!(key = toml_key_in (tab, i)))
             break;
-        if ((raw = toml_raw_in (tab, key))) {
-            if (value_to_json (raw, &val) < 0)
-                goto error;
-        }
-        else if ((subtab = toml_table_in (tab, key))) {
-            if (table_to_json (subtab, &val) < 0)
-                goto error;
-        }
-        else if ((arr = toml_array_in (tab, key))) {
-            if (array_to_json (arr, &val) < 0)
-                goto error;
-        }
+        if (i < nkval)
+            rc = value_to_json (toml_raw_in (tab, key), &val);
+        else if (i < nkval + narr)
+            rc = array_to_json (toml_array_in (tab, key), &val);
+        else
+            rc = table_to_json (toml_table_in (tab, key), &val);
+        if (rc < 0)
+            return -1;
         if (json_object_set_new (obj, key, val) < 0) {
-            json_decref (val);
-            goto nomem;
+            errno = ENOMEM;
+            return -1;
         }
     }
+    return 0;
+}
+
+/* Convert TOML table to JSON.
+ */
+static int table_to_json (toml_table_t *tab, json_t **op)
+{
+    int saved_errno;
+    json_t *obj;
+
+    if (!(obj = json_object ())) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (table_update (obj, tab) < 0) {
+        saved_errno = errno;
+        json_decref (obj);
+        errno = saved_errno;
+        return -1;
+    }
     *op = obj;
     return 0;
-nomem:
-    errno = ENOMEM;
-error:
-    saved_errno = errno;
-    json_decref (obj);
-    errno = saved_errno;
-    return -1;
+}
+
+int tomltk_table_update (json_t *obj, toml_table_t *tab)
+{
+    if (!obj || !json_is_object (obj) || !tab) {
+        errno = EINVAL;
+        return -1;
+    }
+    return table_update (obj, tab);
 }
 
 json_t *tomltk_table_to_json (toml_table_t *tab)
@@ -32,6 +32,14 @@ struct tomltk_error {
  */
 json_t *tomltk_table_to_json (toml_table_t *tab);
 
+/* Convert TOML table into existing JSON object 'obj', replacing any
+ * top-level keys of 'obj' that 'tab' also defines.  This avoids building
+ * a new object only to merge it with json_object_update().
+ * Return 0 on success, -1 on failure with errno set, in which case 'obj'
+ * may have been partially updated.
+ */
+int tomltk_table_update (json_t *obj, toml_table_t *tab);
+
 /* Convert timestamp JSON object to a time_t (UTC).
  * Return 0 on success, or -1 on failure with errno set.
  */
@@ -47,6 +55,13 @@ json_t *tomltk_epoch_to_json (time_t t);
  */
 int tomltk_ts_to_epoch (toml_timestamp_t *ts, time_t *tp);
 
+/* Convert raw TOML value from toml_raw_in() or toml_raw_at() to a time_t
+ * (UTC), if it is a timestamp.  The common "YYYY-MM-DDTHH:MM:SSZ" form is
+ * converted directly, without toml_rtots().
+ * Return 0 on success, or -1 on failure with errno set.
+ */
+int tomltk_raw_to_epoch (const char *raw, time_t *tp);
+
 /* Wrapper for toml_parse() that internally copies 'conf',
  * adding NULL termination.  On success, 0 is returned.
  * On failure -1 is returned with errno set.  If 'error' is
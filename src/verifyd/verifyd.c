@@ -0,0 +1,465 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* verifyd.c - verify J strings for clients on a UNIX domain socket
+ *
+ * Usage: flux-security-verifyd [-c pattern] -s path
+ *
+ * Verifying with a fresh process or security context pays for config
+ * and CA loading every time.  This daemon keeps one configured context,
+ * with its caches warm, and verifies requests from any number of clients
+ * as described in verifyd_proto.h.
+ *
+ * Config is loaded from 'pattern', or the installed config if not set.
+ * The daemon runs in the foreground until SIGTERM or SIGINT, then
+ * removes the socket and exits.
+ *
+ * Requests are handled in one thread, in arrival order, by a poll(2)
+ * loop.  Each read may deliver many pipelined requests, which are all
+ * answered with a single write.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "src/lib/context.h"
+#include "src/lib/sign.h"
+
+#include "verifyd_proto.h"
+
+#define READ_CHUNK      65536
+#define OUT_HIGHWATER   (16*1024*1024)  // stop reading if more is unsent
+
+struct client {
+    int fd;
+    char *in;               // received bytes
+    size_t insz;
+    size_t inlen;
+    char *out;              // bytes to send, from 'outoff' to 'outlen'
+    size_t outsz;
+    size_t outlen;
+    size_t outoff;
+    bool closing;           // close once 'out' is sent
+    struct client *next;
+};
+
+static const char *prog = "flux-security-verifyd";
+
+static flux_security_t *ctx;
+static struct client *clients;
+static int nclients;
+static char *scratch;       // NUL terminated copy of J
+static size_t scratchsz;
+
+static volatile sig_atomic_t stop;
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: %s [-c pattern] -s path\n", prog);
+    exit (1);
+}
+
+static void stop_handler (int signum)
+{
+    stop = 1;
+}
+
+static void put_be32 (char *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static void put_be64 (char *p, uint64_t val)
+{
+    put_be32 (p, val >> 32);
+    put_be32 (p + 4, val);
+}
+
+static uint32_t get_be32 (const char *s)
+{
+    const unsigned char *p = (const unsigned char *)s;
+
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* Grow '*buf' of size '*bufsz' to hold at least 'need' bytes.
+ */
+static int grow (char **buf, size_t *bufsz, size_t need)
+{
+    size_t size = *bufsz ? *bufsz : READ_CHUNK;
+    char *new;
+
+    if (need <= *bufsz)
+        return 0;
+    while (size < need)
+        size *= 2;
+    if (!(new = realloc (*buf, size)))
+        return -1;
+    *buf = new;
+    *bufsz = size;
+    return 0;
+}
+
+/* Reserve a response frame of 'len' bytes after the length field,
+ * and fill in the length, 'id', and 'errnum'.  Return a pointer to the
+ * rest of the frame, or NULL if out of memory.
+ */
+static char *response_reserve (struct client *c, uint32_t id, int errnum,
+                               size_t len)
+{
+    char *p;
+
+    if (grow (&c->out, &c->outsz, c->outlen + 4 + len) < 0)
+        return NULL;
+    p = c->out + c->outlen;
+    put_be32 (p, len);
+    put_be32 (p + 4, id);
+    put_be32 (p + 8, errnum);
+    c->outlen += 4 + len;
+    return p + 12;
+}
+
+static void respond_error (struct client *c, uint32_t id, int errnum,
+                           const char *msg)
+{
+    size_t len = strlen (msg);
+    char *p;
+
+    if (!(p = response_reserve (c, id, errnum, 8 + len))) {
+        c->closing = true;
+        return;
+    }
+    memcpy (p, msg, len);
+}
+
+/* Verify 'J' of length 'len' and queue the response.
+ */
+static void handle_request (struct client *c, uint32_t id, uint32_t flags,
+                            const char *J, size_t len)
+{
+    const char *mech;
+    int64_t userid;
+    int payloadsz;
+    const char *dot1;
+    const char *dot2;
+    size_t mechlen;
+    size_t n;
+    char *p;
+
+    if ((flags & ~VERIFYD_PAYLOAD)) {
+        respond_error (c, id, EINVAL, "unknown flags");
+        return;
+    }
+    if (memchr (J, '\0', len)) {
+        respond_error (c, id, EINVAL, "J contains a NUL character");
+        return;
+    }
+    if (grow (&scratch, &scratchsz, len + 1) < 0) {
+        respond_error (c, id, ENOMEM, "out of memory");
+        return;
+    }
+    memcpy (scratch, J, len);
+    scratch[len] = '\0';
+    if (flux_sign_unwrap_header (ctx, scratch, &mech, &userid,
+                                 &payloadsz, 0) < 0) {
+        respond_error (c, id, flux_security_last_errnum (ctx),
+                       flux_security_last_error (ctx));
+        return;
+    }
+    /* J was parsed successfully, so it has the form HEADER.PAYLOAD.SIG
+     */
+    dot1 = strchr (scratch, '.');
+    dot2 = strchr (dot1 + 1, '.');
+    mechlen = strlen (mech);
+    if (mechlen > UINT8_MAX)
+        mechlen = UINT8_MAX;
+    n = 8 + 8 + 4 + 4 + 4 + 1 + mechlen;
+    if ((flags & VERIFYD_PAYLOAD))
+        n += payloadsz;
+    if (!(p = response_reserve (c, id, 0, n))) {
+        c->closing = true;
+        return;
+    }
+    put_be64 (p, userid);
+    put_be32 (p + 8, dot1 + 1 - scratch);
+    put_be32 (p + 12, dot2 - dot1 - 1);
+    put_be32 (p + 16, payloadsz);
+    p[20] = mechlen;
+    memcpy (p + 21, mech, mechlen);
+    if ((flags & VERIFYD_PAYLOAD)) {
+        if (flux_sign_decode_payload (ctx, scratch, p + 21 + mechlen,
+                                      payloadsz) != payloadsz) {
+            /* Replace the response just reserved with an error.
+             */
+            c->outlen -= 4 + n;
+            respond_error (c, id, flux_security_last_errnum (ctx),
+                           flux_security_last_error (ctx));
+        }
+    }
+}
+
+/* Handle all complete requests in the input buffer.
+ */
+static void handle_input (struct client *c)
+{
+    size_t off = 0;
+
+    while (!c->closing && c->inlen - off >= 4) {
+        uint32_t len = get_be32 (c->in + off);
+
+        if (len < 8 || len > VERIFYD_MAX_FRAME) {
+            uint32_t id = c->inlen - off >= 8 ? get_be32 (c->in + off + 4)
+                                              : 0;
+            respond_error (c, id, EMSGSIZE, "request has invalid length");
+            c->closing = true;
+            break;
+        }
+        if (c->inlen - off < 4 + (size_t)len)
+            break;
+        handle_request (c,
+                        get_be32 (c->in + off + 4),
+                        get_be32 (c->in + off + 8),
+                        c->in + off + 12,
+                        len - 8);
+        off += 4 + len;
+    }
+    if (off > 0) {
+        memmove (c->in, c->in + off, c->inlen - off);
+        c->inlen -= off;
+    }
+}
+
+static void client_destroy (struct client *c)
+{
+    struct client **cp;
+
+    for (cp = &clients; *cp; cp = &(*cp)->next) {
+        if (*cp == c) {
+            *cp = c->next;
+            break;
+        }
+    }
+    close (c->fd);
+    free (c->in);
+    free (c->out);
+    free (c);
+    nclients--;
+}
+
+/* Read what is available from 'c' and handle it.  Return -1 if the
+ * client should be dropped.
+ */
+static int client_read (struct client *c)
+{
+    ssize_t n;
+
+    if (grow (&c->in, &c->insz, c->inlen + READ_CHUNK) < 0)
+        return -1;
+    if ((n = read (c->fd, c->in + c->inlen, c->insz - c->inlen)) < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (n == 0) {
+        c->closing = true;
+        return 0;
+    }
+    c->inlen += n;
+    handle_input (c);
+    return 0;
+}
+
+/* Send what we can of 'c->out'.  Return -1 if the client should be
+ * dropped.
+ */
+static int client_write (struct client *c)
+{
+    ssize_t n;
+
+    while (c->outoff < c->outlen) {
+        if ((n = send (c->fd, c->out + c->outoff, c->outlen - c->outoff,
+                       MSG_NOSIGNAL)) < 0)
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        c->outoff += n;
+    }
+    c->outoff = c->outlen = 0;
+    return 0;
+}
+
+static void client_accept (int sfd)
+{
+    struct client *c;
+    int fd;
+
+    if ((fd = accept4 (sfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0)
+        return;
+    if (!(c = calloc (1, sizeof (*c)))) {
+        close (fd);
+        return;
+    }
+    c->fd = fd;
+    c->next = clients;
+    clients = c;
+    nclients++;
+}
+
+static int listen_create (const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen (path) >= sizeof (addr.sun_path))
+        die ("%s: socket path is too long", path);
+    strcpy (addr.sun_path, path);
+    if ((fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      0)) < 0)
+        die ("socket: %s", strerror (errno));
+    if (unlink (path) < 0 && errno != ENOENT)
+        die ("unlink %s: %s", path, strerror (errno));
+    if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        die ("bind %s: %s", path, strerror (errno));
+    if (listen (fd, SOMAXCONN) < 0)
+        die ("listen %s: %s", path, strerror (errno));
+    return fd;
+}
+
+static void run (int sfd)
+{
+    struct pollfd *fds = NULL;
+    struct client **pc = NULL;
+    int maxfds = 0;
+
+    while (!stop) {
+        struct client *c;
+        struct client *next;
+        int nfds = 1;
+        int i;
+
+        if (nclients + 1 > maxfds) {
+            maxfds = (nclients + 1) * 2;
+            if (!(fds = realloc (fds, maxfds * sizeof (fds[0])))
+                || !(pc = realloc (pc, maxfds * sizeof (pc[0]))))
+                die ("out of memory");
+        }
+        fds[0].fd = sfd;
+        fds[0].events = POLLIN;
+        for (c = clients; c != NULL; c = c->next) {
+            fds[nfds].fd = c->fd;
+            fds[nfds].events = 0;
+            if (!c->closing && c->outlen - c->outoff < OUT_HIGHWATER)
+                fds[nfds].events |= POLLIN;
+            if (c->outoff < c->outlen)
+                fds[nfds].events |= POLLOUT;
+            pc[nfds++] = c;
+        }
+        if (poll (fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            die ("poll: %s", strerror (errno));
+        }
+        for (i = 1; i < nfds; i++) {
+            c = pc[i];
+            if (((fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                 && !c->closing
+                 && client_read (c) < 0)
+                || client_write (c) < 0) {
+                c->closing = true;
+                c->outoff = c->outlen = 0;  // drop unsent responses
+            }
+        }
+        for (c = clients; c != NULL; c = next) {
+            next = c->next;
+            if (c->closing && c->outoff == c->outlen)
+                client_destroy (c);
+        }
+        if ((fds[0].revents & POLLIN))
+            client_accept (sfd);
+    }
+    free (fds);
+    free (pc);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *pattern = NULL;
+    const char *path = NULL;
+    struct sigaction sa;
+    int sfd;
+    int c;
+
+    while ((c = getopt (argc, argv, "c:s:")) != -1) {
+        switch (c) {
+            case 'c':
+                pattern = optarg;
+                break;
+            case 's':
+                path = optarg;
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc || !path)
+        usage ();
+
+    if (!(ctx = flux_security_create (0)))
+        die ("flux_security_create: %s", strerror (errno));
+    if (flux_security_configure (ctx, pattern) < 0)
+        die ("flux_security_configure: %s", flux_security_last_error (ctx));
+
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = stop_handler;   // no SA_RESTART, so poll is interrupted
+    sigemptyset (&sa.sa_mask);
+    if (sigaction (SIGTERM, &sa, NULL) < 0 || sigaction (SIGINT, &sa, NULL) < 0)
+        die ("sigaction: %s", strerror (errno));
+    signal (SIGPIPE, SIG_IGN);
+
+    sfd = listen_create (path);
+    run (sfd);
+
+    while (clients)
+        client_destroy (clients);
+    close (sfd);
+    (void)unlink (path);
+    free (scratch);
+    flux_security_destroy (ctx);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,58 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+#ifndef _VERIFYD_PROTO_H
+#define _VERIFYD_PROTO_H
+
+/* flux-security-verifyd protocol
+ *
+ * Clients connect to the daemon's UNIX domain stream socket and send
+ * requests, each verifying one J string as flux_sign_unwrap_header()
+ * would.  Requests may be pipelined: a client need not wait for a
+ * response before sending the next request.  Responses are returned in
+ * request order.  All integers are big-endian.
+ *
+ * Request:
+ *   length      u32  size of the rest of the frame
+ *   id          u32  echoed in the response
+ *   flags       u32  VERIFYD_PAYLOAD, or 0
+ *   J           length - 8 bytes, without a terminating NUL
+ *
+ * Response:
+ *   length      u32  size of the rest of the frame
+ *   id          u32  from the request
+ *   errnum      i32  0 on success, otherwise an errno value
+ * followed on success by:
+ *   userid      i64  userid that signed J
+ *   offset      u32  offset of the base64 PAYLOAD field in J
+ *   len         u32  length of the base64 PAYLOAD field in J
+ *   payloadsz   u32  decoded payload size
+ *   mechlen     u8   length of the mechanism name
+ *   mech        mechlen bytes, e.g. "curve"
+ *   payload     payloadsz bytes, only if VERIFYD_PAYLOAD was requested
+ * or on failure by:
+ *   error       rest of the frame, a message without a terminating NUL
+ *
+ * A request longer than VERIFYD_MAX_FRAME gets an EMSGSIZE response,
+ * after which the daemon closes the connection.
+ */
+
+enum {
+    VERIFYD_PAYLOAD = 1,    // return the decoded payload
+};
+
+#define VERIFYD_MAX_FRAME   (64*1024*1024)
+
+#endif /* !_VERIFYD_PROTO_H */
+
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -45,7 +45,9 @@ static void usage (void)
     fprintf (stderr,
 "Usage: ca keygen\n"
 "   or: ca revoke uuid\n"
-"   or: ca verify path\n");
+"   or: ca verify path\n"
+"   or: ca verify-batch\n"
+"   or: ca sign-batch\n");
 }
 
 static struct ca *init_ca (void)
@@ -121,6 +123,77 @@ static void verify (const char *path)
     ca_destroy (ca);
 }
 
+/* Verify a stream of binary certs on stdin, printing the userid of each.
+ */
+static void verify_batch (void)
+{
+    struct ca *ca = init_ca ();
+    ca_error_t error;
+    struct sigcert *cert;
+    int64_t userid;
+
+    if (ca_load (ca, false, error) < 0)
+        die ("ca_load: %s", error);
+    while ((cert = sigcert_fread_binary (stdin))) {
+        if (ca_verify (ca, cert, &userid, NULL, error) < 0)
+            die ("ca_verify: %s", error);
+        printf ("%lld\n", (long long)userid);
+        sigcert_destroy (cert);
+    }
+    if (errno != ENODATA)
+        die ("sigcert_fread_binary: %s", strerror (errno));
+
+    ca_destroy (ca);
+}
+
+/* Read "path userid" lines from stdin.  For each, generate a new cert,
+ * sign it for userid, and store it to path and path.pub.  Keys are
+ * generated in parallel, signed as one batch, and synced once.
+ */
+static void sign_batch (void)
+{
+    struct ca *ca = init_ca ();
+    ca_error_t error;
+    struct sigcert **certs = NULL;
+    char **paths = NULL;
+    int64_t *userids = NULL;
+    int count = 0;
+    char *path;
+    long long userid;
+    int i;
+
+    if (ca_load (ca, true, error) < 0)
+        die ("ca_load: %s", error);
+    while (scanf ("%ms %lld", &path, &userid) == 2) {
+        if (!(paths = realloc (paths, (count + 1) * sizeof (paths[0])))
+            || !(userids = realloc (userids,
+                                    (count + 1) * sizeof (userids[0]))))
+            die ("out of memory");
+        paths[count] = path;
+        userids[count++] = userid;
+    }
+    if (!feof (stdin))
+        die ("error reading path userid from stdin");
+    if (count > 0) {
+        if (!(certs = calloc (count, sizeof (certs[0]))))
+            die ("out of memory");
+        if (sigcert_create_many (certs, count, 0) < 0)
+            die ("sigcert_create_many: %s", strerror (errno));
+        if (ca_sign_batch (ca, certs, count, 0, 0, userids, error) < 0)
+            die ("ca_sign_batch: %s", error);
+        if (sigcert_store_many (certs, (const char **)paths, count) < 0)
+            die ("sigcert_store_many: %s", strerror (errno));
+    }
+    for (i = 0; i < count; i++) {
+        sigcert_destroy (certs[i]);
+        free (paths[i]);
+    }
+    free (certs);
+    free (paths);
+    free (userids);
+
+    ca_destroy (ca);
+}
 
 int main (int argc, char **argv)
 {
@@ -130,6 +203,10 @@ int main (int argc, char **argv)
         revoke (argv[2]);
     else if (argc == 3 && !strcmp (argv[1], "verify"))
         verify (argv[2]);
+    else if (argc == 2 && !strcmp (argv[1], "verify-batch"))
+        verify_batch ();
+    else if (argc == 2 && !strcmp (argv[1], "sign-batch"))
+        sign_batch ();
     else
         usage ();
 
@@ -51,7 +51,8 @@ static void die (const char *fmt, ...)
 static void usage (void)
 {
     fprintf (stderr, "Usage: certutil certname get key [type]\n"
-                     "   or: certutil certname put key [type:]value\n");
+                     "   or: certutil certname put key [type:]value\n"
+                     "   or: certutil certname binary\n");
     exit (1);
 }
 
@@ -162,12 +163,27 @@ void put_meta (const char *certname, const char *key, const char *value)
     sigcert_destroy (cert);
 }
 
+/* Write public cert to stdout in binary form, e.g. for casign --batch.
+ */
+void write_binary (const char *certname)
+{
+    struct sigcert *cert;
+
+    if (!(cert = sigcert_load (certname, false)))
+        die ("load %s: %s", certname, strerror (errno));
+    if (sigcert_fwrite_binary (cert, stdout) < 0)
+        die ("write stdout: %s", strerror (errno));
+    sigcert_destroy (cert);
+}
+
 int main (int argc, char **argv)
 {
     if ((argc == 4 || argc == 5) && !strcmp (argv[2], "get"))
         get_meta (argv[1], argv[3], argc == 5 ? argv[4] : NULL);
     else if ((argc == 5 && !strcmp (argv[2], "put")))
         put_meta (argv[1], argv[3], argv[4]);
+    else if ((argc == 3 && !strcmp (argv[2], "binary")))
+        write_binary (argv[1]);
     else
         usage ();
     return 0;
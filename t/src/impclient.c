@@ -0,0 +1,204 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* impclient.c - send a request to `flux-imp service`
+ *
+ * Usage: impclient SOCKET exec J SHELL ARG
+ *        impclient SOCKET kill SIGNAL PID
+ *
+ * The job shell of exec gets the environment of impclient.
+ *
+ * Exits with the exit code of the job shell for exec (128+signal if
+ *  it was terminated by a signal), 0 on success for kill, or 1 if
+ *  the service closed the connection without a status.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "src/libutil/kv.h"
+
+const char *prog = "impclient";
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static int service_connect (const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof (addr.sun_path))
+        die ("%s: path too long", path);
+    strcpy (addr.sun_path, path);
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+        die ("socket: %s", strerror (errno));
+    if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+        die ("connect %s: %s", path, strerror (errno));
+    return fd;
+}
+
+/*  Send length of encoded kv with our stdio as SCM_RIGHTS, then the kv.
+ */
+static void send_request (int fd, struct kv *kv)
+{
+    const char *buf;
+    int len;
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        char buf[CMSG_SPACE (sizeof (fds))];
+        struct cmsghdr align;
+    } u;
+
+    if (kv_encode (kv, &buf, &len) < 0)
+        die ("kv_encode: %s", strerror (errno));
+
+    memset (&msg, 0, sizeof (msg));
+    memset (&u, 0, sizeof (u));
+    iov.iov_base = &len;
+    iov.iov_len = sizeof (len);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof (u.buf);
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+    if (sendmsg (fd, &msg, 0) != sizeof (len))
+        die ("sendmsg: %s", strerror (errno));
+    if (write (fd, buf, len) != len)
+        die ("write: %s", strerror (errno));
+}
+
+/*  Add our environment to `kv` as "env.NAME" = VALUE entries.
+ */
+static void put_environ (struct kv *kv)
+{
+    extern char **environ;
+    char **e;
+
+    for (e = environ; *e; e++) {
+        const char *val = strchr (*e, '=');
+        char *key;
+
+        if (!val)
+            continue;
+        if (asprintf (&key, "env.%.*s", (int) (val - *e), *e) < 0)
+            die ("Out of memory");
+        if (kv_put (kv, key, KV_STRING, val + 1) < 0)
+            die ("kv_put: %s", strerror (errno));
+        free (key);
+    }
+}
+
+/*  Read one length-prefixed kv reply. Returns NULL on EOF.
+ */
+static struct kv *read_reply (int fd)
+{
+    struct kv *kv;
+    char *buf;
+    int len;
+    int n;
+    int count = 0;
+
+    if ((n = read (fd, &len, sizeof (len))) == 0)
+        return NULL;
+    if (n != sizeof (len) || len <= 0)
+        die ("failed to read reply length");
+    if (!(buf = malloc (len)))
+        die ("Out of memory");
+    while (count < len) {
+        if ((n = read (fd, buf + count, len - count)) <= 0)
+            die ("failed to read reply");
+        count += n;
+    }
+    if (!(kv = kv_decode (buf, len)))
+        die ("kv_decode: %s", strerror (errno));
+    free (buf);
+    return kv;
+}
+
+int main (int argc, char **argv)
+{
+    struct kv *kv;
+    int64_t val;
+    int status = -1;
+    int fd;
+
+    if (argc != 6 && argc != 5)
+        die ("Usage: %s SOCKET exec J SHELL ARG | SOCKET kill SIGNAL PID",
+             prog);
+    if (!(kv = kv_create ())
+        || kv_put (kv, "cmd", KV_STRING, argv[2]) < 0)
+        die ("kv_put: %s", strerror (errno));
+    if (strcmp (argv[2], "exec") == 0 && argc == 6) {
+        if (kv_put (kv, "J", KV_STRING, argv[3]) < 0
+            || kv_put (kv, "shell_path", KV_STRING, argv[4]) < 0
+            || kv_put (kv, "arg", KV_STRING, argv[5]) < 0)
+            die ("kv_put: %s", strerror (errno));
+        put_environ (kv);
+    }
+    else if (strcmp (argv[2], "kill") == 0 && argc == 5) {
+        if (kv_put (kv, "signal", KV_INT64, strtoll (argv[3], NULL, 10)) < 0
+            || kv_put (kv, "pid", KV_INT64, strtoll (argv[4], NULL, 10)) < 0)
+            die ("kv_put: %s", strerror (errno));
+    }
+    else
+        die ("Usage: %s SOCKET exec J SHELL ARG | SOCKET kill SIGNAL PID",
+             prog);
+
+    fd = service_connect (argv[1]);
+    send_request (fd, kv);
+    kv_destroy (kv);
+
+    while ((kv = read_reply (fd))) {
+        if (kv_get (kv, "status", KV_INT64, &val) == 0)
+            status = val;
+        kv_destroy (kv);
+    }
+    close (fd);
+
+    if (status < 0)
+        return 1;
+    if (WIFSIGNALED (status))
+        return 128 + WTERMSIG (status);
+    return WEXITSTATUS (status);
+}
+
+/* vi: ts=4 sw=4 expandtab
+ */
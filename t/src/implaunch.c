@@ -0,0 +1,534 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* implaunch.c - time repeated 'flux-imp exec' of a trivial job shell
+ *
+ * Usage: implaunch [-j] [-S] [-n launches] [-p launchers] [-m mech]
+ *                  [-s shell] [-d dir] flux-imp
+ *
+ * Sign J once, then fork 'launchers' processes (default 1), each running
+ * 'flux-imp exec shell arg' 'launches' times (default 100) with J on
+ * stdin.  Report launches/sec over the whole run and latency percentiles
+ * of each launch, from fork to exit of the IMP and shell, and of each
+ * phase the IMP reports in its 'trace:' line.  With -j, results are
+ * printed as one JSON object per line.
+ *
+ * If FLUX_IMP_CONFIG_PATTERN is set, that config is used for signing
+ * and by the IMP, and phases are reported only if it sets trace = true.
+ * Otherwise, a config allowing the current user to run 'shell' (default
+ * /bin/true) unprivileged, with tracing and sign mechanism 'mech'
+ * (default none), is written to 'dir' (default a temporary directory).
+ * Point 'dir' at a shared file system, or use -m munge, to expose
+ * contention there between parallel launchers.
+ *
+ * With -S, each launch runs 'sudo flux-imp ...', so the IMP runs in its
+ * sudo simulation mode without a setuid install.  This adds the cost
+ * of sudo(8) to launch latency, but not to IMP phases.
+ *
+ * Run with 'make bench', passing options with BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pwd.h>
+
+#include "src/lib/context.h"
+#include "src/lib/sign.h"
+
+#define MAX_PHASES 16
+
+const char *prog = "implaunch";
+
+struct timer {
+    double *samples;    // nanoseconds
+    int count;
+    struct timespec t0;
+};
+
+struct phase {
+    char name[32];
+    struct timer t;
+};
+
+static struct phase phases[MAX_PHASES];
+static int nphases;
+static bool json;
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: implaunch [-j] [-S] [-n launches]"
+                     " [-p launchers] [-m mech] [-s shell] [-d dir]"
+                     " flux-imp\n");
+    exit (1);
+}
+
+static void timer_init (struct timer *t, int n)
+{
+    if (n < 1 || !(t->samples = calloc (n, sizeof (t->samples[0]))))
+        die ("out of memory");
+    t->count = 0;
+}
+
+static void timer_start (struct timer *t)
+{
+    clock_gettime (CLOCK_MONOTONIC, &t->t0);
+}
+
+static void timer_stop (struct timer *t)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t->samples[t->count++] = (t1.tv_sec - t->t0.tv_sec) * 1E9
+                           + (t1.tv_nsec - t->t0.tv_nsec);
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile (const struct timer *t, int p)
+{
+    return t->samples[(t->count - 1) * p / 100] / 1E3;
+}
+
+/* Print one line of results and free the samples.  If 'rate' is
+ * negative, report the inverse of mean latency as ops/sec.
+ */
+static void timer_report (struct timer *t, double rate, const char *name)
+{
+    double total = 0;
+    int i;
+
+    if (t->count == 0)
+        return;
+    for (i = 0; i < t->count; i++)
+        total += t->samples[i];
+    if (rate < 0)
+        rate = total > 0 ? t->count / (total / 1E9) : 0;
+    qsort (t->samples, t->count, sizeof (t->samples[0]), sample_cmp);
+    if (json)
+        printf ("{\"op\":\"%s\",\"count\":%d,\"ops_per_sec\":%.1f,"
+                "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+                "\"max_us\":%.1f}\n",
+                name, t->count, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    else
+        printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+                name, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    free (t->samples);
+    t->samples = NULL;
+}
+
+static void write_all (int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write (fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            die ("write: %s", strerror (errno));
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Read all of 'fd' into 'buf', truncating to 'bufsz' - 1 bytes.
+ */
+static void read_all (int fd, char *buf, size_t bufsz)
+{
+    char discard[1024];
+    size_t count = 0;
+    ssize_t n;
+
+    do {
+        if (count < bufsz - 1)
+            n = read (fd, buf + count, bufsz - 1 - count);
+        else
+            n = read (fd, discard, sizeof (discard));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            die ("read: %s", strerror (errno));
+        }
+        if (count < bufsz - 1)
+            count += n;
+    } while (n != 0);
+    buf[count] = '\0';
+}
+
+/* Write a config for 'shell' and 'mech' to 'dir' and return its path.
+ */
+static char *config_create (const char *dir,
+                            const char *shell,
+                            const char *mech)
+{
+    static char path[PATH_MAX + 1];
+    struct passwd *pw;
+    FILE *f;
+
+    if (!(pw = getpwuid (getuid ())))
+        die ("getpwuid: %s", strerror (errno));
+    if (snprintf (path, sizeof (path), "%s/imp.toml", dir) >= (int)sizeof (path))
+        die ("path buffer overflow");
+    if (!(f = fopen (path, "w")))
+        die ("%s: %s", path, strerror (errno));
+    fprintf (f, "allow-sudo = true\n"
+                "trace = true\n"
+                "[sign]\n"
+                "max-ttl = 3600\n"
+                "default-type = \"%s\"\n"
+                "allowed-types = [ \"%s\" ]\n"
+                "[exec]\n"
+                "allowed-users = [ \"%s\" ]\n"
+                "allowed-shells = [ \"%s\" ]\n"
+                "allow-unprivileged-exec = true\n",
+             mech, mech, pw->pw_name, shell);
+    if (fclose (f) != 0)
+        die ("%s: %s", path, strerror (errno));
+    return path;
+}
+
+/* Return IMP input for a signed J.
+ */
+static char *input_create (const char *pattern)
+{
+    flux_security_t *ctx;
+    const char *J;
+    char *input;
+
+    if (!(ctx = flux_security_create (0)))
+        die ("flux_security_create: %s", strerror (errno));
+    if (flux_security_configure (ctx, pattern) < 0)
+        die ("flux_security_configure: %s", flux_security_last_error (ctx));
+    if (!(J = flux_sign_wrap (ctx, "bench", 5, NULL, 0)))
+        die ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    if (asprintf (&input, "{\"J\":\"%s\"}", J) < 0)
+        die ("out of memory");
+    flux_security_destroy (ctx);
+    return input;
+}
+
+/* Run the IMP once with 'input' on stdin, and copy its stderr to 'errbuf'.
+ * Exit on failure, since results would be meaningless.
+ */
+static void launch (char **argv, const char *input, char *errbuf, int errsz)
+{
+    int in[2];
+    int err[2];
+    int status;
+    pid_t pid;
+
+    if (pipe (in) < 0 || pipe (err) < 0)
+        die ("pipe: %s", strerror (errno));
+    if ((pid = fork ()) < 0)
+        die ("fork: %s", strerror (errno));
+    if (pid == 0) {
+        int fd = open ("/dev/null", O_WRONLY);
+        if (fd < 0
+            || dup2 (in[0], STDIN_FILENO) < 0
+            || dup2 (fd, STDOUT_FILENO) < 0
+            || dup2 (err[1], STDERR_FILENO) < 0)
+            _exit (126);
+        close (in[0]);
+        close (in[1]);
+        close (err[0]);
+        close (err[1]);
+        close (fd);
+        execvp (argv[0], argv);
+        _exit (127);
+    }
+    close (in[0]);
+    close (err[1]);
+    write_all (in[1], input, strlen (input));
+    close (in[1]);
+    read_all (err[0], errbuf, errsz);
+    close (err[0]);
+    if (waitpid (pid, &status, 0) < 0)
+        die ("waitpid: %s", strerror (errno));
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        die ("%s failed (status=0x%x): %s", argv[0], status, errbuf);
+}
+
+/* Run 'n' launches, writing one line per launch to 'fd':
+ *   total=SEC phase=SEC ...
+ * where each phase time is relative to the previous one.
+ */
+static void launcher (int fd, char **argv, const char *input, int n)
+{
+    char errbuf[4096];
+    char line[1024];
+    struct timespec t0, t1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        char *p;
+        char *tok;
+        char *saveptr = NULL;
+        double prev = 0;
+        int len;
+
+        clock_gettime (CLOCK_MONOTONIC, &t0);
+        launch (argv, input, errbuf, sizeof (errbuf));
+        clock_gettime (CLOCK_MONOTONIC, &t1);
+
+        len = snprintf (line, sizeof (line), "total=%.9f",
+                        (t1.tv_sec - t0.tv_sec)
+                        + (t1.tv_nsec - t0.tv_nsec) / 1E9);
+        /* e.g. trace: pid=123 cmd=exec start=1540000000.000000
+         *       imp_conf_load=0.000210 sec_init=0.000312 ...
+         */
+        if ((p = strstr (errbuf, "trace: "))) {
+            p[strcspn (p, "\n")] = '\0';
+            for (tok = strtok_r (p + 7, " ", &saveptr); tok != NULL;
+                 tok = strtok_r (NULL, " ", &saveptr)) {
+                char *eq = strchr (tok, '=');
+                double ts;
+
+                if (!eq || !strncmp (tok, "pid=", 4)
+                        || !strncmp (tok, "cmd=", 4)
+                        || !strncmp (tok, "start=", 6))
+                    continue;
+                ts = strtod (eq + 1, NULL);
+                *eq = '\0';
+                if (len < (int)sizeof (line))
+                    len += snprintf (line + len, sizeof (line) - len,
+                                     " %s=%.9f", tok, ts - prev);
+                prev = ts;
+            }
+        }
+        if (len < (int)sizeof (line) - 1)
+            line[len++] = '\n';
+        write_all (fd, line, len);
+    }
+}
+
+static struct timer *phase_timer (const char *name, int n)
+{
+    int i;
+
+    for (i = 0; i < nphases; i++) {
+        if (!strcmp (phases[i].name, name))
+            return &phases[i].t;
+    }
+    if (nphases == MAX_PHASES)
+        die ("too many trace phases");
+    snprintf (phases[nphases].name, sizeof (phases[nphases].name),
+              "%s", name);
+    timer_init (&phases[nphases].t, n);
+    return &phases[nphases++].t;
+}
+
+/* Parse launcher output 'line' into 'total' and phase timers.
+ */
+static void parse_line (char *line, struct timer *total, int n)
+{
+    char *tok;
+    char *saveptr = NULL;
+
+    for (tok = strtok_r (line, " \n", &saveptr); tok != NULL;
+         tok = strtok_r (NULL, " \n", &saveptr)) {
+        char *eq = strchr (tok, '=');
+        struct timer *t;
+
+        if (!eq)
+            continue;
+        *eq = '\0';
+        t = !strcmp (tok, "total") ? total : phase_timer (tok, n);
+        if (t->count < n)
+            t->samples[t->count++] = strtod (eq + 1, NULL) * 1E9;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    const char *pattern = getenv ("FLUX_IMP_CONFIG_PATTERN");
+    const char *t = getenv ("TMPDIR");
+    const char *mech = "none";
+    const char *shell = "/bin/true";
+    const char *dir = NULL;
+    char tmpdir[PATH_MAX + 1] = "";
+    char *config = NULL;
+    char *input;
+    char *args[8];
+    int nargs = 0;
+    bool sudo = false;
+    int n = 100;
+    int p = 1;
+    pid_t *pids;
+    FILE *f;
+    int fds[2];
+    char line[1024];
+    struct timer total;
+    struct timer wall;
+    double rate;
+    int c;
+    int i;
+
+    while ((c = getopt (argc, argv, "jSn:p:m:s:d:")) != -1) {
+        switch (c) {
+            case 'j':
+                json = true;
+                break;
+            case 'S':
+                sudo = true;
+                break;
+            case 'n':
+                if ((n = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'p':
+                if ((p = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'm':
+                mech = optarg;
+                break;
+            case 's':
+                shell = optarg;
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 1)
+        usage ();
+
+    if (!pattern) {
+        if (!dir) {
+            if (snprintf (tmpdir, sizeof (tmpdir), "%s/implaunch-XXXXXX",
+                          t ? t : "/tmp") >= (int)sizeof (tmpdir))
+                die ("tmpdir buffer overflow");
+            if (!mkdtemp (tmpdir))
+                die ("mkdtemp: %s", strerror (errno));
+            dir = tmpdir;
+        }
+        pattern = config = config_create (dir, shell, mech);
+        if (setenv ("FLUX_IMP_CONFIG_PATTERN", pattern, 1) < 0)
+            die ("setenv: %s", strerror (errno));
+    }
+    input = input_create (pattern);
+
+    /* Like the SUDO tests, pass the config pattern on the sudo
+     * command line, since sudo(8) may not preserve the environment.
+     */
+    if (sudo) {
+        static char env[PATH_MAX + 64];
+        snprintf (env, sizeof (env), "FLUX_IMP_CONFIG_PATTERN=%s", pattern);
+        args[nargs++] = "sudo";
+        args[nargs++] = env;
+    }
+    args[nargs++] = argv[optind];
+    args[nargs++] = "exec";
+    args[nargs++] = (char *)shell;
+    args[nargs++] = "bench";
+    args[nargs] = NULL;
+
+    if (pipe2 (fds, O_CLOEXEC) < 0)
+        die ("pipe2: %s", strerror (errno));
+    if (!(pids = calloc (p, sizeof (pids[0]))))
+        die ("out of memory");
+    timer_init (&wall, 1);
+    timer_start (&wall);
+    for (i = 0; i < p; i++) {
+        if ((pids[i] = fork ()) < 0)
+            die ("fork: %s", strerror (errno));
+        if (pids[i] == 0) {
+            close (fds[0]);
+            launcher (fds[1], args, input, n);
+            _exit (0);
+        }
+    }
+    close (fds[1]);
+
+    /* Each launcher writes whole lines shorter than PIPE_BUF, so lines
+     * from different launchers are not interleaved.
+     */
+    timer_init (&total, n * p);
+    if (!(f = fdopen (fds[0], "r")))
+        die ("fdopen: %s", strerror (errno));
+    while (fgets (line, sizeof (line), f))
+        parse_line (line, &total, n * p);
+    fclose (f);
+    for (i = 0; i < p; i++) {
+        int status;
+        if (waitpid (pids[i], &status, 0) < 0)
+            die ("waitpid: %s", strerror (errno));
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+            die ("launcher %d failed", i);
+    }
+    timer_stop (&wall);
+    if (total.count != n * p)
+        die ("expected %d launches, got %d", n * p, total.count);
+
+    rate = total.count / (wall.samples[0] / 1E9);
+    free (wall.samples);
+    if (!json)
+        printf ("%-32s %10s %9s %9s %9s %9s\n",
+                "operation", "ops/sec",
+                "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    snprintf (line, sizeof (line), "launch x%d", p);
+    timer_report (&total, rate, line);
+    for (i = 0; i < nphases; i++)
+        timer_report (&phases[i].t, -1, phases[i].name);
+
+    if (config)
+        (void)unlink (config);
+    if (tmpdir[0])
+        (void)rmdir (tmpdir);
+    free (pids);
+    free (input);
+    return 0;
+}
+
+/* vi: ts=4 sw=4 expandtab
+ */
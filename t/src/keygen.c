@@ -10,7 +10,10 @@
 
 /* keygen.c - generate signing keys
  *
- * Usage: keygen path
+ * Usage: keygen path [path ...]
+ *
+ * With more than one path, keys are generated in parallel and the
+ * files are synced to disk once at the end.
  */
 
 #if HAVE_CONFIG_H
@@ -39,18 +42,26 @@ static void die (const char *fmt, ...)
 
 int main (int argc, char **argv)
 {
-    struct sigcert *cert;
-    const char *certname;
-
-    if (argc != 2)
-        die ("Usage: keygen path");
-    certname = argv[1];
-
-    if (!(cert = sigcert_create ()))
-        die ("sigcert_create: %s", strerror (errno));
-    if (sigcert_store (cert, certname) < 0)
-        die ("sigcert_store: %s", strerror (errno));
-    sigcert_destroy (cert);
+    struct sigcert **certs;
+    int count = argc - 1;
+    int i;
+
+    if (argc < 2)
+        die ("Usage: keygen path [path ...]");
+
+    if (!(certs = calloc (count, sizeof (certs[0]))))
+        die ("out of memory");
+    if (sigcert_create_many (certs, count, 0) < 0)
+        die ("sigcert_create_many: %s", strerror (errno));
+    if (count == 1) {
+        if (sigcert_store (certs[0], argv[1]) < 0)
+            die ("sigcert_store: %s", strerror (errno));
+    }
+    else if (sigcert_store_many (certs, (const char **)argv + 1, count) < 0)
+        die ("sigcert_store_many: %s", strerror (errno));
+    for (i = 0; i < count; i++)
+        sigcert_destroy (certs[i]);
+    free (certs);
 
     return 0;
 }
@@ -10,7 +10,13 @@
 
 /* sign.c - sign stdin
  *
- * Usage: sign <input >output
+ * Usage: sign [--batch=N | rotate-cert] <input >output
+ *
+ * If 'rotate-cert' is specified, replace that curve cert with a new one
+ * after signing, then sign again with the same context, printing both.
+ *
+ * If --batch=N is specified, sign N copies of the input with
+ * flux_sign_wrap_batch() and a THREADSAFE context, printing one per line.
  */
 
 #if HAVE_CONFIG_H
@@ -25,6 +31,7 @@
 
 #include "src/lib/context.h"
 #include "src/lib/sign.h"
+#include "src/libca/sigcert.h"
 
 const char *prog = "sign";
 
@@ -54,28 +61,83 @@ static int read_all (void *buf, int bufsz)
     return count;
 }
 
+static void sign_batch (flux_security_t *ctx, const char *buf, int buflen,
+                        int count)
+{
+    const void **pays;
+    int *payszs;
+    char **outputs;
+    int i;
+
+    if (!(pays = calloc (count, sizeof (pays[0])))
+        || !(payszs = calloc (count, sizeof (payszs[0])))
+        || !(outputs = calloc (count, sizeof (outputs[0]))))
+        die ("out of memory");
+    for (i = 0; i < count; i++) {
+        pays[i] = buf;
+        payszs[i] = buflen;
+    }
+    if (flux_sign_wrap_batch (ctx, pays, payszs, count, outputs, NULL, 0) < 0)
+        die ("flux_sign_wrap_batch: %s", flux_security_last_error (ctx));
+    for (i = 0; i < count; i++) {
+        printf ("%s\n", outputs[i]);
+        free (outputs[i]);
+    }
+    free (outputs);
+    free (payszs);
+    free (pays);
+}
+
 int main (int argc, char **argv)
 {
     flux_security_t *ctx;
     char buf[1024];
     int buflen;
     const char *msg;
-
-    if (argc != 1)
-        die ("Usage: sign <input >output");
-
-    if (!(ctx = flux_security_create (0)))
+    int batch = 0;
+    int flags = 0;
+
+    if (argc > 2)
+        die ("Usage: sign [--batch=N | rotate-cert] <input >output");
+    if (argc == 2 && !strncmp (argv[1], "--batch=", 8)) {
+        if ((batch = strtol (argv[1] + 8, NULL, 10)) <= 0)
+            die ("batch count must be a positive integer");
+        flags = FLUX_SECURITY_THREADSAFE;
+    }
+
+    if (!(ctx = flux_security_create (flags)))
         die ("flux_security_create");
     if (flux_security_configure (ctx, getenv ("FLUX_IMP_CONFIG_PATTERN")) < 0)
         die ("flux_security_configure: %s", flux_security_last_error (ctx));
 
     buflen = read_all (buf, sizeof (buf));
 
+    if (batch > 0) {
+        sign_batch (ctx, buf, buflen, batch);
+        flux_security_destroy (ctx);
+        return 0;
+    }
+
     if (!(msg = flux_sign_wrap (ctx, buf, buflen, NULL, 0)))
         die ("flux_sign_wrap: %s", flux_security_last_error (ctx));
 
     printf ("%s\n", msg);
 
+    if (argc == 2) {
+        struct sigcert *cert;
+
+        if (!(cert = sigcert_create ()))
+            die ("sigcert_create: %s", strerror (errno));
+        if (sigcert_store (cert, argv[1]) < 0)
+            die ("sigcert_store %s: %s", argv[1], strerror (errno));
+        sigcert_destroy (cert);
+
+        if (!(msg = flux_sign_wrap (ctx, buf, buflen, NULL, 0)))
+            die ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+
+        printf ("%s\n", msg);
+    }
+
     flux_security_destroy (ctx);
 
     return 0;
@@ -10,7 +10,12 @@
 
 /* verify.c - verify signed content on stdin
  *
- * Usage: verify <input >output
+ * Usage: verify [count] <input >output
+ *
+ * If 'count' is specified, unwrap the input that many times with the
+ * same context, and output the payload once.  If the input contains more
+ * than one line, each line is unwrapped in turn with the same context,
+ * and the payload of the last one is output.
  */
 
 #if HAVE_CONFIG_H
@@ -58,14 +63,20 @@ static int read_all (void *buf, int bufsz)
 int main (int argc, char **argv)
 {
     flux_security_t *ctx;
-    char buf[8192];
+    static char buf[65536];
     int buflen;
     int64_t userid;
     const char *payload;
     int payloadsz;
+    int count = 1;
+    int i;
+    char *line;
+    char *next;
 
-    if (argc != 1)
-        die ("Usage: verify <input >output");
+    if (argc > 2)
+        die ("Usage: verify [count] <input >output");
+    if (argc == 2 && (count = strtol (argv[1], NULL, 10)) <= 0)
+        die ("count must be a positive integer");
 
     if (!(ctx = flux_security_create (0)))
         die ("flux_security_create");
@@ -77,9 +88,15 @@ int main (int argc, char **argv)
     while (buflen > 0 && isspace (buf[buflen - 1]))
         buf[--buflen] = '\0';
 
-    if (flux_sign_unwrap (ctx, buf, (const void **)&payload, &payloadsz,
-                          &userid, 0) < 0)
-        die ("flux_sign_unwrap: %s", flux_security_last_error (ctx));
+    for (line = buf; line; line = next) {
+        if ((next = strchr (line, '\n')))
+            *next++ = '\0';
+        for (i = 0; i < count; i++) {
+            if (flux_sign_unwrap (ctx, line, (const void **)&payload,
+                                  &payloadsz, &userid, 0) < 0)
+                die ("flux_sign_unwrap: %s", flux_security_last_error (ctx));
+        }
+    }
 
     if (payload)
         fwrite (payload, payloadsz, 1, stdout);
@@ -0,0 +1,592 @@
+/************************************************************\
+ * Copyright 2018 Lawrence Livermore National Security, LLC
+ * (c.f. AUTHORS, NOTICE.LLNS, COPYING)
+ *
+ * This file is part of the Flux resource manager framework.
+ * For details, see https://github.com/flux-framework.
+ *
+ * SPDX-License-Identifier: LGPL-3.0
+\************************************************************/
+
+/* verifyclient.c - flux-security-verifyd client and benchmark
+ *
+ * Usage: verifyclient [-p] [-w window] path <input >output
+ *        verifyclient -b [-j] [-n count] [-w window] [-m mech]
+ *                     [-D verifyd] path
+ *
+ * In the first form, send each line of input as a J string to the
+ * daemon listening on 'path', with up to 'window' requests (default 64)
+ * in flight, and print one line per response:
+ *   userid mechanism offset len payloadsz [payload]
+ * where the payload is included with -p, or on failure:
+ *   error errnum message
+ *
+ * With -b, sign J once and report verify throughput and latency
+ * percentiles over 'count' verifies (default 1000) with a new context
+ * each time (as a one-shot tool like flux-imp does), with one warm
+ * context in this process, and through the daemon, both one request at
+ * a time and pipelined.  With -j, results are printed as one JSON object
+ * per line.
+ *
+ * The config is taken from FLUX_IMP_CONFIG_PATTERN if set.  Otherwise,
+ * with -b, a config allowing sign mechanism 'mech' (default none) is
+ * written to a temporary directory.  With -D, the 'verifyd' program is
+ * started on 'path' with that config, and stopped on exit.
+ *
+ * Run with 'make bench', passing options with VERIFYD_BENCH_FLAGS="...".
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+#include "src/lib/context.h"
+#include "src/lib/sign.h"
+#include "src/verifyd/verifyd_proto.h"
+
+const char *prog = "verifyclient";
+
+struct timer {
+    double *samples;    // nanoseconds
+    int count;
+    struct timespec t0;
+};
+
+struct response {
+    uint32_t id;
+    int errnum;
+    int64_t userid;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t payloadsz;
+    char mech[256];
+    const char *data;   // payload or error message, not NUL terminated
+    size_t datalen;
+};
+
+/* Buffered reader for responses.
+ */
+static char *rbuf;
+static size_t rbufsz;
+static size_t rlen;
+static size_t roff;
+
+static bool json;
+
+static void die (const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+
+    va_start (ap, fmt);
+    (void)vsnprintf (buf, sizeof (buf), fmt, ap);
+    va_end (ap);
+    fprintf (stderr, "%s: %s\n", prog, buf);
+    exit (1);
+}
+
+static void usage (void)
+{
+    fprintf (stderr, "Usage: verifyclient [-p] [-w window] path"
+                     " <input >output\n"
+                     "   or: verifyclient -b [-j] [-n count] [-w window]"
+                     " [-m mech] [-D verifyd] path\n");
+    exit (1);
+}
+
+static void timer_init (struct timer *t, int n)
+{
+    if (n < 1 || !(t->samples = calloc (n, sizeof (t->samples[0]))))
+        die ("out of memory");
+    t->count = 0;
+}
+
+static void timer_start (struct timer *t)
+{
+    clock_gettime (CLOCK_MONOTONIC, &t->t0);
+}
+
+static void timer_stop (struct timer *t)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t->samples[t->count++] = (t1.tv_sec - t->t0.tv_sec) * 1E9
+                           + (t1.tv_nsec - t->t0.tv_nsec);
+}
+
+static double elapsed (const struct timespec *t0)
+{
+    struct timespec t1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1E9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+static int sample_cmp (const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile (const struct timer *t, int p)
+{
+    return t->samples[(t->count - 1) * p / 100] / 1E3;
+}
+
+/* Print one line of results and free the samples.  If 'rate' is
+ * negative, report the inverse of mean latency as ops/sec.
+ */
+static void timer_report (struct timer *t, double rate, const char *name)
+{
+    double total = 0;
+    int i;
+
+    if (t->count == 0)
+        return;
+    for (i = 0; i < t->count; i++)
+        total += t->samples[i];
+    if (rate < 0)
+        rate = total > 0 ? t->count / (total / 1E9) : 0;
+    qsort (t->samples, t->count, sizeof (t->samples[0]), sample_cmp);
+    if (json)
+        printf ("{\"op\":\"%s\",\"count\":%d,\"ops_per_sec\":%.1f,"
+                "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+                "\"max_us\":%.1f}\n",
+                name, t->count, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    else
+        printf ("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+                name, rate,
+                percentile (t, 50),
+                percentile (t, 90),
+                percentile (t, 99),
+                percentile (t, 100));
+    free (t->samples);
+    t->samples = NULL;
+}
+
+static void put_be32 (char *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static uint32_t get_be32 (const char *s)
+{
+    const unsigned char *p = (const unsigned char *)s;
+
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void write_all (int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write (fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            die ("write: %s", strerror (errno));
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void send_request (int fd, uint32_t id, uint32_t flags,
+                          const char *J, size_t len)
+{
+    static char *buf;
+    static size_t bufsz;
+
+    if (len + 12 > bufsz) {
+        bufsz = len + 12;
+        if (!(buf = realloc (buf, bufsz)))
+            die ("out of memory");
+    }
+    put_be32 (buf, len + 8);
+    put_be32 (buf + 4, id);
+    put_be32 (buf + 8, flags);
+    memcpy (buf + 12, J, len);
+    write_all (fd, buf, len + 12);
+}
+
+/* Ensure at least 'need' unconsumed bytes are buffered.
+ */
+static void fill (int fd, size_t need)
+{
+    ssize_t n;
+
+    if (rlen - roff >= need)
+        return;
+    if (roff > 0) {
+        memmove (rbuf, rbuf + roff, rlen - roff);
+        rlen -= roff;
+        roff = 0;
+    }
+    if (need > rbufsz) {
+        rbufsz = need > 65536 ? need : 65536;
+        if (!(rbuf = realloc (rbuf, rbufsz)))
+            die ("out of memory");
+    }
+    while (rlen < need) {
+        if ((n = read (fd, rbuf + rlen, rbufsz - rlen)) < 0) {
+            if (errno == EINTR)
+                continue;
+            die ("read: %s", strerror (errno));
+        }
+        if (n == 0)
+            die ("verifyd closed the connection");
+        rlen += n;
+    }
+}
+
+/* Read the next response into 'resp', which remains valid until the
+ * next call.
+ */
+static void recv_response (int fd, struct response *resp)
+{
+    const char *p;
+    uint32_t len;
+
+    fill (fd, 4);
+    len = get_be32 (rbuf + roff);
+    if (len < 8)
+        die ("response has invalid length %u", (unsigned int)len);
+    fill (fd, 4 + len);
+    p = rbuf + roff + 4;
+    roff += 4 + len;
+
+    memset (resp, 0, sizeof (*resp));
+    resp->id = get_be32 (p);
+    resp->errnum = (int32_t)get_be32 (p + 4);
+    if (resp->errnum != 0) {
+        resp->data = p + 8;
+        resp->datalen = len - 8;
+        return;
+    }
+    if (len < 8 + 21 || len < 8 + 21 + (uint32_t)(unsigned char)p[28])
+        die ("response is truncated");
+    resp->userid = (int64_t)((uint64_t)get_be32 (p + 8) << 32
+                             | get_be32 (p + 12));
+    resp->offset = get_be32 (p + 16);
+    resp->len = get_be32 (p + 20);
+    resp->payloadsz = get_be32 (p + 24);
+    memcpy (resp->mech, p + 29, (unsigned char)p[28]);
+    resp->data = p + 29 + (unsigned char)p[28];
+    resp->datalen = len - 29 - (unsigned char)p[28];
+}
+
+static int sock_connect (const char *path, int retries)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen (path) >= sizeof (addr.sun_path))
+        die ("%s: socket path is too long", path);
+    strcpy (addr.sun_path, path);
+    for (;;) {
+        if ((fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+            die ("socket: %s", strerror (errno));
+        if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0)
+            break;
+        if (retries-- <= 0 || (errno != ENOENT && errno != ECONNREFUSED))
+            die ("connect %s: %s", path, strerror (errno));
+        close (fd);
+        usleep (10000);
+    }
+    return fd;
+}
+
+static void print_response (const struct response *resp)
+{
+    if (resp->errnum != 0)
+        printf ("error %d %.*s\n", resp->errnum,
+                (int)resp->datalen, resp->data);
+    else if (resp->datalen > 0)
+        printf ("%lld %s %u %u %u %.*s\n",
+                (long long)resp->userid, resp->mech,
+                (unsigned int)resp->offset,
+                (unsigned int)resp->len,
+                (unsigned int)resp->payloadsz,
+                (int)resp->datalen, resp->data);
+    else
+        printf ("%lld %s %u %u %u\n",
+                (long long)resp->userid, resp->mech,
+                (unsigned int)resp->offset,
+                (unsigned int)resp->len,
+                (unsigned int)resp->payloadsz);
+}
+
+/* Verify each line of stdin, keeping up to 'window' requests in flight.
+ */
+static void verify_lines (int fd, uint32_t flags, int window)
+{
+    char *line = NULL;
+    size_t linesz = 0;
+    ssize_t n;
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    struct response resp;
+
+    while ((n = getline (&line, &linesz, stdin)) >= 0) {
+        if (n > 0 && line[n - 1] == '\n')
+            line[--n] = '\0';
+        send_request (fd, sent++, flags, line, n);
+        if (sent - received >= (uint32_t)window) {
+            recv_response (fd, &resp);
+            if (resp.id != received++)
+                die ("response %u is out of order", (unsigned int)resp.id);
+            print_response (&resp);
+        }
+    }
+    while (received < sent) {
+        recv_response (fd, &resp);
+        if (resp.id != received++)
+            die ("response %u is out of order", (unsigned int)resp.id);
+        print_response (&resp);
+    }
+    free (line);
+}
+
+/* Write a config for 'mech' to 'dir' and return its path.
+ */
+static char *config_create (const char *dir, const char *mech)
+{
+    static char path[PATH_MAX + 1];
+    FILE *f;
+
+    if (snprintf (path, sizeof (path), "%s/sign.toml", dir) >= (int)sizeof (path))
+        die ("path buffer overflow");
+    if (!(f = fopen (path, "w")))
+        die ("%s: %s", path, strerror (errno));
+    fprintf (f, "[sign]\n"
+                "max-ttl = 3600\n"
+                "default-type = \"%s\"\n"
+                "allowed-types = [ \"%s\" ]\n",
+             mech, mech);
+    if (fclose (f) != 0)
+        die ("%s: %s", path, strerror (errno));
+    return path;
+}
+
+static flux_security_t *context_create (const char *pattern)
+{
+    flux_security_t *ctx;
+
+    if (!(ctx = flux_security_create (0)))
+        die ("flux_security_create: %s", strerror (errno));
+    if (flux_security_configure (ctx, pattern) < 0)
+        die ("flux_security_configure: %s", flux_security_last_error (ctx));
+    return ctx;
+}
+
+static pid_t daemon_start (const char *verifyd, const char *pattern,
+                           const char *path)
+{
+    pid_t pid;
+
+    if ((pid = fork ()) < 0)
+        die ("fork: %s", strerror (errno));
+    if (pid == 0) {
+        execl (verifyd, verifyd, "-c", pattern, "-s", path, NULL);
+        fprintf (stderr, "%s: %s: %s\n", prog, verifyd, strerror (errno));
+        _exit (127);
+    }
+    return pid;
+}
+
+static void daemon_stop (pid_t pid)
+{
+    int status;
+
+    if (kill (pid, SIGTERM) < 0)
+        die ("kill: %s", strerror (errno));
+    if (waitpid (pid, &status, 0) < 0)
+        die ("waitpid: %s", strerror (errno));
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        die ("verifyd failed (status=0x%x)", status);
+}
+
+static void bench (int fd, const char *pattern, int n, int window)
+{
+    flux_security_t *ctx;
+    const char *J;
+    size_t len;
+    struct timespec *sent;
+    struct timespec wall;
+    struct response resp;
+    struct timer t;
+    char name[64];
+    int i, j;
+
+    ctx = context_create (pattern);
+    if (!(J = flux_sign_wrap (ctx, "bench", 5, NULL, 0)))
+        die ("flux_sign_wrap: %s", flux_security_last_error (ctx));
+    len = strlen (J);
+
+    if (!json)
+        printf ("%-32s %10s %9s %9s %9s %9s\n",
+                "operation", "ops/sec",
+                "p50(us)", "p90(us)", "p99(us)", "max(us)");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        flux_security_t *c;
+        timer_start (&t);
+        c = context_create (pattern);
+        if (flux_sign_unwrap (c, J, NULL, NULL, NULL, 0) < 0)
+            die ("flux_sign_unwrap: %s", flux_security_last_error (c));
+        flux_security_destroy (c);
+        timer_stop (&t);
+    }
+    timer_report (&t, -1, "verify (new context)");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        if (flux_sign_unwrap (ctx, J, NULL, NULL, NULL, 0) < 0)
+            die ("flux_sign_unwrap: %s", flux_security_last_error (ctx));
+        timer_stop (&t);
+    }
+    timer_report (&t, -1, "verify (warm context)");
+
+    timer_init (&t, n);
+    for (i = 0; i < n; i++) {
+        timer_start (&t);
+        send_request (fd, i, 0, J, len);
+        recv_response (fd, &resp);
+        if (resp.errnum != 0)
+            die ("verifyd: %.*s", (int)resp.datalen, resp.data);
+        timer_stop (&t);
+    }
+    timer_report (&t, -1, "verifyd (serial)");
+
+    /* Latency of each pipelined request is from its send to its
+     * response, so it includes time queued behind earlier requests.
+     */
+    if (!(sent = calloc (n, sizeof (sent[0]))))
+        die ("out of memory");
+    timer_init (&t, n);
+    clock_gettime (CLOCK_MONOTONIC, &wall);
+    for (i = 0, j = 0; j < n; ) {
+        while (i < n && i - j < window) {
+            clock_gettime (CLOCK_MONOTONIC, &sent[i]);
+            send_request (fd, i++, 0, J, len);
+        }
+        recv_response (fd, &resp);
+        if (resp.errnum != 0)
+            die ("verifyd: %.*s", (int)resp.datalen, resp.data);
+        if (resp.id != (uint32_t)j)
+            die ("response %u is out of order", (unsigned int)resp.id);
+        t.samples[t.count++] = elapsed (&sent[j++]);
+    }
+    snprintf (name, sizeof (name), "verifyd (pipelined x%d)", window);
+    timer_report (&t, n / (elapsed (&wall) / 1E9), name);
+
+    free (sent);
+    flux_security_destroy (ctx);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *pattern = getenv ("FLUX_IMP_CONFIG_PATTERN");
+    const char *t = getenv ("TMPDIR");
+    const char *mech = "none";
+    const char *verifyd = NULL;
+    char tmpdir[PATH_MAX + 1] = "";
+    char *config = NULL;
+    uint32_t flags = 0;
+    bool bflag = false;
+    int window = 64;
+    int n = 1000;
+    pid_t pid = -1;
+    int fd;
+    int c;
+
+    while ((c = getopt (argc, argv, "pbjn:w:m:D:")) != -1) {
+        switch (c) {
+            case 'p':
+                flags |= VERIFYD_PAYLOAD;
+                break;
+            case 'b':
+                bflag = true;
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 'n':
+                if ((n = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'w':
+                if ((window = strtol (optarg, NULL, 10)) < 1)
+                    usage ();
+                break;
+            case 'm':
+                mech = optarg;
+                break;
+            case 'D':
+                verifyd = optarg;
+                break;
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 1)
+        usage ();
+
+    if (!pattern && (bflag || verifyd)) {
+        if (snprintf (tmpdir, sizeof (tmpdir), "%s/verifyclient-XXXXXX",
+                      t ? t : "/tmp") >= (int)sizeof (tmpdir))
+            die ("tmpdir buffer overflow");
+        if (!mkdtemp (tmpdir))
+            die ("mkdtemp: %s", strerror (errno));
+        pattern = config = config_create (tmpdir, mech);
+    }
+    if (verifyd)
+        pid = daemon_start (verifyd, pattern, argv[optind]);
+    fd = sock_connect (argv[optind], verifyd ? 500 : 0);
+
+    if (bflag)
+        bench (fd, pattern, n, window);
+    else
+        verify_lines (fd, flags, window);
+
+    close (fd);
+    if (pid > 0)
+        daemon_stop (pid);
+    if (config) {
+        (void)unlink (config);
+        (void)rmdir (tmpdir);
+    }
+    free (rbuf);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
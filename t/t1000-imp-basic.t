@@ -35,6 +35,18 @@ test_expect_success 'Bad IMP config generates error' '
 	  test_must_fail $flux_imp version 2>bad-config.error ) &&
 	grep "loading config: bad.toml: 1: syntax error" bad-config.error
 '
+test_expect_success 'flux-imp config-stats reports each config file' '
+	mkdir stats.d &&
+	echo "allow-sudo = true" > stats.d/a.toml &&
+	printf "[exec]\nallowed-users = []\n" > stats.d/b.toml &&
+	FLUX_IMP_CONFIG_PATTERN="stats.d/*.toml" \
+	  $flux_imp config-stats > config-stats.out &&
+	test_debug "cat config-stats.out" &&
+	grep "stats.d/\*.toml: 2 files, glob" config-stats.out &&
+	grep "stats.d/a.toml: 18 bytes, parse .*ms, merge .*ms" \
+	  config-stats.out &&
+	grep "stats.d/b.toml: 26 bytes, parse" config-stats.out
+'
 test_expect_success SUDO 'flux-imp version works under sudo' '
 	$SUDO $flux_imp version | grep "flux-imp v"
 '
@@ -110,6 +110,63 @@ test_expect_success 'CA cannot verify revoked cert' '
 	test_must_fail $ca verify u
 '
 
+test_expect_success 'imp casign --batch signs a stream of certs' '
+	$keygen b1 && $keygen b2 && $keygen b3 &&
+	for c in b1 b2 b3; do $certutil $c binary || return 1; done >batch.in &&
+	$flux_imp casign --batch <batch.in >batch.out &&
+	$ca verify-batch <batch.out >batch.userids &&
+	for i in 1 2 3; do id -u; done >batch.userids.exp &&
+	test_cmp batch.userids.exp batch.userids
+'
+
+test_expect_success 'imp casign --batch works on empty input' '
+	$flux_imp casign --batch </dev/null >batch.empty &&
+	test_must_be_empty batch.empty
+'
+
+test_expect_success 'imp casign --batch fails on truncated input' '
+	head -c 200 batch.in >batch.trunc &&
+	test_must_fail $flux_imp casign --batch <batch.trunc
+'
+
+test_expect_success 'imp casign --batch refuses other userid unless root' '
+	$keygen b4 &&
+	$certutil b4 put userid i:$(($(id -u)+1)) &&
+	$certutil b4 binary >batch.other &&
+	if test $(id -u) -eq 0; then
+		$flux_imp casign --batch <batch.other
+	else
+		test_must_fail $flux_imp casign --batch <batch.other
+	fi
+'
+
+test_expect_success 'keygen generates several certs at once' '
+	$keygen m1 m2 m3 &&
+	for c in m1 m2 m3; do test -f $c && test -f $c.pub || return 1; done &&
+	! cmp -s m1.pub m2.pub
+'
+
+test_expect_success 'ca sign-batch generates and signs certs in bulk' '
+	for i in 1 2 3 4 5; do echo "s$i $(id -u)"; done >sign-batch.in &&
+	$ca sign-batch <sign-batch.in &&
+	for i in 1 2 3 4 5; do $ca verify s$i || return 1; done \
+	    >sign-batch.out &&
+	for i in 1 2 3 4 5; do id -u; done >sign-batch.exp &&
+	test_cmp sign-batch.exp sign-batch.out
+'
+
+test_expect_success 'ca sign-batch works on empty input' '
+	$ca sign-batch </dev/null
+'
+
+test_expect_success 'ca sign-batch fails on malformed input' '
+	echo "s6 notanumber" | test_must_fail $ca sign-batch
+'
+
+test_expect_success 'imp casign fails on unknown argument' '
+	test_must_fail $flux_imp casign --foo <u.pub.unsigned
+'
+
 test_expect_success NO_ASAN 'imp casign fails on /dev/zero input' '
 	test_must_fail $flux_imp casign </dev/zero
 '
@@ -67,6 +67,33 @@ test_expect_success 'sign/verify a short message' '
 	test_cmp sign.in verify.out
 '
 
+test_expect_success 'verify the same message repeatedly' '
+	${verify} 5 <sign.out >verify5.out &&
+	test_cmp sign.in verify5.out
+'
+
+test_expect_success 'verify the same message repeatedly with cred-cache-size = 0' '
+	cp sign.toml sign.toml.orig &&
+	echo "cred-cache-size = 0" >>sign.toml &&
+	${verify} 5 <sign.out >verify5_nocache.out &&
+	test_cmp sign.in verify5_nocache.out
+'
+
+test_expect_success 'verify fails with negative cred-cache-size' '
+	cp sign.toml.orig sign.toml &&
+	echo "cred-cache-size = -1" >>sign.toml &&
+	test_must_fail ${verify} <sign.out 2>badcache.err &&
+	grep -q "cred-cache-size must be" badcache.err &&
+	cp sign.toml.orig sign.toml
+'
+
+test_expect_success 'sign/verify a batch signed in parallel' '
+	${sign} --batch=100 <sign.in >batch.out &&
+	test $(wc -l <batch.out) -eq 100 &&
+	${verify} <batch.out >batch_verify.out &&
+	test_cmp sign.in batch_verify.out
+'
+
 test_expect_success 'verify a hand-created test message' '
 	${xsign} good </dev/null >good.out &&
 	${verify} <good.out
@@ -99,6 +99,62 @@ test_expect_success 'sign/verify a short message' '
 	test_cmp sign.in verify.out
 '
 
+test_expect_success 'sign/verify a batch' '
+	${sign} --batch=40 <sign.in >batch.out &&
+	test $(wc -l <batch.out) -eq 40 &&
+	${verify} <batch.out >batch_verify.out &&
+	test_cmp sign.in batch_verify.out
+'
+
+test_expect_success 'sign with header-version = 2' '
+	config_sign >conf.d/sign.toml &&
+	echo "header-version = 2" >>conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	${sign} <sign.in >sign2.out &&
+	test $(wc -c <sign2.out) -lt $(wc -c <sign.out)
+'
+
+test_expect_success 'version 2 message fails verify with unknown cert' '
+	test_must_fail ${verify} <sign2.out 2>xsign2.err &&
+	grep -q "unknown cert fingerprint" xsign2.err
+'
+
+test_expect_success 'version 2 message verifies after version 1 from same cert' '
+	cat sign.out sign2.out | ${verify} >verify2.out &&
+	test_cmp sign.in verify2.out
+'
+
+test_expect_success 'version 2 message fails verify with cert-cache-size = 0' '
+	echo "cert-cache-size = 0" >>conf.d/sign.toml &&
+	cat sign.out sign2.out | test_must_fail ${verify} 2>xsign2nc.err &&
+	grep -q "unknown cert fingerprint" xsign2nc.err
+'
+
+test_expect_success 'sign with header-version = 3' '
+	config_sign >conf.d/sign.toml &&
+	echo "header-version = 3" >>conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	${sign} <sign.in >sign3.out
+'
+
+test_expect_success 'version 3 message verifies after version 1 from same cert' '
+	cat sign.out sign3.out | ${verify} >verify3.out &&
+	test_cmp sign.in verify3.out
+'
+
+test_expect_success 'sign fails with header-version = 4' '
+	config_sign >conf.d/sign.toml &&
+	echo "header-version = 4" >>conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	test_must_fail ${sign} <sign.in 2>xversion.err &&
+	grep -q "header-version must be" xversion.err
+'
+
+test_expect_success 'restore config' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml
+'
+
 test_expect_success 'switch to un-CA-signed cert' '
 	mv u.pub u.pub.signed &&
 	mv u.pub.unsigned u.pub
@@ -156,6 +212,55 @@ test_expect_success 'message with mech-specific header fails verify' '
 	grep -q "incomplete header" xheader.err
 '
 
+test_expect_success 'enable verify cache' '
+	config_sign >conf.d/sign.toml &&
+	echo "verify-cache-size = 4" >>conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml
+'
+
+test_expect_success 'repeated verify works with verify cache' '
+	${sign} <sign.in >cache.out &&
+	${verify} 10 <cache.out >cache-verify.out &&
+	test_cmp sign.in cache-verify.out
+'
+
+test_expect_success 'message with altered payload fails verify with cache' '
+	test_must_fail ${verify} 2 <xpaychg.out 2>xpaychg-cache.err &&
+	grep -q "verification failure" xpaychg-cache.err
+'
+
+test_expect_success 'message with past xtime fails verify with cache' '
+	test_must_fail ${verify} 2 <xxtime.out 2>xxtime-cache.err &&
+	grep -q "xtime or max-ttl exceeded" xxtime-cache.err
+'
+
+test_expect_success 'repeated verify works with cert cache only' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	${verify} 10 <cache.out >cert-cache-verify.out &&
+	test_cmp sign.in cert-cache-verify.out
+'
+
+test_expect_success 'message with wrong userid fails verify with cert cache' '
+	test_must_fail ${verify} 2 <xuser.out 2>xuser-cache.err &&
+	grep -q "ca: userid mismatch" xuser-cache.err
+'
+
+test_expect_success 'repeated verify works with cert-cache-size = 0' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	echo "cert-cache-size = 0" >>conf.d/sign.toml &&
+	${verify} 2 <cache.out
+'
+
+test_expect_success 'verify fails with negative cert-cache-size' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_ca >>conf.d/sign.toml &&
+	echo "cert-cache-size = -1" >>conf.d/sign.toml &&
+	test_must_fail ${verify} <cache.out 2>xcertcache.err &&
+	grep -q "cert-cache-size must be" xcertcache.err
+'
+
 test_expect_success 'drop [sign.curve] config' '
 	config_sign >conf.d/sign.toml
 '
@@ -243,6 +348,94 @@ test_expect_success 'sign/verify zero length payload using unsigned cert' '
 		LD_PRELOAD=${prelib} ${verify} <znoca.out
 '
 
+test_expect_success 'repeated verify works with cached home cert' '
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} 10 <znoca.out
+'
+
+test_expect_success 'repeated verify works with home-cert-ttl = 0' '
+	echo "home-cert-ttl = 0" >>conf.d/sign.toml &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} 2 <znoca.out
+'
+
+test_expect_success 'verify fails with negative home-cert-ttl' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml &&
+	echo "home-cert-ttl = -1" >>conf.d/sign.toml &&
+	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+	  LD_PRELOAD=${prelib} ${verify} <znoca.out 2>xhomettl.err &&
+	grep -q "home-cert-ttl is invalid" xhomettl.err
+'
+
+test_expect_success 'restore no CA config' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml
+'
+
+test_expect_success 'sign/verify version 2 message using unsigned cert' '
+	config_sign >conf.d/sign.toml &&
+	echo "header-version = 2" >>conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${sign} </dev/null >znoca2.out &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} 2 <znoca2.out
+'
+
+test_expect_success 'version 2 message verifies with home-cert-ttl = 0' '
+	echo "home-cert-ttl = 0" >>conf.d/sign.toml &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} 2 <znoca2.out
+'
+
+test_expect_success 'restore no CA config' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml
+'
+
+test_expect_success 'rotated signing cert is not used before cert-reload-interval' '
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${sign} testuser/.flux/curve/sig \
+		</dev/null >rotate.out &&
+	test $(wc -l <rotate.out) -eq 2 &&
+	head -1 rotate.out >rotate1.out &&
+	tail -1 rotate.out >rotate2.out &&
+	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+	  LD_PRELOAD=${prelib} ${verify} <rotate2.out
+'
+
+test_expect_success 'rotated signing cert is used with cert-reload-interval = 0' '
+	echo "cert-reload-interval = 0" >>conf.d/sign.toml &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${sign} testuser/.flux/curve/sig \
+		</dev/null >rotate.out &&
+	head -1 rotate.out >rotate1.out &&
+	tail -1 rotate.out >rotate2.out &&
+	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+	  LD_PRELOAD=${prelib} ${verify} <rotate1.out &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} <rotate2.out
+'
+
+test_expect_success 'sign fails with negative cert-reload-interval' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml &&
+	echo "cert-reload-interval = -1" >>conf.d/sign.toml &&
+	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+	  LD_PRELOAD=${prelib} ${sign} </dev/null 2>xreload.err &&
+	grep -q "cert-reload-interval is invalid" xreload.err
+'
+
+test_expect_success 'restore no CA config and re-sign' '
+	config_sign >conf.d/sign.toml &&
+	config_sign_curve_noca >>conf.d/sign.toml &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${sign} </dev/null >znoca.out &&
+	TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+		LD_PRELOAD=${prelib} ${verify} <znoca.out
+'
+
 test_expect_success 'verify fails after home cert is changed' '
 	${keygen} testuser/.flux/curve/sig &&
 	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
@@ -250,6 +443,12 @@ test_expect_success 'verify fails after home cert is changed' '
 	grep -q "cert verification failed" xznoca.err
 '
 
+test_expect_success 'version 2 message fails verify after home cert is changed' '
+	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
+	  LD_PRELOAD=${prelib} ${verify} <znoca2.out 2>xznoca2.err &&
+	grep -q "cert verification failed" xznoca2.err
+'
+
 test_expect_success 'verify fails after home cert is removed' '
 	rm testuser/.flux/curve/sig testuser/.flux/curve/sig.pub &&
 	! TEST_PASSWD_FILE=${SHARNESS_TRASH_DIRECTORY}/passwd \
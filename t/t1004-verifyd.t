@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+
+test_description='flux-security-verifyd tests
+
+Verify J strings through the verify daemon, with requests pipelined
+on one connection.
+'
+
+# Append --logfile option if FLUX_TESTS_LOGFILE is set in environment:
+test -n "$FLUX_TESTS_LOGFILE" && set -- "$@" --logfile
+. `dirname $0`/sharness.sh
+
+verifyd=${SHARNESS_BUILD_DIRECTORY}/src/verifyd/flux-security-verifyd
+verifyclient=${SHARNESS_BUILD_DIRECTORY}/t/src/verifyclient
+sign=${SHARNESS_BUILD_DIRECTORY}/t/src/sign
+
+echo "# Using ${verifyd}"
+
+export FLUX_IMP_CONFIG_PATTERN=${SHARNESS_TRASH_DIRECTORY}/sign.toml
+
+# N.B. use a relative socket path, since the trash directory path may
+# be too long for a UNIX domain socket address.
+sock=verifyd.sock
+
+test_expect_success 'create sign config' '
+	cat <<-EOF >sign.toml
+	[sign]
+	max-ttl = 30
+	default-type = "none"
+	allowed-types = [ "none" ]
+	EOF
+'
+test_expect_success 'verifyd fails with no socket path' '
+	test_must_fail $verifyd
+'
+test_expect_success 'verifyd fails with bad config' '
+	test_must_fail $verifyd -c /nonexistent/*.toml -s $sock
+'
+test_expect_success 'create J strings' '
+	printf hello | $sign >J1 &&
+	printf "" | $sign >J2 &&
+	cat J1 J2 J1 >good.in
+'
+test_expect_success 'verifyd returns userid, mechanism and payload size' '
+	$verifyclient -D $verifyd $sock <good.in >good.out &&
+	test_debug "cat good.out" &&
+	test $(wc -l <good.out) -eq 3 &&
+	grep "^$(id -u) none [0-9]* 8 5$" good.out &&
+	grep "^$(id -u) none [0-9]* 0 0$" good.out
+'
+test_expect_success 'payload offset and length locate PAYLOAD field in J' '
+	set -- $(head -1 good.out) &&
+	cut -c$(($3+1))-$(($3+$4)) J1 >field.out &&
+	cut -d. -f2 J1 >field.expected &&
+	test_cmp field.expected field.out
+'
+test_expect_success 'verifyd returns payload on request' '
+	$verifyclient -p -D $verifyd $sock <good.in >payload.out &&
+	test_debug "cat payload.out" &&
+	test $(grep -c " hello$" payload.out) -eq 2
+'
+test_expect_success 'verifyd returns errors in request order' '
+	(cat J1; echo garbage; echo; cat J2) >mixed.in &&
+	$verifyclient -D $verifyd $sock <mixed.in >mixed.out &&
+	test_debug "cat mixed.out" &&
+	test $(wc -l <mixed.out) -eq 4 &&
+	head -1 mixed.out | grep "^$(id -u) none " &&
+	sed -n 2p mixed.out | grep "^error 22 " &&
+	sed -n 3p mixed.out | grep "^error 22 " &&
+	tail -1 mixed.out | grep "^$(id -u) none "
+'
+test_expect_success 'verifyd handles many pipelined requests' '
+	for i in $(seq 1 500); do cat J1; done >many.in &&
+	$verifyclient -w 100 -D $verifyd $sock <many.in >many.out &&
+	test $(grep -c "^$(id -u) none " many.out) -eq 500
+'
+test_expect_success 'verifyd removes its socket on exit' '
+	test_must_fail test -e $sock
+'
+test_expect_success 'verifyclient -b reports daemon and in-process verify' '
+	$verifyclient -b -n 100 -w 8 -D $verifyd $sock >bench.out &&
+	test_debug "cat bench.out" &&
+	grep "^verify (new context) " bench.out &&
+	grep "^verify (warm context) " bench.out &&
+	grep "^verifyd (serial) " bench.out &&
+	grep "^verifyd (pipelined x8) " bench.out
+'
+test_expect_success 'verifyclient -b -j prints one JSON object per line' '
+	$verifyclient -b -j -n 10 -D $verifyd $sock >bench.json &&
+	test_debug "cat bench.json" &&
+	test $(grep -c "^{\"op\":\".*\",\"count\":10,.*}$" bench.json) -eq 4
+'
+test_done
@@ -87,6 +87,46 @@ test_expect_success 'flux-imp exec works in unprivileged mode if configured' '
 	EOF
 	test_cmp works.expected works.out
 '
+test_expect_success 'flux-imp exec emits phase trace if configured' '
+	sed "s/^\[sign\]/trace = true\n&/" sign-none.toml >sign-none-trace.toml &&
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none-trace.toml  &&
+	  fake_imp_input foo | \
+	    $flux_imp exec echo good >trace.out 2>trace.log
+	) &&
+	test_cmp works.expected trace.out &&
+	test_debug "cat trace.log" &&
+	grep "trace: pid=[0-9]* cmd=exec start=" trace.log &&
+	grep "imp_conf_load=.*sec_init=.*flux_sign_unwrap=.*execvp=" trace.log
+'
+test_expect_success 'flux-imp exec does not trace by default' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  fake_imp_input foo | \
+	    $flux_imp exec echo good >notrace.out 2>notrace.log
+	) &&
+	test_must_fail grep "trace:" notrace.log
+'
+test_expect_success 'flux-imp exec runs allowed shell by absolute path' '
+	cat >shell.sh <<-EOF &&
+	#!/bin/sh
+	echo shell \$1
+	EOF
+	chmod +x shell.sh &&
+	sed "s|\"echo\" ]|\"echo\", \"$(pwd)/shell.sh\", \"$(pwd)/noexec.sh\" ]|" \
+	    sign-none.toml >sign-none-path.toml &&
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none-path.toml  &&
+	  fake_imp_input foo | $flux_imp exec $(pwd)/shell.sh good >path.out
+	) &&
+	echo shell good >path.expected &&
+	test_cmp path.expected path.out
+'
+test_expect_success 'flux-imp exec fails with 126 for non-executable shell' '
+	cp shell.sh noexec.sh &&
+	chmod -x noexec.sh &&
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none-path.toml  &&
+	  fake_imp_input foo | \
+	    test_expect_code 126 $flux_imp exec $(pwd)/noexec.sh good
+	)
+'
 test_expect_success 'flux-imp exec fails when signature type not allowed' '
 	( export FLUX_IMP_CONFIG_PATTERN=./sign-none-allowed-munge.toml  &&
 	  fake_imp_input foo | \
@@ -117,6 +157,71 @@ test_expect_success 'flux-imp exec: shell must be in allowed users' '
 	) &&
 	grep -i "not in allowed-users list" nousers.log
 '
+fake_batch_input() {
+	printf '[{"J":"%s","shell":"echo","arg":"one"},' $(echo $1 | $sign)
+	printf '{"J":"%s","shell":"echo","arg":"two"}]' $(echo $1 | $sign)
+}
+test_expect_success 'flux-imp exec --batch works in unprivileged mode' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  fake_batch_input foo | $flux_imp exec --batch >batch.out
+	) &&
+	sort batch.out >batch.sorted &&
+	cat >batch.expected <<-EOF &&
+	one
+	two
+	EOF
+	test_cmp batch.expected batch.sorted
+'
+test_expect_success 'flux-imp exec --batch requires a JSON array' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  fake_imp_input foo | \
+	    test_must_fail $flux_imp exec --batch >batch-noarray.log 2>&1
+	) &&
+	grep "batch must be an array" batch-noarray.log
+'
+test_expect_success 'flux-imp exec --batch starts nothing if any J is bad' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  printf "[{\"J\":\"%s\",\"shell\":\"echo\",\"arg\":\"one\"},\
+	           {\"J\":\"foo\",\"shell\":\"echo\",\"arg\":\"two\"}]" \
+	           $(echo foo | $sign) | \
+	    test_must_fail $flux_imp exec --batch >batch-badsig.out 2>batch-badsig.log
+	) &&
+	grep "signature validation failed" batch-badsig.log &&
+	test_must_be_empty batch-badsig.out
+'
+test_expect_success 'flux-imp exec --batch checks allowed-shells' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  printf "[{\"J\":\"%s\",\"shell\":\"printf\",\"arg\":\"x\"}]" \
+	           $(echo foo | $sign) | \
+	    test_must_fail $flux_imp exec --batch >batch-badshell.log 2>&1
+	) &&
+	grep "not in allowed-shells" batch-badshell.log
+'
+test_expect_success 'flux-imp exec --batch rejects too many jobs' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  J=$(echo foo | $sign) &&
+	  printf "[" >batch-big.json &&
+	  for i in $(seq 1024); do
+	    printf "{\"J\":\"%s\",\"shell\":\"echo\",\"arg\":\"x\"}," \
+	           $J >>batch-big.json
+	  done &&
+	  printf "{\"J\":\"%s\",\"shell\":\"echo\",\"arg\":\"x\"}]" \
+	         $J >>batch-big.json &&
+	  test_must_fail $flux_imp exec --batch <batch-big.json \
+	    >batch-big.out 2>batch-big.log
+	) &&
+	grep "at most 1024 jobs" batch-big.log &&
+	test_must_be_empty batch-big.out
+'
+test_expect_success SUDO 'flux-imp exec --batch works under sudo' '
+	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml  &&
+	  fake_batch_input foo | \
+	    $SUDO FLUX_IMP_CONFIG_PATTERN=sign-none.toml \
+	      $flux_imp exec --batch >batch-sudo.out
+	) &&
+	sort batch-sudo.out >batch-sudo.sorted &&
+	test_cmp batch.expected batch-sudo.sorted
+'
 test_expect_success SUDO 'flux-imp exec: user must be in allowed-shells' '
 	( export FLUX_IMP_CONFIG_PATTERN=sign-none.toml &&
 	  fake_imp_input foo | \
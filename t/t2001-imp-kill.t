@@ -26,6 +26,32 @@ test_expect_success 'flux-imp kill: returns error with pid=0' '
 test_expect_success 'flux-imp kill: returns error with invalid signal' '
 	test_must_fail $flux_imp kill -15 0
 '
+test_expect_success 'flux-imp kill: returns error with pid=0 in list' '
+	test_must_fail $flux_imp kill 15 1234 0 >pidlist.log 2>&1 &&
+	grep "invalid PID 0" pidlist.log
+'
+test_expect_success 'flux-imp kill --cgroup: requires SIGNAL and PATH' '
+	test_must_fail $flux_imp kill --cgroup 15
+'
+test_expect_success 'flux-imp kill --cgroup: requires absolute path' '
+	test_must_fail $flux_imp kill --cgroup 15 foo >cgrelpath.log 2>&1 &&
+	grep "cgroup path must be absolute" cgrelpath.log
+'
+test_expect_success 'flux-imp kill --cgroup: refuses non-cgroup directory' '
+	name=cgroup-notcgroup &&
+	cat <<-EOF >${name}.toml &&
+	[exec]
+	allowed-users = [ "$(whoami)" ]
+	EOF
+	mkdir fakecg &&
+	echo $$ >fakecg/cgroup.procs &&
+	( export FLUX_IMP_CONFIG_PATTERN=${name}.toml &&
+	  test_must_fail $flux_imp kill --cgroup 15 $(pwd)/fakecg \
+	    >${name}.log 2>&1
+	) &&
+	test_debug "cat ${name}.log" &&
+	grep "not a cgroup" ${name}.log
+'
 test_expect_success 'flux-imp kill: checks exec.allowed-users' '
 	name=wronguser &&
 	cat <<-EOF >${name}.toml &&
@@ -110,5 +136,38 @@ test_expect_success SUDO,SYSTEMD_CGROUP 'flux-imp kill: fails for nonexistent pi
 	test_debug "cat ${name}.log" &&
 	grep "No such file or directory"  ${name}.log
 '
+test_expect_success NO_CHAIN_LINT,SYSTEMD_CGROUP 'flux-imp kill: signals multiple pids' '
+	name=allowed-user
+	cat <<-EOF >${name}.toml
+	[exec]
+	allowed-users = [ "$(whoami)" ]
+	EOF
+	sleep 300 &
+	pid1=$!
+	sleep 300 &
+	pid2=$!
+	FLUX_IMP_CONFIG_PATTERN=${name}.toml \
+	    $flux_imp kill 15 $pid1 $pid2 >${name}.log 2>&1 &&
+	test_debug "cat ${name}.log" &&
+	test_expect_code 143 wait $pid1 &&
+	test_expect_code 143 wait $pid2
+'
+test_expect_success NO_CHAIN_LINT,SYSTEMD_CGROUP 'flux-imp kill: signals remaining pids if one fails' '
+	name=allowed-user
+	cat <<-EOF >${name}.toml
+	[exec]
+	allowed-users = [ "$(whoami)" ]
+	EOF
+	for badpid in `seq 10000 12000`; do
+            kill -s 0 ${badpid} >/dev/null 2>&1 || break
+        done
+	sleep 300 & pid=$! &&
+	( export FLUX_IMP_CONFIG_PATTERN=${name}.toml &&
+	    test_must_fail $flux_imp kill 15 $badpid $pid >${name}.log 2>&1
+	) &&
+	test_debug "cat ${name}.log" &&
+	grep "No such file or directory" ${name}.log &&
+	test_expect_code 143 wait $pid
+'
 
 test_done
@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+
+test_description='IMP service basic functionality test
+
+Basic flux-imp service functionality and corner case handling tests
+'
+
+# Append --logfile option if FLUX_TESTS_LOGFILE is set in environment:
+test -n "$FLUX_TESTS_LOGFILE" && set -- "$@" --logfile
+. `dirname $0`/sharness.sh
+
+flux_imp=${SHARNESS_BUILD_DIRECTORY}/src/imp/flux-imp
+sign=${SHARNESS_BUILD_DIRECTORY}/t/src/sign
+impclient=${SHARNESS_BUILD_DIRECTORY}/t/src/impclient
+
+echo "# Using ${flux_imp}"
+
+#  AF_UNIX socket paths are limited in length, so use a short
+#   temporary directory instead of the trash directory.
+sockdir=$(mktemp -d /tmp/imp-service.XXXXXX)
+sock=$sockdir/imp.sock
+
+test_expect_success 'create configs for flux-imp service' '
+	cat <<-EOF >no-service.toml &&
+	[sign]
+	max-ttl = 30
+	default-type = "none"
+	allowed-types = [ "none" ]
+	[exec]
+	allowed-users = [ "$(whoami)" ]
+	allowed-shells = [ "echo", "false", "printenv" ]
+	allow-unprivileged-exec = true
+	EOF
+	sed "s/^\[exec\]/&\nallow-service = true/" no-service.toml >service.toml
+'
+test_expect_success 'flux-imp service fails if not enabled' '
+	( export FLUX_IMP_CONFIG_PATTERN=no-service.toml &&
+	  test_must_fail $flux_imp service $sock >noservice.log 2>&1
+	) &&
+	grep "not enabled in configuration" noservice.log
+'
+test_expect_success 'flux-imp service requires SOCKET argument' '
+	( export FLUX_IMP_CONFIG_PATTERN=service.toml &&
+	  test_must_fail $flux_imp service
+	)
+'
+test_expect_success 'flux-imp service requires absolute SOCKET path' '
+	( export FLUX_IMP_CONFIG_PATTERN=service.toml &&
+	  test_must_fail $flux_imp service imp.sock >relpath.log 2>&1
+	) &&
+	grep "must be an absolute path" relpath.log
+'
+test_expect_success 'start flux-imp service in unprivileged mode' '
+	( export FLUX_IMP_CONFIG_PATTERN=service.toml &&
+	  export IMP_SERVICE_ONLY=service &&
+	  $flux_imp service $sock >service.log 2>&1 &
+	  echo $! >service.pid
+	) &&
+	for i in $(seq 1 50); do test -S $sock && break; sleep 0.1; done &&
+	test -S $sock
+'
+test_expect_success 'flux-imp service: exec works' '
+	J=$(echo foo | FLUX_IMP_CONFIG_PATTERN=service.toml $sign) &&
+	$impclient $sock exec $J echo good >works.out &&
+	echo good >works.expected &&
+	test_cmp works.expected works.out
+'
+test_expect_success 'flux-imp service: job shell exit code is returned' '
+	J=$(echo foo | FLUX_IMP_CONFIG_PATTERN=service.toml $sign) &&
+	test_expect_code 1 $impclient $sock exec $J false x
+'
+test_expect_success 'flux-imp service: job shell gets requestor environment' '
+	J=$(echo foo | FLUX_IMP_CONFIG_PATTERN=service.toml $sign) &&
+	IMP_REQUESTOR=requestor \
+	    $impclient $sock exec $J printenv IMP_REQUESTOR >env.out &&
+	echo requestor >env.expected &&
+	test_cmp env.expected env.out
+'
+test_expect_success 'flux-imp service: job shell does not get service environment' '
+	J=$(echo foo | FLUX_IMP_CONFIG_PATTERN=service.toml $sign) &&
+	test_expect_code 1 \
+	    $impclient $sock exec $J printenv IMP_SERVICE_ONLY >noenv.out &&
+	test_must_be_empty noenv.out
+'
+test_expect_success 'flux-imp service: shell must be in allowed-shells' '
+	J=$(echo foo | FLUX_IMP_CONFIG_PATTERN=service.toml $sign) &&
+	test_must_fail $impclient $sock exec $J printf good >badshell.log 2>&1 &&
+	grep "not in allowed-shells" badshell.log
+'
+test_expect_success 'flux-imp service: bad signature is rejected' '
+	test_must_fail $impclient $sock exec foo echo good >badsig.log 2>&1 &&
+	grep "signature validation failed" badsig.log
+'
+test_expect_success 'flux-imp service: still running after failed requests' '
+	kill -0 $(cat service.pid)
+'
+test_expect_success 'flux-imp service: exits and removes socket on SIGTERM' '
+	kill -TERM $(cat service.pid) &&
+	for i in $(seq 1 50); do test -S $sock || break; sleep 0.1; done &&
+	test_must_fail test -S $sock &&
+	grep "service: exiting" service.log
+'
+rm -rf $sockdir
+test_done
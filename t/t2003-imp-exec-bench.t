@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+
+test_description='IMP exec launch benchmark harness test
+
+Run the flux-imp exec launch benchmark with a few launches, to ensure
+that it works and reports per-phase latency.
+'
+
+# Append --logfile option if FLUX_TESTS_LOGFILE is set in environment:
+test -n "$FLUX_TESTS_LOGFILE" && set -- "$@" --logfile
+. `dirname $0`/sharness.sh
+
+flux_imp=${SHARNESS_BUILD_DIRECTORY}/src/imp/flux-imp
+implaunch=${SHARNESS_BUILD_DIRECTORY}/t/src/implaunch
+
+echo "# Using ${flux_imp}"
+
+test_expect_success 'implaunch fails with no flux-imp argument' '
+	test_must_fail $implaunch
+'
+test_expect_success 'implaunch fails with bad launcher count' '
+	test_must_fail $implaunch -p 0 $flux_imp
+'
+test_expect_success 'implaunch fails if flux-imp exec fails' '
+	test_must_fail $implaunch -n 1 -s /bin/false /nonexistent 2>fail.err &&
+	test_debug "cat fail.err" &&
+	grep "failed" fail.err
+'
+test_expect_success 'implaunch runs flux-imp exec with a generated config' '
+	unset FLUX_IMP_CONFIG_PATTERN &&
+	$implaunch -n 4 -d $(pwd) $flux_imp >launch.out &&
+	test_debug "cat launch.out" &&
+	grep "^launch x1 " launch.out &&
+	grep "^imp_conf_load " launch.out &&
+	grep "^flux_sign_unwrap " launch.out &&
+	grep "^execvp " launch.out
+'
+test_expect_success 'implaunch runs parallel launchers' '
+	$implaunch -n 4 -p 3 -d $(pwd) $flux_imp >launch-par.out &&
+	test_debug "cat launch-par.out" &&
+	grep "^launch x3 " launch-par.out
+'
+test_expect_success 'implaunch -j prints one JSON object per line' '
+	$implaunch -j -n 2 -d $(pwd) $flux_imp >launch.json &&
+	test_debug "cat launch.json" &&
+	grep "^{\"op\":\"launch x1\",\"count\":2," launch.json &&
+	test $(grep -c "^{.*}$" launch.json) -eq $(wc -l <launch.json)
+'
+test_expect_success 'implaunch uses FLUX_IMP_CONFIG_PATTERN if set' '
+	cat <<-EOF >notrace.toml &&
+	allow-sudo = true
+	[sign]
+	max-ttl = 30
+	default-type = "none"
+	allowed-types = [ "none" ]
+	[exec]
+	allowed-users = [ "$(whoami)" ]
+	allowed-shells = [ "/bin/true" ]
+	allow-unprivileged-exec = true
+	EOF
+	FLUX_IMP_CONFIG_PATTERN=notrace.toml \
+	    $implaunch -n 2 $flux_imp >launch-notrace.out &&
+	test_debug "cat launch-notrace.out" &&
+	grep "^launch x1 " launch-notrace.out &&
+	test_must_fail grep "^imp_conf_load " launch-notrace.out
+'
+test_expect_success SUDO,NO_ASAN 'implaunch -S runs flux-imp exec under sudo' '
+	$implaunch -S -n 2 -d $(pwd) $flux_imp >launch-sudo.out &&
+	test_debug "cat launch-sudo.out" &&
+	grep "^launch x1 " launch-sudo.out
+'
+test_done